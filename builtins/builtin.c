@@ -36,7 +36,14 @@ CHAR strBuiltinHelpText[] =
         "\n"
         "Executes a command explicitly as a builtin.\n"
         "\n"
-        "BUILTIN [-license] <cmd>\n";
+        "BUILTIN [-license] <cmd>\n"
+        "BUILTIN -m\n"
+        "\n"
+        "   -m             Display modules loaded by the shell\n"
+        "\n"
+        "Modules that are no longer in use remain loaded so they can be executed\n"
+        "again quickly.  The number of these retained is specified by the\n"
+        "YORIMODULECACHE environment variable, and zero disables retention.\n";
 
 /**
  Display usage text to the user.
@@ -52,6 +59,38 @@ BuiltinHelp()
     return TRUE;
 }
 
+/**
+ Display the modules currently loaded by the shell, along with the time
+ taken to load each and the number of times each has been used.
+
+ @return ExitCode, zero for success, nonzero for failure.
+ */
+DWORD
+BuiltinDisplayModules(VOID)
+{
+    YORI_STRING ModuleName;
+    DWORD Index;
+    DWORD ReferenceCount;
+    DWORD UseCount;
+    DWORD LoadTime;
+    LPTSTR State;
+
+    YoriLibInitEmptyString(&ModuleName);
+    Index = 0;
+    while (YoriCallGetModuleInformation(Index, &ModuleName, &ReferenceCount, &UseCount, &LoadTime)) {
+        if (ReferenceCount == 0) {
+            State = _T("cached");
+        } else {
+            State = _T("active");
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%6i.%03i ms %8i uses  %s  %y\n"), LoadTime / 1000, LoadTime % 1000, UseCount, State, &ModuleName);
+        Index++;
+    }
+    YoriCallFreeYoriString(&ModuleName);
+
+    return EXIT_SUCCESS;
+}
+
 /**
  Yori shell invoke a command explicitly as a builtin
 
@@ -73,6 +112,7 @@ YoriCmd_BUILTIN(
     YORI_STRING CmdLine;
     DWORD i;
     DWORD StartArg = 0;
+    BOOL DisplayModules = FALSE;
     YORI_STRING Arg;
 
     YoriLibLoadNtDllFunctions();
@@ -91,6 +131,9 @@ YoriCmd_BUILTIN(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("license")) == 0) {
                 YoriLibDisplayMitLicense(_T("2017-2018"));
                 return EXIT_SUCCESS;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("m")) == 0) {
+                DisplayModules = TRUE;
+                ArgumentUnderstood = TRUE;
             }
         } else {
             ArgumentUnderstood = TRUE;
@@ -103,6 +146,10 @@ YoriCmd_BUILTIN(
         }
     }
 
+    if (DisplayModules && StartArg == 0) {
+        return BuiltinDisplayModules();
+    }
+
     if (StartArg == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("builtin: missing argument\n"));
         return EXIT_FAILURE;
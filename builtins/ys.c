@@ -208,6 +208,24 @@ typedef struct _YS_ARGUMENT_CONTEXT {
 
 } YS_ARGUMENT_CONTEXT, *PYS_ARGUMENT_CONTEXT;
 
+/**
+ The location of a reference to a script argument, such as %1%, within a
+ line.
+ */
+typedef struct _YS_VARIABLE_SPAN {
+
+    /**
+     The offset of the opening percent character within the line.
+     */
+    DWORD Offset;
+
+    /**
+     The length of the reference, including both percent characters.
+     */
+    DWORD Length;
+
+} YS_VARIABLE_SPAN, *PYS_VARIABLE_SPAN;
+
 /**
  Information about a single line within a Yori script.
  */
@@ -223,6 +241,66 @@ typedef struct _YS_SCRIPT_LINE {
      */
     YORI_STRING LineContents;
 
+    /**
+     The entry for this line within the label table of the script.  This is
+     only meaningful if LabelInserted is TRUE.
+     */
+    YORI_HASH_ENTRY LabelHashEntry;
+
+    /**
+     TRUE if the line is a command to execute, FALSE if it is empty or is a
+     label.
+     */
+    BOOLEAN Executable;
+
+    /**
+     An array of script argument references within the line, in the order
+     they occur.  This is NULL if the line contains no argument references,
+     or if the references could not be located ahead of time, in which case
+     the whole line is expanded each time it executes.
+     */
+    PYS_VARIABLE_SPAN VariableSpans;
+
+    /**
+     The number of elements in the VariableSpans array.
+     */
+    DWORD VariableSpanCount;
+
+    /**
+     The line as parsed by the shell, so that executing it again doesn't
+     need to parse it again.  This is NULL if the line has not been parsed,
+     or if the shell could not parse it ahead of execution, in which case
+     the line is executed as a string.
+     */
+    PVOID ParsedExpression;
+
+    /**
+     For lines containing argument references, the text that
+     ParsedExpression was parsed from after substituting arguments.  The
+     line only needs to be parsed again if substituting arguments results
+     in different text.
+     */
+    YORI_STRING ParsedText;
+
+    /**
+     TRUE if the line contains a variable reference that needs to be
+     expanded before execution.  Lines without any variable references are
+     passed to the shell without being copied.
+     */
+    BOOLEAN ContainsVariables;
+
+    /**
+     TRUE if the line is a label and has been inserted into the label table.
+     */
+    BOOLEAN LabelInserted;
+
+    /**
+     TRUE if an attempt has been made to parse the line (or for lines with
+     argument references, the text in ParsedText.)  ParsedExpression
+     describes the result.
+     */
+    BOOLEAN ParseAttempted;
+
 } YS_SCRIPT_LINE, *PYS_SCRIPT_LINE;
 
 /**
@@ -259,11 +337,18 @@ typedef struct _YS_CALL_STACK {
 
 } YS_CALL_STACK, *PYS_CALL_STACK;
 
-
 /**
- A structure describing a Yori script.
+ A script that has been loaded and analyzed.  Compiled scripts are retained
+ between invocations so that executing the same script again does not need
+ to reload it, provided the file has not changed.
  */
-typedef struct _YS_SCRIPT {
+typedef struct _YS_COMPILED_SCRIPT {
+
+    /**
+     The entry for this script within the list of cached scripts.  This is
+     only meaningful if Cached is TRUE.
+     */
+    YORI_LIST_ENTRY CacheLinks;
 
     /**
      A linked list of lines within the script.
@@ -271,15 +356,62 @@ typedef struct _YS_SCRIPT {
     YORI_LIST_ENTRY LineLinks;
 
     /**
-     A linked list of call context information.
+     A hash table of labels within the script, pointing to the line
+     containing each label.
      */
-    YORI_LIST_ENTRY CallStackLinks;
+    PYORI_HASH_TABLE Labels;
 
     /**
-     File name string.
+     The fully qualified file name of the script.
      */
     YORI_STRING FileName;
 
+    /**
+     The last write time of the file when it was loaded.
+     */
+    FILETIME LastWriteTime;
+
+    /**
+     The size of the file when it was loaded.
+     */
+    LARGE_INTEGER FileSize;
+
+    /**
+     TRUE if the script is in the list of cached scripts.
+     */
+    BOOLEAN Cached;
+
+    /**
+     TRUE if the script is currently executing.  A script that is executing
+     cannot be used by another invocation (ie., a script that executes
+     itself), since the other invocation needs its own active line.
+     */
+    BOOLEAN InUse;
+
+    /**
+     TRUE if the lines of the script have been changed while executing,
+     which happens when another script is included.  A modified script no
+     longer reflects the file and is discarded after it executes.
+     */
+    BOOLEAN Modified;
+
+} YS_COMPILED_SCRIPT, *PYS_COMPILED_SCRIPT;
+
+/**
+ A structure describing an executing Yori script.
+ */
+typedef struct _YS_SCRIPT {
+
+    /**
+     The compiled lines of the script.
+     */
+    PYS_COMPILED_SCRIPT Compiled;
+
+    /**
+     A linked list of call context information.
+     */
+    YORI_LIST_ENTRY CallStackLinks;
+
     /**
      Pointer to the active line within the script.  This can be moved during
      execution via goto or similar.
@@ -306,6 +438,261 @@ typedef struct _YS_SCRIPT {
  */
 PYS_SCRIPT YsActiveScript = NULL;
 
+/**
+ The maximum number of compiled scripts to retain between invocations.
+ */
+#define YS_SCRIPT_CACHE_MAX 16
+
+/**
+ The number of buckets in the label table of each script.
+ */
+#define YS_LABEL_HASH_BUCKETS 31
+
+/**
+ A list of compiled scripts retained between invocations, with the most
+ recently used script first.
+ */
+YORI_LIST_ENTRY YsScriptCache;
+
+/**
+ The number of scripts in the list of compiled scripts.
+ */
+DWORD YsScriptCacheCount;
+
+/**
+ Set to TRUE once an unload routine has been registered to free the list of
+ compiled scripts.
+ */
+BOOL YsScriptCacheUnloadRegistered;
+
+/**
+ Returns TRUE if a variable name refers to something that is substituted by
+ the script, as opposed to an environment variable that is left for the
+ shell to expand.  This must match the names handled by
+ @ref YsExpandArgumentVariables .
+
+ @param VariableName The name of the variable, without percent characters.
+
+ @return TRUE if the variable is substituted by the script, FALSE if it is
+         not.
+ */
+BOOL
+YsIsArgumentVariable(
+    __in PYORI_STRING VariableName
+    )
+{
+    LONGLONG ArgIndex;
+    DWORD CharsConsumed;
+
+    if (YoriLibCompareStringWithLiteral(VariableName, _T("~SCRIPTNAME")) == 0 ||
+        YoriLibCompareStringWithLiteral(VariableName, _T("*")) == 0) {
+
+        return TRUE;
+    }
+
+    if (YoriLibStringToNumber(VariableName, TRUE, &ArgIndex, &CharsConsumed) && CharsConsumed > 0 && CharsConsumed == VariableName->LengthInChars) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Analyze a line once when it is loaded, so that this doesn't need to be
+ repeated each time the line executes.  This locates any references to
+ script arguments, following the same rules as
+ @ref YoriLibExpandCommandVariables , so that execution can substitute
+ values at those locations without scanning the line.
+
+ @param Line The line to analyze.
+ */
+VOID
+YsPrepareLine(
+    __inout PYS_SCRIPT_LINE Line
+    )
+{
+    DWORD Index;
+    DWORD FinalIndex;
+    DWORD IgnoreUntil;
+    DWORD SpanCount;
+    DWORD Pass;
+    YORI_STRING VariableName;
+    PYORI_STRING LineContents;
+
+    Line->Executable = FALSE;
+    Line->ContainsVariables = FALSE;
+    Line->LabelInserted = FALSE;
+    Line->ParseAttempted = FALSE;
+    Line->VariableSpans = NULL;
+    Line->VariableSpanCount = 0;
+    Line->ParsedExpression = NULL;
+    YoriLibInitEmptyString(&Line->ParsedText);
+
+    LineContents = &Line->LineContents;
+
+    if (LineContents->LengthInChars <= 1 ||
+        LineContents->StartOfString[0] == ':') {
+
+        return;
+    }
+
+    Line->Executable = TRUE;
+
+    //
+    //  The first pass counts argument references and the second records
+    //  them.  References to environment variables are skipped, since the
+    //  shell expands those.  A reference without a closing percent is
+    //  expanded in an unusual way, so if one is found, leave the whole line
+    //  to be expanded each time it executes.
+    //
+
+    for (Pass = 0; Pass < 2; Pass++) {
+        SpanCount = 0;
+        IgnoreUntil = 0;
+
+        for (Index = 0; Index < LineContents->LengthInChars; Index++) {
+            if (Index >= IgnoreUntil && YoriLibIsEscapeChar(LineContents->StartOfString[Index])) {
+                IgnoreUntil = Index + 2;
+            }
+
+            if (Index >= IgnoreUntil && LineContents->StartOfString[Index] == '%') {
+                FinalIndex = Index + 1;
+                while (FinalIndex < LineContents->LengthInChars && LineContents->StartOfString[FinalIndex] != '%') {
+                    FinalIndex++;
+                }
+
+                if (FinalIndex == LineContents->LengthInChars) {
+                    if (Line->VariableSpans != NULL) {
+                        YoriLibFree(Line->VariableSpans);
+                        Line->VariableSpans = NULL;
+                    }
+                    Line->ContainsVariables = TRUE;
+                    return;
+                }
+
+                YoriLibInitEmptyString(&VariableName);
+                VariableName.StartOfString = &LineContents->StartOfString[Index + 1];
+                VariableName.LengthInChars = FinalIndex - Index - 1;
+
+                if (YsIsArgumentVariable(&VariableName)) {
+                    if (Line->VariableSpans != NULL) {
+                        Line->VariableSpans[SpanCount].Offset = Index;
+                        Line->VariableSpans[SpanCount].Length = FinalIndex - Index + 1;
+                    }
+                    SpanCount++;
+                }
+
+                Index = FinalIndex;
+            }
+        }
+
+        if (SpanCount == 0) {
+            return;
+        }
+
+        Line->ContainsVariables = TRUE;
+        if (Pass == 0) {
+            Line->VariableSpans = YoriLibMalloc(SpanCount * sizeof(YS_VARIABLE_SPAN));
+            if (Line->VariableSpans == NULL) {
+                return;
+            }
+        }
+    }
+
+    Line->VariableSpanCount = SpanCount;
+}
+
+/**
+ Free any state associated with executing a line, including its parsed form
+ and the location of argument references.
+
+ @param Line The line to clean up.
+ */
+VOID
+YsCleanupLine(
+    __inout PYS_SCRIPT_LINE Line
+    )
+{
+    if (Line->ParsedExpression != NULL) {
+        YoriCallFreeParsedExpression(Line->ParsedExpression);
+        Line->ParsedExpression = NULL;
+    }
+    if (Line->VariableSpans != NULL) {
+        YoriLibFree(Line->VariableSpans);
+        Line->VariableSpans = NULL;
+    }
+    Line->VariableSpanCount = 0;
+    Line->ParseAttempted = FALSE;
+    YoriLibFreeStringContents(&Line->ParsedText);
+}
+
+/**
+ Remove all labels from the label table of a script.
+
+ @param Compiled The script whose labels should be removed.
+ */
+VOID
+YsClearLabelTable(
+    __in PYS_COMPILED_SCRIPT Compiled
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYS_SCRIPT_LINE Line;
+
+    ListEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, NULL);
+    while (ListEntry != NULL) {
+        Line = CONTAINING_RECORD(ListEntry, YS_SCRIPT_LINE, LineLinks);
+        if (Line->LabelInserted) {
+            YoriLibHashRemoveByEntry(&Line->LabelHashEntry);
+            Line->LabelInserted = FALSE;
+        }
+        ListEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, ListEntry);
+    }
+}
+
+/**
+ Populate the label table of a script from its lines.  If a label is defined
+ more than once, the first definition is used, which matches searching the
+ script from the beginning.
+
+ @param Compiled The script whose label table should be populated.
+ */
+VOID
+YsBuildLabelTable(
+    __in PYS_COMPILED_SCRIPT Compiled
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYS_SCRIPT_LINE Line;
+    YORI_STRING LabelString;
+
+    YsClearLabelTable(Compiled);
+
+    ListEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, NULL);
+    while (ListEntry != NULL) {
+        Line = CONTAINING_RECORD(ListEntry, YS_SCRIPT_LINE, LineLinks);
+        if (Line->LineContents.LengthInChars > 1 &&
+            Line->LineContents.StartOfString[0] == ':') {
+
+            YoriLibInitEmptyString(&LabelString);
+            LabelString.MemoryToFree = Line->LineContents.MemoryToFree;
+            LabelString.StartOfString = &Line->LineContents.StartOfString[1];
+            LabelString.LengthInChars = Line->LineContents.LengthInChars - 1;
+
+            if (LabelString.LengthInChars >= 1 &&
+                LabelString.StartOfString[LabelString.LengthInChars - 1] == '\0') {
+                LabelString.LengthInChars--;
+            }
+
+            if (YoriLibHashLookupByKey(Compiled->Labels, &LabelString) == NULL) {
+                YoriLibHashInsertByKey(Compiled->Labels, &LabelString, Line, &Line->LabelHashEntry);
+                Line->LabelInserted = TRUE;
+            }
+        }
+        ListEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, ListEntry);
+    }
+}
+
 /**
  Switch the actively executing line within the script to the specified label,
  if it can be found.
@@ -322,13 +709,15 @@ YsGotoLabel(
 {
     PYORI_LIST_ENTRY ListEntry;
     PYS_SCRIPT_LINE Line;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING LabelString;
 
     //
     //  First special case :eof for no good reason other than CMD does.
     //
 
     if (_tcsicmp(Label, _T(":eof")) == 0) {
-        ListEntry = YoriLibGetPreviousListEntry(&YsActiveScript->LineLinks, NULL);
+        ListEntry = YoriLibGetPreviousListEntry(&YsActiveScript->Compiled->LineLinks, NULL);
         ASSERT(ListEntry != NULL);
         if (ListEntry != NULL) {
             Line = CONTAINING_RECORD(ListEntry, YS_SCRIPT_LINE, LineLinks);
@@ -342,29 +731,12 @@ YsGotoLabel(
     //  Now look for user defined labels within the script.
     //
 
-    ListEntry = YoriLibGetNextListEntry(&YsActiveScript->LineLinks, NULL);
-    while (ListEntry != NULL) {
-        Line = CONTAINING_RECORD(ListEntry, YS_SCRIPT_LINE, LineLinks);
-        if (Line->LineContents.LengthInChars > 1 &&
-            Line->LineContents.StartOfString[0] == ':') {
-
-            YORI_STRING LabelString;
-
-            YoriLibInitEmptyString(&LabelString);
-            LabelString.StartOfString = &Line->LineContents.StartOfString[1];
-            LabelString.LengthInChars = Line->LineContents.LengthInChars - 1;
-
-            if (LabelString.LengthInChars >= 1 &&
-                LabelString.StartOfString[LabelString.LengthInChars - 1] == '\0') {
-                LabelString.LengthInChars--;
-            }
-
-            if (YoriLibCompareStringWithLiteralInsensitive(&LabelString, Label) == 0) {
-                YsActiveScript->ActiveLine = Line;
-                return TRUE;
-            }
-        }
-        ListEntry = YoriLibGetNextListEntry(&YsActiveScript->LineLinks, ListEntry);
+    YoriLibConstantString(&LabelString, Label);
+    HashEntry = YoriLibHashLookupByKey(YsActiveScript->Compiled->Labels, &LabelString);
+    if (HashEntry != NULL) {
+        Line = (PYS_SCRIPT_LINE)HashEntry->Context;
+        YsActiveScript->ActiveLine = Line;
+        return TRUE;
     }
 
     return FALSE;
@@ -432,6 +804,7 @@ YsLoadLines(
 
         ASSERT(ThisLine->LineContents.StartOfString[ThisLine->LineContents.LengthInChars] == '\0');
         ThisLine->LineContents.LengthInChars++;
+        YsPrepareLine(ThisLine);
 
         YoriLibInsertList(InsertPoint, &ThisLine->LineLinks);
         InsertPoint = &ThisLine->LineLinks;
@@ -889,11 +1262,20 @@ YoriCmd_INCLUDE(
 
     YoriLibFreeStringContents(&FileName);
 
+    //
+    //  The lines of the script no longer match its file, so it can't be
+    //  reused once it completes.
+    //
+
+    YsActiveScript->Compiled->Modified = TRUE;
+
     if (!YsLoadLines(FileHandle, &YsActiveScript->ActiveLine->LineLinks)) {
+        YsBuildLabelTable(YsActiveScript->Compiled);
         CloseHandle(FileHandle);
         return EXIT_FAILURE;
     }
 
+    YsBuildLabelTable(YsActiveScript->Compiled);
     CloseHandle(FileHandle);
 
     return EXIT_SUCCESS;
@@ -981,10 +1363,11 @@ YsExpandArgumentVariables(
     PYS_ARGUMENT_CONTEXT ArgContext = (PYS_ARGUMENT_CONTEXT)Context;
 
     if (YoriLibCompareStringWithLiteral(VariableName, _T("~SCRIPTNAME")) == 0) {
-        if (OutputString->LengthAllocated >= YsActiveScript->FileName.LengthInChars) {
-            memcpy(OutputString->StartOfString, YsActiveScript->FileName.StartOfString, YsActiveScript->FileName.LengthInChars * sizeof(TCHAR));
+        PYORI_STRING FileName = &YsActiveScript->Compiled->FileName;
+        if (OutputString->LengthAllocated >= FileName->LengthInChars) {
+            memcpy(OutputString->StartOfString, FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
         }
-        return YsActiveScript->FileName.LengthInChars;
+        return FileName->LengthInChars;
     }
 
     if (YoriLibCompareStringWithLiteral(VariableName, _T("*")) == 0) {
@@ -1028,6 +1411,176 @@ YsExpandArgumentVariables(
     return VariableName->LengthInChars + 2;
 }
 
+/**
+ Substitute script arguments into a line at the locations found when the
+ line was loaded.  This produces the same result as
+ @ref YoriLibExpandCommandVariables without scanning the line.
+
+ @param Line The line to expand.  This must have VariableSpans populated.
+
+ @param ArgContext The arguments to substitute.
+
+ @param ExpandedString On input, an allocated or empty string.  On successful
+        completion, populated with the expanded line, which is NULL
+        terminated but does not include the NULL in its length.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YsExpandLineAtSpans(
+    __in PYS_SCRIPT_LINE Line,
+    __in PYS_ARGUMENT_CONTEXT ArgContext,
+    __inout PYORI_STRING ExpandedString
+    )
+{
+    DWORD SpanIndex;
+    DWORD SourceIndex;
+    DWORD DestIndex;
+    DWORD CopyLength;
+    DWORD LengthNeeded;
+    PYS_VARIABLE_SPAN Span;
+    YORI_STRING VariableName;
+    YORI_STRING DestString;
+
+    ASSERT(Line->VariableSpans != NULL);
+
+    if (ExpandedString->LengthAllocated < Line->LineContents.LengthInChars + 1) {
+        YoriLibFreeStringContents(ExpandedString);
+        if (!YoriLibAllocateString(ExpandedString, Line->LineContents.LengthInChars + 256)) {
+            return FALSE;
+        }
+    }
+
+    SourceIndex = 0;
+    DestIndex = 0;
+
+    for (SpanIndex = 0; SpanIndex <= Line->VariableSpanCount; SpanIndex++) {
+
+        //
+        //  Copy the text preceding this reference, or the text following
+        //  the final reference.
+        //
+
+        if (SpanIndex < Line->VariableSpanCount) {
+            Span = &Line->VariableSpans[SpanIndex];
+            CopyLength = Span->Offset - SourceIndex;
+        } else {
+            Span = NULL;
+            CopyLength = Line->LineContents.LengthInChars - SourceIndex;
+        }
+
+        if (DestIndex + CopyLength + 1 > ExpandedString->LengthAllocated) {
+            ExpandedString->LengthInChars = DestIndex;
+            if (!YoriLibReallocateString(ExpandedString, (DestIndex + CopyLength) * 2)) {
+                return FALSE;
+            }
+        }
+
+        memcpy(&ExpandedString->StartOfString[DestIndex], &Line->LineContents.StartOfString[SourceIndex], CopyLength * sizeof(TCHAR));
+        DestIndex += CopyLength;
+        SourceIndex += CopyLength;
+
+        if (Span == NULL) {
+            break;
+        }
+
+        YoriLibInitEmptyString(&VariableName);
+        VariableName.StartOfString = &Line->LineContents.StartOfString[Span->Offset + 1];
+        VariableName.LengthInChars = Span->Length - 2;
+
+        while (TRUE) {
+            YoriLibInitEmptyString(&DestString);
+            DestString.StartOfString = &ExpandedString->StartOfString[DestIndex];
+            DestString.LengthAllocated = ExpandedString->LengthAllocated - DestIndex - 1;
+
+            LengthNeeded = YsExpandArgumentVariables(&DestString, &VariableName, ArgContext);
+            if (LengthNeeded <= DestString.LengthAllocated) {
+                DestIndex += LengthNeeded;
+                break;
+            }
+
+            ExpandedString->LengthInChars = DestIndex;
+            if (!YoriLibReallocateString(ExpandedString, (DestIndex + LengthNeeded) * 2)) {
+                return FALSE;
+            }
+        }
+
+        SourceIndex += Span->Length;
+    }
+
+    //
+    //  The line includes its NULL terminator, which has been copied as part
+    //  of the text following the final reference.
+    //
+
+    ASSERT(DestIndex > 0 && ExpandedString->StartOfString[DestIndex - 1] == '\0');
+    ExpandedString->LengthInChars = DestIndex - 1;
+
+    return TRUE;
+}
+
+/**
+ Execute a line of a script.  The line is parsed by the shell the first time
+ it executes and the parsed form is retained with the line.  For lines
+ containing argument references, the parsed form is only reused when
+ substituting arguments results in the same text as before, since arguments
+ are substituted before the line is broken into arguments by the shell.
+
+ @param Line The line to execute.
+
+ @param Expression The text of the line to execute, after substituting any
+        arguments.
+
+ @param ArgumentsSubstituted TRUE if Expression was generated by
+        substituting arguments into the line, FALSE if it is the unmodified
+        contents of the line.
+ */
+VOID
+YsExecuteLine(
+    __inout PYS_SCRIPT_LINE Line,
+    __in PYORI_STRING Expression,
+    __in BOOLEAN ArgumentsSubstituted
+    )
+{
+    if (ArgumentsSubstituted &&
+        Line->ParseAttempted &&
+        YoriLibCompareString(&Line->ParsedText, Expression) != 0) {
+
+        if (Line->ParsedExpression != NULL) {
+            YoriCallFreeParsedExpression(Line->ParsedExpression);
+            Line->ParsedExpression = NULL;
+        }
+        Line->ParseAttempted = FALSE;
+    }
+
+    if (!Line->ParseAttempted) {
+        if (ArgumentsSubstituted) {
+            if (Line->ParsedText.LengthAllocated < Expression->LengthInChars + 1) {
+                YoriLibFreeStringContents(&Line->ParsedText);
+                if (!YoriLibAllocateString(&Line->ParsedText, Expression->LengthInChars + 1)) {
+                    YoriCallExecuteExpression(Expression);
+                    return;
+                }
+            }
+            memcpy(Line->ParsedText.StartOfString, Expression->StartOfString, Expression->LengthInChars * sizeof(TCHAR));
+            Line->ParsedText.LengthInChars = Expression->LengthInChars;
+            Line->ParsedText.StartOfString[Line->ParsedText.LengthInChars] = '\0';
+        }
+
+        Line->ParseAttempted = TRUE;
+        if (!YoriCallParseExpression(Expression, &Line->ParsedExpression)) {
+            Line->ParsedExpression = NULL;
+        }
+    }
+
+    if (Line->ParsedExpression != NULL) {
+        YoriCallExecuteParsedExpression(Line->ParsedExpression);
+    } else {
+        YoriCallExecuteExpression(Expression);
+    }
+}
+
 /**
  A structure the maps a command name string into a function callback to
  invoke if that string is used as a command within a script.
@@ -1075,6 +1628,7 @@ YsExecuteScript(
     )
 {
     YORI_STRING LineWithArgumentsExpanded;
+    YORI_STRING UnexpandedLine;
     YORI_STRING CommandName;
     DWORD Index;
     PYORI_LIST_ENTRY NextEntry;
@@ -1097,13 +1651,38 @@ YsExecuteScript(
     YsActiveScript = Script;
 
     YoriLibInitEmptyString(&LineWithArgumentsExpanded);
-    NextEntry = YoriLibGetNextListEntry(&Script->LineLinks, NULL);
+    NextEntry = YoriLibGetNextListEntry(&Script->Compiled->LineLinks, NULL);
     while(NextEntry != NULL) {
         CurrentLine = CONTAINING_RECORD(NextEntry, YS_SCRIPT_LINE, LineLinks);
         Script->ActiveLine = CurrentLine;
 
-        if (CurrentLine->LineContents.LengthInChars > 1 &&
-            CurrentLine->LineContents.StartOfString[0] != ':') {
+        if (CurrentLine->Executable && !CurrentLine->ContainsVariables) {
+
+            //
+            //  If there's nothing to expand, execute the line directly
+            //  without copying it.  The string length here includes the
+            //  NULL terminator, which shouldn't be passed to the shell.
+            //
+
+            YoriLibInitEmptyString(&UnexpandedLine);
+            UnexpandedLine.StartOfString = CurrentLine->LineContents.StartOfString;
+            UnexpandedLine.LengthInChars = CurrentLine->LineContents.LengthInChars - 1;
+            UnexpandedLine.LengthAllocated = CurrentLine->LineContents.LengthInChars;
+            ASSERT(UnexpandedLine.StartOfString[UnexpandedLine.LengthInChars] == '\0');
+
+            YsExecuteLine(CurrentLine, &UnexpandedLine, FALSE);
+            ASSERT(YsActiveScript == Script);
+
+        } else if (CurrentLine->Executable && CurrentLine->VariableSpans != NULL) {
+
+            if (!YsExpandLineAtSpans(CurrentLine, Script->ArgContext, &LineWithArgumentsExpanded)) {
+                break;
+            }
+
+            YsExecuteLine(CurrentLine, &LineWithArgumentsExpanded, TRUE);
+            ASSERT(YsActiveScript == Script);
+
+        } else if (CurrentLine->Executable) {
 
             if (!YoriLibExpandCommandVariables(&CurrentLine->LineContents, '%', TRUE, YsExpandArgumentVariables, Script->ArgContext, &LineWithArgumentsExpanded)) {
                 break;
@@ -1128,7 +1707,7 @@ YsExecuteScript(
             ASSERT(YsActiveScript == Script);
         }
 
-        NextEntry = YoriLibGetNextListEntry(&Script->LineLinks, &Script->ActiveLine->LineLinks);
+        NextEntry = YoriLibGetNextListEntry(&Script->Compiled->LineLinks, &Script->ActiveLine->LineLinks);
     }
 
     YsActiveScript = PreviouslyActiveScript;
@@ -1145,79 +1724,293 @@ YsExecuteScript(
 }
 
 /**
- Deallocate any structures used to record a script in memory.
+ Deallocate a compiled script.  The script must not be in the list of cached
+ scripts.
 
- @param Script The in memory script and state to deallocate.
+ @param Compiled The compiled script to deallocate.
  */
 VOID
-YsFreeScript(
-    __in PYS_SCRIPT Script
+YsFreeCompiledScript(
+    __in PYS_COMPILED_SCRIPT Compiled
     )
 {
     PYS_SCRIPT_LINE CurrentLine;
-    PYS_CALL_STACK StackLocation;
     PYORI_LIST_ENTRY NextEntry;
-    BOOL CallStackFound;
 
-    NextEntry = YoriLibGetNextListEntry(&Script->LineLinks, NULL);
+    ASSERT(!Compiled->Cached && !Compiled->InUse);
+
+    if (Compiled->Labels != NULL) {
+        YsClearLabelTable(Compiled);
+        YoriLibFreeEmptyHashTable(Compiled->Labels);
+    }
+
+    NextEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, NULL);
     while(NextEntry != NULL) {
         CurrentLine = CONTAINING_RECORD(NextEntry, YS_SCRIPT_LINE, LineLinks);
-        NextEntry = YoriLibGetNextListEntry(&Script->LineLinks, NextEntry);
+        NextEntry = YoriLibGetNextListEntry(&Compiled->LineLinks, NextEntry);
 
+        YsCleanupLine(CurrentLine);
         YoriLibFreeStringContents(&CurrentLine->LineContents);
         YoriLibFree(CurrentLine);
     }
 
-    CallStackFound = FALSE;
+    YoriLibFreeStringContents(&Compiled->FileName);
+    YoriLibFree(Compiled);
+}
 
-    NextEntry = YoriLibGetNextListEntry(&Script->CallStackLinks, NULL);
-    while(NextEntry != NULL) {
-        StackLocation = CONTAINING_RECORD(NextEntry, YS_CALL_STACK, StackLinks);
-        NextEntry = YoriLibGetNextListEntry(&StackLocation->StackLinks, NextEntry);
+/**
+ Free all compiled scripts retained between invocations.  This is called
+ when the module is unloaded.
+ */
+VOID
+YORI_BUILTIN_FN
+YsNotifyUnload()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYS_COMPILED_SCRIPT Compiled;
 
-        YsFreeCallStack(StackLocation);
-        CallStackFound = TRUE;
+    ListEntry = YoriLibGetNextListEntry(&YsScriptCache, NULL);
+    while (ListEntry != NULL) {
+        Compiled = CONTAINING_RECORD(ListEntry, YS_COMPILED_SCRIPT, CacheLinks);
+        ListEntry = YoriLibGetNextListEntry(&YsScriptCache, ListEntry);
+        YoriLibRemoveListItem(&Compiled->CacheLinks);
+        Compiled->Cached = FALSE;
+        YsFreeCompiledScript(Compiled);
     }
 
-    if (CallStackFound) {
-        YORI_STRING ReturnCmd;
-        YoriLibConstantString(&ReturnCmd, _T("RETURN"));
-        YoriCallBuiltinUnregister(&ReturnCmd, YoriCmd_RETURN);
+    YsScriptCacheCount = 0;
+    YsScriptCacheUnloadRegistered = FALSE;
+}
+
+/**
+ Load a script from an incoming stream and analyze its lines.
+
+ @param Handle The handle to the stream that contains the script.
+
+ @param FileName The fully qualified file name of the script.
+
+ @param FileInfo Information about the file, used to determine whether the
+        script is still current when it is next executed.
+
+ @return Pointer to the compiled script, or NULL on failure.
+ */
+PYS_COMPILED_SCRIPT
+YsCompileScript(
+    __in HANDLE Handle,
+    __in PYORI_STRING FileName,
+    __in PBY_HANDLE_FILE_INFORMATION FileInfo
+    )
+{
+    PYS_COMPILED_SCRIPT Compiled;
+
+    Compiled = YoriLibMalloc(sizeof(YS_COMPILED_SCRIPT));
+    if (Compiled == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Compiled, sizeof(YS_COMPILED_SCRIPT));
+    YoriLibInitializeListHead(&Compiled->LineLinks);
+    YoriLibCloneString(&Compiled->FileName, FileName);
+    Compiled->LastWriteTime = FileInfo->ftLastWriteTime;
+    Compiled->FileSize.LowPart = FileInfo->nFileSizeLow;
+    Compiled->FileSize.HighPart = FileInfo->nFileSizeHigh;
+
+    Compiled->Labels = YoriLibAllocateHashTable(YS_LABEL_HASH_BUCKETS);
+    if (Compiled->Labels == NULL) {
+        YsFreeCompiledScript(Compiled);
+        return NULL;
+    }
+
+    if (!YsLoadLines(Handle, &Compiled->LineLinks)) {
+        YsFreeCompiledScript(Compiled);
+        return NULL;
     }
 
-    YoriLibFreeStringContents(&Script->FileName);
+    YsBuildLabelTable(Compiled);
+    return Compiled;
 }
 
+/**
+ Find a compiled form of a script, either by reusing one from a previous
+ invocation if the file has not changed since, or by loading it.
+
+ @param FileName The fully qualified file name of the script.
+
+ @param Handle A handle to the opened script file.
+
+ @return Pointer to the compiled script, or NULL on failure.  The caller
+         should call @ref YsReleaseCompiledScript when execution completes.
+ */
+PYS_COMPILED_SCRIPT
+YsAcquireCompiledScript(
+    __in PYORI_STRING FileName,
+    __in HANDLE Handle
+    )
+{
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    PYORI_LIST_ENTRY ListEntry;
+    PYS_COMPILED_SCRIPT Compiled;
+    PYS_COMPILED_SCRIPT Evict;
+    BOOL CanCache;
+
+    if (YsScriptCache.Next == NULL) {
+        YoriLibInitializeListHead(&YsScriptCache);
+    }
+
+    CanCache = TRUE;
+    if (!GetFileInformationByHandle(Handle, &FileInfo)) {
+        ZeroMemory(&FileInfo, sizeof(FileInfo));
+        CanCache = FALSE;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YsScriptCache, NULL);
+    while (ListEntry != NULL) {
+        Compiled = CONTAINING_RECORD(ListEntry, YS_COMPILED_SCRIPT, CacheLinks);
+        ListEntry = YoriLibGetNextListEntry(&YsScriptCache, ListEntry);
+
+        if (YoriLibCompareStringInsensitive(&Compiled->FileName, FileName) != 0) {
+            continue;
+        }
+
+        //
+        //  If the script is executing itself, the new invocation needs its
+        //  own copy.
+        //
+
+        if (Compiled->InUse) {
+            CanCache = FALSE;
+            break;
+        }
+
+        if (CanCache &&
+            Compiled->LastWriteTime.dwLowDateTime == FileInfo.ftLastWriteTime.dwLowDateTime &&
+            Compiled->LastWriteTime.dwHighDateTime == FileInfo.ftLastWriteTime.dwHighDateTime &&
+            Compiled->FileSize.LowPart == FileInfo.nFileSizeLow &&
+            (DWORD)Compiled->FileSize.HighPart == FileInfo.nFileSizeHigh) {
+
+            YoriLibRemoveListItem(&Compiled->CacheLinks);
+            YoriLibInsertList(&YsScriptCache, &Compiled->CacheLinks);
+            Compiled->InUse = TRUE;
+            return Compiled;
+        }
+
+        //
+        //  The file has changed, so discard the previous version.
+        //
+
+        YoriLibRemoveListItem(&Compiled->CacheLinks);
+        Compiled->Cached = FALSE;
+        YsScriptCacheCount--;
+        YsFreeCompiledScript(Compiled);
+        break;
+    }
+
+    Compiled = YsCompileScript(Handle, FileName, &FileInfo);
+    if (Compiled == NULL) {
+        return NULL;
+    }
+
+    //
+    //  Make room by discarding the least recently used script that is not
+    //  executing.
+    //
+
+    if (CanCache && YsScriptCacheCount >= YS_SCRIPT_CACHE_MAX) {
+        ListEntry = YoriLibGetPreviousListEntry(&YsScriptCache, NULL);
+        while (ListEntry != NULL) {
+            Evict = CONTAINING_RECORD(ListEntry, YS_COMPILED_SCRIPT, CacheLinks);
+            if (!Evict->InUse) {
+                YoriLibRemoveListItem(&Evict->CacheLinks);
+                Evict->Cached = FALSE;
+                YsScriptCacheCount--;
+                YsFreeCompiledScript(Evict);
+                break;
+            }
+            ListEntry = YoriLibGetPreviousListEntry(&YsScriptCache, ListEntry);
+        }
+
+        if (YsScriptCacheCount >= YS_SCRIPT_CACHE_MAX) {
+            CanCache = FALSE;
+        }
+    }
+
+    if (CanCache) {
+        YoriLibInsertList(&YsScriptCache, &Compiled->CacheLinks);
+        Compiled->Cached = TRUE;
+        YsScriptCacheCount++;
+
+        if (!YsScriptCacheUnloadRegistered) {
+            YoriCallSetUnloadRoutine(YsNotifyUnload);
+            YsScriptCacheUnloadRegistered = TRUE;
+        }
+    }
+
+    Compiled->InUse = TRUE;
+    return Compiled;
+}
 
 /**
- Load a script from an incoming stream.
+ Indicate that execution of a compiled script has completed.  If the script
+ is cached and unmodified, it is retained for the next invocation; otherwise
+ it is deallocated.
 
- @param Handle The handle to the stream that contains the script.
+ @param Compiled The compiled script.
+ */
+VOID
+YsReleaseCompiledScript(
+    __in PYS_COMPILED_SCRIPT Compiled
+    )
+{
+    ASSERT(Compiled->InUse);
+    Compiled->InUse = FALSE;
 
- @param Script On successful completion, populated with the contents of the
-        script.
+    if (Compiled->Cached && !Compiled->Modified) {
+        return;
+    }
 
- @return TRUE to indicate success, FALSE to indicate failure.
+    if (Compiled->Cached) {
+        YoriLibRemoveListItem(&Compiled->CacheLinks);
+        Compiled->Cached = FALSE;
+        YsScriptCacheCount--;
+    }
+
+    YsFreeCompiledScript(Compiled);
+}
+
+/**
+ Deallocate any structures used to record the state of an executing script,
+ and release its compiled form.
+
+ @param Script The executing script state to deallocate.
  */
-BOOL
-YsLoadScript(
-    __in HANDLE Handle,
-    __out PYS_SCRIPT Script
+VOID
+YsFreeScript(
+    __in PYS_SCRIPT Script
     )
 {
-    BOOL Result = TRUE;
+    PYS_CALL_STACK StackLocation;
+    PYORI_LIST_ENTRY NextEntry;
+    BOOL CallStackFound;
 
-    YoriLibInitializeListHead(&Script->LineLinks);
-    YoriLibInitializeListHead(&Script->CallStackLinks);
+    CallStackFound = FALSE;
 
-    if (!YsLoadLines(Handle, &Script->LineLinks)) {
-        Result = FALSE;
+    NextEntry = YoriLibGetNextListEntry(&Script->CallStackLinks, NULL);
+    while(NextEntry != NULL) {
+        StackLocation = CONTAINING_RECORD(NextEntry, YS_CALL_STACK, StackLinks);
+        NextEntry = YoriLibGetNextListEntry(&StackLocation->StackLinks, NextEntry);
+
+        YsFreeCallStack(StackLocation);
+        CallStackFound = TRUE;
     }
 
-    if (Result == FALSE) {
-        YsFreeScript(Script);
+    if (CallStackFound) {
+        YORI_STRING ReturnCmd;
+        YoriLibConstantString(&ReturnCmd, _T("RETURN"));
+        YoriCallBuiltinUnregister(&ReturnCmd, YoriCmd_RETURN);
     }
-    return Result;
+
+    YsReleaseCompiledScript(Script->Compiled);
+    Script->Compiled = NULL;
 }
 
 /**
@@ -1242,6 +2035,7 @@ YoriCmd_YS(
     DWORD i;
     DWORD StartArg = 0;
     YS_SCRIPT Script;
+    PYS_COMPILED_SCRIPT Compiled;
     YORI_STRING Arg;
 
     YoriLibLoadNtDllFunctions();
@@ -1299,15 +2093,17 @@ YoriCmd_YS(
         return EXIT_FAILURE;
     }
 
+    Compiled = YsAcquireCompiledScript(&FileName, FileHandle);
+    CloseHandle(FileHandle);
+    YoriLibFreeStringContents(&FileName);
 
-    if (!YsLoadScript(FileHandle, &Script)) {
-        YoriLibFreeStringContents(&FileName);
+    if (Compiled == NULL) {
         return EXIT_FAILURE;
     }
 
-    memcpy(&Script.FileName, &FileName, sizeof(YORI_STRING));
-
-    CloseHandle(FileHandle);
+    ZeroMemory(&Script, sizeof(Script));
+    Script.Compiled = Compiled;
+    YoriLibInitializeListHead(&Script.CallStackLinks);
 
     Script.GlobalArgContext.ShiftCount = StartArg;
     Script.GlobalArgContext.ArgC = ArgC;
@@ -43,7 +43,7 @@ CHAR strDuHelpText[] =
         "   -c             Display compressed file size\n"
         "   -color         Use file color highlighting\n"
         "   -d             Include space used by alternate data streams\n"
-        "   -h             Average space used across multiple hard links\n"
+        "   -h             Count space used by files with multiple hard links once\n"
         "   -r <num>       The maximum recursion depth to display\n"
         "   -s <size>      Only display directories containing at least size bytes\n"
         "   -u             Round space up to file allocation unit or cluster size\n"
@@ -86,17 +86,93 @@ typedef struct _DU_WIN32_FIND_STREAM_DATA {
 } DU_WIN32_FIND_STREAM_DATA, *PDU_WIN32_FIND_STREAM_DATA;
 
 /**
- A structure describing a particular directory.  When traversing through
- files to calculate space, there will be one of these structures for each
- parent component of the file.
+ The number of buckets in the hash table of file IDs which have been counted
+ already.  This must be a power of two.
  */
-typedef struct _DU_DIRECTORY_STACK {
+#define DU_FILE_ID_BUCKETS          (0x10000)
+
+/**
+ The size of the buffer used to receive directory enumeration information
+ from the file system.
+ */
+#define DU_ENUM_BUFFER_SIZE         (64 * 1024)
+
+/**
+ An entry in the hash table of files which have been counted already.  This
+ is used to ensure that files with multiple hard links are only counted once.
+ */
+typedef struct _DU_FILE_ID_ENTRY {
+
+    /**
+     Pointer to the next entry in the same hash bucket.
+     */
+    struct _DU_FILE_ID_ENTRY *Next;
+
+    /**
+     The serial number of the volume containing the file.
+     */
+    DWORD VolumeSerialNumber;
+
+    /**
+     The file ID, which is unique within the volume.
+     */
+    LARGE_INTEGER FileId;
+} DU_FILE_ID_ENTRY, *PDU_FILE_ID_ENTRY;
+
+/**
+ A structure describing a particular directory.  Each directory found while
+ traversing will have one of these structures, linked to its parent, so the
+ tree can be enumerated concurrently and reported once complete.
+ */
+typedef struct _DU_DIRECTORY {
+
+    /**
+     The list of child directories found within this directory.  This is
+     only modified by the thread enumerating this directory.
+     */
+    YORI_LIST_ENTRY ChildList;
+
+    /**
+     The link of this directory within its parent's ChildList, or within
+     the list of root directories if this has no parent.
+     */
+    YORI_LIST_ENTRY SiblingListEntry;
+
+    /**
+     The link of this directory within the list of directories waiting to
+     be enumerated.
+     */
+    YORI_LIST_ENTRY PendingListEntry;
+
+    /**
+     Pointer to the parent directory, or NULL if this is a root.
+     */
+    struct _DU_DIRECTORY *Parent;
 
     /**
      The name of this directory, in escaped form.
      */
     YORI_STRING DirectoryName;
 
+    /**
+     The depth of this directory relative to the user's search criteria.
+     */
+    DWORD Depth;
+
+    /**
+     The serial number of the volume containing this directory.
+     */
+    DWORD VolumeSerialNumber;
+
+    /**
+     The number of outstanding operations on this directory.  This consists
+     of one reference for the enumeration of this directory plus one for
+     each child directory that has not completed.  When this reaches zero
+     the space consumed by this directory and all children is final and is
+     propagated to the parent.
+     */
+    LONG ReferenceCount;
+
     /**
      The number of files or directories encountered within this directory.
      */
@@ -120,7 +196,50 @@ typedef struct _DU_DIRECTORY_STACK {
      enabled.
      */
     LONGLONG AllocationSize;
-} DU_DIRECTORY_STACK, *PDU_DIRECTORY_STACK;
+} DU_DIRECTORY, *PDU_DIRECTORY;
+
+/**
+ Information about a single file found within a directory, collected from
+ whichever directory enumeration mechanism is in use.
+ */
+typedef struct _DU_FILE_ENTRY {
+
+    /**
+     The file attributes.
+     */
+    DWORD FileAttributes;
+
+    /**
+     The reparse tag, if the file is a reparse point.
+     */
+    DWORD ReparseTag;
+
+    /**
+     The file size, in bytes.
+     */
+    LARGE_INTEGER EndOfFile;
+
+    /**
+     The file system's allocation size for the file, in bytes.  Only
+     meaningful if AllocationSizeValid is TRUE.
+     */
+    LARGE_INTEGER AllocationSize;
+
+    /**
+     The file ID.  Only meaningful if FileIdValid is TRUE.
+     */
+    LARGE_INTEGER FileId;
+
+    /**
+     TRUE if AllocationSize was returned from the directory enumeration.
+     */
+    BOOLEAN AllocationSizeValid;
+
+    /**
+     TRUE if FileId was returned from the directory enumeration.
+     */
+    BOOLEAN FileIdValid;
+} DU_FILE_ENTRY, *PDU_FILE_ENTRY;
 
 /**
  Context passed to the callback which is invoked for each file found.
@@ -128,25 +247,70 @@ typedef struct _DU_DIRECTORY_STACK {
 typedef struct _DU_CONTEXT {
 
     /**
-     An array of directory components corresponding to the components within
-     the path currently being parsed.  File sizes are added to the leafmost
-     element (ie., StackIndex) and when a change to a parent component is
-     detected, size from the child component is propagated to the parent and
-     the child component is prepared for reuse by the next child directory.
+     The list of root directories, being the parents of objects matching
+     the user's search criteria.
+     */
+    YORI_LIST_ENTRY RootList;
+
+    /**
+     The most recently created root directory.  Objects matching the user's
+     search criteria are typically in the same directory so this is checked
+     before creating a new root.
+     */
+    PDU_DIRECTORY CurrentRoot;
+
+    /**
+     The list of directories waiting to be enumerated by worker threads.
+     */
+    YORI_LIST_ENTRY PendingList;
+
+    /**
+     A mutex to synchronize access to PendingList.
+     */
+    HANDLE Mutex;
+
+    /**
+     An event signalled when more directories are added to PendingList.
+     */
+    HANDLE WorkerWaitEvent;
+
+    /**
+     An event signalled when worker threads should terminate.
+     */
+    HANDLE WorkerShutdownEvent;
+
+    /**
+     An event signalled when all root directories have completed.
+     */
+    HANDLE AllRootsCompleteEvent;
+
+    /**
+     An array of handles to worker threads.
+     */
+    PHANDLE Threads;
+
+    /**
+     The number of worker threads that have been created.
+     */
+    DWORD ThreadsAllocated;
+
+    /**
+     The number of root directories that have not completed, plus one while
+     the user's search criteria is being expanded.
      */
-    PDU_DIRECTORY_STACK DirStack;
+    LONG RootsOutstanding;
 
     /**
-     Index of the last element in the directory stack that has been operated
-     on.
+     Set to TRUE if the operation was cancelled, so remaining directories
+     are not enumerated.
      */
-    DWORD StackIndex;
+    BOOL Cancelled;
 
     /**
-     The number of allocated elements in the DirStack array.  Will be zero
-     if the array has not been allocated yet.
+     A hash table of file IDs which have been counted already.  This is only
+     allocated if hard links should be counted once.
      */
-    DWORD StackAllocated;
+    PDU_FILE_ID_ENTRY *FileIdBuckets;
 
     /**
      The maximum depth to display.  This is a user specified value allowing
@@ -166,9 +330,9 @@ typedef struct _DU_CONTEXT {
     BOOL CompressedFileSize;
 
     /**
-     Average size across multiple hard links.
+     Count space used by files with multiple hard links once.
      */
-    BOOL AverageHardLinkSize;
+    BOOL SingleCountHardLinks;
 
     /**
      Count space used by alternate data streams on the file.
@@ -209,68 +373,216 @@ typedef struct _DU_CONTEXT {
 } DU_CONTEXT, *PDU_CONTEXT;
 
 /**
- Deallocate all child allocations within a DU_CONTEXT structure.  The
- structure itself is typically stack allocated and will not be freed.
+ Check whether a file ID has been counted already, and if not, record it so
+ that future links to the same file are not counted.  Insertion is lock
+ free: entries are never removed while enumerating, so a new entry is pushed
+ onto the head of its bucket and the push is retried if another thread
+ changed the bucket in the meantime.
 
- @param DuContext Pointer to the DuContext to clean up.
+ @param DuContext Pointer to the DU context containing the hash table.
+
+ @param VolumeSerialNumber The serial number of the volume containing the
+        file.
+
+ @param FileId Pointer to the file ID.
+
+ @return TRUE if the file has not been counted before and should be counted
+         now, FALSE if it has been counted already.
+ */
+BOOL
+DuFileIdSetInsert(
+    __in PDU_CONTEXT DuContext,
+    __in DWORD VolumeSerialNumber,
+    __in PLARGE_INTEGER FileId
+    )
+{
+    DWORD Hash;
+    PDU_FILE_ID_ENTRY *Bucket;
+    PDU_FILE_ID_ENTRY Head;
+    PDU_FILE_ID_ENTRY Entry;
+    PDU_FILE_ID_ENTRY NewEntry;
+
+    Hash = FileId->LowPart ^ ((DWORD)FileId->HighPart * 31) ^ VolumeSerialNumber;
+    Hash = Hash ^ (Hash >> 16);
+    Bucket = &DuContext->FileIdBuckets[Hash & (DU_FILE_ID_BUCKETS - 1)];
+
+    NewEntry = NULL;
+    Head = *Bucket;
+    while (TRUE) {
+        for (Entry = Head; Entry != NULL; Entry = Entry->Next) {
+            if (Entry->FileId.QuadPart == FileId->QuadPart &&
+                Entry->VolumeSerialNumber == VolumeSerialNumber) {
+
+                if (NewEntry != NULL) {
+                    YoriLibFree(NewEntry);
+                }
+                return FALSE;
+            }
+        }
+
+        if (NewEntry == NULL) {
+            NewEntry = YoriLibMalloc(sizeof(DU_FILE_ID_ENTRY));
+            if (NewEntry == NULL) {
+                return TRUE;
+            }
+            NewEntry->VolumeSerialNumber = VolumeSerialNumber;
+            NewEntry->FileId.QuadPart = FileId->QuadPart;
+        }
+
+        NewEntry->Next = Head;
+        Entry = InterlockedCompareExchangePointer((PVOID *)Bucket, NewEntry, Head);
+        if (Entry == Head) {
+            return TRUE;
+        }
+        Head = Entry;
+    }
+}
+
+/**
+ Free all entries within the hash table of file IDs, and the table itself.
+
+ @param DuContext Pointer to the DU context containing the hash table.
  */
 VOID
-DuCleanupContext(
+DuFileIdSetFree(
     __in PDU_CONTEXT DuContext
     )
 {
     DWORD Index;
+    PDU_FILE_ID_ENTRY Entry;
+    PDU_FILE_ID_ENTRY NextEntry;
 
-    for (Index = 0; Index < DuContext->StackAllocated; Index++) {
-        YoriLibFreeStringContents(&DuContext->DirStack[Index].DirectoryName);
+    if (DuContext->FileIdBuckets == NULL) {
+        return;
     }
 
-    if (DuContext->DirStack != NULL) {
-        YoriLibFree(DuContext->DirStack);
-        DuContext->DirStack = NULL;
+    for (Index = 0; Index < DU_FILE_ID_BUCKETS; Index++) {
+        Entry = DuContext->FileIdBuckets[Index];
+        while (Entry != NULL) {
+            NextEntry = Entry->Next;
+            YoriLibFree(Entry);
+            Entry = NextEntry;
+        }
     }
 
-    DuContext->StackAllocated = 0;
-    DuContext->StackIndex = 0;
-    YoriLibFileFiltFreeFilter(&DuContext->ColorRules);
+    YoriLibFree(DuContext->FileIdBuckets);
+    DuContext->FileIdBuckets = NULL;
 }
 
 /**
- Clear the contents of a directory frame so it can be reused.
+ Allocate a directory structure and initialize it as a child of a specified
+ parent.  The caller is expected to insert it into the tree.
+
+ @param Parent Optionally points to the parent directory.  If NULL, the
+        directory is a root.
+
+ @param DirName Pointer to the directory name.
 
- @param DirStack Pointer to the directory frame to clear.
+ @return Pointer to the directory, or NULL on allocation failure.
  */
-VOID
-DuCloseStack(
-    __in PDU_DIRECTORY_STACK DirStack
+PDU_DIRECTORY
+DuAllocateDirectory(
+    __in_opt PDU_DIRECTORY Parent,
+    __in PYORI_STRING DirName
+    )
+{
+    PDU_DIRECTORY Directory;
+
+    Directory = YoriLibMalloc(sizeof(DU_DIRECTORY) + (DirName->LengthInChars + 1) * sizeof(TCHAR));
+    if (Directory == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Directory, sizeof(DU_DIRECTORY));
+    YoriLibInitializeListHead(&Directory->ChildList);
+    Directory->Parent = Parent;
+    Directory->ReferenceCount = 1;
+
+    YoriLibInitEmptyString(&Directory->DirectoryName);
+    Directory->DirectoryName.StartOfString = (LPTSTR)(Directory + 1);
+    Directory->DirectoryName.LengthAllocated = DirName->LengthInChars + 1;
+    memcpy(Directory->DirectoryName.StartOfString, DirName->StartOfString, DirName->LengthInChars * sizeof(TCHAR));
+    Directory->DirectoryName.StartOfString[DirName->LengthInChars] = '\0';
+    Directory->DirectoryName.LengthInChars = DirName->LengthInChars;
+
+    if (Parent != NULL) {
+        Directory->Depth = Parent->Depth + 1;
+        Directory->VolumeSerialNumber = Parent->VolumeSerialNumber;
+        Directory->AllocationSize = Parent->AllocationSize;
+    }
+
+    return Directory;
+}
+
+/**
+ Initialize a root directory, being the parent of objects matching the
+ user's search criteria.  Child directories inherit the allocation unit
+ size from here, since links to other volumes are not traversed.
+
+ @param DuContext Pointer to the DU context specifying the options to apply.
+
+ @param Directory Pointer to the root directory to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+DuInitializeRootDirectory(
+    __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory
     )
 {
+    DWORD SectorsPerCluster;
+    DWORD BytesPerSector;
+    DWORD NumberOfFreeClusters;
+    DWORD TotalNumberOfClusters;
+
     //
-    //  Note the DirectoryName string remains allocated in the hope that the
-    //  next directory can use it.
+    //  If GetDiskFreeSpace fails, see if it works on the effective root.
+    //  This is to support systems without mount points where this call can
+    //  fail when called on a directory.
     //
 
-    DirStack->DirectoryName.LengthInChars = 0;
-    DirStack->ObjectsFoundThisDirectory = 0;
-    DirStack->SpaceConsumedThisDirectory = 0;
-    DirStack->SpaceConsumedInChildren = 0;
+    if (DuContext->AllocationSize) {
+        if (!GetDiskFreeSpace(Directory->DirectoryName.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
+            YORI_STRING EffectiveRoot;
+
+            Directory->AllocationSize = 4096;
+
+            if (YoriLibFindEffectiveRoot(&Directory->DirectoryName, &EffectiveRoot) &&
+                EffectiveRoot.LengthInChars < Directory->DirectoryName.LengthInChars) {
+
+                TCHAR SavedChar;
+                SavedChar = EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars];
+                EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = '\0';
+
+                if (GetDiskFreeSpace(EffectiveRoot.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
+                    Directory->AllocationSize = SectorsPerCluster * BytesPerSector;
+                }
+
+                EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = SavedChar;
+            }
+
+        } else {
+            Directory->AllocationSize = SectorsPerCluster * BytesPerSector;
+        }
+    }
+
+    return TRUE;
 }
 
 /**
- Print the space consumed by a particular directory, and close out the
- directory's stack frame so it can be reused by the next directory.
+ Print the space consumed by a particular directory.
 
- @param DuContext Pointer to the DuContext which contains the directory to
-        display and close.
+ @param DuContext Pointer to the DuContext specifying display options.
 
- @param Depth Specifies the array index of the directory to display and close.
+ @param Directory Pointer to the directory to display.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-DuReportAndCloseStack(
+DuReportDirectory(
     __in PDU_CONTEXT DuContext,
-    __in DWORD Depth
+    __in PDU_DIRECTORY Directory
     )
 {
     YORI_STRING UnescapedPath;
@@ -282,14 +594,10 @@ DuReportAndCloseStack(
     TCHAR VtAttributeBuffer[YORI_MAX_INTERNAL_VT_ESCAPE_CHARS];
     YORILIB_COLOR_ATTRIBUTES Attribute;
 
-    PDU_DIRECTORY_STACK DirStack;
-
-    DirStack = &DuContext->DirStack[Depth];
-
     if (DuContext->MaximumDepthToDisplay == 0 ||
-        Depth <= DuContext->MaximumDepthToDisplay) {
+        Directory->Depth <= DuContext->MaximumDepthToDisplay) {
 
-        SizeToDisplay.QuadPart = DirStack->SpaceConsumedInChildren + DirStack->SpaceConsumedThisDirectory;
+        SizeToDisplay.QuadPart = Directory->SpaceConsumedInChildren + Directory->SpaceConsumedThisDirectory;
 
         if (DuContext->MinimumDirectorySizeToDisplay.QuadPart == 0 ||
             SizeToDisplay.QuadPart >= DuContext->MinimumDirectorySizeToDisplay.QuadPart) {
@@ -299,10 +607,10 @@ DuReportAndCloseStack(
             //
 
             YoriLibInitEmptyString(&UnescapedPath);
-            if (YoriLibUnescapePath(&DirStack->DirectoryName, &UnescapedPath)) {
+            if (YoriLibUnescapePath(&Directory->DirectoryName, &UnescapedPath)) {
                 StringToDisplay = &UnescapedPath;
             } else {
-                StringToDisplay = &DirStack->DirectoryName;
+                StringToDisplay = &Directory->DirectoryName;
             }
 
             //
@@ -322,17 +630,17 @@ DuReportAndCloseStack(
             YoriLibInitEmptyString(&VtAttribute);
             if (DuContext->ColorRules.NumberCriteria) {
                 WIN32_FIND_DATA FileInfo;
-        
+
                 VtAttribute.StartOfString = VtAttributeBuffer;
                 VtAttribute.LengthAllocated = sizeof(VtAttributeBuffer)/sizeof(VtAttributeBuffer[0]);
-        
-                YoriLibUpdateFindDataFromFileInformation(&FileInfo, DirStack->DirectoryName.StartOfString, TRUE);
-        
-                if (!YoriLibFileFiltCheckColorMatch(&DuContext->ColorRules, &DirStack->DirectoryName, &FileInfo, &Attribute)) {
+
+                YoriLibUpdateFindDataFromFileInformation(&FileInfo, Directory->DirectoryName.StartOfString, TRUE);
+
+                if (!YoriLibFileFiltCheckColorMatch(&DuContext->ColorRules, &Directory->DirectoryName, &FileInfo, &Attribute)) {
                     Attribute.Ctrl = YORILIB_ATTRCTRL_WINDOW_BG | YORILIB_ATTRCTRL_WINDOW_FG;
                     Attribute.Win32Attr = (UCHAR)YoriLibVtGetDefaultColor();
                 }
-        
+
                 YoriLibVtStringForTextAttribute(&VtAttribute, Attribute.Ctrl, Attribute.Win32Attr);
             }
 
@@ -353,120 +661,109 @@ DuReportAndCloseStack(
         }
     }
 
-    DuCloseStack(DirStack);
     return TRUE;
 }
 
 /**
- Display all directory frames which have not been otherwise displayed because
- no object has been found in a subsequent directory.
+ Display a completed directory tree, with each directory displayed after
+ its children, and free the tree.
 
- @param DuContext Pointer to the DuContext which may contain active directory
-        frames.
+ @param DuContext Pointer to the DuContext specifying display options.
 
- @param MinDepthToDisplay Indicates the minimum depth number that should be
-        displayed to the user.  Frames below this are cleared for reuse but
-        not displayed.
+ @param Directory Pointer to the directory to display and free.  On return
+        this allocation is no longer valid.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param MinDepthToDisplay Indicates the minimum depth number that should be
+        displayed to the user.  Directories below this are freed but not
+        displayed.
  */
-BOOL
-DuReportAndCloseAllActiveStacks(
+VOID
+DuReportAndFreeTree(
     __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory,
     __in DWORD MinDepthToDisplay
     )
 {
-    DWORD Index;
-    Index = DuContext->StackIndex;
-    if (Index >= DuContext->StackAllocated) {
-        ASSERT(Index == 0);
-        ASSERT(DuContext->DirStack == NULL);
-        return TRUE;
+    PYORI_LIST_ENTRY ListEntry;
+    PDU_DIRECTORY Child;
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->ChildList, NULL);
+    while (ListEntry != NULL) {
+        Child = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, SiblingListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->ChildList, ListEntry);
+        YoriLibRemoveListItem(&Child->SiblingListEntry);
+        DuReportAndFreeTree(DuContext, Child, MinDepthToDisplay);
     }
-    while (TRUE) {
-        if (Index > 0) {
-            DuContext->DirStack[Index - 1].SpaceConsumedInChildren += DuContext->DirStack[Index].SpaceConsumedInChildren + DuContext->DirStack[Index].SpaceConsumedThisDirectory;
-        }
-        if (Index >= MinDepthToDisplay) {
-            DuReportAndCloseStack(DuContext, Index);
-        } else {
-            DuCloseStack(&DuContext->DirStack[Index]);
-        }
-        if (Index == 0) {
-            break;
-        }
-        Index--;
-        DuContext->StackIndex--;
+
+    if (Directory->Depth >= MinDepthToDisplay && !DuContext->Cancelled) {
+        DuReportDirectory(DuContext, Directory);
     }
-    return TRUE;
+
+    YoriLibFree(Directory);
 }
 
 /**
- Initialize a single directory stack location.
-
- @param DuContext Pointer to the DU context specifying the options to apply.
+ Release a reference on a directory.  When the final reference is released,
+ all child directories have completed, so the space consumed by them is
+ final and is accumulated into this directory, and the reference this
+ directory holds on its parent is released in turn.  No locks are required
+ because each directory is only finalized by the thread that releases its
+ final reference.
 
- @param DirStack Pointer to the directory stack location to initialize.
+ @param DuContext Pointer to the DU context.
 
- @param DirName Pointer to the directory name to initialize in the stack.
-
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param Directory Pointer to the directory to release a reference on.
  */
-BOOL
-DuInitializeDirectoryStack(
+VOID
+DuDereferenceDirectory(
     __in PDU_CONTEXT DuContext,
-    __in PDU_DIRECTORY_STACK DirStack,
-    __in PYORI_STRING DirName
+    __in PDU_DIRECTORY Directory
     )
 {
-    DWORD SectorsPerCluster;
-    DWORD BytesPerSector;
-    DWORD NumberOfFreeClusters;
-    DWORD TotalNumberOfClusters;
+    PYORI_LIST_ENTRY ListEntry;
+    PDU_DIRECTORY Child;
 
-    if (DirStack->DirectoryName.LengthAllocated <= DirName->LengthInChars) {
-        YoriLibFreeStringContents(&DirStack->DirectoryName);
-        if (!YoriLibAllocateString(&DirStack->DirectoryName, DirName->LengthInChars + 80)) {
-            return FALSE;
+    while (Directory != NULL) {
+        if (InterlockedDecrement(&Directory->ReferenceCount) != 0) {
+            break;
         }
-    }
-
-    memcpy(DirStack->DirectoryName.StartOfString, DirName->StartOfString, DirName->LengthInChars * sizeof(TCHAR));
-    DirStack->DirectoryName.StartOfString[DirName->LengthInChars] = '\0';
-    DirStack->DirectoryName.LengthInChars = DirName->LengthInChars;
-
-    //
-    //  If GetDiskFreeSpace fails, see if it works on the effective root.
-    //  This is to support systems without mount points where this call can
-    //  fail when called on a directory.
-    //
-
-    if (DuContext->AllocationSize) {
-        if (!GetDiskFreeSpace(DirStack->DirectoryName.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
-            YORI_STRING EffectiveRoot;
-
-            DirStack->AllocationSize = 4096;
-
-            if (YoriLibFindEffectiveRoot(&DirStack->DirectoryName, &EffectiveRoot) &&
-                EffectiveRoot.LengthInChars < DirStack->DirectoryName.LengthInChars) {
 
-                TCHAR SavedChar;
-                SavedChar = EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars];
-                EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = '\0';
-
-                if (GetDiskFreeSpace(EffectiveRoot.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
-                    DirStack->AllocationSize = SectorsPerCluster * BytesPerSector;
-                }
+        Directory->SpaceConsumedInChildren = 0;
+        ListEntry = YoriLibGetNextListEntry(&Directory->ChildList, NULL);
+        while (ListEntry != NULL) {
+            Child = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, SiblingListEntry);
+            Directory->SpaceConsumedInChildren += Child->SpaceConsumedInChildren + Child->SpaceConsumedThisDirectory;
+            ListEntry = YoriLibGetNextListEntry(&Directory->ChildList, ListEntry);
+        }
 
-                EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = SavedChar;
+        if (Directory->Parent == NULL) {
+            if (InterlockedDecrement(&DuContext->RootsOutstanding) == 0) {
+                SetEvent(DuContext->AllRootsCompleteEvent);
             }
-
-        } else {
-            DirStack->AllocationSize = SectorsPerCluster * BytesPerSector;
         }
+
+        Directory = Directory->Parent;
     }
+}
 
-    return TRUE;
+/**
+ Add a directory to the queue of directories to be enumerated by worker
+ threads.
+
+ @param DuContext Pointer to the DU context.
+
+ @param Directory Pointer to the directory to enumerate.
+ */
+VOID
+DuQueueDirectory(
+    __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory
+    )
+{
+    WaitForSingleObject(DuContext->Mutex, INFINITE);
+    YoriLibAppendList(&DuContext->PendingList, &Directory->PendingListEntry);
+    ReleaseMutex(DuContext->Mutex);
+    SetEvent(DuContext->WorkerWaitEvent);
 }
 
 /**
@@ -475,12 +772,12 @@ DuInitializeDirectoryStack(
 
  @param DuContext Context specifying the accounting options to apply.
 
- @param DirStack Pointer to the directory stack indicating the allocation size
-        used for the directory.
+ @param Directory Pointer to the directory containing the file, indicating
+        the allocation size and volume used for the directory.
 
  @param FilePath Pointer to a fully specified path to the file.
 
- @param FileInfo Pointer to the block of data returned from directory
+ @param FileEntry Pointer to the block of data returned from directory
         enumerate.
 
  @return The number of bytes attributable to the file.
@@ -488,19 +785,41 @@ DuInitializeDirectoryStack(
 LARGE_INTEGER
 DuCalculateSpaceUsedByFile(
     __in PDU_CONTEXT DuContext,
-    __in PDU_DIRECTORY_STACK DirStack,
+    __in PDU_DIRECTORY Directory,
     __in PYORI_STRING FilePath,
-    __in PWIN32_FIND_DATA FileInfo
+    __in PDU_FILE_ENTRY FileEntry
     )
 {
     LARGE_INTEGER FileSize;
     HANDLE FileHandle = INVALID_HANDLE_VALUE;
     BOOL ForceSizeZero = FALSE;
     BOOL ReportedOpenError = FALSE;
+    BOOL IsWofBacked = FALSE;
+    BOOL NeedHandle = FALSE;
 
     FileSize.QuadPart = 0;
 
-    if (DuContext->AverageHardLinkSize || DuContext->WimBackedFilesAsZero) {
+    if ((FileEntry->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 &&
+        FileEntry->ReparseTag == IO_REPARSE_TAG_WOF) {
+
+        IsWofBacked = TRUE;
+    }
+
+    //
+    //  A handle is only needed to check for WIM backing, which only applies
+    //  to WOF reparse points, or to find the file ID if the enumeration
+    //  didn't return it.
+    //
+
+    if (DuContext->WimBackedFilesAsZero && IsWofBacked) {
+        NeedHandle = TRUE;
+    }
+
+    if (DuContext->SingleCountHardLinks && !FileEntry->FileIdValid) {
+        NeedHandle = TRUE;
+    }
+
+    if (NeedHandle) {
 
         FileHandle = CreateFile(FilePath->StartOfString,
                                 FILE_READ_ATTRIBUTES|SYNCHRONIZE,
@@ -519,18 +838,53 @@ DuCalculateSpaceUsedByFile(
     }
 
     //
-    //  If the file is WIM backed and the user requested it, count the default
-    //  stream size as zero.
+    //  If hard links should only be counted once, check whether this file
+    //  has been seen already.  If the enumeration didn't supply a file ID,
+    //  query it from the handle, and only record files that have more than
+    //  one link.
     //
 
-    if (DuContext->WimBackedFilesAsZero) {
-        struct {
-            WOF_EXTERNAL_INFO WofHeader;
-            union {
-                WIM_PROVIDER_EXTERNAL_INFO WimInfo;
-                FILE_PROVIDER_EXTERNAL_INFO FileInfo;
-            } u;
-        } WofInfo;
+    if (DuContext->SingleCountHardLinks) {
+        if (FileEntry->FileIdValid) {
+            if (!DuFileIdSetInsert(DuContext, Directory->VolumeSerialNumber, &FileEntry->FileId)) {
+                ForceSizeZero = TRUE;
+            }
+        } else if (FileHandle != INVALID_HANDLE_VALUE) {
+            BY_HANDLE_FILE_INFORMATION HandleFileInfo;
+            LARGE_INTEGER FileId;
+
+            if (GetFileInformationByHandle(FileHandle, &HandleFileInfo) &&
+                HandleFileInfo.nNumberOfLinks > 1) {
+
+                FileId.LowPart = HandleFileInfo.nFileIndexLow;
+                FileId.HighPart = HandleFileInfo.nFileIndexHigh;
+                if (!DuFileIdSetInsert(DuContext, HandleFileInfo.dwVolumeSerialNumber, &FileId)) {
+                    ForceSizeZero = TRUE;
+                }
+            }
+        }
+
+        if (ForceSizeZero) {
+            if (FileHandle != INVALID_HANDLE_VALUE) {
+                CloseHandle(FileHandle);
+            }
+            return FileSize;
+        }
+    }
+
+    //
+    //  If the file is WIM backed and the user requested it, count the default
+    //  stream size as zero.
+    //
+
+    if (DuContext->WimBackedFilesAsZero && FileHandle != INVALID_HANDLE_VALUE && IsWofBacked) {
+        struct {
+            WOF_EXTERNAL_INFO WofHeader;
+            union {
+                WIM_PROVIDER_EXTERNAL_INFO WimInfo;
+                FILE_PROVIDER_EXTERNAL_INFO FileInfo;
+            } u;
+        } WofInfo;
         DWORD BytesReturned;
 
         if (DeviceIoControl(FileHandle, FSCTL_GET_EXTERNAL_BACKING, NULL, 0, &WofInfo, sizeof(WofInfo), &BytesReturned, NULL)) {
@@ -543,22 +897,32 @@ DuCalculateSpaceUsedByFile(
 
     //
     //  If the default stream size wasn't forced to zero above, calculate it
-    //  now as either the compressed or uncompressed file size.
+    //  now as either the compressed or uncompressed file size.  For files
+    //  compressed by the file system, the allocation size returned from the
+    //  enumeration is the compressed size.  WOF compressed files store their
+    //  data in a different stream, so these need to be queried explicitly.
     //
 
     if (!ForceSizeZero) {
         if (DuContext->CompressedFileSize &&
-            DllKernel32.pGetCompressedFileSizeW) {
-    
+            FileEntry->AllocationSizeValid &&
+            !IsWofBacked) {
+
+            if ((FileEntry->FileAttributes & (FILE_ATTRIBUTE_COMPRESSED | FILE_ATTRIBUTE_SPARSE_FILE)) != 0) {
+                FileSize.QuadPart = FileEntry->AllocationSize.QuadPart;
+            } else {
+                FileSize.QuadPart = FileEntry->EndOfFile.QuadPart;
+            }
+        } else if (DuContext->CompressedFileSize &&
+                   DllKernel32.pGetCompressedFileSizeW) {
+
             FileSize.LowPart = DllKernel32.pGetCompressedFileSizeW(FilePath->StartOfString, (PDWORD)&FileSize.HighPart);
-    
+
             if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
-                FileSize.LowPart = FileInfo->nFileSizeLow;
-                FileSize.HighPart = FileInfo->nFileSizeHigh;
+                FileSize.QuadPart = FileEntry->EndOfFile.QuadPart;
             }
         } else {
-            FileSize.LowPart = FileInfo->nFileSizeLow;
-            FileSize.HighPart = FileInfo->nFileSizeHigh;
+            FileSize.QuadPart = FileEntry->EndOfFile.QuadPart;
         }
     }
 
@@ -567,7 +931,7 @@ DuCalculateSpaceUsedByFile(
     //
 
     if (DuContext->AllocationSize) {
-        FileSize.QuadPart = (FileSize.QuadPart + DirStack->AllocationSize - 1) & (~(DirStack->AllocationSize - 1));
+        FileSize.QuadPart = (FileSize.QuadPart + Directory->AllocationSize - 1) & (~(Directory->AllocationSize - 1));
     }
 
     //
@@ -596,7 +960,7 @@ DuCalculateSpaceUsedByFile(
                 if (_tcscmp(FindStreamData.cStreamName, L"::$DATA") != 0) {
                     FileSize.QuadPart += FindStreamData.StreamSize.QuadPart;
                     if (DuContext->AllocationSize) {
-                        FileSize.QuadPart = (FileSize.QuadPart + DirStack->AllocationSize - 1) & (~(DirStack->AllocationSize - 1));
+                        FileSize.QuadPart = (FileSize.QuadPart + Directory->AllocationSize - 1) & (~(Directory->AllocationSize - 1));
                     }
                 }
             } while (DllKernel32.pFindNextStreamW(hFind, &FindStreamData));
@@ -604,169 +968,616 @@ DuCalculateSpaceUsedByFile(
         }
     }
 
+    if (FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(FileHandle);
+    }
+
+    return FileSize;
+}
+
+/**
+ Account for a single object found within a directory.  Files have their
+ space added to the directory.  Directories which are not links are added
+ as children of the directory and queued for enumeration.
+
+ @param DuContext Pointer to the DU context.
+
+ @param Directory Pointer to the directory containing the object.
+
+ @param FilePath Pointer to a fully specified path to the object.
+
+ @param FileEntry Pointer to information about the object.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+DuProcessDirectoryEntry(
+    __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory,
+    __in PYORI_STRING FilePath,
+    __in PDU_FILE_ENTRY FileEntry
+    )
+{
+    PDU_DIRECTORY Child;
+    LARGE_INTEGER FileSize;
+
+    Directory->ObjectsFoundThisDirectory++;
+
+    if ((FileEntry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        FileSize = DuCalculateSpaceUsedByFile(DuContext, Directory, FilePath, FileEntry);
+        Directory->SpaceConsumedThisDirectory += FileSize.QuadPart;
+        return TRUE;
+    }
+
     //
-    //  If the file has a size and hardlink averaging is reuqested, divide the
-    //  size found by the number of hard links.
+    //  Symbolic links and mount points are not traversed.
     //
 
-    if (DuContext->AverageHardLinkSize && FileHandle != INVALID_HANDLE_VALUE && FileSize.QuadPart != 0) {
-        BY_HANDLE_FILE_INFORMATION HandleFileInfo;
+    if ((FileEntry->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 &&
+        (FileEntry->ReparseTag == IO_REPARSE_TAG_MOUNT_POINT ||
+         FileEntry->ReparseTag == IO_REPARSE_TAG_SYMLINK)) {
 
-        if (GetFileInformationByHandle(FileHandle, &HandleFileInfo)) {
-            if (HandleFileInfo.nNumberOfLinks > 1) {
-                FileSize.QuadPart = FileSize.QuadPart / HandleFileInfo.nNumberOfLinks;
-            }
+        return TRUE;
+    }
+
+    Child = DuAllocateDirectory(Directory, FilePath);
+    if (Child == NULL) {
+        return FALSE;
+    }
+
+    YoriLibAppendList(&Directory->ChildList, &Child->SiblingListEntry);
+    InterlockedIncrement(&Directory->ReferenceCount);
+    DuQueueDirectory(DuContext, Child);
+    return TRUE;
+}
+
+/**
+ Build the full path to an object within a directory.
+
+ @param Directory Pointer to the directory containing the object.
+
+ @param FileName Pointer to the name of the object within the directory.
+
+ @param FilePath Pointer to a string to populate with the full path.  This
+        string is reallocated if it is not large enough.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+DuBuildChildPath(
+    __in PDU_DIRECTORY Directory,
+    __in PYORI_STRING FileName,
+    __inout PYORI_STRING FilePath
+    )
+{
+    DWORD LengthNeeded;
+    DWORD DirLength;
+
+    DirLength = Directory->DirectoryName.LengthInChars;
+    LengthNeeded = DirLength + 1 + FileName->LengthInChars + 1;
+    if (FilePath->LengthAllocated < LengthNeeded) {
+        YoriLibFreeStringContents(FilePath);
+        if (!YoriLibAllocateString(FilePath, LengthNeeded + 80)) {
+            return FALSE;
         }
     }
 
-    if (FileHandle != INVALID_HANDLE_VALUE) {
-        CloseHandle(FileHandle);
+    memcpy(FilePath->StartOfString, Directory->DirectoryName.StartOfString, DirLength * sizeof(TCHAR));
+    FilePath->LengthInChars = DirLength;
+    if (DirLength == 0 || !YoriLibIsSep(FilePath->StartOfString[DirLength - 1])) {
+        FilePath->StartOfString[FilePath->LengthInChars] = '\\';
+        FilePath->LengthInChars++;
     }
+    memcpy(&FilePath->StartOfString[FilePath->LengthInChars], FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
+    FilePath->LengthInChars += FileName->LengthInChars;
+    FilePath->StartOfString[FilePath->LengthInChars] = '\0';
+    return TRUE;
+}
 
+/**
+ Returns TRUE if the name refers to the current or parent directory.
 
-    return FileSize;
+ @param FileName Pointer to the file name.
+
+ @return TRUE if the name is . or .., FALSE otherwise.
+ */
+BOOL
+DuIsDotFile(
+    __in PYORI_STRING FileName
+    )
+{
+    if (FileName->LengthInChars == 1 && FileName->StartOfString[0] == '.') {
+        return TRUE;
+    }
+    if (FileName->LengthInChars == 2 && FileName->StartOfString[0] == '.' && FileName->StartOfString[1] == '.') {
+        return TRUE;
+    }
+    return FALSE;
 }
 
+/**
+ Report that a directory could not be enumerated.
+
+ @param Directory Pointer to the directory that could not be enumerated.
 
+ @param ErrorCode The Win32 error code describing the failure.
+ */
+VOID
+DuReportEnumerateError(
+    __in PDU_DIRECTORY Directory,
+    __in DWORD ErrorCode
+    )
+{
+    LPTSTR ErrText = YoriLibGetWinErrorText(ErrorCode);
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Enumerate of %y failed, results incomplete: %s"), &Directory->DirectoryName, ErrText);
+    YoriLibFreeWinErrorText(ErrText);
+}
 
 /**
- A callback that is invoked when a file is found that matches a search criteria
- specified in the set of strings to enumerate.
+ Enumerate a directory using the ID based directory information class, which
+ returns sizes, allocation sizes and file IDs without opening each file.
 
- @param FilePath Pointer to the file path that was found.
+ @param DuContext Pointer to the DU context.
 
- @param FileInfo Information about the file.
+ @param Directory Pointer to the directory to enumerate.
 
- @param Depth Recursion depth, ignored in this application.
+ @param FilePath Pointer to a scratch string used to construct full paths.
 
- @param Context Pointer to the du context structure indicating the
-        action to perform and populated with the number of objects found.
+ @param EnumBuffer Pointer to a buffer to receive enumeration information.
 
- @return TRUE to continute enumerating, FALSE to abort.
+ @param EnumBufferLength The length of EnumBuffer, in bytes.
+
+ @return TRUE if the directory was enumerated or an error reported, FALSE if
+         this enumeration class is not supported and the caller should fall
+         back to another mechanism.
  */
 BOOL
-DuFileFoundCallback(
-    __in PYORI_STRING FilePath,
-    __in PWIN32_FIND_DATA FileInfo,
-    __in DWORD Depth,
-    __in PVOID Context
+DuEnumerateDirectoryById(
+    __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory,
+    __inout PYORI_STRING FilePath,
+    __in PUCHAR EnumBuffer,
+    __in DWORD EnumBufferLength
     )
 {
-    PDU_CONTEXT DuContext = (PDU_CONTEXT)Context;
-    LPTSTR FilePart;
-    DWORD Index;
+    HANDLE DirHandle;
+    BY_HANDLE_FILE_INFORMATION HandleFileInfo;
+    PFILE_ID_BOTH_DIR_INFO DirInfo;
+    DU_FILE_ENTRY FileEntry;
+    YORI_STRING FileName;
+    DWORD InfoClass;
+    DWORD ErrorCode;
+    BOOL FirstQuery;
+
+    DirHandle = CreateFile(Directory->DirectoryName.StartOfString,
+                           FILE_LIST_DIRECTORY|FILE_READ_ATTRIBUTES|SYNCHRONIZE,
+                           FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS,
+                           NULL);
+
+    if (DirHandle == INVALID_HANDLE_VALUE) {
+        DuReportEnumerateError(Directory, GetLastError());
+        return TRUE;
+    }
 
-    if (Depth >= DuContext->StackAllocated) {
-        PDU_DIRECTORY_STACK NewStack;
-        NewStack = YoriLibMalloc((Depth + 8) * sizeof(DU_DIRECTORY_STACK));
-        if (NewStack == NULL) {
-            return FALSE;
-        }
+    if (GetFileInformationByHandle(DirHandle, &HandleFileInfo)) {
+        Directory->VolumeSerialNumber = HandleFileInfo.dwVolumeSerialNumber;
+    }
+
+    YoriLibInitEmptyString(&FileName);
+    InfoClass = FileIdBothDirectoryRestartInfo;
+    FirstQuery = TRUE;
+
+    while (DllKernel32.pGetFileInformationByHandleEx(DirHandle, InfoClass, EnumBuffer, EnumBufferLength)) {
+        InfoClass = FileIdBothDirectoryInfo;
+        FirstQuery = FALSE;
+        DirInfo = (PFILE_ID_BOTH_DIR_INFO)EnumBuffer;
+
+        while (TRUE) {
+            FileName.StartOfString = DirInfo->FileName;
+            FileName.LengthInChars = DirInfo->FileNameLength / sizeof(WCHAR);
+
+            if (!DuIsDotFile(&FileName)) {
+                FileEntry.FileAttributes = DirInfo->FileAttributes;
+                FileEntry.ReparseTag = 0;
+                if ((DirInfo->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+                    FileEntry.ReparseTag = DirInfo->EaSize;
+                }
+                FileEntry.EndOfFile.QuadPart = DirInfo->EndOfFile.QuadPart;
+                FileEntry.AllocationSize.QuadPart = DirInfo->AllocationSize.QuadPart;
+                FileEntry.FileId.QuadPart = DirInfo->FileId.QuadPart;
+                FileEntry.AllocationSizeValid = TRUE;
+                FileEntry.FileIdValid = (BOOLEAN)(DirInfo->FileId.QuadPart != 0);
+
+                if (!DuBuildChildPath(Directory, &FileName, FilePath) ||
+                    !DuProcessDirectoryEntry(DuContext, Directory, FilePath, &FileEntry)) {
+
+                    CloseHandle(DirHandle);
+                    return TRUE;
+                }
+            }
 
-        if (DuContext->StackAllocated > 0) {
-            memcpy(NewStack, DuContext->DirStack, DuContext->StackAllocated * sizeof(DU_DIRECTORY_STACK));
-            YoriLibFree(DuContext->DirStack);
+            if (DirInfo->NextEntryOffset == 0) {
+                break;
+            }
+            DirInfo = (PFILE_ID_BOTH_DIR_INFO)((PUCHAR)DirInfo + DirInfo->NextEntryOffset);
         }
 
-        for (Index = DuContext->StackAllocated; Index < Depth + 8; Index++) {
-            YoriLibInitEmptyString(&NewStack[Index].DirectoryName);
-            NewStack[Index].ObjectsFoundThisDirectory = 0;
-            NewStack[Index].SpaceConsumedThisDirectory = 0;
-            NewStack[Index].SpaceConsumedInChildren = 0;
+        if (YoriLibIsOperationCancelled()) {
+            DuContext->Cancelled = TRUE;
+            break;
         }
+    }
+
+    ErrorCode = GetLastError();
+    CloseHandle(DirHandle);
 
-        DuContext->DirStack = NewStack;
-        DuContext->StackAllocated = Depth + 8;
+    if (FirstQuery &&
+        (ErrorCode == ERROR_INVALID_PARAMETER ||
+         ErrorCode == ERROR_NOT_SUPPORTED ||
+         ErrorCode == ERROR_INVALID_FUNCTION)) {
+
+        return FALSE;
     }
 
-    //
-    //  StackIndex would normally be populated except for the first item at
-    //  Depth == 0
-    //
+    if (!DuContext->Cancelled &&
+        ErrorCode != ERROR_NO_MORE_FILES &&
+        ErrorCode != ERROR_FILE_NOT_FOUND) {
 
-    if (DuContext->StackIndex > 0 || DuContext->DirStack[0].DirectoryName.LengthInChars > 0) {
-        Index = DuContext->StackIndex;
-        while (TRUE) {
-            DWORD StackDirLength;
-            StackDirLength = DuContext->DirStack[Index].DirectoryName.LengthInChars;
-            if (Depth >= Index &&
-                YoriLibCompareStringCount(FilePath, &DuContext->DirStack[Index].DirectoryName, StackDirLength) == 0 &&
-                (FilePath->LengthInChars == StackDirLength ||
-                 YoriLibIsSep(FilePath->StartOfString[StackDirLength]) ||
-                 YoriLibIsSep(DuContext->DirStack[Index].DirectoryName.StartOfString[StackDirLength - 1]))) {
+        DuReportEnumerateError(Directory, ErrorCode);
+    }
 
-                break;
-            }
+    return TRUE;
+}
+
+/**
+ Enumerate a directory using FindFirstFile, for systems or file systems that
+ do not support ID based enumeration.
 
-            // YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Reporting because file %y (depth %i) not in directory %y (depth %i)\n"), FilePath, Depth, &DuContext->DirStack[Index].DirectoryName, Index);
-            if (Index > 0) {
-                DuContext->DirStack[Index - 1].SpaceConsumedInChildren += DuContext->DirStack[Index].SpaceConsumedInChildren + DuContext->DirStack[Index].SpaceConsumedThisDirectory;
+ @param DuContext Pointer to the DU context.
+
+ @param Directory Pointer to the directory to enumerate.
+
+ @param FilePath Pointer to a scratch string used to construct full paths.
+ */
+VOID
+DuEnumerateDirectoryByFind(
+    __in PDU_CONTEXT DuContext,
+    __in PDU_DIRECTORY Directory,
+    __inout PYORI_STRING FilePath
+    )
+{
+    HANDLE hFind;
+    WIN32_FIND_DATA FindData;
+    DU_FILE_ENTRY FileEntry;
+    YORI_STRING FileName;
+
+    YoriLibConstantString(&FileName, _T("*"));
+    if (!DuBuildChildPath(Directory, &FileName, FilePath)) {
+        return;
+    }
+
+    hFind = FindFirstFile(FilePath->StartOfString, &FindData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        DuReportEnumerateError(Directory, GetLastError());
+        return;
+    }
+
+    ZeroMemory(&FileEntry, sizeof(FileEntry));
+
+    do {
+        YoriLibConstantString(&FileName, FindData.cFileName);
+        if (!DuIsDotFile(&FileName)) {
+            FileEntry.FileAttributes = FindData.dwFileAttributes;
+            FileEntry.ReparseTag = 0;
+            if ((FindData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+                FileEntry.ReparseTag = FindData.dwReserved0;
             }
-            DuReportAndCloseStack(DuContext, Index);
-            if (Index == 0) {
+            FileEntry.EndOfFile.LowPart = FindData.nFileSizeLow;
+            FileEntry.EndOfFile.HighPart = FindData.nFileSizeHigh;
+
+            if (!DuBuildChildPath(Directory, &FileName, FilePath) ||
+                !DuProcessDirectoryEntry(DuContext, Directory, FilePath, &FileEntry)) {
+
                 break;
             }
-            Index--;
-            DuContext->StackIndex--;
         }
-    }
 
-    FilePart = YoriLibFindRightMostCharacter(FilePath, '\\');
-    ASSERT(FilePart != NULL);
-    if (FilePart != NULL) {
-        YORI_STRING ThisDirName;
-        YoriLibInitEmptyString(&ThisDirName);
-        ThisDirName.StartOfString = FilePath->StartOfString;
-        ThisDirName.LengthInChars = (DWORD)(FilePart - FilePath->StartOfString);
-        if (ThisDirName.LengthInChars == 6) {
-            ThisDirName.LengthInChars++;
-            if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ThisDirName)) {
-                ThisDirName.LengthInChars--;
-            }
+        if (YoriLibIsOperationCancelled()) {
+            DuContext->Cancelled = TRUE;
+            break;
         }
 
-        Index = Depth;
-        while (TRUE) {
-            if (DuContext->DirStack[Index].DirectoryName.LengthInChars > 0) {
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+}
+
+/**
+ A worker thread which enumerates directories found on the pending list.
+ Each directory enumerated may add more directories to the pending list.
 
-                ASSERT(Index == DuContext->StackIndex);
-                ASSERT(YoriLibCompareString(&DuContext->DirStack[Index].DirectoryName, &ThisDirName) == 0);
+ @param Context Pointer to the DU context.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+DWORD WINAPI
+DuWorker(
+    __in LPVOID Context
+    )
+{
+    PDU_CONTEXT DuContext = (PDU_CONTEXT)Context;
+    PDU_DIRECTORY Directory;
+    DWORD FoundEvent;
+    HANDLE WaitHandles[2];
+    YORI_STRING FilePath;
+    PUCHAR EnumBuffer;
+    BOOL MoreWork;
+
+    YoriLibInitEmptyString(&FilePath);
+    EnumBuffer = NULL;
+    if (DllKernel32.pGetFileInformationByHandleEx) {
+        EnumBuffer = YoriLibMalloc(DU_ENUM_BUFFER_SIZE);
+    }
+
+    WaitHandles[0] = DuContext->WorkerWaitEvent;
+    WaitHandles[1] = DuContext->WorkerShutdownEvent;
+
+    while (TRUE) {
+
+        //
+        //  Wait for an indication of more work or shutdown.
+        //
+
+        FoundEvent = WaitForMultipleObjects(2, WaitHandles, FALSE, INFINITE);
+
+        //
+        //  Process any queued work.  If more work remains after removing an
+        //  item, wake another worker to process it.
+        //
+
+        while (TRUE) {
+            WaitForSingleObject(DuContext->Mutex, INFINITE);
+            if (YoriLibIsListEmpty(&DuContext->PendingList)) {
+                ReleaseMutex(DuContext->Mutex);
                 break;
             }
-            if (!DuInitializeDirectoryStack(DuContext, &DuContext->DirStack[Index], &ThisDirName)) {
-                return FALSE;
-            }
-            ASSERT(DuContext->DirStack[Index].ObjectsFoundThisDirectory == 0);
-            ASSERT(DuContext->DirStack[Index].SpaceConsumedThisDirectory == 0);
-            ASSERT(DuContext->DirStack[Index].SpaceConsumedInChildren == 0);
-            if (Index == 0) {
-                break;
+            Directory = CONTAINING_RECORD(DuContext->PendingList.Next, DU_DIRECTORY, PendingListEntry);
+            YoriLibRemoveListItem(&Directory->PendingListEntry);
+            MoreWork = !YoriLibIsListEmpty(&DuContext->PendingList);
+            ReleaseMutex(DuContext->Mutex);
+
+            if (MoreWork) {
+                SetEvent(DuContext->WorkerWaitEvent);
             }
-            Index--;
-            FilePart = YoriLibFindRightMostCharacter(&ThisDirName, '\\');
-            ASSERT(FilePart != NULL);
-            ThisDirName.LengthInChars = (DWORD)(FilePart - ThisDirName.StartOfString);
-            if (ThisDirName.LengthInChars == 6) {
-                ThisDirName.LengthInChars++;
-                if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ThisDirName)) {
-                    ThisDirName.LengthInChars--;
+
+            if (!DuContext->Cancelled) {
+                if (EnumBuffer == NULL ||
+                    !DuEnumerateDirectoryById(DuContext, Directory, &FilePath, EnumBuffer, DU_ENUM_BUFFER_SIZE)) {
+
+                    DuEnumerateDirectoryByFind(DuContext, Directory, &FilePath);
                 }
             }
+
+            DuDereferenceDirectory(DuContext, Directory);
         }
+
+        //
+        //  If shutdown was requested, terminate the thread.
+        //
+
+        if (FoundEvent == (WAIT_OBJECT_0 + 1)) {
+            break;
+        }
+    }
+
+    YoriLibFreeStringContents(&FilePath);
+    if (EnumBuffer != NULL) {
+        YoriLibFree(EnumBuffer);
+    }
+
+    return TRUE;
+}
+
+/**
+ Create the synchronization objects and worker threads used to enumerate
+ directories.
+
+ @param DuContext Pointer to the DU context.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+DuInitializeWorkers(
+    __in PDU_CONTEXT DuContext
+    )
+{
+    SYSTEM_INFO SystemInfo;
+    DWORD MaxThreads;
+    DWORD ThreadId;
+
+    YoriLibInitializeListHead(&DuContext->RootList);
+    YoriLibInitializeListHead(&DuContext->PendingList);
+
+    DuContext->WorkerWaitEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (DuContext->WorkerWaitEvent == NULL) {
+        return FALSE;
+    }
+
+    DuContext->WorkerShutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (DuContext->WorkerShutdownEvent == NULL) {
+        return FALSE;
+    }
+
+    DuContext->AllRootsCompleteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (DuContext->AllRootsCompleteEvent == NULL) {
+        return FALSE;
+    }
+
+    DuContext->Mutex = CreateMutex(NULL, FALSE, NULL);
+    if (DuContext->Mutex == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  Enumeration spends most of its time waiting on the file system, so
+    //  use twice as many threads as processors to keep the device busy.
+    //
+
+    GetSystemInfo(&SystemInfo);
+    MaxThreads = SystemInfo.dwNumberOfProcessors * 2;
+    if (MaxThreads < 2) {
+        MaxThreads = 2;
+    }
+    if (MaxThreads > 32) {
+        MaxThreads = 32;
     }
 
-    DuContext->StackIndex = Depth;
-    DuContext->DirStack[Depth].ObjectsFoundThisDirectory++;
+    DuContext->Threads = YoriLibMalloc(sizeof(HANDLE) * MaxThreads);
+    if (DuContext->Threads == NULL) {
+        return FALSE;
+    }
+
+    for (DuContext->ThreadsAllocated = 0; DuContext->ThreadsAllocated < MaxThreads; DuContext->ThreadsAllocated++) {
+        DuContext->Threads[DuContext->ThreadsAllocated] = CreateThread(NULL, 0, DuWorker, DuContext, 0, &ThreadId);
+        if (DuContext->Threads[DuContext->ThreadsAllocated] == NULL) {
+            break;
+        }
+    }
 
-    if ((FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
-        LARGE_INTEGER FileSize;
-        FileSize = DuCalculateSpaceUsedByFile(DuContext, &DuContext->DirStack[Depth], FilePath, FileInfo);
-        DuContext->DirStack[Depth].SpaceConsumedThisDirectory += FileSize.QuadPart;
+    if (DuContext->ThreadsAllocated == 0) {
+        return FALSE;
     }
 
     return TRUE;
 }
 
+/**
+ Deallocate all child allocations within a DU_CONTEXT structure, including
+ waiting for worker threads to terminate.  The structure itself is typically
+ stack allocated and will not be freed.
+
+ @param DuContext Pointer to the DuContext to clean up.
+ */
+VOID
+DuCleanupContext(
+    __in PDU_CONTEXT DuContext
+    )
+{
+    DWORD Index;
+
+    if (DuContext->ThreadsAllocated > 0) {
+        SetEvent(DuContext->WorkerShutdownEvent);
+        WaitForMultipleObjects(DuContext->ThreadsAllocated, DuContext->Threads, TRUE, INFINITE);
+        for (Index = 0; Index < DuContext->ThreadsAllocated; Index++) {
+            CloseHandle(DuContext->Threads[Index]);
+            DuContext->Threads[Index] = NULL;
+        }
+        DuContext->ThreadsAllocated = 0;
+    }
+    if (DuContext->Threads != NULL) {
+        YoriLibFree(DuContext->Threads);
+        DuContext->Threads = NULL;
+    }
+    if (DuContext->WorkerWaitEvent != NULL) {
+        CloseHandle(DuContext->WorkerWaitEvent);
+        DuContext->WorkerWaitEvent = NULL;
+    }
+    if (DuContext->WorkerShutdownEvent != NULL) {
+        CloseHandle(DuContext->WorkerShutdownEvent);
+        DuContext->WorkerShutdownEvent = NULL;
+    }
+    if (DuContext->AllRootsCompleteEvent != NULL) {
+        CloseHandle(DuContext->AllRootsCompleteEvent);
+        DuContext->AllRootsCompleteEvent = NULL;
+    }
+    if (DuContext->Mutex != NULL) {
+        CloseHandle(DuContext->Mutex);
+        DuContext->Mutex = NULL;
+    }
+
+    DuFileIdSetFree(DuContext);
+    YoriLibFileFiltFreeFilter(&DuContext->ColorRules);
+}
+
+/**
+ A callback that is invoked when a file is found that matches a search criteria
+ specified in the set of strings to enumerate.  Each object is accounted to
+ a root directory representing its parent, and directories are queued for
+ enumeration by worker threads.
+
+ @param FilePath Pointer to the file path that was found.
+
+ @param FileInfo Information about the file.
+
+ @param Depth Recursion depth, ignored in this application.
+
+ @param Context Pointer to the du context structure indicating the
+        action to perform and populated with the number of objects found.
+
+ @return TRUE to continute enumerating, FALSE to abort.
+ */
+BOOL
+DuFileFoundCallback(
+    __in PYORI_STRING FilePath,
+    __in PWIN32_FIND_DATA FileInfo,
+    __in DWORD Depth,
+    __in PVOID Context
+    )
+{
+    PDU_CONTEXT DuContext = (PDU_CONTEXT)Context;
+    PDU_DIRECTORY Root;
+    DU_FILE_ENTRY FileEntry;
+    LPTSTR FilePart;
+    YORI_STRING ThisDirName;
+
+    UNREFERENCED_PARAMETER(Depth);
+
+    FilePart = YoriLibFindRightMostCharacter(FilePath, '\\');
+    ASSERT(FilePart != NULL);
+    if (FilePart == NULL) {
+        return TRUE;
+    }
+
+    YoriLibInitEmptyString(&ThisDirName);
+    ThisDirName.StartOfString = FilePath->StartOfString;
+    ThisDirName.LengthInChars = (DWORD)(FilePart - FilePath->StartOfString);
+    if (ThisDirName.LengthInChars == 6) {
+        ThisDirName.LengthInChars++;
+        if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ThisDirName)) {
+            ThisDirName.LengthInChars--;
+        }
+    }
+
+    //
+    //  Find or create the root for the parent of this object.
+    //
+
+    Root = DuContext->CurrentRoot;
+    if (Root == NULL || YoriLibCompareString(&Root->DirectoryName, &ThisDirName) != 0) {
+        Root = DuAllocateDirectory(NULL, &ThisDirName);
+        if (Root == NULL) {
+            return FALSE;
+        }
+        DuInitializeRootDirectory(DuContext, Root);
+        YoriLibAppendList(&DuContext->RootList, &Root->SiblingListEntry);
+        InterlockedIncrement(&DuContext->RootsOutstanding);
+        DuContext->CurrentRoot = Root;
+    }
+
+    ZeroMemory(&FileEntry, sizeof(FileEntry));
+    FileEntry.FileAttributes = FileInfo->dwFileAttributes;
+    if ((FileInfo->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+        FileEntry.ReparseTag = FileInfo->dwReserved0;
+    }
+    FileEntry.EndOfFile.LowPart = FileInfo->nFileSizeLow;
+    FileEntry.EndOfFile.HighPart = FileInfo->nFileSizeHigh;
+
+    return DuProcessDirectoryEntry(DuContext, Root, FilePath, &FileEntry);
+}
+
 /**
  A callback that is invoked when a directory cannot be successfully enumerated.
 
@@ -797,6 +1608,91 @@ DuFileEnumerateErrorCallback(
     return TRUE;
 }
 
+/**
+ Calculate and display the space used by objects matching a single user
+ specified search criteria.  The top level objects are expanded on this
+ thread, and all directories below them are enumerated by worker threads.
+ Once all directories have completed, the results are displayed.
+
+ @param DuContext Pointer to the DU context.
+
+ @param FileSpec Pointer to the user's search criteria.
+
+ @param MatchFlags Flags to use when expanding the search criteria.
+
+ @param ErrorCallback Optionally points to a function to invoke if the
+        search criteria cannot be expanded.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+DuProcessFileSpec(
+    __in PDU_CONTEXT DuContext,
+    __in PYORI_STRING FileSpec,
+    __in DWORD MatchFlags,
+    __in_opt PYORILIB_FILE_ENUM_ERROR_FN ErrorCallback
+    )
+{
+    YORI_STRING FullFileSpec;
+    PYORI_STRING EffectiveFileSpec;
+    PYORI_LIST_ENTRY ListEntry;
+    PDU_DIRECTORY Root;
+    DWORD FileAttributes;
+
+    //
+    //  If the criteria refers to a directory, convert it to a full path so
+    //  the directory is returned as an object within its parent, which is
+    //  how it will be reported.
+    //
+
+    EffectiveFileSpec = FileSpec;
+    YoriLibInitEmptyString(&FullFileSpec);
+    FileAttributes = GetFileAttributes(FileSpec->StartOfString);
+    if (FileAttributes != (DWORD)-1 &&
+        (FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+
+        if (YoriLibGetFullPathNameReturnAllocation(FileSpec, TRUE, &FullFileSpec, NULL)) {
+            EffectiveFileSpec = &FullFileSpec;
+        }
+    }
+
+    DuContext->RootsOutstanding = 1;
+    DuContext->CurrentRoot = NULL;
+    ResetEvent(DuContext->AllRootsCompleteEvent);
+
+    YoriLibForEachFile(EffectiveFileSpec, MatchFlags, 0, DuFileFoundCallback, ErrorCallback, DuContext);
+    YoriLibFreeStringContents(&FullFileSpec);
+
+    //
+    //  Release the references held while expanding the criteria, and wait
+    //  for the worker threads to complete everything below it.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&DuContext->RootList, NULL);
+    while (ListEntry != NULL) {
+        Root = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, SiblingListEntry);
+        ListEntry = YoriLibGetNextListEntry(&DuContext->RootList, ListEntry);
+        DuDereferenceDirectory(DuContext, Root);
+    }
+
+    if (InterlockedDecrement(&DuContext->RootsOutstanding) == 0) {
+        SetEvent(DuContext->AllRootsCompleteEvent);
+    }
+
+    WaitForSingleObject(DuContext->AllRootsCompleteEvent, INFINITE);
+
+    ListEntry = YoriLibGetNextListEntry(&DuContext->RootList, NULL);
+    while (ListEntry != NULL) {
+        Root = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, SiblingListEntry);
+        ListEntry = YoriLibGetNextListEntry(&DuContext->RootList, ListEntry);
+        YoriLibRemoveListItem(&Root->SiblingListEntry);
+        DuReportAndFreeTree(DuContext, Root, 1);
+    }
+
+    DuContext->CurrentRoot = NULL;
+    return TRUE;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the du builtin command.
@@ -852,7 +1748,7 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("a")) == 0) {
                 DuContext.CompressedFileSize = TRUE;
                 DuContext.IncludeNamedStreams = TRUE;
-                DuContext.AverageHardLinkSize = TRUE;
+                DuContext.SingleCountHardLinks = TRUE;
                 DuContext.AllocationSize = TRUE;
                 DuContext.WimBackedFilesAsZero = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -866,7 +1762,7 @@ ENTRYPOINT(
                 DuContext.IncludeNamedStreams = TRUE;
                 ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("h")) == 0) {
-                DuContext.AverageHardLinkSize = TRUE;
+                DuContext.SingleCountHardLinks = TRUE;
                 ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("r")) == 0) {
                 if (i + 1 < ArgC) {
@@ -932,10 +1828,28 @@ ENTRYPOINT(
     YoriLibCancelEnable();
 #endif
 
+    if (DuContext.SingleCountHardLinks) {
+        DuContext.FileIdBuckets = YoriLibMalloc(DU_FILE_ID_BUCKETS * sizeof(PDU_FILE_ID_ENTRY));
+        if (DuContext.FileIdBuckets == NULL) {
+            DuCleanupContext(&DuContext);
+            return EXIT_FAILURE;
+        }
+        ZeroMemory(DuContext.FileIdBuckets, DU_FILE_ID_BUCKETS * sizeof(PDU_FILE_ID_ENTRY));
+    }
+
+    if (!DuInitializeWorkers(&DuContext)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("du: could not create worker threads\n"));
+        DuCleanupContext(&DuContext);
+        return EXIT_FAILURE;
+    }
+
+    //
+    //  Only the objects matching the search criteria are returned here.
+    //  Directories below them are enumerated by the worker threads.
+    //
+
     MatchFlags = YORILIB_FILEENUM_RETURN_FILES |
-                 YORILIB_FILEENUM_RETURN_DIRECTORIES |
-                 YORILIB_FILEENUM_RECURSE_BEFORE_RETURN |
-                 YORILIB_FILEENUM_NO_LINK_TRAVERSE;
+                 YORILIB_FILEENUM_RETURN_DIRECTORIES;
     if (BasicEnumeration) {
         MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
     }
@@ -947,12 +1861,13 @@ ENTRYPOINT(
     if (StartArg == 0 || StartArg == ArgC) {
         YORI_STRING FilesInDirectorySpec;
         YoriLibConstantString(&FilesInDirectorySpec, _T("."));
-        YoriLibForEachFile(&FilesInDirectorySpec, MatchFlags, 0, DuFileFoundCallback, NULL, &DuContext);
-        DuReportAndCloseAllActiveStacks(&DuContext, 1);
+        DuProcessFileSpec(&DuContext, &FilesInDirectorySpec, MatchFlags, NULL);
     } else {
         for (i = StartArg; i < ArgC; i++) {
-            YoriLibForEachFile(&ArgV[i], MatchFlags, 0, DuFileFoundCallback, DuFileEnumerateErrorCallback, &DuContext);
-            DuReportAndCloseAllActiveStacks(&DuContext, 1);
+            DuProcessFileSpec(&DuContext, &ArgV[i], MatchFlags, DuFileEnumerateErrorCallback);
+            if (DuContext.Cancelled) {
+                break;
+            }
         }
     }
 
@@ -37,16 +37,25 @@ const
 CHAR strForHelpText[] =
         "Enumerates through a list of strings or files.\n"
         "\n"
-        "FOR [-license] [-b] [-c] [-d] [-i <criteria>] [-p n] [-r] <var> in (<list>)\n"
-        "    do <cmd>\n"
+        "FOR [-license] [-b] [-c] [-d] [-i <criteria>] [-n] [-o] [-p n|auto] [-r] [-x]\n"
+        "    <var> in (<list>) do <cmd>\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
         "   -c             Use cmd as a subshell rather than Yori\n"
         "   -d             Match directories rather than files\n"
         "   -i <criteria>  Only treat match files if they meet criteria, see below\n"
         "   -l             Use (start,step,end) notation for the list\n"
+        "   -n             Execute a builtin command without launching a process\n"
+        "   -o             Display the output of each command whole once it completes\n"
         "   -p <n>         Execute with <n> concurrent processes\n"
+        "   -p auto        Execute with one process per processor not otherwise busy\n"
         "   -r             Look for matches in subdirectories under the current directory\n"
+        "   -x             Execute each command with as many matches as will fit\n"
+        "\n"
+        " When -x is specified, each argument containing <var> is repeated once for\n"
+        " each match.  If the command does not contain <var>, -x has no effect and\n"
+        " the command is executed once per match.  With -c, the shorter cmd command\n"
+        " line limit is used.  With -p, each combined command counts as one process.\n"
         "\n"
         " The -i option will match files only if they meet criteria.  This is a\n"
         " semicolon delimited list of entries matching the following form:\n"
@@ -74,6 +83,82 @@ ForHelp()
     return TRUE;
 }
 
+/**
+ The number of milliseconds between samples of system processor usage when
+ determining how many processes to execute concurrently.  This is also the
+ interval at which running processes are checked for completion if a
+ completion message has not arrived.
+ */
+#define FOR_LOAD_SAMPLE_INTERVAL 1000
+
+/**
+ The number of buckets in the hash table of running processes.
+ */
+#define FOR_CHILD_HASH_BUCKETS 251
+
+/**
+ The size of the buffer used to copy buffered output from a completed
+ process to standard output.
+ */
+#define FOR_OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ The maximum length of a command line, in characters, to construct when
+ executing multiple matches in one command.  This is a little below the
+ limit imposed by CreateProcess.
+ */
+#define FOR_BATCH_MAX_CMDLINE 32000
+
+/**
+ The maximum length of a command line, in characters, to construct when
+ executing multiple matches in one command via CMD, which has a much lower
+ limit than CreateProcess.
+ */
+#define FOR_BATCH_MAX_CMD_CMDLINE 8000
+
+/**
+ Information about a single process that is currently running as a result of
+ this program.
+ */
+typedef struct _FOR_CHILD_PROCESS {
+
+    /**
+     The entry for this process within the list of running processes.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this process within the hash table of running processes,
+     keyed by process ID.  This is used to find the process when a message
+     indicating that it has terminated is received from the job object.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     A handle to the process.
+     */
+    HANDLE hProcess;
+
+    /**
+     The process ID of the process.
+     */
+    DWORD ProcessId;
+
+    /**
+     If output is being buffered, a handle to a temporary file containing
+     the output of the process.  If output is not being buffered, this is
+     NULL.
+     */
+    HANDLE hOutput;
+
+    /**
+     A buffer containing the process ID as a string, used as the key of
+     HashEntry.
+     */
+    TCHAR KeyBuffer[16];
+
+} FOR_CHILD_PROCESS, *PFOR_CHILD_PROCESS;
+
 /**
  State about the currently running processes as well as information required
  to launch any new processes from this program.
@@ -85,6 +170,41 @@ typedef struct _FOR_EXEC_CONTEXT {
      */
     BOOL InvokeCmd;
 
+    /**
+     If TRUE, the command is executed as a builtin within the shell process
+     rather than by launching a subshell.  This is only meaningful when this
+     program is running as a builtin.
+     */
+    BOOL InProcBuiltin;
+
+    /**
+     If TRUE, matches are collected and the command is executed with as
+     many matches as can fit in a single command line.
+     */
+    BOOL BatchMode;
+
+    /**
+     If TRUE, the number of concurrent processes is determined from the
+     number of processors in the system and their current usage.  If FALSE,
+     TargetConcurrentCount is used as specified.
+     */
+    BOOL AutoConcurrency;
+
+    /**
+     If TRUE, the output of each process is written to a temporary file and
+     displayed once the process completes, so that the output of concurrent
+     processes is not interleaved.
+     */
+    BOOL BufferOutput;
+
+    /**
+     If TRUE, processes are assigned to a job object whose completion port
+     indicates when each process terminates.  If FALSE, process handles are
+     waited on directly, which limits the number of concurrent processes to
+     MAXIMUM_WAIT_OBJECTS.
+     */
+    BOOL UseCompletionPort;
+
     /**
      The string that might be found in ArgV which should be changed to contain
      the value of any match.
@@ -115,20 +235,496 @@ typedef struct _FOR_EXEC_CONTEXT {
     DWORD CurrentConcurrentCount;
 
     /**
-     An array of handles with CurrentConcurrentCount number of valid
-     elements.  These correspond to processes that are currently running.
+     A list of processes that are currently running, in the order they were
+     launched.  Paired with FOR_CHILD_PROCESS::ListEntry .
+     */
+    YORI_LIST_ENTRY ChildList;
+
+    /**
+     A hash table of processes that are currently running, keyed by process
+     ID.  Paired with FOR_CHILD_PROCESS::HashEntry .
      */
-    PHANDLE HandleArray;
+    PYORI_HASH_TABLE ChildHash;
+
+    /**
+     A job object that all processes are assigned to.
+     */
+    HANDLE hJob;
+
+    /**
+     A completion port that receives messages from the job object.
+     */
+    HANDLE hPort;
+
+    /**
+     The number of logical processors in the system.
+     */
+    DWORD ProcessorCount;
+
+    /**
+     TRUE if a previous sample of system processor usage has been recorded.
+     */
+    BOOL LoadSampled;
+
+    /**
+     The tick count when system processor usage was last sampled.
+     */
+    DWORD LastLoadSampleTick;
+
+    /**
+     The system idle time when processor usage was last sampled.
+     */
+    LARGE_INTEGER LastIdleTime;
+
+    /**
+     The system busy time, including kernel and user time, when processor
+     usage was last sampled.
+     */
+    LARGE_INTEGER LastBusyTime;
+
+    /**
+     The directory to create temporary files in, without a trailing
+     separator.  This is populated when the first temporary file is created.
+     */
+    YORI_STRING TempPath;
+
+    /**
+     A buffer used to copy buffered output from a completed process to
+     standard output.
+     */
+    PUCHAR OutputBuffer;
 
     /**
      A list of criteria to filter matches against.
      */
     YORI_LIB_FILE_FILTER Filter;
 
+    /**
+     An array of matches that have been found but not yet executed, when
+     executing multiple matches in one command.
+     */
+    PYORI_STRING BatchMatches;
+
+    /**
+     The number of elements in BatchMatches that contain matches.
+     */
+    DWORD BatchMatchCount;
+
+    /**
+     The number of elements allocated in BatchMatches.
+     */
+    DWORD BatchMatchesAllocated;
+
+    /**
+     The estimated length of the command line needed to execute the matches
+     in BatchMatches, in characters.
+     */
+    DWORD BatchLength;
+
+    /**
+     The estimated length of the command line needed to execute the command
+     excluding any argument containing the substitute variable.
+     */
+    DWORD BatchFixedLength;
+
+    /**
+     The length of all arguments containing the substitute variable,
+     including a separator and quotes for each, before substitution.
+     */
+    DWORD BatchVariableArgLength;
+
+    /**
+     The number of times the substitute variable occurs in all arguments.
+     */
+    DWORD BatchSubstituteCount;
+
 } FOR_EXEC_CONTEXT, *PFOR_EXEC_CONTEXT;
 
 /**
- Wait for any single process to complete.
+ Prepare to track child processes.  Where the host OS supports it, processes
+ are assigned to a job object whose completion port indicates when each
+ process terminates, allowing any number of processes to be tracked.
+
+ @param ExecContext Pointer to the for exec context.
+ */
+VOID
+ForInitializeReaper(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    SYSTEM_INFO SystemInfo;
+
+    YoriLibInitializeListHead(&ExecContext->ChildList);
+
+    GetSystemInfo(&SystemInfo);
+    ExecContext->ProcessorCount = SystemInfo.dwNumberOfProcessors;
+    if (ExecContext->ProcessorCount == 0) {
+        ExecContext->ProcessorCount = 1;
+    }
+
+    YoriLibLoadKernel32Functions();
+    if (DllKernel32.pCreateIoCompletionPort == NULL ||
+        DllKernel32.pGetQueuedCompletionStatus == NULL) {
+
+        return;
+    }
+
+    ExecContext->ChildHash = YoriLibAllocateHashTable(FOR_CHILD_HASH_BUCKETS);
+    if (ExecContext->ChildHash == NULL) {
+        return;
+    }
+
+    ExecContext->hJob = YoriLibCreateJobObject();
+    if (ExecContext->hJob == NULL) {
+        return;
+    }
+
+    ExecContext->hPort = DllKernel32.pCreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (ExecContext->hPort == NULL) {
+        return;
+    }
+
+    if (!YoriLibAssociateJobObjectWithCompletionPort(ExecContext->hJob, ExecContext->hPort, ExecContext)) {
+        return;
+    }
+
+    ExecContext->UseCompletionPort = TRUE;
+}
+
+/**
+ Release any resources used to track child processes.  All child processes
+ are expected to have completed.
+
+ @param ExecContext Pointer to the for exec context.
+ */
+VOID
+ForCleanupReaper(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    ASSERT(ExecContext->CurrentConcurrentCount == 0);
+
+    if (ExecContext->hPort != NULL) {
+        CloseHandle(ExecContext->hPort);
+        ExecContext->hPort = NULL;
+    }
+
+    if (ExecContext->hJob != NULL) {
+        CloseHandle(ExecContext->hJob);
+        ExecContext->hJob = NULL;
+    }
+
+    if (ExecContext->ChildHash != NULL) {
+        YoriLibFreeEmptyHashTable(ExecContext->ChildHash);
+        ExecContext->ChildHash = NULL;
+    }
+
+    if (ExecContext->OutputBuffer != NULL) {
+        YoriLibFree(ExecContext->OutputBuffer);
+        ExecContext->OutputBuffer = NULL;
+    }
+
+    YoriLibFreeStringContents(&ExecContext->TempPath);
+}
+
+/**
+ Determine the number of processes that should be running concurrently.  If
+ a fixed number was specified, that number is used.  Otherwise, this is the
+ number of processors in the system, less any processors that are busy
+ executing something other than processes launched by this program.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @return The number of processes that should be running concurrently.
+ */
+DWORD
+ForGetTargetConcurrentCount(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    FILETIME IdleTime;
+    FILETIME KernelTime;
+    FILETIME UserTime;
+    LARGE_INTEGER Idle;
+    LARGE_INTEGER Busy;
+    LONGLONG IdleDelta;
+    LONGLONG TotalDelta;
+    DWORD BusyProcessors;
+    DWORD Target;
+    DWORD Now;
+
+    if (ExecContext->AutoConcurrency) {
+
+        //
+        //  The first time through, or if processor usage cannot be queried,
+        //  assume every processor is available.
+        //
+
+        if (ExecContext->TargetConcurrentCount == 0) {
+            ExecContext->TargetConcurrentCount = ExecContext->ProcessorCount;
+        }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159)
+#endif
+        Now = GetTickCount();
+
+        if (DllKernel32.pGetSystemTimes != NULL &&
+            (!ExecContext->LoadSampled || Now - ExecContext->LastLoadSampleTick >= FOR_LOAD_SAMPLE_INTERVAL) &&
+            DllKernel32.pGetSystemTimes(&IdleTime, &KernelTime, &UserTime)) {
+
+            //
+            //  Kernel time includes idle time, so busy time is kernel plus
+            //  user, and the fraction of it which is not idle is the
+            //  fraction of the system that is doing work.
+            //
+
+            Idle.LowPart = IdleTime.dwLowDateTime;
+            Idle.HighPart = IdleTime.dwHighDateTime;
+            Busy.LowPart = KernelTime.dwLowDateTime;
+            Busy.HighPart = KernelTime.dwHighDateTime;
+            Busy.QuadPart += ((LONGLONG)UserTime.dwHighDateTime << 32) | UserTime.dwLowDateTime;
+
+            if (ExecContext->LoadSampled) {
+                IdleDelta = Idle.QuadPart - ExecContext->LastIdleTime.QuadPart;
+                TotalDelta = Busy.QuadPart - ExecContext->LastBusyTime.QuadPart;
+                if (TotalDelta > 0 && IdleDelta >= 0 && IdleDelta <= TotalDelta) {
+                    BusyProcessors = (DWORD)(((TotalDelta - IdleDelta) * ExecContext->ProcessorCount + TotalDelta / 2) / TotalDelta);
+
+                    //
+                    //  Processors used by processes launched from here are
+                    //  not load that should reduce the target.
+                    //
+
+                    if (BusyProcessors > ExecContext->CurrentConcurrentCount) {
+                        BusyProcessors = BusyProcessors - ExecContext->CurrentConcurrentCount;
+                    } else {
+                        BusyProcessors = 0;
+                    }
+
+                    if (BusyProcessors >= ExecContext->ProcessorCount) {
+                        ExecContext->TargetConcurrentCount = 1;
+                    } else {
+                        ExecContext->TargetConcurrentCount = ExecContext->ProcessorCount - BusyProcessors;
+                    }
+                }
+            }
+
+            ExecContext->LastIdleTime.QuadPart = Idle.QuadPart;
+            ExecContext->LastBusyTime.QuadPart = Busy.QuadPart;
+            ExecContext->LastLoadSampleTick = Now;
+            ExecContext->LoadSampled = TRUE;
+        }
+    }
+
+    Target = ExecContext->TargetConcurrentCount;
+    if (!ExecContext->UseCompletionPort && Target > MAXIMUM_WAIT_OBJECTS) {
+        Target = MAXIMUM_WAIT_OBJECTS;
+    }
+
+    return Target;
+}
+
+/**
+ Create a temporary file to contain the output of a child process.  The file
+ is deleted when its handle is closed.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param OutputHandle On successful completion, updated to contain a handle
+        to the temporary file.  This handle is not inheritable.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ForCreateOutputFile(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __out PHANDLE OutputHandle
+    )
+{
+    YORI_STRING Prefix;
+    YORI_STRING TempName;
+    DWORD LengthNeeded;
+    HANDLE Handle;
+
+    if (ExecContext->TempPath.StartOfString == NULL) {
+        LengthNeeded = GetTempPath(0, NULL);
+        if (LengthNeeded == 0) {
+            return FALSE;
+        }
+        if (!YoriLibAllocateString(&ExecContext->TempPath, LengthNeeded)) {
+            return FALSE;
+        }
+        ExecContext->TempPath.LengthInChars = GetTempPath(ExecContext->TempPath.LengthAllocated, ExecContext->TempPath.StartOfString);
+        if (ExecContext->TempPath.LengthInChars == 0 ||
+            ExecContext->TempPath.LengthInChars >= ExecContext->TempPath.LengthAllocated) {
+
+            YoriLibFreeStringContents(&ExecContext->TempPath);
+            return FALSE;
+        }
+
+        if (YoriLibIsSep(ExecContext->TempPath.StartOfString[ExecContext->TempPath.LengthInChars - 1])) {
+            ExecContext->TempPath.LengthInChars--;
+            ExecContext->TempPath.StartOfString[ExecContext->TempPath.LengthInChars] = '\0';
+        }
+    }
+
+    YoriLibConstantString(&Prefix, _T("FOR"));
+    if (!YoriLibGetTempFileName(&ExecContext->TempPath, &Prefix, NULL, &TempName)) {
+        return FALSE;
+    }
+
+    Handle = CreateFile(TempName.StartOfString,
+                        GENERIC_READ | GENERIC_WRITE,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        NULL,
+                        OPEN_EXISTING,
+                        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                        NULL);
+
+    if (Handle == INVALID_HANDLE_VALUE) {
+        DeleteFile(TempName.StartOfString);
+        YoriLibFreeStringContents(&TempName);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&TempName);
+    *OutputHandle = Handle;
+    return TRUE;
+}
+
+/**
+ Display the buffered output of a child process that has completed.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param Child Pointer to the child process whose output should be displayed.
+ */
+VOID
+ForDisplayChildOutput(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in PFOR_CHILD_PROCESS Child
+    )
+{
+    DWORD BytesRead;
+    DWORD BytesWritten;
+    HANDLE hStdOut;
+
+    if (ExecContext->OutputBuffer == NULL) {
+        ExecContext->OutputBuffer = YoriLibMalloc(FOR_OUTPUT_BUFFER_SIZE);
+        if (ExecContext->OutputBuffer == NULL) {
+            return;
+        }
+    }
+
+    hStdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    SetFilePointer(Child->hOutput, 0, NULL, FILE_BEGIN);
+
+    while (ReadFile(Child->hOutput, ExecContext->OutputBuffer, FOR_OUTPUT_BUFFER_SIZE, &BytesRead, NULL) &&
+           BytesRead > 0) {
+
+        if (!WriteFile(hStdOut, ExecContext->OutputBuffer, BytesRead, &BytesWritten, NULL)) {
+            break;
+        }
+    }
+}
+
+/**
+ Find a running child process by its process ID.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param ProcessId The process ID to find.
+
+ @return Pointer to the child process, or NULL if no child process launched
+         by this program has the specified process ID.
+ */
+PFOR_CHILD_PROCESS
+ForFindChildProcess(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in DWORD ProcessId
+    )
+{
+    TCHAR KeyBuffer[16];
+    YORI_STRING Key;
+    PYORI_HASH_ENTRY HashEntry;
+
+    YoriLibInitEmptyString(&Key);
+    Key.StartOfString = KeyBuffer;
+    Key.LengthAllocated = sizeof(KeyBuffer)/sizeof(KeyBuffer[0]);
+    Key.LengthInChars = YoriLibSPrintf(KeyBuffer, _T("%x"), ProcessId);
+
+    HashEntry = YoriLibHashLookupByKey(ExecContext->ChildHash, &Key);
+    if (HashEntry == NULL) {
+        return NULL;
+    }
+
+    return (PFOR_CHILD_PROCESS)HashEntry->Context;
+}
+
+/**
+ Start tracking a newly launched child process.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param Child Pointer to the child process, with its process handle and
+        process ID populated.
+ */
+VOID
+ForTrackChildProcess(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in PFOR_CHILD_PROCESS Child
+    )
+{
+    YORI_STRING Key;
+
+    YoriLibAppendList(&ExecContext->ChildList, &Child->ListEntry);
+    if (ExecContext->ChildHash != NULL) {
+        YoriLibInitEmptyString(&Key);
+        Key.StartOfString = Child->KeyBuffer;
+        Key.LengthAllocated = sizeof(Child->KeyBuffer)/sizeof(Child->KeyBuffer[0]);
+        Key.LengthInChars = YoriLibSPrintf(Child->KeyBuffer, _T("%x"), Child->ProcessId);
+        YoriLibHashInsertByKey(ExecContext->ChildHash, &Key, Child, &Child->HashEntry);
+    }
+    ExecContext->CurrentConcurrentCount++;
+}
+
+/**
+ Release a child process that has completed, displaying its output if output
+ is being buffered.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param Child Pointer to the child process that has completed.
+ */
+VOID
+ForReapChildProcess(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in PFOR_CHILD_PROCESS Child
+    )
+{
+    if (Child->hOutput != NULL) {
+        ForDisplayChildOutput(ExecContext, Child);
+        CloseHandle(Child->hOutput);
+    }
+
+    YoriLibRemoveListItem(&Child->ListEntry);
+    if (Child->HashEntry.Key.StartOfString != NULL) {
+        YoriLibHashRemoveByEntry(&Child->HashEntry);
+    }
+    CloseHandle(Child->hProcess);
+    YoriLibFree(Child);
+
+    ASSERT(ExecContext->CurrentConcurrentCount > 0);
+    ExecContext->CurrentConcurrentCount--;
+}
+
+/**
+ Wait for any single process to complete.  If processor usage is being used
+ to determine the number of concurrent processes, this may return without
+ any process completing so the caller can reevaluate the number of processes
+ to run.
 
  @param ExecContext Pointer to the for exec context containing information
         about currently running processes.
@@ -138,68 +734,246 @@ ForWaitForProcessToComplete(
     __in PFOR_EXEC_CONTEXT ExecContext
     )
 {
+    HANDLE HandleArray[MAXIMUM_WAIT_OBJECTS];
+    PFOR_CHILD_PROCESS ChildArray[MAXIMUM_WAIT_OBJECTS];
+    PYORI_LIST_ENTRY ListEntry;
+    PFOR_CHILD_PROCESS Child;
+    LPOVERLAPPED Overlapped;
+    DWORD_PTR CompletionKey;
+    DWORD Message;
     DWORD Result;
-    DWORD Index;
     DWORD Count;
+    DWORD Timeout;
+
+    if (ExecContext->UseCompletionPort) {
+        while (TRUE) {
+            if (!DllKernel32.pGetQueuedCompletionStatus(ExecContext->hPort, &Message, &CompletionKey, &Overlapped, FOR_LOAD_SAMPLE_INTERVAL)) {
+                break;
+            }
 
-    Result = WaitForMultipleObjects(ExecContext->CurrentConcurrentCount, ExecContext->HandleArray, FALSE, INFINITE);
+            if (Message != JOB_OBJECT_MSG_EXIT_PROCESS &&
+                Message != JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS) {
 
-    ASSERT(Result >= WAIT_OBJECT_0 && Result < (WAIT_OBJECT_0 + ExecContext->CurrentConcurrentCount));
+                continue;
+            }
 
-    Index = Result - WAIT_OBJECT_0;
+            //
+            //  The job also contains any processes launched by the child
+            //  processes, so messages for unknown processes are ignored.
+            //  Since a process ID can be reused after a grandchild exits,
+            //  check that the process has really terminated.
+            //
 
-    CloseHandle(ExecContext->HandleArray[Index]);
+            Child = ForFindChildProcess(ExecContext, (DWORD)(DWORD_PTR)Overlapped);
+            if (Child != NULL &&
+                WaitForSingleObject(Child->hProcess, 0) == WAIT_OBJECT_0) {
 
-    for (Count = Index; Count < ExecContext->CurrentConcurrentCount - 1; Count++) {
+                ForReapChildProcess(ExecContext, Child);
+                return;
+            }
+        }
 
-#if defined(_MSC_VER) && (_MSC_VER >= 1700)
         //
-        //  The "correct" annotation here would describe that HandleArray is
-        //  of TargetConcurrentCount elements, CurrentConcurrentCount of which
-        //  are readable, and CurrentConcurrentCount needs to be less than or
-        //  equal to TargetConcurrentCount.  This is something that I don't
-        //  see a way to express as of this writing.
+        //  Messages from a job object are not guaranteed to be delivered,
+        //  so if none has arrived for a while, check for any process that
+        //  has completed without one.
         //
-#pragma warning(suppress: 6001)
-#endif
-        ExecContext->HandleArray[Count] = ExecContext->HandleArray[Count + 1];
+
+        ListEntry = YoriLibGetNextListEntry(&ExecContext->ChildList, NULL);
+        while (ListEntry != NULL) {
+            Child = CONTAINING_RECORD(ListEntry, FOR_CHILD_PROCESS, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&ExecContext->ChildList, ListEntry);
+            if (WaitForSingleObject(Child->hProcess, 0) == WAIT_OBJECT_0) {
+                ForReapChildProcess(ExecContext, Child);
+            }
+        }
+
+        return;
     }
 
-    ExecContext->CurrentConcurrentCount--;
+    //
+    //  Without a completion port, wait on the oldest processes directly.
+    //
+
+    Count = 0;
+    ListEntry = YoriLibGetNextListEntry(&ExecContext->ChildList, NULL);
+    while (ListEntry != NULL && Count < MAXIMUM_WAIT_OBJECTS) {
+        Child = CONTAINING_RECORD(ListEntry, FOR_CHILD_PROCESS, ListEntry);
+        ChildArray[Count] = Child;
+        HandleArray[Count] = Child->hProcess;
+        Count++;
+        ListEntry = YoriLibGetNextListEntry(&ExecContext->ChildList, ListEntry);
+    }
+
+    if (Count == 0) {
+        return;
+    }
+
+    Timeout = INFINITE;
+    if (ExecContext->AutoConcurrency) {
+        Timeout = FOR_LOAD_SAMPLE_INTERVAL;
+    }
+
+    Result = WaitForMultipleObjects(Count, HandleArray, FALSE, Timeout);
+    if (Result >= WAIT_OBJECT_0 && Result < (WAIT_OBJECT_0 + Count)) {
+        ForReapChildProcess(ExecContext, ChildArray[Result - WAIT_OBJECT_0]);
+    }
 }
 
 /**
- Execute a new command in response to a newly matched element.
+ Count the number of times the substitute variable occurs in an argument.
 
- @param Match The match that was found from the set.
+ @param Arg Pointer to the argument to check.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @return The number of times the substitute variable occurs in the argument.
+ */
+DWORD
+ForCountSubstitutes(
+    __in PYORI_STRING Arg,
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    YORI_STRING Remaining;
+    DWORD FoundOffset;
+    DWORD SubstitutesFound;
+
+    YoriLibInitEmptyString(&Remaining);
+    Remaining.StartOfString = Arg->StartOfString;
+    Remaining.LengthInChars = Arg->LengthInChars;
+    SubstitutesFound = 0;
+
+    while (YoriLibFindFirstMatchingSubstring(&Remaining, 1, ExecContext->SubstituteVariable, &FoundOffset)) {
+        SubstitutesFound++;
+        Remaining.StartOfString += FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
+        Remaining.LengthInChars -= FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
+    }
+
+    return SubstitutesFound;
+}
+
+/**
+ Generate a new argument from a template argument by replacing each
+ occurrence of the substitute variable with a match.
+
+ @param TemplateArg Pointer to the template argument.
+
+ @param Match Pointer to the match to substitute.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param NewArg On successful completion, populated with a newly allocated
+        argument.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ForSubstituteArgument(
+    __in PYORI_STRING TemplateArg,
+    __in PYORI_STRING Match,
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __out PYORI_STRING NewArg
+    )
+{
+    DWORD FoundOffset;
+    DWORD SubstitutesFound;
+    DWORD ArgLengthNeeded;
+    YORI_STRING OldArg;
+    YORI_STRING NewArgWritePoint;
+
+    YoriLibInitEmptyString(&OldArg);
+    OldArg.StartOfString = TemplateArg->StartOfString;
+    OldArg.LengthInChars = TemplateArg->LengthInChars;
+    SubstitutesFound = 0;
+
+    while (YoriLibFindFirstMatchingSubstring(&OldArg, 1, ExecContext->SubstituteVariable, &FoundOffset)) {
+        SubstitutesFound++;
+        OldArg.StartOfString += FoundOffset + 1;
+        OldArg.LengthInChars -= FoundOffset + 1;
+    }
+
+    ArgLengthNeeded = TemplateArg->LengthInChars + SubstitutesFound * Match->LengthInChars - SubstitutesFound * ExecContext->SubstituteVariable->LengthInChars + 1;
+    if (!YoriLibAllocateString(NewArg, ArgLengthNeeded)) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&NewArgWritePoint);
+    NewArgWritePoint.StartOfString = NewArg->StartOfString;
+    NewArgWritePoint.LengthAllocated = NewArg->LengthAllocated;
+
+    YoriLibInitEmptyString(&OldArg);
+    OldArg.StartOfString = TemplateArg->StartOfString;
+    OldArg.LengthInChars = TemplateArg->LengthInChars;
+
+    while (TRUE) {
+        if (YoriLibFindFirstMatchingSubstring(&OldArg, 1, ExecContext->SubstituteVariable, &FoundOffset)) {
+            memcpy(NewArgWritePoint.StartOfString, OldArg.StartOfString, FoundOffset * sizeof(TCHAR));
+            NewArgWritePoint.StartOfString += FoundOffset;
+            NewArgWritePoint.LengthAllocated -= FoundOffset;
+            memcpy(NewArgWritePoint.StartOfString, Match->StartOfString, Match->LengthInChars * sizeof(TCHAR));
+            NewArgWritePoint.StartOfString += Match->LengthInChars;
+            NewArgWritePoint.LengthAllocated -= Match->LengthInChars;
+
+            OldArg.StartOfString += FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
+            OldArg.LengthInChars -= FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
+        } else {
+            memcpy(NewArgWritePoint.StartOfString, OldArg.StartOfString, OldArg.LengthInChars * sizeof(TCHAR));
+            NewArgWritePoint.StartOfString += OldArg.LengthInChars;
+            NewArgWritePoint.LengthAllocated -= OldArg.LengthInChars;
+            NewArgWritePoint.StartOfString[0] = '\0';
+
+            NewArg->LengthInChars = (DWORD)(NewArgWritePoint.StartOfString - NewArg->StartOfString);
+            ASSERT(NewArg->LengthInChars < NewArg->LengthAllocated);
+            ASSERT(YoriLibIsStringNullTerminated(NewArg));
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Execute a new command in response to one or more newly matched elements.
+
+ @param Matches An array of matches that were found from the set.
+
+ @param MatchCount The number of elements in Matches.  Each argument
+        containing the substitute variable is repeated once for each match.
 
  @param ExecContext The current state of child processes and information about
         the arguments for any new child process.
  */
 VOID
 ForExecuteCommand(
-    __in PYORI_STRING Match,
+    __in PYORI_STRING Matches,
+    __in DWORD MatchCount,
     __in PFOR_EXEC_CONTEXT ExecContext
     )
 {
-    DWORD ArgsNeeded = ExecContext->ArgC;
+    DWORD ArgsNeeded;
     DWORD PrefixArgCount;
-    DWORD FoundOffset;
     DWORD Count;
-    DWORD SubstitutesFound;
+    DWORD ArgIndex;
+    DWORD MatchIndex;
     DWORD ArgLengthNeeded;
-    YORI_STRING OldArg;
-    YORI_STRING NewArgWritePoint;
     PYORI_STRING NewArgArray;
     YORI_STRING CmdLine;
     PROCESS_INFORMATION ProcessInfo;
     STARTUPINFO StartupInfo;
+    PFOR_CHILD_PROCESS Child;
+    HANDLE hChildOutput;
 
     YoriLibInitEmptyString(&CmdLine);
+    Child = NULL;
+    hChildOutput = NULL;
 
 #ifdef YORI_BUILTIN
-    if (!ExecContext->InvokeCmd &&
-        ExecContext->TargetConcurrentCount == 1) {
+    if (ExecContext->InProcBuiltin ||
+        (!ExecContext->InvokeCmd &&
+         !ExecContext->AutoConcurrency &&
+         ExecContext->TargetConcurrentCount == 1)) {
         PrefixArgCount = 0;
     } else {
         PrefixArgCount = 2;
@@ -208,7 +982,14 @@ ForExecuteCommand(
     PrefixArgCount = 2;
 #endif
 
-    ArgsNeeded += PrefixArgCount;
+    ArgsNeeded = PrefixArgCount;
+    for (Count = 0; Count < ExecContext->ArgC; Count++) {
+        if (MatchCount > 1 && ForCountSubstitutes(&ExecContext->ArgV[Count], ExecContext) > 0) {
+            ArgsNeeded += MatchCount;
+        } else {
+            ArgsNeeded++;
+        }
+    }
 
     NewArgArray = YoriLibMalloc(ArgsNeeded * sizeof(YORI_STRING));
     if (NewArgArray == NULL) {
@@ -253,71 +1034,79 @@ ForExecuteCommand(
         YoriLibConstantString(&NewArgArray[1], _T("/c"));
     }
 
+    ArgIndex = PrefixArgCount;
     for (Count = 0; Count < ExecContext->ArgC; Count++) {
-        YoriLibInitEmptyString(&OldArg);
-        OldArg.StartOfString = ExecContext->ArgV[Count].StartOfString;
-        OldArg.LengthInChars = ExecContext->ArgV[Count].LengthInChars;
-        SubstitutesFound = 0;
-
-        while (YoriLibFindFirstMatchingSubstring(&OldArg, 1, ExecContext->SubstituteVariable, &FoundOffset)) {
-            SubstitutesFound++;
-            OldArg.StartOfString += FoundOffset + 1;
-            OldArg.LengthInChars -= FoundOffset + 1;
-        }
-
-        ArgLengthNeeded = ExecContext->ArgV[Count].LengthInChars + SubstitutesFound * Match->LengthInChars - SubstitutesFound * ExecContext->SubstituteVariable->LengthInChars + 1;
-        if (!YoriLibAllocateString(&NewArgArray[Count + PrefixArgCount], ArgLengthNeeded)) {
-            goto Cleanup;
-        }
-
-        YoriLibInitEmptyString(&NewArgWritePoint);
-        NewArgWritePoint.StartOfString = NewArgArray[Count + PrefixArgCount].StartOfString;
-        NewArgWritePoint.LengthAllocated = NewArgArray[Count + PrefixArgCount].LengthAllocated;
-
-        YoriLibInitEmptyString(&OldArg);
-        OldArg.StartOfString = ExecContext->ArgV[Count].StartOfString;
-        OldArg.LengthInChars = ExecContext->ArgV[Count].LengthInChars;
-
-        while (TRUE) {
-            if (YoriLibFindFirstMatchingSubstring(&OldArg, 1, ExecContext->SubstituteVariable, &FoundOffset)) {
-                memcpy(NewArgWritePoint.StartOfString, OldArg.StartOfString, FoundOffset * sizeof(TCHAR));
-                NewArgWritePoint.StartOfString += FoundOffset;
-                NewArgWritePoint.LengthAllocated -= FoundOffset;
-                memcpy(NewArgWritePoint.StartOfString, Match->StartOfString, Match->LengthInChars * sizeof(TCHAR));
-                NewArgWritePoint.StartOfString += Match->LengthInChars;
-                NewArgWritePoint.LengthAllocated -= Match->LengthInChars;
-
-                OldArg.StartOfString += FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
-                OldArg.LengthInChars -= FoundOffset + ExecContext->SubstituteVariable->LengthInChars;
-            } else {
-                memcpy(NewArgWritePoint.StartOfString, OldArg.StartOfString, OldArg.LengthInChars * sizeof(TCHAR));
-                NewArgWritePoint.StartOfString += OldArg.LengthInChars;
-                NewArgWritePoint.LengthAllocated -= OldArg.LengthInChars;
-                NewArgWritePoint.StartOfString[0] = '\0';
-
-                NewArgArray[Count + PrefixArgCount].LengthInChars = (DWORD)(NewArgWritePoint.StartOfString - NewArgArray[Count + PrefixArgCount].StartOfString);
-                ASSERT(NewArgArray[Count + PrefixArgCount].LengthInChars < NewArgArray[Count + PrefixArgCount].LengthAllocated);
-                ASSERT(YoriLibIsStringNullTerminated(&NewArgArray[Count + PrefixArgCount]));
-                break;
+        if (MatchCount > 1 && ForCountSubstitutes(&ExecContext->ArgV[Count], ExecContext) > 0) {
+            for (MatchIndex = 0; MatchIndex < MatchCount; MatchIndex++) {
+                if (!ForSubstituteArgument(&ExecContext->ArgV[Count], &Matches[MatchIndex], ExecContext, &NewArgArray[ArgIndex])) {
+                    goto Cleanup;
+                }
+                ArgIndex++;
+            }
+        } else {
+            if (!ForSubstituteArgument(&ExecContext->ArgV[Count], &Matches[0], ExecContext, &NewArgArray[ArgIndex])) {
+                goto Cleanup;
             }
+            ArgIndex++;
         }
     }
 
+    ASSERT(ArgIndex == ArgsNeeded);
+
     if (!YoriLibBuildCmdlineFromArgcArgv(ArgsNeeded, NewArgArray, TRUE, &CmdLine)) {
         goto Cleanup;
     }
 
 #ifdef YORI_BUILTIN
     if (PrefixArgCount == 0) {
-        YoriCallExecuteExpression(&CmdLine);
+        if (ExecContext->InProcBuiltin) {
+            YoriCallExecuteBuiltin(&CmdLine);
+        } else {
+            YoriCallExecuteExpression(&CmdLine);
+        }
         goto Cleanup;
     }
 #endif
 
+    Child = YoriLibMalloc(sizeof(FOR_CHILD_PROCESS));
+    if (Child == NULL) {
+        goto Cleanup;
+    }
+    ZeroMemory(Child, sizeof(FOR_CHILD_PROCESS));
+
     memset(&StartupInfo, 0, sizeof(StartupInfo));
     StartupInfo.cb = sizeof(StartupInfo);
 
-    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, 0, NULL, NULL, &StartupInfo, &ProcessInfo)) {
+    //
+    //  If output is being buffered, give the child an inheritable handle to
+    //  a temporary file as its standard output.  The handle is only
+    //  inheritable for the duration of this launch so that other children
+    //  do not hold it open.
+    //
+
+    if (ExecContext->BufferOutput) {
+        if (!ForCreateOutputFile(ExecContext, &Child->hOutput)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: could not create temporary file, output will not be buffered\n"));
+            ExecContext->BufferOutput = FALSE;
+            Child->hOutput = NULL;
+        } else if (!DuplicateHandle(GetCurrentProcess(), Child->hOutput, GetCurrentProcess(), &hChildOutput, 0, TRUE, DUPLICATE_SAME_ACCESS)) {
+            hChildOutput = NULL;
+            CloseHandle(Child->hOutput);
+            Child->hOutput = NULL;
+        } else {
+            StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+            StartupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+            StartupInfo.hStdOutput = hChildOutput;
+            StartupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        }
+    }
+
+    //
+    //  The process is created suspended so that it is part of the job
+    //  before it can launch anything or exit.
+    //
+
+    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &StartupInfo, &ProcessInfo)) {
         DWORD LastError = GetLastError();
         LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: execution failed: %s"), ErrText);
@@ -325,17 +1114,45 @@ ForExecuteCommand(
         goto Cleanup;
     }
 
+    //
+    //  If this program is itself within a job that does not allow nesting,
+    //  the process cannot be assigned to a job.  Fall back to waiting on
+    //  process handles.
+    //
+
+    if (ExecContext->UseCompletionPort &&
+        !YoriLibAssignProcessToJobObject(ExecContext->hJob, ProcessInfo.hProcess)) {
+
+        ExecContext->UseCompletionPort = FALSE;
+    }
+
+    Child->hProcess = ProcessInfo.hProcess;
+    Child->ProcessId = ProcessInfo.dwProcessId;
+    ForTrackChildProcess(ExecContext, Child);
+    Child = NULL;
+
+    ResumeThread(ProcessInfo.hThread);
     CloseHandle(ProcessInfo.hThread);
 
-    ExecContext->HandleArray[ExecContext->CurrentConcurrentCount] = ProcessInfo.hProcess;
-    ExecContext->CurrentConcurrentCount++;
+    while (ExecContext->CurrentConcurrentCount > 0 &&
+           ExecContext->CurrentConcurrentCount >= ForGetTargetConcurrentCount(ExecContext)) {
 
-    if (ExecContext->CurrentConcurrentCount == ExecContext->TargetConcurrentCount) {
         ForWaitForProcessToComplete(ExecContext);
     }
 
 Cleanup:
 
+    if (hChildOutput != NULL) {
+        CloseHandle(hChildOutput);
+    }
+
+    if (Child != NULL) {
+        if (Child->hOutput != NULL) {
+            CloseHandle(Child->hOutput);
+        }
+        YoriLibFree(Child);
+    }
+
     for (Count = 0; Count < ArgsNeeded; Count++) {
         YoriLibFreeStringContents(&NewArgArray[Count]);
     }
@@ -344,6 +1161,178 @@ Cleanup:
     YoriLibFree(NewArgArray);
 }
 
+/**
+ Calculate the lengths used to determine how many matches can be executed in
+ a single command.  If the command does not contain the variable, batching is
+ disabled.
+
+ @param ExecContext Pointer to the for exec context.
+ */
+VOID
+ForInitializeBatch(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD Count;
+    DWORD SubstitutesFound;
+
+    //
+    //  Allow for the path to the subshell and its "/c" argument.
+    //
+
+    ExecContext->BatchFixedLength = MAX_PATH + sizeof(" /c ");
+    ExecContext->BatchVariableArgLength = 0;
+    ExecContext->BatchSubstituteCount = 0;
+
+    for (Count = 0; Count < ExecContext->ArgC; Count++) {
+        SubstitutesFound = ForCountSubstitutes(&ExecContext->ArgV[Count], ExecContext);
+        if (SubstitutesFound > 0) {
+            ExecContext->BatchVariableArgLength += ExecContext->ArgV[Count].LengthInChars + 3;
+            ExecContext->BatchSubstituteCount += SubstitutesFound;
+        } else {
+            ExecContext->BatchFixedLength += ExecContext->ArgV[Count].LengthInChars + 3;
+        }
+    }
+
+    ExecContext->BatchLength = ExecContext->BatchFixedLength;
+
+    //
+    //  If the command never refers to the variable, every match would
+    //  generate an identical command, and combining them would execute it
+    //  once for all matches.  Execute once per match instead.
+    //
+
+    if (ExecContext->BatchSubstituteCount == 0) {
+        ExecContext->BatchMode = FALSE;
+    }
+}
+
+/**
+ Execute the command for any matches that have been collected but not yet
+ executed.
+
+ @param ExecContext Pointer to the for exec context.
+ */
+VOID
+ForFlushBatch(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD Index;
+
+    if (ExecContext->BatchMatchCount == 0) {
+        return;
+    }
+
+    ForExecuteCommand(ExecContext->BatchMatches, ExecContext->BatchMatchCount, ExecContext);
+
+    for (Index = 0; Index < ExecContext->BatchMatchCount; Index++) {
+        YoriLibFreeStringContents(&ExecContext->BatchMatches[Index]);
+    }
+    ExecContext->BatchMatchCount = 0;
+    ExecContext->BatchLength = ExecContext->BatchFixedLength;
+}
+
+/**
+ Free any matches that have been collected but not executed, along with the
+ array used to hold them.
+
+ @param ExecContext Pointer to the for exec context.
+ */
+VOID
+ForCleanupBatch(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < ExecContext->BatchMatchCount; Index++) {
+        YoriLibFreeStringContents(&ExecContext->BatchMatches[Index]);
+    }
+    ExecContext->BatchMatchCount = 0;
+
+    if (ExecContext->BatchMatches != NULL) {
+        YoriLibFree(ExecContext->BatchMatches);
+        ExecContext->BatchMatches = NULL;
+    }
+    ExecContext->BatchMatchesAllocated = 0;
+}
+
+/**
+ Process a newly matched element.  If multiple matches are being executed
+ in one command, the match is collected until the command line would become
+ too long, otherwise the command is executed immediately.
+
+ @param Match The match that was found from the set.
+
+ @param ExecContext The current state of child processes and information about
+        the arguments for any new child process.
+ */
+VOID
+ForProcessMatch(
+    __in PYORI_STRING Match,
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    PYORI_STRING NewMatches;
+    DWORD NewAllocated;
+    DWORD MatchLength;
+    DWORD LengthLimit;
+
+    if (!ExecContext->BatchMode) {
+        ForExecuteCommand(Match, 1, ExecContext);
+        return;
+    }
+
+    MatchLength = ExecContext->BatchVariableArgLength +
+                  ExecContext->BatchSubstituteCount * Match->LengthInChars -
+                  ExecContext->BatchSubstituteCount * ExecContext->SubstituteVariable->LengthInChars;
+
+    LengthLimit = FOR_BATCH_MAX_CMDLINE;
+    if (ExecContext->InvokeCmd) {
+        LengthLimit = FOR_BATCH_MAX_CMD_CMDLINE;
+    }
+
+    if (ExecContext->BatchMatchCount > 0 &&
+        ExecContext->BatchLength + MatchLength > LengthLimit) {
+
+        ForFlushBatch(ExecContext);
+    }
+
+    if (ExecContext->BatchMatchCount == ExecContext->BatchMatchesAllocated) {
+        NewAllocated = ExecContext->BatchMatchesAllocated * 2;
+        if (NewAllocated < 64) {
+            NewAllocated = 64;
+        }
+        NewMatches = YoriLibMalloc(NewAllocated * sizeof(YORI_STRING));
+        if (NewMatches == NULL) {
+            ForExecuteCommand(Match, 1, ExecContext);
+            return;
+        }
+        if (ExecContext->BatchMatches != NULL) {
+            memcpy(NewMatches, ExecContext->BatchMatches, ExecContext->BatchMatchCount * sizeof(YORI_STRING));
+            YoriLibFree(ExecContext->BatchMatches);
+        }
+        ExecContext->BatchMatches = NewMatches;
+        ExecContext->BatchMatchesAllocated = NewAllocated;
+    }
+
+    //
+    //  The match is owned by the caller and may be reused, so copy it.
+    //
+
+    if (!YoriLibAllocateString(&ExecContext->BatchMatches[ExecContext->BatchMatchCount], Match->LengthInChars + 1)) {
+        ForExecuteCommand(Match, 1, ExecContext);
+        return;
+    }
+
+    memcpy(ExecContext->BatchMatches[ExecContext->BatchMatchCount].StartOfString, Match->StartOfString, Match->LengthInChars * sizeof(TCHAR));
+    ExecContext->BatchMatches[ExecContext->BatchMatchCount].LengthInChars = Match->LengthInChars;
+    ExecContext->BatchMatches[ExecContext->BatchMatchCount].StartOfString[Match->LengthInChars] = '\0';
+    ExecContext->BatchMatchCount++;
+    ExecContext->BatchLength += MatchLength;
+}
+
 /**
  A callback that is invoked when a file is found that matches a search criteria
  specified in the set of strings to enumerate.
@@ -380,7 +1369,7 @@ ForFileFoundCallback(
         return TRUE;
     }
 
-    ForExecuteCommand(FilePath, ExecContext);
+    ForProcessMatch(FilePath, ExecContext);
     return TRUE;
 }
 
@@ -479,11 +1468,29 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
                 StepMode = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("n")) == 0) {
+#ifdef YORI_BUILTIN
+                ExecContext.InProcBuiltin = TRUE;
+#else
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: -n is only supported when for is a builtin, ignored\n"));
+#endif
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("o")) == 0) {
+                ExecContext.BufferOutput = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("p")) == 0) {
-                if (i + 1 < ArgC) {
+                if (i + 1 < ArgC &&
+                    YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("auto")) == 0) {
+
+                    ExecContext.AutoConcurrency = TRUE;
+                    ExecContext.TargetConcurrentCount = 0;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                } else if (i + 1 < ArgC) {
                     LONGLONG LlNumberProcesses = 0;
                     DWORD CharsConsumed = 0;
                     YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlNumberProcesses, &CharsConsumed);
+                    ExecContext.AutoConcurrency = FALSE;
                     ExecContext.TargetConcurrentCount = (DWORD)LlNumberProcesses;
                     ArgumentUnderstood = TRUE;
                     if (ExecContext.TargetConcurrentCount < 1) {
@@ -494,6 +1501,9 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("r")) == 0) {
                 Recurse = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("x")) == 0) {
+                ExecContext.BatchMode = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("-")) == 0) {
                 ArgumentUnderstood = TRUE;
                 StartArg = i + 1;
@@ -575,9 +1585,9 @@ ENTRYPOINT(
 
     ExecContext.ArgC = ArgC - CmdArg;
     ExecContext.ArgV = &ArgV[CmdArg];
-    ExecContext.HandleArray = YoriLibMalloc(ExecContext.TargetConcurrentCount * sizeof(HANDLE));
-    if (ExecContext.HandleArray == NULL) {
-        goto cleanup_and_exit;
+    ForInitializeReaper(&ExecContext);
+    if (ExecContext.BatchMode) {
+        ForInitializeBatch(&ExecContext);
     }
 
     MatchFlags = 0;
@@ -695,7 +1705,7 @@ ENTRYPOINT(
             }
 
             YoriLibNumberToString(&FoundMatch, Current, 10, 0, '\0');
-            ForExecuteCommand(&FoundMatch, &ExecContext);
+            ForProcessMatch(&FoundMatch, &ExecContext);
             Current += Step;
         } while(TRUE);
 
@@ -758,7 +1768,7 @@ ENTRYPOINT(
                 if (RequiresExpansion) {
                     YoriLibForEachFile(&ThisMatch, MatchFlags, 0, ForFileFoundCallback, NULL, &ExecContext);
                 } else {
-                    ForExecuteCommand(&ThisMatch, &ExecContext);
+                    ForProcessMatch(&ThisMatch, &ExecContext);
                 }
             }
 
@@ -771,18 +1781,27 @@ ENTRYPOINT(
         }
     }
 
+    ForFlushBatch(&ExecContext);
+
     while (ExecContext.CurrentConcurrentCount > 0) {
         ForWaitForProcessToComplete(&ExecContext);
     }
 
     YoriLibFileFiltFreeFilter(&ExecContext.Filter);
-    YoriLibFree(ExecContext.HandleArray);
+    ForCleanupBatch(&ExecContext);
+    ForCleanupReaper(&ExecContext);
 
     return EXIT_SUCCESS;
 
 cleanup_and_exit:
 
+    while (ExecContext.CurrentConcurrentCount > 0) {
+        ForWaitForProcessToComplete(&ExecContext);
+    }
+
     YoriLibFileFiltFreeFilter(&ExecContext.Filter);
+    ForCleanupBatch(&ExecContext);
+    ForCleanupReaper(&ExecContext);
 
     return EXIT_FAILURE;
 }
@@ -439,6 +439,46 @@ YoriCallExecuteExpression(
     return pYoriApiExecuteExpression(Expression);
 }
 
+/**
+ Prototype for the @ref YoriApiExecuteParsedExpression function.
+ */
+typedef BOOL YORI_API_EXECUTE_PARSED_EXPRESSION(PVOID);
+
+/**
+ Prototype for a pointer to the @ref YoriApiExecuteParsedExpression function.
+ */
+typedef YORI_API_EXECUTE_PARSED_EXPRESSION *PYORI_API_EXECUTE_PARSED_EXPRESSION;
+
+/**
+ Pointer to the @ref YoriApiExecuteParsedExpression function.
+ */
+PYORI_API_EXECUTE_PARSED_EXPRESSION pYoriApiExecuteParsedExpression;
+
+/**
+ Execute an expression previously parsed with @ref YoriCallParseExpression .
+
+ @param ParsedExpression Pointer to the parsed expression.
+
+ @return TRUE to indicate it was successfully executed, FALSE otherwise.
+ */
+__success(return)
+BOOL
+YoriCallExecuteParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    if (pYoriApiExecuteParsedExpression == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        pYoriApiExecuteParsedExpression = (PYORI_API_EXECUTE_PARSED_EXPRESSION)GetProcAddress(hYori, "YoriApiExecuteParsedExpression");
+        if (pYoriApiExecuteParsedExpression == NULL) {
+            return FALSE;
+        }
+    }
+    return pYoriApiExecuteParsedExpression(ParsedExpression);
+}
+
 /**
  Prototype for the @ref YoriApiExpandAlias function.
  */
@@ -520,6 +560,42 @@ YoriCallExitProcess(
     pYoriApiExitProcess(ExitCode);
 }
 
+/**
+ Prototype for the @ref YoriApiFreeParsedExpression function.
+ */
+typedef VOID YORI_API_FREE_PARSED_EXPRESSION(PVOID);
+
+/**
+ Prototype for a pointer to the @ref YoriApiFreeParsedExpression function.
+ */
+typedef YORI_API_FREE_PARSED_EXPRESSION *PYORI_API_FREE_PARSED_EXPRESSION;
+
+/**
+ Pointer to the @ref YoriApiFreeParsedExpression function.
+ */
+PYORI_API_FREE_PARSED_EXPRESSION pYoriApiFreeParsedExpression;
+
+/**
+ Free an expression previously parsed with @ref YoriCallParseExpression .
+
+ @param ParsedExpression Pointer to the parsed expression.
+ */
+VOID
+YoriCallFreeParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    if (pYoriApiFreeParsedExpression == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        pYoriApiFreeParsedExpression = (PYORI_API_FREE_PARSED_EXPRESSION)GetProcAddress(hYori, "YoriApiFreeParsedExpression");
+        if (pYoriApiFreeParsedExpression == NULL) {
+            return;
+        }
+    }
+    pYoriApiFreeParsedExpression(ParsedExpression);
+}
 
 /**
  Prototype for the @ref YoriApiFreeYoriString function.
@@ -831,6 +907,65 @@ YoriCallGetJobInformation(
     return pYoriApiGetJobInformation(JobId, HasCompleted, HasOutput, ExitCode, Command);
 }
 
+/**
+ Prototype for the @ref YoriApiGetModuleInformation function.
+ */
+typedef BOOL YORI_API_GET_MODULE_INFORMATION(DWORD, PYORI_STRING, PDWORD, PDWORD, PDWORD);
+
+/**
+ Prototype for a pointer to the @ref YoriApiGetModuleInformation function.
+ */
+typedef YORI_API_GET_MODULE_INFORMATION *PYORI_API_GET_MODULE_INFORMATION;
+
+/**
+ Pointer to the @ref YoriApiGetModuleInformation function.
+ */
+PYORI_API_GET_MODULE_INFORMATION pYoriApiGetModuleInformation;
+
+/**
+ Returns information about a module that is currently loaded by the shell,
+ including modules that are retained in the module cache after use.
+
+ @param Index The zero based index of the module to query.
+
+ @param ModuleName On successful completion, updated to contain the full
+        path to the module.  Free this with @ref YoriCallFreeYoriString .
+
+ @param ReferenceCount On successful completion, updated to contain the
+        number of references to the module.  Zero indicates the module is
+        only loaded because it is cached.
+
+ @param UseCount On successful completion, updated to contain the number of
+        times the module has been located for execution.
+
+ @param LoadTimeInMicroseconds On successful completion, updated to contain
+        the time taken to load the module.
+
+ @return TRUE to indicate success, FALSE to indicate failure, including
+         when Index is beyond the number of loaded modules.
+ */
+__success(return)
+BOOL
+YoriCallGetModuleInformation(
+    __in DWORD Index,
+    __inout PYORI_STRING ModuleName,
+    __out PDWORD ReferenceCount,
+    __out PDWORD UseCount,
+    __out PDWORD LoadTimeInMicroseconds
+    )
+{
+    if (pYoriApiGetModuleInformation == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        pYoriApiGetModuleInformation = (PYORI_API_GET_MODULE_INFORMATION)GetProcAddress(hYori, "YoriApiGetModuleInformation");
+        if (pYoriApiGetModuleInformation == NULL) {
+            return FALSE;
+        }
+    }
+    return pYoriApiGetModuleInformation(Index, ModuleName, ReferenceCount, UseCount, LoadTimeInMicroseconds);
+}
+
 /**
  Prototype for the @ref YoriApiGetJobOutput function.
  */
@@ -1043,6 +1178,53 @@ YoriCallIncrementPromptRecursionDepth(
     return pYoriApiIncrementPromptRecursionDepth();
 }
 
+/**
+ Prototype for the @ref YoriApiParseExpression function.
+ */
+typedef BOOL YORI_API_PARSE_EXPRESSION(PYORI_STRING, PVOID *);
+
+/**
+ Prototype for a pointer to the @ref YoriApiParseExpression function.
+ */
+typedef YORI_API_PARSE_EXPRESSION *PYORI_API_PARSE_EXPRESSION;
+
+/**
+ Pointer to the @ref YoriApiParseExpression function.
+ */
+PYORI_API_PARSE_EXPRESSION pYoriApiParseExpression;
+
+/**
+ Parse a command string into a form that can be executed repeatedly without
+ parsing it again.
+
+ @param Expression The string to parse.
+
+ @param ParsedExpression On successful completion, updated to point to the
+        parsed expression.  Free this with
+        @ref YoriCallFreeParsedExpression .
+
+ @return TRUE to indicate the expression was parsed, FALSE if it could not
+         be and should be executed with @ref YoriCallExecuteExpression .
+ */
+__success(return)
+BOOL
+YoriCallParseExpression(
+    __in PYORI_STRING Expression,
+    __out PVOID * ParsedExpression
+    )
+{
+    if (pYoriApiParseExpression == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        pYoriApiParseExpression = (PYORI_API_PARSE_EXPRESSION)GetProcAddress(hYori, "YoriApiParseExpression");
+        if (pYoriApiParseExpression == NULL) {
+            return FALSE;
+        }
+    }
+    return pYoriApiParseExpression(Expression, ParsedExpression);
+}
+
 /**
  Prototype for the @ref YoriApiPipeJobOutput function.
  */
@@ -84,4 +84,33 @@ YoriLibLimitJobObjectPriority(
     return DllKernel32.pSetInformationJobObject(hJob, 2, &LimitInfo, sizeof(LimitInfo));
 }
 
+/**
+ Associate a job object with a completion port, so that messages describing
+ processes within the job, such as their termination, are queued to the port.
+ If this functionality is not supported by the host OS, returns FALSE.
+
+ @param hJob Handle to the job object.
+
+ @param hPort Handle to the completion port.
+
+ @param Key A context value to return with each message from this job.
+
+ @return TRUE on success, FALSE on failure.
+ */
+BOOL
+YoriLibAssociateJobObjectWithCompletionPort(
+    __in HANDLE hJob,
+    __in HANDLE hPort,
+    __in_opt PVOID Key
+    )
+{
+    YORI_JOB_ASSOCIATE_COMPLETION_PORT AssociateInfo;
+    if (DllKernel32.pSetInformationJobObject == NULL) {
+        return FALSE;
+    }
+    AssociateInfo.Key = Key;
+    AssociateInfo.Port = hPort;
+    return DllKernel32.pSetInformationJobObject(hJob, 7, &AssociateInfo, sizeof(AssociateInfo));
+}
+
 // vim:sw=4:ts=4:et:
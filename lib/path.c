@@ -187,12 +187,12 @@ typedef struct _YORI_PATHEXT_COMPONENT {
 } YORI_PATHEXT_COMPONENT, *PYORI_PATHEXT_COMPONENT;
 
 /**
- Convert a directory name and matched file within that directory into a fully
+ Convert a directory name and file name within that directory into a fully
  qualified file path.
 
  @param SearchPath Pointer to the directory being searched.
 
- @param Match Pointer to the object found within the directory.
+ @param FileName Pointer to the name of the object within the directory.
 
  @param Out On successful completion, updated to point to a fully qualified
         path to the file.
@@ -200,16 +200,14 @@ typedef struct _YORI_PATHEXT_COMPONENT {
  @param FullPath If TRUE, return an escaped form of the path; if FALSE, return
         a Win32 path without any escape.
 
- @return TRUE to indicate the lookup was successful, and FALSE to indicate a
-         lookup failure.  Success does not imply a match was found; if a
-         lookup successfully found nothing, FoundPath will contain an empty
-         string.
+ @return TRUE to indicate the path was successfully generated, FALSE if it
+         was not.
  */
 __success(return)
 BOOL
-YoriLibLocateBuildFullName(
+YoriLibLocateBuildFullNameFromString(
     __in PYORI_STRING SearchPath,
-    __in PWIN32_FIND_DATA Match,
+    __in PYORI_STRING FileName,
     __inout PYORI_STRING Out,
     __in BOOL FullPath
     )
@@ -218,9 +216,8 @@ YoriLibLocateBuildFullName(
     YORI_STRING FoundPath;
     LPTSTR fn;
     BOOL NeedsSeperator;
-    DWORD FileNameLen = _tcslen(Match->cFileName);
 
-    if (!YoriLibAllocateString(&FoundPath, SearchPath->LengthInChars + 1 + FileNameLen + 1)) {
+    if (!YoriLibAllocateString(&FoundPath, SearchPath->LengthInChars + 1 + FileName->LengthInChars + 1)) {
         return FALSE;
     }
 
@@ -249,18 +246,53 @@ YoriLibLocateBuildFullName(
         FoundPath.LengthInChars = SearchPath->LengthInChars;
     }
 
-    memcpy(&FoundPath.StartOfString[FoundPath.LengthInChars], Match->cFileName, (FileNameLen + 1) * sizeof(TCHAR));
-    FoundPath.LengthInChars += FileNameLen;
+    memcpy(&FoundPath.StartOfString[FoundPath.LengthInChars], FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
+    FoundPath.LengthInChars += FileName->LengthInChars;
+    FoundPath.StartOfString[FoundPath.LengthInChars] = '\0';
 
     if (!YoriLibGetFullPathNameReturnAllocation(&FoundPath, FullPath, Out, &fn)) {
         YoriLibFreeStringContents(&FoundPath);
         return FALSE;
     }
-    YoriLibFreeStringContents(&FoundPath);
 
+    YoriLibFreeStringContents(&FoundPath);
     return TRUE;
 }
 
+/**
+ Convert a directory name and matched file within that directory into a fully
+ qualified file path.
+
+ @param SearchPath Pointer to the directory being searched.
+
+ @param Match Pointer to the object found within the directory.
+
+ @param Out On successful completion, updated to point to a fully qualified
+        path to the file.
+
+ @param FullPath If TRUE, return an escaped form of the path; if FALSE, return
+        a Win32 path without any escape.
+
+ @return TRUE to indicate the lookup was successful, and FALSE to indicate a
+         lookup failure.  Success does not imply a match was found; if a
+         lookup successfully found nothing, FoundPath will contain an empty
+         string.
+ */
+__success(return)
+BOOL
+YoriLibLocateBuildFullName(
+    __in PYORI_STRING SearchPath,
+    __in PWIN32_FIND_DATA Match,
+    __inout PYORI_STRING Out,
+    __in BOOL FullPath
+    )
+{
+    YORI_STRING FileName;
+
+    YoriLibConstantString(&FileName, Match->cFileName);
+    return YoriLibLocateBuildFullNameFromString(SearchPath, &FileName, Out, FullPath);
+}
+
 /**
  A hardcoded search order for file extensions if the environment variable is
  not defined.
@@ -667,6 +699,948 @@ YoriLibLocateFileExtensionsInOnePath(
     return TRUE;
 }
 
+/**
+ A single file or subdirectory found within a directory that is described by
+ the PATH index.  Subdirectories are included because a search of the
+ directory on disk would match them.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_FILE {
+
+    /**
+     The links of this file within the list of files in the directory.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry of this file within the directory's hash table, keyed by the
+     file name.  The hash is case insensitive, so lookups don't need to
+     know the case of the file on disk.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the file, in the case it was found on disk.  The string
+     is allocated as part of this structure.
+     */
+    YORI_STRING FileName;
+} YORI_LIB_PATH_INDEX_FILE, *PYORI_LIB_PATH_INDEX_FILE;
+
+/**
+ A single directory that is a component of the PATH index.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_DIRECTORY {
+
+    /**
+     The directory, as specified in the PATH environment variable.
+     */
+    YORI_STRING DirectoryPath;
+
+    /**
+     A change notification handle which is signalled when files are added,
+     removed or renamed in the directory.  If this is NULL, the directory
+     is not indexed and must be searched on every request.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     A hash table of files within the directory.
+     */
+    PYORI_HASH_TABLE FileTable;
+
+    /**
+     A list of files within the directory, in enumeration order.
+     */
+    YORI_LIST_ENTRY FileList;
+} YORI_LIB_PATH_INDEX_DIRECTORY, *PYORI_LIB_PATH_INDEX_DIRECTORY;
+
+/**
+ An index of the contents of each directory in a PATH environment variable.
+ */
+typedef struct _YORI_LIB_PATH_INDEX {
+
+    /**
+     The value of the PATH environment variable that this index describes.
+     If the environment variable changes, the index is no longer valid.
+     */
+    YORI_STRING PathVariable;
+
+    /**
+     The number of elements in the Directories array.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     An array of directories, in the order they are found in PATH.
+     */
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directories;
+} YORI_LIB_PATH_INDEX, *PYORI_LIB_PATH_INDEX;
+
+/**
+ Process wide state describing the PATH index.  The index is only used by
+ processes that opt into it, since it is only valuable for a process that
+ performs many path lookups over its lifetime.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_STATE {
+
+    /**
+     TRUE if the process has requested the PATH index be used.
+     */
+    BOOL Enabled;
+
+    /**
+     Set to TRUE to indicate that any background index build should stop
+     as soon as possible.
+     */
+    BOOL TerminateBuild;
+
+    /**
+     A mutex that synchronizes access to the current index.  This is held
+     for the duration of any lookup using the index.
+     */
+    HANDLE Mutex;
+
+    /**
+     The most recently built index.  This may describe a PATH value that
+     is no longer current.
+     */
+    PYORI_LIB_PATH_INDEX Index;
+
+    /**
+     A handle to a thread building a new index, or NULL if no build has
+     been started.
+     */
+    HANDLE BuildThread;
+
+    /**
+     The value of the PATH environment variable that the build thread is
+     constructing an index for.  This is owned by the build thread while it
+     is running.
+     */
+    YORI_STRING BuildPathVariable;
+} YORI_LIB_PATH_INDEX_STATE, *PYORI_LIB_PATH_INDEX_STATE;
+
+/**
+ The state of the PATH index for this process.
+ */
+YORI_LIB_PATH_INDEX_STATE YoriLibPathIndexState;
+
+/**
+ Free all files that have been indexed for a single directory.
+
+ @param Directory Pointer to the directory whose contents should be freed.
+ */
+VOID
+YoriLibPathIndexFreeDirectoryContents(
+    __in PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_FILE File;
+
+    if (Directory->FileTable == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->FileList, ListEntry);
+        YoriLibRemoveListItem(&File->ListEntry);
+        YoriLibHashRemoveByEntry(&File->HashEntry);
+        YoriLibFree(File);
+    }
+
+    YoriLibFreeEmptyHashTable(Directory->FileTable);
+    Directory->FileTable = NULL;
+}
+
+/**
+ Enumerate the files within a single directory and populate the directory's
+ hash table.  Any previously indexed contents are discarded.
+
+ @param Directory Pointer to the directory to enumerate.
+
+ @return TRUE to indicate the directory was successfully indexed, FALSE if
+         it was not.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexScanDirectory(
+    __in PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    YORI_STRING SearchName;
+    YORI_STRING FileName;
+    HANDLE hFind;
+    WIN32_FIND_DATA FindData;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_FILE File;
+    DWORD FileCount;
+
+    YoriLibPathIndexFreeDirectoryContents(Directory);
+    YoriLibInitializeListHead(&Directory->FileList);
+
+    if (!YoriLibAllocateString(&SearchName, Directory->DirectoryPath.LengthInChars + sizeof("\\*"))) {
+        return FALSE;
+    }
+
+    if (Directory->DirectoryPath.LengthInChars > 0 &&
+        YoriLibIsSep(Directory->DirectoryPath.StartOfString[Directory->DirectoryPath.LengthInChars - 1])) {
+
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y*"), &Directory->DirectoryPath);
+    } else {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y\\*"), &Directory->DirectoryPath);
+    }
+
+    //
+    //  Collect every file and subdirectory in the directory, since a search
+    //  on disk would match either.  Extensions are not filtered here so
+    //  that a change to PATHEXT doesn't invalidate the index.
+    //
+
+    FileCount = 0;
+    hFind = FindFirstFile(SearchName.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchName);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    do {
+        if (_tcscmp(FindData.cFileName, _T(".")) != 0 &&
+            _tcscmp(FindData.cFileName, _T("..")) != 0) {
+
+            YoriLibConstantString(&FileName, FindData.cFileName);
+            File = YoriLibMalloc(sizeof(YORI_LIB_PATH_INDEX_FILE) + (FileName.LengthInChars + 1) * sizeof(TCHAR));
+            if (File == NULL) {
+                break;
+            }
+
+            YoriLibInitEmptyString(&File->FileName);
+            File->FileName.StartOfString = (LPTSTR)(File + 1);
+            memcpy(File->FileName.StartOfString, FileName.StartOfString, (FileName.LengthInChars + 1) * sizeof(TCHAR));
+            File->FileName.LengthInChars = FileName.LengthInChars;
+            File->FileName.LengthAllocated = FileName.LengthInChars + 1;
+            YoriLibAppendList(&Directory->FileList, &File->ListEntry);
+            FileCount++;
+        }
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+
+    //
+    //  Now that the number of files is known, size the hash table to match
+    //  and insert each file into it.
+    //
+
+    Directory->FileTable = YoriLibAllocateHashTable(FileCount / 4 + 1);
+    if (Directory->FileTable == NULL) {
+        ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+        while (ListEntry != NULL) {
+            File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&Directory->FileList, ListEntry);
+            YoriLibRemoveListItem(&File->ListEntry);
+            YoriLibFree(File);
+        }
+        return FALSE;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+        YoriLibHashInsertByKey(Directory->FileTable, &File->FileName, File, &File->HashEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->FileList, ListEntry);
+    }
+
+    return TRUE;
+}
+
+/**
+ Stop indexing a directory.  Future lookups will search the directory
+ directly.
+
+ @param Directory Pointer to the directory to stop indexing.
+ */
+VOID
+YoriLibPathIndexAbandonDirectory(
+    __in PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    YoriLibPathIndexFreeDirectoryContents(Directory);
+    if (Directory->ChangeNotification != NULL) {
+        FindCloseChangeNotification(Directory->ChangeNotification);
+        Directory->ChangeNotification = NULL;
+    }
+}
+
+/**
+ Free a PATH index.
+
+ @param Index Pointer to the index to free.
+ */
+VOID
+YoriLibPathIndexFree(
+    __in PYORI_LIB_PATH_INDEX Index
+    )
+{
+    DWORD Count;
+
+    for (Count = 0; Count < Index->DirectoryCount; Count++) {
+        YoriLibPathIndexAbandonDirectory(&Index->Directories[Count]);
+        YoriLibFreeStringContents(&Index->Directories[Count].DirectoryPath);
+    }
+
+    if (Index->Directories != NULL) {
+        YoriLibFree(Index->Directories);
+    }
+    YoriLibFreeStringContents(&Index->PathVariable);
+    YoriLibFree(Index);
+}
+
+/**
+ Find the next component within a PATH environment variable.  Components
+ are seperated by semicolons and may be enclosed in quotes.
+
+ @param PathVariable Pointer to the PATH environment variable.
+
+ @param Offset On input, the offset within the environment variable to start
+        searching from.  On output, updated to point beyond the component
+        that was found.
+
+ @param Component On successful completion, updated to point to the
+        component within PathVariable.  This string is not allocated.
+
+ @return TRUE to indicate a component was found, FALSE if the end of the
+         environment variable was reached.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexGetNextComponent(
+    __in PYORI_STRING PathVariable,
+    __inout PDWORD Offset,
+    __out PYORI_STRING Component
+    )
+{
+    DWORD Index;
+    TCHAR Terminator;
+
+    Index = *Offset;
+    YoriLibInitEmptyString(Component);
+
+    while (Index < PathVariable->LengthInChars) {
+        if (PathVariable->StartOfString[Index] == ';') {
+            Index++;
+            continue;
+        }
+
+        Terminator = ';';
+        if (PathVariable->StartOfString[Index] == '"') {
+            Terminator = '"';
+            Index++;
+        }
+
+        Component->StartOfString = &PathVariable->StartOfString[Index];
+        while (Index < PathVariable->LengthInChars &&
+               PathVariable->StartOfString[Index] != Terminator) {
+            Index++;
+        }
+        Component->LengthInChars = (DWORD)(&PathVariable->StartOfString[Index] - Component->StartOfString);
+
+        if (Terminator == '"' && Index < PathVariable->LengthInChars) {
+            Index++;
+        }
+
+        if (Component->LengthInChars > 0) {
+            *Offset = Index;
+            return TRUE;
+        }
+    }
+
+    *Offset = Index;
+    return FALSE;
+}
+
+/**
+ Build an index of the directories within a PATH environment variable.
+ Directories which are relative, or which cannot be monitored for changes,
+ are recorded so that they can be searched in PATH order, but their contents
+ are not indexed.
+
+ @param PathVariable Pointer to the value of the PATH environment variable.
+
+ @return On successful completion, a pointer to the index.  The caller is
+         expected to free this with @ref YoriLibPathIndexFree .  On failure,
+         NULL.
+ */
+__success(return != NULL)
+PYORI_LIB_PATH_INDEX
+YoriLibPathIndexBuild(
+    __in PYORI_STRING PathVariable
+    )
+{
+    PYORI_LIB_PATH_INDEX Index;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+    YORI_STRING Component;
+    DWORD Offset;
+    DWORD Count;
+
+    Index = YoriLibMalloc(sizeof(YORI_LIB_PATH_INDEX));
+    if (Index == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Index, sizeof(YORI_LIB_PATH_INDEX));
+    if (!YoriLibAllocateString(&Index->PathVariable, PathVariable->LengthInChars + 1)) {
+        YoriLibFree(Index);
+        return NULL;
+    }
+    memcpy(Index->PathVariable.StartOfString, PathVariable->StartOfString, PathVariable->LengthInChars * sizeof(TCHAR));
+    Index->PathVariable.LengthInChars = PathVariable->LengthInChars;
+    Index->PathVariable.StartOfString[Index->PathVariable.LengthInChars] = '\0';
+
+    Count = 0;
+    Offset = 0;
+    while (YoriLibPathIndexGetNextComponent(&Index->PathVariable, &Offset, &Component)) {
+        Count++;
+    }
+
+    if (Count == 0) {
+        return Index;
+    }
+
+    Index->Directories = YoriLibMalloc(Count * sizeof(YORI_LIB_PATH_INDEX_DIRECTORY));
+    if (Index->Directories == NULL) {
+        YoriLibPathIndexFree(Index);
+        return NULL;
+    }
+    ZeroMemory(Index->Directories, Count * sizeof(YORI_LIB_PATH_INDEX_DIRECTORY));
+
+    Offset = 0;
+    while (Index->DirectoryCount < Count &&
+           YoriLibPathIndexGetNextComponent(&Index->PathVariable, &Offset, &Component)) {
+
+        if (YoriLibPathIndexState.TerminateBuild) {
+            YoriLibPathIndexFree(Index);
+            return NULL;
+        }
+
+        Directory = &Index->Directories[Index->DirectoryCount];
+        YoriLibInitializeListHead(&Directory->FileList);
+        if (!YoriLibAllocateString(&Directory->DirectoryPath, Component.LengthInChars + 1)) {
+            YoriLibPathIndexFree(Index);
+            return NULL;
+        }
+        memcpy(Directory->DirectoryPath.StartOfString, Component.StartOfString, Component.LengthInChars * sizeof(TCHAR));
+        Directory->DirectoryPath.LengthInChars = Component.LengthInChars;
+        Directory->DirectoryPath.StartOfString[Directory->DirectoryPath.LengthInChars] = '\0';
+        Index->DirectoryCount++;
+
+        //
+        //  Relative directories depend on the current directory, so their
+        //  contents can't be remembered.
+        //
+
+        if (!YoriLibIsDriveLetterWithColonAndSlash(&Directory->DirectoryPath) &&
+            !(Directory->DirectoryPath.LengthInChars >= 2 &&
+              YoriLibIsSep(Directory->DirectoryPath.StartOfString[0]) &&
+              YoriLibIsSep(Directory->DirectoryPath.StartOfString[1]))) {
+
+            continue;
+        }
+
+        //
+        //  Register for notifications before enumerating so that any
+        //  change that occurs during the enumerate causes a rescan.
+        //
+
+        Directory->ChangeNotification = FindFirstChangeNotification(Directory->DirectoryPath.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+        if (Directory->ChangeNotification == INVALID_HANDLE_VALUE) {
+            Directory->ChangeNotification = NULL;
+            continue;
+        }
+
+        if (!YoriLibPathIndexScanDirectory(Directory)) {
+            YoriLibPathIndexAbandonDirectory(Directory);
+        }
+    }
+
+    return Index;
+}
+
+/**
+ A background thread which constructs a new PATH index and, once complete,
+ makes it available for lookups.
+
+ @param Context Unused.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriLibPathIndexBuildWorker(
+    __in PVOID Context
+    )
+{
+    PYORI_LIB_PATH_INDEX Index;
+    PYORI_LIB_PATH_INDEX OldIndex;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    Index = YoriLibPathIndexBuild(&YoriLibPathIndexState.BuildPathVariable);
+    YoriLibFreeStringContents(&YoriLibPathIndexState.BuildPathVariable);
+    if (Index == NULL) {
+        return 0;
+    }
+
+    WaitForSingleObject(YoriLibPathIndexState.Mutex, INFINITE);
+    OldIndex = YoriLibPathIndexState.Index;
+    YoriLibPathIndexState.Index = Index;
+    ReleaseMutex(YoriLibPathIndexState.Mutex);
+
+    if (OldIndex != NULL) {
+        YoriLibPathIndexFree(OldIndex);
+    }
+
+    return 0;
+}
+
+/**
+ Start building an index for a PATH value on a background thread, unless a
+ build is already in progress.  This function assumes the caller holds the
+ index mutex.
+
+ @param PathVariable Pointer to the value of the PATH environment variable
+        to index.
+ */
+VOID
+YoriLibPathIndexStartBuild(
+    __in PYORI_STRING PathVariable
+    )
+{
+    DWORD ThreadId;
+
+    if (YoriLibPathIndexState.BuildThread != NULL) {
+        if (WaitForSingleObject(YoriLibPathIndexState.BuildThread, 0) != WAIT_OBJECT_0) {
+            return;
+        }
+        CloseHandle(YoriLibPathIndexState.BuildThread);
+        YoriLibPathIndexState.BuildThread = NULL;
+    }
+
+    if (!YoriLibAllocateString(&YoriLibPathIndexState.BuildPathVariable, PathVariable->LengthInChars + 1)) {
+        return;
+    }
+    memcpy(YoriLibPathIndexState.BuildPathVariable.StartOfString, PathVariable->StartOfString, PathVariable->LengthInChars * sizeof(TCHAR));
+    YoriLibPathIndexState.BuildPathVariable.LengthInChars = PathVariable->LengthInChars;
+    YoriLibPathIndexState.BuildPathVariable.StartOfString[PathVariable->LengthInChars] = '\0';
+
+    YoriLibPathIndexState.BuildThread = CreateThread(NULL, 0, YoriLibPathIndexBuildWorker, NULL, 0, &ThreadId);
+    if (YoriLibPathIndexState.BuildThread == NULL) {
+        YoriLibFreeStringContents(&YoriLibPathIndexState.BuildPathVariable);
+    }
+}
+
+/**
+ Indicate that this process performs frequent path lookups and would benefit
+ from an index of the contents of each directory in PATH.  The index is
+ constructed on a background thread; until it is ready, lookups search the
+ file system directly.
+
+ @return TRUE to indicate the index was enabled, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexEnable(VOID)
+{
+    YORI_STRING PathVariable;
+    DWORD PathLength;
+
+    if (YoriLibPathIndexState.Enabled) {
+        return TRUE;
+    }
+
+    YoriLibPathIndexState.Mutex = CreateMutex(NULL, FALSE, NULL);
+    if (YoriLibPathIndexState.Mutex == NULL) {
+        return FALSE;
+    }
+
+    YoriLibPathIndexState.TerminateBuild = FALSE;
+    YoriLibPathIndexState.Enabled = TRUE;
+
+    PathLength = GetEnvironmentVariable(_T("PATH"), NULL, 0);
+    if (PathLength > 0 && YoriLibAllocateString(&PathVariable, PathLength)) {
+        PathVariable.LengthInChars = GetEnvironmentVariable(_T("PATH"), PathVariable.StartOfString, PathVariable.LengthAllocated);
+        if (PathVariable.LengthInChars > 0 && PathVariable.LengthInChars < PathVariable.LengthAllocated) {
+            WaitForSingleObject(YoriLibPathIndexState.Mutex, INFINITE);
+            YoriLibPathIndexStartBuild(&PathVariable);
+            ReleaseMutex(YoriLibPathIndexState.Mutex);
+        }
+        YoriLibFreeStringContents(&PathVariable);
+    }
+
+    return TRUE;
+}
+
+/**
+ Stop using the PATH index and free all memory associated with it.
+ */
+VOID
+YoriLibPathIndexDisable(VOID)
+{
+    if (!YoriLibPathIndexState.Enabled) {
+        return;
+    }
+
+    YoriLibPathIndexState.TerminateBuild = TRUE;
+    if (YoriLibPathIndexState.BuildThread != NULL) {
+        WaitForSingleObject(YoriLibPathIndexState.BuildThread, INFINITE);
+        CloseHandle(YoriLibPathIndexState.BuildThread);
+        YoriLibPathIndexState.BuildThread = NULL;
+    }
+    YoriLibFreeStringContents(&YoriLibPathIndexState.BuildPathVariable);
+
+    if (YoriLibPathIndexState.Index != NULL) {
+        YoriLibPathIndexFree(YoriLibPathIndexState.Index);
+        YoriLibPathIndexState.Index = NULL;
+    }
+
+    CloseHandle(YoriLibPathIndexState.Mutex);
+    YoriLibPathIndexState.Mutex = NULL;
+    YoriLibPathIndexState.Enabled = FALSE;
+}
+
+/**
+ Obtain the PATH index for a specified PATH value.  If the current index
+ describes a different value, a new index is built in the background and
+ this request is not satisfied from the index.
+
+ @param PathVariable Pointer to the current value of the PATH environment
+        variable.
+
+ @return On success, a pointer to the index.  The index mutex is held and the
+         caller is expected to release it with @ref YoriLibPathIndexRelease .
+         If no index is available, returns NULL and the mutex is not held.
+ */
+PYORI_LIB_PATH_INDEX
+YoriLibPathIndexAcquire(
+    __in PYORI_STRING PathVariable
+    )
+{
+    PYORI_LIB_PATH_INDEX Index;
+
+    if (!YoriLibPathIndexState.Enabled) {
+        return NULL;
+    }
+
+    WaitForSingleObject(YoriLibPathIndexState.Mutex, INFINITE);
+    Index = YoriLibPathIndexState.Index;
+    if (Index != NULL &&
+        YoriLibCompareString(&Index->PathVariable, PathVariable) == 0) {
+
+        return Index;
+    }
+
+    YoriLibPathIndexStartBuild(PathVariable);
+    ReleaseMutex(YoriLibPathIndexState.Mutex);
+    return NULL;
+}
+
+/**
+ Indicate that a lookup has finished using the PATH index.
+
+ @param Index Pointer to the index returned from
+        @ref YoriLibPathIndexAcquire .
+ */
+VOID
+YoriLibPathIndexRelease(
+    __in PYORI_LIB_PATH_INDEX Index
+    )
+{
+    UNREFERENCED_PARAMETER(Index);
+    ReleaseMutex(YoriLibPathIndexState.Mutex);
+}
+
+/**
+ Check whether a directory in the PATH index has changed since it was
+ enumerated, and if so, enumerate it again.  If the directory can no longer
+ be monitored, it stops being indexed.
+
+ @param Directory Pointer to the directory to check.
+ */
+VOID
+YoriLibPathIndexRefreshDirectory(
+    __in PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    if (Directory->ChangeNotification == NULL) {
+        return;
+    }
+
+    if (WaitForSingleObject(Directory->ChangeNotification, 0) != WAIT_OBJECT_0) {
+        return;
+    }
+
+    //
+    //  Rearm the notification before enumerating so any change during the
+    //  enumerate is detected next time.
+    //
+
+    if (!FindNextChangeNotification(Directory->ChangeNotification) ||
+        !YoriLibPathIndexScanDirectory(Directory)) {
+
+        YoriLibPathIndexAbandonDirectory(Directory);
+    }
+}
+
+/**
+ Search the directories in PATH for a file using the PATH index.  Each
+ directory is searched in PATH order, and within each directory extensions
+ are matched in PATHEXT order.  Directories which are not indexed are
+ searched on disk.
+
+ @param SearchFor The file name to search for, without any path component.
+        If MatchAllCallback is specified, this may end in a wildcard, in which
+        case every file starting with the specified prefix and ending in one
+        of the extensions is returned.  Wildcards are not handled by the
+        index if KnownExtension is TRUE.
+
+ @param PathVariable The value of the PATH environment variable.
+
+ @param PathExtData Points to an array of file name extensions to search for.
+        If the file name has a known extension, this should contain a single
+        empty extension.
+
+ @param PathExtCount The number of elements in PathExtData.
+
+ @param KnownExtension If TRUE, the file name already has an extension, and
+        PathExtData should contain a single empty extension.  The current
+        directory is checked for SearchFor before searching the PATH.  A
+        search on disk for a name with a known extension and a wildcard
+        reports only the first match in each directory, so these searches
+        are left to the caller.
+
+ @param MatchAllCallback Optional callback to be invoked on every single
+        match.  If not specified, the first match is returned in FoundPath.
+
+ @param MatchAllContext Optional context to pass to the callback, if it is
+        specified.
+
+ @param FoundPath Points to a buffer to populate with the first match if
+        MatchAllCallback is not specified.
+
+ @param Handled On successful completion, set to TRUE if the search was
+        performed using the index, or FALSE if the index could not be used.
+        If the index could not be used, no matches have been returned and
+        the caller is expected to search without it.
+
+ @return TRUE to indicate the lookup was successful, and FALSE to indicate a
+         lookup failure.  Success does not imply a match was found; if a
+         lookup successfully found nothing, FoundPath will contain an empty
+         string.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexLocate(
+    __in PYORI_STRING SearchFor,
+    __in PYORI_STRING PathVariable,
+    __inout PYORI_PATHEXT_COMPONENT PathExtData,
+    __in DWORD PathExtCount,
+    __in BOOL KnownExtension,
+    __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
+    __in_opt PVOID MatchAllContext,
+    __inout PYORI_STRING FoundPath,
+    __out PBOOL Handled
+    )
+{
+    PYORI_LIB_PATH_INDEX Index;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+    PYORI_LIB_PATH_INDEX_FILE File;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING Prefix;
+    YORI_STRING Key;
+    YORI_STRING ScratchArea;
+    DWORD DirIndex;
+    DWORD ExtIndex;
+    DWORD CharIndex;
+    DWORD LongestExtension;
+    BOOL PrefixMatch;
+    BOOL Result;
+
+    *Handled = FALSE;
+
+    //
+    //  The index can answer exact name lookups, and prefix lookups when the
+    //  caller wants all matches of a name without an extension.  Anything
+    //  more complex is left to the file system.
+    //
+
+    if (SearchFor->LengthInChars == 0) {
+        return TRUE;
+    }
+
+    YoriLibInitEmptyString(&Prefix);
+    Prefix.StartOfString = SearchFor->StartOfString;
+    Prefix.LengthInChars = SearchFor->LengthInChars;
+    PrefixMatch = FALSE;
+    if (SearchFor->StartOfString[SearchFor->LengthInChars - 1] == '*') {
+        if (MatchAllCallback == NULL || KnownExtension) {
+            return TRUE;
+        }
+        PrefixMatch = TRUE;
+        Prefix.LengthInChars--;
+    }
+
+    for (CharIndex = 0; CharIndex < Prefix.LengthInChars; CharIndex++) {
+        if (Prefix.StartOfString[CharIndex] == '*' ||
+            Prefix.StartOfString[CharIndex] == '?' ||
+            YoriLibIsSep(Prefix.StartOfString[CharIndex]) ||
+            Prefix.StartOfString[CharIndex] == ':') {
+
+            return TRUE;
+        }
+    }
+
+    LongestExtension = 0;
+    for (ExtIndex = 0; ExtIndex < PathExtCount; ExtIndex++) {
+        if (PathExtData[ExtIndex].Extension.LengthInChars > LongestExtension) {
+            LongestExtension = PathExtData[ExtIndex].Extension.LengthInChars;
+        }
+    }
+
+    if (!YoriLibAllocateString(&Key, Prefix.LengthInChars + LongestExtension + 1)) {
+        return FALSE;
+    }
+
+    Index = YoriLibPathIndexAcquire(PathVariable);
+    if (Index == NULL) {
+        YoriLibFreeStringContents(&Key);
+        return TRUE;
+    }
+
+    *Handled = TRUE;
+    Result = TRUE;
+    YoriLibInitEmptyString(&ScratchArea);
+    FoundPath->StartOfString[0] = '\0';
+    FoundPath->LengthInChars = 0;
+
+    if (KnownExtension) {
+        YORI_STRING NoPath;
+
+        YoriLibConstantString(&NoPath, _T(""));
+        YoriLibSearchEnv(SearchFor, &NoPath, &Key, MatchAllCallback, MatchAllContext, FoundPath, FALSE);
+        if (MatchAllCallback == NULL && FoundPath->StartOfString[0] != '\0') {
+            goto Exit;
+        }
+        FoundPath->StartOfString[0] = '\0';
+        FoundPath->LengthInChars = 0;
+    }
+
+    for (DirIndex = 0; DirIndex < Index->DirectoryCount; DirIndex++) {
+        Directory = &Index->Directories[DirIndex];
+        YoriLibPathIndexRefreshDirectory(Directory);
+
+        //
+        //  If the directory isn't indexed, search it on disk.
+        //
+
+        if (Directory->FileTable == NULL) {
+            if (!YoriLibLocateFileExtensionsInOnePath(SearchFor,
+                                                      &Directory->DirectoryPath,
+                                                      &ScratchArea,
+                                                      PathExtData,
+                                                      PathExtCount,
+                                                      MatchAllCallback,
+                                                      MatchAllContext,
+                                                      FoundPath,
+                                                      FALSE)) {
+                Result = FALSE;
+                goto Exit;
+            }
+
+            if (FoundPath->StartOfString[0] != '\0') {
+                goto Exit;
+            }
+            continue;
+        }
+
+        if (PrefixMatch) {
+
+            //
+            //  Report every file starting with the prefix whose extension
+            //  is one of the ones being searched for.
+            //
+
+            ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+            while (ListEntry != NULL) {
+                File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+                ListEntry = YoriLibGetNextListEntry(&Directory->FileList, ListEntry);
+
+                if (YoriLibCompareStringInsensitiveCount(&File->FileName, &Prefix, Prefix.LengthInChars) != 0) {
+                    continue;
+                }
+
+                for (ExtIndex = 0; ExtIndex < PathExtCount; ExtIndex++) {
+                    if (File->FileName.LengthInChars > PathExtData[ExtIndex].Extension.LengthInChars &&
+                        _tcsnicmp(PathExtData[ExtIndex].Extension.StartOfString,
+                                  &File->FileName.StartOfString[File->FileName.LengthInChars - PathExtData[ExtIndex].Extension.LengthInChars],
+                                  PathExtData[ExtIndex].Extension.LengthInChars) == 0) {
+
+                        break;
+                    }
+                }
+
+                if (ExtIndex < PathExtCount) {
+                    if (!YoriLibLocateBuildFullNameFromString(&Directory->DirectoryPath, &File->FileName, FoundPath, FALSE)) {
+                        Result = FALSE;
+                        goto Exit;
+                    }
+                    if (!MatchAllCallback(FoundPath, MatchAllContext)) {
+                        Result = FALSE;
+                        goto Exit;
+                    }
+                    FoundPath->StartOfString[0] = '\0';
+                    FoundPath->LengthInChars = 0;
+                }
+            }
+            continue;
+        }
+
+        //
+        //  Look up the name with each extension in PATHEXT order.
+        //
+
+        for (ExtIndex = 0; ExtIndex < PathExtCount; ExtIndex++) {
+            Key.LengthInChars = YoriLibSPrintf(Key.StartOfString, _T("%y%y"), &Prefix, &PathExtData[ExtIndex].Extension);
+            HashEntry = YoriLibHashLookupByKey(Directory->FileTable, &Key);
+            if (HashEntry == NULL) {
+                continue;
+            }
+
+            File = (PYORI_LIB_PATH_INDEX_FILE)HashEntry->Context;
+            if (!YoriLibLocateBuildFullNameFromString(&Directory->DirectoryPath, &File->FileName, FoundPath, FALSE)) {
+                Result = FALSE;
+                goto Exit;
+            }
+
+            if (MatchAllCallback == NULL) {
+                goto Exit;
+            }
+
+            if (!MatchAllCallback(FoundPath, MatchAllContext)) {
+                Result = FALSE;
+                goto Exit;
+            }
+            FoundPath->StartOfString[0] = '\0';
+            FoundPath->LengthInChars = 0;
+        }
+    }
+
+Exit:
+    YoriLibPathIndexRelease(Index);
+    YoriLibFreeStringContents(&ScratchArea);
+    YoriLibFreeStringContents(&Key);
+    return Result;
+}
+
 /**
  Perform a path search for a file which could have any path and could have any
  extension.
@@ -705,6 +1679,7 @@ YoriLibPathLocateUnknownExtensionUnknownLocation(
     LPTSTR ThisPath;
     YORI_STRING SearchPath;
     YORI_STRING ScratchArea;
+    BOOL Handled;
 
     ASSERT(YoriLibIsStringNullTerminated(PathVariable));
 
@@ -713,6 +1688,8 @@ YoriLibPathLocateUnknownExtensionUnknownLocation(
         return FALSE;
     }
 
+    Handled = FALSE;
+
     //
     //  MSFIX Should probably be quote aware
     //
@@ -742,10 +1719,27 @@ YoriLibPathLocateUnknownExtensionUnknownLocation(
 
     //
     //  If we don't have a match, check each of the path components
-    //  until we find one.
+    //  until we find one.  If the PATH index is available, use it;
+    //  otherwise, search each directory on disk.
     //
 
     if (FoundPath->StartOfString[0] == '\0') {
+        if (!YoriLibPathIndexLocate(SearchFor,
+                                    PathVariable,
+                                    PathExtComponents,
+                                    PathExtCount,
+                                    FALSE,
+                                    MatchAllCallback,
+                                    MatchAllContext,
+                                    FoundPath,
+                                    &Handled)) {
+            YoriLibFreeStringContents(&ScratchArea);
+            YoriLibPathFreePathExtComponents(PathExtComponents, PathExtCount);
+            return FALSE;
+        }
+    }
+
+    if (!Handled && FoundPath->StartOfString[0] == '\0') {
         ThisPath = _tcstok_s(PathVariable->StartOfString, _T(";"), &TokCtx);
         while (ThisPath != NULL) {
 
@@ -926,6 +1920,31 @@ YoriLibPathLocateKnownExtensionUnknownLocation(
 {
 
     YORI_STRING ScratchArea;
+    YORI_PATHEXT_COMPONENT ExactMatch;
+    BOOL Handled;
+
+    //
+    //  The name already has an extension, so the index is searched for an
+    //  exact match, which is an empty extension.
+    //
+
+    YoriLibConstantString(&ExactMatch.Extension, _T(""));
+    ExactMatch.Found = FALSE;
+    if (!YoriLibPathIndexLocate(SearchFor,
+                                PathVariable,
+                                &ExactMatch,
+                                1,
+                                TRUE,
+                                MatchAllCallback,
+                                MatchAllContext,
+                                FoundPath,
+                                &Handled)) {
+        return FALSE;
+    }
+
+    if (Handled) {
+        return TRUE;
+    }
 
     if (!YoriLibAllocateString(&ScratchArea, SearchFor->LengthAllocated + 256)) {
         return FALSE;
@@ -27,6 +27,101 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+/**
+ Load information about all processes currently executing in the system into
+ a caller supplied buffer.  If the buffer is not large enough it is
+ reallocated, so callers that sample repeatedly can keep using the same
+ allocation rather than growing a new one on every call.
+
+ @param ProcessInfo On input, points to a buffer previously returned from
+        this function, or NULL to allocate a new buffer.  On output, updated
+        to point to a list of processes executing within the system.  The
+        caller is expected to free this with YoriLibFree, including on
+        failure if the value is not NULL.
+
+ @param BytesAllocated On input, the size of the buffer in ProcessInfo, in
+        bytes.  On output, updated to contain the size of the buffer
+        currently pointed to by ProcessInfo.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibRefreshSystemProcessList(
+    __inout PYORI_SYSTEM_PROCESS_INFORMATION *ProcessInfo,
+    __inout PDWORD BytesAllocated
+    )
+{
+    PYORI_SYSTEM_PROCESS_INFORMATION LocalProcessInfo;
+    DWORD BytesReturned;
+    DWORD BytesToAllocate;
+    LONG Status;
+
+    if (DllNtDll.pNtQuerySystemInformation == NULL) {
+        return FALSE;
+    }
+
+    LocalProcessInfo = *ProcessInfo;
+    if (LocalProcessInfo == NULL) {
+        *BytesAllocated = 0;
+    }
+
+    while (TRUE) {
+
+        if (LocalProcessInfo != NULL) {
+            BytesReturned = 0;
+            Status = DllNtDll.pNtQuerySystemInformation(SystemProcessInformation, LocalProcessInfo, *BytesAllocated, &BytesReturned);
+            if (Status != (LONG)0xc0000004) {
+                break;
+            }
+        } else {
+            BytesReturned = 0;
+        }
+
+        //
+        //  If the system indicated how much space it needs, allocate that
+        //  plus some room for processes created before the next call.
+        //  Otherwise, double the buffer.
+        //
+
+        if (*BytesAllocated == 0) {
+            BytesToAllocate = 64 * 1024;
+        } else if (BytesReturned > *BytesAllocated) {
+            BytesToAllocate = BytesReturned + BytesReturned / 4;
+        } else {
+            BytesToAllocate = *BytesAllocated * 2;
+        }
+
+        if (BytesToAllocate > 64 * 1024 * 1024) {
+            return FALSE;
+        }
+
+        if (LocalProcessInfo != NULL) {
+            YoriLibFree(LocalProcessInfo);
+            *ProcessInfo = NULL;
+            *BytesAllocated = 0;
+        }
+
+        LocalProcessInfo = YoriLibMalloc(BytesToAllocate);
+        if (LocalProcessInfo == NULL) {
+            return FALSE;
+        }
+
+        *ProcessInfo = LocalProcessInfo;
+        *BytesAllocated = BytesToAllocate;
+    }
+
+    if (Status != 0) {
+        return FALSE;
+    }
+
+    if (BytesReturned == 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  Load information about all processes currently executing in the system.
 
@@ -43,6 +138,34 @@ YoriLibGetSystemProcessList(
     )
 {
     PYORI_SYSTEM_PROCESS_INFORMATION LocalProcessInfo = NULL;
+    DWORD BytesAllocated = 0;
+
+    if (!YoriLibRefreshSystemProcessList(&LocalProcessInfo, &BytesAllocated)) {
+        if (LocalProcessInfo != NULL) {
+            YoriLibFree(LocalProcessInfo);
+        }
+        return FALSE;
+    }
+
+    *ProcessInfo = LocalProcessInfo;
+    return TRUE;
+}
+/**
+ Load information about all handles currently open in the system.
+
+ @param HandleInfo On successful completion, updated to point to a list of
+        handles open within the system.  The caller is expected to free this
+        with YoriLibFree.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibGetSystemHandlesList(
+    __out PYORI_SYSTEM_HANDLE_INFORMATION_EX *HandleInfo
+    )
+{
+    PYORI_SYSTEM_HANDLE_INFORMATION_EX LocalHandleInfo = NULL;
     DWORD BytesReturned;
     DWORD BytesAllocated;
     LONG Status;
@@ -52,41 +175,46 @@ YoriLibGetSystemProcessList(
     }
 
     BytesAllocated = 0;
+    BytesReturned = 0;
 
     do {
 
-        if (LocalProcessInfo != NULL) {
-            YoriLibFree(LocalProcessInfo);
+        if (LocalHandleInfo != NULL) {
+            YoriLibFree(LocalHandleInfo);
         }
 
+        //
+        //  Handles are opened and closed constantly, so if the system
+        //  indicated how much space it needs, allocate some extra.
+        //
+
         if (BytesAllocated == 0) {
-            BytesAllocated = 64 * 1024;
-        } else if (BytesAllocated <= 1024 * 1024) {
-            BytesAllocated = BytesAllocated * 4;
+            BytesAllocated = 1024 * 1024;
+        } else if (BytesReturned > BytesAllocated) {
+            BytesAllocated = BytesReturned + BytesReturned / 4;
         } else {
+            BytesAllocated = BytesAllocated * 2;
+        }
+
+        if (BytesAllocated > 256 * 1024 * 1024) {
             return FALSE;
         }
 
-        LocalProcessInfo = YoriLibMalloc(BytesAllocated);
-        if (LocalProcessInfo == NULL) {
+        LocalHandleInfo = YoriLibMalloc(BytesAllocated);
+        if (LocalHandleInfo == NULL) {
             return FALSE;
         }
 
-        Status = DllNtDll.pNtQuerySystemInformation(SystemProcessInformation, LocalProcessInfo, BytesAllocated, &BytesReturned);
+        BytesReturned = 0;
+        Status = DllNtDll.pNtQuerySystemInformation(SystemExtendedHandleInformation, LocalHandleInfo, BytesAllocated, &BytesReturned);
     } while (Status == (LONG)0xc0000004);
 
-
     if (Status != 0) {
-        YoriLibFree(LocalProcessInfo);
+        YoriLibFree(LocalHandleInfo);
         return FALSE;
     }
 
-    if (BytesReturned == 0) {
-        YoriLibFree(LocalProcessInfo);
-        return FALSE;
-    }
-
-    *ProcessInfo = LocalProcessInfo;
+    *HandleInfo = LocalHandleInfo;
     return TRUE;
 }
 
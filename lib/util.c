@@ -365,4 +365,165 @@ YoriLibIsStdInConsole()
     return FALSE;
 }
 
+/**
+ Create a timer which becomes signalled at a fixed interval.  Because the
+ timer is periodic, the time spent processing each interval does not delay
+ the next one, so a caller sampling at this interval does not drift.
+
+ @param IntervalInMs The interval between signals, in milliseconds.
+
+ @return Handle to the timer, or NULL if the system does not support
+         waitable timers.  The caller should close this with CloseHandle.
+ */
+HANDLE
+YoriLibCreatePeriodicTimer(
+    __in DWORD IntervalInMs
+    )
+{
+    HANDLE hTimer;
+    LARGE_INTEGER DueTime;
+
+    if (DllKernel32.pCreateWaitableTimerW == NULL ||
+        DllKernel32.pSetWaitableTimer == NULL ||
+        IntervalInMs > 0x7FFFFFFF) {
+
+        return NULL;
+    }
+
+    hTimer = DllKernel32.pCreateWaitableTimerW(NULL, FALSE, NULL);
+    if (hTimer == NULL) {
+        return NULL;
+    }
+
+    //
+    //  A negative due time is relative to now, in 100ns units.
+    //
+
+    DueTime.QuadPart = -10 * 1000 * (LONGLONG)IntervalInMs;
+    if (!DllKernel32.pSetWaitableTimer(hTimer, &DueTime, (LONG)IntervalInMs, NULL, NULL, FALSE)) {
+        CloseHandle(hTimer);
+        return NULL;
+    }
+
+    return hTimer;
+}
+
+/**
+ Wait for the next interval to elapse, or for the current operation to be
+ cancelled.  If a periodic timer is supplied, this waits on the timer.
+ Otherwise the wait is calculated from a tick count deadline which is
+ advanced by one interval on each call, so the time spent processing each
+ interval is still not added to the next.
+
+ @param hTimer Optionally points to a timer returned from
+        @ref YoriLibCreatePeriodicTimer .
+
+ @param IntervalInMs The interval between samples, in milliseconds.
+
+ @param NextDeadline Points to the tick count when the next interval
+        elapses.  This is only used if hTimer is NULL, and the caller should
+        initialize it to the tick count when sampling began plus one
+        interval.  On return, updated to the deadline of the following
+        interval.
+
+ @return TRUE to indicate the interval elapsed, FALSE to indicate the
+         operation was cancelled.
+ */
+BOOL
+YoriLibWaitForPeriodicTimer(
+    __in_opt HANDLE hTimer,
+    __in DWORD IntervalInMs,
+    __inout PDWORD NextDeadline
+    )
+{
+    HANDLE WaitHandles[2];
+    DWORD HandleCount;
+    DWORD WaitResult;
+    DWORD Timeout;
+    DWORD Now;
+    LONG Remaining;
+
+    HandleCount = 0;
+    if (YoriLibCancelGetEvent() != NULL) {
+        WaitHandles[HandleCount++] = YoriLibCancelGetEvent();
+    }
+
+    if (hTimer != NULL) {
+        WaitHandles[HandleCount++] = hTimer;
+        Timeout = INFINITE;
+    } else {
+
+        //
+        //  If processing fell more than an interval behind, start again
+        //  from now rather than trying to catch up.
+        //
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        Now = GetTickCount();
+        Remaining = (LONG)(*NextDeadline - Now);
+        if (Remaining < 0) {
+            if ((DWORD)(-Remaining) > IntervalInMs) {
+                *NextDeadline = Now;
+            }
+            Remaining = 0;
+        }
+        Timeout = (DWORD)Remaining;
+        *NextDeadline = *NextDeadline + IntervalInMs;
+    }
+
+    if (HandleCount == 0) {
+        Sleep(Timeout);
+        return TRUE;
+    }
+
+    WaitResult = WaitForMultipleObjects(HandleCount, WaitHandles, FALSE, Timeout);
+    if (WaitResult == WAIT_TIMEOUT) {
+        return TRUE;
+    }
+
+    if (WaitResult == WAIT_OBJECT_0 + HandleCount - 1 && hTimer != NULL) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Output a time of day in year/month/day hour:minute:second.millisecond form.
+ This is intended for use when expanding variables describing when a sample
+ was collected.
+
+ @param SampleTime Pointer to the time to output.
+
+ @param OutputString Pointer to a string to populate with the contents of
+        the variable.
+
+ @return The number of characters populated into the variable, or the number
+         of characters required to successfully populate the contents into
+         the variable.
+ */
+DWORD
+YoriLibOutputSystemTime(
+    __in PSYSTEMTIME SampleTime,
+    __inout PYORI_STRING OutputString
+    )
+{
+    YORI_STRING String;
+    TCHAR StringBuffer[32];
+
+    YoriLibInitEmptyString(&String);
+    String.StartOfString = StringBuffer;
+    String.LengthAllocated = sizeof(StringBuffer)/sizeof(StringBuffer[0]);
+    String.LengthInChars = YoriLibSPrintf(String.StartOfString, _T("%04i/%02i/%02i %02i:%02i:%02i.%03i"), SampleTime->wYear, SampleTime->wMonth, SampleTime->wDay, SampleTime->wHour, SampleTime->wMinute, SampleTime->wSecond, SampleTime->wMilliseconds);
+
+    if (OutputString->LengthAllocated >= String.LengthInChars) {
+        memcpy(OutputString->StartOfString, String.StartOfString, String.LengthInChars * sizeof(TCHAR));
+    }
+
+    return String.LengthInChars;
+}
+
 // vim:sw=4:ts=4:et:
@@ -76,6 +76,11 @@ YoriCallExecuteExpression(
     __in PYORI_STRING Expression
     );
 
+BOOL
+YoriCallExecuteParsedExpression(
+    __in PVOID ParsedExpression
+    );
+
 VOID
 YoriCallExitProcess(
     __in DWORD ExitCode
@@ -87,6 +92,11 @@ YoriCallExpandAlias(
     __in PYORI_STRING ExpandedString
     );
 
+VOID
+YoriCallFreeParsedExpression(
+    __in PVOID ParsedExpression
+    );
+
 VOID
 YoriCallFreeYoriString(
     __in PYORI_STRING String
@@ -128,6 +138,15 @@ YoriCallGetJobInformation(
     __inout PYORI_STRING Command
     );
 
+BOOL
+YoriCallGetModuleInformation(
+    __in DWORD Index,
+    __inout PYORI_STRING ModuleName,
+    __out PDWORD ReferenceCount,
+    __out PDWORD UseCount,
+    __out PDWORD LoadTimeInMicroseconds
+    );
+
 BOOL
 YoriCallGetJobOutput(
     __in DWORD JobId,
@@ -155,6 +174,12 @@ BOOL
 YoriCallIncrementPromptRecursionDepth(
     );
 
+BOOL
+YoriCallParseExpression(
+    __in PYORI_STRING Expression,
+    __out PVOID * ParsedExpression
+    );
+
 BOOL
 YoriCallPipeJobOutput(
     __in DWORD JobId,
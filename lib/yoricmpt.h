@@ -777,9 +777,40 @@ typedef struct _YORI_SYSTEM_PROCESS_INFORMATION {
     PVOID Reserved6[2];
 
     /**
-     Ignored in this application.
+     The number of read operations performed by the process.  This is only
+     returned on NT 5.0 and above.
      */
-    LARGE_INTEGER Reserved7[6];
+    LARGE_INTEGER ReadOperationCount;
+
+    /**
+     The number of write operations performed by the process.  This is only
+     returned on NT 5.0 and above.
+     */
+    LARGE_INTEGER WriteOperationCount;
+
+    /**
+     The number of operations other than read and write performed by the
+     process.  This is only returned on NT 5.0 and above.
+     */
+    LARGE_INTEGER OtherOperationCount;
+
+    /**
+     The number of bytes read by the process.  This is only returned on
+     NT 5.0 and above.
+     */
+    LARGE_INTEGER ReadTransferCount;
+
+    /**
+     The number of bytes written by the process.  This is only returned on
+     NT 5.0 and above.
+     */
+    LARGE_INTEGER WriteTransferCount;
+
+    /**
+     The number of bytes transferred by operations other than read and
+     write.  This is only returned on NT 5.0 and above.
+     */
+    LARGE_INTEGER OtherTransferCount;
 
 } YORI_SYSTEM_PROCESS_INFORMATION, *PYORI_SYSTEM_PROCESS_INFORMATION;
 
@@ -820,6 +851,108 @@ typedef struct _YORI_SYSTEM_THREAD_INFORMATION {
     ULONG Reserved4[5];
 } YORI_SYSTEM_THREAD_INFORMATION, *PYORI_SYSTEM_THREAD_INFORMATION;
 
+/**
+ Definition of the system handle information enumeration class for
+ NtQuerySystemInformation .
+ */
+#define SystemExtendedHandleInformation (64)
+
+/**
+ Information returned about every handle in the system.
+ */
+typedef struct _YORI_SYSTEM_HANDLE_ENTRY_EX {
+
+    /**
+     The address of the object in kernel memory.
+     */
+    PVOID Object;
+
+    /**
+     The process identifier of the process containing the handle.
+     */
+    DWORD_PTR UniqueProcessId;
+
+    /**
+     The value of the handle within the process.
+     */
+    DWORD_PTR HandleValue;
+
+    /**
+     The access granted to the handle.
+     */
+    ULONG GrantedAccess;
+
+    /**
+     Ignored in this application.
+     */
+    USHORT CreatorBackTraceIndex;
+
+    /**
+     The type of the object.  The meaning of this value differs between
+     systems, so callers must determine the value for a given type at
+     runtime.
+     */
+    USHORT ObjectTypeIndex;
+
+    /**
+     Attributes of the handle, such as whether it is inheritable.
+     */
+    ULONG HandleAttributes;
+
+    /**
+     Reserved.
+     */
+    ULONG Reserved;
+} YORI_SYSTEM_HANDLE_ENTRY_EX, *PYORI_SYSTEM_HANDLE_ENTRY_EX;
+
+/**
+ Information returned about all handles in the system.
+ */
+typedef struct _YORI_SYSTEM_HANDLE_INFORMATION_EX {
+
+    /**
+     The number of handles in the Handles array.
+     */
+    DWORD_PTR NumberOfHandles;
+
+    /**
+     Reserved.
+     */
+    DWORD_PTR Reserved;
+
+    /**
+     An array of information about each handle.
+     */
+    YORI_SYSTEM_HANDLE_ENTRY_EX Handles[1];
+} YORI_SYSTEM_HANDLE_INFORMATION_EX, *PYORI_SYSTEM_HANDLE_INFORMATION_EX;
+
+/**
+ Definition of the object name information class for NtQueryObject .
+ */
+#define ObjectNameInformation (1)
+
+/**
+ Information returned about the name of an object.  The name is typically
+ returned immediately after this structure.
+ */
+typedef struct _YORI_OBJECT_NAME_INFORMATION {
+
+    /**
+     The length of the name, in bytes.
+     */
+    USHORT LengthInBytes;
+
+    /**
+     The size of the buffer containing the name, in bytes.
+     */
+    USHORT MaximumLengthInBytes;
+
+    /**
+     Pointer to the name.
+     */
+    LPWSTR Buffer;
+} YORI_OBJECT_NAME_INFORMATION, *PYORI_OBJECT_NAME_INFORMATION;
+
 /**
  A structure describing how to take a live dump.
  */
@@ -1610,6 +1743,14 @@ typedef struct _YORI_SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX {
 #define IO_REPARSE_TAG_APPEXECLINK (0x8000001B)
 #endif
 
+#ifndef IO_REPARSE_TAG_WOF
+/**
+ The reparse tag indicating a file whose contents are provided by the
+ Windows Overlay Filter, either from a WIM or in compressed form.
+ */
+#define IO_REPARSE_TAG_WOF         (0x80000017)
+#endif
+
 /**
  A structure recording reparse data on a file.
  */
@@ -2471,6 +2612,102 @@ typedef struct _FILE_DISPOSITION_INFO {
  */
 #define FileDispositionInfo (0x000000004)
 
+/**
+ A structure describing a single entry returned from a directory
+ enumeration, including its file ID.
+ */
+typedef struct _FILE_ID_BOTH_DIR_INFO {
+
+    /**
+     The offset in bytes from this entry to the next entry, or zero if this
+     is the final entry in the buffer.
+     */
+    DWORD NextEntryOffset;
+
+    /**
+     The byte offset of the file within the parent directory.
+     */
+    DWORD FileIndex;
+
+    /**
+     The time the file was created.
+     */
+    LARGE_INTEGER CreationTime;
+
+    /**
+     The time the file was last accessed.
+     */
+    LARGE_INTEGER LastAccessTime;
+
+    /**
+     The time the file was last written.
+     */
+    LARGE_INTEGER LastWriteTime;
+
+    /**
+     The time the file metadata was last changed.
+     */
+    LARGE_INTEGER ChangeTime;
+
+    /**
+     The file size, in bytes.
+     */
+    LARGE_INTEGER EndOfFile;
+
+    /**
+     The file system's allocation size for the file, in bytes.
+     */
+    LARGE_INTEGER AllocationSize;
+
+    /**
+     The file attributes.
+     */
+    DWORD FileAttributes;
+
+    /**
+     The length of the file name, in bytes.
+     */
+    DWORD FileNameLength;
+
+    /**
+     The size of extended attributes on the file, or the reparse tag if the
+     file is a reparse point.
+     */
+    DWORD EaSize;
+
+    /**
+     The length of the short file name, in bytes.
+     */
+    CCHAR ShortNameLength;
+
+    /**
+     The short file name.
+     */
+    WCHAR ShortName[12];
+
+    /**
+     The file ID, unique within the volume.
+     */
+    LARGE_INTEGER FileId;
+
+    /**
+     The file name.  This is not NULL terminated.
+     */
+    WCHAR FileName[1];
+} FILE_ID_BOTH_DIR_INFO, *PFILE_ID_BOTH_DIR_INFO;
+
+/**
+ The identifier of the request type that returns the above structure,
+ continuing an existing enumeration.
+ */
+#define FileIdBothDirectoryInfo        (0x00000000A)
+
+/**
+ The identifier of the request type that returns the above structure,
+ restarting the enumeration from the beginning of the directory.
+ */
+#define FileIdBothDirectoryRestartInfo (0x00000000B)
+
 #endif
 
 #ifndef STORAGE_INFO_FLAGS_ALIGNED_DEVICE
@@ -2930,9 +3167,9 @@ typedef struct _YORI_JOB_BASIC_ACCOUNTING_INFORMATION {
     LARGE_INTEGER Unused2;
 
     /**
-     Field not needed/supported by YoriLib.
+     The total number of page faults taken by processes in the job.
      */
-    DWORD Unused3;
+    DWORD TotalPageFaultCount;
 
     /**
      The total number of processes that have been initiated.
@@ -3003,6 +3240,59 @@ typedef struct _YORI_JOB_BASIC_LIMIT_INFORMATION {
     DWORD Unused7;
 } YORI_JOB_BASIC_LIMIT_INFORMATION, *PYORI_JOB_BASIC_LIMIT_INFORMATION;
 
+/**
+ Structure to query basic accounting and IO information about a job.
+ */
+typedef struct _YORI_JOB_BASIC_AND_IO_ACCOUNTING_INFORMATION {
+
+    /**
+     Basic accounting information about the job.
+     */
+    YORI_JOB_BASIC_ACCOUNTING_INFORMATION BasicInfo;
+
+    /**
+     The IO performed by all processes in the job.
+     */
+    YORI_IO_COUNTERS IoInfo;
+} YORI_JOB_BASIC_AND_IO_ACCOUNTING_INFORMATION, *PYORI_JOB_BASIC_AND_IO_ACCOUNTING_INFORMATION;
+
+/**
+ Structure to query or change extended limit information about a job.
+ */
+typedef struct _YORI_JOB_EXTENDED_LIMIT_INFORMATION {
+
+    /**
+     Basic limit information about the job.
+     */
+    YORI_JOB_BASIC_LIMIT_INFORMATION BasicLimitInformation;
+
+    /**
+     Field not needed/supported by YoriLib.
+     */
+    YORI_IO_COUNTERS Unused1;
+
+    /**
+     Field not needed/supported by YoriLib.
+     */
+    SIZE_T Unused2;
+
+    /**
+     Field not needed/supported by YoriLib.
+     */
+    SIZE_T Unused3;
+
+    /**
+     The maximum amount of memory committed by any single process in the
+     job.
+     */
+    SIZE_T PeakProcessMemoryUsed;
+
+    /**
+     The maximum amount of memory committed by all processes in the job.
+     */
+    SIZE_T PeakJobMemoryUsed;
+} YORI_JOB_EXTENDED_LIMIT_INFORMATION, *PYORI_JOB_EXTENDED_LIMIT_INFORMATION;
+
 /**
  Information specifying how to associate a job object handle with a completion
  port.
@@ -3021,6 +3311,21 @@ typedef struct _YORI_JOB_ASSOCIATE_COMPLETION_PORT {
     HANDLE Port;
 } YORI_JOB_ASSOCIATE_COMPLETION_PORT, *PYORI_JOB_ASSOCIATE_COMPLETION_PORT;
 
+#ifndef JOB_OBJECT_MSG_EXIT_PROCESS
+/**
+ The completion port message indicating that a process in a job has exited.
+ */
+#define JOB_OBJECT_MSG_EXIT_PROCESS 7
+#endif
+
+#ifndef JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS
+/**
+ The completion port message indicating that a process in a job has exited
+ due to an unhandled exception.
+ */
+#define JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS 8
+#endif
+
 #ifndef LOCALE_RETURN_NUMBER
 /**
  A definition for LOCALE_RETURN_NUMBER if it is not defined by the current
@@ -4832,6 +5137,18 @@ NT_QUERY_INFORMATION_THREAD(HANDLE, DWORD, PVOID, DWORD, PDWORD);
  */
 typedef NT_QUERY_INFORMATION_THREAD *PNT_QUERY_INFORMATION_THREAD;
 
+/**
+ A prototype for the NtQueryObject function.
+ */
+typedef
+LONG WINAPI
+NT_QUERY_OBJECT(HANDLE, DWORD, PVOID, DWORD, PDWORD);
+
+/**
+ A prototype for a pointer to the NtQueryObject function.
+ */
+typedef NT_QUERY_OBJECT *PNT_QUERY_OBJECT;
+
 /**
  A prototype for the NtQuerySystemInformation function.
  */
@@ -4897,6 +5214,11 @@ typedef struct _YORI_NTDLL_FUNCTIONS {
      */
     PNT_QUERY_INFORMATION_THREAD pNtQueryInformationThread;
 
+    /**
+     If it's available on the current system, a pointer to NtQueryObject.
+     */
+    PNT_QUERY_OBJECT pNtQueryObject;
+
     /**
      If it's available on the current system, a pointer to
      NtQuerySystemInformation.
@@ -4956,6 +5278,18 @@ CREATE_HARD_LINKW(LPWSTR, LPWSTR, PVOID);
  */
 typedef CREATE_HARD_LINKW *PCREATE_HARD_LINKW;
 
+/**
+ A prototype for the CreateIoCompletionPort function.
+ */
+typedef
+HANDLE WINAPI
+CREATE_IO_COMPLETION_PORT(HANDLE, HANDLE, DWORD_PTR, DWORD);
+
+/**
+ A prototype for a pointer to the CreateIoCompletionPort function.
+ */
+typedef CREATE_IO_COMPLETION_PORT *PCREATE_IO_COMPLETION_PORT;
+
 /**
  A prototype for the CreateJobObjectW function.
  */
@@ -4980,6 +5314,18 @@ CREATE_SYMBOLIC_LINKW(LPTSTR, LPTSTR, DWORD);
  */
 typedef CREATE_SYMBOLIC_LINKW *PCREATE_SYMBOLIC_LINKW;
 
+/**
+ A prototype for the CreateWaitableTimerW function.
+ */
+typedef
+HANDLE WINAPI
+CREATE_WAITABLE_TIMERW(LPSECURITY_ATTRIBUTES, BOOL, LPCWSTR);
+
+/**
+ A prototype for a pointer to the CreateWaitableTimerW function.
+ */
+typedef CREATE_WAITABLE_TIMERW *PCREATE_WAITABLE_TIMERW;
+
 /**
  A prototype for the FindFirstStreamW function.
  */
@@ -5256,6 +5602,30 @@ GET_PRODUCT_INFO(DWORD, DWORD, DWORD, DWORD, PDWORD);
  */
 typedef GET_PRODUCT_INFO *PGET_PRODUCT_INFO;
 
+/**
+ A prototype for the GetQueuedCompletionStatus function.
+ */
+typedef
+BOOL WINAPI
+GET_QUEUED_COMPLETION_STATUS(HANDLE, LPDWORD, PDWORD_PTR, LPOVERLAPPED *, DWORD);
+
+/**
+ A prototype for a pointer to the GetQueuedCompletionStatus function.
+ */
+typedef GET_QUEUED_COMPLETION_STATUS *PGET_QUEUED_COMPLETION_STATUS;
+
+/**
+ A prototype for the GetSystemTimes function.
+ */
+typedef
+BOOL WINAPI
+GET_SYSTEM_TIMES(LPFILETIME, LPFILETIME, LPFILETIME);
+
+/**
+ A prototype for a pointer to the GetSystemTimes function.
+ */
+typedef GET_SYSTEM_TIMES *PGET_SYSTEM_TIMES;
+
 /**
  A prototype for the GetTickCount64 function.
  */
@@ -5340,6 +5710,18 @@ OPEN_THREAD(DWORD, BOOL, DWORD);
  */
 typedef OPEN_THREAD *POPEN_THREAD;
 
+/**
+ A prototype for the PostQueuedCompletionStatus function.
+ */
+typedef
+BOOL WINAPI
+POST_QUEUED_COMPLETION_STATUS(HANDLE, DWORD, DWORD_PTR, LPOVERLAPPED);
+
+/**
+ A prototype for a pointer to the PostQueuedCompletionStatus function.
+ */
+typedef POST_QUEUED_COMPLETION_STATUS *PPOST_QUEUED_COMPLETION_STATUS;
+
 /**
  A prototype for the QueryFullProcessImageNameW function.
  */
@@ -5364,6 +5746,18 @@ QUERY_INFORMATION_JOB_OBJECT(HANDLE, DWORD, PVOID, DWORD, LPDWORD);
  */
 typedef QUERY_INFORMATION_JOB_OBJECT *PQUERY_INFORMATION_JOB_OBJECT;
 
+/**
+ A prototype for the ReadDirectoryChangesW function.
+ */
+typedef
+BOOL WINAPI
+READ_DIRECTORY_CHANGESW(HANDLE, LPVOID, DWORD, BOOL, DWORD, LPDWORD, LPOVERLAPPED, LPOVERLAPPED_COMPLETION_ROUTINE);
+
+/**
+ A prototype for a pointer to the ReadDirectoryChangesW function.
+ */
+typedef READ_DIRECTORY_CHANGESW *PREAD_DIRECTORY_CHANGESW;
+
 /**
  A prototype for the RegisterApplicationRestart function.
  */
@@ -5436,6 +5830,18 @@ SET_INFORMATION_JOB_OBJECT(HANDLE, DWORD, PVOID, DWORD);
  */
 typedef SET_INFORMATION_JOB_OBJECT *PSET_INFORMATION_JOB_OBJECT;
 
+/**
+ A prototype for the SetWaitableTimer function.
+ */
+typedef
+BOOL WINAPI
+SET_WAITABLE_TIMER(HANDLE, LARGE_INTEGER *, LONG, PVOID, PVOID, BOOL);
+
+/**
+ A prototype for a pointer to the SetWaitableTimer function.
+ */
+typedef SET_WAITABLE_TIMER *PSET_WAITABLE_TIMER;
+
 /**
  A prototype for the Wow64DisableWow64FsRedirection function.
  */
@@ -5498,6 +5904,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PCREATE_HARD_LINKW pCreateHardLinkW;
 
+    /**
+     If it's available on the current system, a pointer to CreateIoCompletionPort.
+     */
+    PCREATE_IO_COMPLETION_PORT pCreateIoCompletionPort;
+
     /**
      If it's available on the current system, a pointer to CreateJobObjectW.
      */
@@ -5508,6 +5919,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PCREATE_SYMBOLIC_LINKW pCreateSymbolicLinkW;
 
+    /**
+     If it's available on the current system, a pointer to CreateWaitableTimerW.
+     */
+    PCREATE_WAITABLE_TIMERW pCreateWaitableTimerW;
+
     /**
      If it's available on the current system, a pointer to FindFirstStreamW.
      */
@@ -5623,6 +6039,16 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PGET_PRODUCT_INFO pGetProductInfo;
 
+    /**
+     If it's available on the current system, a pointer to GetQueuedCompletionStatus.
+     */
+    PGET_QUEUED_COMPLETION_STATUS pGetQueuedCompletionStatus;
+
+    /**
+     If it's available on the current system, a pointer to GetSystemTimes.
+     */
+    PGET_SYSTEM_TIMES pGetSystemTimes;
+
     /**
      If it's available on the current system, a pointer to GetTickCount64.
      */
@@ -5658,6 +6084,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     POPEN_THREAD pOpenThread;
 
+    /**
+     If it's available on the current system, a pointer to PostQueuedCompletionStatus.
+     */
+    PPOST_QUEUED_COMPLETION_STATUS pPostQueuedCompletionStatus;
+
     /**
      If it's available on the current system, a pointer to QueryFullProcessImageNameW.
      */
@@ -5668,6 +6099,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PQUERY_INFORMATION_JOB_OBJECT pQueryInformationJobObject;
 
+    /**
+     If it's available on the current system, a pointer to ReadDirectoryChangesW.
+     */
+    PREAD_DIRECTORY_CHANGESW pReadDirectoryChangesW;
+
     /**
      If it's available on the current system, a pointer to RegisterApplicationRestart.
      */
@@ -5698,6 +6134,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PSET_INFORMATION_JOB_OBJECT pSetInformationJobObject;
 
+    /**
+     If it's available on the current system, a pointer to SetWaitableTimer.
+     */
+    PSET_WAITABLE_TIMER pSetWaitableTimer;
+
     /**
      If it's available on the current system, a pointer to Wow64DisableWow64FsRedirection.
      */
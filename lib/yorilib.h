@@ -2238,6 +2238,13 @@ YoriLibLimitJobObjectPriority(
     __in DWORD Priority
     );
 
+BOOL
+YoriLibAssociateJobObjectWithCompletionPort(
+    __in HANDLE hJob,
+    __in HANDLE hPort,
+    __in_opt PVOID Key
+    );
+
 // *** LICENSE.C ***
 
 BOOL
@@ -2476,6 +2483,19 @@ YoriLibGetSystemProcessList(
     __out PYORI_SYSTEM_PROCESS_INFORMATION *ProcessInfo
     );
 
+__success(return)
+BOOL
+YoriLibRefreshSystemProcessList(
+    __inout PYORI_SYSTEM_PROCESS_INFORMATION *ProcessInfo,
+    __inout PDWORD BytesAllocated
+    );
+
+__success(return)
+BOOL
+YoriLibGetSystemHandlesList(
+    __out PYORI_SYSTEM_HANDLE_INFORMATION_EX *HandleInfo
+    );
+
 // *** RECYCLE.C ***
 
 BOOL
@@ -2764,6 +2784,13 @@ YoriLibPathLocateUnknownExtensionKnownLocation(
     __inout PYORI_STRING FoundPath
     );
 
+__success(return)
+BOOL
+YoriLibPathIndexEnable(VOID);
+
+VOID
+YoriLibPathIndexDisable(VOID);
+
 __success(return)
 BOOL
 YoriLibPathLocateUnknownExtensionUnknownLocation(
@@ -3569,4 +3596,22 @@ YoriLibIsPathUrl(
 
 BOOL YoriLibIsStdInConsole();
 
+HANDLE
+YoriLibCreatePeriodicTimer(
+    __in DWORD IntervalInMs
+    );
+
+BOOL
+YoriLibWaitForPeriodicTimer(
+    __in_opt HANDLE hTimer,
+    __in DWORD IntervalInMs,
+    __inout PDWORD NextDeadline
+    );
+
+DWORD
+YoriLibOutputSystemTime(
+    __in PSYSTEMTIME SampleTime,
+    __inout PYORI_STRING OutputString
+    );
+
 // vim:sw=4:ts=4:et:
@@ -35,9 +35,13 @@ CHAR strLsofHelpText[] =
         "\n"
         "Determine which processes are keeping files open.\n"
         "\n"
-        "LSOF [-license] [-b] [-s] <file>...\n"
+        "LSOF [-license] [-b] [-h] [-s] <file>...\n"
+        "LSOF [-license] -h\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -h             Search a snapshot of all handles in the system, displaying\n"
+        "                    the handle within each process.  If no file is\n"
+        "                    specified, display all open files\n"
         "   -s             Process files from all subdirectories\n";
 
 /**
@@ -54,6 +58,909 @@ LsofHelp()
     return TRUE;
 }
 
+/**
+ The number of threads used to resolve the names of file handles.
+ */
+#define LSOF_NAME_WORKER_COUNT (4)
+
+/**
+ The number of milliseconds to wait for the name of a single handle to be
+ resolved before abandoning it.  Querying the name of some handles, such as
+ synchronous pipes with a pending read, blocks until that read completes.
+ */
+#define LSOF_NAME_TIMEOUT (200)
+
+/**
+ The size of the buffer used to receive the name of a single handle, in
+ bytes.
+ */
+#define LSOF_NAME_BUFFER_SIZE (sizeof(YORI_OBJECT_NAME_INFORMATION) + 0x10000)
+
+/**
+ A handle to a file within a process.
+ */
+typedef struct _LSOF_OPEN_HANDLE {
+
+    /**
+     The entry for this handle within the list of handles to a path.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The process containing the handle.
+     */
+    DWORD ProcessId;
+
+    /**
+     The value of the handle within the process.
+     */
+    DWORD_PTR HandleValue;
+} LSOF_OPEN_HANDLE, *PLSOF_OPEN_HANDLE;
+
+/**
+ A path that is open by one or more handles in the system.
+ */
+typedef struct _LSOF_INDEXED_PATH {
+
+    /**
+     The entry for this path within the hash table of paths, keyed by the
+     escaped full path.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The entry for this path within the list of all paths.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     A list of handles that refer to this path.
+     */
+    YORI_LIST_ENTRY Handles;
+
+    /**
+     The escaped full path.  The buffer for this string follows the
+     structure.
+     */
+    YORI_STRING Path;
+} LSOF_INDEXED_PATH, *PLSOF_INDEXED_PATH;
+
+/**
+ A thread which queries the name of one handle at a time.  The thread only
+ issues a system call into its own buffer, so if the query does not
+ complete in time it can be terminated without leaving any process state
+ inconsistent.
+ */
+typedef struct _LSOF_NAME_WORKER {
+
+    /**
+     The thread performing queries.
+     */
+    HANDLE hThread;
+
+    /**
+     An event signalled by the main thread when FileHandle is ready to be
+     queried, or when the thread should exit.
+     */
+    HANDLE hRequestEvent;
+
+    /**
+     An event signalled by the worker when a query has completed.
+     */
+    HANDLE hCompleteEvent;
+
+    /**
+     A duplicate of the handle being queried, opened in this process.
+     */
+    HANDLE FileHandle;
+
+    /**
+     The process containing the handle being queried.
+     */
+    DWORD ProcessId;
+
+    /**
+     The value of the handle being queried within its process.
+     */
+    DWORD_PTR HandleValue;
+
+    /**
+     The tick count when the current query was started.
+     */
+    DWORD StartTick;
+
+    /**
+     The result of the most recent query.
+     */
+    LONG Status;
+
+    /**
+     TRUE if a query has been issued and its result not yet collected.
+     */
+    BOOL Busy;
+
+    /**
+     TRUE if the thread should exit when hRequestEvent is signalled.
+     */
+    BOOL Exit;
+
+    /**
+     The buffer to receive the name of the handle.
+     */
+    PYORI_OBJECT_NAME_INFORMATION NameInfo;
+} LSOF_NAME_WORKER, *PLSOF_NAME_WORKER;
+
+/**
+ A drive letter and the NT device that it refers to.
+ */
+typedef struct _LSOF_DEVICE_MAP {
+
+    /**
+     The drive letter.
+     */
+    TCHAR DriveLetter;
+
+    /**
+     The NT device name that the drive letter refers to.
+     */
+    YORI_STRING DeviceName;
+} LSOF_DEVICE_MAP, *PLSOF_DEVICE_MAP;
+
+/**
+ An index of every file handle in the system, built from a single snapshot
+ of system handles.
+ */
+typedef struct _LSOF_HANDLE_INDEX {
+
+    /**
+     A hash table of paths, keyed by escaped full path.
+     */
+    PYORI_HASH_TABLE PathHash;
+
+    /**
+     A list of all paths in the index.
+     */
+    YORI_LIST_ENTRY PathList;
+
+    /**
+     The threads used to resolve handle names.  An entry is NULL if the
+     thread could not be created.
+     */
+    PLSOF_NAME_WORKER Workers[LSOF_NAME_WORKER_COUNT];
+
+    /**
+     The number of handles whose name could not be resolved in time.
+     */
+    DWORD TimedOutCount;
+
+    /**
+     The number of valid entries in the Devices array.
+     */
+    DWORD DeviceCount;
+
+    /**
+     The NT device name for each drive letter.
+     */
+    LSOF_DEVICE_MAP Devices[26];
+} LSOF_HANDLE_INDEX, *PLSOF_HANDLE_INDEX;
+
+/**
+ The entrypoint for a thread which resolves handle names.
+
+ @param Context Pointer to the worker structure.
+
+ @return Zero.
+ */
+DWORD WINAPI
+LsofNameWorkerThread(
+    __in LPVOID Context
+    )
+{
+    PLSOF_NAME_WORKER Worker = (PLSOF_NAME_WORKER)Context;
+    DWORD BytesReturned;
+
+    while (TRUE) {
+        WaitForSingleObject(Worker->hRequestEvent, INFINITE);
+        if (Worker->Exit) {
+            break;
+        }
+
+        Worker->Status = DllNtDll.pNtQueryObject(Worker->FileHandle, ObjectNameInformation, Worker->NameInfo, LSOF_NAME_BUFFER_SIZE, &BytesReturned);
+        SetEvent(Worker->hCompleteEvent);
+    }
+
+    return 0;
+}
+
+/**
+ Free a worker structure and any handles it refers to.  The thread must
+ have exited.
+
+ @param Worker Pointer to the worker to free.
+ */
+VOID
+LsofFreeNameWorker(
+    __in PLSOF_NAME_WORKER Worker
+    )
+{
+    if (Worker->hThread != NULL) {
+        CloseHandle(Worker->hThread);
+    }
+    if (Worker->hRequestEvent != NULL) {
+        CloseHandle(Worker->hRequestEvent);
+    }
+    if (Worker->hCompleteEvent != NULL) {
+        CloseHandle(Worker->hCompleteEvent);
+    }
+    if (Worker->FileHandle != NULL) {
+        CloseHandle(Worker->FileHandle);
+    }
+    YoriLibFree(Worker);
+}
+
+/**
+ Create a thread to resolve handle names.
+
+ @return Pointer to the worker, or NULL on failure.
+ */
+PLSOF_NAME_WORKER
+LsofStartNameWorker(VOID)
+{
+    PLSOF_NAME_WORKER Worker;
+    DWORD ThreadId;
+
+    Worker = YoriLibMalloc(sizeof(LSOF_NAME_WORKER) + LSOF_NAME_BUFFER_SIZE);
+    if (Worker == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Worker, sizeof(LSOF_NAME_WORKER));
+    Worker->NameInfo = (PYORI_OBJECT_NAME_INFORMATION)(Worker + 1);
+
+    Worker->hRequestEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Worker->hCompleteEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Worker->hRequestEvent == NULL || Worker->hCompleteEvent == NULL) {
+        LsofFreeNameWorker(Worker);
+        return NULL;
+    }
+
+    Worker->hThread = CreateThread(NULL, 0, LsofNameWorkerThread, Worker, 0, &ThreadId);
+    if (Worker->hThread == NULL) {
+        LsofFreeNameWorker(Worker);
+        return NULL;
+    }
+
+    return Worker;
+}
+
+/**
+ Tell a worker thread to exit, wait for it to do so, and free it.
+
+ @param Worker Pointer to the worker.  The worker must not be busy.
+ */
+VOID
+LsofStopNameWorker(
+    __in PLSOF_NAME_WORKER Worker
+    )
+{
+    ASSERT(!Worker->Busy);
+    Worker->Exit = TRUE;
+    SetEvent(Worker->hRequestEvent);
+    WaitForSingleObject(Worker->hThread, INFINITE);
+    LsofFreeNameWorker(Worker);
+}
+
+/**
+ Terminate a worker thread whose query did not complete in time.  If the
+ thread terminates, the worker is freed.  If it does not, the worker is
+ leaked, since the thread may still write to it.
+
+ @param Worker Pointer to the worker.
+ */
+VOID
+LsofAbandonNameWorker(
+    __in PLSOF_NAME_WORKER Worker
+    )
+{
+    TerminateThread(Worker->hThread, 0);
+    if (WaitForSingleObject(Worker->hThread, LSOF_NAME_TIMEOUT) == WAIT_OBJECT_0) {
+        LsofFreeNameWorker(Worker);
+    }
+}
+
+/**
+ Load the NT device name that each drive letter refers to, so that object
+ names can be converted into Win32 paths.
+
+ @param Index Pointer to the index to populate.
+ */
+VOID
+LsofLoadDeviceMap(
+    __inout PLSOF_HANDLE_INDEX Index
+    )
+{
+    TCHAR DriveName[3];
+    TCHAR DeviceName[MAX_PATH];
+    DWORD Length;
+    PLSOF_DEVICE_MAP Device;
+    TCHAR Letter;
+
+    DriveName[1] = ':';
+    DriveName[2] = '\0';
+
+    for (Letter = 'A'; Letter <= 'Z'; Letter++) {
+        DriveName[0] = Letter;
+        Length = QueryDosDevice(DriveName, DeviceName, sizeof(DeviceName)/sizeof(DeviceName[0]));
+        if (Length == 0) {
+            continue;
+        }
+
+        Device = &Index->Devices[Index->DeviceCount];
+        YoriLibInitEmptyString(&Device->DeviceName);
+        Length = (DWORD)_tcslen(DeviceName);
+        if (!YoriLibAllocateString(&Device->DeviceName, Length + 1)) {
+            continue;
+        }
+
+        memcpy(Device->DeviceName.StartOfString, DeviceName, Length * sizeof(TCHAR));
+        Device->DeviceName.StartOfString[Length] = '\0';
+        Device->DeviceName.LengthInChars = Length;
+        Device->DriveLetter = Letter;
+        Index->DeviceCount++;
+    }
+}
+
+/**
+ Convert an NT object name into an escaped Win32 full path.
+
+ @param Index Pointer to the index containing the device map.
+
+ @param ObjectName Pointer to the NT object name.
+
+ @param Path On successful completion, populated with a newly allocated
+        escaped full path.
+
+ @return TRUE to indicate success, FALSE if the object name does not refer
+         to a path accessible through a drive letter or UNC share.
+ */
+__success(return)
+BOOL
+LsofConvertObjectName(
+    __in PLSOF_HANDLE_INDEX Index,
+    __in PYORI_STRING ObjectName,
+    __out PYORI_STRING Path
+    )
+{
+    DWORD DeviceIndex;
+    DWORD PrefixLength;
+    PLSOF_DEVICE_MAP Device;
+    YORI_STRING Remainder;
+
+    YoriLibInitEmptyString(&Remainder);
+
+    for (DeviceIndex = 0; DeviceIndex < Index->DeviceCount; DeviceIndex++) {
+        Device = &Index->Devices[DeviceIndex];
+        PrefixLength = Device->DeviceName.LengthInChars;
+        if (ObjectName->LengthInChars >= PrefixLength &&
+            YoriLibCompareStringInsensitiveCount(ObjectName, &Device->DeviceName, PrefixLength) == 0 &&
+            (ObjectName->LengthInChars == PrefixLength || ObjectName->StartOfString[PrefixLength] == '\\')) {
+
+            Remainder.StartOfString = &ObjectName->StartOfString[PrefixLength];
+            Remainder.LengthInChars = ObjectName->LengthInChars - PrefixLength;
+            if (!YoriLibAllocateString(Path, sizeof("\\\\?\\C:\\") + Remainder.LengthInChars)) {
+                return FALSE;
+            }
+            Path->LengthInChars = YoriLibSPrintf(Path->StartOfString, _T("\\\\?\\%c:%y"), Device->DriveLetter, &Remainder);
+            if (Path->LengthInChars == sizeof("\\\\?\\C:") - 1) {
+                Path->StartOfString[Path->LengthInChars++] = '\\';
+                Path->StartOfString[Path->LengthInChars] = '\0';
+            }
+            return TRUE;
+        }
+    }
+
+    PrefixLength = sizeof("\\Device\\Mup\\") - 1;
+    if (YoriLibCompareStringWithLiteralInsensitiveCount(ObjectName, _T("\\Device\\Mup\\"), PrefixLength) == 0) {
+        Remainder.StartOfString = &ObjectName->StartOfString[PrefixLength];
+        Remainder.LengthInChars = ObjectName->LengthInChars - PrefixLength;
+        if (!YoriLibAllocateString(Path, sizeof("\\\\?\\UNC\\") + Remainder.LengthInChars)) {
+            return FALSE;
+        }
+        Path->LengthInChars = YoriLibSPrintf(Path->StartOfString, _T("\\\\?\\UNC\\%y"), &Remainder);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Record that a handle in a process refers to a path.
+
+ @param Index Pointer to the index.
+
+ @param Path Pointer to the escaped full path.
+
+ @param ProcessId The process containing the handle.
+
+ @param HandleValue The value of the handle within the process.
+ */
+VOID
+LsofAddHandleToIndex(
+    __inout PLSOF_HANDLE_INDEX Index,
+    __in PYORI_STRING Path,
+    __in DWORD ProcessId,
+    __in DWORD_PTR HandleValue
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PLSOF_INDEXED_PATH IndexedPath;
+    PLSOF_OPEN_HANDLE OpenHandle;
+
+    HashEntry = YoriLibHashLookupByKey(Index->PathHash, Path);
+    if (HashEntry != NULL) {
+        IndexedPath = (PLSOF_INDEXED_PATH)HashEntry->Context;
+    } else {
+        IndexedPath = YoriLibMalloc(sizeof(LSOF_INDEXED_PATH) + (Path->LengthInChars + 1) * sizeof(TCHAR));
+        if (IndexedPath == NULL) {
+            return;
+        }
+
+        YoriLibInitEmptyString(&IndexedPath->Path);
+        IndexedPath->Path.StartOfString = (LPTSTR)(IndexedPath + 1);
+        IndexedPath->Path.LengthInChars = Path->LengthInChars;
+        IndexedPath->Path.LengthAllocated = Path->LengthInChars + 1;
+        memcpy(IndexedPath->Path.StartOfString, Path->StartOfString, Path->LengthInChars * sizeof(TCHAR));
+        IndexedPath->Path.StartOfString[Path->LengthInChars] = '\0';
+        YoriLibInitializeListHead(&IndexedPath->Handles);
+        YoriLibHashInsertByKey(Index->PathHash, &IndexedPath->Path, IndexedPath, &IndexedPath->HashEntry);
+        YoriLibAppendList(&Index->PathList, &IndexedPath->ListEntry);
+    }
+
+    OpenHandle = YoriLibMalloc(sizeof(LSOF_OPEN_HANDLE));
+    if (OpenHandle == NULL) {
+        return;
+    }
+
+    OpenHandle->ProcessId = ProcessId;
+    OpenHandle->HandleValue = HandleValue;
+    YoriLibAppendList(&IndexedPath->Handles, &OpenHandle->ListEntry);
+}
+
+/**
+ Collect the result of a completed query from a worker and add it to the
+ index.  On return the worker is ready for another query.
+
+ @param Index Pointer to the index.
+
+ @param Worker Pointer to the worker whose query has completed.
+ */
+VOID
+LsofCompleteNameWorker(
+    __inout PLSOF_HANDLE_INDEX Index,
+    __inout PLSOF_NAME_WORKER Worker
+    )
+{
+    YORI_STRING ObjectName;
+    YORI_STRING Path;
+
+    if (Worker->Status == 0 && Worker->NameInfo->LengthInBytes > 0) {
+        YoriLibInitEmptyString(&ObjectName);
+        ObjectName.StartOfString = Worker->NameInfo->Buffer;
+        ObjectName.LengthInChars = Worker->NameInfo->LengthInBytes / sizeof(WCHAR);
+
+        YoriLibInitEmptyString(&Path);
+        if (LsofConvertObjectName(Index, &ObjectName, &Path)) {
+            LsofAddHandleToIndex(Index, &Path, Worker->ProcessId, Worker->HandleValue);
+            YoriLibFreeStringContents(&Path);
+        }
+    }
+
+    CloseHandle(Worker->FileHandle);
+    Worker->FileHandle = NULL;
+    Worker->Busy = FALSE;
+}
+
+/**
+ Wait for at least one busy worker to either complete its query or exceed
+ the time allowed for it.  Workers that exceed the time allowed are
+ terminated and replaced.
+
+ @param Index Pointer to the index.
+
+ @return TRUE if a worker is now available, FALSE if no workers were busy.
+ */
+BOOL
+LsofWaitForNameWorker(
+    __inout PLSOF_HANDLE_INDEX Index
+    )
+{
+    HANDLE WaitHandles[LSOF_NAME_WORKER_COUNT];
+    DWORD WorkerIndexes[LSOF_NAME_WORKER_COUNT];
+    PLSOF_NAME_WORKER Worker;
+    DWORD Count;
+    DWORD WorkerIndex;
+    DWORD Now;
+    DWORD Waited;
+    DWORD LongestWaited;
+    DWORD Timeout;
+    DWORD WaitResult;
+
+    Count = 0;
+    LongestWaited = 0;
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Now = GetTickCount();
+    for (WorkerIndex = 0; WorkerIndex < LSOF_NAME_WORKER_COUNT; WorkerIndex++) {
+        Worker = Index->Workers[WorkerIndex];
+        if (Worker != NULL && Worker->Busy) {
+            WaitHandles[Count] = Worker->hCompleteEvent;
+            WorkerIndexes[Count] = WorkerIndex;
+            Count++;
+            Waited = Now - Worker->StartTick;
+            if (Waited > LongestWaited) {
+                LongestWaited = Waited;
+            }
+        }
+    }
+
+    if (Count == 0) {
+        return FALSE;
+    }
+
+    Timeout = 0;
+    if (LongestWaited < LSOF_NAME_TIMEOUT) {
+        Timeout = LSOF_NAME_TIMEOUT - LongestWaited;
+    }
+
+    WaitResult = WaitForMultipleObjects(Count, WaitHandles, FALSE, Timeout);
+    if (WaitResult >= WAIT_OBJECT_0 && WaitResult < WAIT_OBJECT_0 + Count) {
+        WorkerIndex = WorkerIndexes[WaitResult - WAIT_OBJECT_0];
+        LsofCompleteNameWorker(Index, Index->Workers[WorkerIndex]);
+        return TRUE;
+    }
+
+    //
+    //  Replace any worker that has taken too long.
+    //
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Now = GetTickCount();
+    for (WorkerIndex = 0; WorkerIndex < LSOF_NAME_WORKER_COUNT; WorkerIndex++) {
+        Worker = Index->Workers[WorkerIndex];
+        if (Worker != NULL && Worker->Busy &&
+            Now - Worker->StartTick >= LSOF_NAME_TIMEOUT) {
+
+            Index->TimedOutCount++;
+            LsofAbandonNameWorker(Worker);
+            Index->Workers[WorkerIndex] = LsofStartNameWorker();
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Free an index of file handles.
+
+ @param Index Pointer to the index to free.
+ */
+VOID
+LsofFreeHandleIndex(
+    __in PLSOF_HANDLE_INDEX Index
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIST_ENTRY HandleEntry;
+    PLSOF_INDEXED_PATH IndexedPath;
+    PLSOF_OPEN_HANDLE OpenHandle;
+    DWORD DeviceIndex;
+
+    if (Index->PathHash != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&Index->PathList, NULL);
+        while (ListEntry != NULL) {
+            IndexedPath = CONTAINING_RECORD(ListEntry, LSOF_INDEXED_PATH, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&Index->PathList, ListEntry);
+
+            HandleEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, NULL);
+            while (HandleEntry != NULL) {
+                OpenHandle = CONTAINING_RECORD(HandleEntry, LSOF_OPEN_HANDLE, ListEntry);
+                HandleEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, HandleEntry);
+                YoriLibFree(OpenHandle);
+            }
+
+            YoriLibHashRemoveByEntry(&IndexedPath->HashEntry);
+            YoriLibRemoveListItem(&IndexedPath->ListEntry);
+            YoriLibFree(IndexedPath);
+        }
+
+        YoriLibFreeEmptyHashTable(Index->PathHash);
+        Index->PathHash = NULL;
+    }
+
+    for (DeviceIndex = 0; DeviceIndex < Index->DeviceCount; DeviceIndex++) {
+        YoriLibFreeStringContents(&Index->Devices[DeviceIndex].DeviceName);
+    }
+    Index->DeviceCount = 0;
+}
+
+/**
+ Build an index of every file handle in the system.  This takes a single
+ snapshot of all handles, duplicates each file handle into this process,
+ and resolves its name on a pool of worker threads so that a handle whose
+ name query blocks only delays the index by a bounded time.
+
+ @param Index Pointer to the index to populate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+LsofBuildHandleIndex(
+    __out PLSOF_HANDLE_INDEX Index
+    )
+{
+    PYORI_SYSTEM_HANDLE_INFORMATION_EX HandleInfo;
+    PYORI_SYSTEM_HANDLE_ENTRY_EX Entry;
+    PLSOF_NAME_WORKER Worker;
+    HANDLE ProbeHandle;
+    HANDLE ProcessHandle;
+    HANDLE FileHandle;
+    DWORD CurrentProcessId;
+    DWORD ProcessId;
+    DWORD HandleIndex;
+    DWORD WorkerIndex;
+    USHORT FileTypeIndex;
+    BOOL FileTypeFound;
+
+    ZeroMemory(Index, sizeof(LSOF_HANDLE_INDEX));
+    YoriLibInitializeListHead(&Index->PathList);
+
+    if (DllNtDll.pNtQueryObject == NULL) {
+        return FALSE;
+    }
+
+    Index->PathHash = YoriLibAllocateHashTable(4000);
+    if (Index->PathHash == NULL) {
+        return FALSE;
+    }
+
+    LsofLoadDeviceMap(Index);
+
+    //
+    //  The type index for file objects differs between systems.  Open a
+    //  file and find the type of that handle in the snapshot.
+    //
+
+    ProbeHandle = CreateFile(_T("NUL"), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (ProbeHandle == INVALID_HANDLE_VALUE) {
+        LsofFreeHandleIndex(Index);
+        return FALSE;
+    }
+
+    if (!YoriLibGetSystemHandlesList(&HandleInfo)) {
+        CloseHandle(ProbeHandle);
+        LsofFreeHandleIndex(Index);
+        return FALSE;
+    }
+
+    CloseHandle(ProbeHandle);
+
+    CurrentProcessId = GetCurrentProcessId();
+    FileTypeFound = FALSE;
+    FileTypeIndex = 0;
+    for (HandleIndex = 0; HandleIndex < HandleInfo->NumberOfHandles; HandleIndex++) {
+        Entry = &HandleInfo->Handles[HandleIndex];
+        if (Entry->UniqueProcessId == CurrentProcessId &&
+            Entry->HandleValue == (DWORD_PTR)ProbeHandle) {
+
+            FileTypeIndex = Entry->ObjectTypeIndex;
+            FileTypeFound = TRUE;
+            break;
+        }
+    }
+
+    if (!FileTypeFound) {
+        YoriLibFree(HandleInfo);
+        LsofFreeHandleIndex(Index);
+        return FALSE;
+    }
+
+    for (WorkerIndex = 0; WorkerIndex < LSOF_NAME_WORKER_COUNT; WorkerIndex++) {
+        Index->Workers[WorkerIndex] = LsofStartNameWorker();
+    }
+
+    //
+    //  Handles for a process are typically adjacent in the snapshot, so
+    //  keep the most recent process open.
+    //
+
+    ProcessId = (DWORD)-1;
+    ProcessHandle = NULL;
+
+    for (HandleIndex = 0; HandleIndex < HandleInfo->NumberOfHandles; HandleIndex++) {
+        Entry = &HandleInfo->Handles[HandleIndex];
+        if (Entry->ObjectTypeIndex != FileTypeIndex ||
+            Entry->UniqueProcessId == CurrentProcessId) {
+
+            continue;
+        }
+
+        if ((DWORD)Entry->UniqueProcessId != ProcessId) {
+            if (ProcessHandle != NULL) {
+                CloseHandle(ProcessHandle);
+            }
+            ProcessId = (DWORD)Entry->UniqueProcessId;
+            ProcessHandle = OpenProcess(PROCESS_DUP_HANDLE, FALSE, ProcessId);
+        }
+
+        if (ProcessHandle == NULL) {
+            continue;
+        }
+
+        if (!DuplicateHandle(ProcessHandle, (HANDLE)Entry->HandleValue, GetCurrentProcess(), &FileHandle, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+            continue;
+        }
+
+        //
+        //  Find a worker that isn't busy, waiting for one if necessary.
+        //
+
+        Worker = NULL;
+        while (Worker == NULL) {
+            for (WorkerIndex = 0; WorkerIndex < LSOF_NAME_WORKER_COUNT; WorkerIndex++) {
+                if (Index->Workers[WorkerIndex] != NULL && !Index->Workers[WorkerIndex]->Busy) {
+                    Worker = Index->Workers[WorkerIndex];
+                    break;
+                }
+            }
+
+            if (Worker == NULL && !LsofWaitForNameWorker(Index)) {
+                break;
+            }
+        }
+
+        if (Worker == NULL) {
+            CloseHandle(FileHandle);
+            break;
+        }
+
+        Worker->FileHandle = FileHandle;
+        Worker->ProcessId = ProcessId;
+        Worker->HandleValue = Entry->HandleValue;
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        Worker->StartTick = GetTickCount();
+        Worker->Busy = TRUE;
+        SetEvent(Worker->hRequestEvent);
+    }
+
+    if (ProcessHandle != NULL) {
+        CloseHandle(ProcessHandle);
+    }
+
+    while (LsofWaitForNameWorker(Index));
+
+    for (WorkerIndex = 0; WorkerIndex < LSOF_NAME_WORKER_COUNT; WorkerIndex++) {
+        if (Index->Workers[WorkerIndex] != NULL) {
+            LsofStopNameWorker(Index->Workers[WorkerIndex]);
+            Index->Workers[WorkerIndex] = NULL;
+        }
+    }
+
+    YoriLibFree(HandleInfo);
+    return TRUE;
+}
+
+/**
+ Find the process image name for a process ID.
+
+ @param ProcessId The process to find the image name for.
+
+ @param ProcessName On successful completion, populated with the image name.
+        On failure, set to an empty string.
+
+ @param ProcessNameSize The number of characters in ProcessName.
+ */
+VOID
+LsofGetProcessName(
+    __in DWORD ProcessId,
+    __out_ecount(ProcessNameSize) LPTSTR ProcessName,
+    __in DWORD ProcessNameSize
+    )
+{
+    HANDLE ProcessHandle;
+
+    ProcessName[0] = '\0';
+    ProcessHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, ProcessId);
+    if (ProcessHandle != NULL) {
+        DllKernel32.pQueryFullProcessImageNameW(ProcessHandle, 0, ProcessName, &ProcessNameSize);
+        CloseHandle(ProcessHandle);
+    }
+}
+
+/**
+ Display every handle that refers to a path, using the handle index.
+
+ @param Index Pointer to the index.
+
+ @param FilePath Pointer to the escaped full path to look up.
+ */
+VOID
+LsofDisplayIndexedPath(
+    __in PLSOF_HANDLE_INDEX Index,
+    __in PYORI_STRING FilePath
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PLSOF_INDEXED_PATH IndexedPath;
+    PLSOF_OPEN_HANDLE OpenHandle;
+    PYORI_LIST_ENTRY ListEntry;
+    TCHAR ProcessName[300];
+
+    HashEntry = YoriLibHashLookupByKey(Index->PathHash, FilePath);
+    if (HashEntry == NULL) {
+        return;
+    }
+
+    IndexedPath = (PLSOF_INDEXED_PATH)HashEntry->Context;
+    ListEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, NULL);
+    while (ListEntry != NULL) {
+        OpenHandle = CONTAINING_RECORD(ListEntry, LSOF_OPEN_HANDLE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, ListEntry);
+
+        LsofGetProcessName(OpenHandle->ProcessId, ProcessName, sizeof(ProcessName)/sizeof(ProcessName[0]));
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%10i %8x %s\n"), OpenHandle->ProcessId, (DWORD)OpenHandle->HandleValue, ProcessName);
+    }
+}
+
+/**
+ Display every path in the handle index along with the handles that refer
+ to it.
+
+ @param Index Pointer to the index.
+ */
+VOID
+LsofDisplayAllIndexedPaths(
+    __in PLSOF_HANDLE_INDEX Index
+    )
+{
+    PLSOF_INDEXED_PATH IndexedPath;
+    PLSOF_OPEN_HANDLE OpenHandle;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIST_ENTRY HandleEntry;
+    YORI_STRING UnescapedPath;
+    PYORI_STRING DisplayPath;
+
+    YoriLibInitEmptyString(&UnescapedPath);
+
+    ListEntry = YoriLibGetNextListEntry(&Index->PathList, NULL);
+    while (ListEntry != NULL) {
+        IndexedPath = CONTAINING_RECORD(ListEntry, LSOF_INDEXED_PATH, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Index->PathList, ListEntry);
+
+        DisplayPath = &IndexedPath->Path;
+        if (YoriLibUnescapePath(&IndexedPath->Path, &UnescapedPath)) {
+            DisplayPath = &UnescapedPath;
+        }
+
+        HandleEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, NULL);
+        while (HandleEntry != NULL) {
+            OpenHandle = CONTAINING_RECORD(HandleEntry, LSOF_OPEN_HANDLE, ListEntry);
+            HandleEntry = YoriLibGetNextListEntry(&IndexedPath->Handles, HandleEntry);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%10i %8x %y\n"), OpenHandle->ProcessId, (DWORD)OpenHandle->HandleValue, DisplayPath);
+        }
+    }
+
+    YoriLibFreeStringContents(&UnescapedPath);
+}
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -76,6 +983,13 @@ typedef struct _LSOF_CONTEXT {
      */
     PFILE_PROCESS_IDS_USING_FILE_INFORMATION Buffer;
 
+    /**
+     If files should be found from a snapshot of system handles, points to
+     the index of that snapshot.  If NULL, each file is opened and queried
+     for the processes using it.
+     */
+    PLSOF_HANDLE_INDEX HandleIndex;
+
 } LSOF_CONTEXT, *PLSOF_CONTEXT;
 
 /**
@@ -115,6 +1029,11 @@ LsofFileFoundCallback(
 
     LsofContext->FilesFoundThisArg++;
 
+    if (LsofContext->HandleIndex != NULL) {
+        LsofDisplayIndexedPath(LsofContext->HandleIndex, FilePath);
+        return TRUE;
+    }
+
     FileHandle = CreateFile(FilePath->StartOfString,
                             FILE_READ_ATTRIBUTES,
                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
@@ -140,16 +1059,9 @@ LsofFileFoundCallback(
     Status = DllNtDll.pNtQueryInformationFile(FileHandle, &IoStatus, LsofContext->Buffer, LsofContext->BufferLength, FileProcessIdsUsingFileInformation);
     if (Status == 0) {
         for (Index = 0; Index < LsofContext->Buffer->NumberOfProcesses; Index++) {
-            HANDLE ProcessHandle;
             TCHAR ProcessName[300];
-            DWORD ProcessNameSize;
 
-            ProcessName[0] = '\0';
-            ProcessNameSize = sizeof(ProcessName)/sizeof(ProcessName[0]);
-            ProcessHandle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)LsofContext->Buffer->ProcessIds[Index]);
-            if (ProcessHandle != NULL) {
-                DllKernel32.pQueryFullProcessImageNameW(ProcessHandle, 0, ProcessName, &ProcessNameSize);
-            }
+            LsofGetProcessName((DWORD)LsofContext->Buffer->ProcessIds[Index], ProcessName, sizeof(ProcessName)/sizeof(ProcessName[0]));
             YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%10i %s\n"), LsofContext->Buffer->ProcessIds[Index], ProcessName);
         }
     } else {
@@ -194,7 +1106,9 @@ ENTRYPOINT(
     DWORD MatchFlags;
     BOOL Recursive = FALSE;
     BOOL BasicEnumeration = FALSE;
+    BOOL UseHandleIndex = FALSE;
     LSOF_CONTEXT LsofContext;
+    LSOF_HANDLE_INDEX HandleIndex;
     YORI_STRING Arg;
 
     ZeroMemory(&LsofContext, sizeof(LsofContext));
@@ -215,6 +1129,9 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("h")) == 0) {
+                UseHandleIndex = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("s")) == 0) {
                 Recursive = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -234,8 +1151,9 @@ ENTRYPOINT(
         }
     }
 
-    if (DllNtDll.pNtQueryInformationFile == NULL ||
-        DllKernel32.pQueryFullProcessImageNameW == NULL) {
+    if (DllKernel32.pQueryFullProcessImageNameW == NULL ||
+        (!UseHandleIndex && DllNtDll.pNtQueryInformationFile == NULL) ||
+        (UseHandleIndex && DllNtDll.pNtQueryObject == NULL)) {
 
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: OS support not present\n"));
         return EXIT_FAILURE;
@@ -243,14 +1161,36 @@ ENTRYPOINT(
 
     //
     //  Attempt to enable backup privilege so an administrator can access more
-    //  objects successfully.
+    //  objects successfully.  When searching handles, debug privilege allows
+    //  handles to be duplicated from more processes.
     //
 
     YoriLibEnableBackupPrivilege();
 
+    if (UseHandleIndex) {
+        YoriLibEnableDebugPrivilege();
+        if (!LsofBuildHandleIndex(&HandleIndex)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: could not query system handles\n"));
+            return EXIT_FAILURE;
+        }
+        if (HandleIndex.TimedOutCount > 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("lsof: %i handles did not respond and were skipped\n"), HandleIndex.TimedOutCount);
+        }
+        LsofContext.HandleIndex = &HandleIndex;
+
+        if (StartArg == 0 || StartArg == ArgC) {
+            LsofDisplayAllIndexedPaths(&HandleIndex);
+            LsofFreeHandleIndex(&HandleIndex);
+            return EXIT_SUCCESS;
+        }
+    }
+
     LsofContext.BufferLength = 16 * 1024;
     LsofContext.Buffer = YoriLibMalloc(LsofContext.BufferLength);
     if (LsofContext.Buffer == NULL) {
+        if (UseHandleIndex) {
+            LsofFreeHandleIndex(&HandleIndex);
+        }
         return EXIT_FAILURE;
     }
 
@@ -287,6 +1227,9 @@ ENTRYPOINT(
     }
 
     YoriLibFree(LsofContext.Buffer);
+    if (UseHandleIndex) {
+        LsofFreeHandleIndex(&HandleIndex);
+    }
 
     return EXIT_SUCCESS;
 }
@@ -35,10 +35,16 @@ CHAR strMemHelpText[] =
         "\n"
         "Display memory usage.\n"
         "\n"
-        "MEM [-license] [-c [-g]] [<fmt>]\n"
+        "MEM [-license] [-c [-g]] [-i <ms>] [-n <count>] [-o <file>] [<fmt>]\n"
         "\n"
         "   -c             Display memory usage of processes the user has access to\n"
         "   -g             Count all processes with the same name together\n"
+        "   -i             Sample memory usage repeatedly at the specified interval\n"
+        "   -n             Stop after the specified number of samples\n"
+        "   -o             Write samples to the specified file\n"
+        "\n"
+        "When sampling, the default format is one line of comma separated values per\n"
+        "sample.  Sampling stops when Ctrl+C is pressed.\n"
         "\n"
         "Format specifiers are:\n"
         "   $AVAILABLECOMMIT$      The amount of memory that the system has available\n"
@@ -52,6 +58,7 @@ CHAR strMemHelpText[] =
         "                          in human friendly format\n"
         "   $COMMITLIMITBYTES$     The maximum amount of memory the system can allocate\n"
         "                          in raw bytes\n"
+        "   $TIMESTAMP$            The local time when the information was collected\n"
         "   $TOTALMEM$             The amount of physical memory in human friendly\n"
         "                          format\n"
         "   $TOTALMEMBYTES$        The amount of physical memory in raw bytes\n";
@@ -147,6 +154,11 @@ typedef struct _MEM_CONTEXT {
      process concept.
      */
     LARGE_INTEGER AvailableVirtual;
+
+    /**
+     The local time when the information was collected.
+     */
+    SYSTEMTIME SampleTime;
 } MEM_CONTEXT, *PMEM_CONTEXT;
 
 /**
@@ -191,6 +203,8 @@ MemExpandVariables(
         return MemOutputLargeInteger(MemContext->TotalCommit, 10, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("AVAILABLECOMMITBYTES")) == 0) {
         return MemOutputLargeInteger(MemContext->AvailableCommit, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TIMESTAMP")) == 0) {
+        return YoriLibOutputSystemTime(&MemContext->SampleTime, OutputBuffer);
     } else {
         return 0;
     }
@@ -224,7 +238,8 @@ MemExpandVariables(
  If the user has requested it, go through the set of found processes, and
  merge later entries with the same image name into the first entry.  On
  successful completion, update the count of processes to be reduced by the
- number of merges performed.
+ number of merges performed.  The first entry with each name is found via a
+ hash table, so the list is only traversed once.
 
  @param ProcessInfo Pointer to a linked list of processes.
 
@@ -241,58 +256,84 @@ MemGroupProcessNames(
     PYORI_SYSTEM_PROCESS_INFORMATION FirstEntryWithName;
     PYORI_SYSTEM_PROCESS_INFORMATION CurrentEntry;
     PYORI_SYSTEM_PROCESS_INFORMATION PreviousEntry;
+    PYORI_SYSTEM_PROCESS_INFORMATION NextEntry;
+    PYORI_HASH_TABLE NameHash;
+    PYORI_HASH_ENTRY HashEntries;
+    PYORI_HASH_ENTRY HashEntry;
+    DWORD HashEntryCount;
     DWORD ProcessCount;
-    YORI_STRING PrimaryName;
+    DWORD Index;
     YORI_STRING FoundName;
 
-    YoriLibInitEmptyString(&PrimaryName);
+    NameHash = YoriLibAllocateHashTable(250);
+    if (NameHash == NULL) {
+        return FALSE;
+    }
+
+    HashEntries = YoriLibMalloc(*NumberOfProcesses * sizeof(YORI_HASH_ENTRY));
+    if (HashEntries == NULL) {
+        YoriLibFreeEmptyHashTable(NameHash);
+        return FALSE;
+    }
+
     YoriLibInitEmptyString(&FoundName);
-    FirstEntryWithName = ProcessInfo;
+    HashEntryCount = 0;
     ProcessCount = *NumberOfProcesses;
+    CurrentEntry = ProcessInfo;
+    PreviousEntry = NULL;
 
     do {
 
-        PrimaryName.StartOfString = FirstEntryWithName->ImageName;
-        PrimaryName.LengthInChars = FirstEntryWithName->ImageNameLengthInBytes / sizeof(WCHAR);
+        if (CurrentEntry->NextEntryOffset == 0) {
+            NextEntry = NULL;
+        } else {
+            NextEntry = YoriLibAddToPointer(CurrentEntry, CurrentEntry->NextEntryOffset);
+        }
 
-        FirstEntryWithName->ProcessId = 1;
-        CurrentEntry = FirstEntryWithName;
-        PreviousEntry = CurrentEntry;
+        FoundName.StartOfString = CurrentEntry->ImageName;
+        FoundName.LengthInChars = CurrentEntry->ImageNameLengthInBytes / sizeof(WCHAR);
 
-        while (CurrentEntry->NextEntryOffset != 0) {
+        HashEntry = YoriLibHashLookupByKey(NameHash, &FoundName);
+        if (HashEntry != NULL) {
 
-            CurrentEntry = YoriLibAddToPointer(CurrentEntry, CurrentEntry->NextEntryOffset);
-            FoundName.StartOfString = CurrentEntry->ImageName;
-            FoundName.LengthInChars = CurrentEntry->ImageNameLengthInBytes / sizeof(WCHAR);
+            //
+            //  Merge into the first entry with this name and unlink this
+            //  entry from the list.  The first entry always precedes this
+            //  one, so PreviousEntry is valid.
+            //
 
-            if (YoriLibCompareStringInsensitive(&PrimaryName, &FoundName) == 0) {
-                FirstEntryWithName->WorkingSetSize += CurrentEntry->WorkingSetSize;
-                FirstEntryWithName->CommitSize += CurrentEntry->CommitSize;
-                FirstEntryWithName->ProcessId++;
-                if (CurrentEntry->NextEntryOffset == 0) {
-                    PreviousEntry->NextEntryOffset = 0;
-                } else {
-                    PreviousEntry->NextEntryOffset += CurrentEntry->NextEntryOffset;
-                }
-                ProcessCount--;
+            FirstEntryWithName = HashEntry->Context;
+            FirstEntryWithName->WorkingSetSize += CurrentEntry->WorkingSetSize;
+            FirstEntryWithName->CommitSize += CurrentEntry->CommitSize;
+            FirstEntryWithName->ProcessId++;
+            if (CurrentEntry->NextEntryOffset == 0) {
+                PreviousEntry->NextEntryOffset = 0;
             } else {
-                PreviousEntry = CurrentEntry;
+                PreviousEntry->NextEntryOffset += CurrentEntry->NextEntryOffset;
             }
+            ProcessCount--;
+        } else {
+            ASSERT(HashEntryCount < *NumberOfProcesses);
+            CurrentEntry->ProcessId = 1;
+            YoriLibHashInsertByKey(NameHash, &FoundName, CurrentEntry, &HashEntries[HashEntryCount]);
+            HashEntryCount++;
+            PreviousEntry = CurrentEntry;
         }
 
-        if (FirstEntryWithName->NextEntryOffset == 0) {
-            break;
-        }
+        CurrentEntry = NextEntry;
+    } while (CurrentEntry != NULL);
 
-        FirstEntryWithName = YoriLibAddToPointer(FirstEntryWithName, FirstEntryWithName->NextEntryOffset);
-    } while (TRUE);
+    for (Index = 0; Index < HashEntryCount; Index++) {
+        YoriLibHashRemoveByEntry(&HashEntries[Index]);
+    }
+    YoriLibFreeEmptyHashTable(NameHash);
+    YoriLibFree(HashEntries);
 
     *NumberOfProcesses = ProcessCount;
 
     return TRUE;
 }
 
-
 /**
  Display the memory used by all processes that the current user has access
  to.
@@ -306,12 +347,9 @@ MemDisplayProcessMemoryUsage(
 {
     PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo = NULL;
     PYORI_SYSTEM_PROCESS_INFORMATION CurrentEntry;
-    DWORD BytesReturned;
-    DWORD BytesAllocated;
     DWORD NumberOfProcesses;
     DWORD CurrentProcessIndex;
     PYORI_SYSTEM_PROCESS_INFORMATION *SortedProcesses;
-    LONG Status;
     YORI_STRING BaseName;
     LARGE_INTEGER liCommit;
     LARGE_INTEGER liWorkingSet;
@@ -335,38 +373,7 @@ MemDisplayProcessMemoryUsage(
         return FALSE;
     }
 
-    BytesAllocated = 0;
-
-    do {
-
-        if (ProcessInfo != NULL) {
-            YoriLibFree(ProcessInfo);
-        }
-
-        if (BytesAllocated == 0) {
-            BytesAllocated = 64 * 1024;
-        } else if (BytesAllocated <= 1024 * 1024) {
-            BytesAllocated = BytesAllocated * 4;
-        } else {
-            return FALSE;
-        }
-
-        ProcessInfo = YoriLibMalloc(BytesAllocated);
-        if (ProcessInfo == NULL) {
-            return FALSE;
-        }
-
-        Status = DllNtDll.pNtQuerySystemInformation(SystemProcessInformation, ProcessInfo, BytesAllocated, &BytesReturned);
-    } while (Status == (LONG)0xc0000004);
-
-
-    if (Status != 0) {
-        YoriLibFree(ProcessInfo);
-        return FALSE;
-    }
-
-    if (BytesReturned == 0) {
-        YoriLibFree(ProcessInfo);
+    if (!YoriLibGetSystemProcessList(&ProcessInfo)) {
         return FALSE;
     }
 
@@ -470,6 +477,91 @@ MemDisplayProcessMemoryUsage(
     return TRUE;
 }
 
+/**
+ A callback function to expand each variable in the format string to its
+ own name, used to generate a header row when sampling.
+
+ @param OutputBuffer A pointer to the output buffer to populate with data
+        if a known variable is found.
+
+ @param VariableName The variable name to expand.
+
+ @param Context Unused.
+
+ @return The number of characters successfully populated, or the number of
+         characters required in order to successfully populate, or zero
+         on error.
+ */
+DWORD
+MemExpandVariableNames(
+    __inout PYORI_STRING OutputBuffer,
+    __in PYORI_STRING VariableName,
+    __in PVOID Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (OutputBuffer->LengthAllocated >= VariableName->LengthInChars) {
+        memcpy(OutputBuffer->StartOfString, VariableName->StartOfString, VariableName->LengthInChars * sizeof(TCHAR));
+    }
+
+    return VariableName->LengthInChars;
+}
+
+/**
+ Collect the current memory usage of the system.
+
+ @param MemContext Pointer to the context to populate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+MemCollectSample(
+    __out PMEM_CONTEXT MemContext
+    )
+{
+    GetLocalTime(&MemContext->SampleTime);
+
+    if (DllKernel32.pGlobalMemoryStatusEx) {
+        YORI_MEMORYSTATUSEX MemStatusEx;
+        MemStatusEx.dwLength = sizeof(MemStatusEx);
+        if (!DllKernel32.pGlobalMemoryStatusEx(&MemStatusEx)) {
+            DWORD Err = GetLastError();
+            LPTSTR ErrText = YoriLibGetWinErrorText(Err);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Query of memory failed: %s"), ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            return FALSE;
+        }
+
+        MemContext->TotalPhysical.QuadPart = MemStatusEx.ullTotalPhys;
+        MemContext->AvailablePhysical.QuadPart = MemStatusEx.ullAvailPhys;
+        MemContext->TotalCommit.QuadPart = MemStatusEx.ullTotalPageFile;
+        MemContext->AvailableCommit.QuadPart = MemStatusEx.ullAvailPageFile;
+        MemContext->TotalVirtual.QuadPart = MemStatusEx.ullTotalVirtual;
+        MemContext->AvailableVirtual.QuadPart = MemStatusEx.ullAvailVirtual;
+    } else {
+        MEMORYSTATUS MemStatus;
+        //
+        //  Warning about using a deprecated function and how we should use
+        //  GlobalMemoryStatusEx instead.  The analyzer isn't smart enough to
+        //  notice that when it's available, that's what we do.
+        //
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159)
+#endif
+        GlobalMemoryStatus(&MemStatus);
+        MemContext->TotalPhysical.QuadPart = MemStatus.dwTotalPhys;
+        MemContext->AvailablePhysical.QuadPart = MemStatus.dwAvailPhys;
+        MemContext->TotalCommit.QuadPart = MemStatus.dwTotalPageFile;
+        MemContext->AvailableCommit.QuadPart = MemStatus.dwAvailPageFile;
+        MemContext->TotalVirtual.QuadPart = MemStatus.dwTotalVirtual;
+        MemContext->AvailableVirtual.QuadPart = MemStatus.dwAvailVirtual;
+    }
+
+    return TRUE;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the mem builtin command.
@@ -507,10 +599,27 @@ ENTRYPOINT(
     MEM_CONTEXT MemContext;
     YORI_STRING DisplayString;
     YORI_STRING AllocatedFormatString;
+    PYORI_STRING OutputFileName;
+    BOOL Sampling;
+    LONGLONG llTemp;
+    DWORD CharsConsumed;
+    DWORD Interval;
+    DWORD SampleCount;
+    DWORD SampleIndex;
+    DWORD NextDeadline;
+    DWORD Result;
+    HANDLE hOutput;
+    HANDLE hTimer;
     LPTSTR DefaultFormatString = _T("Total Physical: $TOTALMEM$\n")
                                  _T("Available Physical: $AVAILABLEMEM$\n")
                                  _T("Commit Limit: $COMMITLIMIT$\n")
                                  _T("Available Commit: $AVAILABLECOMMIT$\n");
+    LPTSTR DefaultSampleFormatString = _T("$TIMESTAMP$,$TOTALMEMBYTES$,$AVAILABLEMEMBYTES$,$COMMITLIMITBYTES$,$AVAILABLECOMMITBYTES$\n");
+
+    Sampling = FALSE;
+    Interval = 0;
+    SampleCount = 0;
+    OutputFileName = NULL;
 
     for (i = 1; i < ArgC; i++) {
 
@@ -531,6 +640,34 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("g")) == 0) {
                 GroupProcesses = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("i")) == 0) {
+                if (ArgC > i + 1 &&
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &llTemp, &CharsConsumed) &&
+                    CharsConsumed > 0 &&
+                    llTemp > 0) {
+
+                    Interval = (DWORD)llTemp;
+                    Sampling = TRUE;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("n")) == 0) {
+                if (ArgC > i + 1 &&
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &llTemp, &CharsConsumed) &&
+                    CharsConsumed > 0 &&
+                    llTemp > 0) {
+
+                    SampleCount = (DWORD)llTemp;
+                    Sampling = TRUE;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("o")) == 0) {
+                if (ArgC > i + 1) {
+                    OutputFileName = &ArgV[i + 1];
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             }
         } else {
             ArgumentUnderstood = TRUE;
@@ -555,53 +692,113 @@ ENTRYPOINT(
         MemDisplayProcessMemoryUsage(GroupProcesses);
     }
 
-    if (DllKernel32.pGlobalMemoryStatusEx) {
-        YORI_MEMORYSTATUSEX MemStatusEx;
-        MemStatusEx.dwLength = sizeof(MemStatusEx);
-        if (!DllKernel32.pGlobalMemoryStatusEx(&MemStatusEx)) {
-            DWORD Err = GetLastError();
-            LPTSTR ErrText = YoriLibGetWinErrorText(Err);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Query of memory failed: %s"), ErrText);
+    //
+    //  When sampling, default to one second between samples, and to a
+    //  format that produces one row per sample.
+    //
+
+    if (Sampling) {
+        if (Interval == 0) {
+            Interval = 1000;
+        }
+        if (AllocatedFormatString.StartOfString == DefaultFormatString) {
+            YoriLibConstantString(&AllocatedFormatString, DefaultSampleFormatString);
+        }
+    } else {
+        SampleCount = 1;
+    }
+
+    hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (OutputFileName != NULL) {
+        YORI_STRING FullPath;
+
+        YoriLibInitEmptyString(&FullPath);
+        if (!YoriLibUserStringToSingleFilePath(OutputFileName, TRUE, &FullPath)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("mem: could not resolve %y\n"), OutputFileName);
+            YoriLibFreeStringContents(&AllocatedFormatString);
+            return EXIT_FAILURE;
+        }
+
+        hOutput = CreateFile(FullPath.StartOfString, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hOutput == INVALID_HANDLE_VALUE) {
+            DWORD LastError = GetLastError();
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("mem: open of %y failed: %s"), &FullPath, ErrText);
             YoriLibFreeWinErrorText(ErrText);
+            YoriLibFreeStringContents(&FullPath);
             YoriLibFreeStringContents(&AllocatedFormatString);
             return EXIT_FAILURE;
         }
+        YoriLibFreeStringContents(&FullPath);
+    }
 
-        MemContext.TotalPhysical.QuadPart = MemStatusEx.ullTotalPhys;
-        MemContext.AvailablePhysical.QuadPart = MemStatusEx.ullAvailPhys;
-        MemContext.TotalCommit.QuadPart = MemStatusEx.ullTotalPageFile;
-        MemContext.AvailableCommit.QuadPart = MemStatusEx.ullAvailPageFile;
-        MemContext.TotalVirtual.QuadPart = MemStatusEx.ullTotalVirtual;
-        MemContext.AvailableVirtual.QuadPart = MemStatusEx.ullAvailVirtual;
-    } else {
-        MEMORYSTATUS MemStatus;
-        //
-        //  Warning about using a deprecated function and how we should use
-        //  GlobalMemoryStatusEx instead.  The analyzer isn't smart enough to
-        //  notice that when it's available, that's what we do.
-        //
+    YoriLibInitEmptyString(&DisplayString);
+
+    //
+    //  If sampling with the default format, start with a row describing
+    //  each column.
+    //
+
+    if (Sampling && AllocatedFormatString.StartOfString == DefaultSampleFormatString) {
+        YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, MemExpandVariableNames, NULL, &DisplayString);
+        if (DisplayString.StartOfString != NULL) {
+            YoriLibOutputString(hOutput, 0, &DisplayString);
+        }
+    }
+
+    hTimer = NULL;
+    NextDeadline = 0;
+    if (Sampling) {
+        YoriLibCancelEnable();
+        hTimer = YoriLibCreatePeriodicTimer(Interval);
 #if defined(_MSC_VER) && (_MSC_VER >= 1700)
-#pragma warning(suppress: 28159)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
 #endif
-        GlobalMemoryStatus(&MemStatus);
-        MemContext.TotalPhysical.QuadPart = MemStatus.dwTotalPhys;
-        MemContext.AvailablePhysical.QuadPart = MemStatus.dwAvailPhys;
-        MemContext.TotalCommit.QuadPart = MemStatus.dwTotalPageFile;
-        MemContext.AvailableCommit.QuadPart = MemStatus.dwAvailPageFile;
-        MemContext.TotalVirtual.QuadPart = MemStatus.dwTotalVirtual;
-        MemContext.AvailableVirtual.QuadPart = MemStatus.dwAvailVirtual;
+        NextDeadline = GetTickCount() + Interval;
     }
 
+    //
+    //  Reuse the display buffer between samples, and wait on a timer
+    //  between them so that no processor time is consumed.
+    //
 
-    YoriLibInitEmptyString(&DisplayString);
-    YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, MemExpandVariables, &MemContext, &DisplayString);
-    if (DisplayString.StartOfString != NULL) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
-        YoriLibFreeStringContents(&DisplayString);
+    Result = EXIT_SUCCESS;
+    for (SampleIndex = 0; SampleCount == 0 || SampleIndex < SampleCount; SampleIndex++) {
+
+        if (SampleIndex > 0 &&
+            !YoriLibWaitForPeriodicTimer(hTimer, Interval, &NextDeadline)) {
+
+            break;
+        }
+
+        if (!MemCollectSample(&MemContext)) {
+            Result = EXIT_FAILURE;
+            break;
+        }
+
+        YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, MemExpandVariables, &MemContext, &DisplayString);
+        if (DisplayString.StartOfString != NULL) {
+            YoriLibOutputString(hOutput, 0, &DisplayString);
+        }
     }
+
+    if (Sampling) {
+        YoriLibCancelDisable();
+    }
+
+    if (hTimer != NULL) {
+        CloseHandle(hTimer);
+    }
+
+    if (OutputFileName != NULL) {
+        CloseHandle(hOutput);
+    }
+
+    YoriLibFreeStringContents(&DisplayString);
     YoriLibFreeStringContents(&AllocatedFormatString);
 
-    return EXIT_SUCCESS;
+    return Result;
 }
 
 // vim:sw=4:ts=4:et:
@@ -38,7 +38,15 @@ CHAR strProcInfoHelpText[] =
         "\n"
         "Collects information about a running system process.\n"
         "\n"
-        "PROCINFO [-license] [-f <fmt>] <pid>\n"
+        "PROCINFO [-license] [-f <fmt>] [-i <ms>] [-n <count>] [-o <file>] <pid>\n"
+        "\n"
+        "   -f             Specify a format string to display\n"
+        "   -i             Sample the process repeatedly at the specified interval\n"
+        "   -n             Stop after the specified number of samples\n"
+        "   -o             Write samples to the specified file\n"
+        "\n"
+        "When sampling, the default format is one line of comma separated values per\n"
+        "sample.  Sampling stops when the process exits or Ctrl+C is pressed.\n"
         "\n"
         "Format specifiers are:\n"
         "   $COMMIT$        Amount of Kb of memory committed by the process\n"
@@ -55,6 +63,7 @@ CHAR strProcInfoHelpText[] =
         "   $READCOUNT$     Number of read operations generated by the process\n"
         "   $READBYTES$     Number of bytes read by the process\n"
         "   $READCOUNT$     Number of read operations generated by the process\n"
+        "   $TIMESTAMP$     The local time when the information was collected\n"
         "   $WORKINGSET$    Amount of Kb of memory in the process working set\n"
         "   $WRITEBYTES$    Number of bytes written by the process\n"
         "   $WRITECOUNT$    Number of write operations generated by the process\n";
@@ -158,7 +167,6 @@ ProcInfoOutputTimestamp(
     return String.LengthInChars;
 }
 
-
 /**
  Context containing the results of execution to pass to helper function used
  to format output.
@@ -192,6 +200,11 @@ typedef struct _PROCINFO_CONTEXT {
      */
     YORI_IO_COUNTERS IoCounters;
 
+    /**
+     The local time when the information was collected.
+     */
+    SYSTEMTIME SampleTime;
+
 } PROCINFO_CONTEXT, *PPROCINFO_CONTEXT;
 
 /**
@@ -255,6 +268,8 @@ ProcInfoExpandVariables(
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("READCOUNT")) == 0) {
         IoCount.QuadPart = ProcInfoContext->IoCounters.ReadOperations;
         return ProcInfoOutputLargeInteger(IoCount, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TIMESTAMP")) == 0) {
+        return YoriLibOutputSystemTime(&ProcInfoContext->SampleTime, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("WORKINGSET")) == 0) {
         MemInKb.QuadPart = ProcInfoContext->VmInfo.WorkingSetSize / 1024;
         return ProcInfoOutputLargeInteger(MemInKb, 10, OutputBuffer);
@@ -268,6 +283,100 @@ ProcInfoExpandVariables(
     return 0;
 }
 
+/**
+ A callback function to expand each variable in the format string to its
+ own name, used to generate a header row when sampling.
+
+ @param OutputBuffer A pointer to the output buffer to populate with data
+        if a known variable is found.
+
+ @param VariableName The variable name to expand.
+
+ @param Context Unused.
+
+ @return The number of characters successfully populated, or the number of
+         characters required in order to successfully populate, or zero
+         on error.
+ */
+DWORD
+ProcInfoExpandVariableNames(
+    __inout PYORI_STRING OutputBuffer,
+    __in PYORI_STRING VariableName,
+    __in PVOID Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (OutputBuffer->LengthAllocated >= VariableName->LengthInChars) {
+        memcpy(OutputBuffer->StartOfString, VariableName->StartOfString, VariableName->LengthInChars * sizeof(TCHAR));
+    }
+
+    return VariableName->LengthInChars;
+}
+
+/**
+ Collect the current times, memory and IO usage of a process.
+
+ @param hProcess Handle to the process, opened for
+        PROCESS_QUERY_INFORMATION access.  When sampling repeatedly, the same
+        handle is used for each sample.
+
+ @param ProcInfoContext Pointer to the context to populate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+ProcInfoCollectSample(
+    __in HANDLE hProcess,
+    __out PPROCINFO_CONTEXT ProcInfoContext
+    )
+{
+    FILETIME ftCreationTime;
+    FILETIME ftExitTime;
+    FILETIME ftKernelTime;
+    FILETIME ftUserTime;
+    FILETIME ftNow;
+    LARGE_INTEGER liNow;
+    LARGE_INTEGER liCreationTime;
+
+    //
+    //  Save off times from the process.
+    //
+
+    GetProcessTimes(hProcess, &ftCreationTime, &ftExitTime, &ftKernelTime, &ftUserTime);
+    liCreationTime.HighPart = ftCreationTime.dwHighDateTime;
+    liCreationTime.LowPart = ftCreationTime.dwLowDateTime;
+    ProcInfoContext->KernelTimeInMs.HighPart = ftKernelTime.dwHighDateTime;
+    ProcInfoContext->KernelTimeInMs.LowPart = ftKernelTime.dwLowDateTime;
+    ProcInfoContext->KernelTimeInMs.QuadPart = ProcInfoContext->KernelTimeInMs.QuadPart / (10 * 1000);
+    ProcInfoContext->UserTimeInMs.HighPart = ftUserTime.dwHighDateTime;
+    ProcInfoContext->UserTimeInMs.LowPart = ftUserTime.dwLowDateTime;
+    ProcInfoContext->UserTimeInMs.QuadPart = ProcInfoContext->UserTimeInMs.QuadPart / (10 * 1000);
+
+    GetSystemTimeAsFileTime(&ftNow);
+    liNow.HighPart = ftNow.dwHighDateTime;
+    liNow.LowPart = ftNow.dwLowDateTime;
+    GetLocalTime(&ProcInfoContext->SampleTime);
+
+    ProcInfoContext->ElapsedTimeInMs.QuadPart = (liNow.QuadPart - liCreationTime.QuadPart) / (10 * 1000);
+
+    if (DllNtDll.pNtQueryInformationProcess != NULL) {
+        DWORD Status;
+        DWORD dwBytesReturned;
+        Status = DllNtDll.pNtQueryInformationProcess(hProcess, ProcessVmCounters, &ProcInfoContext->VmInfo, sizeof(ProcInfoContext->VmInfo), &dwBytesReturned);
+        if (Status != 0) {
+            return FALSE;
+        }
+    }
+
+    if (DllKernel32.pGetProcessIoCounters != NULL) {
+        DllKernel32.pGetProcessIoCounters(hProcess, &ProcInfoContext->IoCounters);
+    }
+
+    return TRUE;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the procinfo builtin command.
@@ -297,25 +406,26 @@ ENTRYPOINT(
     )
 {
     BOOL ArgumentUnderstood;
+    BOOL Sampling;
     DWORD StartArg = 1;
     LONGLONG llTemp;
     DWORD CharsConsumed;
     DWORD Pid;
     DWORD i;
+    DWORD Interval;
+    DWORD SampleCount;
+    DWORD SampleIndex;
+    DWORD NextDeadline;
+    DWORD ExitCode;
+    DWORD Result;
     YORI_STRING Arg;
     YORI_STRING DisplayString;
     YORI_STRING AllocatedFormatString;
+    PYORI_STRING OutputFileName;
     PROCINFO_CONTEXT ProcInfoContext;
-    FILETIME ftCreationTime;
-    FILETIME ftExitTime;
-    FILETIME ftKernelTime;
-    FILETIME ftUserTime;
-    SYSTEMTIME stNow;
-    FILETIME ftNow;
-    LARGE_INTEGER liNow;
     HANDLE hProcess;
-
-    LARGE_INTEGER liCreationTime;
+    HANDLE hOutput;
+    HANDLE hTimer;
 
     LPTSTR DefaultFormatString = 
                                  _T("Commit size:     $COMMIT$ Kb\n")
@@ -325,9 +435,16 @@ ENTRYPOINT(
                                  _T("Elapsed time:    $ELAPSED$\n")
                                  _T("Working set:     $WORKINGSET$ Kb\n");
 
+    LPTSTR DefaultSampleFormatString = 
+                                 _T("$TIMESTAMP$,$CPUMS$,$CPUKERNELMS$,$CPUUSERMS$,$WORKINGSET$,$COMMIT$,$READBYTES$,$WRITEBYTES$,$OTHERIOBYTES$\n");
+
     YoriLibInitEmptyString(&AllocatedFormatString);
     YoriLibConstantString(&AllocatedFormatString, DefaultFormatString);
     ZeroMemory(&ProcInfoContext, sizeof(ProcInfoContext));
+    Sampling = FALSE;
+    Interval = 0;
+    SampleCount = 0;
+    OutputFileName = NULL;
 
     for (i = 1; i < ArgC; i++) {
 
@@ -349,6 +466,34 @@ ENTRYPOINT(
                     ArgumentUnderstood = TRUE;
                     i++;
                 }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("i")) == 0) {
+                if (ArgC > i + 1 &&
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &llTemp, &CharsConsumed) &&
+                    CharsConsumed > 0 &&
+                    llTemp > 0) {
+
+                    Interval = (DWORD)llTemp;
+                    Sampling = TRUE;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("n")) == 0) {
+                if (ArgC > i + 1 &&
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &llTemp, &CharsConsumed) &&
+                    CharsConsumed > 0 &&
+                    llTemp > 0) {
+
+                    SampleCount = (DWORD)llTemp;
+                    Sampling = TRUE;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("o")) == 0) {
+                if (ArgC > i + 1) {
+                    OutputFileName = &ArgV[i + 1];
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             }
         } else {
             ArgumentUnderstood = TRUE;
@@ -363,6 +508,7 @@ ENTRYPOINT(
 
     if (StartArg == 0 || StartArg >= ArgC) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("procinfo: missing argument\n"));
+        YoriLibFreeStringContents(&AllocatedFormatString);
         return EXIT_FAILURE;
     }
 
@@ -370,66 +516,140 @@ ENTRYPOINT(
         CharsConsumed == 0) {
 
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("procinfo: could not parse PID\n"));
+        YoriLibFreeStringContents(&AllocatedFormatString);
         return EXIT_FAILURE;
     }
 
     Pid = (DWORD)llTemp;
 
+    //
+    //  When sampling, default to one second between samples, and to a
+    //  format that produces one row per sample.
+    //
+
+    if (Sampling) {
+        if (Interval == 0) {
+            Interval = 1000;
+        }
+        if (AllocatedFormatString.StartOfString == DefaultFormatString) {
+            YoriLibConstantString(&AllocatedFormatString, DefaultSampleFormatString);
+        }
+    } else {
+        SampleCount = 1;
+    }
+
     hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, Pid);
     if (hProcess == NULL) {
         DWORD LastError = GetLastError();
         LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("procinfo: open process failed: %s"), ErrText);
         YoriLibFreeWinErrorText(ErrText);
+        YoriLibFreeStringContents(&AllocatedFormatString);
         return EXIT_FAILURE;
     }
 
+    hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (OutputFileName != NULL) {
+        YORI_STRING FullPath;
+
+        YoriLibInitEmptyString(&FullPath);
+        if (!YoriLibUserStringToSingleFilePath(OutputFileName, TRUE, &FullPath)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("procinfo: could not resolve %y\n"), OutputFileName);
+            CloseHandle(hProcess);
+            YoriLibFreeStringContents(&AllocatedFormatString);
+            return EXIT_FAILURE;
+        }
+
+        hOutput = CreateFile(FullPath.StartOfString, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hOutput == INVALID_HANDLE_VALUE) {
+            DWORD LastError = GetLastError();
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("procinfo: open of %y failed: %s"), &FullPath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            YoriLibFreeStringContents(&FullPath);
+            CloseHandle(hProcess);
+            YoriLibFreeStringContents(&AllocatedFormatString);
+            return EXIT_FAILURE;
+        }
+        YoriLibFreeStringContents(&FullPath);
+    }
+
+    YoriLibInitEmptyString(&DisplayString);
+
     //
-    //  Save off times from the process.
+    //  If sampling with the default format, start with a row describing
+    //  each column.
     //
 
-    GetProcessTimes(hProcess, &ftCreationTime, &ftExitTime, &ftKernelTime, &ftUserTime);
-    liCreationTime.HighPart = ftCreationTime.dwHighDateTime;
-    liCreationTime.LowPart = ftCreationTime.dwLowDateTime;
-    ProcInfoContext.KernelTimeInMs.HighPart = ftKernelTime.dwHighDateTime;
-    ProcInfoContext.KernelTimeInMs.LowPart = ftKernelTime.dwLowDateTime;
-    ProcInfoContext.KernelTimeInMs.QuadPart = ProcInfoContext.KernelTimeInMs.QuadPart / (10 * 1000);
-    ProcInfoContext.UserTimeInMs.HighPart = ftUserTime.dwHighDateTime;
-    ProcInfoContext.UserTimeInMs.LowPart = ftUserTime.dwLowDateTime;
-    ProcInfoContext.UserTimeInMs.QuadPart = ProcInfoContext.UserTimeInMs.QuadPart / (10 * 1000);
-
-    GetSystemTime(&stNow);
-    SystemTimeToFileTime(&stNow, &ftNow);
-    liNow.HighPart = ftNow.dwHighDateTime;
-    liNow.LowPart = ftNow.dwLowDateTime;
+    if (Sampling && AllocatedFormatString.StartOfString == DefaultSampleFormatString) {
+        YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, ProcInfoExpandVariableNames, NULL, &DisplayString);
+        if (DisplayString.StartOfString != NULL) {
+            YoriLibOutputString(hOutput, 0, &DisplayString);
+        }
+    }
 
-    ProcInfoContext.ElapsedTimeInMs.QuadPart = (liNow.QuadPart - liCreationTime.QuadPart) / (10 * 1000);
+    hTimer = NULL;
+    NextDeadline = 0;
+    if (Sampling) {
+        YoriLibCancelEnable();
+        hTimer = YoriLibCreatePeriodicTimer(Interval);
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        NextDeadline = GetTickCount() + Interval;
+    }
 
-    if (DllNtDll.pNtQueryInformationProcess != NULL) {
-        DWORD Status;
-        DWORD dwBytesReturned;
-        Status = DllNtDll.pNtQueryInformationProcess(hProcess, ProcessVmCounters, &ProcInfoContext.VmInfo, sizeof(ProcInfoContext.VmInfo), &dwBytesReturned);
-        if (Status != 0) {
-            CloseHandle(hProcess);
-            return FALSE;
+    //
+    //  Collect each sample with the same process handle, and reuse the
+    //  display buffer between samples.  Between samples this waits on a
+    //  timer so that it consumes no processor time.
+    //
+
+    Result = EXIT_SUCCESS;
+    for (SampleIndex = 0; SampleCount == 0 || SampleIndex < SampleCount; SampleIndex++) {
+
+        if (SampleIndex > 0 &&
+            !YoriLibWaitForPeriodicTimer(hTimer, Interval, &NextDeadline)) {
+
+            break;
+        }
+
+        if (!ProcInfoCollectSample(hProcess, &ProcInfoContext)) {
+            Result = EXIT_FAILURE;
+            break;
+        }
+
+        YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, ProcInfoExpandVariables, &ProcInfoContext, &DisplayString);
+        if (DisplayString.StartOfString != NULL) {
+            YoriLibOutputString(hOutput, 0, &DisplayString);
+        }
+
+        if (Sampling &&
+            GetExitCodeProcess(hProcess, &ExitCode) &&
+            ExitCode != STILL_ACTIVE) {
+
+            break;
         }
     }
 
-    if (DllKernel32.pGetProcessIoCounters != NULL) {
-        DllKernel32.pGetProcessIoCounters(hProcess, &ProcInfoContext.IoCounters);
+    if (Sampling) {
+        YoriLibCancelDisable();
     }
 
-    CloseHandle(hProcess);
+    if (hTimer != NULL) {
+        CloseHandle(hTimer);
+    }
 
-    YoriLibInitEmptyString(&DisplayString);
-    YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, ProcInfoExpandVariables, &ProcInfoContext, &DisplayString);
-    if (DisplayString.StartOfString != NULL) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
-        YoriLibFreeStringContents(&DisplayString);
+    if (OutputFileName != NULL) {
+        CloseHandle(hOutput);
     }
+
+    CloseHandle(hProcess);
+    YoriLibFreeStringContents(&DisplayString);
     YoriLibFreeStringContents(&AllocatedFormatString);
 
-    return EXIT_SUCCESS;
+    return Result;
 }
 
 // vim:sw=4:ts=4:et:
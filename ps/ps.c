@@ -36,10 +36,15 @@ CHAR strPsHelpText[] =
         "Display process list.\n"
         "\n"
         "PS [-license] [-a] [-f] [-l]\n"
+        "PS [-license] -t <seconds> [-s <column>]\n"
         "\n"
         "   -a             Display all processes\n"
         "   -f             Display full format including command line\n"
-        "   -l             Display long format including memory usage\n";
+        "   -l             Display long format including memory usage\n"
+        "   -s             Sort the continuous display by column, one of:\n"
+        "                    commit, cpu, io, name, pid, ws, wsdelta\n"
+        "   -t             Continuously display all processes, refreshing after the\n"
+        "                    specified number of seconds.  Press q to stop\n";
 
 /**
  Display usage text to the user.
@@ -93,6 +98,115 @@ PsOutputLargeInteger(
     return String.LengthInChars;
 }
 
+/**
+ The column that the live view should be sorted by.
+ */
+typedef enum _PS_SORT_ORDER {
+    PsSortProcessId = 0,
+    PsSortName,
+    PsSortCpu,
+    PsSortIo,
+    PsSortWorkingSet,
+    PsSortWorkingSetDelta,
+    PsSortCommit,
+    PsSortMax
+} PS_SORT_ORDER;
+
+/**
+ The name of each sort column as specified on the command line.
+ */
+CONST LPCTSTR PsSortNames[PsSortMax] = {
+    _T("pid"),
+    _T("name"),
+    _T("cpu"),
+    _T("io"),
+    _T("ws"),
+    _T("wsdelta"),
+    _T("commit")
+};
+
+/**
+ Information about a process carried from one sample of the live view to
+ the next, so that rates can be calculated from the difference between
+ consecutive samples.
+ */
+typedef struct _PS_PROCESS_SAMPLE {
+
+    /**
+     The entry for this process within the list of all tracked processes.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this process within the hash table of tracked processes,
+     keyed by process ID.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The process identifier.
+     */
+    DWORD_PTR ProcessId;
+
+    /**
+     The time the process was created.  This is used to detect a process ID
+     being reused by a new process between samples.
+     */
+    LARGE_INTEGER CreateTime;
+
+    /**
+     The total user and kernel time of the process as of the previous
+     sample.
+     */
+    LARGE_INTEGER PreviousCpuTime;
+
+    /**
+     The total number of bytes transferred by the process as of the
+     previous sample.
+     */
+    LARGE_INTEGER PreviousIoBytes;
+
+    /**
+     The working set of the process as of the previous sample.
+     */
+    SIZE_T PreviousWorkingSet;
+
+    /**
+     The sample number that last observed this process.  Processes not
+     observed in the most recent sample have exited.
+     */
+    DWORD Generation;
+
+    /**
+     Pointer to the information about the process in the most recent
+     sample.  This points into the process list buffer, so it is only valid
+     until the next sample is taken.
+     */
+    PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo;
+
+    /**
+     The percentage of system processor time consumed by the process since
+     the previous sample, in tenths of a percent.
+     */
+    DWORD CpuTenthsPercent;
+
+    /**
+     The number of bytes per second transferred by the process since the
+     previous sample.
+     */
+    LARGE_INTEGER IoBytesPerSecond;
+
+    /**
+     The change in working set since the previous sample.
+     */
+    LONGLONG WorkingSetDelta;
+
+    /**
+     Buffer for the hash table key, which is the process ID in string form.
+     */
+    TCHAR KeyBuffer[20];
+} PS_PROCESS_SAMPLE, *PPS_PROCESS_SAMPLE;
+
 /**
  Context about process enumeration tasks to perform.
  */
@@ -108,6 +222,76 @@ typedef struct _PS_CONTEXT {
      */
     BOOL DisplayMemory;
 
+    /**
+     TRUE if the live view is being displayed to a console, so each sample
+     should redraw the window rather than being appended to the output.
+     */
+    BOOL LiveViewToConsole;
+
+    /**
+     The column to sort the live view by.
+     */
+    PS_SORT_ORDER SortOrder;
+
+    /**
+     The interval between samples of the live view, in milliseconds.  Zero
+     if a single snapshot should be displayed.
+     */
+    DWORD RefreshInterval;
+
+    /**
+     The number of processors in the system, used to express processor
+     usage as a fraction of the whole system.
+     */
+    DWORD ProcessorCount;
+
+    /**
+     TRUE if the system reports I/O counters as part of process information.
+     */
+    BOOL IoCountersValid;
+
+    /**
+     The number of samples taken by the live view.
+     */
+    DWORD Generation;
+
+    /**
+     The system time when the previous sample was taken.
+     */
+    LARGE_INTEGER PreviousSampleTime;
+
+    /**
+     The buffer containing the most recent process list.  This is retained
+     between samples to avoid reallocating it each time.
+     */
+    PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo;
+
+    /**
+     The size of the ProcessInfo buffer, in bytes.
+     */
+    DWORD ProcessInfoBytes;
+
+    /**
+     A list of processes observed by the live view.
+     */
+    YORI_LIST_ENTRY SampleList;
+
+    /**
+     A hash table of processes observed by the live view, keyed by process
+     ID.
+     */
+    PYORI_HASH_TABLE SampleHash;
+
+    /**
+     An array of processes in the most recent sample, in display order.
+     */
+    PPS_PROCESS_SAMPLE *SortedSamples;
+
+    /**
+     The number of elements allocated in the SortedSamples array.
+     */
+    DWORD SortedSamplesAllocated;
+
 } PS_CONTEXT, *PPS_CONTEXT;
 
 /**
@@ -475,6 +659,678 @@ PsDisplayConsoleProcesses(
     return TRUE;
 }
 
+/**
+ Find the sample describing a process observed by a previous sample of the
+ live view.
+
+ @param PsContext Pointer to the ps context.
+
+ @param ProcessId The process ID to find.
+
+ @return Pointer to the sample, or NULL if the process was not observed
+         previously.
+ */
+PPS_PROCESS_SAMPLE
+PsFindProcessSample(
+    __in PPS_CONTEXT PsContext,
+    __in DWORD_PTR ProcessId
+    )
+{
+    TCHAR KeyBuffer[20];
+    YORI_STRING Key;
+    PYORI_HASH_ENTRY HashEntry;
+
+    YoriLibInitEmptyString(&Key);
+    Key.StartOfString = KeyBuffer;
+    Key.LengthAllocated = sizeof(KeyBuffer)/sizeof(KeyBuffer[0]);
+    Key.LengthInChars = YoriLibSPrintf(KeyBuffer, _T("%x"), (DWORD)ProcessId);
+
+    HashEntry = YoriLibHashLookupByKey(PsContext->SampleHash, &Key);
+    if (HashEntry == NULL) {
+        return NULL;
+    }
+
+    return (PPS_PROCESS_SAMPLE)HashEntry->Context;
+}
+
+/**
+ Allocate a sample for a process not observed by a previous sample of the
+ live view and start tracking it.
+
+ @param PsContext Pointer to the ps context.
+
+ @param ProcessId The process ID to track.
+
+ @return Pointer to the sample, or NULL on allocation failure.
+ */
+PPS_PROCESS_SAMPLE
+PsTrackProcessSample(
+    __in PPS_CONTEXT PsContext,
+    __in DWORD_PTR ProcessId
+    )
+{
+    PPS_PROCESS_SAMPLE Sample;
+    YORI_STRING Key;
+
+    Sample = YoriLibMalloc(sizeof(PS_PROCESS_SAMPLE));
+    if (Sample == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Sample, sizeof(PS_PROCESS_SAMPLE));
+    Sample->ProcessId = ProcessId;
+
+    YoriLibInitEmptyString(&Key);
+    Key.StartOfString = Sample->KeyBuffer;
+    Key.LengthAllocated = sizeof(Sample->KeyBuffer)/sizeof(Sample->KeyBuffer[0]);
+    Key.LengthInChars = YoriLibSPrintf(Sample->KeyBuffer, _T("%x"), (DWORD)ProcessId);
+
+    YoriLibHashInsertByKey(PsContext->SampleHash, &Key, Sample, &Sample->HashEntry);
+    YoriLibAppendList(&PsContext->SampleList, &Sample->ListEntry);
+    return Sample;
+}
+
+/**
+ Stop tracking a process in the live view and free its sample.
+
+ @param Sample Pointer to the sample to free.
+ */
+VOID
+PsFreeProcessSample(
+    __in PPS_PROCESS_SAMPLE Sample
+    )
+{
+    YoriLibHashRemoveByEntry(&Sample->HashEntry);
+    YoriLibRemoveListItem(&Sample->ListEntry);
+    YoriLibFree(Sample);
+}
+
+/**
+ Return the number of bytes transferred by a process.
+
+ @param PsContext Pointer to the ps context.
+
+ @param ProcessInfo Pointer to information about the process.
+
+ @return The number of bytes transferred by the process, or zero if the
+         system does not report this information.
+ */
+LONGLONG
+PsGetProcessIoBytes(
+    __in PPS_CONTEXT PsContext,
+    __in PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo
+    )
+{
+    if (!PsContext->IoCountersValid) {
+        return 0;
+    }
+
+    return ProcessInfo->ReadTransferCount.QuadPart +
+           ProcessInfo->WriteTransferCount.QuadPart +
+           ProcessInfo->OtherTransferCount.QuadPart;
+}
+
+/**
+ Update a process sample with information from the most recent process
+ list, calculating the change since the previous sample.
+
+ @param PsContext Pointer to the ps context.
+
+ @param Sample Pointer to the sample to update.
+
+ @param ProcessInfo Pointer to information about the process in the most
+        recent process list.
+
+ @param ElapsedTime The time since the previous sample, in 100ns units.
+        This is zero if there is no previous sample.
+ */
+VOID
+PsUpdateProcessSample(
+    __in PPS_CONTEXT PsContext,
+    __in PPS_PROCESS_SAMPLE Sample,
+    __in PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo,
+    __in LONGLONG ElapsedTime
+    )
+{
+    LARGE_INTEGER CpuTime;
+    LARGE_INTEGER IoBytes;
+    BOOL PreviousValid;
+
+    CpuTime.QuadPart = ProcessInfo->KernelTime.QuadPart + ProcessInfo->UserTime.QuadPart;
+    IoBytes.QuadPart = PsGetProcessIoBytes(PsContext, ProcessInfo);
+
+    //
+    //  If this process wasn't seen before, or the process ID now refers to
+    //  a different process, there's nothing to compare against.
+    //
+
+    PreviousValid = FALSE;
+    if (Sample->Generation != 0 &&
+        Sample->CreateTime.QuadPart == ProcessInfo->CreateTime.QuadPart) {
+
+        PreviousValid = TRUE;
+    }
+
+    Sample->CpuTenthsPercent = 0;
+    Sample->IoBytesPerSecond.QuadPart = 0;
+    Sample->WorkingSetDelta = 0;
+
+    if (PreviousValid && ElapsedTime > 0) {
+        if (CpuTime.QuadPart > Sample->PreviousCpuTime.QuadPart) {
+            Sample->CpuTenthsPercent = (DWORD)((CpuTime.QuadPart - Sample->PreviousCpuTime.QuadPart) * 1000 / (ElapsedTime * PsContext->ProcessorCount));
+            if (Sample->CpuTenthsPercent > 1000) {
+                Sample->CpuTenthsPercent = 1000;
+            }
+        }
+        if (IoBytes.QuadPart > Sample->PreviousIoBytes.QuadPart) {
+            Sample->IoBytesPerSecond.QuadPart = (IoBytes.QuadPart - Sample->PreviousIoBytes.QuadPart) * 10 * 1000 * 1000 / ElapsedTime;
+        }
+        Sample->WorkingSetDelta = (LONGLONG)ProcessInfo->WorkingSetSize - (LONGLONG)Sample->PreviousWorkingSet;
+    }
+
+    Sample->CreateTime.QuadPart = ProcessInfo->CreateTime.QuadPart;
+    Sample->PreviousCpuTime.QuadPart = CpuTime.QuadPart;
+    Sample->PreviousIoBytes.QuadPart = IoBytes.QuadPart;
+    Sample->PreviousWorkingSet = ProcessInfo->WorkingSetSize;
+    Sample->ProcessInfo = ProcessInfo;
+    Sample->Generation = PsContext->Generation;
+}
+
+/**
+ Determine whether one process should be displayed before another in the
+ live view.
+
+ @param PsContext Pointer to the ps context specifying the sort order.
+
+ @param First Pointer to the first process.
+
+ @param Second Pointer to the second process.
+
+ @return TRUE if the first process should be displayed before the second,
+         FALSE if not.
+ */
+BOOL
+PsIsSampleBefore(
+    __in PPS_CONTEXT PsContext,
+    __in PPS_PROCESS_SAMPLE First,
+    __in PPS_PROCESS_SAMPLE Second
+    )
+{
+    YORI_STRING FirstName;
+    YORI_STRING SecondName;
+
+    switch(PsContext->SortOrder) {
+        case PsSortName:
+            YoriLibInitEmptyString(&FirstName);
+            FirstName.StartOfString = First->ProcessInfo->ImageName;
+            FirstName.LengthInChars = First->ProcessInfo->ImageNameLengthInBytes / sizeof(WCHAR);
+            YoriLibInitEmptyString(&SecondName);
+            SecondName.StartOfString = Second->ProcessInfo->ImageName;
+            SecondName.LengthInChars = Second->ProcessInfo->ImageNameLengthInBytes / sizeof(WCHAR);
+            return (YoriLibCompareStringInsensitive(&FirstName, &SecondName) < 0);
+        case PsSortCpu:
+            return (First->CpuTenthsPercent > Second->CpuTenthsPercent);
+        case PsSortIo:
+            return (First->IoBytesPerSecond.QuadPart > Second->IoBytesPerSecond.QuadPart);
+        case PsSortWorkingSet:
+            return (First->ProcessInfo->WorkingSetSize > Second->ProcessInfo->WorkingSetSize);
+        case PsSortWorkingSetDelta:
+            return (First->WorkingSetDelta > Second->WorkingSetDelta);
+        case PsSortCommit:
+            return (First->ProcessInfo->CommitSize > Second->ProcessInfo->CommitSize);
+    }
+
+    return (First->ProcessId < Second->ProcessId);
+}
+
+/**
+ Take a sample of all processes in the system, calculate the change from the
+ previous sample, and populate the sorted array of processes to display.
+
+ @param PsContext Pointer to the ps context.
+
+ @param SampleCount On successful completion, updated to contain the number
+        of processes in the sorted array.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+PsTakeLiveSample(
+    __in PPS_CONTEXT PsContext,
+    __out PDWORD SampleCount
+    )
+{
+    PYORI_SYSTEM_PROCESS_INFORMATION CurrentEntry;
+    PPS_PROCESS_SAMPLE Sample;
+    PYORI_LIST_ENTRY ListEntry;
+    FILETIME SystemTime;
+    LARGE_INTEGER SampleTime;
+    LONGLONG ElapsedTime;
+    DWORD ProcessCount;
+    DWORD InsertIndex;
+
+    if (!YoriLibRefreshSystemProcessList(&PsContext->ProcessInfo, &PsContext->ProcessInfoBytes)) {
+        return FALSE;
+    }
+
+    GetSystemTimeAsFileTime(&SystemTime);
+    SampleTime.LowPart = SystemTime.dwLowDateTime;
+    SampleTime.HighPart = SystemTime.dwHighDateTime;
+    ElapsedTime = 0;
+    if (PsContext->Generation > 0) {
+        ElapsedTime = SampleTime.QuadPart - PsContext->PreviousSampleTime.QuadPart;
+    }
+    PsContext->PreviousSampleTime.QuadPart = SampleTime.QuadPart;
+    PsContext->Generation++;
+
+    //
+    //  Make sure the sorted array can describe every process in this
+    //  sample.
+    //
+
+    ProcessCount = 0;
+    CurrentEntry = PsContext->ProcessInfo;
+    do {
+        ProcessCount++;
+        if (CurrentEntry->NextEntryOffset == 0) {
+            break;
+        }
+        CurrentEntry = YoriLibAddToPointer(CurrentEntry, CurrentEntry->NextEntryOffset);
+    } while(TRUE);
+
+    if (ProcessCount > PsContext->SortedSamplesAllocated) {
+        if (PsContext->SortedSamples != NULL) {
+            YoriLibFree(PsContext->SortedSamples);
+        }
+        PsContext->SortedSamplesAllocated = 0;
+        PsContext->SortedSamples = YoriLibMalloc((ProcessCount + 64) * sizeof(PPS_PROCESS_SAMPLE));
+        if (PsContext->SortedSamples == NULL) {
+            return FALSE;
+        }
+        PsContext->SortedSamplesAllocated = ProcessCount + 64;
+    }
+
+    //
+    //  Match each process against the previous sample, and insert it into
+    //  the array in display order.
+    //
+
+    ProcessCount = 0;
+    CurrentEntry = PsContext->ProcessInfo;
+    do {
+        Sample = PsFindProcessSample(PsContext, CurrentEntry->ProcessId);
+        if (Sample == NULL) {
+            Sample = PsTrackProcessSample(PsContext, CurrentEntry->ProcessId);
+        }
+
+        if (Sample != NULL && Sample->Generation != PsContext->Generation) {
+            PsUpdateProcessSample(PsContext, Sample, CurrentEntry, ElapsedTime);
+
+            InsertIndex = ProcessCount;
+            while (InsertIndex > 0 &&
+                   PsIsSampleBefore(PsContext, Sample, PsContext->SortedSamples[InsertIndex - 1])) {
+
+                PsContext->SortedSamples[InsertIndex] = PsContext->SortedSamples[InsertIndex - 1];
+                InsertIndex--;
+            }
+            PsContext->SortedSamples[InsertIndex] = Sample;
+            ProcessCount++;
+        }
+
+        if (CurrentEntry->NextEntryOffset == 0) {
+            break;
+        }
+        CurrentEntry = YoriLibAddToPointer(CurrentEntry, CurrentEntry->NextEntryOffset);
+    } while(TRUE);
+
+    //
+    //  Anything not observed in this sample has exited.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&PsContext->SampleList, NULL);
+    while (ListEntry != NULL) {
+        Sample = CONTAINING_RECORD(ListEntry, PS_PROCESS_SAMPLE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&PsContext->SampleList, ListEntry);
+        if (Sample->Generation != PsContext->Generation) {
+            PsFreeProcessSample(Sample);
+        }
+    }
+
+    *SampleCount = ProcessCount;
+    return TRUE;
+}
+
+/**
+ Display a single process in the live view.
+
+ @param Sample Pointer to the process to display.
+ */
+VOID
+PsDisplayLiveSample(
+    __in PPS_PROCESS_SAMPLE Sample
+    )
+{
+    PYORI_SYSTEM_PROCESS_INFORMATION ProcessInfo;
+    YORI_STRING BaseName;
+    YORI_STRING IoString;
+    YORI_STRING WorkingSetString;
+    YORI_STRING DeltaString;
+    YORI_STRING CommitString;
+    TCHAR IoStringBuffer[6];
+    TCHAR WorkingSetStringBuffer[6];
+    TCHAR DeltaStringBuffer[6];
+    TCHAR CommitStringBuffer[6];
+    LARGE_INTEGER Value;
+    TCHAR DeltaSign;
+
+    ProcessInfo = Sample->ProcessInfo;
+
+    YoriLibInitEmptyString(&BaseName);
+    BaseName.StartOfString = ProcessInfo->ImageName;
+    BaseName.LengthInChars = ProcessInfo->ImageNameLengthInBytes / sizeof(WCHAR);
+
+    if (BaseName.LengthInChars == 0 && ProcessInfo->ProcessId == 0) {
+        YoriLibConstantString(&BaseName, _T("Idle"));
+    }
+
+    YoriLibInitEmptyString(&IoString);
+    IoString.StartOfString = IoStringBuffer;
+    IoString.LengthAllocated = sizeof(IoStringBuffer)/sizeof(IoStringBuffer[0]);
+    YoriLibFileSizeToString(&IoString, &Sample->IoBytesPerSecond);
+
+    YoriLibInitEmptyString(&WorkingSetString);
+    WorkingSetString.StartOfString = WorkingSetStringBuffer;
+    WorkingSetString.LengthAllocated = sizeof(WorkingSetStringBuffer)/sizeof(WorkingSetStringBuffer[0]);
+    Value.QuadPart = ProcessInfo->WorkingSetSize;
+    YoriLibFileSizeToString(&WorkingSetString, &Value);
+
+    YoriLibInitEmptyString(&DeltaString);
+    DeltaString.StartOfString = DeltaStringBuffer;
+    DeltaString.LengthAllocated = sizeof(DeltaStringBuffer)/sizeof(DeltaStringBuffer[0]);
+    if (Sample->WorkingSetDelta < 0) {
+        DeltaSign = '-';
+        Value.QuadPart = -Sample->WorkingSetDelta;
+    } else if (Sample->WorkingSetDelta > 0) {
+        DeltaSign = '+';
+        Value.QuadPart = Sample->WorkingSetDelta;
+    } else {
+        DeltaSign = ' ';
+        Value.QuadPart = 0;
+    }
+    YoriLibFileSizeToString(&DeltaString, &Value);
+
+    YoriLibInitEmptyString(&CommitString);
+    CommitString.StartOfString = CommitStringBuffer;
+    CommitString.LengthAllocated = sizeof(CommitStringBuffer)/sizeof(CommitStringBuffer[0]);
+    Value.QuadPart = ProcessInfo->CommitSize;
+    YoriLibFileSizeToString(&CommitString, &Value);
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-6i | %-15y | %3i.%i%% | %-6y | %-10y | %c%-6y | %-10y\n"), ProcessInfo->ProcessId, &BaseName, Sample->CpuTenthsPercent / 10, Sample->CpuTenthsPercent % 10, &IoString, &WorkingSetString, DeltaSign, &DeltaString, &CommitString);
+}
+
+/**
+ Display the most recent sample of the live view.  When displaying to a
+ console, the window is redrawn in place and the number of processes is
+ limited to what fits in the window.
+
+ @param PsContext Pointer to the ps context.
+
+ @param SampleCount The number of processes in the sorted array.
+ */
+VOID
+PsDisplayLiveView(
+    __in PPS_CONTEXT PsContext,
+    __in DWORD SampleCount
+    )
+{
+    CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
+    HANDLE hConsole;
+    COORD Origin;
+    DWORD DisplayCount;
+    DWORD CharsToClear;
+    DWORD CharsWritten;
+    DWORD Index;
+
+    DisplayCount = SampleCount;
+    hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    //
+    //  Move to the top of the window and leave room for the summary,
+    //  header, and a blank line at the bottom.
+    //
+
+    if (PsContext->LiveViewToConsole &&
+        GetConsoleScreenBufferInfo(hConsole, &ScreenInfo)) {
+
+        Origin.X = ScreenInfo.srWindow.Left;
+        Origin.Y = ScreenInfo.srWindow.Top;
+        SetConsoleCursorPosition(hConsole, Origin);
+        if ((DWORD)(ScreenInfo.srWindow.Bottom - ScreenInfo.srWindow.Top) < DisplayCount + 2) {
+            DisplayCount = ScreenInfo.srWindow.Bottom - ScreenInfo.srWindow.Top;
+            if (DisplayCount >= 2) {
+                DisplayCount = DisplayCount - 2;
+            } else {
+                DisplayCount = 0;
+            }
+        }
+    }
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%i processes, sorted by %s, refreshing every %i seconds\n"), SampleCount, PsSortNames[PsContext->SortOrder], PsContext->RefreshInterval / 1000);
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("  Pid  | Process         |  Cpu%%  | Io/s   | WorkingSet | WsDelta | Commit\n"));
+    for (Index = 0; Index < DisplayCount; Index++) {
+        PsDisplayLiveSample(PsContext->SortedSamples[Index]);
+    }
+
+    //
+    //  Clear anything left from the previous sample.  Each line is a fixed
+    //  width, so this only needs to clear the rest of the window below the
+    //  output.
+    //
+
+    if (PsContext->LiveViewToConsole) {
+        if (GetConsoleScreenBufferInfo(hConsole, &ScreenInfo) &&
+            ScreenInfo.dwCursorPosition.Y <= ScreenInfo.srWindow.Bottom) {
+
+            CharsToClear = (ScreenInfo.srWindow.Bottom - ScreenInfo.dwCursorPosition.Y + 1) * ScreenInfo.dwSize.X - ScreenInfo.dwCursorPosition.X;
+            FillConsoleOutputCharacter(hConsole, ' ', CharsToClear, ScreenInfo.dwCursorPosition, &CharsWritten);
+            FillConsoleOutputAttribute(hConsole, ScreenInfo.wAttributes, CharsToClear, ScreenInfo.dwCursorPosition, &CharsWritten);
+        }
+    } else {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n"));
+    }
+}
+
+/**
+ Clear the console window before drawing the live view, so that text from
+ before the live view started is not left beside it.
+ */
+VOID
+PsClearConsoleWindow(VOID)
+{
+    CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
+    HANDLE hConsole;
+    COORD Origin;
+    DWORD CharsToClear;
+    DWORD CharsWritten;
+
+    hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (!GetConsoleScreenBufferInfo(hConsole, &ScreenInfo)) {
+        return;
+    }
+
+    Origin.X = 0;
+    Origin.Y = ScreenInfo.srWindow.Top;
+    CharsToClear = (ScreenInfo.srWindow.Bottom - ScreenInfo.srWindow.Top + 1) * ScreenInfo.dwSize.X;
+    FillConsoleOutputCharacter(hConsole, ' ', CharsToClear, Origin, &CharsWritten);
+    FillConsoleOutputAttribute(hConsole, ScreenInfo.wAttributes, CharsToClear, Origin, &CharsWritten);
+}
+
+/**
+ Wait for the interval between samples of the live view to elapse.
+
+ @param PsContext Pointer to the ps context.
+
+ @return TRUE if the interval elapsed and another sample should be taken,
+         FALSE if the user asked to stop.
+ */
+BOOL
+PsWaitForNextSample(
+    __in PPS_CONTEXT PsContext
+    )
+{
+    HANDLE WaitHandles[2];
+    DWORD HandleCount;
+    DWORD WaitResult;
+    DWORD StartTime;
+    DWORD Elapsed;
+    DWORD ConsoleMode;
+    INPUT_RECORD InputRecord;
+    DWORD RecordsRead;
+    HANDLE hConIn;
+
+    HandleCount = 0;
+    WaitHandles[HandleCount++] = YoriLibCancelGetEvent();
+    hConIn = GetStdHandle(STD_INPUT_HANDLE);
+    if (GetConsoleMode(hConIn, &ConsoleMode)) {
+        WaitHandles[HandleCount++] = hConIn;
+    }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    StartTime = GetTickCount();
+    while (TRUE) {
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        Elapsed = GetTickCount() - StartTime;
+        if (Elapsed >= PsContext->RefreshInterval) {
+            return TRUE;
+        }
+
+        WaitResult = WaitForMultipleObjects(HandleCount, WaitHandles, FALSE, PsContext->RefreshInterval - Elapsed);
+        if (WaitResult == WAIT_TIMEOUT) {
+            return TRUE;
+        }
+
+        if (WaitResult != WAIT_OBJECT_0 + 1) {
+            return FALSE;
+        }
+
+        //
+        //  Console input arrived.  Consume it, and stop if it's a request
+        //  to quit.
+        //
+
+        if (!ReadConsoleInput(hConIn, &InputRecord, 1, &RecordsRead)) {
+            return FALSE;
+        }
+
+        if (RecordsRead > 0 &&
+            InputRecord.EventType == KEY_EVENT &&
+            InputRecord.Event.KeyEvent.bKeyDown) {
+
+            if (InputRecord.Event.KeyEvent.wVirtualKeyCode == VK_ESCAPE ||
+                InputRecord.Event.KeyEvent.uChar.UnicodeChar == 'q' ||
+                InputRecord.Event.KeyEvent.uChar.UnicodeChar == 'Q') {
+
+                return FALSE;
+            }
+        }
+    }
+}
+
+/**
+ Repeatedly display information about all processes, including processor
+ usage, I/O rate and working set change between samples, until the user
+ stops it.
+
+ @param PsContext Pointer to the ps context.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+PsDisplayLiveProcesses(
+    __in PPS_CONTEXT PsContext
+    )
+{
+    SYSTEM_INFO SystemInfo;
+    PPS_PROCESS_SAMPLE Sample;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD SampleCount;
+    DWORD MajorVersion;
+    DWORD MinorVersion;
+    DWORD BuildNumber;
+    DWORD ConsoleMode;
+    BOOL Result;
+
+    GetSystemInfo(&SystemInfo);
+    PsContext->ProcessorCount = SystemInfo.dwNumberOfProcessors;
+    if (PsContext->ProcessorCount == 0) {
+        PsContext->ProcessorCount = 1;
+    }
+
+    YoriLibGetOsVersion(&MajorVersion, &MinorVersion, &BuildNumber);
+    if (MajorVersion >= 5) {
+        PsContext->IoCountersValid = TRUE;
+    }
+
+    PsContext->SampleHash = YoriLibAllocateHashTable(250);
+    if (PsContext->SampleHash == NULL) {
+        return FALSE;
+    }
+    YoriLibInitializeListHead(&PsContext->SampleList);
+
+    if (GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &ConsoleMode)) {
+        PsContext->LiveViewToConsole = TRUE;
+        PsClearConsoleWindow();
+    }
+
+    YoriLibCancelEnable();
+
+    Result = TRUE;
+    while (TRUE) {
+        if (!PsTakeLiveSample(PsContext, &SampleCount)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("ps: could not query process list\n"));
+            Result = FALSE;
+            break;
+        }
+
+        PsDisplayLiveView(PsContext, SampleCount);
+
+        if (!PsWaitForNextSample(PsContext)) {
+            break;
+        }
+    }
+
+    YoriLibCancelDisable();
+
+    ListEntry = YoriLibGetNextListEntry(&PsContext->SampleList, NULL);
+    while (ListEntry != NULL) {
+        Sample = CONTAINING_RECORD(ListEntry, PS_PROCESS_SAMPLE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&PsContext->SampleList, ListEntry);
+        PsFreeProcessSample(Sample);
+    }
+    YoriLibFreeEmptyHashTable(PsContext->SampleHash);
+    PsContext->SampleHash = NULL;
+
+    if (PsContext->SortedSamples != NULL) {
+        YoriLibFree(PsContext->SortedSamples);
+        PsContext->SortedSamples = NULL;
+    }
+
+    if (PsContext->ProcessInfo != NULL) {
+        YoriLibFree(PsContext->ProcessInfo);
+        PsContext->ProcessInfo = NULL;
+    }
+
+    return Result;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the ps builtin command.
@@ -509,8 +1365,12 @@ ENTRYPOINT(
     YORI_STRING Arg;
     BOOL DisplayAll;
     PS_CONTEXT PsContext;
+    LONGLONG Interval;
+    DWORD CharsConsumed;
+    DWORD Index;
 
     ZeroMemory(&PsContext, sizeof(PsContext));
+    PsContext.SortOrder = PsSortCpu;
     DisplayAll = FALSE;
 
     for (i = 1; i < ArgC; i++) {
@@ -535,6 +1395,27 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
                 PsContext.DisplayMemory = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("s")) == 0) {
+                if (ArgC > i + 1) {
+                    for (Index = 0; Index < PsSortMax; Index++) {
+                        if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], PsSortNames[Index]) == 0) {
+                            PsContext.SortOrder = (PS_SORT_ORDER)Index;
+                            ArgumentUnderstood = TRUE;
+                            i++;
+                            break;
+                        }
+                    }
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("t")) == 0) {
+                if (ArgC > i + 1 &&
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &Interval, &CharsConsumed) &&
+                    CharsConsumed > 0 &&
+                    Interval > 0) {
+
+                    PsContext.RefreshInterval = (DWORD)Interval * 1000;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             }
         } else {
             ArgumentUnderstood = TRUE;
@@ -547,7 +1428,11 @@ ENTRYPOINT(
         }
     }
 
-    if (DisplayAll) {
+    if (PsContext.RefreshInterval != 0) {
+        if (!PsDisplayLiveProcesses(&PsContext)) {
+            return EXIT_FAILURE;
+        }
+    } else if (DisplayAll) {
         PsDisplayAllProcesses(&PsContext);
     } else {
         PsDisplayConsoleProcesses(&PsContext);
@@ -66,10 +66,64 @@ typedef struct _YORI_ALIAS {
 YORI_LIST_ENTRY YoriShAliasesList;
 
 /**
- Hashtable of aliases currently registered with Yori.
+ Hashtable of aliases currently registered with Yori.  The list above
+ retains the order aliases were defined in for display, and this table is
+ used for all lookups by name.
  */
 PYORI_HASH_TABLE YoriShAliasesHash;
 
+/**
+ The number of buckets in the alias hash table.
+ */
+#define YORI_SH_ALIAS_HASH_BUCKETS 250
+
+/**
+ The number of characters needed to describe all user defined aliases in
+ the form returned by @ref YoriShGetAliasStrings , excluding the final
+ terminator.
+ */
+DWORD YoriShAliasesUserChars;
+
+/**
+ The number of characters needed to describe all internal aliases in the
+ form returned by @ref YoriShGetAliasStrings , excluding the final
+ terminator.
+ */
+DWORD YoriShAliasesInternalChars;
+
+/**
+ Update the number of characters needed to describe the set of aliases
+ following the insertion or removal of an alias.
+
+ @param Alias Pointer to the alias being inserted or removed.
+
+ @param Inserting TRUE if the alias is being inserted, FALSE if it is being
+        removed.
+ */
+VOID
+YoriShUpdateAliasCharCount(
+    __in PYORI_ALIAS Alias,
+    __in BOOL Inserting
+    )
+{
+    DWORD CharsForAlias;
+
+    CharsForAlias = Alias->Alias.LengthInChars + Alias->Value.LengthInChars + 2;
+    if (Alias->Internal) {
+        if (Inserting) {
+            YoriShAliasesInternalChars += CharsForAlias;
+        } else {
+            YoriShAliasesInternalChars -= CharsForAlias;
+        }
+    } else {
+        if (Inserting) {
+            YoriShAliasesUserChars += CharsForAlias;
+        } else {
+            YoriShAliasesUserChars -= CharsForAlias;
+        }
+    }
+}
+
 /**
  The app name to use when asking conhost for alias information.  Note this
  really has nothing to do with the actual binary name.
@@ -113,6 +167,7 @@ YoriShDeleteAlias(
     if (!ExistingAlias->Internal && DllKernel32.pAddConsoleAliasW) {
         DllKernel32.pAddConsoleAliasW(ExistingAlias->Alias.StartOfString, NULL, ALIAS_APP_NAME);
     }
+    YoriShUpdateAliasCharCount(ExistingAlias, FALSE);
     YoriLibRemoveListItem(&ExistingAlias->ListEntry);
     YoriLibFreeStringContents(&ExistingAlias->Alias);
     YoriLibFreeStringContents(&ExistingAlias->Value);
@@ -160,7 +215,7 @@ YoriShAddAlias(
         YoriShDeleteAlias(Alias);
     } else {
         YoriLibInitializeListHead(&YoriShAliasesList);
-        YoriShAliasesHash = YoriLibAllocateHashTable(250);
+        YoriShAliasesHash = YoriLibAllocateHashTable(YORI_SH_ALIAS_HASH_BUCKETS);
         if (YoriShAliasesHash == NULL) {
             return FALSE;
         }
@@ -198,6 +253,7 @@ YoriShAddAlias(
 
     YoriLibAppendList(&YoriShAliasesList, &NewAlias->ListEntry);
     YoriLibHashInsertByKey(YoriShAliasesHash, &NewAlias->Alias, NewAlias, &NewAlias->HashEntry);
+    YoriShUpdateAliasCharCount(NewAlias, TRUE);
     
     return TRUE;
 }
@@ -373,6 +429,8 @@ YoriShClearAllAliases()
 
     YoriLibFreeEmptyHashTable(YoriShAliasesHash);
     YoriShAliasesHash = NULL;
+    YoriShAliasesUserChars = 0;
+    YoriShAliasesInternalChars = 0;
 }
 
 /**
@@ -404,25 +462,16 @@ YoriShGetAliasStrings(
     DWORD StringOffset;
     BOOLEAN IncludeThisEntry;
 
-    if (YoriShAliasesList.Next != NULL) {
-        ListEntry = YoriLibGetNextListEntry(&YoriShAliasesList, NULL);
-        while (ListEntry != NULL) {
-            Alias = CONTAINING_RECORD(ListEntry, YORI_ALIAS, ListEntry);
-            IncludeThisEntry = FALSE;
-            if (Alias->Internal) {
-                if (IncludeFlags & YORI_SH_GET_ALIAS_STRINGS_INCLUDE_INTERNAL) {
-                    IncludeThisEntry = TRUE;
-                }
-            } else {
-                if (IncludeFlags & YORI_SH_GET_ALIAS_STRINGS_INCLUDE_USER) {
-                    IncludeThisEntry = TRUE;
-                }
-            }
-            if (IncludeThisEntry) {
-                CharsNeeded += Alias->Alias.LengthInChars + Alias->Value.LengthInChars + 2;
-            }
-            ListEntry = YoriLibGetNextListEntry(&YoriShAliasesList, ListEntry);
-        }
+    //
+    //  The size of each set of aliases is maintained as aliases are added
+    //  and removed, so only one pass over the list is needed.
+    //
+
+    if (IncludeFlags & YORI_SH_GET_ALIAS_STRINGS_INCLUDE_INTERNAL) {
+        CharsNeeded += YoriShAliasesInternalChars;
+    }
+    if (IncludeFlags & YORI_SH_GET_ALIAS_STRINGS_INCLUDE_USER) {
+        CharsNeeded += YoriShAliasesUserChars;
     }
 
     CharsNeeded += 1;
@@ -622,28 +671,133 @@ YoriShGetSystemAliasStrings(
 }
 
 /**
- Find an alias with a specified name within a list of NULL terminated strings.
+ A single alias found within a NULL terminated list of alias strings.
+ */
+typedef struct _YORI_SH_ALIAS_STRING {
+
+    /**
+     The entry of this alias within a hash table of alias strings, keyed by
+     the alias name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the alias.  This points into the list of alias strings.
+     */
+    YORI_STRING AliasName;
+
+    /**
+     The value of the alias.  This points into the list of alias strings.
+     */
+    YORI_STRING AliasValue;
+} YORI_SH_ALIAS_STRING, *PYORI_SH_ALIAS_STRING;
+
+/**
+ A set of aliases parsed from a NULL terminated list of alias strings, along
+ with a hash table to find each by name.
+ */
+typedef struct _YORI_SH_ALIAS_STRING_SET {
+
+    /**
+     A hash table of the aliases in the set.
+     */
+    PYORI_HASH_TABLE HashTable;
+
+    /**
+     An array of aliases in the set, in the order they were found.
+     */
+    PYORI_SH_ALIAS_STRING Entries;
+
+    /**
+     The number of elements in the Entries array.
+     */
+    DWORD EntryCount;
+} YORI_SH_ALIAS_STRING_SET, *PYORI_SH_ALIAS_STRING_SET;
+
+/**
+ Free a set of aliases previously parsed with @ref YoriShParseAliasStrings .
+
+ @param AliasSet Pointer to the set of aliases to free.
+ */
+VOID
+YoriShFreeAliasStringSet(
+    __in PYORI_SH_ALIAS_STRING_SET AliasSet
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < AliasSet->EntryCount; Index++) {
+        YoriLibHashRemoveByEntry(&AliasSet->Entries[Index].HashEntry);
+    }
+
+    if (AliasSet->HashTable != NULL) {
+        YoriLibFreeEmptyHashTable(AliasSet->HashTable);
+        AliasSet->HashTable = NULL;
+    }
 
- @param AliasStrings The list of strings to search through.
+    if (AliasSet->Entries != NULL) {
+        YoriLibFree(AliasSet->Entries);
+        AliasSet->Entries = NULL;
+    }
+    AliasSet->EntryCount = 0;
+}
 
- @param AliasName The name of the alias to find.
+/**
+ Parse a NULL terminated list of alias strings into a set of aliases which
+ can be found by name.  If an alias name is present more than once, the
+ first instance is used.
 
- @param AliasValue On successful completion, this is updated to point to the
-        value of the found match.  Note this value is not referenced.
+ @param AliasStrings The list of strings to parse.  The resulting set points
+        into this list, so it must remain valid until the set is freed.
 
- @return TRUE to indicate a match was found, FALSE to indicate it was not.
+ @param AliasSet On successful completion, populated with the set of aliases.
+        The caller is expected to free this with
+        @ref YoriShFreeAliasStringSet .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
  */
 __success(return)
 BOOL
-YoriShFindAliasWithinStrings(
+YoriShParseAliasStrings(
     __in PYORI_STRING AliasStrings,
-    __in PYORI_STRING AliasName,
-    __out PYORI_STRING AliasValue
+    __out PYORI_SH_ALIAS_STRING_SET AliasSet
     )
 {
     DWORD CharsConsumed;
+    DWORD StringCount;
     YORI_STRING FoundAliasName;
     YORI_STRING FoundAliasValue;
+    PYORI_SH_ALIAS_STRING Entry;
+
+    AliasSet->HashTable = NULL;
+    AliasSet->Entries = NULL;
+    AliasSet->EntryCount = 0;
+
+    //
+    //  Count the number of strings so the array can be allocated at once.
+    //
+
+    StringCount = 0;
+    for (CharsConsumed = 0;
+         CharsConsumed < AliasStrings->LengthInChars && CharsConsumed < AliasStrings->LengthAllocated;
+         CharsConsumed++) {
+
+        if (AliasStrings->StartOfString[CharsConsumed] == '\0') {
+            StringCount++;
+        }
+    }
+    StringCount++;
+
+    AliasSet->HashTable = YoriLibAllocateHashTable(YORI_SH_ALIAS_HASH_BUCKETS);
+    if (AliasSet->HashTable == NULL) {
+        return FALSE;
+    }
+
+    AliasSet->Entries = YoriLibMalloc(StringCount * sizeof(YORI_SH_ALIAS_STRING));
+    if (AliasSet->Entries == NULL) {
+        YoriShFreeAliasStringSet(AliasSet);
+        return FALSE;
+    }
 
     YoriLibInitEmptyString(&FoundAliasName);
     YoriLibInitEmptyString(&FoundAliasValue);
@@ -668,21 +822,27 @@ YoriShFindAliasWithinStrings(
             }
 
             CharsConsumed += FoundAliasValue.LengthInChars + 1;
-        }
 
-        if (YoriLibCompareStringInsensitive(AliasName, &FoundAliasName) == 0) {
-            memcpy(AliasValue, &FoundAliasValue, sizeof(YORI_STRING));
-            return TRUE;
+            if (AliasSet->EntryCount < StringCount &&
+                YoriLibHashLookupByKey(AliasSet->HashTable, &FoundAliasName) == NULL) {
+
+                Entry = &AliasSet->Entries[AliasSet->EntryCount];
+                memcpy(&Entry->AliasName, &FoundAliasName, sizeof(YORI_STRING));
+                memcpy(&Entry->AliasValue, &FoundAliasValue, sizeof(YORI_STRING));
+                YoriLibHashInsertByKey(AliasSet->HashTable, &Entry->AliasName, Entry, &Entry->HashEntry);
+                AliasSet->EntryCount++;
+            }
         }
     }
 
-    return FALSE;
+    return TRUE;
 }
 
 /**
- Incorporate changes into the current set of aliases.  This function scans
- two NULL terminated lists of aliases to find changes in the new set over
- the old set and incorporate those into the current environment.
+ Incorporate changes into the current set of aliases.  This function parses
+ two NULL terminated lists of aliases into hash tables, and uses these to
+ find changes in the new set over the old set and incorporate those into the
+ current environment.
 
  @param MergeFromCmd If TRUE, these alias lists are treated as CMD format
         and need to be migrated in order to incorporate them into Yori.
@@ -701,98 +861,65 @@ YoriShMergeChangedAliasStrings(
     __in PYORI_STRING NewStrings
     )
 {
-    DWORD CharsConsumed;
-    YORI_STRING FoundAliasName;
-    YORI_STRING FoundAliasValue;
-    YORI_STRING OldAliasValue;
+    YORI_SH_ALIAS_STRING_SET OldSet;
+    YORI_SH_ALIAS_STRING_SET NewSet;
+    PYORI_SH_ALIAS_STRING Entry;
+    PYORI_SH_ALIAS_STRING OldEntry;
+    PYORI_HASH_ENTRY HashEntry;
+    DWORD Index;
 
-    YoriLibInitEmptyString(&FoundAliasName);
-    YoriLibInitEmptyString(&FoundAliasValue);
+    if (!YoriShParseAliasStrings(OldStrings, &OldSet)) {
+        return FALSE;
+    }
+
+    if (!YoriShParseAliasStrings(NewStrings, &NewSet)) {
+        YoriShFreeAliasStringSet(&OldSet);
+        return FALSE;
+    }
 
     //
-    //  Navigate through the new alias strings.
+    //  Navigate through the new alias strings.  If an alias is not in the
+    //  old set, or has changed, add it now.
     //
 
-    CharsConsumed = 0;
-    while (CharsConsumed < NewStrings->LengthInChars && CharsConsumed < NewStrings->LengthAllocated) {
-        FoundAliasName.StartOfString = &NewStrings->StartOfString[CharsConsumed];
-        FoundAliasName.LengthInChars = 0;
-        while (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '\0' &&
-               FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '=') {
-
-            FoundAliasName.LengthInChars++;
-        }
-
-        CharsConsumed += FoundAliasName.LengthInChars + 1;
-
-        if (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] == '=') {
-            FoundAliasValue.LengthInChars = 0;
-            FoundAliasValue.StartOfString = &FoundAliasName.StartOfString[FoundAliasName.LengthInChars + 1];
-            while (FoundAliasValue.StartOfString[FoundAliasValue.LengthInChars] != '\0') {
-                FoundAliasValue.LengthInChars++;
+    for (Index = 0; Index < NewSet.EntryCount; Index++) {
+        Entry = &NewSet.Entries[Index];
+        HashEntry = YoriLibHashLookupByKey(OldSet.HashTable, &Entry->AliasName);
+        if (HashEntry != NULL) {
+            OldEntry = HashEntry->Context;
+            if (YoriLibCompareString(&Entry->AliasValue, &OldEntry->AliasValue) == 0) {
+                continue;
             }
+        }
 
-            CharsConsumed += FoundAliasValue.LengthInChars + 1;
-
-            //
-            //  Now we've found something, check its state in the old
-            //  alias strings.  If it's not there or changed, add it now.
-            //
-
-            if (!YoriShFindAliasWithinStrings(OldStrings, &FoundAliasName, &OldAliasValue) ||
-                YoriLibCompareString(&FoundAliasValue, &OldAliasValue) != 0) {
-                if (MergeFromCmd) {
-                    LPTSTR MigratedAlias;
-                    YORI_STRING YsMigratedAlias;
-                    if (YoriShImportAliasValue(FoundAliasValue.StartOfString, &MigratedAlias)) {
-                        YoriLibConstantString(&YsMigratedAlias, MigratedAlias);
-                        YoriShAddAlias(&FoundAliasName, &YsMigratedAlias, FALSE);
-                        YoriLibDereference(MigratedAlias);
-                    }
-                } else {
-                    YoriShAddAlias(&FoundAliasName, &FoundAliasValue, FALSE);
-                }
+        if (MergeFromCmd) {
+            LPTSTR MigratedAlias;
+            YORI_STRING YsMigratedAlias;
+            if (YoriShImportAliasValue(Entry->AliasValue.StartOfString, &MigratedAlias)) {
+                YoriLibConstantString(&YsMigratedAlias, MigratedAlias);
+                YoriShAddAlias(&Entry->AliasName, &YsMigratedAlias, FALSE);
+                YoriLibDereference(MigratedAlias);
             }
+        } else {
+            YoriShAddAlias(&Entry->AliasName, &Entry->AliasValue, FALSE);
         }
     }
 
     //
-    //  Navigate through the old alias strings.
+    //  Navigate through the old alias strings.  If an alias is not in the
+    //  new set, delete it.
     //
 
-    CharsConsumed = 0;
-    while (CharsConsumed < OldStrings->LengthInChars && CharsConsumed < OldStrings->LengthAllocated) {
-        FoundAliasName.StartOfString = &OldStrings->StartOfString[CharsConsumed];
-        FoundAliasName.LengthInChars = 0;
-        while (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '\0' &&
-               FoundAliasName.StartOfString[FoundAliasName.LengthInChars] != '=') {
-
-            FoundAliasName.LengthInChars++;
-        }
-
-        CharsConsumed += FoundAliasName.LengthInChars + 1;
-
-        if (FoundAliasName.StartOfString[FoundAliasName.LengthInChars] == '=') {
-            FoundAliasValue.LengthInChars = 0;
-            FoundAliasValue.StartOfString = &FoundAliasName.StartOfString[FoundAliasName.LengthInChars + 1];
-            while (FoundAliasValue.StartOfString[FoundAliasValue.LengthInChars] != '\0') {
-                FoundAliasValue.LengthInChars++;
-            }
-
-            CharsConsumed += FoundAliasValue.LengthInChars + 1;
-
-            //
-            //  Now we've found something, check its state in the new
-            //  alias strings.  If it's not there, delete it.
-            //
-
-            if (!YoriShFindAliasWithinStrings(NewStrings, &FoundAliasName, &OldAliasValue)) {
-                YoriShDeleteAlias(&FoundAliasName);
-            }
+    for (Index = 0; Index < OldSet.EntryCount; Index++) {
+        Entry = &OldSet.Entries[Index];
+        if (YoriLibHashLookupByKey(NewSet.HashTable, &Entry->AliasName) == NULL) {
+            YoriShDeleteAlias(&Entry->AliasName);
         }
     }
 
-    return FALSE;
+    YoriShFreeAliasStringSet(&NewSet);
+    YoriShFreeAliasStringSet(&OldSet);
+    return TRUE;
 }
 
 /**
@@ -195,6 +195,21 @@ YoriApiExecuteExpression(
     return YoriShExecuteExpression(Expression);
 }
 
+/**
+ Execute an expression previously parsed with @ref YoriApiParseExpression .
+
+ @param ParsedExpression Pointer to the parsed expression.
+
+ @return TRUE to indicate it was successfully executed, FALSE otherwise.
+ */
+BOOL
+YoriApiExecuteParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    return YoriShExecuteParsedExpression(ParsedExpression);
+}
+
 /**
  Terminates the currently running instance of Yori.
 
@@ -228,6 +243,19 @@ YoriApiExpandAlias(
     return YoriShExpandAliasFromString(CommandString, ExpandedString);
 }
 
+/**
+ Free an expression previously parsed with @ref YoriApiParseExpression .
+
+ @param ParsedExpression Pointer to the parsed expression.
+ */
+VOID
+YoriApiFreeParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    YoriShFreeParsedExpression(ParsedExpression);
+}
+
 /**
  Free a previously returned Yori string.
 
@@ -365,6 +393,40 @@ YoriApiGetJobInformation(
     return YoriShGetJobInformation(JobId, HasCompleted, HasOutput, ExitCode, Command);
 }
 
+/**
+ Returns information about a module that is currently loaded by the shell,
+ including modules that are retained in the module cache after use.
+
+ @param Index The zero based index of the module to query.
+
+ @param ModuleName On successful completion, updated to contain the full
+        path to the module.
+
+ @param ReferenceCount On successful completion, updated to contain the
+        number of references to the module.  Zero indicates the module is
+        only loaded because it is cached.
+
+ @param UseCount On successful completion, updated to contain the number of
+        times the module has been located for execution.
+
+ @param LoadTimeInMicroseconds On successful completion, updated to contain
+        the time taken to load the module.
+
+ @return TRUE to indicate success, FALSE to indicate failure, including
+         when Index is beyond the number of loaded modules.
+ */
+BOOL
+YoriApiGetModuleInformation(
+    __in DWORD Index,
+    __inout PYORI_STRING ModuleName,
+    __out PDWORD ReferenceCount,
+    __out PDWORD UseCount,
+    __out PDWORD LoadTimeInMicroseconds
+    )
+{
+    return YoriShGetModuleInformation(Index, ModuleName, ReferenceCount, UseCount, LoadTimeInMicroseconds);
+}
+
 /**
  Get any output buffers from a completed job, including stdout and stderr
  buffers.
@@ -461,6 +523,28 @@ YoriApiIncrementPromptRecursionDepth(
     return TRUE;
 }
 
+/**
+ Parse a command string into a form that can be executed repeatedly without
+ parsing it again.
+
+ @param Expression The string to parse.
+
+ @param ParsedExpression On successful completion, updated to point to the
+        parsed expression.  Free this with
+        @ref YoriApiFreeParsedExpression .
+
+ @return TRUE to indicate the expression was parsed, FALSE if it could not
+         be and should be executed with @ref YoriApiExecuteExpression .
+ */
+BOOL
+YoriApiParseExpression(
+    __in PYORI_STRING Expression,
+    __out PVOID * ParsedExpression
+    )
+{
+    return YoriShParseExpression(Expression, ParsedExpression);
+}
+
 /**
  Take any existing output from a job and send it to a pipe handle, and continue
  sending further output into the pipe handle.
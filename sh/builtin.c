@@ -33,7 +33,10 @@
 YORI_LIST_ENTRY YoriShLoadedModules;
 
 /**
- Hash table of builtin callbacks currently registered with Yori.
+ Hash table of builtin callbacks currently registered with Yori, keyed by
+ command name, and of loaded modules, keyed by full path.  The context of
+ each entry begins with a @ref YORI_SH_BUILTIN_HASH_TYPE indicating which
+ kind of object it is.
  */
 PYORI_HASH_TABLE YoriShBuiltinHash;
 
@@ -64,7 +67,155 @@ typedef struct _YORI_SH_BUILTIN_UNLOAD_CALLBACK {
 } YORI_SH_BUILTIN_UNLOAD_CALLBACK, *PYORI_SH_BUILTIN_UNLOAD_CALLBACK;
 
 /**
- Load a DLL file into a loaded module object that can be referenced.
+ A list of modules that are no longer referenced but remain loaded so that
+ executing them again does not need to reload them.  Ordered from least to
+ most recently used.
+ */
+YORI_LIST_ENTRY YoriShIdleModules;
+
+/**
+ The number of modules on @ref YoriShIdleModules .
+ */
+DWORD YoriShIdleModuleCount;
+
+/**
+ The number of idle modules to keep loaded if the user has not specified a
+ value with the YORIMODULECACHE environment variable.
+ */
+#define YORI_SH_DEFAULT_MODULE_CACHE_SIZE (8)
+
+/**
+ The number of idle modules to keep loaded, as determined from the
+ environment.
+ */
+DWORD YoriShModuleCacheSize;
+
+/**
+ The environment generation at the time YoriShModuleCacheSize was
+ determined.
+ */
+DWORD YoriShModuleCacheGeneration;
+
+/**
+ TRUE if YoriShModuleCacheSize has been determined from the environment.
+ */
+BOOLEAN YoriShModuleCacheSizeValid;
+
+/**
+ Allocate the hash table used to find builtin commands and loaded modules
+ if it has not been allocated already.
+
+ @return TRUE if the hash table exists, FALSE if it could not be allocated.
+ */
+__success(return)
+BOOL
+YoriShAllocateBuiltinHash(VOID)
+{
+    if (YoriShBuiltinHash == NULL) {
+        YoriShBuiltinHash = YoriLibAllocateHashTable(50);
+        if (YoriShBuiltinHash == NULL) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ Return the number of unreferenced modules that should remain loaded.  This
+ is specified by the YORIMODULECACHE environment variable, where zero
+ indicates modules should be unloaded as soon as they are no longer in use.
+ The value is only reparsed when the environment changes.
+
+ @return The number of idle modules to retain.
+ */
+DWORD
+YoriShGetModuleCacheSize(VOID)
+{
+    TCHAR Buffer[16];
+    YORI_STRING NumberString;
+    DWORD EnvVarLength;
+    DWORD CharsConsumed;
+    LONGLONG Number;
+
+    if (YoriShModuleCacheSizeValid &&
+        YoriShModuleCacheGeneration == YoriShGlobal.EnvironmentGeneration) {
+
+        return YoriShModuleCacheSize;
+    }
+
+    YoriShModuleCacheSize = YORI_SH_DEFAULT_MODULE_CACHE_SIZE;
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIMODULECACHE"), Buffer, sizeof(Buffer)/sizeof(Buffer[0]), &YoriShModuleCacheGeneration);
+    if (EnvVarLength > 0 && EnvVarLength < sizeof(Buffer)/sizeof(Buffer[0])) {
+        YoriLibInitEmptyString(&NumberString);
+        NumberString.StartOfString = Buffer;
+        NumberString.LengthInChars = EnvVarLength;
+        if (YoriLibStringToNumber(&NumberString, TRUE, &Number, &CharsConsumed) &&
+            CharsConsumed > 0 &&
+            Number >= 0) {
+
+            YoriShModuleCacheSize = (DWORD)Number;
+        }
+    }
+
+    YoriShModuleCacheSizeValid = TRUE;
+    return YoriShModuleCacheSize;
+}
+
+/**
+ Unload a module that has no remaining references.  The module is removed
+ from the loaded module list and the hash table, its unload notification is
+ invoked, and the DLL is freed.
+
+ @param LoadedModule The module to unload.
+ */
+VOID
+YoriShUnloadModule(
+    __in PYORI_SH_LOADED_MODULE LoadedModule
+    )
+{
+    ASSERT(LoadedModule->ReferenceCount == 0);
+    YoriLibRemoveListItem(&LoadedModule->ListEntry);
+    YoriLibHashRemoveByEntry(&LoadedModule->HashEntry);
+    if (LoadedModule->UnloadNotify != NULL) {
+        LoadedModule->UnloadNotify();
+    }
+    if (LoadedModule->ModuleHandle != NULL) {
+        FreeLibrary(LoadedModule->ModuleHandle);
+    }
+    YoriLibFree(LoadedModule);
+}
+
+/**
+ Unload the least recently used idle modules until no more than the
+ specified number remain loaded.
+
+ @param MaximumIdleModules The number of idle modules to retain.
+ */
+VOID
+YoriShTrimModuleCache(
+    __in DWORD MaximumIdleModules
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_LOADED_MODULE LoadedModule;
+
+    while (YoriShIdleModuleCount > MaximumIdleModules) {
+        ListEntry = YoriLibGetNextListEntry(&YoriShIdleModules, NULL);
+        ASSERT(ListEntry != NULL);
+        if (ListEntry == NULL) {
+            break;
+        }
+        LoadedModule = CONTAINING_RECORD(ListEntry, YORI_SH_LOADED_MODULE, IdleListEntry);
+        YoriLibRemoveListItem(&LoadedModule->IdleListEntry);
+        YoriShIdleModuleCount--;
+        YoriShUnloadModule(LoadedModule);
+    }
+}
+
+/**
+ Load a DLL file into a loaded module object that can be referenced.  If
+ the DLL is already loaded, including if it is idle in the module cache,
+ the existing module is referenced and returned.
 
  @param DllName Pointer to a NULL terminated string of a DLL to load.
 
@@ -77,34 +228,48 @@ YoriShLoadDll(
     )
 {
     PYORI_SH_LOADED_MODULE FoundEntry = NULL;
-    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING DllNameString;
     DWORD DllNameLength;
     DWORD OldErrorMode;
+    PVOID ProfileHandle;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    LARGE_INTEGER Frequency;
 
-    if (YoriShLoadedModules.Next != NULL) {
-        ListEntry = YoriLibGetNextListEntry(&YoriShLoadedModules, NULL);
-        while (ListEntry != NULL) {
-            FoundEntry = CONTAINING_RECORD(ListEntry, YORI_SH_LOADED_MODULE, ListEntry);
-            if (YoriLibCompareStringWithLiteralInsensitive(&FoundEntry->DllName, DllName) == 0) {
-                FoundEntry->ReferenceCount++;
-                return FoundEntry;
-            }
+    if (!YoriShAllocateBuiltinHash()) {
+        return NULL;
+    }
 
-            ListEntry = YoriLibGetNextListEntry(&YoriShLoadedModules, ListEntry);
+    YoriLibConstantString(&DllNameString, DllName);
+    HashEntry = YoriLibHashLookupByKey(YoriShBuiltinHash, &DllNameString);
+    if (HashEntry != NULL) {
+        FoundEntry = (PYORI_SH_LOADED_MODULE)HashEntry->Context;
+        if (FoundEntry->HashType == YoriShBuiltinHashTypeModule) {
+            if (FoundEntry->ReferenceCount == 0) {
+                YoriLibRemoveListItem(&FoundEntry->IdleListEntry);
+                YoriShIdleModuleCount--;
+            }
+            FoundEntry->ReferenceCount++;
+            FoundEntry->UseCount++;
+            return FoundEntry;
         }
     }
 
-    DllNameLength = _tcslen(DllName);
+    DllNameLength = (DWORD)_tcslen(DllName);
     FoundEntry = YoriLibMalloc(sizeof(YORI_SH_LOADED_MODULE) + (DllNameLength + 1) * sizeof(TCHAR));
     if (FoundEntry == NULL) {
         return NULL;
     }
 
+    FoundEntry->HashType = YoriShBuiltinHashTypeModule;
     YoriLibInitEmptyString(&FoundEntry->DllName);
     FoundEntry->DllName.StartOfString = (LPTSTR)(FoundEntry + 1);
     FoundEntry->DllName.LengthInChars = DllNameLength;
     memcpy(FoundEntry->DllName.StartOfString, DllName, DllNameLength * sizeof(TCHAR));
+    FoundEntry->DllName.StartOfString[DllNameLength] = '\0';
     FoundEntry->ReferenceCount = 1;
+    FoundEntry->UseCount = 1;
     FoundEntry->UnloadNotify = NULL;
 
     //
@@ -114,7 +279,11 @@ YoriShLoadDll(
 
     OldErrorMode = SetErrorMode(SEM_FAILCRITICALERRORS);
 
+    ProfileHandle = YoriShProfileBegin(YoriShProfileTypeModule, &FoundEntry->DllName);
+    QueryPerformanceCounter(&StartTime);
     FoundEntry->ModuleHandle = LoadLibrary(DllName);
+    QueryPerformanceCounter(&EndTime);
+    YoriShProfileEnd(ProfileHandle);
     if (FoundEntry->ModuleHandle == NULL) {
         SetErrorMode(OldErrorMode);
         YoriLibFree(FoundEntry);
@@ -122,16 +291,24 @@ YoriShLoadDll(
     }
     SetErrorMode(OldErrorMode);
 
+    FoundEntry->LoadTimeInMicroseconds = 0;
+    if (QueryPerformanceFrequency(&Frequency) && Frequency.QuadPart != 0) {
+        FoundEntry->LoadTimeInMicroseconds = (DWORD)((EndTime.QuadPart - StartTime.QuadPart) * 1000 * 1000 / Frequency.QuadPart);
+    }
+
     if (YoriShLoadedModules.Next == NULL) {
         YoriLibInitializeListHead(&YoriShLoadedModules);
     }
     YoriLibAppendList(&YoriShLoadedModules, &FoundEntry->ListEntry);
+    YoriLibHashInsertByKey(YoriShBuiltinHash, &FoundEntry->DllName, FoundEntry, &FoundEntry->HashEntry);
     return FoundEntry;
 }
 
 /**
- Dereference a loaded DLL module and free it if the reference count reaches
- zero.
+ Dereference a loaded DLL module.  When the reference count reaches zero,
+ the module is retained in the module cache if the cache has capacity, and
+ the least recently used idle modules are unloaded to stay within that
+ capacity.  If the cache is disabled, the module is unloaded immediately.
 
  @param LoadedModule The module to dereference.
  */
@@ -140,19 +317,26 @@ YoriShReleaseDll(
     __in PYORI_SH_LOADED_MODULE LoadedModule
     )
 {
-    if (LoadedModule->ReferenceCount > 1) {
-        LoadedModule->ReferenceCount--;
+    DWORD CacheSize;
+
+    ASSERT(LoadedModule->ReferenceCount > 0);
+    LoadedModule->ReferenceCount--;
+    if (LoadedModule->ReferenceCount > 0) {
         return;
     }
 
-    YoriLibRemoveListItem(&LoadedModule->ListEntry);
-    if (LoadedModule->UnloadNotify != NULL) {
-        LoadedModule->UnloadNotify();
+    CacheSize = YoriShGetModuleCacheSize();
+    if (CacheSize == 0) {
+        YoriShUnloadModule(LoadedModule);
+        return;
     }
-    if (LoadedModule->ModuleHandle != NULL) {
-        FreeLibrary(LoadedModule->ModuleHandle);
+
+    if (YoriShIdleModules.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShIdleModules);
     }
-    YoriLibFree(LoadedModule);
+    YoriLibAppendList(&YoriShIdleModules, &LoadedModule->IdleListEntry);
+    YoriShIdleModuleCount++;
+    YoriShTrimModuleCache(CacheSize);
 }
 
 /**
@@ -169,6 +353,74 @@ YoriShReferenceDll(
     LoadedModule->ReferenceCount++;
 }
 
+/**
+ Return information about a module that is currently loaded, including
+ modules that are no longer referenced but are retained in the module cache.
+
+ @param Index The zero based index of the module to return information
+        about.
+
+ @param ModuleName On successful completion, updated to contain the full
+        path to the module.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @param ReferenceCount On successful completion, updated to contain the
+        number of references to the module.  Zero indicates the module is
+        idle and is only loaded because it is cached.
+
+ @param UseCount On successful completion, updated to contain the number of
+        times the module has been located for execution.
+
+ @param LoadTimeInMicroseconds On successful completion, updated to contain
+        the time taken to load the module.
+
+ @return TRUE to indicate success, FALSE if Index does not refer to a loaded
+         module or memory could not be allocated.
+ */
+__success(return)
+BOOL
+YoriShGetModuleInformation(
+    __in DWORD Index,
+    __inout PYORI_STRING ModuleName,
+    __out PDWORD ReferenceCount,
+    __out PDWORD UseCount,
+    __out PDWORD LoadTimeInMicroseconds
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_LOADED_MODULE LoadedModule;
+    DWORD CurrentIndex;
+
+    if (YoriShLoadedModules.Next == NULL) {
+        return FALSE;
+    }
+
+    CurrentIndex = 0;
+    ListEntry = YoriLibGetNextListEntry(&YoriShLoadedModules, NULL);
+    while (ListEntry != NULL) {
+        if (CurrentIndex == Index) {
+            LoadedModule = CONTAINING_RECORD(ListEntry, YORI_SH_LOADED_MODULE, ListEntry);
+            if (ModuleName->LengthAllocated <= LoadedModule->DllName.LengthInChars) {
+                YoriLibFreeStringContents(ModuleName);
+                if (!YoriLibAllocateString(ModuleName, LoadedModule->DllName.LengthInChars + 1)) {
+                    return FALSE;
+                }
+            }
+            memcpy(ModuleName->StartOfString, LoadedModule->DllName.StartOfString, LoadedModule->DllName.LengthInChars * sizeof(TCHAR));
+            ModuleName->StartOfString[LoadedModule->DllName.LengthInChars] = '\0';
+            ModuleName->LengthInChars = LoadedModule->DllName.LengthInChars;
+            *ReferenceCount = LoadedModule->ReferenceCount;
+            *UseCount = LoadedModule->UseCount;
+            *LoadTimeInMicroseconds = LoadedModule->LoadTimeInMicroseconds;
+            return TRUE;
+        }
+        CurrentIndex++;
+        ListEntry = YoriLibGetNextListEntry(&YoriShLoadedModules, ListEntry);
+    }
+
+    return FALSE;
+}
+
 /**
  Pointer to the active module, being the DLL that was most recently invoked
  by the shell.
@@ -481,6 +733,14 @@ YoriShExecuteInProc(
     YoriShGlobal.EscapedCmdContext = SavedEscapedCmdContext;
     YoriShRevertRedirection(&PreviousRedirectContext);
 
+    //
+    //  Builtins can modify the environment directly, such as by changing
+    //  the current directory on a drive, without going through the shell.
+    //  Check for this so the cached environment block isn't stale.
+    //
+
+    YoriShCheckForEnvironmentChange();
+
     if (WasPipe) {
         YoriShForwardProcessBufferToNextProcess(ExecContext);
     } else {
@@ -587,7 +847,11 @@ YoriShBuiltIn (
         HashEntry = YoriLibHashLookupByKey(YoriShBuiltinHash, &CmdContext->ArgV[0]);
         if (HashEntry != NULL) {
             CallbackEntry = (PYORI_SH_BUILTIN_CALLBACK)HashEntry->Context;
-            BuiltInCmd = CallbackEntry->BuiltInFn;
+            if (CallbackEntry->HashType == YoriShBuiltinHashTypeCallback) {
+                BuiltInCmd = CallbackEntry->BuiltInFn;
+            } else {
+                CallbackEntry = NULL;
+            }
         }
     }
 
@@ -709,11 +973,8 @@ YoriShBuiltinRegister(
     if (YoriShGlobal.BuiltinCallbacks.Next == NULL) {
         YoriLibInitializeListHead(&YoriShGlobal.BuiltinCallbacks);
     }
-    if (YoriShBuiltinHash == NULL) {
-        YoriShBuiltinHash = YoriLibAllocateHashTable(50);
-        if (YoriShBuiltinHash == NULL) {
-            return FALSE;
-        }
+    if (!YoriShAllocateBuiltinHash()) {
+        return FALSE;
     }
 
     NewCallback = YoriLibReferencedMalloc(sizeof(YORI_SH_BUILTIN_CALLBACK) + (BuiltinCmd->LengthInChars + 1) * sizeof(TCHAR));
@@ -721,6 +982,7 @@ YoriShBuiltinRegister(
         return FALSE;
     }
 
+    NewCallback->HashType = YoriShBuiltinHashTypeCallback;
     YoriLibInitEmptyString(&NewCallback->BuiltinName);
     NewCallback->BuiltinName.StartOfString = (LPTSTR)(NewCallback + 1);
     NewCallback->BuiltinName.LengthInChars = BuiltinCmd->LengthInChars;
@@ -775,10 +1037,13 @@ YoriShBuiltinUnregister(
 
 
     if (YoriShBuiltinHash != NULL) {
-        HashEntry = YoriLibHashRemoveByKey(YoriShBuiltinHash, BuiltinCmd);
-        if (HashEntry != NULL) {
+        HashEntry = YoriLibHashLookupByKey(YoriShBuiltinHash, BuiltinCmd);
+        if (HashEntry != NULL &&
+            ((PYORI_SH_BUILTIN_CALLBACK)HashEntry->Context)->HashType == YoriShBuiltinHashTypeCallback) {
+
             Callback = (PYORI_SH_BUILTIN_CALLBACK)HashEntry->Context;
             ASSERT(CallbackFn == Callback->BuiltInFn);
+            YoriLibHashRemoveByEntry(HashEntry);
             YoriLibRemoveListItem(&Callback->ListEntry);
             if (Callback->ReferencedModule != NULL) {
                 YoriShReleaseDll(Callback->ReferencedModule);
@@ -820,8 +1085,19 @@ YoriShBuiltinUnregisterAll(
         }
     }
 
+    //
+    //  Releasing the modules that implemented builtins may have left them
+    //  in the module cache.  Unload everything that is cached before
+    //  tearing down the hash table that refers to it.
+    //
+
+    if (YoriShIdleModules.Next != NULL) {
+        YoriShTrimModuleCache(0);
+    }
+
     if (YoriShBuiltinHash != NULL) {
         YoriLibFreeEmptyHashTable(YoriShBuiltinHash);
+        YoriShBuiltinHash = NULL;
     }
 
     if (YoriShBuiltinUnloadCallbacks.Next != NULL) {
@@ -119,7 +119,10 @@ YoriShPerformHistoryTabCompletion(
 {
     LPTSTR FoundPath;
     DWORD CompareLength;
-    PYORI_LIST_ENTRY ListEntry;
+    YORI_STRING Prefix;
+    PYORI_SH_HISTORY_ENTRY *HistoryMatches;
+    DWORD HistoryMatchCount;
+    DWORD Index;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
     PYORI_SH_TAB_COMPLETE_MATCH Match;
     PYORI_HASH_ENTRY PriorEntry;
@@ -139,56 +142,65 @@ YoriShPerformHistoryTabCompletion(
     FoundPath = NULL;
 
     //
-    //  Search the list of history.
+    //  Search the history index for entries starting with the prefix.
+    //  These are returned from most recent to least recent.
     //
 
-    ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, NULL);
-    while (ListEntry != NULL) {
-        HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+    YoriLibInitEmptyString(&Prefix);
+    Prefix.StartOfString = TabContext->SearchString.StartOfString;
+    Prefix.LengthInChars = CompareLength;
 
-        if (YoriLibCompareStringInsensitiveCount(&HistoryEntry->CmdLine, &TabContext->SearchString, CompareLength) == 0) {
+    if (!YoriShFindHistoryPrefixMatches(&Prefix, &HistoryMatches, &HistoryMatchCount)) {
+        return;
+    }
 
-            //
-            //  Allocate a match entry for this file.
-            //
+    for (Index = 0; Index < HistoryMatchCount; Index++) {
+        HistoryEntry = HistoryMatches[Index];
 
-            Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (HistoryEntry->CmdLine.LengthInChars + 1) * sizeof(TCHAR));
-            if (Match == NULL) {
-                return;
-            }
+        //
+        //  Allocate a match entry for this file.
+        //
 
-            //
-            //  Populate the file into the entry.
-            //
+        Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (HistoryEntry->CmdLine.LengthInChars + 1) * sizeof(TCHAR));
+        if (Match == NULL) {
+            YoriLibFree(HistoryMatches);
+            return;
+        }
 
-            YoriLibInitEmptyString(&Match->Value);
-            Match->Value.StartOfString = (LPTSTR)(Match + 1);
-            YoriLibReference(Match);
-            Match->Value.MemoryToFree = Match;
-            YoriLibSPrintf(Match->Value.StartOfString, _T("%y"), &HistoryEntry->CmdLine);
-            Match->Value.LengthInChars = HistoryEntry->CmdLine.LengthInChars;
-            Match->CursorOffset = Match->Value.LengthInChars;
+        //
+        //  Populate the file into the entry.
+        //
 
-            //
-            //  If the user is requesting all matches to be enumerates for
-            //  tab completion, don't add an entry if there's a duplicate.
-            //  If the user is requesting to be able to cycle to the next
-            //  entry, keep duplicates, because they're an in-order record
-            //  of the commands the user entered.
-
-            PriorEntry = NULL;
-            if (YoriShGlobal.CompletionListAll) {
-                PriorEntry = YoriLibHashLookupByKey(TabContext->MatchHashTable, &Match->Value);
-            }
+        YoriLibInitEmptyString(&Match->Value);
+        Match->Value.StartOfString = (LPTSTR)(Match + 1);
+        YoriLibReference(Match);
+        Match->Value.MemoryToFree = Match;
+        YoriLibSPrintf(Match->Value.StartOfString, _T("%y"), &HistoryEntry->CmdLine);
+        Match->Value.LengthInChars = HistoryEntry->CmdLine.LengthInChars;
+        Match->CursorOffset = Match->Value.LengthInChars;
 
-            if (PriorEntry == NULL) {
-                YoriShAddMatchToTabContextAtEnd(TabContext, Match);
-            } else {
-                YoriLibFreeStringContents(&Match->Value);
-                YoriLibDereference(Match);
-            }
+        //
+        //  If the user is requesting all matches to be enumerates for
+        //  tab completion, don't add an entry if there's a duplicate.
+        //  If the user is requesting to be able to cycle to the next
+        //  entry, keep duplicates, because they're an in-order record
+        //  of the commands the user entered.
+
+        PriorEntry = NULL;
+        if (YoriShGlobal.CompletionListAll) {
+            PriorEntry = YoriLibHashLookupByKey(TabContext->MatchHashTable, &Match->Value);
+        }
+
+        if (PriorEntry == NULL) {
+            YoriShAddMatchToTabContextAtEnd(TabContext, Match);
+        } else {
+            YoriLibFreeStringContents(&Match->Value);
+            YoriLibDereference(Match);
         }
-        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+    }
+
+    if (HistoryMatches != NULL) {
+        YoriLibFree(HistoryMatches);
     }
 }
 
@@ -584,6 +596,13 @@ typedef struct _YORI_SH_FILE_COMPLETE_CONTEXT {
      */
     BOOL AbortMatching;
 
+    /**
+     Set to TRUE when reporting objects that matched the search string as a
+     subsequence rather than a prefix.  In this case the long name is used
+     without checking it against the search string.
+     */
+    BOOL FuzzyMatch;
+
 } YORI_SH_FILE_COMPLETE_CONTEXT, *PYORI_SH_FILE_COMPLETE_CONTEXT;
 
 /**
@@ -777,162 +796,1402 @@ YoriShFileTabCompletionCallback(
             Match->CursorOffset = Match->Value.LengthInChars;
         }
 
-        Match->Value.LengthAllocated = Match->Value.LengthInChars + 1;
-    } else {
-        YORI_STRING StringToFinalSlash;
-        YORI_STRING SearchAfterFinalSlash;
-        YORI_STRING LongFileName;
-        YORI_STRING ShortFileName;
-        PYORI_STRING FileNameToUse = NULL;
+        Match->Value.LengthAllocated = Match->Value.LengthInChars + 1;
+    } else {
+        YORI_STRING StringToFinalSlash;
+        YORI_STRING SearchAfterFinalSlash;
+        YORI_STRING LongFileName;
+        YORI_STRING ShortFileName;
+        PYORI_STRING FileNameToUse = NULL;
+
+        YoriLibConstantString(&LongFileName, FileInfo->cFileName);
+        YoriLibConstantString(&ShortFileName, FileInfo->cAlternateFileName);
+
+        if (ShortFileName.LengthInChars == 0 || FileCompleteContext->FuzzyMatch) {
+            FileNameToUse = &LongFileName;
+        } else {
+            YoriLibConstantString(&SearchAfterFinalSlash, &FileCompleteContext->SearchString[FileCompleteContext->CharsToFinalSlash]);
+            ASSERT(SearchAfterFinalSlash.LengthInChars > 0);
+            if (YoriLibDoesFileMatchExpression(&LongFileName, &SearchAfterFinalSlash)) {
+                FileNameToUse = &LongFileName;
+            } else if (YoriLibDoesFileMatchExpression(&ShortFileName, &SearchAfterFinalSlash)) {
+                FileNameToUse = &ShortFileName;
+            } else {
+
+                //
+                //  If we can't match the long or the short name, it can be
+                //  because the expression contains extended path operators
+                //  such as {} or [].  In order to use these with suggestions
+                //  this code would need to be a lot smarter.  We could use
+                //  them for tab completion, but this piece of code can't
+                //  currently tell the difference.
+                //
+
+                return TRUE;
+            }
+        }
+
+        //
+        //  Allocate a match entry for this file.
+        //
+
+        Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (FileCompleteContext->Prefix.LengthInChars + FileCompleteContext->CharsToFinalSlash + FileNameToUse->LengthInChars + 1 + FileCompleteContext->Suffix.LengthInChars + 1) * sizeof(TCHAR));
+        if (Match == NULL) {
+            return FALSE;
+        }
+
+        //
+        //  Populate the file into the entry.
+        //
+
+        YoriLibInitEmptyString(&Match->Value);
+        Match->Value.StartOfString = (LPTSTR)(Match + 1);
+        YoriLibReference(Match);
+        Match->Value.MemoryToFree = Match;
+
+        YoriLibInitEmptyString(&StringToFinalSlash);
+        StringToFinalSlash.StartOfString = FileCompleteContext->SearchString;
+        StringToFinalSlash.LengthInChars = FileCompleteContext->CharsToFinalSlash;
+
+
+        if (FileCompleteContext->Suffix.LengthInChars > 0) {
+            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y\\%y"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse, &FileCompleteContext->Suffix);
+            Match->CursorOffset = Match->Value.LengthInChars - FileCompleteContext->Suffix.LengthInChars;
+        } else if ((FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+                   YoriShGlobal.CompletionTrailingSlash) {
+            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y\\"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse);
+            Match->CursorOffset = Match->Value.LengthInChars;
+        } else {
+            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse);
+            Match->CursorOffset = Match->Value.LengthInChars;
+        }
+
+        Match->Value.LengthAllocated = Match->Value.LengthInChars + 1;
+    }
+
+    //
+    //  Insert into the list.  Don't insert if an entry with the same
+    //  string is found.  If maintaining sorting, insert before an entry
+    //  that is greater than this one.
+    //
+
+    if (!FileCompleteContext->KeepCompletionsSorted) {
+        PYORI_HASH_ENTRY PriorEntry;
+        PriorEntry = YoriLibHashLookupByKey(FileCompleteContext->TabContext->MatchHashTable, &Match->Value);
+        if (PriorEntry == NULL) {
+            YoriShAddMatchToTabContextAtEnd(FileCompleteContext->TabContext, Match);
+        } else {
+            YoriLibFreeStringContents(&Match->Value);
+            YoriLibDereference(Match);
+            Match = NULL;
+        }
+    } else {
+        ListEntry = YoriLibGetPreviousListEntry(&FileCompleteContext->TabContext->MatchList, NULL);
+        do {
+            if (ListEntry == NULL) {
+                YoriShAddMatchToTabContext(FileCompleteContext->TabContext, NULL, Match);
+                break;
+            }
+            Existing = CONTAINING_RECORD(ListEntry, YORI_SH_TAB_COMPLETE_MATCH, ListEntry);
+            CompareResult = YoriLibCompareStringInsensitive(&Match->Value, &Existing->Value);
+            if (CompareResult > 0) {
+                YoriShAddMatchToTabContext(FileCompleteContext->TabContext, ListEntry, Match);
+                break;
+            } else if (CompareResult == 0) {
+                YoriLibFreeStringContents(&Match->Value);
+                YoriLibDereference(Match);
+                Match = NULL;
+                break;
+            }
+            ListEntry = YoriLibGetPreviousListEntry(&FileCompleteContext->TabContext->MatchList, ListEntry);
+        } while(TRUE);
+    }
+
+    if (Match != NULL) {
+        FileCompleteContext->FilesFound++;
+    }
+
+    return TRUE;
+}
+
+/**
+ A callback that is invoked when a directory cannot be successfully enumerated.
+ This routine checks for errors that seem sufficiently permanent that no
+ further heuristic matching should be performed.
+
+ @param FilePath Pointer to the file path that could not be enumerated.
+
+ @param ErrorCode The Win32 error code describing the failure.
+
+ @param Depth Recursion depth, ignored in this application.
+
+ @param Context Pointer to the file enumeration context.
+
+ @return TRUE to continute enumerating, FALSE to abort.
+ */
+BOOL
+YoriShFileTabCompletionErrorCallback(
+    __in PYORI_STRING FilePath,
+    __in DWORD ErrorCode,
+    __in DWORD Depth,
+    __in PVOID Context
+    )
+{
+    PYORI_SH_FILE_COMPLETE_CONTEXT FileCompleteContext = (PYORI_SH_FILE_COMPLETE_CONTEXT)Context;
+
+    UNREFERENCED_PARAMETER(FilePath);
+    UNREFERENCED_PARAMETER(Depth);
+
+    if (ErrorCode == ERROR_BAD_NET_NAME ||
+        ErrorCode == ERROR_NETNAME_DELETED ||
+        ErrorCode == ERROR_NETWORK_ACCESS_DENIED ||
+        ErrorCode == ERROR_BAD_NETPATH) {
+
+        FileCompleteContext->AbortMatching = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ The maximum number of fuzzy matches to return from a single tab completion.
+ Only the highest ranked matches are retained.
+ */
+#define YORI_SH_FUZZY_MAX_MATCHES (64)
+
+/**
+ The number of recent history lines to inspect when ranking fuzzy matches
+ by how frequently and recently they have been used.
+ */
+#define YORI_SH_FRECENCY_HISTORY_LINES (256)
+
+/**
+ A single object found within a cached directory.
+ */
+typedef struct _YORI_SH_DIRECTORY_CACHE_ENTRY {
+
+    /**
+     The long name of the object.  This string contains the allocation for
+     both names.
+     */
+    YORI_STRING LongName;
+
+    /**
+     The short name of the object.  This may be empty if the object does not
+     have a short name.  The memory is owned by LongName.
+     */
+    YORI_STRING ShortName;
+
+    /**
+     The attributes of the object, used to distinguish files and directories.
+     */
+    DWORD FileAttributes;
+
+    /**
+     A bitmask of the letters and digits contained within the long name.
+     This is used to quickly reject candidates which cannot contain a fuzzy
+     search string before comparing character by character.
+     */
+    DWORD CharMask;
+} YORI_SH_DIRECTORY_CACHE_ENTRY, *PYORI_SH_DIRECTORY_CACHE_ENTRY;
+
+/**
+ A cached listing of the contents of a single directory.
+ */
+typedef struct _YORI_SH_DIRECTORY_CACHE {
+
+    /**
+     The fully qualified path to the directory, without a trailing slash.
+     */
+    YORI_STRING DirectoryPath;
+
+    /**
+     A change notification handle which is signalled when objects are added,
+     removed or renamed within the directory, indicating the cache is stale.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     An array of objects found within the directory.
+     */
+    PYORI_SH_DIRECTORY_CACHE_ENTRY Entries;
+
+    /**
+     The number of elements in the Entries array that are populated.
+     */
+    DWORD EntryCount;
+
+    /**
+     The number of elements allocated in the Entries array.
+     */
+    DWORD EntriesAllocated;
+} YORI_SH_DIRECTORY_CACHE, *PYORI_SH_DIRECTORY_CACHE;
+
+/**
+ A single background enumeration of a directory.  This is shared between
+ the input thread and the thread performing the enumeration, and is freed
+ when both are finished with it, so that the input thread never needs to
+ wait for an enumeration that it is no longer interested in.
+ */
+typedef struct _YORI_SH_DIRECTORY_CACHE_BUILD {
+
+    /**
+     The number of references to this structure.  One is held by the thread
+     performing the enumeration and one by the input thread while it is
+     tracking the enumeration.
+     */
+    LONG ReferenceCount;
+
+    /**
+     Set to TRUE to indicate the background thread should stop enumerating
+     and discard its result because it is no longer needed.
+     */
+    BOOL volatile Terminate;
+
+    /**
+     The fully qualified path to the directory being enumerated.
+     */
+    YORI_STRING BuildPath;
+
+    /**
+     A handle to the cache mutex owned by this enumeration, so that it
+     remains valid if the input thread closes its handle first.
+     */
+    HANDLE Mutex;
+} YORI_SH_DIRECTORY_CACHE_BUILD, *PYORI_SH_DIRECTORY_CACHE_BUILD;
+
+/**
+ State for directory enumeration that is performed speculatively while the
+ user is typing so that a later tab completion can be satisfied from memory.
+ */
+typedef struct _YORI_SH_DIRECTORY_CACHE_STATE {
+
+    /**
+     A mutex which synchronizes the input thread with the background
+     enumeration when publishing a new cache.  The background thread only
+     holds this while publishing a result, and the input thread does not
+     wait for it, so if it is contended the cache is not used.
+     */
+    HANDLE Mutex;
+
+    /**
+     The most recently completed cache.  This can be NULL if no directory has
+     been enumerated.
+     */
+    PYORI_SH_DIRECTORY_CACHE Cache;
+
+    /**
+     A handle to a background thread enumerating a directory, or NULL if no
+     enumeration is being tracked.
+     */
+    HANDLE BuildThread;
+
+    /**
+     The enumeration being performed by BuildThread.
+     */
+    PYORI_SH_DIRECTORY_CACHE_BUILD Build;
+
+    /**
+     A copy of the input buffer when the directory to enumerate was last
+     determined, so the command need not be parsed again if the user has
+     not changed it.
+     */
+    YORI_STRING PrefetchString;
+
+    /**
+     The cursor offset within the input buffer when the directory to
+     enumerate was last determined, or -1 if the input should be parsed on
+     the next call regardless of its contents.
+     */
+    DWORD PrefetchOffset;
+} YORI_SH_DIRECTORY_CACHE_STATE, *PYORI_SH_DIRECTORY_CACHE_STATE;
+
+/**
+ Global state for speculative directory enumeration.
+ */
+YORI_SH_DIRECTORY_CACHE_STATE YoriShDirectoryCacheState;
+
+/**
+ Return a bitmask of the letters and digits within a string.  Each letter
+ maps to one bit irrespective of case, and all digits share one bit.
+
+ @param String Pointer to the string to generate a mask for.
+
+ @return The bitmask of characters present in the string.
+ */
+DWORD
+YoriShGetFuzzyCharMask(
+    __in PYORI_STRING String
+    )
+{
+    DWORD Index;
+    DWORD Mask;
+    TCHAR Char;
+
+    Mask = 0;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Char = YoriLibUpcaseChar(String->StartOfString[Index]);
+        if (Char >= 'A' && Char <= 'Z') {
+            Mask |= (1 << (Char - 'A'));
+        } else if (Char >= '0' && Char <= '9') {
+            Mask |= (1 << 26);
+        }
+    }
+
+    return Mask;
+}
+
+/**
+ Free a cached directory listing.
+
+ @param Cache Pointer to the cache to free.
+ */
+VOID
+YoriShFreeDirectoryCache(
+    __in PYORI_SH_DIRECTORY_CACHE Cache
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < Cache->EntryCount; Index++) {
+        YoriLibFreeStringContents(&Cache->Entries[Index].LongName);
+    }
+
+    if (Cache->Entries != NULL) {
+        YoriLibFree(Cache->Entries);
+    }
+
+    if (Cache->ChangeNotification != NULL) {
+        FindCloseChangeNotification(Cache->ChangeNotification);
+    }
+
+    YoriLibFreeStringContents(&Cache->DirectoryPath);
+    YoriLibFree(Cache);
+}
+
+/**
+ Return TRUE if a cached directory listing no longer reflects the contents
+ of the directory.
+
+ @param Cache Pointer to the cache to check.
+
+ @return TRUE if the cache should be discarded, FALSE if it is current.
+ */
+BOOL
+YoriShIsDirectoryCacheStale(
+    __in PYORI_SH_DIRECTORY_CACHE Cache
+    )
+{
+    if (Cache->ChangeNotification == NULL ||
+        WaitForSingleObject(Cache->ChangeNotification, 0) != WAIT_TIMEOUT) {
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Enumerate the contents of a directory into a new cache.
+
+ @param DirectoryPath Pointer to the fully qualified path to the directory.
+
+ @param Terminate Optionally points to a flag which, if set to TRUE while
+        enumerating, causes the enumeration to be abandoned.
+
+ @return Pointer to the newly allocated cache, or NULL on failure.
+ */
+PYORI_SH_DIRECTORY_CACHE
+YoriShBuildDirectoryCache(
+    __in PYORI_STRING DirectoryPath,
+    __in_opt BOOL volatile * Terminate
+    )
+{
+    PYORI_SH_DIRECTORY_CACHE Cache;
+    PYORI_SH_DIRECTORY_CACHE_ENTRY Entry;
+    PYORI_SH_DIRECTORY_CACHE_ENTRY NewEntries;
+    WIN32_FIND_DATA FindData;
+    YORI_STRING SearchPath;
+    HANDLE hFind;
+    DWORD LongLength;
+    DWORD ShortLength;
+    DWORD NewAllocated;
+
+    Cache = YoriLibMalloc(sizeof(YORI_SH_DIRECTORY_CACHE));
+    if (Cache == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Cache, sizeof(YORI_SH_DIRECTORY_CACHE));
+    if (!YoriLibAllocateString(&Cache->DirectoryPath, DirectoryPath->LengthInChars + 1)) {
+        YoriLibFree(Cache);
+        return NULL;
+    }
+    Cache->DirectoryPath.LengthInChars = YoriLibSPrintf(Cache->DirectoryPath.StartOfString, _T("%y"), DirectoryPath);
+
+    //
+    //  Register for changes before enumerating, so that anything which
+    //  changes during enumeration causes the result to be considered
+    //  stale.
+    //
+
+    Cache->ChangeNotification = FindFirstChangeNotification(Cache->DirectoryPath.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+    if (Cache->ChangeNotification == INVALID_HANDLE_VALUE) {
+        Cache->ChangeNotification = NULL;
+        YoriShFreeDirectoryCache(Cache);
+        return NULL;
+    }
+
+    if (!YoriLibAllocateString(&SearchPath, DirectoryPath->LengthInChars + 3)) {
+        YoriShFreeDirectoryCache(Cache);
+        return NULL;
+    }
+    SearchPath.LengthInChars = YoriLibSPrintf(SearchPath.StartOfString, _T("%y\\*"), DirectoryPath);
+
+    hFind = FindFirstFile(SearchPath.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchPath);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        YoriShFreeDirectoryCache(Cache);
+        return NULL;
+    }
+
+    do {
+        if (Terminate != NULL && *Terminate) {
+            FindClose(hFind);
+            YoriShFreeDirectoryCache(Cache);
+            return NULL;
+        }
+
+        if (_tcscmp(FindData.cFileName, _T(".")) == 0 ||
+            _tcscmp(FindData.cFileName, _T("..")) == 0) {
+
+            continue;
+        }
+
+        if (Cache->EntryCount == Cache->EntriesAllocated) {
+            NewAllocated = Cache->EntriesAllocated * 2;
+            if (NewAllocated < 256) {
+                NewAllocated = 256;
+            }
+            NewEntries = YoriLibMalloc(NewAllocated * sizeof(YORI_SH_DIRECTORY_CACHE_ENTRY));
+            if (NewEntries == NULL) {
+                FindClose(hFind);
+                YoriShFreeDirectoryCache(Cache);
+                return NULL;
+            }
+            if (Cache->Entries != NULL) {
+                memcpy(NewEntries, Cache->Entries, Cache->EntryCount * sizeof(YORI_SH_DIRECTORY_CACHE_ENTRY));
+                YoriLibFree(Cache->Entries);
+            }
+            Cache->Entries = NewEntries;
+            Cache->EntriesAllocated = NewAllocated;
+        }
+
+        LongLength = _tcslen(FindData.cFileName);
+        ShortLength = _tcslen(FindData.cAlternateFileName);
+
+        Entry = &Cache->Entries[Cache->EntryCount];
+        if (!YoriLibAllocateString(&Entry->LongName, LongLength + 1 + ShortLength + 1)) {
+            FindClose(hFind);
+            YoriShFreeDirectoryCache(Cache);
+            return NULL;
+        }
+
+        memcpy(Entry->LongName.StartOfString, FindData.cFileName, (LongLength + 1) * sizeof(TCHAR));
+        Entry->LongName.LengthInChars = LongLength;
+
+        YoriLibInitEmptyString(&Entry->ShortName);
+        Entry->ShortName.StartOfString = &Entry->LongName.StartOfString[LongLength + 1];
+        memcpy(Entry->ShortName.StartOfString, FindData.cAlternateFileName, (ShortLength + 1) * sizeof(TCHAR));
+        Entry->ShortName.LengthInChars = ShortLength;
+
+        Entry->FileAttributes = FindData.dwFileAttributes;
+        Entry->CharMask = YoriShGetFuzzyCharMask(&Entry->LongName);
+        Cache->EntryCount++;
+
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+    return Cache;
+}
+
+/**
+ Release a reference on a background enumeration, freeing it if this is the
+ final reference.
+
+ @param Build Pointer to the enumeration.
+ */
+VOID
+YoriShDereferenceDirectoryCacheBuild(
+    __in PYORI_SH_DIRECTORY_CACHE_BUILD Build
+    )
+{
+    if (InterlockedDecrement(&Build->ReferenceCount) == 0) {
+        YoriLibFreeStringContents(&Build->BuildPath);
+        CloseHandle(Build->Mutex);
+        YoriLibFree(Build);
+    }
+}
+
+/**
+ A background thread which enumerates a directory and publishes the result,
+ unless the enumeration has been abandoned.
+
+ @param Context Pointer to the enumeration to perform.  The thread owns a
+        reference to this which it releases when it completes.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriShDirectoryCacheBuildWorker(
+    __in LPVOID Context
+    )
+{
+    PYORI_SH_DIRECTORY_CACHE_BUILD Build;
+    PYORI_SH_DIRECTORY_CACHE Cache;
+    PYORI_SH_DIRECTORY_CACHE OldCache;
+
+    Build = (PYORI_SH_DIRECTORY_CACHE_BUILD)Context;
+
+    Cache = YoriShBuildDirectoryCache(&Build->BuildPath, &Build->Terminate);
+    if (Cache == NULL) {
+        YoriShDereferenceDirectoryCacheBuild(Build);
+        return 0;
+    }
+
+    //
+    //  Check for abandonment with the mutex held, so that once the input
+    //  thread has abandoned the enumeration and acquired the mutex, this
+    //  thread cannot publish a result.
+    //
+
+    OldCache = NULL;
+    WaitForSingleObject(Build->Mutex, INFINITE);
+    if (!Build->Terminate) {
+        OldCache = YoriShDirectoryCacheState.Cache;
+        YoriShDirectoryCacheState.Cache = Cache;
+        Cache = NULL;
+    }
+    ReleaseMutex(Build->Mutex);
+
+    if (OldCache != NULL) {
+        YoriShFreeDirectoryCache(OldCache);
+    }
+
+    if (Cache != NULL) {
+        YoriShFreeDirectoryCache(Cache);
+    }
+
+    YoriShDereferenceDirectoryCacheBuild(Build);
+    return 0;
+}
+
+/**
+ Stop tracking any background enumeration.  This never waits for the
+ enumeration; the background thread releases its resources when it
+ completes.
+
+ @param Abandon If TRUE, the background thread is told to stop enumerating
+        and discard its result because it is not needed.  If FALSE, it is
+        allowed to complete and publish its result.
+ */
+VOID
+YoriShDetachDirectoryCacheBuild(
+    __in BOOL Abandon
+    )
+{
+    if (YoriShDirectoryCacheState.BuildThread == NULL) {
+        return;
+    }
+
+    if (Abandon) {
+        YoriShDirectoryCacheState.Build->Terminate = TRUE;
+    }
+
+    CloseHandle(YoriShDirectoryCacheState.BuildThread);
+    YoriShDirectoryCacheState.BuildThread = NULL;
+    YoriShDereferenceDirectoryCacheBuild(YoriShDirectoryCacheState.Build);
+    YoriShDirectoryCacheState.Build = NULL;
+}
+
+/**
+ If a background enumeration has completed, stop tracking it, so that its
+ result can be found in the cache.
+ */
+VOID
+YoriShReapDirectoryCacheBuild(VOID)
+{
+    if (YoriShDirectoryCacheState.BuildThread != NULL &&
+        WaitForSingleObject(YoriShDirectoryCacheState.BuildThread, 0) == WAIT_OBJECT_0) {
+
+        YoriShDetachDirectoryCacheBuild(FALSE);
+    }
+}
+
+/**
+ Resolve the directory that a file tab completion would search in.  This
+ follows the same rules as file enumeration, so the result can be compared
+ against a cached directory.
+
+ @param SearchString Pointer to the string being completed.
+
+ @param CharsToFinalSlash The number of characters in SearchString up to and
+        including the final seperator.
+
+ @param DirectoryPath On successful completion, populated with the fully
+        qualified path to the directory, without a trailing seperator.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShResolveCompletionDirectory(
+    __in PYORI_STRING SearchString,
+    __in DWORD CharsToFinalSlash,
+    __out PYORI_STRING DirectoryPath
+    )
+{
+    YORI_STRING DirectoryPart;
+    DWORD Index;
+
+    YoriLibInitEmptyString(&DirectoryPart);
+    YoriLibInitEmptyString(DirectoryPath);
+
+    //
+    //  Wildcards in the directory part or streams aren't handled by the
+    //  cache.  A colon is only expected as part of a drive letter.
+    //
+
+    for (Index = 0; Index < CharsToFinalSlash; Index++) {
+        if (SearchString->StartOfString[Index] == '*' ||
+            SearchString->StartOfString[Index] == '?' ||
+            (SearchString->StartOfString[Index] == ':' && Index != 1)) {
+
+            return FALSE;
+        }
+    }
+
+    if (CharsToFinalSlash > 0) {
+        DirectoryPart.StartOfString = SearchString->StartOfString;
+        DirectoryPart.LengthInChars = CharsToFinalSlash;
+
+        if ((DirectoryPart.LengthInChars > 3 ||
+             !YoriLibIsDriveLetterWithColonAndSlash(&DirectoryPart)) &&
+            DirectoryPart.LengthInChars > 1 &&
+            YoriLibIsSep(DirectoryPart.StartOfString[DirectoryPart.LengthInChars - 1])) {
+
+            DirectoryPart.LengthInChars--;
+        }
+    } else {
+        YoriLibConstantString(&DirectoryPart, _T("."));
+    }
+
+    if (!YoriLibGetFullPathNameReturnAllocation(&DirectoryPart, TRUE, DirectoryPath, NULL)) {
+        return FALSE;
+    }
+
+    if (DirectoryPath->LengthInChars > 0 &&
+        YoriLibIsSep(DirectoryPath->StartOfString[DirectoryPath->LengthInChars - 1])) {
+
+        DirectoryPath->LengthInChars--;
+        DirectoryPath->StartOfString[DirectoryPath->LengthInChars] = '\0';
+    }
+
+    return TRUE;
+}
+
+/**
+ Return TRUE if the portion of a search string following the final
+ seperator can be evaluated against a cached directory.  This requires the
+ string to be a literal prefix followed by a single trailing '*', without
+ any characters that imply streams or heuristic prefixes.
+
+ @param SearchString Pointer to the search string.
+
+ @param CharsToFinalSlash The number of characters in SearchString up to and
+        including the final seperator.
+
+ @return TRUE if the string can be evaluated against a cached directory.
+ */
+BOOL
+YoriShIsSearchStringCacheable(
+    __in PYORI_STRING SearchString,
+    __in DWORD CharsToFinalSlash
+    )
+{
+    DWORD Index;
+    TCHAR Char;
+
+    if (SearchString->LengthInChars <= CharsToFinalSlash ||
+        SearchString->StartOfString[SearchString->LengthInChars - 1] != '*') {
+
+        return FALSE;
+    }
+
+    for (Index = CharsToFinalSlash; Index < SearchString->LengthInChars - 1; Index++) {
+        Char = SearchString->StartOfString[Index];
+        if (Char == '*' || Char == '?' || Char == '[' || Char == '{' ||
+            Char == ':' || Char == '=' || Char == '>' || Char == '<' ||
+            Char == '\'' || Char == '%') {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Obtain the cached contents of a directory.  This never waits for a
+ background enumeration, so if the directory is still being enumerated, it
+ is treated as not cached.  On success the cache is returned with the cache
+ mutex held, and the caller must call @ref YoriShReleaseDirectoryCache .
+
+ @param DirectoryPath Pointer to the fully qualified path of the directory.
+
+ @param BuildIfMissing If TRUE, and no current cache exists for the
+        directory, the directory is enumerated synchronously.  If FALSE,
+        NULL is returned and the caller is expected to search the directory
+        itself.
+
+ @return Pointer to the cache, or NULL if no cache is available.
+ */
+PYORI_SH_DIRECTORY_CACHE
+YoriShAcquireDirectoryCache(
+    __in PYORI_STRING DirectoryPath,
+    __in BOOL BuildIfMissing
+    )
+{
+    PYORI_SH_DIRECTORY_CACHE Cache;
+
+    if (YoriShDirectoryCacheState.Mutex == NULL) {
+        YoriShDirectoryCacheState.Mutex = CreateMutex(NULL, FALSE, NULL);
+        if (YoriShDirectoryCacheState.Mutex == NULL) {
+            return NULL;
+        }
+    }
+
+    //
+    //  If a background enumeration has completed, its result is in the
+    //  cache.  If one is still running and the directory is about to be
+    //  enumerated here, its result is no longer needed.
+    //
+
+    YoriShReapDirectoryCacheBuild();
+    if (BuildIfMissing) {
+        YoriShDetachDirectoryCacheBuild(TRUE);
+    }
+
+    if (WaitForSingleObject(YoriShDirectoryCacheState.Mutex, 0) != WAIT_OBJECT_0) {
+        return NULL;
+    }
+
+    Cache = YoriShDirectoryCacheState.Cache;
+    if (Cache != NULL &&
+        YoriLibCompareStringInsensitive(&Cache->DirectoryPath, DirectoryPath) == 0 &&
+        !YoriShIsDirectoryCacheStale(Cache)) {
+
+        return Cache;
+    }
+
+    if (!BuildIfMissing) {
+        ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+        return NULL;
+    }
+
+    Cache = YoriShBuildDirectoryCache(DirectoryPath, NULL);
+    if (Cache == NULL) {
+        ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+        return NULL;
+    }
+
+    if (YoriShDirectoryCacheState.Cache != NULL) {
+        YoriShFreeDirectoryCache(YoriShDirectoryCacheState.Cache);
+    }
+    YoriShDirectoryCacheState.Cache = Cache;
+    return Cache;
+}
+
+/**
+ Release a cache previously obtained with @ref YoriShAcquireDirectoryCache .
+ */
+VOID
+YoriShReleaseDirectoryCache(VOID)
+{
+    ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+}
+
+/**
+ Indicate a single cached object to the file tab completion callback as if
+ it had been found by enumerating the directory.
+
+ @param Cache Pointer to the cached directory containing the object.
+
+ @param Entry Pointer to the cached object.
+
+ @param FullPath Pointer to a string with enough space to contain the full
+        path to any object within the directory.
+
+ @param EnumContext Pointer to the file completion context.
+
+ @return TRUE to continue, FALSE to stop.
+ */
+BOOL
+YoriShReportCachedFile(
+    __in PYORI_SH_DIRECTORY_CACHE Cache,
+    __in PYORI_SH_DIRECTORY_CACHE_ENTRY Entry,
+    __inout PYORI_STRING FullPath,
+    __in PYORI_SH_FILE_COMPLETE_CONTEXT EnumContext
+    )
+{
+    WIN32_FIND_DATA FindData;
+
+    ZeroMemory(&FindData, sizeof(FindData));
+    FindData.dwFileAttributes = Entry->FileAttributes;
+    YoriLibSPrintfS(FindData.cFileName, sizeof(FindData.cFileName)/sizeof(FindData.cFileName[0]), _T("%y"), &Entry->LongName);
+    YoriLibSPrintfS(FindData.cAlternateFileName, sizeof(FindData.cAlternateFileName)/sizeof(FindData.cAlternateFileName[0]), _T("%y"), &Entry->ShortName);
+
+    FullPath->LengthInChars = YoriLibSPrintfS(FullPath->StartOfString, FullPath->LengthAllocated, _T("%y\\%y"), &Cache->DirectoryPath, &Entry->LongName);
+
+    return YoriShFileTabCompletionCallback(FullPath, &FindData, 0, EnumContext);
+}
+
+/**
+ Attempt to satisfy a file tab completion from a cached directory listing
+ rather than enumerating the file system.
+
+ @param SearchString The string to search for, which ends with a trailing
+        '*' character.
+
+ @param MatchFlags The flags indicating whether files and/or directories
+        should be returned.
+
+ @param EnumContext Pointer to the file completion context.
+
+ @param Handled On successful completion, set to TRUE if the search was
+        performed against the cache, or FALSE if the caller should enumerate
+        the file system.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShForEachCachedFile(
+    __in PYORI_STRING SearchString,
+    __in DWORD MatchFlags,
+    __in PYORI_SH_FILE_COMPLETE_CONTEXT EnumContext,
+    __out PBOOL Handled
+    )
+{
+    PYORI_SH_DIRECTORY_CACHE Cache;
+    PYORI_SH_DIRECTORY_CACHE_ENTRY Entry;
+    YORI_STRING DirectoryPath;
+    YORI_STRING FilePart;
+    YORI_STRING FullPath;
+    DWORD CharsToFinalSlash;
+    DWORD Index;
+    BOOL Result;
+
+    *Handled = FALSE;
+
+    CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(SearchString);
+    if (!YoriShIsSearchStringCacheable(SearchString, CharsToFinalSlash)) {
+        return TRUE;
+    }
+
+    if (!YoriShResolveCompletionDirectory(SearchString, CharsToFinalSlash, &DirectoryPath)) {
+        return TRUE;
+    }
+
+    Cache = YoriShAcquireDirectoryCache(&DirectoryPath, FALSE);
+    YoriLibFreeStringContents(&DirectoryPath);
+    if (Cache == NULL) {
+        return TRUE;
+    }
+
+    if (!YoriLibAllocateString(&FullPath, Cache->DirectoryPath.LengthInChars + 1 + MAX_PATH + 1)) {
+        YoriShReleaseDirectoryCache();
+        return TRUE;
+    }
+
+    *Handled = TRUE;
+
+    YoriLibInitEmptyString(&FilePart);
+    FilePart.StartOfString = &SearchString->StartOfString[CharsToFinalSlash];
+    FilePart.LengthInChars = SearchString->LengthInChars - CharsToFinalSlash - 1;
+
+    Result = TRUE;
+    for (Index = 0; Index < Cache->EntryCount; Index++) {
+        Entry = &Cache->Entries[Index];
+        if ((Entry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+            if ((MatchFlags & YORILIB_FILEENUM_RETURN_DIRECTORIES) == 0) {
+                continue;
+            }
+        } else {
+            if ((MatchFlags & YORILIB_FILEENUM_RETURN_FILES) == 0) {
+                continue;
+            }
+        }
+
+        if (YoriLibCompareStringInsensitiveCount(&Entry->LongName, &FilePart, FilePart.LengthInChars) != 0 &&
+            (Entry->ShortName.LengthInChars == 0 ||
+             YoriLibCompareStringInsensitiveCount(&Entry->ShortName, &FilePart, FilePart.LengthInChars) != 0)) {
+
+            continue;
+        }
+
+        if (!YoriShReportCachedFile(Cache, Entry, &FullPath, EnumContext)) {
+            Result = FALSE;
+            break;
+        }
+    }
+
+    YoriShReleaseDirectoryCache();
+    YoriLibFreeStringContents(&FullPath);
+    return Result;
+}
+
+/**
+ Return TRUE if a character begins a new word within a file name, which
+ makes a fuzzy match at that position more significant.
+
+ @param Name Pointer to the file name.
+
+ @param Index The index of the character within the file name.
+
+ @return TRUE if the character begins a word, FALSE if it does not.
+ */
+BOOL
+YoriShIsFuzzyWordStart(
+    __in PYORI_STRING Name,
+    __in DWORD Index
+    )
+{
+    TCHAR Prior;
+    TCHAR Char;
+
+    if (Index == 0) {
+        return TRUE;
+    }
+
+    Prior = Name->StartOfString[Index - 1];
+    Char = Name->StartOfString[Index];
+    if (Prior == '.' || Prior == '_' || Prior == '-' || Prior == ' ') {
+        return TRUE;
+    }
+
+    if (Prior >= 'a' && Prior <= 'z' && Char >= 'A' && Char <= 'Z') {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Check whether every character in a search string occurs within a file
+ name in order, and if so, generate a score indicating the quality of the
+ match.  Matches at the beginning of words and consecutive matches score
+ higher, and long names are penalized slightly.
+
+ @param Pattern Pointer to the string being searched for.
+
+ @param Name Pointer to the candidate file name.
+
+ @param Score On successful completion, updated to contain the score of the
+        match.
+
+ @return TRUE if the name contains the pattern as a subsequence, FALSE if
+         it does not.
+ */
+__success(return)
+BOOL
+YoriShFuzzyMatch(
+    __in PYORI_STRING Pattern,
+    __in PYORI_STRING Name,
+    __out PLONG Score
+    )
+{
+    DWORD PatternIndex;
+    DWORD NameIndex;
+    DWORD PriorMatch;
+    LONG ThisScore;
+
+    ThisScore = 0;
+    PatternIndex = 0;
+    PriorMatch = (DWORD)-1;
+
+    for (NameIndex = 0; NameIndex < Name->LengthInChars && PatternIndex < Pattern->LengthInChars; NameIndex++) {
+        if (YoriLibUpcaseChar(Name->StartOfString[NameIndex]) != YoriLibUpcaseChar(Pattern->StartOfString[PatternIndex])) {
+            continue;
+        }
+
+        ThisScore += 16;
+        if (YoriShIsFuzzyWordStart(Name, NameIndex)) {
+            ThisScore += 32;
+        }
+        if (PriorMatch != (DWORD)-1 && PriorMatch + 1 == NameIndex) {
+            ThisScore += 24;
+        }
+        PriorMatch = NameIndex;
+        PatternIndex++;
+    }
+
+    if (PatternIndex < Pattern->LengthInChars) {
+        return FALSE;
+    }
+
+    ThisScore -= (LONG)(Name->LengthInChars - Pattern->LengthInChars);
+    *Score = ThisScore;
+    return TRUE;
+}
+
+/**
+ A name that has been used recently, along with a weight indicating how
+ often and how recently it was used.
+ */
+typedef struct _YORI_SH_FRECENCY_ENTRY {
+
+    /**
+     The hash entry for this name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The accumulated weight of this name.
+     */
+    DWORD Weight;
+} YORI_SH_FRECENCY_ENTRY, *PYORI_SH_FRECENCY_ENTRY;
+
+/**
+ A table of names that have been used recently, used to rank fuzzy matches.
+ */
+typedef struct _YORI_SH_FRECENCY_TABLE {
+
+    /**
+     The history strings that names within the table refer to.
+     */
+    YORI_STRING HistoryStrings;
+
+    /**
+     A hash table of names, pointing to entries in the Entries array.
+     */
+    PYORI_HASH_TABLE HashTable;
+
+    /**
+     An array of entries.
+     */
+    PYORI_SH_FRECENCY_ENTRY Entries;
+
+    /**
+     The number of populated elements in the Entries array.
+     */
+    DWORD EntryCount;
+} YORI_SH_FRECENCY_TABLE, *PYORI_SH_FRECENCY_TABLE;
+
+/**
+ Free the contents of a table of recently used names.
+
+ @param Table Pointer to the table to free.
+ */
+VOID
+YoriShFreeFrecencyTable(
+    __in PYORI_SH_FRECENCY_TABLE Table
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < Table->EntryCount; Index++) {
+        YoriLibHashRemoveByEntry(&Table->Entries[Index].HashEntry);
+    }
+
+    if (Table->HashTable != NULL) {
+        YoriLibFreeEmptyHashTable(Table->HashTable);
+    }
+
+    if (Table->Entries != NULL) {
+        YoriLibFree(Table->Entries);
+    }
+
+    YoriLibFreeStringContents(&Table->HistoryStrings);
+}
+
+/**
+ Build a table of the final path components of every argument used within
+ recent history.  Each time a name is used its weight increases, with more
+ recent uses increasing the weight more.
+
+ @param Table On successful completion, populated with the table of names.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShBuildFrecencyTable(
+    __out PYORI_SH_FRECENCY_TABLE Table
+    )
+{
+    LPTSTR ThisLine;
+    DWORD LineCount;
+    DWORD LineIndex;
+    DWORD TokenCount;
+    DWORD Index;
+    DWORD Start;
+    DWORD LineLength;
+    YORI_STRING Token;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_FRECENCY_ENTRY Entry;
+
+    ZeroMemory(Table, sizeof(YORI_SH_FRECENCY_TABLE));
+    YoriLibInitEmptyString(&Table->HistoryStrings);
+
+    if (!YoriShGetHistoryStrings(YORI_SH_FRECENCY_HISTORY_LINES, &Table->HistoryStrings)) {
+        return FALSE;
+    }
+
+    //
+    //  Every token is at least one character followed by a seperator, so
+    //  this bounds the number of entries.
+    //
+
+    LineCount = 0;
+    TokenCount = 0;
+    ThisLine = Table->HistoryStrings.StartOfString;
+    while (*ThisLine != '\0') {
+        LineLength = _tcslen(ThisLine);
+        TokenCount += LineLength / 2 + 1;
+        LineCount++;
+        ThisLine += LineLength + 1;
+    }
+
+    Table->HashTable = YoriLibAllocateHashTable(TokenCount / 4 + 1);
+    Table->Entries = YoriLibMalloc(TokenCount * sizeof(YORI_SH_FRECENCY_ENTRY));
+    if (Table->HashTable == NULL || Table->Entries == NULL) {
+        YoriShFreeFrecencyTable(Table);
+        return FALSE;
+    }
+
+    LineIndex = 0;
+    ThisLine = Table->HistoryStrings.StartOfString;
+    while (*ThisLine != '\0') {
+        LineLength = _tcslen(ThisLine);
+        LineIndex++;
+
+        Index = 0;
+        while (Index < LineLength) {
+            while (Index < LineLength && (ThisLine[Index] == ' ' || ThisLine[Index] == '"')) {
+                Index++;
+            }
+            Start = Index;
+            while (Index < LineLength && ThisLine[Index] != ' ' && ThisLine[Index] != '"') {
+                Index++;
+            }
+
+            YoriLibInitEmptyString(&Token);
+            Token.StartOfString = &ThisLine[Start];
+            Token.LengthInChars = Index - Start;
+            Token.MemoryToFree = Table->HistoryStrings.MemoryToFree;
+
+            while (Token.LengthInChars > 0 && YoriLibIsSep(Token.StartOfString[Token.LengthInChars - 1])) {
+                Token.LengthInChars--;
+            }
+
+            Start = YoriShFindFinalSlashIfSpecified(&Token);
+            Token.StartOfString += Start;
+            Token.LengthInChars -= Start;
+
+            if (Token.LengthInChars == 0) {
+                continue;
+            }
+
+            //
+            //  Older lines contribute less.  Every use contributes something,
+            //  so frequently used names rank highly even if they haven't
+            //  been used recently.
+            //
+
+            HashEntry = YoriLibHashLookupByKey(Table->HashTable, &Token);
+            if (HashEntry != NULL) {
+                Entry = HashEntry->Context;
+            } else {
+                ASSERT(Table->EntryCount < TokenCount);
+                Entry = &Table->Entries[Table->EntryCount];
+                Entry->Weight = 0;
+                YoriLibHashInsertByKey(Table->HashTable, &Token, Entry, &Entry->HashEntry);
+                Table->EntryCount++;
+            }
+
+            Entry->Weight += 4 + (LineIndex * 60) / LineCount;
+        }
+
+        ThisLine += LineLength + 1;
+    }
+
+    return TRUE;
+}
+
+/**
+ A candidate fuzzy match with its score.
+ */
+typedef struct _YORI_SH_FUZZY_CANDIDATE {
+
+    /**
+     Pointer to the cached object that matched.
+     */
+    PYORI_SH_DIRECTORY_CACHE_ENTRY Entry;
+
+    /**
+     The score of the match, including its history weight.
+     */
+    LONG Score;
+} YORI_SH_FUZZY_CANDIDATE, *PYORI_SH_FUZZY_CANDIDATE;
+
+/**
+ Populate tab completion matches with objects whose names contain the
+ search string as a subsequence.  This is used when no object has the
+ search string as a prefix.  Matches are ranked by the quality of the
+ match and by how frequently and recently the name has been used in
+ history, and only the highest ranked matches are returned.
+
+ @param SearchString The string to search for, which ends with a trailing
+        '*' character.
+
+ @param MatchFlags The flags indicating whether files and/or directories
+        should be returned.
+
+ @param EnumContext Pointer to the file completion context.
+ */
+VOID
+YoriShPerformFuzzyFileTabCompletion(
+    __in PYORI_STRING SearchString,
+    __in DWORD MatchFlags,
+    __in PYORI_SH_FILE_COMPLETE_CONTEXT EnumContext
+    )
+{
+    PYORI_SH_DIRECTORY_CACHE Cache;
+    PYORI_SH_DIRECTORY_CACHE_ENTRY Entry;
+    YORI_SH_FUZZY_CANDIDATE Candidates[YORI_SH_FUZZY_MAX_MATCHES];
+    YORI_SH_FRECENCY_TABLE Frecency;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING DirectoryPath;
+    YORI_STRING Pattern;
+    YORI_STRING FullPath;
+    DWORD CandidateCount;
+    DWORD CharsToFinalSlash;
+    DWORD PatternMask;
+    DWORD Index;
+    DWORD Insert;
+    LONG Score;
+    BOOL HaveFrecency;
+    BOOL KeepCompletionsSorted;
+
+    CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(SearchString);
+    if (!YoriShIsSearchStringCacheable(SearchString, CharsToFinalSlash)) {
+        return;
+    }
 
-        YoriLibConstantString(&LongFileName, FileInfo->cFileName);
-        YoriLibConstantString(&ShortFileName, FileInfo->cAlternateFileName);
+    YoriLibInitEmptyString(&Pattern);
+    Pattern.StartOfString = &SearchString->StartOfString[CharsToFinalSlash];
+    Pattern.LengthInChars = SearchString->LengthInChars - CharsToFinalSlash - 1;
+    if (Pattern.LengthInChars < 2) {
+        return;
+    }
 
-        if (ShortFileName.LengthInChars == 0) {
-            FileNameToUse = &LongFileName;
-        } else {
-            YoriLibConstantString(&SearchAfterFinalSlash, &FileCompleteContext->SearchString[FileCompleteContext->CharsToFinalSlash]);
-            ASSERT(SearchAfterFinalSlash.LengthInChars > 0);
-            if (YoriLibDoesFileMatchExpression(&LongFileName, &SearchAfterFinalSlash)) {
-                FileNameToUse = &LongFileName;
-            } else if (YoriLibDoesFileMatchExpression(&ShortFileName, &SearchAfterFinalSlash)) {
-                FileNameToUse = &ShortFileName;
-            } else {
+    if (!YoriShResolveCompletionDirectory(SearchString, CharsToFinalSlash, &DirectoryPath)) {
+        return;
+    }
 
-                //
-                //  If we can't match the long or the short name, it can be
-                //  because the expression contains extended path operators
-                //  such as {} or [].  In order to use these with suggestions
-                //  this code would need to be a lot smarter.  We could use
-                //  them for tab completion, but this piece of code can't
-                //  currently tell the difference.
-                //
+    Cache = YoriShAcquireDirectoryCache(&DirectoryPath, TRUE);
+    YoriLibFreeStringContents(&DirectoryPath);
+    if (Cache == NULL) {
+        return;
+    }
 
-                return TRUE;
+    HaveFrecency = YoriShBuildFrecencyTable(&Frecency);
+    PatternMask = YoriShGetFuzzyCharMask(&Pattern);
+    CandidateCount = 0;
+
+    for (Index = 0; Index < Cache->EntryCount; Index++) {
+        Entry = &Cache->Entries[Index];
+        if ((Entry->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+            if ((MatchFlags & YORILIB_FILEENUM_RETURN_DIRECTORIES) == 0) {
+                continue;
+            }
+        } else {
+            if ((MatchFlags & YORILIB_FILEENUM_RETURN_FILES) == 0) {
+                continue;
             }
         }
 
         //
-        //  Allocate a match entry for this file.
+        //  Reject anything that doesn't contain every letter in the pattern
+        //  before comparing character by character.
         //
 
-        Match = YoriLibReferencedMalloc(sizeof(YORI_SH_TAB_COMPLETE_MATCH) + (FileCompleteContext->Prefix.LengthInChars + FileCompleteContext->CharsToFinalSlash + FileNameToUse->LengthInChars + 1 + FileCompleteContext->Suffix.LengthInChars + 1) * sizeof(TCHAR));
-        if (Match == NULL) {
-            return FALSE;
+        if ((Entry->CharMask & PatternMask) != PatternMask) {
+            continue;
         }
 
-        //
-        //  Populate the file into the entry.
-        //
-
-        YoriLibInitEmptyString(&Match->Value);
-        Match->Value.StartOfString = (LPTSTR)(Match + 1);
-        YoriLibReference(Match);
-        Match->Value.MemoryToFree = Match;
-
-        YoriLibInitEmptyString(&StringToFinalSlash);
-        StringToFinalSlash.StartOfString = FileCompleteContext->SearchString;
-        StringToFinalSlash.LengthInChars = FileCompleteContext->CharsToFinalSlash;
-
+        if (!YoriShFuzzyMatch(&Pattern, &Entry->LongName, &Score)) {
+            continue;
+        }
 
-        if (FileCompleteContext->Suffix.LengthInChars > 0) {
-            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y\\%y"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse, &FileCompleteContext->Suffix);
-            Match->CursorOffset = Match->Value.LengthInChars - FileCompleteContext->Suffix.LengthInChars;
-        } else if ((FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
-                   YoriShGlobal.CompletionTrailingSlash) {
-            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y\\"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse);
-            Match->CursorOffset = Match->Value.LengthInChars;
-        } else {
-            Match->Value.LengthInChars = YoriLibSPrintf(Match->Value.StartOfString, _T("%y%y%y"), &FileCompleteContext->Prefix, &StringToFinalSlash, FileNameToUse);
-            Match->CursorOffset = Match->Value.LengthInChars;
+        if (HaveFrecency) {
+            HashEntry = YoriLibHashLookupByKey(Frecency.HashTable, &Entry->LongName);
+            if (HashEntry != NULL) {
+                Score += ((PYORI_SH_FRECENCY_ENTRY)HashEntry->Context)->Weight;
+            }
         }
 
-        Match->Value.LengthAllocated = Match->Value.LengthInChars + 1;
-    }
+        //
+        //  Keep the candidate array sorted from highest to lowest score,
+        //  discarding the lowest once the array is full.
+        //
 
-    //
-    //  Insert into the list.  Don't insert if an entry with the same
-    //  string is found.  If maintaining sorting, insert before an entry
-    //  that is greater than this one.
-    //
+        if (CandidateCount == YORI_SH_FUZZY_MAX_MATCHES) {
+            if (Score <= Candidates[CandidateCount - 1].Score) {
+                continue;
+            }
+            CandidateCount--;
+        }
 
-    if (!FileCompleteContext->KeepCompletionsSorted) {
-        PYORI_HASH_ENTRY PriorEntry;
-        PriorEntry = YoriLibHashLookupByKey(FileCompleteContext->TabContext->MatchHashTable, &Match->Value);
-        if (PriorEntry == NULL) {
-            YoriShAddMatchToTabContextAtEnd(FileCompleteContext->TabContext, Match);
-        } else {
-            YoriLibFreeStringContents(&Match->Value);
-            YoriLibDereference(Match);
-            Match = NULL;
+        Insert = CandidateCount;
+        while (Insert > 0 && Candidates[Insert - 1].Score < Score) {
+            Candidates[Insert] = Candidates[Insert - 1];
+            Insert--;
         }
-    } else {
-        ListEntry = YoriLibGetPreviousListEntry(&FileCompleteContext->TabContext->MatchList, NULL);
-        do {
-            if (ListEntry == NULL) {
-                YoriShAddMatchToTabContext(FileCompleteContext->TabContext, NULL, Match);
-                break;
-            }
-            Existing = CONTAINING_RECORD(ListEntry, YORI_SH_TAB_COMPLETE_MATCH, ListEntry);
-            CompareResult = YoriLibCompareStringInsensitive(&Match->Value, &Existing->Value);
-            if (CompareResult > 0) {
-                YoriShAddMatchToTabContext(FileCompleteContext->TabContext, ListEntry, Match);
-                break;
-            } else if (CompareResult == 0) {
-                YoriLibFreeStringContents(&Match->Value);
-                YoriLibDereference(Match);
-                Match = NULL;
-                break;
-            }
-            ListEntry = YoriLibGetPreviousListEntry(&FileCompleteContext->TabContext->MatchList, ListEntry);
-        } while(TRUE);
+        Candidates[Insert].Entry = Entry;
+        Candidates[Insert].Score = Score;
+        CandidateCount++;
     }
 
-    if (Match != NULL) {
-        FileCompleteContext->FilesFound++;
+    if (HaveFrecency) {
+        YoriShFreeFrecencyTable(&Frecency);
     }
 
-    return TRUE;
-}
-
-/**
- A callback that is invoked when a directory cannot be successfully enumerated.
- This routine checks for errors that seem sufficiently permanent that no
- further heuristic matching should be performed.
-
- @param FilePath Pointer to the file path that could not be enumerated.
-
- @param ErrorCode The Win32 error code describing the failure.
-
- @param Depth Recursion depth, ignored in this application.
-
- @param Context Pointer to the file enumeration context.
+    if (CandidateCount > 0 &&
+        YoriLibAllocateString(&FullPath, Cache->DirectoryPath.LengthInChars + 1 + MAX_PATH + 1)) {
 
- @return TRUE to continute enumerating, FALSE to abort.
- */
-BOOL
-YoriShFileTabCompletionErrorCallback(
-    __in PYORI_STRING FilePath,
-    __in DWORD ErrorCode,
-    __in DWORD Depth,
-    __in PVOID Context
-    )
-{
-    PYORI_SH_FILE_COMPLETE_CONTEXT FileCompleteContext = (PYORI_SH_FILE_COMPLETE_CONTEXT)Context;
+        //
+        //  Add matches in ranked order rather than sorting them by name.
+        //
 
-    UNREFERENCED_PARAMETER(FilePath);
-    UNREFERENCED_PARAMETER(Depth);
+        KeepCompletionsSorted = EnumContext->KeepCompletionsSorted;
+        EnumContext->KeepCompletionsSorted = FALSE;
+        EnumContext->FuzzyMatch = TRUE;
 
-    if (ErrorCode == ERROR_BAD_NET_NAME ||
-        ErrorCode == ERROR_NETNAME_DELETED ||
-        ErrorCode == ERROR_NETWORK_ACCESS_DENIED ||
-        ErrorCode == ERROR_BAD_NETPATH) {
+        for (Index = 0; Index < CandidateCount; Index++) {
+            if (!YoriShReportCachedFile(Cache, Candidates[Index].Entry, &FullPath, EnumContext)) {
+                break;
+            }
+        }
 
-        FileCompleteContext->AbortMatching = TRUE;
-        return FALSE;
+        EnumContext->FuzzyMatch = FALSE;
+        EnumContext->KeepCompletionsSorted = KeepCompletionsSorted;
+        YoriLibFreeStringContents(&FullPath);
     }
 
-    return TRUE;
+    YoriShReleaseDirectoryCache();
 }
 
 /**
@@ -1012,13 +2271,21 @@ YoriShFindMatchingStreamsForStringOrCursorPosition(
 {
     YORI_STRING FileMidpointSearchString;
     DWORD Index;
+    BOOL Handled;
 
     //
-    //  First check for a match for the whole string
+    //  First check for a match for the whole string.  If the directory
+    //  contents have already been enumerated, filter those rather than
+    //  enumerating again.
     //
 
     EnumContext->SearchString = SearchString->StartOfString;
-    if (!YoriLibForEachStream(SearchString, MatchFlags, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext)) {
+    if (!YoriShForEachCachedFile(SearchString, MatchFlags, EnumContext, &Handled)) {
+        return;
+    }
+
+    if (!Handled &&
+        !YoriLibForEachStream(SearchString, MatchFlags, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext)) {
         return;
     }
 
@@ -1194,6 +2461,7 @@ YoriShPerformFileTabCompletion(
     EnumContext.TabContext = TabContext;
     EnumContext.FilesFound = 0;
     EnumContext.AbortMatching = FALSE;
+    EnumContext.FuzzyMatch = FALSE;
 
     //
     //  Set flags indicating what to find
@@ -1237,6 +2505,21 @@ YoriShPerformFileTabCompletion(
         YoriShFindMatchingStreamsForStringOrCursorPosition(TabContext, &SearchString, MatchFlags, SearchStringOffset, &EnumContext);
     }
 
+    //
+    //  If nothing has the string as a prefix, look for objects containing
+    //  the characters in order.  This isn't done for suggestions, which
+    //  can only append to what the user has typed.
+    //
+
+    if (EnumContext.FilesFound == 0 &&
+        !EnumContext.AbortMatching &&
+        (TabContext->TabFlagsUsedCreatingList & YORI_SH_TAB_SUGGESTIONS) == 0) {
+
+        EnumContext.CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&SearchString);
+        EnumContext.SearchString = SearchString.StartOfString;
+        YoriShPerformFuzzyFileTabCompletion(&SearchString, MatchFlags, &EnumContext);
+    }
+
 
     //
     //  If we haven't found any matches against the literal file name, strip
@@ -2822,4 +4105,190 @@ YoriShCompleteSuggestion(
     YoriShFreeCmdContext(&CmdContext);
 }
 
+/**
+ Begin enumerating the directory that the argument under the cursor refers
+ to in the background, so that a later tab completion or suggestion can be
+ satisfied from memory.  This is called as the user types, so it never
+ waits for a background enumeration or for the cache to become available.
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShPrefetchTabCompletion(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    YORI_SH_CMD_CONTEXT CmdContext;
+    YORI_STRING BackquoteSubset;
+    DWORD OffsetInSubstring;
+    YORI_STRING PrefixBeforeBackquoteSubstring;
+    YORI_STRING SuffixAfterBackquoteSubstring;
+    YORI_STRING Arg;
+    YORI_STRING DirectoryPath;
+    PYORI_SH_DIRECTORY_CACHE Cache;
+    PYORI_SH_DIRECTORY_CACHE_BUILD Build;
+    DWORD CharsToFinalSlash;
+    DWORD ThreadId;
+
+    if (Buffer->TabContext.TabCount != 0) {
+        return;
+    }
+
+    //
+    //  If the input hasn't changed since the last call, such as when the
+    //  cursor blinks or the display is refreshed, the directory it refers
+    //  to hasn't changed either.
+    //
+
+    if (Buffer->CurrentOffset == YoriShDirectoryCacheState.PrefetchOffset &&
+        YoriLibCompareString(&Buffer->String, &YoriShDirectoryCacheState.PrefetchString) == 0) {
+
+        return;
+    }
+
+    if (YoriShDirectoryCacheState.PrefetchString.LengthAllocated < Buffer->String.LengthInChars) {
+        YoriLibFreeStringContents(&YoriShDirectoryCacheState.PrefetchString);
+        if (!YoriLibAllocateString(&YoriShDirectoryCacheState.PrefetchString, Buffer->String.LengthInChars + 64)) {
+            return;
+        }
+    }
+    memcpy(YoriShDirectoryCacheState.PrefetchString.StartOfString, Buffer->String.StartOfString, Buffer->String.LengthInChars * sizeof(TCHAR));
+    YoriShDirectoryCacheState.PrefetchString.LengthInChars = Buffer->String.LengthInChars;
+    YoriShDirectoryCacheState.PrefetchOffset = Buffer->CurrentOffset;
+
+    YoriShFindStringSubsetForCompletion(&Buffer->String,
+                                        Buffer->CurrentOffset,
+                                        YoriTabCompleteSearchFiles,
+                                        &BackquoteSubset,
+                                        &OffsetInSubstring,
+                                        &PrefixBeforeBackquoteSubstring,
+                                        &SuffixAfterBackquoteSubstring);
+
+    if (!YoriShParseCmdlineToCmdContext(&BackquoteSubset, OffsetInSubstring, TRUE, &CmdContext)) {
+        return;
+    }
+
+    YoriLibInitEmptyString(&Arg);
+    if (CmdContext.CurrentArg < CmdContext.ArgC) {
+        memcpy(&Arg, &CmdContext.ArgV[CmdContext.CurrentArg], sizeof(YORI_STRING));
+    }
+
+    CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&Arg);
+    if (!YoriShResolveCompletionDirectory(&Arg, CharsToFinalSlash, &DirectoryPath)) {
+        YoriShFreeCmdContext(&CmdContext);
+        return;
+    }
+    YoriShFreeCmdContext(&CmdContext);
+
+    if (YoriShDirectoryCacheState.Mutex == NULL) {
+        YoriShDirectoryCacheState.Mutex = CreateMutex(NULL, FALSE, NULL);
+        if (YoriShDirectoryCacheState.Mutex == NULL) {
+            YoriLibFreeStringContents(&DirectoryPath);
+            return;
+        }
+    }
+
+    //
+    //  If the directory is already being enumerated, there's nothing to do.
+    //  If a different directory is being enumerated, that result is no
+    //  longer interesting.
+    //
+
+    YoriShReapDirectoryCacheBuild();
+    if (YoriShDirectoryCacheState.BuildThread != NULL) {
+        if (YoriLibCompareStringInsensitive(&YoriShDirectoryCacheState.Build->BuildPath, &DirectoryPath) == 0) {
+            YoriLibFreeStringContents(&DirectoryPath);
+            return;
+        }
+        YoriShDetachDirectoryCacheBuild(TRUE);
+    }
+
+    //
+    //  If the directory has a current cache, there's nothing to do.  If
+    //  the cache is for a different directory or is stale, discard it now
+    //  so the directory isn't held open while the user operates on it.
+    //  If the mutex is held, a background thread is publishing a result;
+    //  try again on the next call rather than waiting for it.
+    //
+
+    if (WaitForSingleObject(YoriShDirectoryCacheState.Mutex, 0) != WAIT_OBJECT_0) {
+        YoriShDirectoryCacheState.PrefetchOffset = (DWORD)-1;
+        YoriLibFreeStringContents(&DirectoryPath);
+        return;
+    }
+
+    Cache = YoriShDirectoryCacheState.Cache;
+    if (Cache != NULL) {
+        if (YoriLibCompareStringInsensitive(&Cache->DirectoryPath, &DirectoryPath) == 0 &&
+            !YoriShIsDirectoryCacheStale(Cache)) {
+
+            ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+            YoriLibFreeStringContents(&DirectoryPath);
+            return;
+        }
+        YoriShDirectoryCacheState.Cache = NULL;
+        YoriShFreeDirectoryCache(Cache);
+    }
+    ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+
+    Build = YoriLibMalloc(sizeof(YORI_SH_DIRECTORY_CACHE_BUILD));
+    if (Build == NULL) {
+        YoriLibFreeStringContents(&DirectoryPath);
+        return;
+    }
+
+    if (!DuplicateHandle(GetCurrentProcess(), YoriShDirectoryCacheState.Mutex, GetCurrentProcess(), &Build->Mutex, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+        YoriLibFree(Build);
+        YoriLibFreeStringContents(&DirectoryPath);
+        return;
+    }
+
+    memcpy(&Build->BuildPath, &DirectoryPath, sizeof(YORI_STRING));
+    Build->Terminate = FALSE;
+    Build->ReferenceCount = 2;
+
+    YoriShDirectoryCacheState.BuildThread = CreateThread(NULL, 0, YoriShDirectoryCacheBuildWorker, Build, 0, &ThreadId);
+    if (YoriShDirectoryCacheState.BuildThread == NULL) {
+        Build->ReferenceCount = 1;
+        YoriShDereferenceDirectoryCacheBuild(Build);
+        return;
+    }
+    YoriShDirectoryCacheState.Build = Build;
+}
+
+/**
+ Indicate that a new command is being entered, so the next call to
+ @ref YoriShPrefetchTabCompletion should parse the input even if it matches
+ the previous command.  The current directory may have changed since then.
+ */
+VOID
+YoriShResetTabCompletionPrefetch(VOID)
+{
+    YoriShDirectoryCacheState.PrefetchOffset = (DWORD)-1;
+}
+
+/**
+ Stop any background enumeration and free any cached directory contents.
+ This is called when the shell is exiting.  Any background enumeration is
+ abandoned rather than waited for, and once the mutex is acquired here it
+ can no longer publish a result.
+ */
+VOID
+YoriShCleanupTabCompletionCache(VOID)
+{
+    YoriShDetachDirectoryCacheBuild(TRUE);
+    YoriLibFreeStringContents(&YoriShDirectoryCacheState.PrefetchString);
+    YoriShDirectoryCacheState.PrefetchOffset = (DWORD)-1;
+    if (YoriShDirectoryCacheState.Mutex != NULL) {
+        WaitForSingleObject(YoriShDirectoryCacheState.Mutex, INFINITE);
+        if (YoriShDirectoryCacheState.Cache != NULL) {
+            YoriShFreeDirectoryCache(YoriShDirectoryCacheState.Cache);
+            YoriShDirectoryCacheState.Cache = NULL;
+        }
+        ReleaseMutex(YoriShDirectoryCacheState.Mutex);
+        CloseHandle(YoriShDirectoryCacheState.Mutex);
+        YoriShDirectoryCacheState.Mutex = NULL;
+    }
+}
+
 // vim:sw=4:ts=4:et:
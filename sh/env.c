@@ -45,6 +45,385 @@ YoriShIsEnvironmentVariableChar(
     return FALSE;
 }
 
+/**
+ A single variable within the cached copy of the environment block.
+ */
+typedef struct _YORI_SH_ENV_CACHE_VARIABLE {
+
+    /**
+     The entry for this variable within the hash table, keyed by the
+     variable name.  The key refers to memory within the cached block.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     Pointer to the NULL terminated value of the variable within the cached
+     block.
+     */
+    LPTSTR Value;
+
+    /**
+     The length of the value, in characters, not including the NULL.
+     */
+    DWORD ValueLength;
+
+    /**
+     Set to TRUE when a new environment block being applied contains this
+     variable, so that variables absent from the new block can be deleted.
+     */
+    BOOLEAN Present;
+} YORI_SH_ENV_CACHE_VARIABLE, *PYORI_SH_ENV_CACHE_VARIABLE;
+
+/**
+ A copy of the shell's environment block, which is passed to child processes
+ as they are launched, along with a hash table used to look up variables
+ within it.  The copy is regenerated when the environment generation
+ changes.
+ */
+typedef struct _YORI_SH_ENV_CACHE {
+
+    /**
+     A mutex synchronizing access to the cache, since processes can be
+     launched and variables queried from threads other than the main
+     thread.
+     */
+    HANDLE Mutex;
+
+    /**
+     TRUE if the cache reflects the environment at generation Generation.
+     */
+    BOOLEAN Valid;
+
+    /**
+     The environment generation that the cache was built from.
+     */
+    DWORD Generation;
+
+    /**
+     The number of elements in the Variables array.
+     */
+    DWORD VariableCount;
+
+    /**
+     A copy of the environment block, terminated by two NULLs.  This is a
+     referenced allocation so that a process launch can continue to use it
+     while the cache is regenerated.  LengthInChars includes both
+     terminating NULLs.
+     */
+    YORI_STRING Block;
+
+    /**
+     A hash table of variables within Block, keyed by name.
+     */
+    PYORI_HASH_TABLE HashTable;
+
+    /**
+     An array of variables found within Block.
+     */
+    PYORI_SH_ENV_CACHE_VARIABLE Variables;
+} YORI_SH_ENV_CACHE, *PYORI_SH_ENV_CACHE;
+
+/**
+ The cached copy of the environment block.
+ */
+YORI_SH_ENV_CACHE YoriShEnvCache;
+
+/**
+ Discard any cached copy of the environment.  This assumes the caller holds
+ the cache mutex, if it exists.
+ */
+VOID
+YoriShDiscardEnvironmentCache(VOID)
+{
+    DWORD Index;
+
+    if (YoriShEnvCache.HashTable != NULL) {
+        for (Index = 0; Index < YoriShEnvCache.VariableCount; Index++) {
+            YoriLibHashRemoveByEntry(&YoriShEnvCache.Variables[Index].HashEntry);
+        }
+        YoriLibFreeEmptyHashTable(YoriShEnvCache.HashTable);
+        YoriShEnvCache.HashTable = NULL;
+    }
+
+    if (YoriShEnvCache.Variables != NULL) {
+        YoriLibFree(YoriShEnvCache.Variables);
+        YoriShEnvCache.Variables = NULL;
+    }
+
+    YoriShEnvCache.VariableCount = 0;
+    YoriLibFreeStringContents(&YoriShEnvCache.Block);
+    YoriShEnvCache.Valid = FALSE;
+}
+
+/**
+ Ensure the cached copy of the environment reflects the current
+ environment generation, regenerating it if required.  This assumes the
+ caller holds the cache mutex.
+
+ @return TRUE if the cache is valid, FALSE if it could not be generated.
+ */
+__success(return)
+BOOL
+YoriShRefreshEnvironmentCache(VOID)
+{
+    LPTSTR ThisVar;
+    LPTSTR ThisValue;
+    DWORD VarLen;
+    DWORD Count;
+    DWORD Generation;
+    YORI_STRING Key;
+    PYORI_SH_ENV_CACHE_VARIABLE Variable;
+
+    Generation = YoriShGlobal.EnvironmentGeneration;
+    if (YoriShEnvCache.Valid && YoriShEnvCache.Generation == Generation) {
+        return TRUE;
+    }
+
+    YoriShDiscardEnvironmentCache();
+
+    if (!YoriLibGetEnvironmentStrings(&YoriShEnvCache.Block)) {
+        return FALSE;
+    }
+
+    //
+    //  Count the variables so the array can be allocated, and record the
+    //  length of the block including both terminators.
+    //
+
+    Count = 0;
+    ThisVar = YoriShEnvCache.Block.StartOfString;
+    while (*ThisVar != '\0') {
+        Count++;
+        ThisVar += _tcslen(ThisVar) + 1;
+    }
+    YoriShEnvCache.Block.LengthInChars = (DWORD)(ThisVar - YoriShEnvCache.Block.StartOfString) + 1;
+    if (YoriShEnvCache.Block.LengthInChars < 2) {
+        YoriShEnvCache.Block.LengthInChars = 2;
+    }
+
+    YoriShEnvCache.HashTable = YoriLibAllocateHashTable(Count / 2 + 1);
+    if (YoriShEnvCache.HashTable == NULL) {
+        YoriShDiscardEnvironmentCache();
+        return FALSE;
+    }
+
+    if (Count > 0) {
+        YoriShEnvCache.Variables = YoriLibMalloc(Count * sizeof(YORI_SH_ENV_CACHE_VARIABLE));
+        if (YoriShEnvCache.Variables == NULL) {
+            YoriShDiscardEnvironmentCache();
+            return FALSE;
+        }
+    }
+
+    //
+    //  Index each variable.  The first character is skipped when looking
+    //  for the separator, since that's how drive current directories are
+    //  recorded.
+    //
+
+    ThisVar = YoriShEnvCache.Block.StartOfString;
+    while (*ThisVar != '\0') {
+        VarLen = (DWORD)_tcslen(ThisVar);
+        ThisValue = _tcschr(&ThisVar[1], '=');
+        if (ThisValue != NULL) {
+            ASSERT(YoriShEnvCache.VariableCount < Count);
+            Variable = &YoriShEnvCache.Variables[YoriShEnvCache.VariableCount];
+            Variable->Value = ThisValue + 1;
+            Variable->ValueLength = VarLen - (DWORD)(Variable->Value - ThisVar);
+            Variable->Present = FALSE;
+            YoriLibInitEmptyString(&Key);
+            Key.StartOfString = ThisVar;
+            Key.LengthInChars = (DWORD)(ThisValue - ThisVar);
+            YoriLibHashInsertByKey(YoriShEnvCache.HashTable, &Key, Variable, &Variable->HashEntry);
+            YoriShEnvCache.VariableCount++;
+        }
+
+        ThisVar += VarLen + 1;
+    }
+
+    YoriShEnvCache.Generation = Generation;
+    YoriShEnvCache.Valid = TRUE;
+    return TRUE;
+}
+
+/**
+ Acquire the mutex protecting the environment cache, creating it if it does
+ not exist.
+
+ @return TRUE if the mutex was acquired, FALSE if it could not be created.
+ */
+__success(return)
+BOOL
+YoriShAcquireEnvironmentCache(VOID)
+{
+    if (YoriShEnvCache.Mutex == NULL) {
+        YoriShEnvCache.Mutex = CreateMutex(NULL, FALSE, NULL);
+        if (YoriShEnvCache.Mutex == NULL) {
+            return FALSE;
+        }
+    }
+
+    WaitForSingleObject(YoriShEnvCache.Mutex, INFINITE);
+    return TRUE;
+}
+
+/**
+ Look up a variable from the cached copy of the environment.  This behaves
+ like GetEnvironmentVariable, and falls back to it if the cache cannot be
+ generated.
+
+ @param Name The name of the environment variable to get.
+
+ @param Variable Pointer to the buffer to receive the variable's contents.
+
+ @param Size The length of the Variable parameter, in characters.
+
+ @return The number of characters copied (without NULL), or if the buffer
+         is too small, the number of characters needed (including NULL.)
+         Zero if the variable is not defined.
+ */
+DWORD
+YoriShGetCachedEnvironmentVariable(
+    __in LPCTSTR Name,
+    __out_opt LPTSTR Variable,
+    __in DWORD Size
+    )
+{
+    YORI_STRING NameString;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_ENV_CACHE_VARIABLE Found;
+    DWORD Length;
+
+    if (!YoriShAcquireEnvironmentCache()) {
+        return GetEnvironmentVariable(Name, Variable, Size);
+    }
+
+    if (!YoriShRefreshEnvironmentCache()) {
+        ReleaseMutex(YoriShEnvCache.Mutex);
+        return GetEnvironmentVariable(Name, Variable, Size);
+    }
+
+    YoriLibConstantString(&NameString, Name);
+    HashEntry = YoriLibHashLookupByKey(YoriShEnvCache.HashTable, &NameString);
+    if (HashEntry == NULL) {
+        ReleaseMutex(YoriShEnvCache.Mutex);
+        SetLastError(ERROR_ENVVAR_NOT_FOUND);
+        return 0;
+    }
+
+    Found = (PYORI_SH_ENV_CACHE_VARIABLE)HashEntry->Context;
+    if (Variable != NULL && Size > Found->ValueLength) {
+        memcpy(Variable, Found->Value, (Found->ValueLength + 1) * sizeof(TCHAR));
+        Length = Found->ValueLength;
+    } else {
+        Length = Found->ValueLength + 1;
+    }
+
+    ReleaseMutex(YoriShEnvCache.Mutex);
+    return Length;
+}
+
+/**
+ Return a referenced copy of the current environment block, suitable for
+ passing to CreateProcess with CREATE_UNICODE_ENVIRONMENT.  The block is
+ only regenerated if the environment has changed since it was last
+ generated.
+
+ @return Pointer to the environment block, which the caller should release
+         with @ref YoriLibDereference , or NULL if it could not be
+         generated, in which case the caller should allow the child to
+         inherit the environment from the process.
+ */
+PVOID
+YoriShReferenceEnvironmentBlock(VOID)
+{
+    PVOID Block;
+
+    if (!YoriShAcquireEnvironmentCache()) {
+        return NULL;
+    }
+
+    Block = NULL;
+    if (YoriShRefreshEnvironmentCache()) {
+        ASSERT(YoriShEnvCache.Block.MemoryToFree == YoriShEnvCache.Block.StartOfString);
+        Block = YoriShEnvCache.Block.MemoryToFree;
+        YoriLibReference(Block);
+    }
+
+    ReleaseMutex(YoriShEnvCache.Mutex);
+    return Block;
+}
+
+/**
+ Check whether the process environment was changed without the shell being
+ informed, which can occur when in process commands modify it directly.  If
+ it has changed, the environment generation is advanced so that state
+ derived from the environment, including the cached environment block, is
+ regenerated.  This only compares against the cached block, so it does
+ nothing if the cache is not currently valid.
+ */
+VOID
+YoriShCheckForEnvironmentChange(VOID)
+{
+    YORI_STRING CurrentEnvironment;
+    LPTSTR ThisVar;
+    DWORD LengthInChars;
+    BOOLEAN Changed;
+
+    if (YoriShEnvCache.Mutex == NULL || !YoriShEnvCache.Valid) {
+        return;
+    }
+
+    if (!YoriLibGetEnvironmentStrings(&CurrentEnvironment)) {
+        return;
+    }
+
+    ThisVar = CurrentEnvironment.StartOfString;
+    while (*ThisVar != '\0') {
+        ThisVar += _tcslen(ThisVar) + 1;
+    }
+    LengthInChars = (DWORD)(ThisVar - CurrentEnvironment.StartOfString) + 1;
+    if (LengthInChars < 2) {
+        LengthInChars = 2;
+    }
+
+    Changed = FALSE;
+    WaitForSingleObject(YoriShEnvCache.Mutex, INFINITE);
+    if (YoriShEnvCache.Valid &&
+        YoriShEnvCache.Generation == YoriShGlobal.EnvironmentGeneration) {
+
+        if (YoriShEnvCache.Block.LengthInChars != LengthInChars ||
+            memcmp(YoriShEnvCache.Block.StartOfString, CurrentEnvironment.StartOfString, LengthInChars * sizeof(TCHAR)) != 0) {
+
+            Changed = TRUE;
+        }
+    }
+    ReleaseMutex(YoriShEnvCache.Mutex);
+
+    YoriLibFreeStringContents(&CurrentEnvironment);
+
+    if (Changed) {
+        YoriShGlobal.EnvironmentGeneration++;
+    }
+}
+
+/**
+ Free the cached copy of the environment on shell exit.
+ */
+VOID
+YoriShFreeEnvironmentCache(VOID)
+{
+    if (YoriShEnvCache.Mutex == NULL) {
+        return;
+    }
+
+    WaitForSingleObject(YoriShEnvCache.Mutex, INFINITE);
+    YoriShDiscardEnvironmentCache();
+    ReleaseMutex(YoriShEnvCache.Mutex);
+    CloseHandle(YoriShEnvCache.Mutex);
+    YoriShEnvCache.Mutex = NULL;
+}
+
 /**
  Wrapper around the Win32 GetEnvironmentVariable call, but augmented with
  "magic" things that appear to be variables but aren't, including %CD% and
@@ -101,7 +480,7 @@ YoriShGetEnvironmentVariableWithoutSubstitution(
             Length++;
         }
     } else {
-        Length = GetEnvironmentVariable(Name, Variable, Size);
+        Length = YoriShGetCachedEnvironmentVariable(Name, Variable, Size);
     }
 
     if (Generation != NULL) {
@@ -871,7 +1250,8 @@ YoriShSetEnvironmentVariable(
 
 /**
  Apply an environment block into the running process.  Variables not explicitly
- included in this block are discarded.
+ included in this block are discarded.  Only variables whose values differ
+ from the current environment are modified.
 
  @param NewEnv Pointer to the new environment block to apply.
 
@@ -883,45 +1263,39 @@ YoriShSetEnvironmentStrings(
     __in PYORI_STRING NewEnv
     )
 {
-    YORI_STRING CurrentEnvironment;
+    YORI_STRING VariableName;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_ENV_CACHE_VARIABLE Existing;
+    LPTSTR NullTerminatedName;
     LPTSTR ThisVar;
     LPTSTR ThisValue;
     DWORD VarLen;
+    DWORD ValueLength;
+    DWORD Index;
 
-    //
-    //  Query the current environment and delete everything in it.
-    //
-
-    if (!YoriLibGetEnvironmentStrings(&CurrentEnvironment)) {
+    if (!YoriShAcquireEnvironmentCache()) {
         return FALSE;
     }
-    ThisVar = CurrentEnvironment.StartOfString;
-    while (*ThisVar != '\0') {
-        VarLen = _tcslen(ThisVar);
 
-        //
-        //  We know there's at least one char.  Skip it if it's equals since
-        //  that's how drive current directories are recorded.
-        //
-
-        ThisValue = _tcschr(&ThisVar[1], '=');
-        if (ThisValue != NULL) {
-            ThisValue[0] = '\0';
-            SetEnvironmentVariable(ThisVar, NULL);
-        }
+    if (!YoriShRefreshEnvironmentCache()) {
+        ReleaseMutex(YoriShEnvCache.Mutex);
+        return FALSE;
+    }
 
-        ThisVar += VarLen;
-        ThisVar++;
+    for (Index = 0; Index < YoriShEnvCache.VariableCount; Index++) {
+        YoriShEnvCache.Variables[Index].Present = FALSE;
     }
-    YoriLibFreeStringContents(&CurrentEnvironment);
 
     //
-    //  Now load the new environment.
+    //  Set each variable in the new environment whose value differs from
+    //  the current environment, and note which current variables are
+    //  present in the new environment.
     //
 
+    YoriLibInitEmptyString(&VariableName);
     ThisVar = NewEnv->StartOfString;
     while (*ThisVar != '\0') {
-        VarLen = _tcslen(ThisVar);
+        VarLen = (DWORD)_tcslen(ThisVar);
 
         //
         //  We know there's at least one char.  Skip it if it's equals since
@@ -932,14 +1306,48 @@ YoriShSetEnvironmentStrings(
         if (ThisValue != NULL) {
             ThisValue[0] = '\0';
             ThisValue++;
-            SetEnvironmentVariable(ThisVar, ThisValue);
+            ValueLength = VarLen - (DWORD)(ThisValue - ThisVar);
+
+            VariableName.StartOfString = ThisVar;
+            VariableName.LengthInChars = (DWORD)(ThisValue - ThisVar - 1);
+            HashEntry = YoriLibHashLookupByKey(YoriShEnvCache.HashTable, &VariableName);
+            Existing = NULL;
+            if (HashEntry != NULL) {
+                Existing = (PYORI_SH_ENV_CACHE_VARIABLE)HashEntry->Context;
+                Existing->Present = TRUE;
+            }
+
+            if (Existing == NULL ||
+                Existing->ValueLength != ValueLength ||
+                memcmp(Existing->Value, ThisValue, ValueLength * sizeof(TCHAR)) != 0) {
+
+                SetEnvironmentVariable(ThisVar, ThisValue);
+            }
         }
 
         ThisVar += VarLen;
         ThisVar++;
     }
 
+    //
+    //  Delete anything in the current environment that is not in the new
+    //  one.  The name is copied since the cached block may be in use by a
+    //  process launch on another thread.
+    //
+
+    for (Index = 0; Index < YoriShEnvCache.VariableCount; Index++) {
+        Existing = &YoriShEnvCache.Variables[Index];
+        if (!Existing->Present) {
+            NullTerminatedName = YoriLibCStringFromYoriString(&Existing->HashEntry.Key);
+            if (NullTerminatedName != NULL) {
+                SetEnvironmentVariable(NullTerminatedName, NULL);
+                YoriLibDereference(NullTerminatedName);
+            }
+        }
+    }
+
     YoriShGlobal.EnvironmentGeneration++;
+    ReleaseMutex(YoriShEnvCache.Mutex);
 
     return TRUE;
 }
@@ -637,6 +637,7 @@ YoriShCreateProcess(
     YORI_SH_PREVIOUS_REDIRECT_CONTEXT PreviousRedirectContext;
     DWORD CreationFlags = 0;
     DWORD LastError;
+    PVOID EnvironmentBlock;
 
     ZeroMemory(&ProcessInfo, sizeof(ProcessInfo));
     if (FailedInRedirection != NULL) {
@@ -671,8 +672,22 @@ YoriShCreateProcess(
         return LastError;
     }
 
-    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, CreationFlags, NULL, NULL, &StartupInfo, &ProcessInfo)) {
+    //
+    //  Pass the cached copy of the environment, which is only regenerated
+    //  when the environment changes.  If it's not available, the child
+    //  inherits the environment from this process.
+    //
+
+    EnvironmentBlock = YoriShReferenceEnvironmentBlock();
+    if (EnvironmentBlock != NULL) {
+        CreationFlags |= CREATE_UNICODE_ENVIRONMENT;
+    }
+
+    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, CreationFlags, EnvironmentBlock, NULL, &StartupInfo, &ProcessInfo)) {
         LastError = GetLastError();
+        if (EnvironmentBlock != NULL) {
+            YoriLibDereference(EnvironmentBlock);
+        }
         YoriShRevertRedirection(&PreviousRedirectContext);
         YoriLibFreeStringContents(&CmdLine);
         return LastError;
@@ -680,6 +695,10 @@ YoriShCreateProcess(
         YoriShRevertRedirection(&PreviousRedirectContext);
     }
 
+    if (EnvironmentBlock != NULL) {
+        YoriLibDereference(EnvironmentBlock);
+    }
+
     ASSERT(ExecContext->hProcess == NULL);
     ExecContext->hProcess = ProcessInfo.hProcess;
     ExecContext->hPrimaryThread = ProcessInfo.hThread;
@@ -1459,6 +1478,9 @@ YoriShExecuteSingleProgram(
     if (ExecProcess) {
 
         BOOL FailedInRedirection = FALSE;
+        PVOID ProfileHandle;
+
+        ProfileHandle = YoriShProfileBegin(YoriShProfileTypeProcess, &ExecContext->CmdToExec.ArgV[0]);
 
         if (!LaunchViaShellExecute && !ExecContext->CaptureEnvironmentOnExit) {
             DWORD Err = YoriShCreateProcess(ExecContext, &FailedInRedirection);
@@ -1495,6 +1517,7 @@ YoriShExecuteSingleProgram(
 
         if (LaunchFailed) {
             YoriShCleanupFailedProcessLaunch(ExecContext);
+            YoriShProfileEnd(ProfileHandle);
             return 1;
         }
 
@@ -1534,6 +1557,8 @@ YoriShExecuteSingleProgram(
                 }
             }
         }
+
+        YoriShProfileEnd(ProfileHandle);
     }
     return ExitCode;
 }
@@ -1778,6 +1803,37 @@ YoriShExecExecPlan(
     }
 }
 
+/**
+ Prepare the output of a backquoted expression for substitution into a
+ command.  Newlines at the end of the output, which tools frequently emit
+ but are of no value here, are removed, and any other newlines are
+ converted to spaces.
+
+ @param ProcessOutput The output to update.
+ */
+VOID
+YoriShTrimBackquoteOutput(
+    __inout PYORI_STRING ProcessOutput
+    )
+{
+    DWORD Index;
+
+    while (ProcessOutput->LengthInChars > 0 &&
+           (ProcessOutput->StartOfString[ProcessOutput->LengthInChars - 1] == '\n' ||
+            ProcessOutput->StartOfString[ProcessOutput->LengthInChars - 1] == '\r')) {
+
+        ProcessOutput->LengthInChars--;
+    }
+
+    for (Index = 0; Index < ProcessOutput->LengthInChars; Index++) {
+        if ((ProcessOutput->StartOfString[Index] == '\n' ||
+             ProcessOutput->StartOfString[Index] == '\r')) {
+
+            ProcessOutput->StartOfString[Index] = ' ';
+        }
+    }
+}
+
 /**
  Execute an expression and capture the output of the entire expression into
  a buffer.  This is used when evaluating backquoted expressions.
@@ -1800,7 +1856,6 @@ YoriShExecuteExpressionAndCaptureOutput(
     PYORI_SH_SINGLE_EXEC_CONTEXT ExecContext;
     YORI_SH_CMD_CONTEXT CmdContext;
     PVOID OutputBuffer;
-    DWORD Index;
 
     //
     //  Parse the expression we're trying to execute.
@@ -1847,48 +1902,465 @@ YoriShExecuteExpressionAndCaptureOutput(
 
     YoriLibInitEmptyString(ProcessOutput);
     if (OutputBuffer != NULL) {
-
         YoriShGetProcessOutputBuffer(OutputBuffer, ProcessOutput);
+        YoriShTrimBackquoteOutput(ProcessOutput);
+    }
 
-        //
-        //  Truncate any newlines from the output, which tools
-        //  frequently emit but are of no value here
-        //
+    YoriShFreeExecPlan(&ExecPlan);
+    YoriShFreeCmdContext(&CmdContext);
+
+    return TRUE;
+}
+
+
+/**
+ The maximum number of backquote results to retain for reuse.
+ */
+#define YORI_SH_BACKQUOTE_CACHE_MAX (32)
+
+/**
+ A previously evaluated backquote expression whose result can be reused
+ for a limited time.
+ */
+typedef struct _YORI_SH_BACKQUOTE_CACHE_ENTRY {
+
+    /**
+     The entry within the list of cached results, with the most recently
+     cached result first.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The expression that was evaluated.
+     */
+    YORI_STRING Expression;
+
+    /**
+     The current directory when the expression was evaluated.
+     */
+    YORI_STRING Directory;
+
+    /**
+     The result of evaluating the expression.
+     */
+    YORI_STRING Output;
+
+    /**
+     The tick count when the expression was evaluated.
+     */
+    DWORD TickCountCached;
+} YORI_SH_BACKQUOTE_CACHE_ENTRY, *PYORI_SH_BACKQUOTE_CACHE_ENTRY;
+
+/**
+ The list of cached backquote results.
+ */
+YORI_LIST_ENTRY YoriShBackquoteCache;
+
+/**
+ The number of entries in the list of cached backquote results.
+ */
+DWORD YoriShBackquoteCacheCount;
+
+/**
+ Remove a cached backquote result and free it.
+
+ @param Entry The cached result to free.
+ */
+VOID
+YoriShFreeBackquoteCacheEntry(
+    __in PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry
+    )
+{
+    YoriLibRemoveListItem(&Entry->ListEntry);
+    YoriLibFreeStringContents(&Entry->Output);
+    YoriLibFree(Entry);
+    YoriShBackquoteCacheCount--;
+}
+
+/**
+ Free all cached backquote results.
+ */
+VOID
+YoriShFreeBackquoteCache()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+
+    if (YoriShBackquoteCache.Next == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCache, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_CACHE_ENTRY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCache, ListEntry);
+        YoriShFreeBackquoteCacheEntry(Entry);
+    }
+}
+
+/**
+ Look for a cached result from evaluating an expression in the current
+ directory.  Any results older than the specified lifetime are discarded.
+
+ @param Expression The expression to look for.
+
+ @param Directory The current directory.
+
+ @param CacheLifetime The maximum age of a result to return, in
+        milliseconds.
+
+ @param Output On successful completion, updated to contain a referenced
+        copy of the result.
+
+ @return TRUE if a result was found, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriShLookupBackquoteCache(
+    __in PYORI_STRING Expression,
+    __in PYORI_STRING Directory,
+    __in DWORD CacheLifetime,
+    __out PYORI_STRING Output
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+    DWORD Now;
 
-        while (ProcessOutput->LengthInChars > 0 &&
-               (ProcessOutput->StartOfString[ProcessOutput->LengthInChars - 1] == '\n' ||
-                ProcessOutput->StartOfString[ProcessOutput->LengthInChars - 1] == '\r')) {
+    if (YoriShBackquoteCache.Next == NULL) {
+        return FALSE;
+    }
 
-            ProcessOutput->LengthInChars--;
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Now = GetTickCount();
+    ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCache, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_CACHE_ENTRY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShBackquoteCache, ListEntry);
+
+        if (Now - Entry->TickCountCached >= CacheLifetime) {
+            YoriShFreeBackquoteCacheEntry(Entry);
+            continue;
         }
 
-        //
-        //  Convert any remaining newlines to spaces
-        //
+        if (YoriLibCompareString(&Entry->Expression, Expression) == 0 &&
+            YoriLibCompareStringInsensitive(&Entry->Directory, Directory) == 0) {
 
-        for (Index = 0; Index < ProcessOutput->LengthInChars; Index++) {
-            if ((ProcessOutput->StartOfString[Index] == '\n' ||
-                 ProcessOutput->StartOfString[Index] == '\r')) {
+            YoriLibCloneString(Output, &Entry->Output);
+            return TRUE;
+        }
+    }
 
-                ProcessOutput->StartOfString[Index] = ' ';
-            }
+    return FALSE;
+}
+
+/**
+ Record the result of evaluating an expression in the current directory so
+ it can be reused.
+
+ @param Expression The expression that was evaluated.
+
+ @param Directory The current directory.
+
+ @param Output The result of evaluating the expression.  This is referenced
+        by the cache and must not be modified by the caller.
+ */
+VOID
+YoriShInsertBackquoteCache(
+    __in PYORI_STRING Expression,
+    __in PYORI_STRING Directory,
+    __in PYORI_STRING Output
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_BACKQUOTE_CACHE_ENTRY Entry;
+
+    if (YoriShBackquoteCache.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShBackquoteCache);
+    }
+
+    if (YoriShBackquoteCacheCount >= YORI_SH_BACKQUOTE_CACHE_MAX) {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShBackquoteCache, NULL);
+        if (ListEntry != NULL) {
+            Entry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_CACHE_ENTRY, ListEntry);
+            YoriShFreeBackquoteCacheEntry(Entry);
         }
     }
 
-    YoriShFreeExecPlan(&ExecPlan);
-    YoriShFreeCmdContext(&CmdContext);
+    Entry = YoriLibMalloc(sizeof(YORI_SH_BACKQUOTE_CACHE_ENTRY) + (Expression->LengthInChars + Directory->LengthInChars) * sizeof(TCHAR));
+    if (Entry == NULL) {
+        return;
+    }
+
+    YoriLibInitEmptyString(&Entry->Expression);
+    Entry->Expression.StartOfString = (LPTSTR)(Entry + 1);
+    Entry->Expression.LengthInChars = Expression->LengthInChars;
+    memcpy(Entry->Expression.StartOfString, Expression->StartOfString, Expression->LengthInChars * sizeof(TCHAR));
+
+    YoriLibInitEmptyString(&Entry->Directory);
+    Entry->Directory.StartOfString = Entry->Expression.StartOfString + Expression->LengthInChars;
+    Entry->Directory.LengthInChars = Directory->LengthInChars;
+    memcpy(Entry->Directory.StartOfString, Directory->StartOfString, Directory->LengthInChars * sizeof(TCHAR));
+
+    YoriLibCloneString(&Entry->Output, Output);
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Entry->TickCountCached = GetTickCount();
+
+    YoriLibInsertList(&YoriShBackquoteCache, &Entry->ListEntry);
+    YoriShBackquoteCacheCount++;
+}
+
+/**
+ Attempt to start evaluating a backquoted expression without waiting for it
+ to complete.  This is only possible if the expression consists of a single
+ external program whose output is captured; builtins and anything more
+ complex need to be executed on the shell's thread.
+
+ @param Expression The expression to execute.
+
+ @param Evaluation On successful completion, updated to contain the state
+        of the launched process.
+
+ @return TRUE if the process was launched, FALSE if the expression must be
+         evaluated synchronously.
+ */
+__success(return)
+BOOL
+YoriShLaunchBackquoteConcurrently(
+    __in PYORI_STRING Expression,
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    )
+{
+    PYORI_SH_SINGLE_EXEC_CONTEXT ExecContext;
+    YORI_STRING YsExt;
+    LPTSTR szExt;
+    BOOL ExecutableFound;
+
+    if (!YoriShParseCmdlineToCmdContext(Expression, 0, TRUE, &Evaluation->CmdContext)) {
+        return FALSE;
+    }
+
+    if (Evaluation->CmdContext.ArgC == 0) {
+        YoriShFreeCmdContext(&Evaluation->CmdContext);
+        return FALSE;
+    }
+
+    if (!YoriShParseCmdContextToExecPlan(&Evaluation->CmdContext, &Evaluation->ExecPlan, NULL, NULL, NULL, NULL)) {
+        YoriShFreeCmdContext(&Evaluation->CmdContext);
+        return FALSE;
+    }
+
+    ExecContext = Evaluation->ExecPlan.FirstCmd;
+    if (Evaluation->ExecPlan.NumberCommands != 1 ||
+        ExecContext->NextProgram != NULL ||
+        ExecContext->StdOutType != StdOutTypeDefault ||
+        ExecContext->StdErrType == StdErrTypeBuffer ||
+        YoriLibIsPathUrl(&ExecContext->CmdToExec.ArgV[0])) {
+
+        goto Synchronous;
+    }
+
+    if (!YoriShResolveCommandToExecutable(&ExecContext->CmdToExec, &ExecutableFound) ||
+        !ExecutableFound) {
+
+        goto Synchronous;
+    }
 
+    //
+    //  Only plain executables are launched directly.  Scripts and modules
+    //  need the shell to interpret them.
+    //
+
+    szExt = YoriLibFindRightMostCharacter(&ExecContext->CmdToExec.ArgV[0], '.');
+    if (szExt == NULL) {
+        goto Synchronous;
+    }
+
+    YoriLibInitEmptyString(&YsExt);
+    YsExt.StartOfString = szExt;
+    YsExt.LengthInChars = ExecContext->CmdToExec.ArgV[0].LengthInChars - (DWORD)(szExt - ExecContext->CmdToExec.ArgV[0].StartOfString);
+    if (YoriLibCompareStringWithLiteralInsensitive(&YsExt, _T(".exe")) != 0) {
+        goto Synchronous;
+    }
+
+    ExecContext->StdOutType = StdOutTypeBuffer;
+    ExecContext->WaitForCompletion = TRUE;
+
+    if (YoriShCreateProcess(ExecContext, NULL) != NO_ERROR) {
+        YoriShCleanupFailedProcessLaunch(ExecContext);
+        goto Synchronous;
+    }
+
+    YoriShCommenceProcessBuffersIfNeeded(ExecContext);
+    Evaluation->Launched = TRUE;
     return TRUE;
+
+Synchronous:
+    YoriShFreeExecPlan(&Evaluation->ExecPlan);
+    YoriShFreeCmdContext(&Evaluation->CmdContext);
+    return FALSE;
+}
+
+/**
+ Wait for a backquoted expression launched with
+ @ref YoriShLaunchBackquoteConcurrently to complete and collect its output.
+
+ @param Evaluation The state of the launched process.
+ */
+VOID
+YoriShCompleteConcurrentBackquote(
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    )
+{
+    PYORI_SH_SINGLE_EXEC_CONTEXT ExecContext;
+    DWORD ExitCode;
+
+    ASSERT(Evaluation->Launched);
+    ExecContext = Evaluation->ExecPlan.FirstCmd;
+
+    if (ExecContext->hProcess != NULL) {
+        YoriShWaitForProcessToTerminate(ExecContext);
+        if (GetExitCodeProcess(ExecContext->hProcess, &ExitCode)) {
+            YoriShGlobal.ErrorLevel = ExitCode;
+        }
+    }
+
+    YoriLibInitEmptyString(&Evaluation->Output);
+    if (ExecContext->StdOut.Buffer.ProcessBuffers != NULL) {
+        YoriShGetProcessOutputBuffer(ExecContext->StdOut.Buffer.ProcessBuffers, &Evaluation->Output);
+        YoriShTrimBackquoteOutput(&Evaluation->Output);
+    }
+
+    if (YoriLibIsOperationCancelled()) {
+        YoriShCancelExecPlan(&Evaluation->ExecPlan);
+    }
+
+    YoriShFreeExecPlan(&Evaluation->ExecPlan);
+    YoriShFreeCmdContext(&Evaluation->CmdContext);
+    Evaluation->Launched = FALSE;
+    Evaluation->Evaluated = TRUE;
 }
 
+/**
+ Abandon a backquoted expression launched with
+ @ref YoriShLaunchBackquoteConcurrently without collecting its output.  Any
+ process that is still executing is terminated.
+
+ @param Evaluation The state of the launched process.
+ */
+VOID
+YoriShCancelConcurrentBackquote(
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    )
+{
+    ASSERT(Evaluation->Launched);
+    YoriShCancelExecPlan(&Evaluation->ExecPlan);
+    YoriShFreeExecPlan(&Evaluation->ExecPlan);
+    YoriShFreeCmdContext(&Evaluation->CmdContext);
+    Evaluation->Launched = FALSE;
+}
+
+/**
+ Construct a new expression where each backquoted substring, including the
+ characters that delimit it, is replaced with the result of evaluating it.
+
+ @param Expression The expression containing the backquoted substrings.
+
+ @param Substrings An array of backquoted substrings within Expression, in
+        the order they occur.
+
+ @param Evaluations An array of evaluations corresponding to Substrings,
+        each of which contains the output to substitute.
+
+ @param SubstringCount The number of elements in the Substrings and
+        Evaluations arrays.
+
+ @param ResultingExpression On successful completion, updated to contain a
+        newly allocated expression.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShSubstituteBackquoteOutput(
+    __in PYORI_STRING Expression,
+    __in PYORI_SH_BACKQUOTE_SUBSTRING Substrings,
+    __in PYORI_SH_BACKQUOTE_EVALUATION Evaluations,
+    __in DWORD SubstringCount,
+    __out PYORI_STRING ResultingExpression
+    )
+{
+    YORI_STRING NewFullExpression;
+    DWORD Index;
+    DWORD LengthNeeded;
+    DWORD SourceOffset;
+    DWORD PrefixOffset;
+
+    LengthNeeded = Expression->LengthInChars;
+    for (Index = 0; Index < SubstringCount; Index++) {
+        LengthNeeded = LengthNeeded - Substrings[Index].CharsInPrefix - Substrings[Index].String.LengthInChars - 1;
+        LengthNeeded = LengthNeeded + Evaluations[Index].Output.LengthInChars;
+    }
+
+    if (!YoriLibAllocateString(&NewFullExpression, LengthNeeded + 1)) {
+        return FALSE;
+    }
+
+    SourceOffset = 0;
+    for (Index = 0; Index < SubstringCount; Index++) {
+        PrefixOffset = (DWORD)(Substrings[Index].String.StartOfString - Expression->StartOfString) - Substrings[Index].CharsInPrefix;
+
+        memcpy(&NewFullExpression.StartOfString[NewFullExpression.LengthInChars],
+               &Expression->StartOfString[SourceOffset],
+               (PrefixOffset - SourceOffset) * sizeof(TCHAR));
+        NewFullExpression.LengthInChars += PrefixOffset - SourceOffset;
+
+        memcpy(&NewFullExpression.StartOfString[NewFullExpression.LengthInChars],
+               Evaluations[Index].Output.StartOfString,
+               Evaluations[Index].Output.LengthInChars * sizeof(TCHAR));
+        NewFullExpression.LengthInChars += Evaluations[Index].Output.LengthInChars;
+
+        SourceOffset = PrefixOffset + Substrings[Index].CharsInPrefix + Substrings[Index].String.LengthInChars + 1;
+    }
+
+    memcpy(&NewFullExpression.StartOfString[NewFullExpression.LengthInChars],
+           &Expression->StartOfString[SourceOffset],
+           (Expression->LengthInChars - SourceOffset) * sizeof(TCHAR));
+    NewFullExpression.LengthInChars += Expression->LengthInChars - SourceOffset;
+    ASSERT(NewFullExpression.LengthInChars == LengthNeeded);
+    NewFullExpression.StartOfString[NewFullExpression.LengthInChars] = '\0';
+
+    memcpy(ResultingExpression, &NewFullExpression, sizeof(YORI_STRING));
+    return TRUE;
+}
 
 /**
  Parse and execute all backquotes in an expression, potentially resulting
  in a new expression.  This will internally perform parsing and redirection,
  as well as execute multiple subprocesses as needed.
 
+ Backquotes are evaluated from the most deeply nested level outward, and
+ expressions within a level are evaluated from left to right.  When a level
+ contains more than one expression, consecutive expressions that are each a
+ single external program are started together and run concurrently.  Any
+ that are running are completed before an expression that must be evaluated
+ by the shell, so that expression observes the effects of everything to its
+ left.  All results are substituted once every expression at that level has
+ completed.
+
  @param Expression The string to execute.
 
+ @param CacheLifetime If nonzero, specifies the number of milliseconds that
+        the result of a backquoted expression can be reused for when the
+        same expression is evaluated in the same directory.  If zero, every
+        expression is executed.
+
  @param ResultingExpression On successful completion, updated to contain
         the final expression to evaluate.  This may be the same as Expression
         if no backquote expansion occurred.
@@ -1899,24 +2371,28 @@ __success(return)
 BOOL
 YoriShExpandBackquotes(
     __in PYORI_STRING Expression,
+    __in DWORD CacheLifetime,
     __out PYORI_STRING ResultingExpression
     )
 {
     YORI_STRING CurrentFullExpression;
-    YORI_STRING CurrentExpressionSubset;
-
-    YORI_STRING ProcessOutput;
-
-    YORI_STRING InitialPortion;
-    YORI_STRING TrailingPortion;
     YORI_STRING NewFullExpression;
-
-    DWORD CharsInBackquotePrefix;
+    YORI_STRING CurrentDirectory;
+    PYORI_SH_BACKQUOTE_SUBSTRING Substrings;
+    PYORI_SH_BACKQUOTE_EVALUATION Evaluations;
+    DWORD SubstringCount;
+    DWORD Index;
+    DWORD LaunchedIndex;
+    DWORD LengthNeeded;
+    BOOL EvaluationFailed;
+    BOOL Substituted;
 
     YoriLibInitEmptyString(&CurrentFullExpression);
     CurrentFullExpression.StartOfString = Expression->StartOfString;
     CurrentFullExpression.LengthInChars = Expression->LengthInChars;
 
+    YoriLibInitEmptyString(&CurrentDirectory);
+
     while(TRUE) {
 
         //
@@ -1925,48 +2401,127 @@ YoriShExpandBackquotes(
         //  create commands that can nest further backticks?
         //
 
-        if (!YoriShFindNextBackquoteSubstring(&CurrentFullExpression, &CurrentExpressionSubset, &CharsInBackquotePrefix)) {
+        if (!YoriShFindDeepestBackquoteSubstrings(&CurrentFullExpression, &Substrings, &SubstringCount)) {
             break;
         }
 
-        if (!YoriShExecuteExpressionAndCaptureOutput(&CurrentExpressionSubset, &ProcessOutput)) {
+        Evaluations = YoriLibMalloc(SubstringCount * sizeof(YORI_SH_BACKQUOTE_EVALUATION));
+        if (Evaluations == NULL) {
+            YoriLibFree(Substrings);
+            YoriLibFreeStringContents(&CurrentFullExpression);
+            YoriLibFreeStringContents(&CurrentDirectory);
+            return FALSE;
+        }
+
+        ZeroMemory(Evaluations, SubstringCount * sizeof(YORI_SH_BACKQUOTE_EVALUATION));
+
+        //
+        //  Reuse any recent results if the caller allows it.
+        //
+
+        if (CacheLifetime != 0 && CurrentDirectory.StartOfString == NULL) {
+            LengthNeeded = GetCurrentDirectory(0, NULL);
+            if (YoriLibAllocateString(&CurrentDirectory, LengthNeeded)) {
+                CurrentDirectory.LengthInChars = GetCurrentDirectory(CurrentDirectory.LengthAllocated, CurrentDirectory.StartOfString);
+            }
+        }
+
+        if (CacheLifetime != 0 && CurrentDirectory.StartOfString != NULL) {
+            for (Index = 0; Index < SubstringCount; Index++) {
+                if (YoriShLookupBackquoteCache(&Substrings[Index].String, &CurrentDirectory, CacheLifetime, &Evaluations[Index].Output)) {
+                    Evaluations[Index].Evaluated = TRUE;
+                    Evaluations[Index].FromCache = TRUE;
+                }
+            }
+        }
+
+        //
+        //  Evaluate expressions from left to right.  If there's more than
+        //  one expression, each that can run concurrently is started and
+        //  left running.  Before evaluating one that can't, wait for all
+        //  that are running, since it may depend on their side effects.
+        //
+
+        EvaluationFailed = FALSE;
+        for (Index = 0; Index < SubstringCount; Index++) {
+            if (Evaluations[Index].Evaluated) {
+                continue;
+            }
+
+            if (SubstringCount > 1 &&
+                YoriShLaunchBackquoteConcurrently(&Substrings[Index].String, &Evaluations[Index])) {
+
+                continue;
+            }
+
+            for (LaunchedIndex = 0; LaunchedIndex < Index; LaunchedIndex++) {
+                if (Evaluations[LaunchedIndex].Launched) {
+                    YoriShCompleteConcurrentBackquote(&Evaluations[LaunchedIndex]);
+                }
+            }
+
+            if (!YoriShExecuteExpressionAndCaptureOutput(&Substrings[Index].String, &Evaluations[Index].Output)) {
+                EvaluationFailed = TRUE;
+                break;
+            }
+            Evaluations[Index].Evaluated = TRUE;
+        }
+
+        for (Index = 0; Index < SubstringCount; Index++) {
+            if (Evaluations[Index].Launched) {
+                YoriShCompleteConcurrentBackquote(&Evaluations[Index]);
+            }
+        }
+
+        //
+        //  If an expression couldn't be evaluated, leave the expression as
+        //  it is.
+        //
+
+        if (EvaluationFailed) {
+            for (Index = 0; Index < SubstringCount; Index++) {
+                YoriLibFreeStringContents(&Evaluations[Index].Output);
+            }
+            YoriLibFree(Evaluations);
+            YoriLibFree(Substrings);
             break;
         }
 
         //
-        //  Calculate the number of characters from before the first
-        //  backquote, the number after the last backquote, and the
-        //  number just obtained from the buffer.
+        //  Remember any new results if the caller allows it, then replace
+        //  every substring with its result.
         //
 
-        YoriLibInitEmptyString(&InitialPortion);
-        YoriLibInitEmptyString(&TrailingPortion);
+        if (CacheLifetime != 0 && CurrentDirectory.StartOfString != NULL) {
+            for (Index = 0; Index < SubstringCount; Index++) {
+                if (!Evaluations[Index].FromCache) {
+                    YoriShInsertBackquoteCache(&Substrings[Index].String, &CurrentDirectory, &Evaluations[Index].Output);
+                }
+            }
+        }
 
-        InitialPortion.StartOfString = CurrentFullExpression.StartOfString;
-        InitialPortion.LengthInChars = (DWORD)(CurrentExpressionSubset.StartOfString - CurrentFullExpression.StartOfString - CharsInBackquotePrefix);
+        Substituted = YoriShSubstituteBackquoteOutput(&CurrentFullExpression, Substrings, Evaluations, SubstringCount, &NewFullExpression);
 
-        TrailingPortion.StartOfString = &CurrentFullExpression.StartOfString[InitialPortion.LengthInChars + CurrentExpressionSubset.LengthInChars + 1 + CharsInBackquotePrefix];
-        TrailingPortion.LengthInChars = CurrentFullExpression.LengthInChars - InitialPortion.LengthInChars - CurrentExpressionSubset.LengthInChars - 1 - CharsInBackquotePrefix;
+        for (Index = 0; Index < SubstringCount; Index++) {
+            YoriLibFreeStringContents(&Evaluations[Index].Output);
+        }
 
-        if (!YoriLibAllocateString(&NewFullExpression, InitialPortion.LengthInChars + ProcessOutput.LengthInChars + TrailingPortion.LengthInChars + 1)) {
+        if (!Substituted) {
+            YoriLibFree(Evaluations);
+            YoriLibFree(Substrings);
             YoriLibFreeStringContents(&CurrentFullExpression);
-            YoriLibFreeStringContents(&ProcessOutput);
+            YoriLibFreeStringContents(&CurrentDirectory);
             return FALSE;
         }
 
-        NewFullExpression.LengthInChars = YoriLibSPrintf(NewFullExpression.StartOfString,
-                                                         _T("%y%y%y"),
-                                                         &InitialPortion,
-                                                         &ProcessOutput,
-                                                         &TrailingPortion);
+        YoriLibFree(Evaluations);
+        YoriLibFree(Substrings);
 
         YoriLibFreeStringContents(&CurrentFullExpression);
-
         memcpy(&CurrentFullExpression, &NewFullExpression, sizeof(YORI_STRING));
-
-        YoriLibFreeStringContents(&ProcessOutput);
     }
 
+    YoriLibFreeStringContents(&CurrentDirectory);
     memcpy(ResultingExpression, &CurrentFullExpression, sizeof(YORI_STRING));
     return TRUE;
 }
@@ -1991,12 +2546,16 @@ YoriShExecuteExpression(
     YORI_SH_EXEC_PLAN ExecPlan;
     YORI_SH_CMD_CONTEXT CmdContext;
     YORI_STRING CurrentFullExpression;
+    PVOID ProfileHandle;
+
+    ProfileHandle = YoriShProfileBegin(YoriShProfileTypeLine, Expression);
 
     //
     //  Expand all backquotes.
     //
 
-    if (!YoriShExpandBackquotes(Expression, &CurrentFullExpression)) {
+    if (!YoriShExpandBackquotes(Expression, 0, &CurrentFullExpression)) {
+        YoriShProfileEnd(ProfileHandle);
         return FALSE;
     }
 
@@ -2009,12 +2568,14 @@ YoriShExecuteExpression(
     if (!YoriShParseCmdlineToCmdContext(&CurrentFullExpression, 0, TRUE, &CmdContext)) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Parse error\n"));
         YoriLibFreeStringContents(&CurrentFullExpression);
+        YoriShProfileEnd(ProfileHandle);
         return FALSE;
     }
 
     if (CmdContext.ArgC == 0) {
         YoriShFreeCmdContext(&CmdContext);
         YoriLibFreeStringContents(&CurrentFullExpression);
+        YoriShProfileEnd(ProfileHandle);
         return FALSE;
     }
 
@@ -2022,6 +2583,7 @@ YoriShExecuteExpression(
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Parse error\n"));
         YoriLibFreeStringContents(&CurrentFullExpression);
         YoriShFreeCmdContext(&CmdContext);
+        YoriShProfileEnd(ProfileHandle);
         return FALSE;
     }
 
@@ -2031,8 +2593,159 @@ YoriShExecuteExpression(
     YoriShFreeCmdContext(&CmdContext);
 
     YoriLibFreeStringContents(&CurrentFullExpression);
+    YoriShProfileEnd(ProfileHandle);
+
+    return TRUE;
+}
+
+/**
+ An expression that has been parsed once so that it can be executed
+ repeatedly without parsing it again.
+ */
+typedef struct _YORI_SH_PARSED_EXPRESSION {
+
+    /**
+     The text of the expression, used to describe it when profiling.
+     */
+    YORI_STRING Expression;
+
+    /**
+     The arguments of the expression.  Environment variables are not
+     expanded, since their values can change between executions.
+     */
+    YORI_SH_CMD_CONTEXT CmdContext;
+} YORI_SH_PARSED_EXPRESSION, *PYORI_SH_PARSED_EXPRESSION;
+
+/**
+ Parse a command string into a form that can be executed repeatedly with
+ @ref YoriShExecuteParsedExpression .  Expressions containing backquotes
+ cannot be parsed ahead of execution, since the output of each backquoted
+ expression is substituted before the expression is parsed.
+
+ @param Expression The string to parse.
+
+ @param ParsedExpression On successful completion, updated to point to the
+        parsed expression.  This should be freed with
+        @ref YoriShFreeParsedExpression .
+
+ @return TRUE to indicate the expression was parsed, FALSE if it could not
+         be and should be executed with @ref YoriShExecuteExpression .
+ */
+__success(return)
+BOOL
+YoriShParseExpression(
+    __in PYORI_STRING Expression,
+    __out PVOID * ParsedExpression
+    )
+{
+    PYORI_SH_PARSED_EXPRESSION Parsed;
+    DWORD Index;
+
+    for (Index = 0; Index < Expression->LengthInChars; Index++) {
+        if (Expression->StartOfString[Index] == '`') {
+            return FALSE;
+        }
+    }
+
+    Parsed = YoriLibMalloc(sizeof(YORI_SH_PARSED_EXPRESSION));
+    if (Parsed == NULL) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&Parsed->Expression, Expression->LengthInChars + 1)) {
+        YoriLibFree(Parsed);
+        return FALSE;
+    }
+    memcpy(Parsed->Expression.StartOfString, Expression->StartOfString, Expression->LengthInChars * sizeof(TCHAR));
+    Parsed->Expression.LengthInChars = Expression->LengthInChars;
+    Parsed->Expression.StartOfString[Parsed->Expression.LengthInChars] = '\0';
+
+    if (!YoriShParseCmdlineToCmdContext(&Parsed->Expression, 0, FALSE, &Parsed->CmdContext)) {
+        YoriLibFreeStringContents(&Parsed->Expression);
+        YoriLibFree(Parsed);
+        return FALSE;
+    }
+
+    if (Parsed->CmdContext.ArgC == 0) {
+        YoriShFreeCmdContext(&Parsed->CmdContext);
+        YoriLibFreeStringContents(&Parsed->Expression);
+        YoriLibFree(Parsed);
+        return FALSE;
+    }
+
+    *ParsedExpression = Parsed;
+    return TRUE;
+}
+
+/**
+ Execute an expression previously parsed with @ref YoriShParseExpression .
+ Environment variables and aliases are expanded as part of each execution,
+ so this behaves the same as @ref YoriShExecuteExpression on the original
+ string.
+
+ @param ParsedExpression Pointer to the parsed expression.
+
+ @return TRUE to indicate it was successfully executed, FALSE otherwise.
+ */
+__success(return)
+BOOL
+YoriShExecuteParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    PYORI_SH_PARSED_EXPRESSION Parsed;
+    YORI_SH_EXEC_PLAN ExecPlan;
+    YORI_SH_CMD_CONTEXT CmdContext;
+    PVOID ProfileHandle;
+
+    Parsed = (PYORI_SH_PARSED_EXPRESSION)ParsedExpression;
+    ProfileHandle = YoriShProfileBegin(YoriShProfileTypeLine, &Parsed->Expression);
+
+    //
+    //  Arguments are referenced by the copy, and any that contain
+    //  environment variables are replaced, so the parsed expression is
+    //  unchanged for the next execution.
+    //
+
+    if (!YoriShCopyCmdContext(&CmdContext, &Parsed->CmdContext)) {
+        YoriShProfileEnd(ProfileHandle);
+        return FALSE;
+    }
+
+    YoriShExpandEnvironmentInCmdContext(&CmdContext);
+
+    if (!YoriShParseCmdContextToExecPlan(&CmdContext, &ExecPlan, NULL, NULL, NULL, NULL)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Parse error\n"));
+        YoriShFreeCmdContext(&CmdContext);
+        YoriShProfileEnd(ProfileHandle);
+        return FALSE;
+    }
+
+    YoriShExecExecPlan(&ExecPlan, NULL);
+
+    YoriShFreeExecPlan(&ExecPlan);
+    YoriShFreeCmdContext(&CmdContext);
+    YoriShProfileEnd(ProfileHandle);
 
     return TRUE;
 }
 
+/**
+ Free an expression previously parsed with @ref YoriShParseExpression .
+
+ @param ParsedExpression Pointer to the parsed expression.
+ */
+VOID
+YoriShFreeParsedExpression(
+    __in PVOID ParsedExpression
+    )
+{
+    PYORI_SH_PARSED_EXPRESSION Parsed;
+
+    Parsed = (PYORI_SH_PARSED_EXPRESSION)ParsedExpression;
+    YoriShFreeCmdContext(&Parsed->CmdContext);
+    YoriLibFreeStringContents(&Parsed->Expression);
+    YoriLibFree(Parsed);
+}
+
 // vim:sw=4:ts=4:et:
@@ -48,6 +48,412 @@ HANDLE YoriShHistoryLock;
  */
 BOOL YoriShHistoryInitialized;
 
+/**
+ The sequence number to assign to the next history entry.  This allows
+ entries to be ordered by the time they were entered without walking the
+ list.
+ */
+DWORD YoriShHistoryNextSequence;
+
+/**
+ An array of history entries sorted by command line without regard to case,
+ and then by sequence number.  This allows prefix searches to be resolved
+ with a binary search.  The index is built on first use and maintained as
+ entries are added and removed.
+ */
+PYORI_SH_HISTORY_ENTRY *YoriShHistoryIndex;
+
+/**
+ The number of entries in YoriShHistoryIndex .
+ */
+DWORD YoriShHistoryIndexCount;
+
+/**
+ The number of entries allocated in YoriShHistoryIndex .
+ */
+DWORD YoriShHistoryIndexAllocated;
+
+/**
+ TRUE if YoriShHistoryIndex describes every entry in history.  FALSE if it
+ needs to be rebuilt before use.
+ */
+BOOL YoriShHistoryIndexValid;
+
+/**
+ The number of entries at the end of the history list which have not been
+ written to the history file.
+ */
+DWORD YoriShHistoryUnsavedCount;
+
+/**
+ The number of lines in the history file.  This can exceed the number of
+ entries in history, because new entries are appended to the file and old
+ ones are only discarded when the file is compacted.
+ */
+DWORD YoriShHistoryFileLineCount;
+
+/**
+ TRUE if the history file is known to contain every entry in history other
+ than the unsaved ones, so new entries can be appended to it.  FALSE if the
+ file must be rewritten in full.
+ */
+BOOL YoriShHistoryFileInSync;
+
+/**
+ The full path to the history file that was loaded or last written.  If
+ YORIHISTFILE changes to refer to a different file, that file is rewritten
+ in full.
+ */
+YORI_STRING YoriShHistoryFilePath;
+
+/**
+ Compare two history entries for the purpose of ordering the history index.
+ Entries are ordered by command line without regard to case, and entries
+ with the same command line are ordered by the sequence they were entered.
+
+ @param Entry1 Pointer to the first entry to compare.
+
+ @param Entry2 Pointer to the second entry to compare.
+
+ @return Less than zero if Entry1 should be ordered before Entry2, greater
+         than zero if Entry1 should be ordered after Entry2, or zero if
+         the entries are the same.
+ */
+int
+YoriShHistoryCompareEntries(
+    __in PYORI_SH_HISTORY_ENTRY Entry1,
+    __in PYORI_SH_HISTORY_ENTRY Entry2
+    )
+{
+    int Result;
+
+    Result = YoriLibCompareStringInsensitive(&Entry1->CmdLine, &Entry2->CmdLine);
+    if (Result != 0) {
+        return Result;
+    }
+
+    if (Entry1->Sequence < Entry2->Sequence) {
+        return -1;
+    } else if (Entry1->Sequence > Entry2->Sequence) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ Compare two history entries such that the most recently entered entry is
+ ordered first.
+
+ @param Entry1 Pointer to the first entry to compare.
+
+ @param Entry2 Pointer to the second entry to compare.
+
+ @return Less than zero if Entry1 is newer than Entry2, greater than zero
+         if Entry1 is older than Entry2, or zero if they are the same.
+ */
+int
+YoriShHistoryCompareNewestFirst(
+    __in PYORI_SH_HISTORY_ENTRY Entry1,
+    __in PYORI_SH_HISTORY_ENTRY Entry2
+    )
+{
+    if (Entry1->Sequence > Entry2->Sequence) {
+        return -1;
+    } else if (Entry1->Sequence < Entry2->Sequence) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ A prototype for a function that compares two history entries.
+ */
+typedef int YORI_SH_HISTORY_COMPARE_FN(PYORI_SH_HISTORY_ENTRY, PYORI_SH_HISTORY_ENTRY);
+
+/**
+ A pointer to a function that compares two history entries.
+ */
+typedef YORI_SH_HISTORY_COMPARE_FN *PYORI_SH_HISTORY_COMPARE_FN;
+
+/**
+ Sort an array of history entries using a merge sort.
+
+ @param Entries Pointer to the array of entries to sort.
+
+ @param Count The number of elements in the array.
+
+ @param CompareFn Pointer to a function to determine the order of entries.
+
+ @return TRUE to indicate the array was sorted, FALSE if memory could not be
+         allocated to sort it.
+ */
+__success(return)
+BOOL
+YoriShHistorySortEntries(
+    __inout PYORI_SH_HISTORY_ENTRY *Entries,
+    __in DWORD Count,
+    __in PYORI_SH_HISTORY_COMPARE_FN CompareFn
+    )
+{
+    PYORI_SH_HISTORY_ENTRY *Scratch;
+    PYORI_SH_HISTORY_ENTRY *Source;
+    PYORI_SH_HISTORY_ENTRY *Dest;
+    PYORI_SH_HISTORY_ENTRY *Swap;
+    DWORD Width;
+    DWORD Start;
+    DWORD Middle;
+    DWORD End;
+    DWORD Left;
+    DWORD Right;
+    DWORD Out;
+
+    if (Count < 2) {
+        return TRUE;
+    }
+
+    Scratch = YoriLibMalloc(Count * sizeof(PYORI_SH_HISTORY_ENTRY));
+    if (Scratch == NULL) {
+        return FALSE;
+    }
+
+    Source = Entries;
+    Dest = Scratch;
+
+    for (Width = 1; Width < Count; Width = Width * 2) {
+        for (Start = 0; Start < Count; Start = Start + 2 * Width) {
+            Middle = Start + Width;
+            if (Middle > Count) {
+                Middle = Count;
+            }
+            End = Middle + Width;
+            if (End > Count) {
+                End = Count;
+            }
+
+            Left = Start;
+            Right = Middle;
+            for (Out = Start; Out < End; Out++) {
+                if (Left < Middle &&
+                    (Right >= End || CompareFn(Source[Left], Source[Right]) <= 0)) {
+
+                    Dest[Out] = Source[Left];
+                    Left++;
+                } else {
+                    Dest[Out] = Source[Right];
+                    Right++;
+                }
+            }
+        }
+
+        Swap = Source;
+        Source = Dest;
+        Dest = Swap;
+    }
+
+    if (Source != Entries) {
+        memcpy(Entries, Source, Count * sizeof(PYORI_SH_HISTORY_ENTRY));
+    }
+
+    YoriLibFree(Scratch);
+    return TRUE;
+}
+
+/**
+ Free the history index.  It will be rebuilt on next use.
+ */
+VOID
+YoriShHistoryFreeIndex(VOID)
+{
+    if (YoriShHistoryIndex != NULL) {
+        YoriLibFree(YoriShHistoryIndex);
+        YoriShHistoryIndex = NULL;
+    }
+    YoriShHistoryIndexCount = 0;
+    YoriShHistoryIndexAllocated = 0;
+    YoriShHistoryIndexValid = FALSE;
+}
+
+/**
+ Find the first position in the history index whose entry is not ordered
+ before the specified command line and sequence number.
+
+ @param CmdLine Pointer to the command line to search for.
+
+ @param Sequence The sequence number to search for.
+
+ @return The position within the index.  This may equal the number of
+         entries in the index if every entry is ordered first.
+ */
+DWORD
+YoriShHistoryIndexLowerBound(
+    __in PYORI_STRING CmdLine,
+    __in DWORD Sequence
+    )
+{
+    DWORD Low;
+    DWORD High;
+    DWORD Middle;
+    PYORI_SH_HISTORY_ENTRY Entry;
+    int Result;
+
+    Low = 0;
+    High = YoriShHistoryIndexCount;
+    while (Low < High) {
+        Middle = Low + (High - Low) / 2;
+        Entry = YoriShHistoryIndex[Middle];
+        Result = YoriLibCompareStringInsensitive(&Entry->CmdLine, CmdLine);
+        if (Result < 0 || (Result == 0 && Entry->Sequence < Sequence)) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+/**
+ Build the history index from the list of history entries.  This function
+ assumes the history lock is held.
+
+ @return TRUE to indicate the index is valid, FALSE if it could not be built.
+ */
+__success(return)
+BOOL
+YoriShHistoryBuildIndex(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    DWORD Count;
+
+    if (YoriShHistoryIndexValid) {
+        return TRUE;
+    }
+
+    YoriShHistoryFreeIndex();
+
+    YoriShHistoryIndexAllocated = YoriShCommandHistoryCount + 64;
+    YoriShHistoryIndex = YoriLibMalloc(YoriShHistoryIndexAllocated * sizeof(PYORI_SH_HISTORY_ENTRY));
+    if (YoriShHistoryIndex == NULL) {
+        YoriShHistoryIndexAllocated = 0;
+        return FALSE;
+    }
+
+    Count = 0;
+    if (YoriShGlobal.CommandHistory.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
+        while (ListEntry != NULL && Count < YoriShHistoryIndexAllocated) {
+            HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+            YoriShHistoryIndex[Count] = HistoryEntry;
+            Count++;
+            ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+        }
+    }
+
+    if (!YoriShHistorySortEntries(YoriShHistoryIndex, Count, YoriShHistoryCompareEntries)) {
+        YoriShHistoryFreeIndex();
+        return FALSE;
+    }
+
+    YoriShHistoryIndexCount = Count;
+    YoriShHistoryIndexValid = TRUE;
+    return TRUE;
+}
+
+/**
+ Insert a new entry into the history index, if the index has been built.
+ This function assumes the history lock is held.
+
+ @param HistoryEntry Pointer to the entry to insert.
+ */
+VOID
+YoriShHistoryIndexInsert(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    DWORD Position;
+
+    if (!YoriShHistoryIndexValid) {
+        return;
+    }
+
+    if (YoriShHistoryIndexCount >= YoriShHistoryIndexAllocated) {
+        PYORI_SH_HISTORY_ENTRY *NewIndex;
+        DWORD NewAllocated;
+
+        NewAllocated = YoriShHistoryIndexAllocated * 2 + 64;
+        NewIndex = YoriLibMalloc(NewAllocated * sizeof(PYORI_SH_HISTORY_ENTRY));
+        if (NewIndex == NULL) {
+            YoriShHistoryFreeIndex();
+            return;
+        }
+        memcpy(NewIndex, YoriShHistoryIndex, YoriShHistoryIndexCount * sizeof(PYORI_SH_HISTORY_ENTRY));
+        YoriLibFree(YoriShHistoryIndex);
+        YoriShHistoryIndex = NewIndex;
+        YoriShHistoryIndexAllocated = NewAllocated;
+    }
+
+    Position = YoriShHistoryIndexLowerBound(&HistoryEntry->CmdLine, HistoryEntry->Sequence);
+    memmove(&YoriShHistoryIndex[Position + 1],
+            &YoriShHistoryIndex[Position],
+            (YoriShHistoryIndexCount - Position) * sizeof(PYORI_SH_HISTORY_ENTRY));
+    YoriShHistoryIndex[Position] = HistoryEntry;
+    YoriShHistoryIndexCount++;
+}
+
+/**
+ Remove an entry from the history index, if the index has been built.  This
+ function assumes the history lock is held.
+
+ @param HistoryEntry Pointer to the entry to remove.
+ */
+VOID
+YoriShHistoryIndexRemove(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    DWORD Position;
+
+    if (!YoriShHistoryIndexValid) {
+        return;
+    }
+
+    Position = YoriShHistoryIndexLowerBound(&HistoryEntry->CmdLine, HistoryEntry->Sequence);
+    if (Position >= YoriShHistoryIndexCount ||
+        YoriShHistoryIndex[Position] != HistoryEntry) {
+
+        ASSERT(FALSE);
+        YoriShHistoryFreeIndex();
+        return;
+    }
+
+    YoriShHistoryIndexCount--;
+    memmove(&YoriShHistoryIndex[Position],
+            &YoriShHistoryIndex[Position + 1],
+            (YoriShHistoryIndexCount - Position) * sizeof(PYORI_SH_HISTORY_ENTRY));
+}
+
+/**
+ Remove a history entry from the history list and index and free it.  This
+ function assumes the history lock is held.
+
+ @param HistoryEntry Pointer to the entry to free.
+ */
+VOID
+YoriShHistoryFreeEntry(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    YoriShHistoryIndexRemove(HistoryEntry);
+    YoriLibRemoveListItem(&HistoryEntry->ListEntry);
+    YoriLibFreeStringContents(&HistoryEntry->CmdLine);
+    YoriLibFree(HistoryEntry);
+    YoriShCommandHistoryCount--;
+    if (YoriShHistoryUnsavedCount > YoriShCommandHistoryCount) {
+        YoriShHistoryUnsavedCount = YoriShCommandHistoryCount;
+    }
+}
+
 /**
  Add an entered command into the command history buffer.
 
@@ -57,7 +463,7 @@ BOOL YoriShHistoryInitialized;
  @param IgnoreIfRepeat If TRUE, don't add a new line if the immediate
         previous line is identical.  Note it must be exactly identical,
         including case.  If FALSE, add the new entry regardless.
- 
+
  @return TRUE to indicate an entry was successfully added, FALSE if it was
          not.
  */
@@ -102,19 +508,20 @@ YoriShAddToHistory(
         }
 
         YoriLibCloneString(&NewHistoryEntry->CmdLine, NewCmd);
+        NewHistoryEntry->Sequence = YoriShHistoryNextSequence;
+        YoriShHistoryNextSequence++;
 
         YoriLibAppendList(&YoriShGlobal.CommandHistory, &NewHistoryEntry->ListEntry);
+        YoriShHistoryIndexInsert(NewHistoryEntry);
         YoriShCommandHistoryCount++;
+        YoriShHistoryUnsavedCount++;
         while (YoriShCommandHistoryCount > YoriShCommandHistoryMax) {
             PYORI_LIST_ENTRY ListEntry;
             PYORI_SH_HISTORY_ENTRY OldHistoryEntry;
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
             OldHistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
-            YoriLibRemoveListItem(ListEntry);
-            YoriLibFreeStringContents(&OldHistoryEntry->CmdLine);
-            YoriLibFree(OldHistoryEntry);
-            YoriShCommandHistoryCount--;
+            YoriShHistoryFreeEntry(OldHistoryEntry);
         }
         ReleaseMutex(YoriShHistoryLock);
     }
@@ -138,11 +545,34 @@ YoriShRemoveOneHistoryEntry(
     __in PYORI_SH_HISTORY_ENTRY HistoryEntry
     )
 {
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD Index;
+    BOOL Unsaved;
+
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
-        YoriLibRemoveListItem(&HistoryEntry->ListEntry);
-        YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-        YoriLibFree(HistoryEntry);
-        YoriShCommandHistoryCount--;
+
+        //
+        //  If the entry has already been written to the history file, the
+        //  file needs to be rewritten to remove it.
+        //
+
+        Unsaved = FALSE;
+        ListEntry = NULL;
+        for (Index = 0; Index < YoriShHistoryUnsavedCount; Index++) {
+            ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+            if (ListEntry == &HistoryEntry->ListEntry) {
+                Unsaved = TRUE;
+                break;
+            }
+        }
+
+        if (Unsaved) {
+            YoriShHistoryUnsavedCount--;
+        } else {
+            YoriShHistoryFileInSync = FALSE;
+        }
+
+        YoriShHistoryFreeEntry(HistoryEntry);
         ReleaseMutex(YoriShHistoryLock);
     }
 }
@@ -157,19 +587,109 @@ YoriShClearAllHistory()
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
 
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
+        YoriShHistoryFreeIndex();
         ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
         while (ListEntry != NULL) {
             HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
-            YoriLibRemoveListItem(&HistoryEntry->ListEntry);
-            YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-            YoriLibFree(HistoryEntry);
-            YoriShCommandHistoryCount--;
+            YoriShHistoryFreeEntry(HistoryEntry);
         }
+        YoriShHistoryFileInSync = FALSE;
+        YoriLibFreeStringContents(&YoriShHistoryFilePath);
         ReleaseMutex(YoriShHistoryLock);
     }
 }
 
+/**
+ Return the set of history entries that start with a specified prefix,
+ ordered from most recent to least recent.  This is resolved with a binary
+ search of the history index, so its cost depends on the number of matches
+ rather than the number of entries in history.
+
+ @param Prefix Pointer to the prefix to search for.  Comparisons are
+        performed without regard to case.  If this string is empty, all
+        history entries are returned.
+
+ @param Matches On successful completion, updated to point to an array of
+        matching history entries.  The caller is expected to free this with
+        @ref YoriLibFree .  The entries remain owned by history and are only
+        valid until history is next modified.
+
+ @param MatchCount On successful completion, updated to contain the number
+        of elements in Matches.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShFindHistoryPrefixMatches(
+    __in PYORI_STRING Prefix,
+    __out PYORI_SH_HISTORY_ENTRY **Matches,
+    __out PDWORD MatchCount
+    )
+{
+    DWORD Start;
+    DWORD End;
+    DWORD Count;
+    PYORI_SH_HISTORY_ENTRY *Result;
+
+    *Matches = NULL;
+    *MatchCount = 0;
+
+    if (WaitForSingleObject(YoriShHistoryLock, 0) != WAIT_OBJECT_0) {
+        return FALSE;
+    }
+
+    if (!YoriShHistoryBuildIndex()) {
+        ReleaseMutex(YoriShHistoryLock);
+        return FALSE;
+    }
+
+    //
+    //  Every entry starting with the prefix is ordered at or after the
+    //  prefix itself, and the matches are contiguous.
+    //
+
+    Start = YoriShHistoryIndexLowerBound(Prefix, 0);
+    End = Start;
+    while (End < YoriShHistoryIndexCount &&
+           YoriLibCompareStringInsensitiveCount(&YoriShHistoryIndex[End]->CmdLine, Prefix, Prefix->LengthInChars) == 0) {
+
+        End++;
+    }
+
+    Count = End - Start;
+    if (Count == 0) {
+        ReleaseMutex(YoriShHistoryLock);
+        return TRUE;
+    }
+
+    Result = YoriLibMalloc(Count * sizeof(PYORI_SH_HISTORY_ENTRY));
+    if (Result == NULL) {
+        ReleaseMutex(YoriShHistoryLock);
+        return FALSE;
+    }
+
+    memcpy(Result, &YoriShHistoryIndex[Start], Count * sizeof(PYORI_SH_HISTORY_ENTRY));
+    ReleaseMutex(YoriShHistoryLock);
+
+    if (!YoriShHistorySortEntries(Result, Count, YoriShHistoryCompareNewestFirst)) {
+        YoriLibFree(Result);
+        return FALSE;
+    }
+
+    *Matches = Result;
+    *MatchCount = Count;
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 26165) // Analyze thinks a lock might be leaked
+                                 // if WaitForSingleObject acquired it but
+                                 // returned a different result.  That can't
+                                 // happen.
+#endif
+    return TRUE;
+}
+
 /**
  Configure the maximum amount of history to retain if the user has requested
  this behavior by setting YORIHISTSIZE.
@@ -235,36 +755,27 @@ YoriShInitHistory()
 }
 
 /**
- Load history from a file if the user has requested this behavior by
- setting YORIHISTFILE.  Configure the maximum amount of history to retain
- if the user has requested this behavior by setting YORIHISTSIZE.
+ Resolve the YORIHISTFILE environment variable into a full path.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param FilePath On successful completion, updated to contain the full path
+        to the history file.  The caller is expected to free this with
+        @ref YoriLibFreeStringContents .
+
+ @return TRUE to indicate a history file is configured and its path was
+         returned, FALSE if it is not configured or could not be resolved.
  */
 __success(return)
 BOOL
-YoriShLoadHistoryFromFile()
+YoriShGetHistoryFilePath(
+    __out PYORI_STRING FilePath
+    )
 {
     DWORD EnvVarLength;
     YORI_STRING UserHistFileName;
-    YORI_STRING FilePath;
-    HANDLE FileHandle;
-    PVOID LineContext = NULL;
-    YORI_STRING LineString;
-
-    if (YoriShHistoryInitialized) {
-        return TRUE;
-    }
-
-    YoriShInitHistory();
-
-    //
-    //  Check if there's a file to load saved history from.
-    //
 
     EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
     if (EnvVarLength == 0) {
-        return TRUE;
+        return FALSE;
     }
 
     if (!YoriLibAllocateString(&UserHistFileName, EnvVarLength)) {
@@ -278,35 +789,235 @@ YoriShLoadHistoryFromFile()
         return FALSE;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
+    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, FilePath)) {
         YoriLibFreeStringContents(&UserHistFileName);
         return FALSE;
     }
 
     YoriLibFreeStringContents(&UserHistFileName);
+    return TRUE;
+}
 
-    FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_READ,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                            NULL,
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL,
-                            NULL);
+/**
+ Find the next line within a buffer of text loaded from the history file.
+ Lines may be terminated by CRLF, LF or CR.
 
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
-        DWORD LastError = GetLastError();
-        if (LastError != ERROR_FILE_NOT_FOUND) {
-            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-            YoriLibFreeStringContents(&FilePath);
+ @param Text Pointer to the text loaded from the history file.
+
+ @param Offset On input, the offset within Text to find the next line from.
+        On output, updated to point after the line that was found.
+
+ @param Line On successful completion, updated to point to the line within
+        Text, excluding any line terminator.  This string is not referenced.
+
+ @return TRUE to indicate a line was found, FALSE if the end of the text was
+         reached.
+ */
+__success(return)
+BOOL
+YoriShGetNextHistoryFileLine(
+    __in PYORI_STRING Text,
+    __inout PDWORD Offset,
+    __out PYORI_STRING Line
+    )
+{
+    DWORD Index;
+
+    Index = *Offset;
+    if (Index >= Text->LengthInChars) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(Line);
+    Line->StartOfString = &Text->StartOfString[Index];
+    while (Index < Text->LengthInChars &&
+           Text->StartOfString[Index] != '\r' &&
+           Text->StartOfString[Index] != '\n') {
+
+        Index++;
+    }
+    Line->LengthInChars = (DWORD)(&Text->StartOfString[Index] - Line->StartOfString);
+
+    if (Index < Text->LengthInChars && Text->StartOfString[Index] == '\r') {
+        Index++;
+    }
+    if (Index < Text->LengthInChars && Text->StartOfString[Index] == '\n') {
+        Index++;
+    }
+
+    *Offset = Index;
+    return TRUE;
+}
+
+/**
+ Populate history from the complete text of a history file.  Only the most
+ recent lines that fit within the history limit are added.  Each history
+ entry refers to the text buffer rather than being allocated individually.
+
+ @param Text Pointer to the text of the history file.  This must be a
+        referenced allocation.
+ */
+VOID
+YoriShAddHistoryFromText(
+    __in PYORI_STRING Text
+    )
+{
+    DWORD Offset;
+    DWORD LineCount;
+    DWORD LinesToSkip;
+    YORI_STRING Line;
+
+    //
+    //  Count the lines first, so that lines which would be discarded from
+    //  history immediately are never added.
+    //
+
+    LineCount = 0;
+    Offset = 0;
+    while (YoriShGetNextHistoryFileLine(Text, &Offset, &Line)) {
+        if (Line.LengthInChars > 0) {
+            LineCount++;
+        }
+    }
+
+    YoriShHistoryFileLineCount = LineCount;
+    LinesToSkip = 0;
+    if (LineCount > YoriShCommandHistoryMax) {
+        LinesToSkip = LineCount - YoriShCommandHistoryMax;
+    }
+
+    Offset = 0;
+    while (YoriShGetNextHistoryFileLine(Text, &Offset, &Line)) {
+        if (Line.LengthInChars == 0) {
+            continue;
+        }
+
+        if (LinesToSkip > 0) {
+            LinesToSkip--;
+            continue;
+        }
+
+        Line.MemoryToFree = Text->MemoryToFree;
+        Line.LengthAllocated = Line.LengthInChars;
+        if (!YoriShAddToHistory(&Line, FALSE)) {
+            break;
         }
+    }
+}
+
+/**
+ Load history from a file by mapping the file into memory and converting it
+ into a single buffer of text.
+
+ @param FileHandle Handle to the history file.
+
+ @return TRUE to indicate the file was loaded, FALSE if it could not be
+         mapped and should be read instead.
+ */
+__success(return)
+BOOL
+YoriShLoadHistoryFromMappedFile(
+    __in HANDLE FileHandle
+    )
+{
+    DWORD FileSizeLow;
+    DWORD FileSizeHigh;
+    HANDLE MappingHandle;
+    PUCHAR View;
+    PUCHAR Bytes;
+    DWORD ByteCount;
+    DWORD CharCount;
+    DWORD Encoding;
+    YORI_STRING Text;
+
+    FileSizeLow = GetFileSize(FileHandle, &FileSizeHigh);
+    if (FileSizeLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&FilePath);
+    if (FileSizeHigh != 0 || FileSizeLow >= 0x40000000) {
+        return FALSE;
+    }
+
+    if (FileSizeLow == 0) {
+        YoriShHistoryFileLineCount = 0;
+        return TRUE;
+    }
+
+    MappingHandle = CreateFileMapping(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (MappingHandle == NULL) {
+        return FALSE;
+    }
+
+    View = MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (View == NULL) {
+        CloseHandle(MappingHandle);
+        return FALSE;
+    }
+
+    //
+    //  Interpret the file using the same encoding and byte order mark rules
+    //  as the line reader.
+    //
+
+    Bytes = View;
+    ByteCount = FileSizeLow;
+    Encoding = YoriLibGetMultibyteInputEncoding();
+
+    if (Encoding == CP_UTF16) {
+        if (ByteCount >= 2 && Bytes[0] == 0xFF && Bytes[1] == 0xFE) {
+            Bytes += 2;
+            ByteCount -= 2;
+        }
+        CharCount = ByteCount / sizeof(TCHAR);
+    } else {
+        if (Encoding == CP_UTF8 && ByteCount >= 3 &&
+            Bytes[0] == 0xEF && Bytes[1] == 0xBB && Bytes[2] == 0xBF) {
+
+            Bytes += 3;
+            ByteCount -= 3;
+        }
+        CharCount = YoriLibGetMultibyteInputSizeNeeded((LPCSTR)Bytes, ByteCount);
+    }
+
+    if (!YoriLibAllocateString(&Text, CharCount + 1)) {
+        UnmapViewOfFile(View);
+        CloseHandle(MappingHandle);
+        return FALSE;
+    }
+
+    if (Encoding == CP_UTF16) {
+        memcpy(Text.StartOfString, Bytes, CharCount * sizeof(TCHAR));
+    } else if (CharCount > 0) {
+        YoriLibMultibyteInput((LPCSTR)Bytes, ByteCount, Text.StartOfString, CharCount);
+    }
+    Text.LengthInChars = CharCount;
+    Text.StartOfString[CharCount] = '\0';
+
+    UnmapViewOfFile(View);
+    CloseHandle(MappingHandle);
+
+    YoriShAddHistoryFromText(&Text);
+    YoriLibFreeStringContents(&Text);
+    return TRUE;
+}
+
+/**
+ Load history from a file by reading it one line at a time.  This is used if
+ the file cannot be mapped.
+
+ @param FileHandle Handle to the history file.
+ */
+VOID
+YoriShLoadHistoryFromStream(
+    __in HANDLE FileHandle
+    )
+{
+    PVOID LineContext = NULL;
+    YORI_STRING LineString;
 
     YoriLibInitEmptyString(&LineString);
+    YoriShHistoryFileLineCount = 0;
 
     while (TRUE) {
 
@@ -314,6 +1025,10 @@ YoriShLoadHistoryFromFile()
             break;
         }
 
+        if (LineString.LengthInChars > 0) {
+            YoriShHistoryFileLineCount++;
+        }
+
         //
         //  If we fail to add to history, stop.  If it is added to history,
         //  that string is now owned by the history buffer, so reinitialize
@@ -330,13 +1045,90 @@ YoriShLoadHistoryFromFile()
 
     YoriLibLineReadClose(LineContext);
     YoriLibFreeStringContents(&LineString);
+}
+
+/**
+ Load history from a file if the user has requested this behavior by
+ setting YORIHISTFILE.  Configure the maximum amount of history to retain
+ if the user has requested this behavior by setting YORIHISTSIZE.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShLoadHistoryFromFile()
+{
+    YORI_STRING FilePath;
+    HANDLE FileHandle;
+
+    if (YoriShHistoryInitialized) {
+        return TRUE;
+    }
+
+    YoriShInitHistory();
+
+    //
+    //  Check if there's a file to load saved history from.
+    //
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return TRUE;
+    }
+
+    FileHandle = CreateFile(FilePath.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        DWORD LastError = GetLastError();
+        if (LastError != ERROR_FILE_NOT_FOUND) {
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            YoriLibFreeStringContents(&FilePath);
+        } else {
+
+            //
+            //  There's no file, so history can be appended to a new one.
+            //
+
+            YoriShHistoryFileLineCount = 0;
+            YoriShHistoryUnsavedCount = YoriShCommandHistoryCount;
+            YoriShHistoryFileInSync = TRUE;
+            YoriLibFreeStringContents(&YoriShHistoryFilePath);
+            memcpy(&YoriShHistoryFilePath, &FilePath, sizeof(YORI_STRING));
+        }
+        return FALSE;
+    }
+
+    if (!YoriShLoadHistoryFromMappedFile(FileHandle)) {
+        YoriShLoadHistoryFromStream(FileHandle);
+    }
+
     CloseHandle(FileHandle);
+
+    //
+    //  Everything in history so far came from the file, so only entries
+    //  added from here need to be appended to it.
+    //
+
+    YoriShHistoryUnsavedCount = 0;
+    YoriShHistoryFileInSync = TRUE;
+    YoriLibFreeStringContents(&YoriShHistoryFilePath);
+    memcpy(&YoriShHistoryFilePath, &FilePath, sizeof(YORI_STRING));
     return TRUE;
 }
 
 /**
  Write the current command history buffer to a file, if the user has requested
- this behavior by configuring the YORIHISTFILE environment variable.
+ this behavior by configuring the YORIHISTFILE environment variable.  If the
+ file is known to contain the earlier history, only new entries are appended
+ to it.  The file is rewritten in full if that is not known, or if appending
+ has caused it to grow to twice the size of the history being retained.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
@@ -344,41 +1136,36 @@ __success(return)
 BOOL
 YoriShSaveHistoryToFile()
 {
-    DWORD FileNameLength;
-    YORI_STRING UserHistFileName;
     YORI_STRING FilePath;
     HANDLE FileHandle;
     PYORI_LIST_ENTRY ListEntry;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    BOOL FullRewrite;
+    DWORD Index;
+    DWORD LinesWritten;
 
-    FileNameLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (FileNameLength == 0) {
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(&UserHistFileName, FileNameLength)) {
-        return FALSE;
-    }
-
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+    FullRewrite = FALSE;
+    if (!YoriShHistoryFileInSync ||
+        YoriLibCompareStringInsensitive(&FilePath, &YoriShHistoryFilePath) != 0 ||
+        YoriShHistoryFileLineCount + YoriShHistoryUnsavedCount > 2 * YoriShCommandHistoryMax) {
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
+        FullRewrite = TRUE;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
+    if (!FullRewrite && YoriShHistoryUnsavedCount == 0) {
+        YoriLibFreeStringContents(&FilePath);
+        return TRUE;
     }
 
-    YoriLibFreeStringContents(&UserHistFileName);
-
     FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_WRITE,
+                            FullRewrite?GENERIC_WRITE:FILE_APPEND_DATA,
                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
                             NULL,
-                            CREATE_ALWAYS,
+                            FullRewrite?CREATE_ALWAYS:OPEN_ALWAYS,
                             FILE_ATTRIBUTE_NORMAL,
                             NULL);
 
@@ -391,24 +1178,46 @@ YoriShSaveHistoryToFile()
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&FilePath);
-
     //
-    //  Search the list of history.
+    //  Search the list of history.  When appending, skip back over the
+    //  entries which have not been saved yet and write those.
     //
 
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
-        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
+        ListEntry = NULL;
+        if (!FullRewrite) {
+            for (Index = 0; Index < YoriShHistoryUnsavedCount; Index++) {
+                ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+            }
+            ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+        }
+
+        LinesWritten = 0;
+        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
         while (ListEntry != NULL) {
             HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
 
             YoriLibOutputToDevice(FileHandle, 0, _T("%y\n"), &HistoryEntry->CmdLine);
+            LinesWritten++;
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
         }
+
+        if (FullRewrite) {
+            YoriShHistoryFileLineCount = LinesWritten;
+        } else {
+            YoriShHistoryFileLineCount += LinesWritten;
+        }
+        YoriShHistoryUnsavedCount = 0;
+        YoriShHistoryFileInSync = TRUE;
+        YoriLibFreeStringContents(&YoriShHistoryFilePath);
+        memcpy(&YoriShHistoryFilePath, &FilePath, sizeof(YORI_STRING));
+        YoriLibInitEmptyString(&FilePath);
+
         ReleaseMutex(YoriShHistoryLock);
     }
 
+    YoriLibFreeStringContents(&FilePath);
     CloseHandle(FileHandle);
 #if defined(_MSC_VER) && (_MSC_VER >= 1700)
 #pragma warning(suppress: 26165) // Analyze thinks a lock might be leaked
@@ -26,6 +26,17 @@
 
 #include "yori.h"
 
+/**
+ The number of input records to read from the console at a time.
+ */
+#define YORI_SH_INPUT_RECORDS_PER_READ (128)
+
+/**
+ The maximum number of milliseconds to defer displaying the input buffer
+ while a burst of input, such as a paste, is being processed.
+ */
+#define YORI_SH_INPUT_RENDER_INTERVAL (100)
+
 /**
  Returns the coordinates in the console if the cursor is moved by a given
  number of cells.  Note the input value is signed, as this routine can move
@@ -322,8 +333,239 @@ YoriShPostKeyPress(
     }
 }
 
+/**
+ Compose the cells that the input buffer should occupy on the console.
+ These consist of the input buffer, followed by the suggestion, followed by
+ empty cells to erase anything previously displayed beyond them.
+
+ @param Buffer Pointer to the input buffer.
+
+ @param Attributes The color to display the input buffer in.
+
+ @param CellCount The number of cells to compose.  This must be at least
+        the combined length of the input buffer and suggestion.
+
+ @return TRUE to indicate success, FALSE to indicate allocation failure.
+ */
+__success(return)
+BOOL
+YoriShComposeInputCells(
+    __inout PYORI_SH_INPUT_BUFFER Buffer,
+    __in WORD Attributes,
+    __in DWORD CellCount
+    )
+{
+    PCHAR_INFO NewDisplayedCells;
+    PCHAR_INFO NewPendingCells;
+    DWORD NewCellsAllocated;
+    DWORD Index;
+    DWORD SuggestionEnd;
+    WORD SuggestionAttributes;
+
+    if (CellCount > Buffer->CellsAllocated) {
+        NewCellsAllocated = Buffer->CellsAllocated * 2;
+        if (NewCellsAllocated < CellCount) {
+            NewCellsAllocated = CellCount + 256;
+        }
+
+        NewDisplayedCells = YoriLibMalloc(NewCellsAllocated * sizeof(CHAR_INFO));
+        if (NewDisplayedCells == NULL) {
+            return FALSE;
+        }
+
+        NewPendingCells = YoriLibMalloc(NewCellsAllocated * sizeof(CHAR_INFO));
+        if (NewPendingCells == NULL) {
+            YoriLibFree(NewDisplayedCells);
+            return FALSE;
+        }
+
+        if (Buffer->DisplayedCells != NULL) {
+            memcpy(NewDisplayedCells, Buffer->DisplayedCells, Buffer->DisplayedCellsValid * sizeof(CHAR_INFO));
+            YoriLibFree(Buffer->DisplayedCells);
+            YoriLibFree(Buffer->PendingCells);
+        }
+
+        Buffer->DisplayedCells = NewDisplayedCells;
+        Buffer->PendingCells = NewPendingCells;
+        Buffer->CellsAllocated = NewCellsAllocated;
+    }
+
+    ASSERT(CellCount >= Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars);
+
+    for (Index = 0; Index < Buffer->String.LengthInChars; Index++) {
+        Buffer->PendingCells[Index].Char.UnicodeChar = Buffer->String.StartOfString[Index];
+        Buffer->PendingCells[Index].Attributes = Attributes;
+    }
+
+    SuggestionAttributes = (WORD)((Attributes & 0xF0) | FOREGROUND_INTENSITY);
+    SuggestionEnd = Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars;
+    for (; Index < SuggestionEnd; Index++) {
+        Buffer->PendingCells[Index].Char.UnicodeChar = Buffer->SuggestionString.StartOfString[Index - Buffer->String.LengthInChars];
+        Buffer->PendingCells[Index].Attributes = SuggestionAttributes;
+    }
+
+    for (; Index < CellCount; Index++) {
+        Buffer->PendingCells[Index].Char.UnicodeChar = ' ';
+        Buffer->PendingCells[Index].Attributes = Attributes;
+    }
+
+    return TRUE;
+}
+
+/**
+ Write a contiguous range of cells to the console.  Since the console
+ writes rectangles, this requires one write for a partial line at the start,
+ one for any complete lines, and one for a partial line at the end.
+
+ @param Buffer Pointer to the input buffer.
+
+ @param ScreenInfo Pointer to information about the current screen layout.
+
+ @param Cells Pointer to the first cell to write.
+
+ @param Start The location of the first cell on the console.
+
+ @param End The location of the final cell on the console.
+ */
+VOID
+YoriShWriteInputCells(
+    __in PYORI_SH_INPUT_BUFFER Buffer,
+    __in PCONSOLE_SCREEN_BUFFER_INFO ScreenInfo,
+    __in PCHAR_INFO Cells,
+    __in COORD Start,
+    __in COORD End
+    )
+{
+    SMALL_RECT Region;
+    COORD BufferSize;
+    COORD BufferOrigin;
+    SHORT FirstFullLine;
+    SHORT LastFullLine;
+
+    BufferOrigin.X = 0;
+    BufferOrigin.Y = 0;
+
+    if (Start.Y == End.Y) {
+        BufferSize.X = (SHORT)(End.X - Start.X + 1);
+        BufferSize.Y = 1;
+        Region.Left = Start.X;
+        Region.Right = End.X;
+        Region.Top = Start.Y;
+        Region.Bottom = Start.Y;
+        WriteConsoleOutput(Buffer->ConsoleOutputHandle, Cells, BufferSize, BufferOrigin, &Region);
+        return;
+    }
+
+    FirstFullLine = Start.Y;
+    if (Start.X != 0) {
+        BufferSize.X = (SHORT)(ScreenInfo->dwSize.X - Start.X);
+        BufferSize.Y = 1;
+        Region.Left = Start.X;
+        Region.Right = (SHORT)(ScreenInfo->dwSize.X - 1);
+        Region.Top = Start.Y;
+        Region.Bottom = Start.Y;
+        WriteConsoleOutput(Buffer->ConsoleOutputHandle, Cells, BufferSize, BufferOrigin, &Region);
+        Cells = Cells + BufferSize.X;
+        FirstFullLine++;
+    }
+
+    LastFullLine = End.Y;
+    if (End.X != ScreenInfo->dwSize.X - 1) {
+        LastFullLine--;
+    }
+
+    if (LastFullLine >= FirstFullLine) {
+        BufferSize.X = ScreenInfo->dwSize.X;
+        BufferSize.Y = (SHORT)(LastFullLine - FirstFullLine + 1);
+        Region.Left = 0;
+        Region.Right = (SHORT)(ScreenInfo->dwSize.X - 1);
+        Region.Top = FirstFullLine;
+        Region.Bottom = LastFullLine;
+        WriteConsoleOutput(Buffer->ConsoleOutputHandle, Cells, BufferSize, BufferOrigin, &Region);
+        Cells = Cells + BufferSize.X * BufferSize.Y;
+    }
+
+    if (LastFullLine < End.Y) {
+        BufferSize.X = (SHORT)(End.X + 1);
+        BufferSize.Y = 1;
+        Region.Left = 0;
+        Region.Right = End.X;
+        Region.Top = End.Y;
+        Region.Bottom = End.Y;
+        WriteConsoleOutput(Buffer->ConsoleOutputHandle, Cells, BufferSize, BufferOrigin, &Region);
+    }
+}
+
+/**
+ Determine whether a cell being composed matches the cell most recently
+ written to the console at the same location.
+
+ @param Buffer Pointer to the input buffer.
+
+ @param Index The offset of the cell from the beginning of the input buffer.
+
+ @return TRUE if the cell is unchanged, FALSE if it needs to be written.
+ */
+BOOL
+YoriShIsInputCellUnchanged(
+    __in PYORI_SH_INPUT_BUFFER Buffer,
+    __in DWORD Index
+    )
+{
+    if (Index >= Buffer->DisplayedCellsValid) {
+        return FALSE;
+    }
+
+    if (Buffer->PendingCells[Index].Char.UnicodeChar == Buffer->DisplayedCells[Index].Char.UnicodeChar &&
+        Buffer->PendingCells[Index].Attributes == Buffer->DisplayedCells[Index].Attributes) {
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Indicate that the console no longer contains the cells most recently
+ written for the input buffer, so the next display writes every cell.
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShInvalidateInputCells(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    Buffer->DisplayedCellsValid = 0;
+}
+
+/**
+ Free the cells used to display the input buffer.
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShFreeInputCells(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (Buffer->DisplayedCells != NULL) {
+        YoriLibFree(Buffer->DisplayedCells);
+        Buffer->DisplayedCells = NULL;
+    }
+    if (Buffer->PendingCells != NULL) {
+        YoriLibFree(Buffer->PendingCells);
+        Buffer->PendingCells = NULL;
+    }
+    Buffer->CellsAllocated = 0;
+    Buffer->DisplayedCellsValid = 0;
+}
+
 /**
  After a key has been pressed and processed, display the resulting buffer.
+ The new contents are composed into a separate set of cells and compared
+ with the cells most recently written, so only the range that changed is
+ written to the console, which is typically a single write.
 
  @param Buffer Pointer to the input buffer to display.
 
@@ -335,12 +577,12 @@ YoriShDisplayAfterKeyPress(
     __in PYORI_SH_INPUT_BUFFER Buffer
     )
 {
-    DWORD NumberWritten;
-    DWORD NumberToWrite = 0;
-    DWORD NumberToFill = 0;
+    DWORD CellCount;
+    DWORD FirstChanged;
+    DWORD LastChanged;
+    PCHAR_INFO SwapCells;
     COORD WritePosition;
-    COORD FillPosition;
-    COORD SuggestionPosition;
+    COORD EndPosition;
     CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
     HANDLE hConsole;
 
@@ -378,13 +620,6 @@ YoriShDisplayAfterKeyPress(
     YoriLibRedrawSelection(&Buffer->Selection);
     YoriLibRedrawSelection(&Buffer->Mouseover);
 
-    WritePosition.X = 0;
-    WritePosition.Y = 0;
-    SuggestionPosition.X = 0;
-    SuggestionPosition.Y = 0;
-    FillPosition.X = 0;
-    FillPosition.Y = 0;
-
     //
     //  Re-render the text if part of the input string has changed,
     //  or if the location of the cursor in the input string has changed
@@ -400,95 +635,69 @@ YoriShDisplayAfterKeyPress(
         }
 
         //
-        //  Calculate the number of characters truncated from the currently
-        //  displayed buffer.  If the text is being updated, it needs to be
-        //  redrawn from the fill position or less, otherwise we'd leave a
-        //  hole.
+        //  Compose the new frame.  If the text has been truncated, it
+        //  includes empty cells to cover the previously displayed text.
         //
 
-        if (Buffer->PreviousCharsDisplayed > Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars) {
-            NumberToFill = Buffer->PreviousCharsDisplayed - Buffer->String.LengthInChars - Buffer->SuggestionString.LengthInChars;
-            ASSERT(Buffer->DirtyLength == 0 || Buffer->DirtyBeginOffset <= Buffer->PreviousCharsDisplayed - NumberToFill);
+        CellCount = Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars;
+        if (Buffer->PreviousCharsDisplayed > CellCount) {
+            CellCount = Buffer->PreviousCharsDisplayed;
+        }
+
+        if (!YoriShComposeInputCells(Buffer, ScreenInfo.wAttributes, CellCount)) {
+            return FALSE;
         }
 
         //
-        //  Calculate the locations to write both the new text as well as where
-        //  to erase any previous text.
-        //
-        //  Calculate where the buffer will end in order to force the display
-        //  to scroll so the whole output has somewhere to go.  The suggestion
-        //  is scrolled first because it must be longer than the buffer alone,
-        //  so doing this ensures sufficient scrolling has performed for both
-        //  WritePosition and SelectionPosition to be valid.
+        //  Find the range of cells that differ from what was previously
+        //  written.
         //
 
-        if (Buffer->SuggestionString.LengthInChars > 0) {
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, -1 * Buffer->PreviousCurrentOffset + Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars, NULL)) {
-                return FALSE;
-            }
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, -1 * Buffer->PreviousCurrentOffset + Buffer->String.LengthInChars, &SuggestionPosition)) {
-                return FALSE;
-            }
+        FirstChanged = 0;
+        while (FirstChanged < CellCount && YoriShIsInputCellUnchanged(Buffer, FirstChanged)) {
+            FirstChanged++;
         }
 
-        if (Buffer->DirtyBeginOffset < Buffer->String.LengthInChars && Buffer->DirtyLength > 0) {
-            if (Buffer->DirtyBeginOffset + Buffer->DirtyLength > Buffer->String.LengthInChars) {
-                NumberToWrite = Buffer->String.LengthInChars - Buffer->DirtyBeginOffset;
-            } else {
-                NumberToWrite = Buffer->DirtyLength;
+        LastChanged = FirstChanged;
+        if (FirstChanged < CellCount) {
+            LastChanged = CellCount - 1;
+            while (LastChanged > FirstChanged && YoriShIsInputCellUnchanged(Buffer, LastChanged)) {
+                LastChanged--;
             }
 
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, (-1 * Buffer->PreviousCurrentOffset) + Buffer->DirtyBeginOffset + NumberToWrite, NULL)) {
-                return FALSE;
-            }
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, (-1 * Buffer->PreviousCurrentOffset) + Buffer->DirtyBeginOffset, &WritePosition)) {
+            //
+            //  Calculate where the changed range will end in order to force
+            //  the display to scroll so the whole output has somewhere to
+            //  go, then calculate the locations of the first and last cells.
+            //
+
+            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, (-1 * Buffer->PreviousCurrentOffset) + LastChanged + 1, NULL)) {
                 return FALSE;
             }
-        }
-
-
-        if (NumberToFill) {
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, -1 * Buffer->PreviousCurrentOffset + Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars + NumberToFill, NULL)) {
+            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, (-1 * Buffer->PreviousCurrentOffset) + FirstChanged, &WritePosition)) {
                 return FALSE;
             }
-            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, -1 * Buffer->PreviousCurrentOffset + Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars, &FillPosition)) {
+            if (!YoriShDetermineCellLocationIfMovedCacheResult(Buffer, &ScreenInfo, (-1 * Buffer->PreviousCurrentOffset) + LastChanged, &EndPosition)) {
                 return FALSE;
             }
-        }
-
-        if (NumberToWrite > 0 ||
-            Buffer->SuggestionDirty ||
-            Buffer->CurrentOffset != Buffer->PreviousCurrentOffset) {
 
-            //
-            //  Now that we know where the text should go, advance the cursor
-            //  and render the text.
-            //
+            YoriShWriteInputCells(Buffer, &ScreenInfo, &Buffer->PendingCells[FirstChanged], WritePosition, EndPosition);
+        }
 
+        if (Buffer->CurrentOffset != Buffer->PreviousCurrentOffset) {
             if (!YoriShMoveCursorCacheResult(Buffer, &ScreenInfo, Buffer->CurrentOffset - Buffer->PreviousCurrentOffset)) {
                 return FALSE;
             }
-
-            if (NumberToWrite) {
-                WriteConsoleOutputCharacter(hConsole, &Buffer->String.StartOfString[Buffer->DirtyBeginOffset], NumberToWrite, WritePosition, &NumberWritten);
-                FillConsoleOutputAttribute(hConsole, ScreenInfo.wAttributes, NumberToWrite, WritePosition, &NumberWritten);
-            }
-
-            if (Buffer->SuggestionDirty) {
-                WriteConsoleOutputCharacter(hConsole, Buffer->SuggestionString.StartOfString, Buffer->SuggestionString.LengthInChars, SuggestionPosition, &NumberWritten);
-                FillConsoleOutputAttribute(hConsole, (USHORT)((ScreenInfo.wAttributes & 0xF0) | FOREGROUND_INTENSITY), Buffer->SuggestionString.LengthInChars, SuggestionPosition, &NumberWritten);
-            }
         }
 
         //
-        //  If there are additional cells to empty due to truncation, display
-        //  those now.
+        //  The new frame is now what the console contains.
         //
 
-        if (NumberToFill) {
-            FillConsoleOutputCharacter(hConsole, ' ', NumberToFill, FillPosition, &NumberWritten);
-            FillConsoleOutputAttribute(hConsole, ScreenInfo.wAttributes, NumberToFill, FillPosition, &NumberWritten);
-        }
+        SwapCells = Buffer->DisplayedCells;
+        Buffer->DisplayedCells = Buffer->PendingCells;
+        Buffer->PendingCells = SwapCells;
+        Buffer->DisplayedCellsValid = CellCount;
 
         Buffer->PreviousCurrentOffset = Buffer->CurrentOffset;
         Buffer->PreviousCharsDisplayed = Buffer->String.LengthInChars + Buffer->SuggestionString.LengthInChars;
@@ -704,6 +913,7 @@ YoriShTerminateInput(
         Buffer->String.StartOfString[Buffer->String.LengthInChars] = '\0';
     }
     YoriShMoveCursor(Buffer, Buffer->String.LengthInChars - Buffer->CurrentOffset);
+    YoriShFreeInputCells(Buffer);
     YoriShConfigureMouseForPrograms(Buffer->ConsoleInputHandle);
     YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n"));
 }
@@ -907,6 +1117,7 @@ YoriShCompletionListAllMatches(
     YoriShGlobal.NextCommandOffset = Buffer->CurrentOffset;
     Buffer->CurrentOffset = 0;
     Buffer->PreviousCurrentOffset = 0;
+    YoriShInvalidateInputCells(Buffer);
 }
 
 
@@ -1786,9 +1997,209 @@ YoriShClearScreen(
     YoriShPreCommand(TRUE);
 
     Buffer->PreviousCurrentOffset = 0;
+    YoriShInvalidateInputCells(Buffer);
     YoriShExtendDirtyRangeToCover(Buffer, 0, Buffer->String.LengthInChars);
 }
 
+/**
+ Erase the prompt and the current input buffer from the console, leaving
+ the cursor where the prompt began.  The prompt is located by counting
+ backwards from the beginning of the input buffer.
+
+ @param Buffer Pointer to the input buffer.
+
+ @return TRUE to indicate the prompt was erased, FALSE if it could not be
+         located.
+ */
+__success(return)
+BOOL
+YoriShErasePromptAndInput(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    HANDLE ConsoleHandle;
+    CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
+    DWORD PromptCells;
+    DWORD CursorPosition;
+    DWORD PromptPosition;
+    DWORD CharsWritten;
+    COORD PromptStart;
+
+    PromptCells = YoriShGetPromptCellsDisplayed();
+    if (PromptCells == 0) {
+        return FALSE;
+    }
+
+    ConsoleHandle = Buffer->ConsoleOutputHandle;
+    if (!GetConsoleScreenBufferInfo(ConsoleHandle, &ScreenInfo)) {
+        return FALSE;
+    }
+
+    CursorPosition = ScreenInfo.dwCursorPosition.Y * ScreenInfo.dwSize.X + ScreenInfo.dwCursorPosition.X;
+    if (Buffer->PreviousCurrentOffset + PromptCells > CursorPosition) {
+        return FALSE;
+    }
+
+    PromptPosition = CursorPosition - Buffer->PreviousCurrentOffset - PromptCells;
+    PromptStart.X = (SHORT)(PromptPosition % ScreenInfo.dwSize.X);
+    PromptStart.Y = (SHORT)(PromptPosition / ScreenInfo.dwSize.X);
+
+    //
+    //  Selections refer to screen locations, which may no longer contain
+    //  the same text once the prompt changes length.
+    //
+
+    if (YoriLibIsSelectionActive(&Buffer->Selection)) {
+        YoriLibClearSelection(&Buffer->Selection);
+        YoriLibRedrawSelection(&Buffer->Selection);
+    }
+
+    if (YoriLibIsSelectionActive(&Buffer->Mouseover)) {
+        YoriLibClearSelection(&Buffer->Mouseover);
+        YoriLibRedrawSelection(&Buffer->Mouseover);
+    }
+
+    FillConsoleOutputCharacter(ConsoleHandle, ' ', PromptCells + Buffer->PreviousCharsDisplayed, PromptStart, &CharsWritten);
+    FillConsoleOutputAttribute(ConsoleHandle, ScreenInfo.wAttributes, PromptCells + Buffer->PreviousCharsDisplayed, PromptStart, &CharsWritten);
+
+    SetConsoleCursorPosition(ConsoleHandle, PromptStart);
+
+    return TRUE;
+}
+
+/**
+ Redraw the prompt at the current cursor location, and indicate that the
+ entire input buffer needs to be displayed after it.  This is used after
+ @ref YoriShErasePromptAndInput .
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShRedrawPromptAndInput(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    YoriShPreCommand(FALSE);
+    YoriShRedrawPrompt();
+    YoriShPreCommand(TRUE);
+
+    Buffer->PreviousCurrentOffset = 0;
+    Buffer->PreviousCharsDisplayed = 0;
+    YoriShInvalidateInputCells(Buffer);
+    YoriShExtendDirtyRangeToCover(Buffer, 0, Buffer->String.LengthInChars);
+    if (Buffer->SuggestionString.LengthInChars > 0) {
+        Buffer->SuggestionDirty = TRUE;
+    }
+}
+
+/**
+ Redraw the prompt in place after a backquoted expression within it has
+ completed, and resume editing the current input buffer.
+
+ @param Buffer Pointer to the input buffer.
+
+ @return TRUE to indicate the prompt was redrawn, FALSE if it could not be
+         located.
+ */
+__success(return)
+BOOL
+YoriShRepaintPrompt(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (!YoriShErasePromptAndInput(Buffer)) {
+        return FALSE;
+    }
+
+    YoriShRedrawPromptAndInput(Buffer);
+    return TRUE;
+}
+
+/**
+ Tell the user about any background jobs that have completed while input is
+ being entered.  The messages are displayed where the prompt was, and the
+ prompt and input are displayed again below them.  If the prompt cannot be
+ located, the messages are left to be displayed before the next prompt.
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShDisplayJobCompletionsDuringInput(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (!YoriShAreJobCompletionsQueued()) {
+        return;
+    }
+
+    if (!YoriShErasePromptAndInput(Buffer)) {
+        return;
+    }
+
+    YoriShReportQueuedJobCompletions(FALSE);
+    YoriShRedrawPromptAndInput(Buffer);
+    YoriShDisplayAfterKeyPress(Buffer);
+    YoriShConfigureConsoleForInput(Buffer);
+}
+
+/**
+ Wait for console input to arrive.  While waiting, if a background job
+ completes, tell the user about it and continue waiting.
+
+ @param Buffer Pointer to the input buffer.
+
+ @param Timeout The maximum number of milliseconds to wait, or INFINITE.
+
+ @return WAIT_OBJECT_0 if input has arrived, WAIT_TIMEOUT if the timeout
+         elapsed, or another value if the wait failed.
+ */
+DWORD
+YoriShWaitForInput(
+    __in PYORI_SH_INPUT_BUFFER Buffer,
+    __in DWORD Timeout
+    )
+{
+    HANDLE WaitHandles[2];
+    DWORD StartTick;
+    DWORD Elapsed;
+    DWORD Remaining;
+    DWORD Result;
+
+    WaitHandles[0] = Buffer->ConsoleInputHandle;
+    WaitHandles[1] = YoriShGetJobCompletionEvent();
+    if (WaitHandles[1] == NULL) {
+        return WaitForSingleObject(WaitHandles[0], Timeout);
+    }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    StartTick = GetTickCount();
+    Remaining = Timeout;
+
+    while (TRUE) {
+        Result = WaitForMultipleObjects(2, WaitHandles, FALSE, Remaining);
+        if (Result != WAIT_OBJECT_0 + 1) {
+            return Result;
+        }
+
+        YoriShDisplayJobCompletionsDuringInput(Buffer);
+
+        if (Timeout != INFINITE) {
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+            Elapsed = GetTickCount() - StartTick;
+            if (Elapsed >= Timeout) {
+                return WAIT_TIMEOUT;
+            }
+            Remaining = Timeout - Elapsed;
+        }
+    }
+}
+
 /**
  Create a new selection, and if one already exists, advance the selection
  to the left by one character.
@@ -2875,11 +3286,15 @@ YoriShGetExpressionFromConsole(
     DWORD ActuallyRead = 0;
     DWORD CurrentRecordIndex = 0;
     DWORD err;
-    INPUT_RECORD InputRecords[20];
+    INPUT_RECORD InputRecords[YORI_SH_INPUT_RECORDS_PER_READ];
     PINPUT_RECORD InputRecord;
     BOOL ReDisplayRequired;
     BOOL TerminateInput;
     BOOL RestartStateSaved = FALSE;
+    BOOL PromptChanged;
+    BOOL RenderPending = FALSE;
+    DWORD LastRenderTick = 0;
+    DWORD EventsPending;
 
     ZeroMemory(&Buffer, sizeof(Buffer));
     Buffer.InsertMode = TRUE;
@@ -2901,6 +3316,7 @@ YoriShGetExpressionFromConsole(
     }
 
     YoriShConfigureConsoleForInput(&Buffer);
+    YoriShResetTabCompletionPrefetch();
 
     if (YoriShGlobal.NextCommand.LengthInChars > 0) {
         YoriShAddYoriStringToInput(&Buffer, &YoriShGlobal.NextCommand);
@@ -2961,6 +3377,7 @@ YoriShGetExpressionFromConsole(
                     InputRecord->Event.WindowBufferSizeEvent.dwSize.Y != Buffer.ConsoleBufferDimensions.Y) {
 
                     ReDisplayRequired |= YoriShClearInputSelections(&Buffer);
+                    YoriShInvalidateInputCells(&Buffer);
 
                     Buffer.ConsoleBufferDimensions.X = InputRecord->Event.WindowBufferSizeEvent.dwSize.X;
                     Buffer.ConsoleBufferDimensions.Y = InputRecord->Event.WindowBufferSizeEvent.dwSize.Y;
@@ -2987,10 +3404,6 @@ YoriShGetExpressionFromConsole(
             }
         }
 
-        if (ReDisplayRequired) {
-            YoriShDisplayAfterKeyPress(&Buffer);
-        }
-
         //
         //  If we processed any events, remove them from the queue.
         //
@@ -3001,6 +3414,40 @@ YoriShGetExpressionFromConsole(
             }
         }
 
+        //
+        //  If more input has already arrived, such as when text is being
+        //  pasted, process it before displaying anything so that a burst
+        //  of input results in a single update.  Display periodically
+        //  regardless so a very large burst shows progress.
+        //
+
+        if (ReDisplayRequired) {
+            RenderPending = TRUE;
+        }
+
+        if (RenderPending) {
+            if (!GetNumberOfConsoleInputEvents(InputHandle, &EventsPending)) {
+                EventsPending = 0;
+            }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+            if (EventsPending > 0 && GetTickCount() - LastRenderTick < YORI_SH_INPUT_RENDER_INTERVAL) {
+                continue;
+            }
+
+            YoriShDisplayAfterKeyPress(&Buffer);
+            YoriShPrefetchTabCompletion(&Buffer);
+            RenderPending = FALSE;
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+            LastRenderTick = GetTickCount();
+        }
+
         //
         //  Wait to see if any further events arrive.  If we haven't saved
         //  state and the user hasn't done anything for 30 seconds, save
@@ -3019,15 +3466,35 @@ YoriShGetExpressionFromConsole(
         while (TRUE) {
             if (YoriLibIsPeriodicScrollActive(&Buffer.Selection)) {
 
-                err = WaitForSingleObject(InputHandle, 100);
+                err = YoriShWaitForInput(&Buffer, 100);
                 if (err == WAIT_OBJECT_0) {
                     break;
                 }
                 if (err == WAIT_TIMEOUT) {
                     YoriLibPeriodicScrollForSelection(&Buffer.Selection);
                 }
+            } else if (YoriShPromptSegmentsPending()) {
+
+                //
+                //  If part of the prompt is still being evaluated, check
+                //  periodically for it to complete and redraw the prompt
+                //  with the result.
+                //
+
+                err = YoriShWaitForInput(&Buffer, 50);
+                if (err == WAIT_OBJECT_0) {
+                    break;
+                }
+                if (err == WAIT_TIMEOUT) {
+                    if (YoriShCollectPromptSegments(&PromptChanged)) {
+                        if (PromptChanged && YoriShRepaintPrompt(&Buffer)) {
+                            YoriShDisplayAfterKeyPress(&Buffer);
+                        }
+                        YoriShConfigureConsoleForInput(&Buffer);
+                    }
+                }
             } else if (!Buffer.SuggestionPopulated) {
-                err = WaitForSingleObject(InputHandle, YoriShGlobal.DelayBeforeSuggesting);
+                err = YoriShWaitForInput(&Buffer, YoriShGlobal.DelayBeforeSuggesting);
                 if (err == WAIT_OBJECT_0) {
                     break;
                 }
@@ -3044,7 +3511,7 @@ YoriShGetExpressionFromConsole(
                     }
                 }
             } else if (!RestartStateSaved) {
-                err = WaitForSingleObject(InputHandle, 30 * 1000);
+                err = YoriShWaitForInput(&Buffer, 30 * 1000);
                 if (err == WAIT_OBJECT_0) {
                     break;
                 }
@@ -3054,7 +3521,7 @@ YoriShGetExpressionFromConsole(
                     RestartStateSaved = TRUE;
                 }
             } else {
-                err = WaitForSingleObject(InputHandle, INFINITE);
+                err = YoriShWaitForInput(&Buffer, INFINITE);
                 if (err == WAIT_OBJECT_0) {
                     break;
                 }
@@ -3130,6 +3597,7 @@ YoriShGetExpression(
 VOID
 YoriShCleanupInputContext()
 {
+    YoriShCleanupTabCompletionCache();
     if (YoriShGetExpressionLineContext != NULL) {
         YoriLibLineReadClose(YoriShGetExpressionLineContext);
     }
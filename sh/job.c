@@ -73,6 +73,33 @@ typedef struct _YORI_JOB {
      */
     DWORD ExitCode;
 
+    /**
+     The amount of processor time consumed by the process, in 100ns units.
+     Only valid once JobState is either JobStateCompletedAwaitingDelete or
+     JobStateRetained.
+     */
+    LONGLONG CpuTime;
+
+    /**
+     TRUE if the process has been assigned to the job object and the monitor
+     thread will report its completion.  FALSE if the process needs to be
+     checked for completion each time jobs are scanned.
+     */
+    BOOL Monitored;
+
+    /**
+     TRUE if the monitor thread has found the process has completed and has
+     inserted the job into the list of completed jobs.
+     */
+    BOOL CompletionQueued;
+
+    /**
+     The link into the list of jobs the monitor thread has found to have
+     completed which have not yet been reported.  Protected by the monitor
+     mutex.
+     */
+    YORI_LIST_ENTRY CompletedListEntry;
+
     /**
      A handle to the child process.
      */
@@ -91,10 +118,467 @@ typedef struct _YORI_JOB {
 } YORI_JOB, *PYORI_JOB;
 
 /**
- The global list of active jobs.
+ The global list of active jobs.  This list is only modified by the main
+ thread, which holds the monitor mutex when doing so, so the monitor thread
+ can walk it while holding the mutex.
  */
 YORI_LIST_ENTRY JobList;
 
+/**
+ The number of milliseconds the monitor thread waits for a message before
+ checking whether any monitored process has completed without one.  Messages
+ from a job object are not guaranteed to be delivered.
+ */
+#define YORI_SH_JOB_MONITOR_POLL_INTERVAL (5000)
+
+/**
+ State for a background thread which is notified when processes in
+ background jobs terminate, so that completion can be reported without
+ checking every job.
+ */
+typedef struct _YORI_SH_JOB_MONITOR {
+
+    /**
+     TRUE once an attempt has been made to start the monitor.  If the attempt
+     fails, it is not retried and jobs are checked individually.
+     */
+    BOOL StartAttempted;
+
+    /**
+     A job object containing the processes of background jobs.
+     */
+    HANDLE hJobObject;
+
+    /**
+     A completion port which receives messages when processes in the job
+     object terminate.
+     */
+    HANDLE hPort;
+
+    /**
+     A handle to the monitor thread.
+     */
+    HANDLE hThread;
+
+    /**
+     A mutex which synchronizes the monitor thread with the main thread.
+     */
+    HANDLE Mutex;
+
+    /**
+     An auto reset event which is signalled when the monitor thread inserts
+     a job into CompletedList.
+     */
+    HANDLE CompletionEvent;
+
+    /**
+     A list of jobs which have completed but not yet been reported.
+     */
+    YORI_LIST_ENTRY CompletedList;
+
+    /**
+     The number of monitored jobs that are still executing.  Protected by
+     Mutex.
+     */
+    DWORD MonitoredCount;
+} YORI_SH_JOB_MONITOR, *PYORI_SH_JOB_MONITOR;
+
+/**
+ The global state for monitoring background jobs.
+ */
+YORI_SH_JOB_MONITOR YoriShJobMonitor;
+
+/**
+ The number of executing jobs which are not monitored and need to be checked
+ for completion each time jobs are scanned.
+ */
+DWORD YoriShJobsPolledCount;
+
+/**
+ The number of jobs which have completed and are awaiting deletion.
+ */
+DWORD YoriShJobsAwaitingDeleteCount;
+
+/**
+ Record the exit code and processor time of a job whose process has
+ terminated.
+
+ @param ThisJob The job whose process has terminated.
+ */
+VOID
+YoriShCaptureJobResult(
+    __in PYORI_JOB ThisJob
+    )
+{
+    FILETIME CreationTime;
+    FILETIME ExitTime;
+    FILETIME KernelTime;
+    FILETIME UserTime;
+    LARGE_INTEGER Kernel;
+    LARGE_INTEGER User;
+
+    GetExitCodeProcess(ThisJob->hProcess, &ThisJob->ExitCode);
+
+    ThisJob->CpuTime = 0;
+    if (GetProcessTimes(ThisJob->hProcess, &CreationTime, &ExitTime, &KernelTime, &UserTime)) {
+        Kernel.LowPart = KernelTime.dwLowDateTime;
+        Kernel.HighPart = KernelTime.dwHighDateTime;
+        User.LowPart = UserTime.dwLowDateTime;
+        User.HighPart = UserTime.dwHighDateTime;
+        ThisJob->CpuTime = Kernel.QuadPart + User.QuadPart;
+    }
+}
+
+/**
+ Check whether a monitored job has completed, and if so, record its result
+ and queue it to be reported.  This is called from the monitor thread with
+ the monitor mutex held.
+
+ @param ThisJob The job to check.
+
+ @return TRUE if the job has completed, FALSE if it is still executing.
+ */
+BOOL
+YoriShQueueJobIfCompleted(
+    __in PYORI_JOB ThisJob
+    )
+{
+    if (!ThisJob->Monitored ||
+        ThisJob->CompletionQueued ||
+        ThisJob->JobState != JobStateExecuting) {
+
+        return FALSE;
+    }
+
+    if (WaitForSingleObject(ThisJob->hProcess, 0) != WAIT_OBJECT_0) {
+        return FALSE;
+    }
+
+    YoriShCaptureJobResult(ThisJob);
+    ThisJob->CompletionQueued = TRUE;
+    YoriLibAppendList(&YoriShJobMonitor.CompletedList, &ThisJob->CompletedListEntry);
+    ASSERT(YoriShJobMonitor.MonitoredCount > 0);
+    YoriShJobMonitor.MonitoredCount--;
+    SetEvent(YoriShJobMonitor.CompletionEvent);
+    return TRUE;
+}
+
+/**
+ A background thread which waits for processes in background jobs to
+ terminate and queues the corresponding jobs to be reported.
+
+ @param Context Unused.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriShJobMonitorThread(
+    __in PVOID Context
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_JOB ThisJob;
+    LPOVERLAPPED Overlapped;
+    DWORD_PTR CompletionKey;
+    DWORD Message;
+    DWORD ProcessId;
+    DWORD Timeout;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    while (TRUE) {
+
+        //
+        //  Only poll while processes are being monitored.  When a process
+        //  is added, a message is posted to wake this thread so that it
+        //  starts polling.
+        //
+
+        WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+        if (YoriShJobMonitor.MonitoredCount > 0) {
+            Timeout = YORI_SH_JOB_MONITOR_POLL_INTERVAL;
+        } else {
+            Timeout = INFINITE;
+        }
+        ReleaseMutex(YoriShJobMonitor.Mutex);
+
+        Overlapped = NULL;
+        if (!DllKernel32.pGetQueuedCompletionStatus(YoriShJobMonitor.hPort, &Message, &CompletionKey, &Overlapped, Timeout)) {
+            if (GetLastError() != WAIT_TIMEOUT) {
+                break;
+            }
+
+            //
+            //  If no message has arrived for a while, check for any
+            //  monitored process that completed without one.
+            //
+
+            WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+            if (YoriShJobMonitor.MonitoredCount > 0) {
+                ListEntry = YoriLibGetNextListEntry(&JobList, NULL);
+                while (ListEntry != NULL) {
+                    ThisJob = CONTAINING_RECORD(ListEntry, YORI_JOB, ListEntry);
+                    ListEntry = YoriLibGetNextListEntry(&JobList, ListEntry);
+                    YoriShQueueJobIfCompleted(ThisJob);
+                }
+            }
+            ReleaseMutex(YoriShJobMonitor.Mutex);
+            continue;
+        }
+
+        //
+        //  A message without a key is posted when the shell wants this
+        //  thread to exit.
+        //
+
+        if (CompletionKey == 0) {
+            break;
+        }
+
+        if (Message != JOB_OBJECT_MSG_EXIT_PROCESS &&
+            Message != JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS) {
+
+            continue;
+        }
+
+        //
+        //  The job object also contains any processes launched by jobs, so
+        //  messages for unknown processes are ignored.  Since a process ID
+        //  can be reused, the job's process is checked to have terminated.
+        //
+
+        ProcessId = (DWORD)(DWORD_PTR)Overlapped;
+        WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+        ListEntry = YoriLibGetNextListEntry(&JobList, NULL);
+        while (ListEntry != NULL) {
+            ThisJob = CONTAINING_RECORD(ListEntry, YORI_JOB, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&JobList, ListEntry);
+            if (ThisJob->dwProcessId == ProcessId &&
+                YoriShQueueJobIfCompleted(ThisJob)) {
+
+                break;
+            }
+        }
+        ReleaseMutex(YoriShJobMonitor.Mutex);
+    }
+
+    return 0;
+}
+
+/**
+ Stop the monitor thread and close the handles it uses.  Any jobs it has
+ queued as completed remain on the completed list.
+ */
+VOID
+YoriShStopJobMonitor(VOID)
+{
+    if (YoriShJobMonitor.hThread != NULL) {
+        DllKernel32.pPostQueuedCompletionStatus(YoriShJobMonitor.hPort, 0, 0, NULL);
+        WaitForSingleObject(YoriShJobMonitor.hThread, INFINITE);
+        CloseHandle(YoriShJobMonitor.hThread);
+        YoriShJobMonitor.hThread = NULL;
+    }
+
+    if (YoriShJobMonitor.hPort != NULL) {
+        CloseHandle(YoriShJobMonitor.hPort);
+        YoriShJobMonitor.hPort = NULL;
+    }
+
+    if (YoriShJobMonitor.hJobObject != NULL) {
+        CloseHandle(YoriShJobMonitor.hJobObject);
+        YoriShJobMonitor.hJobObject = NULL;
+    }
+
+    if (YoriShJobMonitor.CompletionEvent != NULL) {
+        CloseHandle(YoriShJobMonitor.CompletionEvent);
+        YoriShJobMonitor.CompletionEvent = NULL;
+    }
+
+    if (YoriShJobMonitor.Mutex != NULL) {
+        CloseHandle(YoriShJobMonitor.Mutex);
+        YoriShJobMonitor.Mutex = NULL;
+    }
+}
+
+/**
+ Start the monitor thread if it has not been started.  This requires a job
+ object and completion port, which are not available on older systems.
+ It also requires nested jobs, which were added in Windows 8.  Without them,
+ placing a background process in the shell's job would prevent programs
+ such as nice, timethis or for -p from placing their children in their
+ own jobs.
+
+ @return TRUE if the monitor thread is running, FALSE if it is not and jobs
+         should be checked individually.
+ */
+BOOL
+YoriShStartJobMonitor(VOID)
+{
+    DWORD ThreadId;
+    DWORD OsVerMajor;
+    DWORD OsVerMinor;
+    DWORD OsBuildNumber;
+
+    if (YoriShJobMonitor.StartAttempted) {
+        return (YoriShJobMonitor.hThread != NULL);
+    }
+
+    YoriShJobMonitor.StartAttempted = TRUE;
+    YoriLibInitializeListHead(&YoriShJobMonitor.CompletedList);
+
+    if (DllKernel32.pCreateIoCompletionPort == NULL ||
+        DllKernel32.pGetQueuedCompletionStatus == NULL ||
+        DllKernel32.pPostQueuedCompletionStatus == NULL) {
+
+        return FALSE;
+    }
+
+    YoriLibGetOsVersion(&OsVerMajor, &OsVerMinor, &OsBuildNumber);
+    if (OsVerMajor < 6 || (OsVerMajor == 6 && OsVerMinor < 2)) {
+        return FALSE;
+    }
+
+    YoriShJobMonitor.Mutex = CreateMutex(NULL, FALSE, NULL);
+    YoriShJobMonitor.CompletionEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    YoriShJobMonitor.hJobObject = YoriLibCreateJobObject();
+    YoriShJobMonitor.hPort = DllKernel32.pCreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+
+    if (YoriShJobMonitor.Mutex == NULL ||
+        YoriShJobMonitor.CompletionEvent == NULL ||
+        YoriShJobMonitor.hJobObject == NULL ||
+        YoriShJobMonitor.hPort == NULL) {
+
+        YoriShStopJobMonitor();
+        return FALSE;
+    }
+
+    if (!YoriLibAssociateJobObjectWithCompletionPort(YoriShJobMonitor.hJobObject, YoriShJobMonitor.hPort, &YoriShJobMonitor)) {
+        YoriShStopJobMonitor();
+        return FALSE;
+    }
+
+    YoriShJobMonitor.hThread = CreateThread(NULL, 0, YoriShJobMonitorThread, NULL, 0, &ThreadId);
+    if (YoriShJobMonitor.hThread == NULL) {
+        YoriShStopJobMonitor();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Return an event which is signalled when a background job completes, so
+ that the caller can report it without waiting for the next prompt.
+
+ @return Handle to the event, or NULL if job completion is not monitored.
+ */
+HANDLE
+YoriShGetJobCompletionEvent(VOID)
+{
+    return YoriShJobMonitor.CompletionEvent;
+}
+
+/**
+ Return TRUE if any background job has completed but has not yet been
+ reported.
+
+ @return TRUE if completed jobs are waiting to be reported, FALSE if not.
+ */
+BOOL
+YoriShAreJobCompletionsQueued(VOID)
+{
+    BOOL Result;
+
+    if (YoriShJobMonitor.Mutex == NULL) {
+        return FALSE;
+    }
+
+    WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+    Result = (YoriLibGetNextListEntry(&YoriShJobMonitor.CompletedList, NULL) != NULL);
+    ReleaseMutex(YoriShJobMonitor.Mutex);
+    return Result;
+}
+
+/**
+ Mark a job as completed, and optionally tell the user.
+
+ @param ThisJob The job which has completed.  Its result must have been
+        captured.
+
+ @param Quiet TRUE if the user should not be told about the completion.
+ */
+VOID
+YoriShMarkJobCompleted(
+    __in PYORI_JOB ThisJob,
+    __in BOOL Quiet
+    )
+{
+    ThisJob->JobState = JobStateCompletedAwaitingDelete;
+    YoriShJobsAwaitingDeleteCount++;
+    if (!Quiet) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                      _T("Job %i completed, result %i, cpu %lli.%03llis: %y\n"),
+                      ThisJob->JobId,
+                      ThisJob->ExitCode,
+                      ThisJob->CpuTime / (10 * 1000 * 1000),
+                      (ThisJob->CpuTime / (10 * 1000)) % 1000,
+                      &ThisJob->CmdLine);
+    }
+}
+
+/**
+ Report any jobs that the monitor thread has found to have completed.
+
+ @param Quiet TRUE if the user should not be told about the completions.
+
+ @return TRUE if any jobs were found to have completed, FALSE if not.
+ */
+BOOL
+YoriShReportQueuedJobCompletions(
+    __in BOOL Quiet
+    )
+{
+    YORI_LIST_ENTRY Completed;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_JOB ThisJob;
+    BOOL Found;
+
+    if (!YoriShJobMonitor.StartAttempted) {
+        return FALSE;
+    }
+
+    //
+    //  Move the completed jobs to a local list so the mutex isn't held
+    //  while telling the user about them.
+    //
+
+    YoriLibInitializeListHead(&Completed);
+    if (YoriShJobMonitor.Mutex != NULL) {
+        WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+    }
+    ListEntry = YoriLibGetNextListEntry(&YoriShJobMonitor.CompletedList, NULL);
+    while (ListEntry != NULL) {
+        YoriLibRemoveListItem(ListEntry);
+        YoriLibAppendList(&Completed, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShJobMonitor.CompletedList, NULL);
+    }
+    if (YoriShJobMonitor.Mutex != NULL) {
+        ReleaseMutex(YoriShJobMonitor.Mutex);
+    }
+
+    Found = FALSE;
+    ListEntry = YoriLibGetNextListEntry(&Completed, NULL);
+    while (ListEntry != NULL) {
+        ThisJob = CONTAINING_RECORD(ListEntry, YORI_JOB, CompletedListEntry);
+        YoriLibRemoveListItem(ListEntry);
+        YoriShMarkJobCompleted(ThisJob, Quiet);
+        Found = TRUE;
+        ListEntry = YoriLibGetNextListEntry(&Completed, NULL);
+    }
+
+    return Found;
+}
+
 /**
  Allocate a new job for background processing.
 
@@ -153,7 +637,33 @@ YoriShCreateNewJob(
     ThisJob->JobState = JobStateExecuting;
 
     YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Job %i: %y\n"), ThisJob->JobId, &ThisJob->CmdLine);
-    YoriLibAppendList(&JobList, &ThisJob->ListEntry);
+
+    //
+    //  Insert the job and assign its process to the job object while
+    //  holding the mutex, so the monitor thread can't process the exit of
+    //  the process before it can find the job.  If the process can't be
+    //  assigned, or the system doesn't support nested jobs, it is checked
+    //  for completion each time jobs are scanned.
+    //
+
+    if (YoriShStartJobMonitor()) {
+        WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+        YoriLibAppendList(&JobList, &ThisJob->ListEntry);
+        if (YoriLibAssignProcessToJobObject(YoriShJobMonitor.hJobObject, hProcess)) {
+            ThisJob->Monitored = TRUE;
+            YoriShJobMonitor.MonitoredCount++;
+            if (YoriShJobMonitor.MonitoredCount == 1) {
+                DllKernel32.pPostQueuedCompletionStatus(YoriShJobMonitor.hPort, 0, (DWORD_PTR)&YoriShJobMonitor, NULL);
+            }
+        }
+        ReleaseMutex(YoriShJobMonitor.Mutex);
+    } else {
+        YoriLibAppendList(&JobList, &ThisJob->ListEntry);
+    }
+
+    if (!ThisJob->Monitored) {
+        YoriShJobsPolledCount++;
+    }
 
     return TRUE;
 }
@@ -168,7 +678,15 @@ YoriShFreeJob(
     __in PYORI_JOB ThisJob
     )
 {
-    YoriLibRemoveListItem(&ThisJob->ListEntry);
+    ASSERT(!ThisJob->CompletionQueued || ThisJob->JobState != JobStateExecuting);
+
+    if (YoriShJobMonitor.Mutex != NULL) {
+        WaitForSingleObject(YoriShJobMonitor.Mutex, INFINITE);
+        YoriLibRemoveListItem(&ThisJob->ListEntry);
+        ReleaseMutex(YoriShJobMonitor.Mutex);
+    } else {
+        YoriLibRemoveListItem(&ThisJob->ListEntry);
+    }
 
     if (ThisJob->ProcessBuffers != NULL) {
         YoriShDereferenceProcessBuffer(ThisJob->ProcessBuffers);
@@ -180,7 +698,9 @@ YoriShFreeJob(
 
 /**
  Scan the set of outstanding jobs and report to the user if any have
- completed.
+ completed.  Jobs whose processes are monitored are reported when the
+ monitor thread finds them complete, so the list of jobs is only walked if
+ some jobs are not monitored or some completed jobs are awaiting deletion.
 
  @param TeardownAll TRUE if the shell is exiting and wants to tear down all
         state.  FALSE if this is a periodic check to tear down things that
@@ -201,22 +721,36 @@ YoriShScanJobsReportCompletion(
         return TRUE;
     }
 
+    if (TeardownAll) {
+        YoriShStopJobMonitor();
+    }
+
+    YoriShReportQueuedJobCompletions(TeardownAll);
+
+    if (!TeardownAll &&
+        YoriShJobsPolledCount == 0 &&
+        YoriShJobsAwaitingDeleteCount == 0) {
+
+        return TRUE;
+    }
+
     ListEntry = YoriLibGetNextListEntry(&JobList, NULL);
     while (ListEntry != NULL) {
         ThisJob = CONTAINING_RECORD(ListEntry, YORI_JOB, ListEntry);
         ListEntry = YoriLibGetNextListEntry(&JobList, ListEntry);
-        if (ThisJob->JobState == JobStateExecuting) {
+        if (ThisJob->JobState == JobStateExecuting && !ThisJob->Monitored) {
             if (WaitForSingleObject(ThisJob->hProcess, 0) == WAIT_OBJECT_0) {
-                GetExitCodeProcess(ThisJob->hProcess, &ThisJob->ExitCode);
-                ThisJob->JobState = JobStateCompletedAwaitingDelete;
-                if (!TeardownAll) {
-                    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Job %i completed, result %i: %y\n"), ThisJob->JobId, ThisJob->ExitCode, &ThisJob->CmdLine);
-                }
+                YoriShCaptureJobResult(ThisJob);
+                YoriShJobsPolledCount--;
+                YoriShMarkJobCompleted(ThisJob, TeardownAll);
             }
         }
 
         if (TeardownAll && ThisJob->JobState == JobStateExecuting) {
-            ThisJob->JobState = JobStateCompletedAwaitingDelete;
+            if (!ThisJob->Monitored) {
+                YoriShJobsPolledCount--;
+            }
+            YoriShMarkJobCompleted(ThisJob, TRUE);
         }
 
         if (ThisJob->JobState == JobStateCompletedAwaitingDelete) {
@@ -225,6 +759,7 @@ YoriShScanJobsReportCompletion(
                 if (!TeardownAll) {
                     YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Job %i deleted, result %i: %y\n"), ThisJob->JobId, ThisJob->ExitCode, &ThisJob->CmdLine);
                 }
+                YoriShJobsAwaitingDeleteCount--;
                 YoriShFreeJob(ThisJob);
             }
         }
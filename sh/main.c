@@ -39,12 +39,31 @@ CHAR strHelpText[] =
         "\n"
         "Start a Yori shell instance.\n"
         "\n"
-        "YORI [-license] [-c <cmd>] [-k <cmd>]\n"
+        "YORI [-license] [-startup-profile] [-c <cmd>] [-k <cmd>]\n"
         "\n"
         "   -license       Display license text\n"
         "   -c <cmd>       Execute command and terminate the shell\n"
         "   -k <cmd>       Execute command and continue as an interactive shell\n"
-        "   -nouser        Do not execute per-user AutoInit scripts\n";
+        "   -nouser        Do not execute per-user AutoInit scripts\n"
+        "   -startup-profile\n"
+        "                  Display time spent in each init script, line, process\n"
+        "                  and module load\n"
+        "\n"
+        "Scripts in YoriInit.d\\Lazy are executed before the first command rather\n"
+        "than before the first prompt.  Aliases and other state they define are not\n"
+        "available to tab completion or editing while the first command is entered.\n"
+        "With -startup-profile, they are executed before the first prompt so that\n"
+        "their time is included.\n";
+
+/**
+ Set to TRUE if lazy init scripts should be executed before the next command.
+ */
+BOOLEAN YoriShLazyInitPending;
+
+/**
+ Set to TRUE if lazy init scripts should not include per-user scripts.
+ */
+BOOLEAN YoriShLazyInitIgnoreUserScripts;
 
 /**
  Display usage text to the user.
@@ -86,6 +105,7 @@ YoriShExecuteYoriInit(
     LPTSTR szExt;
     YORI_STRING UnescapedPath;
     PYORI_STRING NameToUse;
+    PVOID ProfileHandle;
 
     UNREFERENCED_PARAMETER(FileInfo);
     UNREFERENCED_PARAMETER(Depth);
@@ -109,11 +129,13 @@ YoriShExecuteYoriInit(
         }
     }
 
+    ProfileHandle = YoriShProfileBegin(YoriShProfileTypeScript, NameToUse);
     YoriLibInitEmptyString(&InitNameWithQuotes);
     YoriLibYPrintf(&InitNameWithQuotes, _T("\"%y\""), NameToUse);
     if (InitNameWithQuotes.LengthInChars > 0) {
         YoriShExecuteExpression(&InitNameWithQuotes);
     }
+    YoriShProfileEnd(ProfileHandle);
     YoriLibFreeStringContents(&InitNameWithQuotes);
     YoriLibFreeStringContents(&UnescapedPath);
     return TRUE;
@@ -261,6 +283,13 @@ YoriShInit()
         YoriLibAddEnvironmentComponent(_T("PATHEXT"), &NewExt, TRUE);
     }
 
+    //
+    //  The variables above were set directly, so make sure nothing that
+    //  captured the environment earlier continues to use it.
+    //
+
+    YoriShGlobal.EnvironmentGeneration++;
+
     YoriLibCancelEnable();
     YoriLibCancelIgnore();
 
@@ -328,6 +357,14 @@ YoriShExecuteInitScripts(
         YoriLibForEachFile(&RelativeYoriInitName, YORILIB_FILEENUM_RETURN_FILES, 0, YoriShExecuteYoriInit, NULL, NULL);
     }
 
+    //
+    //  Scripts in the Lazy subdirectory are executed before the first
+    //  command, so the prompt can be displayed without waiting for them.
+    //
+
+    YoriShLazyInitPending = TRUE;
+    YoriShLazyInitIgnoreUserScripts = IgnoreUserScripts;
+
     //
     //  Reload any state next time it's requested.
     //
@@ -337,6 +374,37 @@ YoriShExecuteInitScripts(
     return TRUE;
 }
 
+/**
+ Execute any system or user init scripts whose execution was deferred until
+ the shell is about to execute a command.  This only does anything on the
+ first call.
+
+ @return TRUE to indicate success.
+ */
+BOOL
+YoriShExecuteLazyInitScripts(VOID)
+{
+    YORI_STRING RelativeYoriInitName;
+
+    if (!YoriShLazyInitPending) {
+        return TRUE;
+    }
+
+    YoriShLazyInitPending = FALSE;
+
+    YoriLibConstantString(&RelativeYoriInitName, _T("~AppDir\\YoriInit.d\\Lazy\\*"));
+    YoriLibForEachFile(&RelativeYoriInitName, YORILIB_FILEENUM_RETURN_FILES, 0, YoriShExecuteYoriInit, NULL, NULL);
+
+    if (!YoriShLazyInitIgnoreUserScripts) {
+        YoriLibConstantString(&RelativeYoriInitName, _T("~\\YoriInit.d\\Lazy\\*"));
+        YoriLibForEachFile(&RelativeYoriInitName, YORILIB_FILEENUM_RETURN_FILES, 0, YoriShExecuteYoriInit, NULL, NULL);
+    }
+
+    YoriShGlobal.EnvironmentGeneration++;
+
+    return TRUE;
+}
+
 /**
  Parse the Yori command line and perform any requested actions.
 
@@ -411,6 +479,9 @@ YoriShParseArgs(
                     ArgumentUnderstood = TRUE;
                     break;
                 }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("startup-profile")) == 0) {
+                YoriShProfileEnable();
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("ss")) == 0) {
                 if (ArgC > i + 1) {
                     YoriShGlobal.RecursionDepth++;
@@ -436,6 +507,9 @@ YoriShParseArgs(
     if (StartArgToExec > 0) {
         YORI_STRING YsCmdToExec;
 
+        YoriShExecuteLazyInitScripts();
+        YoriShProfileReport();
+
         if (YoriLibBuildCmdlineFromArgcArgv(ArgC - StartArgToExec, &ArgV[StartArgToExec], TRUE, &YsCmdToExec)) {
             if (YsCmdToExec.LengthInChars > 0) {
                 if (YoriShExecuteExpression(&YsCmdToExec)) {
@@ -697,6 +771,24 @@ ymain (
         YoriShDisplayWarnings();
         YoriShLoadHistoryFromFile();
 
+        //
+        //  An interactive shell resolves many commands and completes many
+        //  executables, so keep an index of the contents of PATH.
+        //
+
+        YoriLibPathIndexEnable();
+
+        //
+        //  If startup is being profiled, execute lazy init scripts now so
+        //  that the report includes them, without including the time spent
+        //  waiting for the first command.
+        //
+
+        if (YoriShProfileIsActive()) {
+            YoriShExecuteLazyInitScripts();
+        }
+        YoriShProfileReport();
+
         while(TRUE) {
 
             YoriShPostCommand();
@@ -725,6 +817,7 @@ ymain (
                 break;
             }
             YoriShPreCommand(TRUE);
+            YoriShExecuteLazyInitScripts();
             YoriShExecPreCommandString();
             if (CurrentExpression.LengthInChars > 0) {
                 YoriShExecuteExpression(&CurrentExpression);
@@ -742,6 +835,10 @@ ymain (
     YoriShBuiltinUnregisterAll();
     YoriShDiscardSavedRestartState(NULL);
     YoriShCleanupInputContext();
+    YoriShFreeBackquoteCache();
+    YoriShCleanupPromptSegments();
+    YoriShFreeEnvironmentCache();
+    YoriLibPathIndexDisable();
     YoriLibFreeStringContents(&YoriShGlobal.PreCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
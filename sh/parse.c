@@ -177,6 +177,45 @@ YoriShTrimSpacesAndAtsFromBeginning(
 }
 
 
+/**
+ Expand any environment variables in each argument of a command context.
+ Arguments which are expanded are replaced with newly allocated strings, so
+ any other command context which references the same arguments is not
+ modified.
+
+ @param CmdContext Pointer to the command context whose arguments should be
+        expanded.
+ */
+VOID
+YoriShExpandEnvironmentInCmdContext(
+    __inout PYORI_SH_CMD_CONTEXT CmdContext
+    )
+{
+    DWORD ArgCount;
+    DWORD ArgOffset;
+    YORI_STRING EnvExpandedString;
+
+    for (ArgCount = 0; ArgCount < CmdContext->ArgC; ArgCount++) {
+        ASSERT(YoriLibIsStringNullTerminated(&CmdContext->ArgV[ArgCount]));
+
+        ArgOffset = 0;
+        if (ArgCount == CmdContext->CurrentArg) {
+            ArgOffset = CmdContext->CurrentArgOffset;
+        }
+        if (YoriShExpandEnvironmentVariables(&CmdContext->ArgV[ArgCount], &EnvExpandedString, &ArgOffset)) {
+            if (EnvExpandedString.StartOfString != CmdContext->ArgV[ArgCount].StartOfString) {
+                if (ArgCount == CmdContext->CurrentArg) {
+                    CmdContext->CurrentArgOffset = ArgOffset;
+                }
+
+                YoriLibFreeStringContents(&CmdContext->ArgV[ArgCount]);
+                memcpy(&CmdContext->ArgV[ArgCount], &EnvExpandedString, sizeof(YORI_STRING));
+                ASSERT(YoriLibIsStringNullTerminated(&CmdContext->ArgV[ArgCount]));
+            }
+        }
+    }
+}
+
 /**
  Parse a single command string into a series of arguments.  This routine takes
  care of splitting things based on the presence or absence of quotes, as well
@@ -191,11 +230,11 @@ YoriShTrimSpacesAndAtsFromBeginning(
         will be marked in the CmdContext as being the active argument.
 
  @param ExpandEnvironmentVariables If TRUE, any environment variables within
-        the expression are expanded.  This occurs after parsing and could
-        be a seperate function.  The effect of this is that a single argument
-        may end up expanding into a string with spaces and have quotes
-        inserted where the user didn't enter any.  If FALSE, environment
-        variables are retained as unexpanded symbols.
+        the expression are expanded.  This occurs after parsing, as described
+        in @ref YoriShExpandEnvironmentInCmdContext .  The effect of this is
+        that a single argument may end up expanding into a string with
+        spaces and have quotes inserted where the user didn't enter any.  If
+        FALSE, environment variables are retained as unexpanded symbols.
 
  @param CmdContext A caller allocated CmdContext to populate with arguments.
         This routine will allocate space for the argument array and contents.
@@ -680,26 +719,7 @@ YoriShParseCmdlineToCmdContext(
     //
 
     if (ExpandEnvironmentVariables) {
-        for (ArgCount = 0; ArgCount < CmdContext->ArgC; ArgCount++) {
-            YORI_STRING EnvExpandedString;
-            ASSERT(YoriLibIsStringNullTerminated(&CmdContext->ArgV[ArgCount]));
-    
-            ArgOffset = 0;
-            if (ArgCount == CmdContext->CurrentArg) {
-                ArgOffset = CmdContext->CurrentArgOffset;
-            }
-            if (YoriShExpandEnvironmentVariables(&CmdContext->ArgV[ArgCount], &EnvExpandedString, &ArgOffset)) {
-                if (EnvExpandedString.StartOfString != CmdContext->ArgV[ArgCount].StartOfString) {
-                    if (ArgCount == CmdContext->CurrentArg) {
-                        CmdContext->CurrentArgOffset = ArgOffset;
-                    }
-    
-                    YoriLibFreeStringContents(&CmdContext->ArgV[ArgCount]);
-                    memcpy(&CmdContext->ArgV[ArgCount], &EnvExpandedString, sizeof(YORI_STRING));
-                    ASSERT(YoriLibIsStringNullTerminated(&CmdContext->ArgV[ArgCount]));
-                }
-            }
-        }
+        YoriShExpandEnvironmentInCmdContext(CmdContext);
     }
 
     return TRUE;
@@ -2278,6 +2298,103 @@ YoriShFindNextBackquoteSubstring(
     return FALSE;
 }
 
+/**
+ Search through a string and return all backquote substrings requiring
+ execution at the deepest level of nesting.  These substrings contain no
+ further backquotes and do not overlap, so they can be executed
+ independently of each other.
+
+ @param String Pointer to the string to process.
+
+ @param Substrings On successful completion, updated to point to an array
+        of substrings in the order they occur within String.  The caller
+        should free this array with YoriLibFree.
+
+ @param SubstringCount On successful completion, updated to contain the
+        number of elements in the Substrings array.
+
+ @return TRUE if there is at least one substring to execute, FALSE if there
+         is not.
+ */
+__success(return)
+BOOL
+YoriShFindDeepestBackquoteSubstrings(
+    __in PYORI_STRING String,
+    __out PYORI_SH_BACKQUOTE_SUBSTRING * Substrings,
+    __out PDWORD SubstringCount
+    )
+{
+    YORI_SH_BACKQUOTE_CONTEXT BackquoteContext;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_BACKQUOTE_ENTRY BackquoteEntry;
+    PYORI_SH_BACKQUOTE_SUBSTRING Found;
+    DWORD SeekingDepth;
+    DWORD Count;
+
+    if (!YoriShParseBackquoteSubstrings(String, &BackquoteContext)) {
+        return FALSE;
+    }
+
+    //
+    //  Find the deepest level containing any substring to execute.
+    //
+
+    Count = 0;
+    for (SeekingDepth = BackquoteContext.MaxDepth; SeekingDepth > 0; SeekingDepth--) {
+
+        ListEntry = YoriLibGetNextListEntry(&BackquoteContext.MatchList, NULL);
+        while (ListEntry != NULL) {
+            BackquoteEntry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_ENTRY, MatchList);
+            if (BackquoteEntry->Terminated && BackquoteEntry->TreeDepth == SeekingDepth) {
+                Count++;
+            }
+            ListEntry = YoriLibGetNextListEntry(&BackquoteContext.MatchList, ListEntry);
+        }
+
+        if (Count > 0) {
+            break;
+        }
+    }
+
+    if (Count == 0) {
+        YoriShFreeBackquoteContext(&BackquoteContext);
+        return FALSE;
+    }
+
+    Found = YoriLibMalloc(Count * sizeof(YORI_SH_BACKQUOTE_SUBSTRING));
+    if (Found == NULL) {
+        YoriShFreeBackquoteContext(&BackquoteContext);
+        return FALSE;
+    }
+
+    //
+    //  Entries are recorded in the order they are opened, and entries at
+    //  the same depth cannot overlap, so this is also the order they occur
+    //  within the string.
+    //
+
+    Count = 0;
+    ListEntry = YoriLibGetNextListEntry(&BackquoteContext.MatchList, NULL);
+    while (ListEntry != NULL) {
+        BackquoteEntry = CONTAINING_RECORD(ListEntry, YORI_SH_BACKQUOTE_ENTRY, MatchList);
+        if (BackquoteEntry->Terminated && BackquoteEntry->TreeDepth == SeekingDepth) {
+            memcpy(&Found[Count].String, &BackquoteEntry->String, sizeof(YORI_STRING));
+            if (BackquoteEntry->NewStyleMatch) {
+                Found[Count].CharsInPrefix = 2;
+            } else {
+                Found[Count].CharsInPrefix = 1;
+            }
+            Count++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&BackquoteContext.MatchList, ListEntry);
+    }
+
+    YoriShFreeBackquoteContext(&BackquoteContext);
+    *Substrings = Found;
+    *SubstringCount = Count;
+    return TRUE;
+}
+
 /**
  Given a string and a current selected offset within the string, find the
  "best" backquote substring for tab completion.  This means the innermost
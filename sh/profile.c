@@ -0,0 +1,319 @@
+/**
+ * @file sh/profile.c
+ *
+ * Yori shell startup profiling
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yori.h"
+
+/**
+ A single timed operation performed while profiling.
+ */
+typedef struct _YORI_SH_PROFILE_RECORD {
+
+    /**
+     The entry for this record within the list of records.  Records are
+     appended in the order operations begin, so nested operations follow
+     the operation that contains them.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The type of operation being timed.
+     */
+    YORI_SH_PROFILE_TYPE Type;
+
+    /**
+     The nesting depth of the operation.
+     */
+    DWORD Depth;
+
+    /**
+     The performance counter value when the operation began.
+     */
+    LARGE_INTEGER StartTime;
+
+    /**
+     The performance counter value when the operation completed.  This is
+     zero if the operation has not completed.
+     */
+    LARGE_INTEGER EndTime;
+
+    /**
+     A description of the operation, such as a file name or command.
+     */
+    YORI_STRING Name;
+} YORI_SH_PROFILE_RECORD, *PYORI_SH_PROFILE_RECORD;
+
+/**
+ Set to TRUE if operations should be recorded.
+ */
+BOOL YoriShProfileActive;
+
+/**
+ The current nesting depth of operations.
+ */
+DWORD YoriShProfileDepth;
+
+/**
+ The list of records collected while profiling.
+ */
+YORI_LIST_ENTRY YoriShProfileRecords;
+
+/**
+ Begin recording operations.
+ */
+VOID
+YoriShProfileEnable(VOID)
+{
+    if (YoriShProfileRecords.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShProfileRecords);
+    }
+    YoriShProfileDepth = 0;
+    YoriShProfileActive = TRUE;
+}
+
+/**
+ Returns TRUE if operations are currently being recorded.
+
+ @return TRUE if operations are being recorded, FALSE if they are not.
+ */
+BOOL
+YoriShProfileIsActive(VOID)
+{
+    return YoriShProfileActive;
+}
+
+/**
+ Indicate that an operation is about to begin.
+
+ @param Type The type of the operation.
+
+ @param Name Pointer to a string describing the operation.
+
+ @return An opaque handle to pass to @ref YoriShProfileEnd when the operation
+         completes.  This is NULL if profiling is not active.
+ */
+PVOID
+YoriShProfileBegin(
+    __in YORI_SH_PROFILE_TYPE Type,
+    __in PYORI_STRING Name
+    )
+{
+    PYORI_SH_PROFILE_RECORD Record;
+
+    if (!YoriShProfileActive) {
+        return NULL;
+    }
+
+    Record = YoriLibMalloc(sizeof(YORI_SH_PROFILE_RECORD) + (Name->LengthInChars + 1) * sizeof(TCHAR));
+    if (Record == NULL) {
+        return NULL;
+    }
+
+    Record->Type = Type;
+    Record->Depth = YoriShProfileDepth;
+    Record->EndTime.QuadPart = 0;
+    YoriLibInitEmptyString(&Record->Name);
+    Record->Name.StartOfString = (LPTSTR)(Record + 1);
+    Record->Name.LengthInChars = Name->LengthInChars;
+    Record->Name.LengthAllocated = Name->LengthInChars + 1;
+    memcpy(Record->Name.StartOfString, Name->StartOfString, Name->LengthInChars * sizeof(TCHAR));
+    Record->Name.StartOfString[Name->LengthInChars] = '\0';
+
+    YoriLibAppendList(&YoriShProfileRecords, &Record->ListEntry);
+    YoriShProfileDepth++;
+
+    QueryPerformanceCounter(&Record->StartTime);
+    return Record;
+}
+
+/**
+ Indicate that an operation has completed.
+
+ @param Handle The handle returned from @ref YoriShProfileBegin .  This can
+        be NULL, in which case this function does nothing.
+ */
+VOID
+YoriShProfileEnd(
+    __in_opt PVOID Handle
+    )
+{
+    PYORI_SH_PROFILE_RECORD Record = (PYORI_SH_PROFILE_RECORD)Handle;
+
+    if (Record == NULL) {
+        return;
+    }
+
+    QueryPerformanceCounter(&Record->EndTime);
+    ASSERT(YoriShProfileDepth > 0);
+    YoriShProfileDepth--;
+}
+
+/**
+ Convert a number of performance counter ticks into microseconds.
+
+ @param Ticks The number of ticks.
+
+ @param Frequency The frequency of the performance counter.
+
+ @return The number of microseconds.
+ */
+LONGLONG
+YoriShProfileTicksToMicroseconds(
+    __in LONGLONG Ticks,
+    __in LONGLONG Frequency
+    )
+{
+    if (Frequency == 0) {
+        return 0;
+    }
+    return (Ticks * 1000 * 1000) / Frequency;
+}
+
+/**
+ Display a number of microseconds as milliseconds to standard error, padded
+ so that subsequent text aligns.
+
+ @param Microseconds The number of microseconds to display.
+ */
+VOID
+YoriShProfileOutputTime(
+    __in LONGLONG Microseconds
+    )
+{
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%8lli.%03lli ms  "), Microseconds / 1000, Microseconds % 1000);
+}
+
+/**
+ Display all recorded operations, followed by the total time spent on each
+ type of operation and the total time since the process started.  Once
+ displayed, the records are freed and profiling stops.
+ */
+VOID
+YoriShProfileReport(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROFILE_RECORD Record;
+    LARGE_INTEGER Frequency;
+    LONGLONG Microseconds;
+    LONGLONG TypeTotals[YoriShProfileTypeMax];
+    DWORD TypeCounts[YoriShProfileTypeMax];
+    DWORD OutermostDepth[YoriShProfileTypeMax];
+    LPCTSTR TypeNames[YoriShProfileTypeMax];
+    FILETIME CreationTime;
+    FILETIME ExitTime;
+    FILETIME KernelTime;
+    FILETIME UserTime;
+    FILETIME CurrentTime;
+    LARGE_INTEGER Start;
+    LARGE_INTEGER Now;
+    DWORD Index;
+
+    if (!YoriShProfileActive) {
+        return;
+    }
+
+    YoriShProfileActive = FALSE;
+
+    ZeroMemory(TypeTotals, sizeof(TypeTotals));
+    ZeroMemory(TypeCounts, sizeof(TypeCounts));
+    for (Index = 0; Index < YoriShProfileTypeMax; Index++) {
+        OutermostDepth[Index] = (DWORD)-1;
+    }
+    TypeNames[YoriShProfileTypeScript] = _T("script");
+    TypeNames[YoriShProfileTypeLine] = _T("line");
+    TypeNames[YoriShProfileTypeProcess] = _T("process");
+    TypeNames[YoriShProfileTypeModule] = _T("module");
+
+    if (!QueryPerformanceFrequency(&Frequency)) {
+        Frequency.QuadPart = 0;
+    }
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Startup profile:\n"));
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShProfileRecords, NULL);
+    while (ListEntry != NULL) {
+        Record = CONTAINING_RECORD(ListEntry, YORI_SH_PROFILE_RECORD, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShProfileRecords, ListEntry);
+
+        if (Record->EndTime.QuadPart != 0) {
+            Microseconds = YoriShProfileTicksToMicroseconds(Record->EndTime.QuadPart - Record->StartTime.QuadPart, Frequency.QuadPart);
+        } else {
+            Microseconds = 0;
+        }
+
+        //
+        //  Only count the outermost operation of each type, so that time
+        //  isn't counted twice when a script executes another script.
+        //  Records are in the order they began, so any type whose
+        //  outermost operation is at this depth or deeper has completed.
+        //
+
+        for (Index = 0; Index < YoriShProfileTypeMax; Index++) {
+            if (OutermostDepth[Index] != (DWORD)-1 &&
+                Record->Depth <= OutermostDepth[Index]) {
+
+                OutermostDepth[Index] = (DWORD)-1;
+            }
+        }
+
+        TypeCounts[Record->Type]++;
+        if (OutermostDepth[Record->Type] == (DWORD)-1) {
+            TypeTotals[Record->Type] += Microseconds;
+            OutermostDepth[Record->Type] = Record->Depth;
+        }
+
+        YoriShProfileOutputTime(Microseconds);
+        for (Index = 0; Index < Record->Depth; Index++) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("  "));
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%s: %y\n"), TypeNames[Record->Type], &Record->Name);
+
+        YoriLibRemoveListItem(&Record->ListEntry);
+        YoriLibFree(Record);
+    }
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("\n"));
+    for (Index = YoriShProfileTypeScript; Index < YoriShProfileTypeMax; Index++) {
+        YoriShProfileOutputTime(TypeTotals[Index]);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%i %s operations\n"), TypeCounts[Index], TypeNames[Index]);
+    }
+
+    //
+    //  Report the time from process creation until now, which includes
+    //  everything that happened before profiling was enabled.
+    //
+
+    if (GetProcessTimes(GetCurrentProcess(), &CreationTime, &ExitTime, &KernelTime, &UserTime)) {
+        GetSystemTimeAsFileTime(&CurrentTime);
+        Start.LowPart = CreationTime.dwLowDateTime;
+        Start.HighPart = CreationTime.dwHighDateTime;
+        Now.LowPart = CurrentTime.dwLowDateTime;
+        Now.HighPart = CurrentTime.dwHighDateTime;
+        YoriShProfileOutputTime((Now.QuadPart - Start.QuadPart) / 10);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("total since process start\n"));
+    }
+}
+
+// vim:sw=4:ts=4:et:
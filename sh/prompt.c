@@ -171,74 +171,813 @@ YoriShExpandPrompt(
 }
 
 /**
- Displays the current prompt string on the console.
+ Return the numeric value of an environment variable used to configure the
+ prompt.
+
+ @param VariableName The name of the environment variable.
+
+ @return The value of the variable, or zero if it is not defined or is not
+         a positive number.
+ */
+DWORD
+YoriShGetPromptEnvironmentNumber(
+    __in LPCTSTR VariableName
+    )
+{
+    DWORD EnvVarLength;
+    YORI_STRING NumberString;
+    DWORD CharsConsumed;
+    LONGLONG Number;
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(VariableName, NULL, 0, NULL);
+    if (EnvVarLength == 0) {
+        return 0;
+    }
+
+    if (!YoriLibAllocateString(&NumberString, EnvVarLength)) {
+        return 0;
+    }
+
+    NumberString.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(VariableName, NumberString.StartOfString, NumberString.LengthAllocated, NULL);
+    if (NumberString.LengthInChars == 0 || NumberString.LengthInChars >= NumberString.LengthAllocated) {
+        YoriLibFreeStringContents(&NumberString);
+        return 0;
+    }
+
+    if (!YoriLibStringToNumber(&NumberString, TRUE, &Number, &CharsConsumed) ||
+        CharsConsumed == 0 ||
+        Number <= 0) {
+
+        Number = 0;
+    }
+
+    YoriLibFreeStringContents(&NumberString);
+    return (DWORD)Number;
+}
+
+/**
+ Return the number of milliseconds that the result of a backquoted
+ expression within the prompt or title can be reused for, as specified by
+ the YORIPROMPTCACHE environment variable.  This allows a prompt that
+ invokes slow commands to be displayed quickly when commands are executed
+ in rapid succession.
+
+ @return The number of milliseconds, or zero if results should not be
+         reused.
+ */
+DWORD
+YoriShGetPromptCacheLifetime()
+{
+    return YoriShGetPromptEnvironmentNumber(_T("YORIPROMPTCACHE"));
+}
+
+/**
+ The maximum number of directories whose prompt segments are retained.
+ */
+#define YORI_SH_PROMPT_DIRECTORY_MAX (8)
+
+/**
+ The maximum number of times to rearm a change notification when draining
+ changes that have already been recorded.
+ */
+#define YORI_SH_PROMPT_DRAIN_MAX (4)
+
+/**
+ A backquoted expression within the prompt and the most recent result of
+ evaluating it.
+ */
+typedef struct _YORI_SH_PROMPT_SEGMENT {
+
+    /**
+     The entry for this segment within the list of segments for a directory.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The expression to evaluate.  This is allocated as part of the segment.
+     */
+    YORI_STRING Expression;
+
+    /**
+     The most recent result of evaluating the expression.  This may be
+     stale if Current is FALSE, and is empty if the expression has never
+     completed.
+     */
+    YORI_STRING Output;
+
+    /**
+     The state of a process evaluating the expression.  This is only
+     meaningful if Pending is TRUE.
+     */
+    YORI_SH_BACKQUOTE_EVALUATION Evaluation;
+
+    /**
+     TRUE if Output reflects the directory as it currently is.
+     */
+    BOOLEAN Current;
+
+    /**
+     TRUE if a process is evaluating the expression.
+     */
+    BOOLEAN Pending;
+
+    /**
+     TRUE if the segment was used by the most recently displayed prompt.
+     Segments which are no longer used are discarded.
+     */
+    BOOLEAN Referenced;
+} YORI_SH_PROMPT_SEGMENT, *PYORI_SH_PROMPT_SEGMENT;
+
+/**
+ The prompt segments evaluated within a single directory.
+ */
+typedef struct _YORI_SH_PROMPT_DIRECTORY {
+
+    /**
+     The entry for this directory within the list of directories, with the
+     most recently used directory first.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The full path to the directory.  This is allocated as part of the
+     directory.
+     */
+    YORI_STRING Directory;
+
+    /**
+     A change notification handle which is signalled when anything in the
+     directory or below it changes, or NULL if changes cannot be detected.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     The environment generation when segments were last evaluated.  Since
+     expressions can depend on environment variables, any change to the
+     environment causes segments to be reevaluated.
+     */
+    DWORD EnvironmentGeneration;
+
+    /**
+     The list of segments evaluated within this directory.
+     */
+    YORI_LIST_ENTRY Segments;
+} YORI_SH_PROMPT_DIRECTORY, *PYORI_SH_PROMPT_DIRECTORY;
+
+/**
+ The list of directories with prompt segments.
+ */
+YORI_LIST_ENTRY YoriShPromptDirectories;
+
+/**
+ The number of entries in the list of directories with prompt segments.
+ */
+DWORD YoriShPromptDirectoryCount;
+
+/**
+ The number of prompt segments which are currently being evaluated.
+ */
+DWORD YoriShPromptPendingCount;
+
+/**
+ The number of console cells occupied by the most recently displayed prompt,
+ or zero if this is not known and the prompt cannot be redrawn in place.
+ */
+DWORD YoriShPromptCellsDisplayed;
+
+/**
+ Free a prompt segment, abandoning any evaluation that is still executing.
+
+ @param Segment The segment to free.
+ */
+VOID
+YoriShFreePromptSegment(
+    __in PYORI_SH_PROMPT_SEGMENT Segment
+    )
+{
+    if (Segment->Pending) {
+        YoriShCancelConcurrentBackquote(&Segment->Evaluation);
+        Segment->Pending = FALSE;
+        YoriShPromptPendingCount--;
+    }
+    YoriLibRemoveListItem(&Segment->ListEntry);
+    YoriLibFreeStringContents(&Segment->Output);
+    YoriLibFree(Segment);
+}
+
+/**
+ Free a directory and all of the prompt segments within it.
+
+ @param Directory The directory to free.
+ */
+VOID
+YoriShFreePromptDirectory(
+    __in PYORI_SH_PROMPT_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_SEGMENT Segment;
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->Segments, NULL);
+    while (ListEntry != NULL) {
+        Segment = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_SEGMENT, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->Segments, ListEntry);
+        YoriShFreePromptSegment(Segment);
+    }
+
+    if (Directory->ChangeNotification != NULL) {
+        FindCloseChangeNotification(Directory->ChangeNotification);
+    }
+
+    YoriLibRemoveListItem(&Directory->ListEntry);
+    YoriLibFree(Directory);
+    YoriShPromptDirectoryCount--;
+}
+
+/**
+ Free all prompt segments, abandoning any evaluations that are still
+ executing.
+ */
+VOID
+YoriShCleanupPromptSegments()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_DIRECTORY Directory;
+
+    if (YoriShPromptDirectories.Next == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, ListEntry);
+        YoriShFreePromptDirectory(Directory);
+    }
+}
+
+/**
+ Consume any changes that have been recorded against a directory's change
+ notification so that only later changes are detected.
+
+ @param Directory The directory whose changes should be consumed.
+
+ @return TRUE if any changes were recorded, FALSE if none were.
+ */
+BOOL
+YoriShDrainPromptDirectoryChanges(
+    __in PYORI_SH_PROMPT_DIRECTORY Directory
+    )
+{
+    DWORD Count;
+    BOOL Changed;
+
+    Changed = FALSE;
+    for (Count = 0; Count < YORI_SH_PROMPT_DRAIN_MAX; Count++) {
+        if (WaitForSingleObject(Directory->ChangeNotification, 0) != WAIT_OBJECT_0) {
+            break;
+        }
+        Changed = TRUE;
+        if (!FindNextChangeNotification(Directory->ChangeNotification)) {
+            FindCloseChangeNotification(Directory->ChangeNotification);
+            Directory->ChangeNotification = NULL;
+            break;
+        }
+    }
+
+    return Changed;
+}
+
+/**
+ Find the prompt segments for the current directory, creating an empty set
+ if the directory has not been seen recently.
+
+ @return Pointer to the directory, or NULL on allocation failure.
+ */
+PYORI_SH_PROMPT_DIRECTORY
+YoriShGetPromptDirectory()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_DIRECTORY Directory;
+    YORI_STRING CurrentDirectory;
+    DWORD LengthNeeded;
+
+    if (YoriShPromptDirectories.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShPromptDirectories);
+    }
+
+    LengthNeeded = GetCurrentDirectory(0, NULL);
+    if (!YoriLibAllocateString(&CurrentDirectory, LengthNeeded)) {
+        return NULL;
+    }
+    CurrentDirectory.LengthInChars = GetCurrentDirectory(CurrentDirectory.LengthAllocated, CurrentDirectory.StartOfString);
+    if (CurrentDirectory.LengthInChars == 0 || CurrentDirectory.LengthInChars >= CurrentDirectory.LengthAllocated) {
+        YoriLibFreeStringContents(&CurrentDirectory);
+        return NULL;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_DIRECTORY, ListEntry);
+        if (YoriLibCompareStringInsensitive(&Directory->Directory, &CurrentDirectory) == 0) {
+            YoriLibFreeStringContents(&CurrentDirectory);
+            YoriLibRemoveListItem(&Directory->ListEntry);
+            YoriLibInsertList(&YoriShPromptDirectories, &Directory->ListEntry);
+            return Directory;
+        }
+        ListEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, ListEntry);
+    }
+
+    if (YoriShPromptDirectoryCount >= YORI_SH_PROMPT_DIRECTORY_MAX) {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShPromptDirectories, NULL);
+        if (ListEntry != NULL) {
+            Directory = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_DIRECTORY, ListEntry);
+            YoriShFreePromptDirectory(Directory);
+        }
+    }
+
+    Directory = YoriLibMalloc(sizeof(YORI_SH_PROMPT_DIRECTORY) + (CurrentDirectory.LengthInChars + 1) * sizeof(TCHAR));
+    if (Directory == NULL) {
+        YoriLibFreeStringContents(&CurrentDirectory);
+        return NULL;
+    }
+
+    YoriLibInitEmptyString(&Directory->Directory);
+    Directory->Directory.StartOfString = (LPTSTR)(Directory + 1);
+    Directory->Directory.LengthInChars = CurrentDirectory.LengthInChars;
+    Directory->Directory.LengthAllocated = CurrentDirectory.LengthInChars + 1;
+    memcpy(Directory->Directory.StartOfString, CurrentDirectory.StartOfString, (CurrentDirectory.LengthInChars + 1) * sizeof(TCHAR));
+    YoriLibFreeStringContents(&CurrentDirectory);
+
+    Directory->ChangeNotification = FindFirstChangeNotification(Directory->Directory.StartOfString, TRUE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (Directory->ChangeNotification == INVALID_HANDLE_VALUE) {
+        Directory->ChangeNotification = NULL;
+    }
+
+    Directory->EnvironmentGeneration = YoriShGlobal.EnvironmentGeneration;
+    YoriLibInitializeListHead(&Directory->Segments);
+    YoriLibInsertList(&YoriShPromptDirectories, &Directory->ListEntry);
+    YoriShPromptDirectoryCount++;
+
+    return Directory;
+}
+
+/**
+ Determine whether anything has changed since the segments within a
+ directory were evaluated, and if so, indicate that they need to be
+ evaluated again.  Segments that are still being evaluated are not
+ affected.
+
+ @param Directory The directory to check.
+ */
+VOID
+YoriShCheckPromptDirectoryForChanges(
+    __in PYORI_SH_PROMPT_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_SEGMENT Segment;
+    BOOL Changed;
+
+    Changed = FALSE;
+    if (Directory->EnvironmentGeneration != YoriShGlobal.EnvironmentGeneration) {
+        Directory->EnvironmentGeneration = YoriShGlobal.EnvironmentGeneration;
+        Changed = TRUE;
+    }
+
+    if (Directory->ChangeNotification == NULL) {
+        Changed = TRUE;
+    } else if (YoriShDrainPromptDirectoryChanges(Directory)) {
+        Changed = TRUE;
+    }
+
+    if (!Changed) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->Segments, NULL);
+    while (ListEntry != NULL) {
+        Segment = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_SEGMENT, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->Segments, ListEntry);
+        Segment->Current = FALSE;
+    }
+}
+
+/**
+ Find the segment within a directory for an expression, creating one if it
+ does not exist.
+
+ @param Directory The directory to search.
+
+ @param Expression The expression to find.
+
+ @return Pointer to the segment, or NULL on allocation failure.
+ */
+PYORI_SH_PROMPT_SEGMENT
+YoriShGetPromptSegment(
+    __in PYORI_SH_PROMPT_DIRECTORY Directory,
+    __in PYORI_STRING Expression
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_SEGMENT Segment;
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->Segments, NULL);
+    while (ListEntry != NULL) {
+        Segment = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_SEGMENT, ListEntry);
+        if (YoriLibCompareString(&Segment->Expression, Expression) == 0) {
+            return Segment;
+        }
+        ListEntry = YoriLibGetNextListEntry(&Directory->Segments, ListEntry);
+    }
+
+    Segment = YoriLibMalloc(sizeof(YORI_SH_PROMPT_SEGMENT) + Expression->LengthInChars * sizeof(TCHAR));
+    if (Segment == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Segment, sizeof(YORI_SH_PROMPT_SEGMENT));
+    YoriLibInitEmptyString(&Segment->Expression);
+    Segment->Expression.StartOfString = (LPTSTR)(Segment + 1);
+    Segment->Expression.LengthInChars = Expression->LengthInChars;
+    memcpy(Segment->Expression.StartOfString, Expression->StartOfString, Expression->LengthInChars * sizeof(TCHAR));
+    YoriLibInitEmptyString(&Segment->Output);
+
+    YoriLibAppendList(&Directory->Segments, &Segment->ListEntry);
+    return Segment;
+}
+
+/**
+ Returns TRUE if any prompt segments are being evaluated, indicating that
+ @ref YoriShCollectPromptSegments should be called periodically.
+
+ @return TRUE if any prompt segments are being evaluated, FALSE if not.
+ */
+BOOL
+YoriShPromptSegmentsPending()
+{
+    return (YoriShPromptPendingCount > 0);
+}
+
+/**
+ Collect the result of any prompt segments whose evaluation has completed.
+ Changes that occurred in a directory while its segments were being
+ evaluated are assumed to be caused by the evaluation, since tools such as
+ source control commonly update their own state, and are ignored.
+
+ @param OutputChanged If specified, on completion set to TRUE if the result
+        of a segment used by the prompt for the current directory has
+        changed, indicating the prompt should be redrawn.
+
+ @return TRUE if any segment completed, FALSE if none did.  Collecting a
+         segment waits for its process, which alters the console
+         configuration.
+ */
+BOOL
+YoriShCollectPromptSegments(
+    __out_opt PBOOL OutputChanged
+    )
+{
+    PYORI_LIST_ENTRY DirectoryEntry;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROMPT_DIRECTORY Directory;
+    PYORI_SH_PROMPT_SEGMENT Segment;
+    DWORD SavedErrorLevel;
+    BOOL Changed;
+    BOOL Completed;
+    BOOL DirectoryPending;
+    BOOL DirectoryCompleted;
+
+    if (OutputChanged != NULL) {
+        *OutputChanged = FALSE;
+    }
+
+    if (YoriShPromptPendingCount == 0) {
+        return FALSE;
+    }
+
+    Changed = FALSE;
+    Completed = FALSE;
+    SavedErrorLevel = YoriShGlobal.ErrorLevel;
+
+    DirectoryEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, NULL);
+    while (DirectoryEntry != NULL) {
+        Directory = CONTAINING_RECORD(DirectoryEntry, YORI_SH_PROMPT_DIRECTORY, ListEntry);
+        DirectoryPending = FALSE;
+        DirectoryCompleted = FALSE;
+
+        ListEntry = YoriLibGetNextListEntry(&Directory->Segments, NULL);
+        while (ListEntry != NULL) {
+            Segment = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_SEGMENT, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&Directory->Segments, ListEntry);
+
+            if (!Segment->Pending) {
+                continue;
+            }
+
+            if (Segment->Evaluation.ExecPlan.FirstCmd->hProcess != NULL &&
+                WaitForSingleObject(Segment->Evaluation.ExecPlan.FirstCmd->hProcess, 0) != WAIT_OBJECT_0) {
+
+                DirectoryPending = TRUE;
+                continue;
+            }
+
+            YoriShCompleteConcurrentBackquote(&Segment->Evaluation);
+            Segment->Pending = FALSE;
+            YoriShPromptPendingCount--;
+            Segment->Current = TRUE;
+            DirectoryCompleted = TRUE;
+
+            if (YoriLibCompareString(&Segment->Output, &Segment->Evaluation.Output) != 0) {
+                if (DirectoryEntry == YoriLibGetNextListEntry(&YoriShPromptDirectories, NULL) &&
+                    Segment->Referenced) {
+
+                    Changed = TRUE;
+                }
+            }
+
+            YoriLibFreeStringContents(&Segment->Output);
+            memcpy(&Segment->Output, &Segment->Evaluation.Output, sizeof(YORI_STRING));
+            YoriLibInitEmptyString(&Segment->Evaluation.Output);
+        }
+
+        if (DirectoryCompleted) {
+            Completed = TRUE;
+            if (!DirectoryPending && Directory->ChangeNotification != NULL) {
+                YoriShDrainPromptDirectoryChanges(Directory);
+            }
+        }
+
+        DirectoryEntry = YoriLibGetNextListEntry(&YoriShPromptDirectories, DirectoryEntry);
+    }
+
+    YoriShGlobal.ErrorLevel = SavedErrorLevel;
+    if (OutputChanged != NULL) {
+        *OutputChanged = Changed;
+    }
+    return Completed;
+}
+
+/**
+ Expand the backquoted expressions within the prompt, using the results of
+ previous evaluations in the current directory where nothing has changed
+ since.  Any expression that needs to be evaluated and consists of a single
+ external program is launched, and the prompt waits up to the deadline for
+ it to complete.  Expressions which do not complete in time are displayed
+ with their previous result, and continue to execute while the user enters
+ input, with the prompt being redrawn when they complete.
+
+ Only the most deeply nested expressions are handled this way; any outer
+ expressions which depend on their results are evaluated normally.
+
+ @param Expression The prompt expression.
+
+ @param Deadline The number of milliseconds to wait for expressions to
+        complete before displaying the prompt.
+
+ @param Redraw If TRUE, the prompt is being redrawn and only existing
+        results should be used, without evaluating anything.
+
+ @param CacheLifetime The number of milliseconds that results of outer
+        expressions can be reused for.
+
+ @param ResultingExpression On successful completion, updated to contain
+        the expanded prompt.  This may be the same as Expression if no
+        backquote expansion occurred.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
+__success(return)
 BOOL
-YoriShDisplayPrompt()
+YoriShExpandPromptSegments(
+    __in PYORI_STRING Expression,
+    __in DWORD Deadline,
+    __in BOOLEAN Redraw,
+    __in DWORD CacheLifetime,
+    __out PYORI_STRING ResultingExpression
+    )
 {
-    DWORD EnvVarLength;
-    YORI_STRING PromptVar;
-    YORI_STRING PromptAfterBackquoteExpansion;
-    YORI_STRING PromptAfterEnvExpansion;
-    YORI_STRING DisplayString;
-    PYORI_STRING StringToUse;
-    DWORD SavedErrorLevel = YoriShGlobal.ErrorLevel;
+    PYORI_SH_PROMPT_DIRECTORY Directory;
+    PYORI_SH_PROMPT_SEGMENT *Segments;
+    PYORI_SH_PROMPT_SEGMENT Segment;
+    PYORI_SH_BACKQUOTE_SUBSTRING Substrings;
+    PYORI_SH_BACKQUOTE_EVALUATION Evaluations;
+    PYORI_LIST_ENTRY ListEntry;
+    YORI_STRING SubstitutedExpression;
+    YORI_STRING Output;
+    DWORD SubstringCount;
+    DWORD Index;
+    DWORD StartTime;
+    DWORD Elapsed;
+    BOOL Substituted;
+
+    if (!YoriShFindDeepestBackquoteSubstrings(Expression, &Substrings, &SubstringCount)) {
+        YoriLibInitEmptyString(ResultingExpression);
+        ResultingExpression->StartOfString = Expression->StartOfString;
+        ResultingExpression->LengthInChars = Expression->LengthInChars;
+        return TRUE;
+    }
+
+    Directory = YoriShGetPromptDirectory();
+    Evaluations = YoriLibMalloc(SubstringCount * (sizeof(YORI_SH_BACKQUOTE_EVALUATION) + sizeof(PYORI_SH_PROMPT_SEGMENT)));
+    if (Directory == NULL || Evaluations == NULL) {
+        if (Evaluations != NULL) {
+            YoriLibFree(Evaluations);
+        }
+        YoriLibFree(Substrings);
+        return YoriShExpandBackquotes(Expression, CacheLifetime, ResultingExpression);
+    }
+
+    ZeroMemory(Evaluations, SubstringCount * (sizeof(YORI_SH_BACKQUOTE_EVALUATION) + sizeof(PYORI_SH_PROMPT_SEGMENT)));
+    Segments = (PYORI_SH_PROMPT_SEGMENT *)(Evaluations + SubstringCount);
+
+    if (!Redraw) {
+        YoriShCollectPromptSegments(NULL);
+        YoriShCheckPromptDirectoryForChanges(Directory);
+    }
 
     //
-    //  Don't update taskbar UI while executing processes executed as part of
-    //  the prompt or title
+    //  Find the segment for each expression, and start evaluating any
+    //  whose result is out of date.  Expressions that can't execute
+    //  concurrently are evaluated now.
     //
 
-    YoriShGlobal.SuppressTaskUi = TRUE;
+    for (Index = 0; Index < SubstringCount; Index++) {
+        Segment = YoriShGetPromptSegment(Directory, &Substrings[Index].String);
+        Segments[Index] = Segment;
+        if (Segment == NULL) {
+            continue;
+        }
+
+        Segment->Referenced = TRUE;
+        if (Redraw || Segment->Current || Segment->Pending) {
+            continue;
+        }
+
+        if (YoriShLaunchBackquoteConcurrently(&Substrings[Index].String, &Segment->Evaluation)) {
+            Segment->Pending = TRUE;
+            YoriShPromptPendingCount++;
+        } else if (YoriShExecuteExpressionAndCaptureOutput(&Substrings[Index].String, &Output)) {
+            YoriLibFreeStringContents(&Segment->Output);
+            memcpy(&Segment->Output, &Output, sizeof(YORI_STRING));
+            Segment->Current = TRUE;
+        }
+    }
 
     //
-    //  See if the environment has changed, and if so, reload the YORIPOSTCMD
-    //  variable.
+    //  Give any launched expressions until the deadline to complete.
     //
 
-    if (YoriShGlobal.PostCmdGeneration != YoriShGlobal.EnvironmentGeneration) {
-        EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPOSTCMD"), NULL, 0, NULL);
-        if (EnvVarLength > 0) {
-            if (YoriLibAllocateString(&PromptVar, EnvVarLength)) {
-
-                YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
-                memcpy(&YoriShGlobal.PostCmdVariable, &PromptVar, sizeof(YORI_STRING));
-                YoriShGlobal.PostCmdVariable.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPOSTCMD"), YoriShGlobal.PostCmdVariable.StartOfString, YoriShGlobal.PostCmdVariable.LengthAllocated, &YoriShGlobal.PostCmdGeneration);
+    if (!Redraw && YoriShPromptPendingCount > 0) {
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        StartTime = GetTickCount();
+        for (Index = 0; Index < SubstringCount; Index++) {
+            Segment = Segments[Index];
+            if (Segment != NULL &&
+                Segment->Pending &&
+                Segment->Evaluation.ExecPlan.FirstCmd->hProcess != NULL) {
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+                Elapsed = GetTickCount() - StartTime;
+                if (Elapsed >= Deadline) {
+                    break;
+                }
+                WaitForSingleObject(Segment->Evaluation.ExecPlan.FirstCmd->hProcess, Deadline - Elapsed);
             }
-        } else {
-            YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
         }
+        YoriShCollectPromptSegments(NULL);
+    }
+
+    for (Index = 0; Index < SubstringCount; Index++) {
+        if (Segments[Index] != NULL) {
+            YoriLibCloneString(&Evaluations[Index].Output, &Segments[Index]->Output);
+        }
+    }
+
+    Substituted = YoriShSubstituteBackquoteOutput(Expression, Substrings, Evaluations, SubstringCount, &SubstitutedExpression);
+
+    for (Index = 0; Index < SubstringCount; Index++) {
+        YoriLibFreeStringContents(&Evaluations[Index].Output);
     }
+    YoriLibFree(Evaluations);
+    YoriLibFree(Substrings);
 
     //
-    //  If YORIPOSTCMD is defined, execute it
+    //  Discard any segments that this prompt no longer uses.
     //
 
-    if (YoriShGlobal.PostCmdVariable.LengthInChars > 0) {
-        YoriShExecuteExpression(&YoriShGlobal.PostCmdVariable);
+    ListEntry = YoriLibGetNextListEntry(&Directory->Segments, NULL);
+    while (ListEntry != NULL) {
+        Segment = CONTAINING_RECORD(ListEntry, YORI_SH_PROMPT_SEGMENT, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->Segments, ListEntry);
+        if (!Segment->Referenced && !Segment->Pending) {
+            YoriShFreePromptSegment(Segment);
+        } else {
+            Segment->Referenced = FALSE;
+        }
+    }
+
+    if (!Substituted) {
+        return FALSE;
     }
 
     //
-    //  See if the environment has changed, and if so, reload the YORIPROMPT
-    //  variable.
+    //  Evaluate any outer expressions.
     //
 
-    if (YoriShGlobal.PromptGeneration != YoriShGlobal.EnvironmentGeneration) {
-        EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPROMPT"), NULL, 0, NULL);
-        if (EnvVarLength > 0) {
-            if (YoriLibAllocateString(&PromptVar, EnvVarLength)) {
+    if (!YoriShExpandBackquotes(&SubstitutedExpression, CacheLifetime, ResultingExpression)) {
+        memcpy(ResultingExpression, &SubstitutedExpression, sizeof(YORI_STRING));
+        return TRUE;
+    }
 
-                YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
-                memcpy(&YoriShGlobal.PromptVariable, &PromptVar, sizeof(YORI_STRING));
-                YoriShGlobal.PromptVariable.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPROMPT"), YoriShGlobal.PromptVariable.StartOfString, YoriShGlobal.PromptVariable.LengthAllocated, &YoriShGlobal.PromptGeneration);
-            }
-        } else {
-            YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
+    if (ResultingExpression->StartOfString == SubstitutedExpression.StartOfString) {
+        memcpy(ResultingExpression, &SubstitutedExpression, sizeof(YORI_STRING));
+    } else {
+        YoriLibFreeStringContents(&SubstitutedExpression);
+    }
+
+    return TRUE;
+}
+
+/**
+ Record the number of console cells occupied by a displayed prompt, so the
+ prompt can later be redrawn in place.  This is only possible if the
+ prompt consists of printable characters and color escapes, so that the
+ number of cells can be determined from the text.
+
+ @param DisplayString The prompt, as displayed.
+ */
+VOID
+YoriShRecordPromptCellsDisplayed(
+    __in PYORI_STRING DisplayString
+    )
+{
+    YORI_STRING PlainText;
+    DWORD Index;
+
+    YoriShPromptCellsDisplayed = 0;
+    YoriLibInitEmptyString(&PlainText);
+    if (!YoriLibStripVtEscapes(DisplayString, &PlainText)) {
+        return;
+    }
+
+    for (Index = 0; Index < PlainText.LengthInChars; Index++) {
+        if (PlainText.StartOfString[Index] < ' ') {
+            YoriLibFreeStringContents(&PlainText);
+            return;
         }
     }
 
+    YoriShPromptCellsDisplayed = PlainText.LengthInChars;
+    YoriLibFreeStringContents(&PlainText);
+}
+
+/**
+ Return the number of console cells occupied by the most recently displayed
+ prompt.
+
+ @return The number of cells, or zero if the prompt cannot be redrawn in
+         place.
+ */
+DWORD
+YoriShGetPromptCellsDisplayed()
+{
+    return YoriShPromptCellsDisplayed;
+}
+
+/**
+ Expand and display the YORIPROMPT variable, or a default prompt if it is
+ not defined.
+
+ @param CacheLifetime The number of milliseconds that the result of a
+        backquoted expression can be reused for.
+
+ @param Redraw If TRUE, the prompt is being redrawn after an expression
+        within it completed, and nothing should be evaluated.
+ */
+VOID
+YoriShDisplayPromptVariable(
+    __in DWORD CacheLifetime,
+    __in BOOLEAN Redraw
+    )
+{
+    DWORD EnvVarLength;
+    YORI_STRING PromptAfterBackquoteExpansion;
+    YORI_STRING PromptAfterEnvExpansion;
+    YORI_STRING DisplayString;
+    PYORI_STRING StringToUse;
+    DWORD Deadline;
+    BOOL Expanded;
+
+    YoriShPromptCellsDisplayed = 0;
+    Deadline = YoriShGetPromptEnvironmentNumber(_T("YORIPROMPTDEADLINE"));
+
     //
     //  Expand and display the prompt
     //
@@ -258,9 +997,18 @@ YoriShDisplayPrompt()
         //
         //  If there are any backquotes, expand them.  If not, or if
         //  expansion fails, we'll end up pointing at the previous string.
+        //  If a deadline is specified, slow expressions are displayed with
+        //  their previous result and the prompt is redrawn when they
+        //  complete.
         //
 
-        if (YoriShExpandBackquotes(StringToUse, &PromptAfterBackquoteExpansion)) {
+        if (Deadline != 0) {
+            Expanded = YoriShExpandPromptSegments(StringToUse, Deadline, Redraw, CacheLifetime, &PromptAfterBackquoteExpansion);
+        } else {
+            Expanded = YoriShExpandBackquotes(StringToUse, CacheLifetime, &PromptAfterBackquoteExpansion);
+        }
+
+        if (Expanded) {
             StringToUse = &PromptAfterBackquoteExpansion;
         }
 
@@ -286,6 +1034,9 @@ YoriShDisplayPrompt()
 
         if (DisplayString.StartOfString != NULL) {
             YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
+            if (Deadline != 0) {
+                YoriShRecordPromptCellsDisplayed(&DisplayString);
+            }
             YoriLibFreeStringContents(&DisplayString);
         }
 
@@ -322,6 +1073,80 @@ YoriShDisplayPrompt()
             YoriLibFree(PromptString);
         }
     }
+}
+
+/**
+ Displays the current prompt string on the console.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriShDisplayPrompt()
+{
+    DWORD EnvVarLength;
+    YORI_STRING PromptVar;
+    YORI_STRING PromptAfterBackquoteExpansion;
+    YORI_STRING PromptAfterEnvExpansion;
+    YORI_STRING DisplayString;
+    PYORI_STRING StringToUse;
+    DWORD SavedErrorLevel = YoriShGlobal.ErrorLevel;
+    DWORD CacheLifetime;
+
+    //
+    //  Don't update taskbar UI while executing processes executed as part of
+    //  the prompt or title
+    //
+
+    YoriShGlobal.SuppressTaskUi = TRUE;
+    CacheLifetime = YoriShGetPromptCacheLifetime();
+
+    //
+    //  See if the environment has changed, and if so, reload the YORIPOSTCMD
+    //  variable.
+    //
+
+    if (YoriShGlobal.PostCmdGeneration != YoriShGlobal.EnvironmentGeneration) {
+        EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPOSTCMD"), NULL, 0, NULL);
+        if (EnvVarLength > 0) {
+            if (YoriLibAllocateString(&PromptVar, EnvVarLength)) {
+
+                YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
+                memcpy(&YoriShGlobal.PostCmdVariable, &PromptVar, sizeof(YORI_STRING));
+                YoriShGlobal.PostCmdVariable.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPOSTCMD"), YoriShGlobal.PostCmdVariable.StartOfString, YoriShGlobal.PostCmdVariable.LengthAllocated, &YoriShGlobal.PostCmdGeneration);
+            }
+        } else {
+            YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
+        }
+    }
+
+    //
+    //  If YORIPOSTCMD is defined, execute it
+    //
+
+    if (YoriShGlobal.PostCmdVariable.LengthInChars > 0) {
+        YoriShExecuteExpression(&YoriShGlobal.PostCmdVariable);
+    }
+
+    //
+    //  See if the environment has changed, and if so, reload the YORIPROMPT
+    //  variable.
+    //
+
+    if (YoriShGlobal.PromptGeneration != YoriShGlobal.EnvironmentGeneration) {
+        EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPROMPT"), NULL, 0, NULL);
+        if (EnvVarLength > 0) {
+            if (YoriLibAllocateString(&PromptVar, EnvVarLength)) {
+
+                YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
+                memcpy(&YoriShGlobal.PromptVariable, &PromptVar, sizeof(YORI_STRING));
+                YoriShGlobal.PromptVariable.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIPROMPT"), YoriShGlobal.PromptVariable.StartOfString, YoriShGlobal.PromptVariable.LengthAllocated, &YoriShGlobal.PromptGeneration);
+            }
+        } else {
+            YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
+        }
+    }
+
+    YoriShDisplayPromptVariable(CacheLifetime, FALSE);
 
     //
     //  If we have a dynamic title, do that too.
@@ -358,7 +1183,7 @@ YoriShDisplayPrompt()
         //  expansion fails, we'll end up pointing at the previous string.
         //
 
-        if (YoriShExpandBackquotes(StringToUse, &PromptAfterBackquoteExpansion)) {
+        if (YoriShExpandBackquotes(StringToUse, CacheLifetime, &PromptAfterBackquoteExpansion)) {
             StringToUse = &PromptAfterBackquoteExpansion;
         }
 
@@ -411,6 +1236,23 @@ YoriShDisplayPrompt()
     return TRUE;
 }
 
+/**
+ Redraw the prompt at the current cursor location using the most recent
+ results of any backquoted expressions, without executing anything.  This
+ is used once an expression that was still executing when the prompt was
+ displayed has completed.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriShRedrawPrompt()
+{
+    YoriShGlobal.SuppressTaskUi = TRUE;
+    YoriShDisplayPromptVariable(YoriShGetPromptCacheLifetime(), TRUE);
+    YoriShGlobal.SuppressTaskUi = FALSE;
+    return TRUE;
+}
+
 /**
  Execute any command that needs to run before every user initiated command.
 
@@ -32,6 +32,230 @@
  */
 BOOL YoriShProcessRegisteredForRestart = FALSE;
 
+/**
+ The signature at the start of a restart state file, which is "YRST" when
+ viewed as bytes.
+ */
+#define YORI_SH_RESTART_SIGNATURE (0x54535259)
+
+/**
+ The version of the restart state file format.  Files with any other version
+ are ignored.
+ */
+#define YORI_SH_RESTART_VERSION (1)
+
+/**
+ The largest restart state file that will be loaded.  Anything larger than
+ this is assumed to be corrupt.
+ */
+#define YORI_SH_RESTART_MAX_FILE_SIZE (64 * 1024 * 1024)
+
+/**
+ The header at the start of a restart state file.  This is followed by a
+ series of sections, each beginning with a YORI_SH_RESTART_SECTION.
+ */
+typedef struct _YORI_SH_RESTART_HEADER {
+
+    /**
+     Set to YORI_SH_RESTART_SIGNATURE.
+     */
+    DWORD Signature;
+
+    /**
+     Set to YORI_SH_RESTART_VERSION.
+     */
+    DWORD Version;
+
+    /**
+     The size of this header, in bytes.  The first section follows
+     immediately after it.
+     */
+    DWORD HeaderSize;
+
+    /**
+     The number of sections that follow the header.
+     */
+    DWORD SectionCount;
+} YORI_SH_RESTART_HEADER, *PYORI_SH_RESTART_HEADER;
+
+/**
+ The types of section that can be contained within a restart state file.
+ */
+typedef enum _YORI_SH_RESTART_SECTION_TYPE {
+    YoriShRestartSectionWindow = 1,
+    YoriShRestartSectionTitle = 2,
+    YoriShRestartSectionCurrentDirectory = 3,
+    YoriShRestartSectionEnvironment = 4,
+    YoriShRestartSectionAliases = 5,
+    YoriShRestartSectionHistory = 6,
+    YoriShRestartSectionContents = 7
+} YORI_SH_RESTART_SECTION_TYPE;
+
+/**
+ The header preceding each section in a restart state file.  The section's
+ data follows immediately after this header, and the next section begins at
+ the next DWORD aligned offset after the data.
+ */
+typedef struct _YORI_SH_RESTART_SECTION {
+
+    /**
+     The type of the section, from YORI_SH_RESTART_SECTION_TYPE.
+     */
+    DWORD Type;
+
+    /**
+     The number of bytes of data in the section, not including this header
+     or any alignment padding.
+     */
+    DWORD LengthInBytes;
+} YORI_SH_RESTART_SECTION, *PYORI_SH_RESTART_SECTION;
+
+/**
+ The data recorded in a YoriShRestartSectionWindow section.
+ */
+typedef struct _YORI_SH_RESTART_WINDOW {
+
+    /**
+     The width of the console screen buffer.
+     */
+    WORD BufferWidth;
+
+    /**
+     The height of the console screen buffer.
+     */
+    WORD BufferHeight;
+
+    /**
+     The width of the console window.
+     */
+    WORD WindowWidth;
+
+    /**
+     The height of the console window.
+     */
+    WORD WindowHeight;
+
+    /**
+     The default color of text.
+     */
+    WORD DefaultColor;
+
+    /**
+     The color of popups.
+     */
+    WORD PopupColor;
+
+    /**
+     The RGB values of each console color.
+     */
+    DWORD ColorTable[16];
+
+    /**
+     The index of the console font.  This and the remaining font fields are
+     zero if the font could not be queried.
+     */
+    DWORD FontIndex;
+
+    /**
+     The width of each character in the console font.
+     */
+    WORD FontWidth;
+
+    /**
+     The height of each character in the console font.
+     */
+    WORD FontHeight;
+
+    /**
+     The family of the console font.
+     */
+    DWORD FontFamily;
+
+    /**
+     The weight of the console font.
+     */
+    DWORD FontWeight;
+
+    /**
+     The name of the console font.
+     */
+    WCHAR FontName[LF_FACESIZE];
+} YORI_SH_RESTART_WINDOW, *PYORI_SH_RESTART_WINDOW;
+
+/**
+ The data at the start of a YoriShRestartSectionContents section.  This is
+ followed by RunCount YORI_SH_RESTART_CELL_RUN structures which together
+ describe Width * Height cells.
+ */
+typedef struct _YORI_SH_RESTART_CONTENTS {
+
+    /**
+     The number of cells in each line.
+     */
+    WORD Width;
+
+    /**
+     The number of lines.
+     */
+    WORD Height;
+
+    /**
+     The number of runs that follow.
+     */
+    DWORD RunCount;
+} YORI_SH_RESTART_CONTENTS, *PYORI_SH_RESTART_CONTENTS;
+
+/**
+ A run of identical console cells.  Most of a console buffer consists of
+ long runs of blank cells, so recording runs rather than cells keeps the
+ window contents small.
+ */
+typedef struct _YORI_SH_RESTART_CELL_RUN {
+
+    /**
+     The number of consecutive cells with this character and attribute.
+     */
+    WORD RunLength;
+
+    /**
+     The character in each cell.
+     */
+    WCHAR Char;
+
+    /**
+     The attribute of each cell.
+     */
+    WORD Attributes;
+} YORI_SH_RESTART_CELL_RUN, *PYORI_SH_RESTART_CELL_RUN;
+
+/**
+ An in memory buffer used to construct restart state before writing it to
+ disk in a single operation.
+ */
+typedef struct _YORI_SH_RESTART_BUFFER {
+
+    /**
+     The allocation containing the restart state.
+     */
+    PUCHAR Buffer;
+
+    /**
+     The number of bytes in Buffer that contain restart state.
+     */
+    DWORD BytesPopulated;
+
+    /**
+     The number of bytes allocated in Buffer.
+     */
+    DWORD BytesAllocated;
+
+    /**
+     Set to TRUE if an allocation has failed.  Once set, further data is
+     discarded and the state is not written.
+     */
+    BOOL AllocationFailed;
+} YORI_SH_RESTART_BUFFER, *PYORI_SH_RESTART_BUFFER;
+
 /**
  Return a path to the temp directory, but allocate extra space for a file name
  to append to it.
@@ -68,6 +292,400 @@ YoriShGetTempPath(
     return TRUE;
 }
 
+/**
+ Ensure a restart buffer has space for additional data, reallocating it if
+ necessary.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param BytesNeeded The number of bytes to be appended to the buffer.
+
+ @return TRUE if the buffer has space for the data, FALSE if it could not
+         be reallocated.
+ */
+BOOL
+YoriShReserveRestartBuffer(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in DWORD BytesNeeded
+    )
+{
+    PUCHAR NewBuffer;
+    DWORD NewBytesAllocated;
+
+    if (Buffer->AllocationFailed) {
+        return FALSE;
+    }
+
+    if (Buffer->BytesPopulated + BytesNeeded <= Buffer->BytesAllocated) {
+        return TRUE;
+    }
+
+    NewBytesAllocated = Buffer->BytesAllocated;
+    if (NewBytesAllocated < 64 * 1024) {
+        NewBytesAllocated = 64 * 1024;
+    }
+
+    while (NewBytesAllocated < Buffer->BytesPopulated + BytesNeeded) {
+        if (NewBytesAllocated >= YORI_SH_RESTART_MAX_FILE_SIZE) {
+            Buffer->AllocationFailed = TRUE;
+            return FALSE;
+        }
+        NewBytesAllocated = NewBytesAllocated * 2;
+    }
+
+    NewBuffer = YoriLibMalloc(NewBytesAllocated);
+    if (NewBuffer == NULL) {
+        Buffer->AllocationFailed = TRUE;
+        return FALSE;
+    }
+
+    if (Buffer->Buffer != NULL) {
+        memcpy(NewBuffer, Buffer->Buffer, Buffer->BytesPopulated);
+        YoriLibFree(Buffer->Buffer);
+    }
+
+    Buffer->Buffer = NewBuffer;
+    Buffer->BytesAllocated = NewBytesAllocated;
+    return TRUE;
+}
+
+/**
+ Append data to a restart buffer.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param Data Pointer to the data to append.
+
+ @param LengthInBytes The number of bytes to append.
+ */
+VOID
+YoriShAppendRestartBuffer(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in PVOID Data,
+    __in DWORD LengthInBytes
+    )
+{
+    if (!YoriShReserveRestartBuffer(Buffer, LengthInBytes)) {
+        return;
+    }
+
+    memcpy(Buffer->Buffer + Buffer->BytesPopulated, Data, LengthInBytes);
+    Buffer->BytesPopulated += LengthInBytes;
+}
+
+/**
+ Begin a new section in a restart buffer.  Data for the section can be
+ appended with @ref YoriShAppendRestartBuffer , and the section is completed
+ with @ref YoriShEndRestartSection .
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param Type The type of the section.
+
+ @return The offset of the section header within the buffer, to pass to
+         @ref YoriShEndRestartSection .
+ */
+DWORD
+YoriShBeginRestartSection(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in YORI_SH_RESTART_SECTION_TYPE Type
+    )
+{
+    YORI_SH_RESTART_SECTION Section;
+    DWORD SectionOffset;
+
+    SectionOffset = Buffer->BytesPopulated;
+    Section.Type = Type;
+    Section.LengthInBytes = 0;
+    YoriShAppendRestartBuffer(Buffer, &Section, sizeof(Section));
+    return SectionOffset;
+}
+
+/**
+ Complete a section in a restart buffer by recording its length and padding
+ the buffer so the next section is DWORD aligned.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param SectionOffset The offset of the section header, as returned from
+        @ref YoriShBeginRestartSection .
+ */
+VOID
+YoriShEndRestartSection(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in DWORD SectionOffset
+    )
+{
+    PYORI_SH_RESTART_SECTION Section;
+    PYORI_SH_RESTART_HEADER Header;
+    DWORD Padding;
+
+    if (Buffer->AllocationFailed) {
+        return;
+    }
+
+    Section = (PYORI_SH_RESTART_SECTION)(Buffer->Buffer + SectionOffset);
+    Section->LengthInBytes = Buffer->BytesPopulated - SectionOffset - sizeof(YORI_SH_RESTART_SECTION);
+
+    Padding = 0;
+    YoriShAppendRestartBuffer(Buffer, &Padding, (sizeof(DWORD) - (Buffer->BytesPopulated % sizeof(DWORD))) % sizeof(DWORD));
+
+    if (!Buffer->AllocationFailed) {
+        Header = (PYORI_SH_RESTART_HEADER)Buffer->Buffer;
+        Header->SectionCount++;
+    }
+}
+
+/**
+ Add a complete section to a restart buffer.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param Type The type of the section.
+
+ @param Data Pointer to the data for the section.
+
+ @param LengthInBytes The number of bytes of data in the section.
+ */
+VOID
+YoriShAddRestartSection(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in YORI_SH_RESTART_SECTION_TYPE Type,
+    __in PVOID Data,
+    __in DWORD LengthInBytes
+    )
+{
+    DWORD SectionOffset;
+
+    SectionOffset = YoriShBeginRestartSection(Buffer, Type);
+    YoriShAppendRestartBuffer(Buffer, Data, LengthInBytes);
+    YoriShEndRestartSection(Buffer, SectionOffset);
+}
+
+/**
+ Add a section to a restart buffer containing a set of NULL terminated
+ strings, terminated by an additional NULL.  Only the strings are recorded;
+ the final terminator is added back when the section is loaded.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param Type The type of the section.
+
+ @param Strings Pointer to the set of strings.  The LengthInChars of this
+        string is modified by this function.
+ */
+VOID
+YoriShAddRestartStringsSection(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in YORI_SH_RESTART_SECTION_TYPE Type,
+    __inout PYORI_STRING Strings
+    )
+{
+    if (!YoriLibAreEnvironmentStringsValid(Strings)) {
+        return;
+    }
+
+    YoriShAddRestartSection(Buffer, Type, Strings->StartOfString, Strings->LengthInChars * sizeof(TCHAR));
+}
+
+/**
+ Capture the contents of the console window and add them to a restart
+ buffer as a series of runs of identical cells.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @param LineCount Specifies the number of lines to capture.  If zero, all
+        lines up to the cursor are captured.
+ */
+VOID
+YoriShAddRestartContentsSection(
+    __inout PYORI_SH_RESTART_BUFFER Buffer,
+    __in DWORD LineCount
+    )
+{
+    CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
+    YORI_SH_RESTART_CONTENTS Contents;
+    YORI_SH_RESTART_CELL_RUN Run;
+    PYORI_SH_RESTART_CONTENTS SavedContents;
+    HANDLE hConsole;
+    PCHAR_INFO LineBuffer;
+    SMALL_RECT LineReadWindow;
+    COORD LineBufferSize;
+    COORD LineBufferOffset;
+    DWORD SectionOffset;
+    DWORD ContentsOffset;
+    WORD LineIndex;
+    WORD CellIndex;
+
+    hConsole = CreateFile(_T("CONOUT$"), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (hConsole == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (!GetConsoleScreenBufferInfo(hConsole, &ScreenInfo)) {
+        CloseHandle(hConsole);
+        return;
+    }
+
+    if (LineCount == 0 || LineCount > (DWORD)ScreenInfo.dwCursorPosition.Y) {
+        LineCount = ScreenInfo.dwCursorPosition.Y;
+    }
+
+    if (LineCount == 0 || ScreenInfo.dwSize.X <= 0) {
+        CloseHandle(hConsole);
+        return;
+    }
+
+    LineBuffer = YoriLibMalloc(ScreenInfo.dwSize.X * sizeof(CHAR_INFO));
+    if (LineBuffer == NULL) {
+        CloseHandle(hConsole);
+        return;
+    }
+
+    Contents.Width = (WORD)ScreenInfo.dwSize.X;
+    Contents.Height = (WORD)LineCount;
+    Contents.RunCount = 0;
+
+    SectionOffset = YoriShBeginRestartSection(Buffer, YoriShRestartSectionContents);
+    ContentsOffset = Buffer->BytesPopulated;
+    YoriShAppendRestartBuffer(Buffer, &Contents, sizeof(Contents));
+
+    LineBufferSize.X = Contents.Width;
+    LineBufferSize.Y = 1;
+    LineBufferOffset.X = 0;
+    LineBufferOffset.Y = 0;
+    Run.RunLength = 0;
+    Run.Char = 0;
+    Run.Attributes = 0;
+
+    //
+    //  Read one line at a time, since ReadConsoleOutput fails if given a
+    //  large request.  Runs are allowed to span lines.
+    //
+
+    for (LineIndex = 0; LineIndex < Contents.Height; LineIndex++) {
+        LineReadWindow.Left = 0;
+        LineReadWindow.Right = (WORD)(Contents.Width - 1);
+        LineReadWindow.Top = (WORD)(ScreenInfo.dwCursorPosition.Y - Contents.Height + LineIndex);
+        LineReadWindow.Bottom = LineReadWindow.Top;
+
+        if (!ReadConsoleOutput(hConsole, LineBuffer, LineBufferSize, LineBufferOffset, &LineReadWindow)) {
+            for (CellIndex = 0; CellIndex < Contents.Width; CellIndex++) {
+                LineBuffer[CellIndex].Char.UnicodeChar = ' ';
+                LineBuffer[CellIndex].Attributes = ScreenInfo.wAttributes;
+            }
+        }
+
+        for (CellIndex = 0; CellIndex < Contents.Width; CellIndex++) {
+            if (Run.RunLength > 0 &&
+                Run.RunLength < 0xFFFF &&
+                Run.Char == LineBuffer[CellIndex].Char.UnicodeChar &&
+                Run.Attributes == LineBuffer[CellIndex].Attributes) {
+
+                Run.RunLength++;
+                continue;
+            }
+
+            if (Run.RunLength > 0) {
+                YoriShAppendRestartBuffer(Buffer, &Run, sizeof(Run));
+                Contents.RunCount++;
+            }
+
+            Run.RunLength = 1;
+            Run.Char = LineBuffer[CellIndex].Char.UnicodeChar;
+            Run.Attributes = LineBuffer[CellIndex].Attributes;
+        }
+    }
+
+    if (Run.RunLength > 0) {
+        YoriShAppendRestartBuffer(Buffer, &Run, sizeof(Run));
+        Contents.RunCount++;
+    }
+
+    if (!Buffer->AllocationFailed) {
+        SavedContents = (PYORI_SH_RESTART_CONTENTS)(Buffer->Buffer + ContentsOffset);
+        SavedContents->RunCount = Contents.RunCount;
+    }
+
+    YoriShEndRestartSection(Buffer, SectionOffset);
+
+    YoriLibFree(LineBuffer);
+    CloseHandle(hConsole);
+}
+
+/**
+ Write a restart buffer to disk.  The buffer is written to a temporary file
+ which is then renamed over any previous restart state, so a termination
+ while writing leaves the previous state intact.
+
+ @param Buffer Pointer to the restart buffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriShWriteRestartBuffer(
+    __in PYORI_SH_RESTART_BUFFER Buffer
+    )
+{
+    YORI_STRING RestartFileName;
+    YORI_STRING TempFileName;
+    HANDLE hFile;
+    DWORD BytesWritten;
+    BOOL Result;
+
+    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.dat") + 2 * sizeof(DWORD))) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&TempFileName, RestartFileName.LengthAllocated)) {
+        YoriLibFreeStringContents(&RestartFileName);
+        return FALSE;
+    }
+
+    memcpy(TempFileName.StartOfString, RestartFileName.StartOfString, RestartFileName.LengthInChars * sizeof(TCHAR));
+    TempFileName.LengthInChars = RestartFileName.LengthInChars;
+
+    YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
+                   _T("\\yori-restart-%x.dat"),
+                   GetCurrentProcessId());
+
+    YoriLibSPrintf(TempFileName.StartOfString + TempFileName.LengthInChars,
+                   _T("\\yori-restart-%x.tmp"),
+                   GetCurrentProcessId());
+
+    hFile = CreateFile(TempFileName.StartOfString,
+                       GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL,
+                       NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        YoriLibFreeStringContents(&TempFileName);
+        YoriLibFreeStringContents(&RestartFileName);
+        return FALSE;
+    }
+
+    Result = WriteFile(hFile, Buffer->Buffer, Buffer->BytesPopulated, &BytesWritten, NULL);
+    if (Result && BytesWritten != Buffer->BytesPopulated) {
+        Result = FALSE;
+    }
+    CloseHandle(hFile);
+
+    if (Result) {
+        Result = MoveFileEx(TempFileName.StartOfString, RestartFileName.StartOfString, MOVEFILE_REPLACE_EXISTING);
+    }
+
+    if (!Result) {
+        DeleteFile(TempFileName.StartOfString);
+    }
+
+    YoriLibFreeStringContents(&TempFileName);
+    YoriLibFreeStringContents(&RestartFileName);
+    return Result;
+}
+
 /**
  Try to save the current state of the process so that it can be recovered
  from this state after a subsequent unexpected termination.
@@ -81,10 +699,12 @@ YoriShSaveRestartStateWorker(
 {
     YORI_CONSOLE_SCREEN_BUFFER_INFOEX ScreenBufferInfo;
     YORI_CONSOLE_FONT_INFOEX FontInfo;
+    YORI_SH_RESTART_HEADER Header;
+    YORI_SH_RESTART_WINDOW Window;
+    YORI_SH_RESTART_BUFFER Buffer;
 
     YORI_STRING WriteBuffer;
     YORI_STRING RestartFileName;
-    YORI_STRING RestartBufferFileName;
     YORI_STRING Env;
     LPTSTR Comma;
     DWORD Count;
@@ -159,7 +779,7 @@ YoriShSaveRestartStateWorker(
     YoriLibFreeStringContents(&RestartFileName);
 
     //
-    //  Query window dimensions and state, and save it.
+    //  Query window dimensions and state.
     //
 
     ZeroMemory(&ScreenBufferInfo, sizeof(ScreenBufferInfo));
@@ -169,69 +789,61 @@ YoriShSaveRestartStateWorker(
         return 0;
     }
 
-    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.ini") + 2 * sizeof(DWORD))) {
-        return 0;
-    }
-
-    YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                   _T("\\yori-restart-%x.ini"),
-                   GetCurrentProcessId());
-
     if (!YoriLibAllocateString(&WriteBuffer, 64 * 1024)) {
-        YoriLibFreeStringContents(&RestartFileName);
         return 0;
     }
 
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.dwSize.X);
-    WritePrivateProfileString(_T("Window"), _T("BufferWidth"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.dwSize.Y);
-    WritePrivateProfileString(_T("Window"), _T("BufferHeight"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.srWindow.Right - ScreenBufferInfo.srWindow.Left + 1);
-    WritePrivateProfileString(_T("Window"), _T("WindowWidth"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.srWindow.Bottom - ScreenBufferInfo.srWindow.Top + 1);
-    WritePrivateProfileString(_T("Window"), _T("WindowHeight"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
+    //
+    //  All state is collected into a single buffer in memory and written
+    //  with a single write once complete.
+    //
 
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), YoriLibVtGetDefaultColor());
-    WritePrivateProfileString(_T("Window"), _T("DefaultColor"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-    YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.wPopupAttributes);
-    WritePrivateProfileString(_T("Window"), _T("PopupColor"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
+    ZeroMemory(&Buffer, sizeof(Buffer));
+    Header.Signature = YORI_SH_RESTART_SIGNATURE;
+    Header.Version = YORI_SH_RESTART_VERSION;
+    Header.HeaderSize = sizeof(Header);
+    Header.SectionCount = 0;
+    YoriShAppendRestartBuffer(&Buffer, &Header, sizeof(Header));
+
+    ZeroMemory(&Window, sizeof(Window));
+    Window.BufferWidth = ScreenBufferInfo.dwSize.X;
+    Window.BufferHeight = ScreenBufferInfo.dwSize.Y;
+    Window.WindowWidth = (WORD)(ScreenBufferInfo.srWindow.Right - ScreenBufferInfo.srWindow.Left + 1);
+    Window.WindowHeight = (WORD)(ScreenBufferInfo.srWindow.Bottom - ScreenBufferInfo.srWindow.Top + 1);
+    Window.DefaultColor = YoriLibVtGetDefaultColor();
+    Window.PopupColor = ScreenBufferInfo.wPopupAttributes;
 
     for (Count = 0; Count < sizeof(ScreenBufferInfo.ColorTable)/sizeof(ScreenBufferInfo.ColorTable[0]); Count++) {
-        TCHAR ColorName[32];
-        YoriLibSPrintf(ColorName, _T("Color%i"), Count);
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), ScreenBufferInfo.ColorTable[Count]);
-        WritePrivateProfileString(_T("Window"), ColorName, WriteBuffer.StartOfString, RestartFileName.StartOfString);
+        Window.ColorTable[Count] = ScreenBufferInfo.ColorTable[Count];
     }
 
     //
-    //  Query the window title and save it.
+    //  Query window font information.
     //
 
-    WriteBuffer.LengthInChars = GetConsoleTitle(WriteBuffer.StartOfString, 4095);
-    if (WriteBuffer.LengthInChars > 0) {
-        WritePrivateProfileString(_T("Window"), _T("Title"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-    } else {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Error getting window title: %i\n"), GetLastError());
+    ZeroMemory(&FontInfo, sizeof(FontInfo));
+    FontInfo.cbSize = sizeof(FontInfo);
+    if (DllKernel32.pGetCurrentConsoleFontEx(GetStdHandle(STD_OUTPUT_HANDLE), FALSE, &FontInfo)) {
+        Window.FontIndex = FontInfo.nFont;
+        Window.FontWidth = FontInfo.dwFontSize.X;
+        Window.FontHeight = FontInfo.dwFontSize.Y;
+        Window.FontFamily = FontInfo.FontFamily;
+        Window.FontWeight = FontInfo.FontWeight;
+        memcpy(Window.FontName, FontInfo.FaceName, sizeof(Window.FontName));
+        Window.FontName[LF_FACESIZE - 1] = '\0';
     }
 
+    YoriShAddRestartSection(&Buffer, YoriShRestartSectionWindow, &Window, sizeof(Window));
+
     //
-    //  Query window font information and save it.
+    //  Query the window title and save it.
     //
 
-    ZeroMemory(&FontInfo, sizeof(FontInfo));
-    FontInfo.cbSize = sizeof(FontInfo);
-    if (DllKernel32.pGetCurrentConsoleFontEx(GetStdHandle(STD_OUTPUT_HANDLE), FALSE, &FontInfo)) {
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), FontInfo.nFont);
-        WritePrivateProfileString(_T("Window"), _T("FontIndex"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), FontInfo.dwFontSize.X);
-        WritePrivateProfileString(_T("Window"), _T("FontWidth"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), FontInfo.dwFontSize.Y);
-        WritePrivateProfileString(_T("Window"), _T("FontHeight"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), FontInfo.FontFamily);
-        WritePrivateProfileString(_T("Window"), _T("FontFamily"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-        YoriLibSPrintf(WriteBuffer.StartOfString, _T("%i"), FontInfo.FontWeight);
-        WritePrivateProfileString(_T("Window"), _T("FontWeight"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
-        WritePrivateProfileString(_T("Window"), _T("FontName"), FontInfo.FaceName, RestartFileName.StartOfString);
+    WriteBuffer.LengthInChars = GetConsoleTitle(WriteBuffer.StartOfString, 4095);
+    if (WriteBuffer.LengthInChars > 0) {
+        YoriShAddRestartSection(&Buffer, YoriShRestartSectionTitle, WriteBuffer.StartOfString, WriteBuffer.LengthInChars * sizeof(TCHAR));
+    } else {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Error getting window title: %i\n"), GetLastError());
     }
 
     //
@@ -240,67 +852,16 @@ YoriShSaveRestartStateWorker(
 
     WriteBuffer.LengthInChars = GetCurrentDirectory(WriteBuffer.LengthAllocated, WriteBuffer.StartOfString);
     if (WriteBuffer.LengthInChars > 0 && WriteBuffer.LengthInChars < WriteBuffer.LengthAllocated) {
-        WritePrivateProfileString(_T("Window"), _T("CurrentDirectory"), WriteBuffer.StartOfString, RestartFileName.StartOfString);
+        YoriShAddRestartSection(&Buffer, YoriShRestartSectionCurrentDirectory, WriteBuffer.StartOfString, WriteBuffer.LengthInChars * sizeof(TCHAR));
     }
 
     //
-    //  Write the current environment
+    //  Write the current environment.  This includes current directories on
+    //  alternate drives, which are recorded as variables like "=C:".
     //
 
     if (YoriLibGetEnvironmentStrings(&Env)) {
-        LPTSTR ThisPair;
-        LPTSTR ThisVar;
-        LPTSTR ThisValue;
-
-        ThisPair = Env.StartOfString;
-        while (*ThisPair != '\0') {
-            ThisVar = ThisPair;
-            ThisPair += _tcslen(ThisPair) + 1;
-
-            if (ThisVar[0] != '=') {
-                ThisValue = _tcschr(ThisVar, '=');
-                if (ThisValue) {
-                    ThisValue[0] = '\0';
-                    ThisValue++;
-
-                    WritePrivateProfileString(_T("Environment"), ThisVar, ThisValue, RestartFileName.StartOfString);
-
-                    ThisValue--;
-                    ThisValue[0] = '=';
-                }
-            }
-        }
-
-        //
-        //  With the "regular" environment done, go through and write a new
-        //  section for current directories on alternate drives.  These are
-        //  part of the environment but inexpressible in the INI format as
-        //  regular entries, so they get their own section.
-        //
-
-        ThisPair = Env.StartOfString;
-        while (*ThisPair != '\0') {
-            ThisVar = ThisPair;
-            ThisPair += _tcslen(ThisPair) + 1;
-
-            if (ThisVar[0] == '=' &&
-                ((ThisVar[1] >= 'A' && ThisVar[1] <= 'Z') ||
-                 (ThisVar[1] >= 'a' && ThisVar[1] <= 'z')) &&
-                ThisVar[2] == ':' &&
-                ThisVar[3] == '=') {
-
-                ThisValue = &ThisVar[3];
-                ThisVar++;
-                ThisValue[0] = '\0';
-                ThisValue++;
-
-                WritePrivateProfileString(_T("CurrentDirectories"), ThisVar, ThisValue, RestartFileName.StartOfString);
-
-                ThisValue--;
-                ThisValue[0] = '=';
-            }
-        }
-
+        YoriShAddRestartStringsSection(&Buffer, YoriShRestartSectionEnvironment, &Env);
         YoriLibFreeStringContents(&Env);
     }
 
@@ -309,45 +870,16 @@ YoriShSaveRestartStateWorker(
     //
 
     if (YoriShGetAliasStrings(YORI_SH_GET_ALIAS_STRINGS_INCLUDE_USER, &Env)) {
-        LPTSTR ThisPair;
-        LPTSTR ThisVar;
-        LPTSTR ThisValue;
-
-        ThisPair = Env.StartOfString;
-        while (*ThisPair != '\0') {
-            ThisVar = ThisPair;
-            ThisPair += _tcslen(ThisPair) + 1;
-            if (ThisVar[0] != '=') {
-                ThisValue = _tcschr(ThisVar, '=');
-                if (ThisValue) {
-                    ThisValue[0] = '\0';
-                    ThisValue++;
-
-                    WritePrivateProfileString(_T("Aliases"), ThisVar, ThisValue, RestartFileName.StartOfString);
-                }
-            }
-        }
-
+        YoriShAddRestartStringsSection(&Buffer, YoriShRestartSectionAliases, &Env);
         YoriLibFreeStringContents(&Env);
     }
 
     //
-    //  Write history.  We only care about values here but want to maintain
-    //  sort order, so zero prefix count to use as a key.
+    //  Write history.
     //
 
     if (YoriShGetHistoryStrings(100, &Env)) {
-        LPTSTR ThisValue;
-
-        ThisValue = Env.StartOfString;
-        Count = 1;
-        while (*ThisValue != '\0') {
-            YoriLibSPrintf(WriteBuffer.StartOfString, _T("%03i"), Count);
-            WritePrivateProfileString(_T("History"), WriteBuffer.StartOfString, ThisValue, RestartFileName.StartOfString);
-            ThisValue += _tcslen(ThisValue) + 1;
-            Count++;
-        }
-
+        YoriShAddRestartStringsSection(&Buffer, YoriShRestartSectionHistory, &Env);
         YoriLibFreeStringContents(&Env);
     }
 
@@ -355,37 +887,20 @@ YoriShSaveRestartStateWorker(
     //  Write the window contents
     //
 
-    if (YoriLibAllocateString(&RestartBufferFileName, RestartFileName.LengthAllocated)) {
+    YoriShAddRestartContentsSection(&Buffer, LineCount);
 
-        HANDLE hBufferFile;
-
-        memcpy(RestartBufferFileName.StartOfString, RestartFileName.StartOfString, RestartFileName.LengthInChars * sizeof(TCHAR));
-        RestartBufferFileName.LengthInChars = RestartFileName.LengthInChars;
-        YoriLibSPrintf(RestartBufferFileName.StartOfString + RestartBufferFileName.LengthInChars,
-                       _T("\\yori-restart-%x.txt"),
-                       GetCurrentProcessId());
-
-        hBufferFile = CreateFile(RestartBufferFileName.StartOfString,
-                                 GENERIC_WRITE,
-                                 FILE_SHARE_READ | FILE_SHARE_DELETE,
-                                 NULL,
-                                 CREATE_ALWAYS,
-                                 FILE_ATTRIBUTE_NORMAL,
-                                 NULL);
-
-        if (hBufferFile != INVALID_HANDLE_VALUE) {
-            YoriLibRewriteConsoleContents(hBufferFile, LineCount, 0);
-            WritePrivateProfileString(_T("Window"), _T("Contents"), RestartBufferFileName.StartOfString, RestartFileName.StartOfString);
-            CloseHandle(hBufferFile);
-        }
+    if (!Buffer.AllocationFailed) {
+        YoriShWriteRestartBuffer(&Buffer);
+    }
 
-        YoriLibFreeStringContents(&RestartBufferFileName);
+    if (Buffer.Buffer != NULL) {
+        YoriLibFree(Buffer.Buffer);
     }
 
     //
     //  Register the process to be restarted on failure
     //
-    
+
     if (!YoriShProcessRegisteredForRestart) {
         YoriLibSPrintf(WriteBuffer.StartOfString, _T("-restart %x"), GetCurrentProcessId());
 
@@ -393,7 +908,6 @@ YoriShSaveRestartStateWorker(
         YoriShProcessRegisteredForRestart = TRUE;
     }
 
-    YoriLibFreeStringContents(&RestartFileName);
     YoriLibFreeStringContents(&WriteBuffer);
 
     return 0;
@@ -448,6 +962,204 @@ YoriShCleanupRestartSaveThreadIfCompleted()
     }
 }
 
+/**
+ Find a section within a mapped restart state file.
+
+ @param View Pointer to the mapped restart state file.  The header is
+        assumed to have been validated.
+
+ @param FileSize The size of the restart state file, in bytes.
+
+ @param Type The type of the section to find.
+
+ @param LengthInBytes On successful completion, updated to contain the number
+        of bytes of data in the section.
+
+ @return Pointer to the section data, or NULL if the section is not present.
+ */
+PUCHAR
+YoriShFindRestartSection(
+    __in PUCHAR View,
+    __in DWORD FileSize,
+    __in YORI_SH_RESTART_SECTION_TYPE Type,
+    __out PDWORD LengthInBytes
+    )
+{
+    PYORI_SH_RESTART_HEADER Header;
+    PYORI_SH_RESTART_SECTION Section;
+    DWORD Offset;
+    DWORD Index;
+
+    Header = (PYORI_SH_RESTART_HEADER)View;
+    Offset = Header->HeaderSize;
+
+    for (Index = 0; Index < Header->SectionCount; Index++) {
+        if (Offset > FileSize || FileSize - Offset < sizeof(YORI_SH_RESTART_SECTION)) {
+            break;
+        }
+
+        Section = (PYORI_SH_RESTART_SECTION)(View + Offset);
+        Offset += sizeof(YORI_SH_RESTART_SECTION);
+        if (Section->LengthInBytes > FileSize - Offset) {
+            break;
+        }
+
+        if (Section->Type == (DWORD)Type) {
+            *LengthInBytes = Section->LengthInBytes;
+            return View + Offset;
+        }
+
+        Offset += Section->LengthInBytes;
+        if (Offset % sizeof(DWORD) != 0) {
+            Offset += sizeof(DWORD) - (Offset % sizeof(DWORD));
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ Copy a section from a mapped restart state file into a string.  A NULL
+ terminator is added, and for sections containing a set of NULL terminated
+ strings, this forms the terminator for the set.
+
+ @param View Pointer to the mapped restart state file.
+
+ @param FileSize The size of the restart state file, in bytes.
+
+ @param Type The type of the section to copy.
+
+ @param String On successful completion, updated to contain the section.
+        This string is reallocated if it is not large enough.
+
+ @return TRUE if the section was found and copied, FALSE if not.
+ */
+BOOL
+YoriShCopyRestartSection(
+    __in PUCHAR View,
+    __in DWORD FileSize,
+    __in YORI_SH_RESTART_SECTION_TYPE Type,
+    __inout PYORI_STRING String
+    )
+{
+    PUCHAR SectionData;
+    DWORD LengthInBytes;
+    DWORD LengthInChars;
+
+    SectionData = YoriShFindRestartSection(View, FileSize, Type, &LengthInBytes);
+    if (SectionData == NULL) {
+        return FALSE;
+    }
+
+    LengthInChars = LengthInBytes / sizeof(TCHAR);
+    if (String->LengthAllocated < LengthInChars + 2) {
+        YoriLibFreeStringContents(String);
+        if (!YoriLibAllocateString(String, LengthInChars + 2)) {
+            return FALSE;
+        }
+    }
+
+    memcpy(String->StartOfString, SectionData, LengthInChars * sizeof(TCHAR));
+    String->StartOfString[LengthInChars] = '\0';
+    String->StartOfString[LengthInChars + 1] = '\0';
+    String->LengthInChars = LengthInChars;
+    return TRUE;
+}
+
+/**
+ Display window contents recorded in a mapped restart state file.
+
+ @param View Pointer to the mapped restart state file.
+
+ @param FileSize The size of the restart state file, in bytes.
+ */
+VOID
+YoriShDisplayRestartContents(
+    __in PUCHAR View,
+    __in DWORD FileSize
+    )
+{
+    PYORI_SH_RESTART_CONTENTS Contents;
+    PYORI_SH_RESTART_CELL_RUN Runs;
+    YORI_STRING Output;
+    YORI_STRING EscapeString;
+    TCHAR EscapeStringBuffer[YORI_MAX_INTERNAL_VT_ESCAPE_CHARS];
+    DWORD LengthInBytes;
+    DWORD CellCount;
+    DWORD CharsNeeded;
+    DWORD Index;
+    WORD LastAttribute;
+    WORD RunIndex;
+
+    Contents = (PYORI_SH_RESTART_CONTENTS)YoriShFindRestartSection(View, FileSize, YoriShRestartSectionContents, &LengthInBytes);
+    if (Contents == NULL || LengthInBytes < sizeof(YORI_SH_RESTART_CONTENTS)) {
+        return;
+    }
+
+    if (Contents->RunCount == 0 ||
+        Contents->RunCount > (LengthInBytes - sizeof(YORI_SH_RESTART_CONTENTS)) / sizeof(YORI_SH_RESTART_CELL_RUN)) {
+
+        return;
+    }
+
+    Runs = (PYORI_SH_RESTART_CELL_RUN)(Contents + 1);
+
+    YoriLibInitEmptyString(&EscapeString);
+    EscapeString.StartOfString = EscapeStringBuffer;
+    EscapeString.LengthAllocated = sizeof(EscapeStringBuffer)/sizeof(EscapeStringBuffer[0]);
+
+    //
+    //  Check that the runs describe the expected number of cells and
+    //  calculate the size of the text including escapes for each change
+    //  in attribute.
+    //
+
+    CellCount = 0;
+    CharsNeeded = 1;
+    LastAttribute = (WORD)~(Runs[0].Attributes);
+    for (Index = 0; Index < Contents->RunCount; Index++) {
+        CellCount += Runs[Index].RunLength;
+        CharsNeeded += Runs[Index].RunLength;
+        if (Runs[Index].Attributes != LastAttribute) {
+            LastAttribute = Runs[Index].Attributes;
+            YoriLibVtStringForTextAttribute(&EscapeString, 0, LastAttribute);
+            CharsNeeded += EscapeString.LengthInChars;
+        }
+    }
+
+    if (CellCount != (DWORD)Contents->Width * Contents->Height) {
+        return;
+    }
+
+    if (!YoriLibAllocateString(&Output, CharsNeeded)) {
+        return;
+    }
+
+    //
+    //  Lines are not separated by newlines because each line occupies the
+    //  full width of the buffer, so the console moves to the next line
+    //  after the final cell of each.
+    //
+
+    Output.LengthInChars = 0;
+    LastAttribute = (WORD)~(Runs[0].Attributes);
+    for (Index = 0; Index < Contents->RunCount; Index++) {
+        if (Runs[Index].Attributes != LastAttribute) {
+            LastAttribute = Runs[Index].Attributes;
+            YoriLibVtStringForTextAttribute(&EscapeString, 0, LastAttribute);
+            memcpy(&Output.StartOfString[Output.LengthInChars], EscapeString.StartOfString, EscapeString.LengthInChars * sizeof(TCHAR));
+            Output.LengthInChars += EscapeString.LengthInChars;
+        }
+        for (RunIndex = 0; RunIndex < Runs[Index].RunLength; RunIndex++) {
+            Output.StartOfString[Output.LengthInChars] = Runs[Index].Char;
+            Output.LengthInChars++;
+        }
+    }
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &Output);
+    YoriLibFreeStringContents(&Output);
+}
+
 /**
  Try to recover a previous process ID that terminated unexpectedly.
 
@@ -465,6 +1177,14 @@ YoriShLoadSavedRestartState(
     YORI_CONSOLE_SCREEN_BUFFER_INFOEX ScreenBufferInfo;
     DWORD Count;
     YORI_CONSOLE_FONT_INFOEX FontInfo;
+    PYORI_SH_RESTART_HEADER Header;
+    PYORI_SH_RESTART_WINDOW Window;
+    HANDLE hFile;
+    HANDLE hMapping;
+    PUCHAR View;
+    DWORD FileSize;
+    DWORD FileSizeHigh;
+    DWORD LengthInBytes;
 
     if (DllKernel32.pSetConsoleScreenBufferInfoEx == NULL ||
         DllKernel32.pSetCurrentConsoleFontEx == NULL) {
@@ -473,74 +1193,123 @@ YoriShLoadSavedRestartState(
     }
 
 
-    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.ini") + 2 * sizeof(DWORD))) {
+    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.dat") + 2 * sizeof(DWORD))) {
         return FALSE;
     }
 
-    ZeroMemory(&ScreenBufferInfo, sizeof(ScreenBufferInfo));
-    ScreenBufferInfo.cbSize = sizeof(ScreenBufferInfo);
-
     YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                   _T("\\yori-restart-%y.ini"),
+                   _T("\\yori-restart-%y.dat"),
                    ProcessId);
 
+    //
+    //  Map the restart state into memory and check that it's a version that
+    //  is understood.
+    //
+
+    hFile = CreateFile(RestartFileName.StartOfString,
+                       GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL,
+                       NULL);
+
+    YoriLibFreeStringContents(&RestartFileName);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    FileSize = GetFileSize(hFile, &FileSizeHigh);
+    if (FileSize == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        CloseHandle(hFile);
+        return FALSE;
+    }
+
+    if (FileSizeHigh != 0 ||
+        FileSize > YORI_SH_RESTART_MAX_FILE_SIZE ||
+        FileSize < sizeof(YORI_SH_RESTART_HEADER)) {
+
+        CloseHandle(hFile);
+        return FALSE;
+    }
+
+    hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+    if (hMapping == NULL) {
+        return FALSE;
+    }
+
+    View = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (View == NULL) {
+        return FALSE;
+    }
+
+    Header = (PYORI_SH_RESTART_HEADER)View;
+    if (Header->Signature != YORI_SH_RESTART_SIGNATURE ||
+        Header->Version != YORI_SH_RESTART_VERSION ||
+        Header->HeaderSize < sizeof(YORI_SH_RESTART_HEADER) ||
+        Header->HeaderSize > FileSize) {
+
+        UnmapViewOfFile(View);
+        return FALSE;
+    }
+
     //
     //  Read and populate window settings
     //
 
-    ScreenBufferInfo.dwSize.X = (USHORT)GetPrivateProfileInt(_T("Window"), _T("BufferWidth"), 0, RestartFileName.StartOfString);
-    ScreenBufferInfo.dwSize.Y = (USHORT)GetPrivateProfileInt(_T("Window"), _T("BufferHeight"), 0, RestartFileName.StartOfString);
+    Window = (PYORI_SH_RESTART_WINDOW)YoriShFindRestartSection(View, FileSize, YoriShRestartSectionWindow, &LengthInBytes);
+    if (Window == NULL || LengthInBytes < sizeof(YORI_SH_RESTART_WINDOW)) {
+        UnmapViewOfFile(View);
+        return FALSE;
+    }
+
+    ZeroMemory(&ScreenBufferInfo, sizeof(ScreenBufferInfo));
+    ScreenBufferInfo.cbSize = sizeof(ScreenBufferInfo);
+
+    ScreenBufferInfo.dwSize.X = Window->BufferWidth;
+    ScreenBufferInfo.dwSize.Y = Window->BufferHeight;
 
     if (ScreenBufferInfo.dwSize.X == 0 || ScreenBufferInfo.dwSize.Y == 0) {
-        YoriLibFreeStringContents(&RestartFileName);
+        UnmapViewOfFile(View);
         return FALSE;
     }
 
-    ScreenBufferInfo.dwMaximumWindowSize.X = (USHORT)GetPrivateProfileInt(_T("Window"), _T("WindowWidth"), 0, RestartFileName.StartOfString);
-    ScreenBufferInfo.dwMaximumWindowSize.Y = (USHORT)GetPrivateProfileInt(_T("Window"), _T("WindowHeight"), 0, RestartFileName.StartOfString);
+    ScreenBufferInfo.dwMaximumWindowSize.X = Window->WindowWidth;
+    ScreenBufferInfo.dwMaximumWindowSize.Y = Window->WindowHeight;
 
     if (ScreenBufferInfo.dwMaximumWindowSize.X == 0 || ScreenBufferInfo.dwMaximumWindowSize.Y == 0) {
-        YoriLibFreeStringContents(&RestartFileName);
+        UnmapViewOfFile(View);
         return FALSE;
     }
 
     ScreenBufferInfo.srWindow.Bottom = (USHORT)(ScreenBufferInfo.dwMaximumWindowSize.Y - 1);
     ScreenBufferInfo.srWindow.Right = (USHORT)(ScreenBufferInfo.dwMaximumWindowSize.X);
 
-    ScreenBufferInfo.wAttributes = (USHORT)GetPrivateProfileInt(_T("Window"), _T("DefaultColor"), 0, RestartFileName.StartOfString);
-    ScreenBufferInfo.wPopupAttributes = (USHORT)GetPrivateProfileInt(_T("Window"), _T("PopupColor"), 0, RestartFileName.StartOfString);
+    ScreenBufferInfo.wAttributes = Window->DefaultColor;
+    ScreenBufferInfo.wPopupAttributes = Window->PopupColor;
 
     for (Count = 0; Count < sizeof(ScreenBufferInfo.ColorTable)/sizeof(ScreenBufferInfo.ColorTable[0]); Count++) {
-        TCHAR ColorName[32];
-        YoriLibSPrintf(ColorName, _T("Color%i"), Count);
-        ScreenBufferInfo.ColorTable[Count] = GetPrivateProfileInt(_T("Window"), ColorName, 0, RestartFileName.StartOfString);
+        ScreenBufferInfo.ColorTable[Count] = Window->ColorTable[Count];
     }
 
     YoriLibVtSetDefaultColor(ScreenBufferInfo.wAttributes);
 
-
-    //
-    //  Apparently GetConsoleTitle can't tell us how much memory it needs, but
-    //  it needs less than 64Kb
-    //
-
-    if (!YoriLibAllocateString(&ReadBuffer, 64 * 1024)) {
-        YoriLibFreeStringContents(&RestartFileName);
-        return FALSE;
-    }
-
     //
     //  Read and populate window fonts
     //
 
     ZeroMemory(&FontInfo, sizeof(FontInfo));
     FontInfo.cbSize = sizeof(FontInfo);
-    FontInfo.nFont = GetPrivateProfileInt(_T("Window"), _T("FontIndex"), 0, RestartFileName.StartOfString);
-    FontInfo.dwFontSize.X = (USHORT)GetPrivateProfileInt(_T("Window"), _T("FontWidth"), 0, RestartFileName.StartOfString);
-    FontInfo.dwFontSize.Y = (USHORT)GetPrivateProfileInt(_T("Window"), _T("FontHeight"), 0, RestartFileName.StartOfString);
-    FontInfo.FontFamily = GetPrivateProfileInt(_T("Window"), _T("FontFamily"), 0, RestartFileName.StartOfString);
-    FontInfo.FontWeight = GetPrivateProfileInt(_T("Window"), _T("FontWeight"), 0, RestartFileName.StartOfString);
-    GetPrivateProfileString(_T("Window"), _T("FontName"), _T(""), FontInfo.FaceName, sizeof(FontInfo.FaceName)/sizeof(FontInfo.FaceName[0]), RestartFileName.StartOfString);
+    FontInfo.nFont = Window->FontIndex;
+    FontInfo.dwFontSize.X = Window->FontWidth;
+    FontInfo.dwFontSize.Y = Window->FontHeight;
+    FontInfo.FontFamily = Window->FontFamily;
+    FontInfo.FontWeight = Window->FontWeight;
+    memcpy(FontInfo.FaceName, Window->FontName, sizeof(FontInfo.FaceName));
+    FontInfo.FaceName[LF_FACESIZE - 1] = '\0';
 
     if (FontInfo.dwFontSize.X > 0 && FontInfo.dwFontSize.Y > 0 && FontInfo.FontWeight > 0) {
         DllKernel32.pSetCurrentConsoleFontEx(GetStdHandle(STD_OUTPUT_HANDLE), FALSE, &FontInfo);
@@ -548,29 +1317,34 @@ YoriShLoadSavedRestartState(
 
     DllKernel32.pSetConsoleScreenBufferInfoEx(GetStdHandle(STD_OUTPUT_HANDLE), &ScreenBufferInfo);
 
+    YoriLibInitEmptyString(&ReadBuffer);
+
     //
     //  Read and populate the window title
     //
 
-    GetPrivateProfileString(_T("Window"), _T("Title"), _T("Yori"), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-    SetConsoleTitle(ReadBuffer.StartOfString);
+    if (YoriShCopyRestartSection(View, FileSize, YoriShRestartSectionTitle, &ReadBuffer)) {
+        SetConsoleTitle(ReadBuffer.StartOfString);
+    } else {
+        SetConsoleTitle(_T("Yori"));
+    }
 
     //
     //  Read and populate the current directory
     //
 
-    ReadBuffer.LengthInChars = GetPrivateProfileString(_T("Window"), _T("CurrentDirectory"), _T(""), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-    if (ReadBuffer.LengthInChars > 0) {
+    if (YoriShCopyRestartSection(View, FileSize, YoriShRestartSectionCurrentDirectory, &ReadBuffer) &&
+        ReadBuffer.LengthInChars > 0) {
+
         SetCurrentDirectory(ReadBuffer.StartOfString);
     }
 
     //
-    //  Populate the environment.
+    //  Populate the environment, including current directories on
+    //  alternate drives.
     //
 
-    ReadBuffer.LengthInChars = GetPrivateProfileSection(_T("Environment"), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-
-    if (ReadBuffer.LengthInChars > 0) {
+    if (YoriShCopyRestartSection(View, FileSize, YoriShRestartSectionEnvironment, &ReadBuffer)) {
         LPTSTR ThisPair;
         LPTSTR ThisVar;
         LPTSTR ThisValue;
@@ -579,58 +1353,35 @@ YoriShLoadSavedRestartState(
         while (*ThisPair != '\0') {
             ThisVar = ThisPair;
             ThisPair += _tcslen(ThisPair) + 1;
-            if (ThisVar[0] != '=') {
-                ThisValue = _tcschr(ThisVar, '=');
-                if (ThisValue) {
-                    ThisValue[0] = '\0';
-                    ThisValue++;
-
-                    SetEnvironmentVariable(ThisVar, ThisValue);
-                }
-            }
-        }
-    }
 
-    //
-    //  Populate current directories.
-    //
+            if (ThisVar[0] == '=') {
+                if (((ThisVar[1] >= 'A' && ThisVar[1] <= 'Z') ||
+                     (ThisVar[1] >= 'a' && ThisVar[1] <= 'z')) &&
+                    ThisVar[2] == ':' &&
+                    ThisVar[3] == '=') {
 
-    ReadBuffer.LengthInChars = GetPrivateProfileSection(_T("CurrentDirectories"), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-
-    if (ReadBuffer.LengthInChars > 0) {
-        LPTSTR ThisPair;
-        LPTSTR ThisVar;
-        LPTSTR ThisValue;
-        TCHAR DriveLetterBuffer[sizeof("=C:")];
-
-        ThisPair = ReadBuffer.StartOfString;
-        while (*ThisPair != '\0') {
-            ThisVar = ThisPair;
-            ThisPair += _tcslen(ThisPair) + 1;
-            if (ThisVar[0] != '=') {
+                    ThisVar[3] = '\0';
+                    SetEnvironmentVariable(ThisVar, &ThisVar[4]);
+                }
+            } else {
                 ThisValue = _tcschr(ThisVar, '=');
                 if (ThisValue) {
                     ThisValue[0] = '\0';
                     ThisValue++;
 
-                    DriveLetterBuffer[0] = '=';
-                    DriveLetterBuffer[1] = ThisVar[0];
-                    DriveLetterBuffer[2] = ':';
-                    DriveLetterBuffer[3] = '\0';
-
-                    SetEnvironmentVariable(DriveLetterBuffer, ThisValue);
+                    SetEnvironmentVariable(ThisVar, ThisValue);
                 }
             }
         }
+
+        YoriShGlobal.EnvironmentGeneration++;
     }
 
     //
     //  Populate aliases
     //
 
-    ReadBuffer.LengthInChars = GetPrivateProfileSection(_T("Aliases"), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-
-    if (ReadBuffer.LengthInChars > 0) {
+    if (YoriShCopyRestartSection(View, FileSize, YoriShRestartSectionAliases, &ReadBuffer)) {
         LPTSTR ThisPair;
         LPTSTR ThisVar;
         LPTSTR ThisValue;
@@ -655,35 +1406,23 @@ YoriShLoadSavedRestartState(
     //  Populate history
     //
 
-    ReadBuffer.LengthInChars = GetPrivateProfileSection(_T("History"), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-
-    if (ReadBuffer.LengthInChars > 0) {
-        LPTSTR ThisPair;
-        LPTSTR ThisVar;
+    if (YoriShCopyRestartSection(View, FileSize, YoriShRestartSectionHistory, &ReadBuffer)) {
         LPTSTR ThisValue;
         YORI_STRING ThisEntry;
         DWORD ValueLength;
 
         YoriShInitHistory();
 
-        ThisPair = ReadBuffer.StartOfString;
-        while (*ThisPair != '\0') {
-            ThisVar = ThisPair;
-            ThisPair += _tcslen(ThisPair) + 1;
-            if (ThisVar[0] != '=') {
-                ThisValue = _tcschr(ThisVar, '=');
-                if (ThisValue) {
-                    ThisValue[0] = '\0';
-                    ThisValue++;
-                    ValueLength = _tcslen(ThisValue);
-                    if (YoriLibAllocateString(&ThisEntry, ValueLength + 1)) {
-                        memcpy(ThisEntry.StartOfString, ThisValue, (ValueLength + 1) * sizeof(TCHAR));
-                        ThisEntry.LengthInChars = ValueLength;
+        ThisValue = ReadBuffer.StartOfString;
+        while (*ThisValue != '\0') {
+            ValueLength = (DWORD)_tcslen(ThisValue);
+            if (YoriLibAllocateString(&ThisEntry, ValueLength + 1)) {
+                memcpy(ThisEntry.StartOfString, ThisValue, (ValueLength + 1) * sizeof(TCHAR));
+                ThisEntry.LengthInChars = ValueLength;
 
-                        YoriShAddToHistory(&ThisEntry, FALSE);
-                    }
-                }
+                YoriShAddToHistory(&ThisEntry, FALSE);
             }
+            ThisValue += ValueLength + 1;
         }
     }
 
@@ -691,38 +1430,10 @@ YoriShLoadSavedRestartState(
     //  Populate window contents
     //
 
-    ReadBuffer.LengthInChars = GetPrivateProfileString(_T("Window"), _T("Contents"), _T(""), ReadBuffer.StartOfString, ReadBuffer.LengthAllocated, RestartFileName.StartOfString);
-
-    if (ReadBuffer.LengthInChars > 0) {
-        HANDLE hBufferFile;
-
-        hBufferFile = CreateFile(ReadBuffer.StartOfString,
-                                 GENERIC_READ,
-                                 FILE_SHARE_READ | FILE_SHARE_DELETE,
-                                 NULL,
-                                 OPEN_EXISTING,
-                                 FILE_ATTRIBUTE_NORMAL,
-                                 NULL);
-
-        if (hBufferFile != INVALID_HANDLE_VALUE) {
-            YORI_STRING LineString;
-            PVOID LineContext = NULL;
-            YoriLibInitEmptyString(&LineString);
-            while (TRUE) {
-                if (!YoriLibReadLineToString(&LineString, &LineContext, hBufferFile)) {
-                    break;
-                }
-
-                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &LineString);
-            }
-            YoriLibLineReadClose(LineContext);
-            YoriLibFreeStringContents(&LineString);
-            CloseHandle(hBufferFile);
-        }
-    }
+    YoriShDisplayRestartContents(View, FileSize);
 
+    UnmapViewOfFile(View);
     YoriLibFreeStringContents(&ReadBuffer);
-    YoriLibFreeStringContents(&RestartFileName);
 
     return TRUE;
 }
@@ -747,17 +1458,17 @@ YoriShDiscardSavedRestartState(
         YoriShGlobal.RestartSaveThread = NULL;
     }
 
-    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.ini") + 2 * sizeof(DWORD))) {
+    if (!YoriShGetTempPath(&RestartFileName, sizeof("\\yori-restart-.dat") + 2 * sizeof(DWORD))) {
         return;
     }
 
     if (ProcessId != NULL) {
         YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                       _T("\\yori-restart-%y.ini"),
+                       _T("\\yori-restart-%y.dat"),
                        ProcessId);
     } else {
         YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                       _T("\\yori-restart-%x.ini"),
+                       _T("\\yori-restart-%x.dat"),
                        GetCurrentProcessId());
     }
 
@@ -765,11 +1476,11 @@ YoriShDiscardSavedRestartState(
 
     if (ProcessId != NULL) {
         YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                       _T("\\yori-restart-%y.txt"),
+                       _T("\\yori-restart-%y.tmp"),
                        ProcessId);
     } else {
         YoriLibSPrintf(RestartFileName.StartOfString + RestartFileName.LengthInChars,
-                       _T("\\yori-restart-%x.txt"),
+                       _T("\\yori-restart-%x.tmp"),
                        GetCurrentProcessId());
     }
 
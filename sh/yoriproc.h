@@ -120,6 +120,16 @@ YoriShBuckPassToCmd (
     ...
     );
 
+__success(return)
+BOOL
+YoriShGetModuleInformation(
+    __in DWORD Index,
+    __inout PYORI_STRING ModuleName,
+    __out PDWORD ReferenceCount,
+    __out PDWORD UseCount,
+    __out PDWORD LoadTimeInMicroseconds
+    );
+
 __success(return)
 BOOL
 YoriShExecuteNamedModuleInProc(
@@ -281,6 +291,17 @@ YoriShCompleteSuggestion(
     __inout PYORI_SH_INPUT_BUFFER Buffer
     );
 
+VOID
+YoriShPrefetchTabCompletion(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    );
+
+VOID
+YoriShResetTabCompletionPrefetch(VOID);
+
+VOID
+YoriShCleanupTabCompletionCache(VOID);
+
 // *** ENV.C ***
 
 BOOL
@@ -288,6 +309,15 @@ YoriShIsEnvironmentVariableChar(
     __in TCHAR Char
     );
 
+PVOID
+YoriShReferenceEnvironmentBlock(VOID);
+
+VOID
+YoriShCheckForEnvironmentChange(VOID);
+
+VOID
+YoriShFreeEnvironmentCache(VOID);
+
 DWORD
 YoriShGetEnvironmentVariableWithoutSubstitution(
     __in LPCTSTR Name,
@@ -372,6 +402,37 @@ __success(return)
 BOOL
 YoriShExpandBackquotes(
     __in PYORI_STRING Expression,
+    __in DWORD CacheLifetime,
+    __out PYORI_STRING ResultingExpression
+    );
+
+VOID
+YoriShFreeBackquoteCache();
+
+__success(return)
+BOOL
+YoriShLaunchBackquoteConcurrently(
+    __in PYORI_STRING Expression,
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    );
+
+VOID
+YoriShCompleteConcurrentBackquote(
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    );
+
+VOID
+YoriShCancelConcurrentBackquote(
+    __inout PYORI_SH_BACKQUOTE_EVALUATION Evaluation
+    );
+
+__success(return)
+BOOL
+YoriShSubstituteBackquoteOutput(
+    __in PYORI_STRING Expression,
+    __in PYORI_SH_BACKQUOTE_SUBSTRING Substrings,
+    __in PYORI_SH_BACKQUOTE_EVALUATION Evaluations,
+    __in DWORD SubstringCount,
     __out PYORI_STRING ResultingExpression
     );
 
@@ -381,6 +442,24 @@ YoriShExecuteExpression(
     __in PYORI_STRING Expression
     );
 
+__success(return)
+BOOL
+YoriShParseExpression(
+    __in PYORI_STRING Expression,
+    __out PVOID * ParsedExpression
+    );
+
+__success(return)
+BOOL
+YoriShExecuteParsedExpression(
+    __in PVOID ParsedExpression
+    );
+
+VOID
+YoriShFreeParsedExpression(
+    __in PVOID ParsedExpression
+    );
+
 // *** HISTORY.C ***
 
 __success(return)
@@ -416,6 +495,14 @@ __success(return)
 BOOL
 YoriShSaveHistoryToFile();
 
+__success(return)
+BOOL
+YoriShFindHistoryPrefixMatches(
+    __in PYORI_STRING Prefix,
+    __out PYORI_SH_HISTORY_ENTRY **Matches,
+    __out PDWORD MatchCount
+    );
+
 __success(return)
 BOOL
 YoriShGetHistoryStrings(
@@ -464,6 +551,17 @@ YoriShScanJobsReportCompletion(
     __in BOOL TeardownAll
     );
 
+HANDLE
+YoriShGetJobCompletionEvent(VOID);
+
+BOOL
+YoriShAreJobCompletionsQueued(VOID);
+
+BOOL
+YoriShReportQueuedJobCompletions(
+    __in BOOL Quiet
+    );
+
 DWORD
 YoriShGetNextJobId(
     __in DWORD PreviousJobId
@@ -522,6 +620,11 @@ YoriShPreCommand(
 
 // *** PARSE.C ***
 
+VOID
+YoriShExpandEnvironmentInCmdContext(
+    __inout PYORI_SH_CMD_CONTEXT CmdContext
+    );
+
 __success(return)
 BOOLEAN
 YoriShParseCmdlineToCmdContext(
@@ -621,6 +724,14 @@ YoriShFindNextBackquoteSubstring(
     __out PDWORD CharsInPrefix
     );
 
+__success(return)
+BOOL
+YoriShFindDeepestBackquoteSubstrings(
+    __in PYORI_STRING String,
+    __out PYORI_SH_BACKQUOTE_SUBSTRING * Substrings,
+    __out PDWORD SubstringCount
+    );
+
 __success(return)
 BOOL
 YoriShFindBestBackquoteSubstringAtOffset(
@@ -629,10 +740,52 @@ YoriShFindBestBackquoteSubstringAtOffset(
     __out PYORI_STRING CurrentSubset
     );
 
+// *** PROFILE.C ***
+
+VOID
+YoriShProfileEnable(VOID);
+
+BOOL
+YoriShProfileIsActive(VOID);
+
+PVOID
+YoriShProfileBegin(
+    __in YORI_SH_PROFILE_TYPE Type,
+    __in PYORI_STRING Name
+    );
+
+VOID
+YoriShProfileEnd(
+    __in_opt PVOID Handle
+    );
+
+VOID
+YoriShProfileReport(VOID);
+
 // *** PROMPT.C ***
+DWORD
+YoriShGetPromptCacheLifetime();
+
+VOID
+YoriShCleanupPromptSegments();
+
+BOOL
+YoriShPromptSegmentsPending();
+
+BOOL
+YoriShCollectPromptSegments(
+    __out_opt PBOOL OutputChanged
+    );
+
+DWORD
+YoriShGetPromptCellsDisplayed();
+
 BOOL
 YoriShDisplayPrompt();
 
+BOOL
+YoriShRedrawPrompt();
+
 BOOL
 YoriShExecPreCommandString();
 
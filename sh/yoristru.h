@@ -417,6 +417,66 @@ typedef struct _YORI_SH_EXEC_PLAN {
 
 } YORI_SH_EXEC_PLAN, *PYORI_SH_EXEC_PLAN;
 
+/**
+ A backquoted substring within an expression which is ready to execute.
+ */
+typedef struct _YORI_SH_BACKQUOTE_SUBSTRING {
+
+    /**
+     The substring to execute.  This shares an allocation with the
+     expression, is not referenced and is not NULL terminated.
+     */
+    YORI_STRING String;
+
+    /**
+     The number of characters immediately before String that were used to
+     indicate its commencement.  The substring is always terminated by a
+     single character.
+     */
+    DWORD CharsInPrefix;
+
+} YORI_SH_BACKQUOTE_SUBSTRING, *PYORI_SH_BACKQUOTE_SUBSTRING;
+
+/**
+ State for a single backquoted expression while a set of expressions is
+ being evaluated.
+ */
+typedef struct _YORI_SH_BACKQUOTE_EVALUATION {
+
+    /**
+     The parsed form of the expression.  This is only meaningful if
+     Launched is TRUE.
+     */
+    YORI_SH_CMD_CONTEXT CmdContext;
+
+    /**
+     The plan to execute the expression.  This is only meaningful if
+     Launched is TRUE.
+     */
+    YORI_SH_EXEC_PLAN ExecPlan;
+
+    /**
+     The result of evaluating the expression.
+     */
+    YORI_STRING Output;
+
+    /**
+     TRUE if the expression has been started as a process that is executing
+     concurrently with other expressions, and needs to be waited on.
+     */
+    BOOLEAN Launched;
+
+    /**
+     TRUE if Output contains the result of the expression.
+     */
+    BOOLEAN Evaluated;
+
+    /**
+     TRUE if Output was obtained from the cache of previous results.
+     */
+    BOOLEAN FromCache;
+} YORI_SH_BACKQUOTE_EVALUATION, *PYORI_SH_BACKQUOTE_EVALUATION;
+
 /**
  Information about a previous command executed by the user.
  */
@@ -431,6 +491,12 @@ typedef struct _YORI_SH_HISTORY_ENTRY {
      The command that was executed by the user.
      */
     YORI_STRING CmdLine;
+
+    /**
+     A number which increases with each command added to history, used to
+     order entries found via the history index.
+     */
+    DWORD Sequence;
 } YORI_SH_HISTORY_ENTRY, *PYORI_SH_HISTORY_ENTRY;
 
 /**
@@ -475,6 +541,17 @@ typedef enum _YORI_SH_TAB_COMPLETE_SEARCH_TYPE {
     YoriTabCompleteSearchArguments = 4
 } YORI_SH_TAB_COMPLETE_SEARCH_TYPE;
 
+/**
+ The types of operation that can be timed when profiling shell startup.
+ */
+typedef enum _YORI_SH_PROFILE_TYPE {
+    YoriShProfileTypeScript = 0,
+    YoriShProfileTypeLine = 1,
+    YoriShProfileTypeProcess = 2,
+    YoriShProfileTypeModule = 3,
+    YoriShProfileTypeMax = 4
+} YORI_SH_PROFILE_TYPE;
+
 /**
  Information about the state of tab completion.
  */
@@ -606,6 +683,33 @@ typedef struct _YORI_SH_INPUT_BUFFER {
      */
     DWORD DirtyLength;
 
+    /**
+     The cells most recently written to the console for the input buffer,
+     the suggestion and any cleared cells following them, starting from the
+     beginning of the input buffer.  The next frame is compared against
+     this so that only cells which have changed are written.
+     */
+    PCHAR_INFO DisplayedCells;
+
+    /**
+     The cells being composed for the next frame.  Once written, this array
+     is exchanged with DisplayedCells.
+     */
+    PCHAR_INFO PendingCells;
+
+    /**
+     The number of elements allocated in each of DisplayedCells and
+     PendingCells.
+     */
+    DWORD CellsAllocated;
+
+    /**
+     The number of elements in DisplayedCells that are known to match the
+     console.  This is reset to zero when the console is changed by other
+     means, forcing the next frame to be written in full.
+     */
+    DWORD DisplayedCellsValid;
+
     /**
      TRUE if the input should be in insert mode, FALSE if it should be
      overwrite mode.
@@ -747,17 +851,48 @@ typedef struct _YORI_SH_DEFAULT_ALIAS_ENTRY {
 
 extern CONST YORI_SH_DEFAULT_ALIAS_ENTRY YoriShDefaultAliasEntries[];
 
+/**
+ The type of an object found through @ref YoriShBuiltinHash .  The hash
+ contains both builtin commands, keyed by command name, and loaded modules,
+ keyed by their full path, so that a single lookup can resolve either.
+ */
+typedef enum _YORI_SH_BUILTIN_HASH_TYPE {
+    YoriShBuiltinHashTypeCallback = 1,
+    YoriShBuiltinHashTypeModule = 2
+} YORI_SH_BUILTIN_HASH_TYPE;
+
 /**
  A structure containing information about a currently loaded DLL.
  */
 typedef struct _YORI_SH_LOADED_MODULE {
 
+    /**
+     The type of this object, which is always
+     YoriShBuiltinHashTypeModule.  This must be the first member so the
+     type of a hash entry's context can be determined.
+     */
+    YORI_SH_BUILTIN_HASH_TYPE HashType;
+
     /**
      The entry for this loaded module on the list of actively loaded
      modules.
      */
     YORI_LIST_ENTRY ListEntry;
 
+    /**
+     The hash entry for this module, keyed by DllName.  Paired with
+     @ref YoriShBuiltinHash .
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The entry for this module on the list of modules that are no longer
+     referenced but remain loaded so they can be reused quickly.  The list
+     is ordered from least to most recently used.  This is only linked
+     when ReferenceCount is zero.
+     */
+    YORI_LIST_ENTRY IdleListEntry;
+
     /**
      A string describing the DLL file name.
      */
@@ -777,6 +912,17 @@ typedef struct _YORI_SH_LOADED_MODULE {
      A handle to the DLL.
      */
     HANDLE ModuleHandle;
+
+    /**
+     The number of times this module has been located for execution,
+     including the initial load.
+     */
+    DWORD UseCount;
+
+    /**
+     The time spent loading the DLL, in microseconds.
+     */
+    DWORD LoadTimeInMicroseconds;
 } YORI_SH_LOADED_MODULE, *PYORI_SH_LOADED_MODULE;
 
 /**
@@ -784,6 +930,13 @@ typedef struct _YORI_SH_LOADED_MODULE {
  */
 typedef struct _YORI_SH_BUILTIN_CALLBACK {
 
+    /**
+     The type of this object, which is always
+     YoriShBuiltinHashTypeCallback.  This must be the first member so the
+     type of a hash entry's context can be determined.
+     */
+    YORI_SH_BUILTIN_HASH_TYPE HashType;
+
     /**
      Links between the registered builtin callbacks.
      */
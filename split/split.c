@@ -92,17 +92,22 @@ typedef struct _SPLIT_CONTEXT {
 } SPLIT_CONTEXT, *PSPLIT_CONTEXT;
 
 /**
- Open a file in which to output the result of a fragment of the split
- operation.
+ Open a file in which to output a fragment of the split operation.
 
- @param SplitContext Pointer to a context describing the split operation
-        and its current state.
+ @param Prefix Pointer to the prefix of part file names.
+
+ @param PartNumber The number of the part to open.
+
+ @param ExtraFlags Additional flags to pass when opening the file, such as
+        FILE_FLAG_OVERLAPPED.
 
  @return Handle to the opened object, or NULL on failure.
  */
 HANDLE
-SplitOpenTargetForCurrentPart(
-    __in PSPLIT_CONTEXT SplitContext
+SplitOpenTargetForPart(
+    __in PYORI_STRING Prefix,
+    __in LONGLONG PartNumber,
+    __in DWORD ExtraFlags
     )
 {
     LPTSTR NewFileName;
@@ -110,17 +115,17 @@ SplitOpenTargetForCurrentPart(
     HANDLE hDestFile;
 
     YoriLibInitEmptyString(&NumberString);
-    if (!YoriLibNumberToString(&NumberString, SplitContext->CurrentPartNumber, 10, 0, '\0')) {
+    if (!YoriLibNumberToString(&NumberString, PartNumber, 10, 0, '\0')) {
         return NULL;
     }
 
-    NewFileName = YoriLibMalloc((SplitContext->Prefix.LengthInChars + NumberString.LengthInChars + 1) * sizeof(TCHAR));
+    NewFileName = YoriLibMalloc((Prefix->LengthInChars + NumberString.LengthInChars + 1) * sizeof(TCHAR));
     if (NewFileName == NULL) {
         YoriLibFreeStringContents(&NumberString);
         return NULL;
     }
 
-    YoriLibSPrintf(NewFileName, _T("%y%y"), &SplitContext->Prefix, &NumberString);
+    YoriLibSPrintf(NewFileName, _T("%y%y"), Prefix, &NumberString);
     YoriLibFreeStringContents(&NumberString);
 
     hDestFile = CreateFile(NewFileName,
@@ -128,7 +133,7 @@ SplitOpenTargetForCurrentPart(
                            FILE_SHARE_READ|FILE_SHARE_DELETE,
                            NULL,
                            CREATE_ALWAYS,
-                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | ExtraFlags,
                            NULL);
     if (hDestFile == INVALID_HANDLE_VALUE) {
         DWORD LastError = GetLastError();
@@ -143,6 +148,764 @@ SplitOpenTargetForCurrentPart(
     return hDestFile;
 }
 
+/**
+ Open a file in which to output the result of a fragment of the split
+ operation.
+
+ @param SplitContext Pointer to a context describing the split operation
+        and its current state.
+
+ @return Handle to the opened object, or NULL on failure.
+ */
+HANDLE
+SplitOpenTargetForCurrentPart(
+    __in PSPLIT_CONTEXT SplitContext
+    )
+{
+    return SplitOpenTargetForPart(&SplitContext->Prefix, SplitContext->CurrentPartNumber, 0);
+}
+
+/**
+ The size of the buffer used by each thread when copying ranges between
+ files.
+ */
+#define SPLIT_COPY_BUFFER_SIZE (1024 * 1024)
+
+/**
+ The maximum number of threads to use when copying ranges between files.
+ Since the operation is bound by I/O, more threads than this are unlikely
+ to help.
+ */
+#define SPLIT_MAX_COPY_THREADS (8)
+
+/**
+ A single region of data to copy, which is either a part of a file being
+ split or a part being joined into a file.
+ */
+typedef struct _SPLIT_RANGE {
+
+    /**
+     The number of the part file that this range is written to or read
+     from.
+     */
+    LONGLONG PartNumber;
+
+    /**
+     The offset of the range within the file being split or joined.
+     */
+    LARGE_INTEGER Offset;
+
+    /**
+     The number of bytes in the range.
+     */
+    LARGE_INTEGER Length;
+
+} SPLIT_RANGE, *PSPLIT_RANGE;
+
+/**
+ Context for copying a set of ranges between files concurrently.
+ */
+typedef struct _SPLIT_COPY_CONTEXT {
+
+    /**
+     Pointer to the prefix of part file names.
+     */
+    PYORI_STRING Prefix;
+
+    /**
+     If TRUE, part files are being joined into a single file.  If FALSE, a
+     single file is being split into part files.
+     */
+    BOOL Join;
+
+    /**
+     A handle, opened for overlapped I/O, to the file being split or the file
+     being joined into.  This is shared by all threads, each of which issues
+     I/O at explicit offsets.
+     */
+    HANDLE SharedHandle;
+
+    /**
+     An array of ranges to copy.  If NULL, ranges are fixed size, described
+     by BytesPerPart, and cover FileSize.
+     */
+    PSPLIT_RANGE Ranges;
+
+    /**
+     If Ranges is NULL, the number of bytes in each range.
+     */
+    LONGLONG BytesPerPart;
+
+    /**
+     If Ranges is NULL, the size of the file being split.
+     */
+    LARGE_INTEGER FileSize;
+
+    /**
+     The number of ranges to copy.
+     */
+    LONG RangeCount;
+
+    /**
+     The index of the next range for a thread to copy.
+     */
+    LONG NextRange;
+
+    /**
+     Set to TRUE if any range could not be copied, which causes threads to
+     stop picking up new ranges.
+     */
+    BOOL Failed;
+
+} SPLIT_COPY_CONTEXT, *PSPLIT_COPY_CONTEXT;
+
+/**
+ Perform a read or write at an explicit offset within a file opened for
+ overlapped I/O, waiting for it to complete.
+
+ @param FileHandle Handle to the file.
+
+ @param Buffer Pointer to the buffer to read into or write from.
+
+ @param Length The number of bytes to transfer.
+
+ @param Offset The offset within the file to transfer at.
+
+ @param Event An event used to wait for the transfer to complete.
+
+ @param Write If TRUE, write to the file.  If FALSE, read from the file.
+
+ @param BytesTransferred On successful completion, updated to contain the
+        number of bytes transferred.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SplitPositionedIo(
+    __in HANDLE FileHandle,
+    __in PVOID Buffer,
+    __in DWORD Length,
+    __in LARGE_INTEGER Offset,
+    __in HANDLE Event,
+    __in BOOL Write,
+    __out PDWORD BytesTransferred
+    )
+{
+    OVERLAPPED Overlapped;
+    BOOL Result;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.Offset = Offset.LowPart;
+    Overlapped.OffsetHigh = Offset.HighPart;
+    Overlapped.hEvent = Event;
+
+    if (Write) {
+        Result = WriteFile(FileHandle, Buffer, Length, BytesTransferred, &Overlapped);
+    } else {
+        Result = ReadFile(FileHandle, Buffer, Length, BytesTransferred, &Overlapped);
+    }
+
+    if (!Result && GetLastError() == ERROR_IO_PENDING) {
+        Result = GetOverlappedResult(FileHandle, &Overlapped, BytesTransferred, TRUE);
+    }
+
+    return Result;
+}
+
+/**
+ Open a part file to read from when joining.
+
+ @param Prefix Pointer to the prefix of part file names.
+
+ @param PartNumber The number of the part to open.
+
+ @param ExtraFlags Additional flags to pass when opening the file, such as
+        FILE_FLAG_OVERLAPPED.
+
+ @param FileSize Optionally points to a value to receive the size of the
+        part file.
+
+ @return Handle to the opened object, or NULL on failure.  On failure,
+         GetLastError indicates the reason for the failure.
+ */
+HANDLE
+SplitOpenSourcePart(
+    __in PYORI_STRING Prefix,
+    __in LONGLONG PartNumber,
+    __in DWORD ExtraFlags,
+    __out_opt PLARGE_INTEGER FileSize
+    )
+{
+    LPTSTR FragmentFileName;
+    YORI_STRING NumberString;
+    HANDLE SourceHandle;
+    DWORD LastError;
+
+    YoriLibInitEmptyString(&NumberString);
+    if (!YoriLibNumberToString(&NumberString, PartNumber, 10, 0, '\0')) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    FragmentFileName = YoriLibMalloc((Prefix->LengthInChars + NumberString.LengthInChars + 1) * sizeof(TCHAR));
+    if (FragmentFileName == NULL) {
+        YoriLibFreeStringContents(&NumberString);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    YoriLibSPrintf(FragmentFileName, _T("%y%y"), Prefix, &NumberString);
+    YoriLibFreeStringContents(&NumberString);
+
+    SourceHandle = CreateFile(FragmentFileName,
+                              GENERIC_READ,
+                              FILE_SHARE_READ|FILE_SHARE_DELETE,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | ExtraFlags,
+                              NULL);
+
+    if (SourceHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        if (LastError != ERROR_FILE_NOT_FOUND || PartNumber == 0) {
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: open of %s failed: %s"), FragmentFileName, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+        }
+        YoriLibFree(FragmentFileName);
+        SetLastError(LastError);
+        return NULL;
+    }
+
+    if (FileSize != NULL) {
+        FileSize->LowPart = GetFileSize(SourceHandle, (LPDWORD)&FileSize->HighPart);
+        if (FileSize->LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+            LastError = GetLastError();
+            CloseHandle(SourceHandle);
+            YoriLibFree(FragmentFileName);
+            SetLastError(LastError);
+            return NULL;
+        }
+    }
+
+    YoriLibFree(FragmentFileName);
+    return SourceHandle;
+}
+
+/**
+ A worker thread which repeatedly picks the next uncopied range and copies
+ it, until all ranges are copied or a failure occurs.
+
+ @param Context Pointer to the copy context.
+
+ @return Zero to indicate success, nonzero to indicate failure.
+ */
+DWORD WINAPI
+SplitCopyWorker(
+    __in LPVOID Context
+    )
+{
+    PSPLIT_COPY_CONTEXT CopyContext;
+    SPLIT_RANGE LocalRange;
+    PSPLIT_RANGE Range;
+    HANDLE PartHandle;
+    HANDLE SourceHandle;
+    HANDLE TargetHandle;
+    HANDLE Event;
+    PVOID Buffer;
+    LARGE_INTEGER SourceOffset;
+    LARGE_INTEGER TargetOffset;
+    LONGLONG BytesRemaining;
+    DWORD BytesToCopy;
+    DWORD BytesRead;
+    DWORD BytesWritten;
+    LONG RangeIndex;
+
+    CopyContext = (PSPLIT_COPY_CONTEXT)Context;
+
+    Buffer = YoriLibMalloc(SPLIT_COPY_BUFFER_SIZE);
+    Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (Buffer == NULL || Event == NULL) {
+        if (Buffer != NULL) {
+            YoriLibFree(Buffer);
+        }
+        if (Event != NULL) {
+            CloseHandle(Event);
+        }
+        CopyContext->Failed = TRUE;
+        return EXIT_FAILURE;
+    }
+
+    while (!CopyContext->Failed) {
+
+        RangeIndex = InterlockedIncrement(&CopyContext->NextRange) - 1;
+        if (RangeIndex >= CopyContext->RangeCount) {
+            break;
+        }
+
+        if (CopyContext->Ranges != NULL) {
+            Range = &CopyContext->Ranges[RangeIndex];
+        } else {
+            Range = &LocalRange;
+            Range->PartNumber = RangeIndex;
+            Range->Offset.QuadPart = RangeIndex * CopyContext->BytesPerPart;
+            Range->Length.QuadPart = CopyContext->FileSize.QuadPart - Range->Offset.QuadPart;
+            if (Range->Length.QuadPart > CopyContext->BytesPerPart) {
+                Range->Length.QuadPart = CopyContext->BytesPerPart;
+            }
+        }
+
+        //
+        //  The part file is read from when joining and written to when
+        //  splitting.  Offsets within the part file start from zero, and
+        //  offsets within the shared file are described by the range.
+        //
+
+        if (CopyContext->Join) {
+            PartHandle = SplitOpenSourcePart(CopyContext->Prefix, Range->PartNumber, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            SourceHandle = PartHandle;
+            TargetHandle = CopyContext->SharedHandle;
+            SourceOffset.QuadPart = 0;
+            TargetOffset.QuadPart = Range->Offset.QuadPart;
+        } else {
+            PartHandle = SplitOpenTargetForPart(CopyContext->Prefix, Range->PartNumber, FILE_FLAG_OVERLAPPED);
+            SourceHandle = CopyContext->SharedHandle;
+            TargetHandle = PartHandle;
+            SourceOffset.QuadPart = Range->Offset.QuadPart;
+            TargetOffset.QuadPart = 0;
+        }
+
+        if (PartHandle == NULL) {
+            CopyContext->Failed = TRUE;
+            break;
+        }
+
+        BytesRemaining = Range->Length.QuadPart;
+        while (BytesRemaining > 0) {
+
+            if (YoriLibIsOperationCancelled()) {
+                CopyContext->Failed = TRUE;
+                break;
+            }
+
+            BytesToCopy = SPLIT_COPY_BUFFER_SIZE;
+            if (BytesRemaining < BytesToCopy) {
+                BytesToCopy = (DWORD)BytesRemaining;
+            }
+
+            if (!SplitPositionedIo(SourceHandle, Buffer, BytesToCopy, SourceOffset, Event, FALSE, &BytesRead) ||
+                BytesRead != BytesToCopy) {
+
+                DWORD LastError = GetLastError();
+                LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: read failed: %s"), ErrText);
+                YoriLibFreeWinErrorText(ErrText);
+                CopyContext->Failed = TRUE;
+                break;
+            }
+
+            if (!SplitPositionedIo(TargetHandle, Buffer, BytesRead, TargetOffset, Event, TRUE, &BytesWritten) ||
+                BytesWritten != BytesRead) {
+
+                DWORD LastError = GetLastError();
+                LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: write failed: %s"), ErrText);
+                YoriLibFreeWinErrorText(ErrText);
+                CopyContext->Failed = TRUE;
+                break;
+            }
+
+            SourceOffset.QuadPart += BytesRead;
+            TargetOffset.QuadPart += BytesRead;
+            BytesRemaining -= BytesRead;
+        }
+
+        CloseHandle(PartHandle);
+    }
+
+    CloseHandle(Event);
+    YoriLibFree(Buffer);
+
+    if (CopyContext->Failed) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ Copy every range described by a copy context, using a pool of threads so
+ that several ranges are copied at once.
+
+ @param CopyContext Pointer to the copy context.
+
+ @return TRUE to indicate every range was copied, FALSE to indicate failure.
+ */
+BOOL
+SplitCopyRanges(
+    __in PSPLIT_COPY_CONTEXT CopyContext
+    )
+{
+    HANDLE Threads[SPLIT_MAX_COPY_THREADS];
+    SYSTEM_INFO SystemInfo;
+    DWORD ThreadCount;
+    DWORD ThreadsStarted;
+    DWORD ThreadId;
+
+    if (CopyContext->RangeCount == 0) {
+        return TRUE;
+    }
+
+    GetSystemInfo(&SystemInfo);
+    ThreadCount = SystemInfo.dwNumberOfProcessors;
+    if (ThreadCount < 2) {
+        ThreadCount = 2;
+    }
+    if (ThreadCount > SPLIT_MAX_COPY_THREADS) {
+        ThreadCount = SPLIT_MAX_COPY_THREADS;
+    }
+    if (ThreadCount > (DWORD)CopyContext->RangeCount) {
+        ThreadCount = (DWORD)CopyContext->RangeCount;
+    }
+
+    CopyContext->NextRange = 0;
+    CopyContext->Failed = FALSE;
+
+    for (ThreadsStarted = 0; ThreadsStarted < ThreadCount; ThreadsStarted++) {
+        Threads[ThreadsStarted] = CreateThread(NULL, 0, SplitCopyWorker, CopyContext, 0, &ThreadId);
+        if (Threads[ThreadsStarted] == NULL) {
+            break;
+        }
+    }
+
+    //
+    //  If no threads could be started, perform the copy on this thread.
+    //
+
+    if (ThreadsStarted == 0) {
+        SplitCopyWorker(CopyContext);
+    } else {
+        WaitForMultipleObjects(ThreadsStarted, Threads, TRUE, INFINITE);
+        for (ThreadId = 0; ThreadId < ThreadsStarted; ThreadId++) {
+            CloseHandle(Threads[ThreadId]);
+        }
+    }
+
+    return !CopyContext->Failed;
+}
+
+/**
+ Scan a file to find where each part should end when splitting by lines.
+ Parts are copied without modification, so this is only possible if the
+ result would be the same as splitting the file as a stream, which writes
+ each line followed by a carriage return line feed and does not write any
+ byte order mark.  The scan therefore fails if the file starts with a byte
+ order mark, or if any line, including the final line, is not terminated
+ with a carriage return line feed pair.  Each part ends after the
+ terminator of its final line.
+
+ @param SourceHandle Handle to the file to scan, opened for overlapped I/O.
+
+ @param FileSize The size of the file.
+
+ @param SplitContext Pointer to the split context, specifying the number of
+        lines per part.
+
+ @param Ranges On successful completion, updated to point to an allocated
+        array of ranges, one per part.  The caller should free this with
+        YoriLibFree.
+
+ @param RangeCount On successful completion, updated to contain the number
+        of elements in Ranges.
+
+ @return TRUE to indicate success, FALSE to indicate failure or that the
+         file cannot be split by copying ranges.
+ */
+BOOL
+SplitFindLineRanges(
+    __in HANDLE SourceHandle,
+    __in LARGE_INTEGER FileSize,
+    __in PSPLIT_CONTEXT SplitContext,
+    __out PSPLIT_RANGE * Ranges,
+    __out PLONG RangeCount
+    )
+{
+    PSPLIT_RANGE RangeArray;
+    PSPLIT_RANGE NewRangeArray;
+    LONG RangesAllocated;
+    LONG RangesFound;
+    PUCHAR Buffer;
+    PWCHAR WideBuffer;
+    HANDLE Event;
+    LARGE_INTEGER ReadOffset;
+    LARGE_INTEGER PartStart;
+    LONGLONG LinesThisPart;
+    DWORD BytesRead;
+    DWORD CharSize;
+    DWORD CharsInBuffer;
+    DWORD Index;
+    WCHAR ThisChar;
+    WCHAR LastChar;
+    BOOLEAN PendingCr;
+    BOOL Result;
+    LARGE_INTEGER LineEnd;
+
+    Result = FALSE;
+    Buffer = NULL;
+    Event = NULL;
+    RangeArray = NULL;
+
+    CharSize = sizeof(UCHAR);
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        CharSize = sizeof(WCHAR);
+    }
+
+    Buffer = YoriLibMalloc(SPLIT_COPY_BUFFER_SIZE);
+    if (Buffer == NULL) {
+        goto Cleanup;
+    }
+    WideBuffer = (PWCHAR)Buffer;
+
+    Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (Event == NULL) {
+        goto Cleanup;
+    }
+
+    RangesAllocated = 64;
+    RangesFound = 0;
+    RangeArray = YoriLibMalloc(RangesAllocated * sizeof(SPLIT_RANGE));
+    if (RangeArray == NULL) {
+        goto Cleanup;
+    }
+
+    PartStart.QuadPart = 0;
+    ReadOffset.QuadPart = 0;
+    LinesThisPart = 0;
+    PendingCr = FALSE;
+    LastChar = '\n';
+
+    while (ReadOffset.QuadPart < FileSize.QuadPart) {
+
+        if (!SplitPositionedIo(SourceHandle, Buffer, SPLIT_COPY_BUFFER_SIZE, ReadOffset, Event, FALSE, &BytesRead)) {
+            if (GetLastError() != ERROR_HANDLE_EOF) {
+                goto Cleanup;
+            }
+            BytesRead = 0;
+        }
+
+        CharsInBuffer = BytesRead / CharSize;
+        if (CharsInBuffer == 0) {
+            break;
+        }
+
+        //
+        //  The stream path would not write a byte order mark, so a file
+        //  that starts with one needs to be processed as a stream.
+        //
+
+        if (ReadOffset.QuadPart == 0) {
+            if (CharSize == sizeof(WCHAR)) {
+                if (WideBuffer[0] == 0xFEFF) {
+                    goto Cleanup;
+                }
+            } else if (BytesRead >= 3 &&
+                       Buffer[0] == 0xEF &&
+                       Buffer[1] == 0xBB &&
+                       Buffer[2] == 0xBF) {
+                goto Cleanup;
+            }
+        }
+
+        for (Index = 0; Index < CharsInBuffer; Index++) {
+            if (CharSize == sizeof(WCHAR)) {
+                ThisChar = WideBuffer[Index];
+            } else {
+                ThisChar = Buffer[Index];
+            }
+
+            //
+            //  Any line feed without a carriage return, or carriage return
+            //  without a line feed, would be rewritten by the stream path.
+            //
+
+            if (ThisChar == '\n') {
+                if (!PendingCr) {
+                    goto Cleanup;
+                }
+            } else if (PendingCr) {
+                goto Cleanup;
+            }
+
+            LastChar = ThisChar;
+            PendingCr = FALSE;
+            if (ThisChar == '\r') {
+                PendingCr = TRUE;
+                continue;
+            }
+
+            if (ThisChar != '\n') {
+                continue;
+            }
+
+            LineEnd.QuadPart = ReadOffset.QuadPart + (Index + 1) * CharSize;
+            LinesThisPart++;
+            if (LinesThisPart == SplitContext->LinesPerPart) {
+                if (RangesFound == RangesAllocated) {
+                    if (RangesAllocated >= MAXLONG / 2) {
+                        goto Cleanup;
+                    }
+                    NewRangeArray = YoriLibMalloc(RangesAllocated * 2 * sizeof(SPLIT_RANGE));
+                    if (NewRangeArray == NULL) {
+                        goto Cleanup;
+                    }
+                    memcpy(NewRangeArray, RangeArray, RangesFound * sizeof(SPLIT_RANGE));
+                    YoriLibFree(RangeArray);
+                    RangeArray = NewRangeArray;
+                    RangesAllocated = RangesAllocated * 2;
+                }
+                RangeArray[RangesFound].PartNumber = RangesFound;
+                RangeArray[RangesFound].Offset.QuadPart = PartStart.QuadPart;
+                RangeArray[RangesFound].Length.QuadPart = LineEnd.QuadPart - PartStart.QuadPart;
+                RangesFound++;
+                PartStart.QuadPart = LineEnd.QuadPart;
+                LinesThisPart = 0;
+            }
+        }
+
+        ReadOffset.QuadPart += CharsInBuffer * CharSize;
+    }
+
+    //
+    //  The stream path terminates the final line, so if the file does not
+    //  end with a line terminator, or has a trailing partial character,
+    //  copying it would give a different result.
+    //
+
+    if (ReadOffset.QuadPart != FileSize.QuadPart || LastChar != '\n') {
+        goto Cleanup;
+    }
+
+    if (LinesThisPart > 0) {
+        if (RangesFound == RangesAllocated) {
+            NewRangeArray = YoriLibMalloc((RangesAllocated + 1) * sizeof(SPLIT_RANGE));
+            if (NewRangeArray == NULL) {
+                goto Cleanup;
+            }
+            memcpy(NewRangeArray, RangeArray, RangesFound * sizeof(SPLIT_RANGE));
+            YoriLibFree(RangeArray);
+            RangeArray = NewRangeArray;
+        }
+        RangeArray[RangesFound].PartNumber = RangesFound;
+        RangeArray[RangesFound].Offset.QuadPart = PartStart.QuadPart;
+        RangeArray[RangesFound].Length.QuadPart = FileSize.QuadPart - PartStart.QuadPart;
+        RangesFound++;
+    }
+
+    *Ranges = RangeArray;
+    *RangeCount = RangesFound;
+    RangeArray = NULL;
+    Result = TRUE;
+
+Cleanup:
+    if (RangeArray != NULL) {
+        YoriLibFree(RangeArray);
+    }
+    if (Event != NULL) {
+        CloseHandle(Event);
+    }
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+    return Result;
+}
+
+/**
+ Split a file on disk into pieces, copying several pieces at once.  In line
+ mode, the file is first scanned to find where each piece ends, and data is
+ copied without being converted between encodings or line endings, so this
+ is only used when the input and output encodings match and the file is
+ already in the form that splitting it as a stream would produce.
+
+ @param FilePath Pointer to the full path of the file to split.
+
+ @param SplitContext Pointer to a context describing the actions to perform.
+
+ @param Handled On completion, set to TRUE if the split was attempted, or
+        FALSE if the file could not be processed this way and no output was
+        written, in which case the caller should process it as a stream.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SplitProcessFile(
+    __in PYORI_STRING FilePath,
+    __in PSPLIT_CONTEXT SplitContext,
+    __out PBOOL Handled
+    )
+{
+    SPLIT_COPY_CONTEXT CopyContext;
+    LONGLONG RangeCount;
+    BOOL Result;
+
+    *Handled = FALSE;
+
+    if (SplitContext->LinesMode &&
+        YoriLibGetMultibyteInputEncoding() != YoriLibGetMultibyteOutputEncoding()) {
+
+        return FALSE;
+    }
+
+    ZeroMemory(&CopyContext, sizeof(CopyContext));
+    CopyContext.Prefix = &SplitContext->Prefix;
+    CopyContext.Join = FALSE;
+
+    CopyContext.SharedHandle = CreateFile(FilePath->StartOfString,
+                                          GENERIC_READ,
+                                          FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                          NULL,
+                                          OPEN_EXISTING,
+                                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                          NULL);
+
+    if (CopyContext.SharedHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    if (GetFileType(CopyContext.SharedHandle) != FILE_TYPE_DISK) {
+        CloseHandle(CopyContext.SharedHandle);
+        return FALSE;
+    }
+
+    CopyContext.FileSize.LowPart = GetFileSize(CopyContext.SharedHandle, (LPDWORD)&CopyContext.FileSize.HighPart);
+    if (CopyContext.FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        CloseHandle(CopyContext.SharedHandle);
+        return FALSE;
+    }
+
+    if (SplitContext->LinesMode) {
+        if (!SplitFindLineRanges(CopyContext.SharedHandle, CopyContext.FileSize, SplitContext, &CopyContext.Ranges, &CopyContext.RangeCount)) {
+            CloseHandle(CopyContext.SharedHandle);
+            return FALSE;
+        }
+    } else {
+        CopyContext.BytesPerPart = SplitContext->BytesPerPart;
+        RangeCount = (CopyContext.FileSize.QuadPart + CopyContext.BytesPerPart - 1) / CopyContext.BytesPerPart;
+        if (RangeCount >= MAXLONG) {
+            CloseHandle(CopyContext.SharedHandle);
+            return FALSE;
+        }
+        CopyContext.RangeCount = (LONG)RangeCount;
+    }
+
+    *Handled = TRUE;
+    Result = SplitCopyRanges(&CopyContext);
+
+    if (CopyContext.Ranges != NULL) {
+        YoriLibFree(CopyContext.Ranges);
+    }
+    CloseHandle(CopyContext.SharedHandle);
+    return Result;
+}
+
 /**
  Take a single incoming stream and break it into pieces.
 
@@ -242,7 +1005,9 @@ SplitProcessStream(
 
 /**
  Join a series of files with a given prefix back into a single file.  This is
- the inverse of split.
+ the inverse of split.  The size of each part is determined first so that
+ the combined file can be allocated up front and each part copied into its
+ offset concurrently.
 
  @param Prefix Pointer to the string containing the prefix name of the set of
         files.
@@ -258,129 +1023,107 @@ SplitJoin(
     __in PYORI_STRING OutputFile
     )
 {
+    SPLIT_COPY_CONTEXT CopyContext;
+    PSPLIT_RANGE NewRanges;
     HANDLE SourceHandle;
-    HANDLE TargetHandle;
-    PUCHAR Buffer;
-    DWORD BytesRead;
-    DWORD BytesAllocated;
-    LONGLONG CurrentFragment;
-    LPTSTR FragmentFileName;
-    YORI_STRING NumberString;
+    LARGE_INTEGER PartSize;
+    LARGE_INTEGER TotalSize;
+    LONG RangesAllocated;
     DWORD LastError;
     LPTSTR ErrText;
+    BOOL Result;
 
     ASSERT(YoriLibIsStringNullTerminated(OutputFile));
 
-    BytesAllocated = 256 * 1024;
+    ZeroMemory(&CopyContext, sizeof(CopyContext));
+    CopyContext.Prefix = Prefix;
+    CopyContext.Join = TRUE;
 
-    Buffer = YoriLibMalloc(BytesAllocated);
-    if (Buffer == NULL) {
+    RangesAllocated = 64;
+    CopyContext.Ranges = YoriLibMalloc(RangesAllocated * sizeof(SPLIT_RANGE));
+    if (CopyContext.Ranges == NULL) {
         return FALSE;
     }
 
-    TargetHandle = CreateFile(OutputFile->StartOfString,
-                              GENERIC_WRITE,
-                              FILE_SHARE_READ | FILE_SHARE_DELETE,
-                              NULL,
-                              CREATE_ALWAYS,
-                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
-                              NULL);
-
-    if (TargetHandle == NULL || TargetHandle == INVALID_HANDLE_VALUE) {
-        LastError = GetLastError();
-        ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: open of %y failed: %s"), OutputFile, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        YoriLibFree(Buffer);
-        return FALSE;
-    }
-
-    CurrentFragment = 0;
+    //
+    //  Find every part and its size, which determines where it belongs in
+    //  the combined file.
+    //
 
+    TotalSize.QuadPart = 0;
     while(TRUE) {
 
-        YoriLibInitEmptyString(&NumberString);
-        if (!YoriLibNumberToString(&NumberString, CurrentFragment, 10, 0, '\0')) {
-            CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
-            return FALSE;
-        }
-
-        FragmentFileName = YoriLibMalloc((Prefix->LengthInChars + NumberString.LengthInChars + 1) * sizeof(TCHAR));
-        if (FragmentFileName == NULL) {
-            YoriLibFreeStringContents(&NumberString);
-            CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
-            return FALSE;
-        }
-
-        YoriLibSPrintf(FragmentFileName, _T("%y%y"), Prefix, &NumberString);
-        YoriLibFreeStringContents(&NumberString);
-
-        SourceHandle = CreateFile(FragmentFileName,
-                                  GENERIC_READ,
-                                  FILE_SHARE_READ|FILE_SHARE_DELETE,
-                                  NULL,
-                                  OPEN_EXISTING,
-                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
-                                  NULL);
-        if (SourceHandle == INVALID_HANDLE_VALUE) {
+        SourceHandle = SplitOpenSourcePart(Prefix, CopyContext.RangeCount, 0, &PartSize);
+        if (SourceHandle == NULL) {
             LastError = GetLastError();
-            if (LastError == ERROR_FILE_NOT_FOUND && CurrentFragment > 0) {
-                YoriLibFree(FragmentFileName);
+            if (LastError == ERROR_FILE_NOT_FOUND && CopyContext.RangeCount > 0) {
                 break;
             }
-            ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: open of %s failed: %s"), FragmentFileName, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-            YoriLibFree(FragmentFileName);
-            CloseHandle(TargetHandle);
-            YoriLibFree(Buffer);
+            YoriLibFree(CopyContext.Ranges);
             return FALSE;
         }
+        CloseHandle(SourceHandle);
 
-        while(TRUE) {
-
-            if (!ReadFile(SourceHandle, Buffer, BytesAllocated, &BytesRead, NULL)) {
-                LastError = GetLastError();
-                if (LastError == ERROR_HANDLE_EOF) {
-                    break;
-                }
-                ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: read of %s failed: %s"), FragmentFileName, ErrText);
-                YoriLibFreeWinErrorText(ErrText);
-                YoriLibFree(FragmentFileName);
-                CloseHandle(TargetHandle);
-                CloseHandle(SourceHandle);
-                YoriLibFree(Buffer);
+        if (CopyContext.RangeCount == RangesAllocated) {
+            if (RangesAllocated >= MAXLONG / 2) {
+                YoriLibFree(CopyContext.Ranges);
                 return FALSE;
             }
-
-            if (BytesRead == 0) {
-                break;
-            }
-
-            if (!WriteFile(TargetHandle, Buffer, BytesRead, &BytesRead, NULL)) {
-                LastError = GetLastError();
-                ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: write to %y failed: %s"), OutputFile, ErrText);
-                YoriLibFreeWinErrorText(ErrText);
-                YoriLibFree(FragmentFileName);
-                CloseHandle(TargetHandle);
-                CloseHandle(SourceHandle);
-                YoriLibFree(Buffer);
+            NewRanges = YoriLibMalloc(RangesAllocated * 2 * sizeof(SPLIT_RANGE));
+            if (NewRanges == NULL) {
+                YoriLibFree(CopyContext.Ranges);
                 return FALSE;
             }
+            memcpy(NewRanges, CopyContext.Ranges, CopyContext.RangeCount * sizeof(SPLIT_RANGE));
+            YoriLibFree(CopyContext.Ranges);
+            CopyContext.Ranges = NewRanges;
+            RangesAllocated = RangesAllocated * 2;
         }
 
-        CloseHandle(SourceHandle);
-        YoriLibFree(FragmentFileName);
-        CurrentFragment++;
+        CopyContext.Ranges[CopyContext.RangeCount].PartNumber = CopyContext.RangeCount;
+        CopyContext.Ranges[CopyContext.RangeCount].Offset.QuadPart = TotalSize.QuadPart;
+        CopyContext.Ranges[CopyContext.RangeCount].Length.QuadPart = PartSize.QuadPart;
+        TotalSize.QuadPart += PartSize.QuadPart;
+        CopyContext.RangeCount++;
     }
 
-    YoriLibFree(Buffer);
-    CloseHandle(TargetHandle);
-    return TRUE;
+    CopyContext.SharedHandle = CreateFile(OutputFile->StartOfString,
+                                          GENERIC_WRITE,
+                                          FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                          NULL,
+                                          CREATE_ALWAYS,
+                                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                          NULL);
+
+    if (CopyContext.SharedHandle == NULL || CopyContext.SharedHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: open of %y failed: %s"), OutputFile, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        YoriLibFree(CopyContext.Ranges);
+        return FALSE;
+    }
+
+    //
+    //  Extend the combined file to its final size before writing, so the
+    //  file system can allocate it in one operation rather than extending
+    //  it as each part is written.  This is only an optimization, so
+    //  failure is not fatal.
+    //
+
+    if (TotalSize.QuadPart > 0) {
+        if (SetFilePointer(CopyContext.SharedHandle, TotalSize.LowPart, &TotalSize.HighPart, FILE_BEGIN) != INVALID_FILE_SIZE ||
+            GetLastError() == NO_ERROR) {
+
+            SetEndOfFile(CopyContext.SharedHandle);
+        }
+    }
+
+    Result = SplitCopyRanges(&CopyContext);
+
+    CloseHandle(CopyContext.SharedHandle);
+    YoriLibFree(CopyContext.Ranges);
+    return Result;
 }
 
 #ifdef YORI_BUILTIN
@@ -547,6 +1290,7 @@ ENTRYPOINT(
         } else {
             HANDLE FileHandle;
             YORI_STRING FilePath;
+            BOOL Handled = FALSE;
 
             if (!YoriLibUserStringToSingleFilePath(&ArgV[StartArg], TRUE, &FilePath)) {
                 return EXIT_FAILURE;
@@ -567,12 +1311,30 @@ ENTRYPOINT(
                 return TRUE;
             }
 
+            //
+            //  If the file is on disk, split it by copying several parts at
+            //  once.  If that's not possible, process it as a stream.
+            //
+
+            if (GetFileType(FileHandle) == FILE_TYPE_DISK) {
+                if (!SplitProcessFile(&FilePath, &SplitContext, &Handled)) {
+                    if (Handled) {
+                        CloseHandle(FileHandle);
+                        YoriLibFreeStringContents(&FilePath);
+                        YoriLibFreeStringContents(&SplitContext.Prefix);
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+
             YoriLibFreeStringContents(&FilePath);
 
-            if (!SplitProcessStream(FileHandle, &SplitContext)) {
-                CloseHandle(FileHandle);
-                YoriLibFreeStringContents(&SplitContext.Prefix);
-                return EXIT_FAILURE;
+            if (!Handled) {
+                if (!SplitProcessStream(FileHandle, &SplitContext)) {
+                    CloseHandle(FileHandle);
+                    YoriLibFreeStringContents(&SplitContext.Prefix);
+                    return EXIT_FAILURE;
+                }
             }
             CloseHandle(FileHandle);
         }
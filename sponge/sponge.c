@@ -36,7 +36,10 @@ CHAR strSpongeHelpText[] =
         "Read input into memory and output once all input is read,\n"
         "  allowing the output to modify the source stream.\n"
         "\n"
-        "SPONGE [-license] [file]\n"
+        "SPONGE [-license] [-m size] [file]\n"
+        "\n"
+        "   -m             The amount of memory to use before spilling input to a\n"
+        "                    temporary file, default 64Mb\n"
         ;
 
 /**
@@ -53,6 +56,17 @@ SpongeHelp()
     return TRUE;
 }
 
+/**
+ The default amount of input to hold in memory before spilling to a
+ temporary file.
+ */
+#define SPONGE_DEFAULT_MEMORY_LIMIT (64 * 1024 * 1024)
+
+/**
+ The size of each write when forwarding data to the target.
+ */
+#define SPONGE_FORWARD_CHUNK_SIZE (64 * 1024)
+
 /**
  A buffer for a single data stream.
  */
@@ -68,11 +82,35 @@ typedef struct _SPONGE_BUFFER {
      */
     DWORD BytesPopulated;
 
+    /**
+     The maximum number of bytes to allocate to this buffer.  If more input
+     than this arrives, the input is spilled to a temporary file.
+     */
+    DWORD MemoryLimit;
+
     /**
      A handle to a pipe which is the source of data for this buffer.
      */
     HANDLE hSource;
 
+    /**
+     A handle to the temporary file that input has been spilled to, or NULL
+     if all input is held in memory.
+     */
+    HANDLE hSpill;
+
+    /**
+     The directory to create a temporary file in if input needs to be
+     spilled.  This is the directory of the target file so the temporary
+     file can be renamed over it.
+     */
+    YORI_STRING SpillDirectory;
+
+    /**
+     The full path to the temporary file that input has been spilled to.
+     */
+    YORI_STRING SpillFileName;
+
     /**
      The data buffer.
      */
@@ -81,7 +119,97 @@ typedef struct _SPONGE_BUFFER {
 } SPONGE_BUFFER, *PSPONGE_BUFFER;
 
 /**
- Populate data from stdin into an in memory buffer.
+ Write the populated contents of the in memory buffer to a handle.
+
+ @param Buffer Pointer to the buffer to write.
+
+ @param BytesToSend The number of bytes from the start of the buffer to
+        write.
+
+ @param hTarget Handle to the target stream to write the buffer to.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeWriteBuffer(
+    __in PCHAR Buffer,
+    __in DWORD BytesToSend,
+    __in HANDLE hTarget
+    )
+{
+    DWORD BytesSent;
+    DWORD BytesToWrite;
+    DWORD BytesWritten;
+
+    BytesSent = 0;
+
+    while (BytesSent < BytesToSend) {
+        BytesToWrite = SPONGE_FORWARD_CHUNK_SIZE;
+        if (BytesSent + BytesToWrite > BytesToSend) {
+            BytesToWrite = BytesToSend - BytesSent;
+        }
+
+        if (!WriteFile(hTarget,
+                       YoriLibAddToPointer(Buffer, BytesSent),
+                       BytesToWrite,
+                       &BytesWritten,
+                       NULL)) {
+
+            return FALSE;
+        }
+
+        BytesSent += BytesWritten;
+        ASSERT(BytesSent <= BytesToSend);
+    }
+
+    return TRUE;
+}
+
+/**
+ Move the contents of the in memory buffer to a temporary file, creating
+ the temporary file if this is the first time the buffer has filled.
+
+ @param ThisBuffer A pointer to the process buffer set.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeBufferSpill(
+    __in PSPONGE_BUFFER ThisBuffer
+    )
+{
+    YORI_STRING Prefix;
+
+    if (ThisBuffer->hSpill == NULL) {
+        if (ThisBuffer->SpillDirectory.LengthInChars == 0) {
+            return FALSE;
+        }
+        YoriLibConstantString(&Prefix, _T("YSPG"));
+        if (!YoriLibGetTempFileName(&ThisBuffer->SpillDirectory, &Prefix, &ThisBuffer->hSpill, &ThisBuffer->SpillFileName)) {
+            DWORD LastError = GetLastError();
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: create of temporary file in %y failed: %s"), &ThisBuffer->SpillDirectory, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            ThisBuffer->hSpill = NULL;
+            return FALSE;
+        }
+    }
+
+    if (!SpongeWriteBuffer(ThisBuffer->Buffer, ThisBuffer->BytesPopulated, ThisBuffer->hSpill)) {
+        DWORD LastError = GetLastError();
+        LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: write to temporary file failed: %s"), ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        return FALSE;
+    }
+
+    ThisBuffer->BytesPopulated = 0;
+    return TRUE;
+}
+
+/**
+ Populate data from stdin into an in memory buffer.  If the buffer would
+ need to grow beyond the memory limit, input is spilled to a temporary file.
 
  @param ThisBuffer A pointer to the process buffer set.
 
@@ -114,15 +242,25 @@ SpongeBufferPump(
                 DWORD NewBytesAllocated;
                 PCHAR NewBuffer;
 
-                if (ThisBuffer->BytesAllocated >= ((DWORD)-1) / 4) {
-                    break;
+                if (ThisBuffer->BytesAllocated >= ThisBuffer->MemoryLimit) {
+                    if (!SpongeBufferSpill(ThisBuffer)) {
+                        break;
+                    }
+                    continue;
                 }
 
-                NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
+                if (ThisBuffer->BytesAllocated >= ThisBuffer->MemoryLimit / 4) {
+                    NewBytesAllocated = ThisBuffer->MemoryLimit;
+                } else {
+                    NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
+                }
 
                 NewBuffer = YoriLibMalloc(NewBytesAllocated);
                 if (NewBuffer == NULL) {
-                    break;
+                    if (!SpongeBufferSpill(ThisBuffer)) {
+                        break;
+                    }
+                    continue;
                 }
 
                 memcpy(NewBuffer, ThisBuffer->Buffer, ThisBuffer->BytesAllocated);
@@ -136,11 +274,23 @@ SpongeBufferPump(
         }
     }
 
+    //
+    //  If any input has been spilled, move the remainder to the temporary
+    //  file too, so the file contains all of the input.
+    //
+
+    if (Result && ThisBuffer->hSpill != NULL && ThisBuffer->BytesPopulated > 0) {
+        if (!SpongeBufferSpill(ThisBuffer)) {
+            Result = FALSE;
+        }
+    }
+
     return Result;
 }
 
 /**
- Output the collected buffer to a stream.
+ Output the collected buffer to a stream.  If input was spilled to a
+ temporary file, the contents of that file are copied to the stream.
 
  @param ThisBuffer Pointer to the buffer to output.
 
@@ -154,35 +304,83 @@ SpongeBufferForward(
     __in HANDLE hTarget
     )
 {
-    DWORD BytesSent;
-    BOOL Result;
+    HANDLE hSpill;
+    DWORD BytesRead;
 
-    BytesSent = 0;
-    Result = TRUE;
-
-    while (BytesSent < ThisBuffer->BytesPopulated) {
-        DWORD BytesToWrite;
-        DWORD BytesWritten;
-        BytesToWrite = 4096;
-        if (BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-            BytesToWrite = ThisBuffer->BytesPopulated - BytesSent;
-        }
+    if (ThisBuffer->hSpill == NULL) {
+        return SpongeWriteBuffer(ThisBuffer->Buffer, ThisBuffer->BytesPopulated, hTarget);
+    }
 
-        if (WriteFile(hTarget,
-                      YoriLibAddToPointer(ThisBuffer->Buffer, BytesSent),
-                      BytesToWrite,
-                      &BytesWritten,
-                      NULL)) {
+    //
+    //  The temporary file handle is opened for write only, so close it and
+    //  reopen it to read the contents back.
+    //
 
-            BytesSent += BytesWritten;
-        } else {
-            Result = FALSE;
+    CloseHandle(ThisBuffer->hSpill);
+    ThisBuffer->hSpill = NULL;
+
+    hSpill = CreateFile(ThisBuffer->SpillFileName.StartOfString,
+                        GENERIC_READ,
+                        FILE_SHARE_READ | FILE_SHARE_DELETE,
+                        NULL,
+                        OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                        NULL);
+
+    if (hSpill == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    while (TRUE) {
+        if (!ReadFile(hSpill, ThisBuffer->Buffer, ThisBuffer->BytesAllocated, &BytesRead, NULL) ||
+            BytesRead == 0) {
+
+            break;
         }
 
-        ASSERT(BytesSent <= ThisBuffer->BytesPopulated);
+        if (!SpongeWriteBuffer(ThisBuffer->Buffer, BytesRead, hTarget)) {
+            CloseHandle(hSpill);
+            return FALSE;
+        }
     }
 
-    return Result;
+    CloseHandle(hSpill);
+    return TRUE;
+}
+
+/**
+ Replace the target file with the temporary file that input has been
+ spilled to.  The temporary file is in the same directory as the target, so
+ this is a rename which leaves either the old contents or the new contents
+ in place, and the target is not modified until all input has been read.
+
+ @param ThisBuffer Pointer to the buffer which has spilled input.
+
+ @param TargetFileName Pointer to the full path of the target file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeBufferReplaceTarget(
+    __in PSPONGE_BUFFER ThisBuffer,
+    __in PYORI_STRING TargetFileName
+    )
+{
+    ASSERT(ThisBuffer->hSpill != NULL);
+
+    if (!FlushFileBuffers(ThisBuffer->hSpill)) {
+        return FALSE;
+    }
+
+    CloseHandle(ThisBuffer->hSpill);
+    ThisBuffer->hSpill = NULL;
+
+    if (!MoveFileEx(ThisBuffer->SpillFileName.StartOfString, TargetFileName->StartOfString, MOVEFILE_REPLACE_EXISTING)) {
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&ThisBuffer->SpillFileName);
+    return TRUE;
 }
 
 /**
@@ -207,7 +405,9 @@ SpongeAllocateBuffer(
 }
 
 /**
- Free structures associated with a single input stream.
+ Free structures associated with a single input stream.  If input was
+ spilled to a temporary file which has not been renamed over the target,
+ the temporary file is deleted.
 
  @param ThisBuffer Pointer to the single stream's buffers to deallocate.
  */
@@ -216,11 +416,90 @@ SpongeFreeBuffer(
     __in PSPONGE_BUFFER ThisBuffer
     )
 {
+    if (ThisBuffer->hSpill != NULL) {
+        CloseHandle(ThisBuffer->hSpill);
+        ThisBuffer->hSpill = NULL;
+    }
+    if (ThisBuffer->SpillFileName.LengthInChars > 0) {
+        DeleteFile(ThisBuffer->SpillFileName.StartOfString);
+    }
+    YoriLibFreeStringContents(&ThisBuffer->SpillFileName);
+    YoriLibFreeStringContents(&ThisBuffer->SpillDirectory);
     if (ThisBuffer->Buffer != NULL) {
         YoriLibFree(ThisBuffer->Buffer);
     }
 }
 
+/**
+ Determine the directory to create a temporary file in if input needs to be
+ spilled.  If a target file is specified, this is its parent directory so
+ the temporary file can be renamed over it.  Otherwise it is the system
+ temporary directory.
+
+ @param ThisBuffer Pointer to the buffer to update with the directory.
+
+ @param TargetFileName Pointer to the full path to the target file, or an
+        empty string if output is to standard output.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeSetSpillDirectory(
+    __in PSPONGE_BUFFER ThisBuffer,
+    __in PYORI_STRING TargetFileName
+    )
+{
+    DWORD Index;
+
+    if (TargetFileName->LengthInChars > 0) {
+        for (Index = TargetFileName->LengthInChars; Index > 0; Index--) {
+            if (YoriLibIsSep(TargetFileName->StartOfString[Index - 1])) {
+                break;
+            }
+        }
+
+        if (Index == 0) {
+            return FALSE;
+        }
+
+        if (!YoriLibAllocateString(&ThisBuffer->SpillDirectory, Index)) {
+            return FALSE;
+        }
+        memcpy(ThisBuffer->SpillDirectory.StartOfString, TargetFileName->StartOfString, (Index - 1) * sizeof(TCHAR));
+        ThisBuffer->SpillDirectory.LengthInChars = Index - 1;
+        ThisBuffer->SpillDirectory.StartOfString[Index - 1] = '\0';
+        return TRUE;
+    }
+
+    Index = GetTempPath(0, NULL);
+    if (Index == 0) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&ThisBuffer->SpillDirectory, Index)) {
+        return FALSE;
+    }
+    ThisBuffer->SpillDirectory.LengthInChars = GetTempPath(ThisBuffer->SpillDirectory.LengthAllocated, ThisBuffer->SpillDirectory.StartOfString);
+    if (ThisBuffer->SpillDirectory.LengthInChars == 0 ||
+        ThisBuffer->SpillDirectory.LengthInChars >= ThisBuffer->SpillDirectory.LengthAllocated) {
+
+        YoriLibFreeStringContents(&ThisBuffer->SpillDirectory);
+        return FALSE;
+    }
+
+    //
+    //  Remove the trailing seperator, since one is added when generating
+    //  the temporary file name.
+    //
+
+    if (YoriLibIsSep(ThisBuffer->SpillDirectory.StartOfString[ThisBuffer->SpillDirectory.LengthInChars - 1])) {
+        ThisBuffer->SpillDirectory.LengthInChars--;
+        ThisBuffer->SpillDirectory.StartOfString[ThisBuffer->SpillDirectory.LengthInChars] = '\0';
+    }
+
+    return TRUE;
+}
+
 
 #ifdef YORI_BUILTIN
 /**
@@ -256,8 +535,10 @@ ENTRYPOINT(
     SPONGE_BUFFER SpongeBuffer;
     YORI_STRING FullFilePath;
     HANDLE hTarget;
+    LARGE_INTEGER MemoryLimit;
 
     ZeroMemory(&SpongeBuffer, sizeof(SpongeBuffer));
+    SpongeBuffer.MemoryLimit = SPONGE_DEFAULT_MEMORY_LIMIT;
 
     for (i = 1; i < ArgC; i++) {
 
@@ -271,6 +552,15 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("license")) == 0) {
                 YoriLibDisplayMitLicense(_T("2019"));
                 return EXIT_SUCCESS;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("m")) == 0) {
+                if (i + 1 < ArgC) {
+                    MemoryLimit = YoriLibStringToFileSize(&ArgV[i + 1]);
+                    if (MemoryLimit.QuadPart >= 1024 && MemoryLimit.HighPart == 0 && MemoryLimit.LowPart < ((DWORD)-1) / 4) {
+                        SpongeBuffer.MemoryLimit = MemoryLimit.LowPart;
+                        ArgumentUnderstood = TRUE;
+                        i++;
+                    }
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("-")) == 0) {
                 ArgumentUnderstood = TRUE;
                 StartArg = i + 1;
@@ -311,11 +601,39 @@ ENTRYPOINT(
         }
     }
 
+    //
+    //  If no directory can be found to spill input to, input is limited to
+    //  what can be held in memory.
+    //
+
+    SpongeSetSpillDirectory(&SpongeBuffer, &FullFilePath);
+
     if (!SpongeBufferPump(&SpongeBuffer)) {
+        YoriLibFreeStringContents(&FullFilePath);
         SpongeFreeBuffer(&SpongeBuffer);
         return EXIT_FAILURE;
     }
 
+    //
+    //  If input was spilled to a temporary file beside the target, rename
+    //  it over the target rather than copying it.
+    //
+
+    if (FullFilePath.LengthInChars > 0 && SpongeBuffer.hSpill != NULL) {
+        if (!SpongeBufferReplaceTarget(&SpongeBuffer, &FullFilePath)) {
+            DWORD LastError = GetLastError();
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: replace of %y failed: %s"), &FullFilePath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            YoriLibFreeStringContents(&FullFilePath);
+            SpongeFreeBuffer(&SpongeBuffer);
+            return EXIT_FAILURE;
+        }
+        YoriLibFreeStringContents(&FullFilePath);
+        SpongeFreeBuffer(&SpongeBuffer);
+        return EXIT_SUCCESS;
+    }
+
     if (FullFilePath.LengthInChars > 0) {
         hTarget = CreateFile(FullFilePath.StartOfString,
                              GENERIC_WRITE,
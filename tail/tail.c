@@ -59,6 +59,150 @@ TailHelp()
     return TRUE;
 }
 
+/**
+ The maximum number of directories that can be watched for changes at once.
+ This is bounded by the number of objects that can be waited on, less one
+ for the cancel event.  Files in directories beyond this are polled.
+ */
+#define TAIL_MAX_WATCHED_DIRECTORIES (MAXIMUM_WAIT_OBJECTS - 1)
+
+/**
+ The interval, in milliseconds, to check for changes to files which cannot
+ be watched via directory change notifications.
+ */
+#define TAIL_FOLLOW_POLL_INTERVAL (200)
+
+/**
+ The interval, in milliseconds, to check all files even when they are being
+ watched.  File systems can defer updating directory entries for files that
+ a writer holds open, which delays notifications for their size changes.
+ */
+#define TAIL_FOLLOW_RESCAN_INTERVAL (5000)
+
+/**
+ The size of the buffer used to receive directory change notifications.
+ */
+#define TAIL_NOTIFY_BUFFER_SIZE (16 * 1024)
+
+/**
+ The size of each block read when scanning backwards from the end of a file
+ to find the start of the lines to display.
+ */
+#define TAIL_REVERSE_SCAN_BLOCK_SIZE (64 * 1024)
+
+/**
+ A directory containing one or more files that are being followed.
+ */
+typedef struct _TAIL_FOLLOW_DIRECTORY {
+
+    /**
+     The link for this directory within the list of watched directories.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The full path to the directory.
+     */
+    YORI_STRING DirectoryPath;
+
+    /**
+     A handle to the directory opened for ReadDirectoryChangesW, or
+     INVALID_HANDLE_VALUE if a change notification handle is used instead.
+     */
+    HANDLE DirectoryHandle;
+
+    /**
+     The handle to wait on.  This is the event used for overlapped
+     ReadDirectoryChangesW requests or a change notification handle.
+     */
+    HANDLE WaitHandle;
+
+    /**
+     The overlapped structure used for ReadDirectoryChangesW requests.
+     */
+    OVERLAPPED Overlapped;
+
+    /**
+     The buffer to receive change records from ReadDirectoryChangesW.
+     */
+    PVOID Buffer;
+
+    /**
+     TRUE if notifications are being received for this directory.  FALSE if
+     they could not be reissued and files within it must be polled.
+     */
+    BOOLEAN Active;
+
+} TAIL_FOLLOW_DIRECTORY, *PTAIL_FOLLOW_DIRECTORY;
+
+/**
+ A file that is being followed.
+ */
+typedef struct _TAIL_FOLLOW_FILE {
+
+    /**
+     The link for this file within the list of followed files.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The full path to the file, used to detect when the file is replaced.
+     */
+    YORI_STRING FilePath;
+
+    /**
+     The final component of FilePath, used to match change records.
+     */
+    YORI_STRING FileName;
+
+    /**
+     The path to display in headers and messages.
+     */
+    YORI_STRING DisplayName;
+
+    /**
+     The currently opened handle to the file.
+     */
+    HANDLE FileHandle;
+
+    /**
+     The line read context for FileHandle.
+     */
+    PVOID LineContext;
+
+    /**
+     The directory being watched for changes to this file, or NULL if the
+     file is polled.
+     */
+    PTAIL_FOLLOW_DIRECTORY Directory;
+
+    /**
+     The volume serial number of the opened file.
+     */
+    DWORD VolumeSerialNumber;
+
+    /**
+     The high 32 bits of the file index of the opened file.
+     */
+    DWORD FileIndexHigh;
+
+    /**
+     The low 32 bits of the file index of the opened file.
+     */
+    DWORD FileIndexLow;
+
+    /**
+     TRUE if the file may have new data to display.
+     */
+    BOOLEAN DataChanged;
+
+    /**
+     TRUE if the name may now refer to a different file.
+     */
+    BOOLEAN NameChanged;
+
+} TAIL_FOLLOW_FILE, *PTAIL_FOLLOW_FILE;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
@@ -117,8 +261,164 @@ typedef struct _TAIL_CONTEXT {
      */
     BOOLEAN Recursive;
 
+    /**
+     A list of files to follow once all arguments have been processed.
+     */
+    YORI_LIST_ENTRY FollowList;
+
+    /**
+     The number of entries in FollowList.
+     */
+    DWORD FollowCount;
+
+    /**
+     A list of directories being watched for changes to followed files.
+     */
+    YORI_LIST_ENTRY DirectoryList;
+
+    /**
+     The number of entries in DirectoryList.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     The followed file that most recently had a header displayed, used to
+     determine when output switches between files.
+     */
+    PTAIL_FOLLOW_FILE LastFileDisplayed;
+
 } TAIL_CONTEXT, *PTAIL_CONTEXT;
 
+/**
+ Scan backwards from the end of a file to find the offset where the final
+ lines to display begin.  The file is read in fixed size blocks from the end
+ towards the start, counting line terminators until enough have been found,
+ so the region to display is only read once more when it is output.  A line
+ is terminated by a line feed, a carriage return, or both together, which
+ matches the line reader.
+
+ @param hSource The opened source file.
+
+ @param TailContext Pointer to context information specifying which lines to
+        display.
+
+ @param StartOffset On successful completion, updated to contain the offset
+        within the file of the first line to display.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+TailFindStartOfFinalLines(
+    __in HANDLE hSource,
+    __in PTAIL_CONTEXT TailContext,
+    __out PLARGE_INTEGER StartOffset
+    )
+{
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER BlockOffset;
+    PUCHAR Buffer;
+    PWCHAR WideBuffer;
+    DWORD BlockLength;
+    DWORD BytesRead;
+    DWORD CharSize;
+    DWORD CharsInBlock;
+    DWORD Index;
+    DWORD TerminatorsFound;
+    DWORD TerminatorsNeeded;
+    WCHAR ThisChar;
+    WCHAR NextChar;
+    BOOLEAN FinalCharSeen;
+
+    FileSize.LowPart = GetFileSize(hSource, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return FALSE;
+    }
+
+    CharSize = sizeof(UCHAR);
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        CharSize = sizeof(WCHAR);
+        FileSize.QuadPart = FileSize.QuadPart & ~((LONGLONG)(sizeof(WCHAR) - 1));
+    }
+
+    Buffer = YoriLibMalloc(TAIL_REVERSE_SCAN_BLOCK_SIZE);
+    if (Buffer == NULL) {
+        return FALSE;
+    }
+    WideBuffer = (PWCHAR)Buffer;
+
+    //
+    //  Each line to display needs a terminator before it, other than the
+    //  first line in the file.  A terminator at the very end of the file
+    //  ends the final line rather than starting a new one, and if not
+    //  waiting for more data, a final line without a terminator will be
+    //  displayed and counts as one of the lines.
+    //
+
+    TerminatorsNeeded = TailContext->LinesToDisplay;
+    TerminatorsFound = 0;
+    FinalCharSeen = FALSE;
+    NextChar = '\0';
+    StartOffset->QuadPart = 0;
+    BlockOffset.QuadPart = FileSize.QuadPart;
+
+    while (BlockOffset.QuadPart > 0) {
+
+        BlockLength = TAIL_REVERSE_SCAN_BLOCK_SIZE;
+        if (BlockOffset.QuadPart < BlockLength) {
+            BlockLength = BlockOffset.LowPart;
+        }
+        BlockOffset.QuadPart = BlockOffset.QuadPart - BlockLength;
+
+        if (SetFilePointer(hSource, BlockOffset.LowPart, &BlockOffset.HighPart, FILE_BEGIN) == INVALID_FILE_SIZE &&
+            GetLastError() != NO_ERROR) {
+
+            YoriLibFree(Buffer);
+            return FALSE;
+        }
+
+        if (!ReadFile(hSource, Buffer, BlockLength, &BytesRead, NULL) ||
+            BytesRead != BlockLength) {
+
+            YoriLibFree(Buffer);
+            return FALSE;
+        }
+
+        CharsInBlock = BlockLength / CharSize;
+        for (Index = CharsInBlock; Index > 0; Index--) {
+            if (CharSize == sizeof(WCHAR)) {
+                ThisChar = WideBuffer[Index - 1];
+            } else {
+                ThisChar = Buffer[Index - 1];
+            }
+
+            if (!FinalCharSeen) {
+                FinalCharSeen = TRUE;
+                if (ThisChar == '\n' || ThisChar == '\r') {
+                    TerminatorsNeeded++;
+                } else if (TailContext->WaitForMore) {
+                    TerminatorsNeeded++;
+                }
+            }
+
+            if (ThisChar == '\n' ||
+                (ThisChar == '\r' && NextChar != '\n')) {
+
+                TerminatorsFound++;
+                if (TerminatorsFound == TerminatorsNeeded) {
+                    StartOffset->QuadPart = BlockOffset.QuadPart + Index * CharSize;
+                    YoriLibFree(Buffer);
+                    return TRUE;
+                }
+            }
+
+            NextChar = ThisChar;
+        }
+    }
+
+    YoriLibFree(Buffer);
+    return TRUE;
+}
+
 /**
  Process a single opened stream, enumerating through all lines and displaying
  the set requested by the user.
@@ -127,109 +427,756 @@ typedef struct _TAIL_CONTEXT {
 
  @param TailContext Pointer to context information specifying which lines to
         display.
- 
+
+ @param LineContext Pointer to a line read context, which should point to
+        NULL on entry.  On completion this is updated to the line read
+        context positioned after the final line displayed, so that
+        following the stream can resume from it.  The caller is responsible
+        for closing it with YoriLibLineReadClose.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 TailProcessStream(
     __in HANDLE hSource,
-    __in PTAIL_CONTEXT TailContext
+    __in PTAIL_CONTEXT TailContext,
+    __inout PVOID * LineContext
     )
 {
-    PVOID LineContext = NULL;
     DWORDLONG StartLine = 0;
     DWORDLONG CurrentLine;
     PYORI_STRING LineString;
     YORI_LIB_LINE_ENDING LineEnding;
     BOOL TimeoutReached;
-    DWORD SeekToEndOffset = 0;
+    LARGE_INTEGER StartOffset;
 
     DWORD FileType = GetFileType(hSource);
     FileType = FileType & ~(FILE_TYPE_REMOTE);
 
+    TailContext->LinesFound = 0;
+
     //
-    //  If it's a file and we want the final few lines, start searching
-    //  from the end, assuming an average line size of 256 bytes.
+    //  If it's a file and we want the final few lines, scan backwards
+    //  from the end to find where they start, then output each line as it
+    //  is read from that point.  Only the requested number of lines are
+    //  output, so if the file grows in the meantime, any new lines are
+    //  left for following the file to display.  If the scan fails, read
+    //  the whole file, keeping the most recent lines.
     //
 
     if (FileType == FILE_TYPE_DISK && TailContext->FinalLine == 0) {
-        SeekToEndOffset = 256 * TailContext->LinesToDisplay;
+        if (TailFindStartOfFinalLines(hSource, TailContext, &StartOffset) &&
+            (SetFilePointer(hSource, StartOffset.LowPart, &StartOffset.HighPart, FILE_BEGIN) != INVALID_FILE_SIZE ||
+             GetLastError() == NO_ERROR)) {
+
+            while (TailContext->LinesFound < TailContext->LinesToDisplay) {
+                if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[0], LineContext, !TailContext->WaitForMore, INFINITE, hSource, &LineEnding, &TimeoutReached)) {
+                    break;
+                }
+
+                TailContext->LinesFound++;
+                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
+            }
+
+            return TRUE;
+        }
+
+        SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
+    }
+
+    while (TRUE) {
+
+        if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[TailContext->LinesFound % TailContext->LinesToDisplay], LineContext, !TailContext->WaitForMore, INFINITE, hSource, &LineEnding, &TimeoutReached)) {
+            break;
+        }
+
+        TailContext->LinesFound++;
+
+        if (TailContext->FinalLine != 0 && TailContext->LinesFound >= TailContext->FinalLine) {
+            break;
+        }
     }
 
-    TailContext->FilesFound++;
-    TailContext->FilesFoundThisArg++;
+    if (TailContext->LinesFound > TailContext->LinesToDisplay) {
+        StartLine = TailContext->LinesFound - TailContext->LinesToDisplay;
+    }
+
+    for (CurrentLine = StartLine; CurrentLine < TailContext->LinesFound; CurrentLine++) {
+        LineString = &TailContext->LinesArray[CurrentLine % TailContext->LinesToDisplay];
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), LineString);
+    }
+
+    return TRUE;
+}
+
+/**
+ Continue outputting lines from a stream which has no path that can be
+ watched for changes, such as standard input.  Pipes are waited on by the
+ line reader, so this returns when the writer closes the pipe.  Other
+ streams are polled.
+
+ @param hSource The opened source stream.
+
+ @param TailContext Pointer to the tail context.
+
+ @param LineContext Pointer to the line read context returned from
+        TailProcessStream.
+ */
+VOID
+TailFollowStream(
+    __in HANDLE hSource,
+    __in PTAIL_CONTEXT TailContext,
+    __inout PVOID * LineContext
+    )
+{
+    YORI_LIB_LINE_ENDING LineEnding;
+    BOOL TimeoutReached;
+    DWORD FileType;
+
+    FileType = GetFileType(hSource);
+    FileType = FileType & ~(FILE_TYPE_REMOTE);
 
     while (TRUE) {
 
-        if (SeekToEndOffset != 0) {
-            if (!SetFilePointer(hSource, -1 * SeekToEndOffset, NULL, FILE_END)) {
-                SeekToEndOffset = 0;
-                SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
+        if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[0], LineContext, FALSE, INFINITE, hSource, &LineEnding, &TimeoutReached)) {
+            if (YoriLibIsOperationCancelled() || FileType == FILE_TYPE_PIPE) {
+                break;
+            }
+            Sleep(TAIL_FOLLOW_POLL_INTERVAL);
+            continue;
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
+    }
+}
+
+/**
+ Issue a request to be notified about changes within a watched directory.
+
+ @param Directory Pointer to the directory to watch.
+
+ @return TRUE if the request was issued, FALSE if it was not.
+ */
+BOOL
+TailIssueDirectoryRead(
+    __in PTAIL_FOLLOW_DIRECTORY Directory
+    )
+{
+    if (!DllKernel32.pReadDirectoryChangesW(Directory->DirectoryHandle,
+                                            Directory->Buffer,
+                                            TAIL_NOTIFY_BUFFER_SIZE,
+                                            FALSE,
+                                            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                            NULL,
+                                            &Directory->Overlapped,
+                                            NULL)) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Free a watched directory, cancelling any outstanding notification request.
+
+ @param Directory Pointer to the directory to free.
+ */
+VOID
+TailFreeDirectory(
+    __in PTAIL_FOLLOW_DIRECTORY Directory
+    )
+{
+    if (Directory->DirectoryHandle != INVALID_HANDLE_VALUE) {
+
+        //
+        //  Closing the handle cancels the request.  Wait for it to drain
+        //  before the buffer and event are freed.
+        //
+
+        CloseHandle(Directory->DirectoryHandle);
+        if (Directory->Active) {
+            WaitForSingleObject(Directory->WaitHandle, INFINITE);
+        }
+        if (Directory->WaitHandle != NULL) {
+            CloseHandle(Directory->WaitHandle);
+        }
+    } else if (Directory->WaitHandle != NULL) {
+        FindCloseChangeNotification(Directory->WaitHandle);
+    }
+
+    if (Directory->Buffer != NULL) {
+        YoriLibFree(Directory->Buffer);
+    }
+    YoriLibFreeStringContents(&Directory->DirectoryPath);
+    YoriLibFree(Directory);
+}
+
+/**
+ Find the watched directory for a parent path, or start watching it if it
+ is not watched already.  ReadDirectoryChangesW is used where available
+ so that changes can be attributed to individual files; otherwise a change
+ notification handle is used.
+
+ @param TailContext Pointer to the tail context.
+
+ @param DirectoryPath Pointer to the full path of the directory.
+
+ @return Pointer to the watched directory, or NULL if it cannot be watched
+         and files within it must be polled.
+ */
+PTAIL_FOLLOW_DIRECTORY
+TailFindOrWatchDirectory(
+    __in PTAIL_CONTEXT TailContext,
+    __in PYORI_STRING DirectoryPath
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PTAIL_FOLLOW_DIRECTORY Directory;
+
+    ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_DIRECTORY, ListEntry);
+        if (YoriLibCompareStringInsensitive(&Directory->DirectoryPath, DirectoryPath) == 0) {
+            return Directory;
+        }
+        ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, ListEntry);
+    }
+
+    if (TailContext->DirectoryCount >= TAIL_MAX_WATCHED_DIRECTORIES) {
+        return NULL;
+    }
+
+    Directory = YoriLibMalloc(sizeof(TAIL_FOLLOW_DIRECTORY));
+    if (Directory == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Directory, sizeof(TAIL_FOLLOW_DIRECTORY));
+    Directory->DirectoryHandle = INVALID_HANDLE_VALUE;
+
+    if (!YoriLibAllocateString(&Directory->DirectoryPath, DirectoryPath->LengthInChars + 1)) {
+        YoriLibFree(Directory);
+        return NULL;
+    }
+    memcpy(Directory->DirectoryPath.StartOfString, DirectoryPath->StartOfString, DirectoryPath->LengthInChars * sizeof(TCHAR));
+    Directory->DirectoryPath.LengthInChars = DirectoryPath->LengthInChars;
+    Directory->DirectoryPath.StartOfString[DirectoryPath->LengthInChars] = '\0';
+
+    if (DllKernel32.pReadDirectoryChangesW != NULL) {
+        Directory->Buffer = YoriLibMalloc(TAIL_NOTIFY_BUFFER_SIZE);
+        Directory->WaitHandle = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (Directory->Buffer != NULL && Directory->WaitHandle != NULL) {
+            Directory->Overlapped.hEvent = Directory->WaitHandle;
+            Directory->DirectoryHandle = CreateFile(Directory->DirectoryPath.StartOfString,
+                                                    FILE_LIST_DIRECTORY,
+                                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                                    NULL,
+                                                    OPEN_EXISTING,
+                                                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                                    NULL);
+            if (Directory->DirectoryHandle != INVALID_HANDLE_VALUE) {
+                if (TailIssueDirectoryRead(Directory)) {
+                    Directory->Active = TRUE;
+                } else {
+                    CloseHandle(Directory->DirectoryHandle);
+                    Directory->DirectoryHandle = INVALID_HANDLE_VALUE;
+                }
+            }
+        }
+
+        if (!Directory->Active) {
+            if (Directory->WaitHandle != NULL) {
+                CloseHandle(Directory->WaitHandle);
+                Directory->WaitHandle = NULL;
+            }
+            if (Directory->Buffer != NULL) {
+                YoriLibFree(Directory->Buffer);
+                Directory->Buffer = NULL;
             }
         }
-        TailContext->LinesFound = 0;
+    }
+
+    if (!Directory->Active) {
+        Directory->WaitHandle = FindFirstChangeNotification(Directory->DirectoryPath.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+        if (Directory->WaitHandle == INVALID_HANDLE_VALUE) {
+            Directory->WaitHandle = NULL;
+            TailFreeDirectory(Directory);
+            return NULL;
+        }
+        Directory->Active = TRUE;
+    }
 
+    YoriLibAppendList(&TailContext->DirectoryList, &Directory->ListEntry);
+    TailContext->DirectoryCount++;
+    return Directory;
+}
+
+/**
+ Add an opened file to the set of files to follow once all arguments have
+ been processed.  On success, the file handle is owned by the follow list.
+
+ @param TailContext Pointer to the tail context.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @param FileHandle The opened handle to the file.
+
+ @return TRUE if the file was added, FALSE if it was not.
+ */
+BOOL
+TailAddFollowFile(
+    __in PTAIL_CONTEXT TailContext,
+    __in PYORI_STRING FilePath,
+    __in HANDLE FileHandle
+    )
+{
+    PTAIL_FOLLOW_FILE FollowFile;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    YORI_STRING DirectoryPath;
+    LPTSTR FinalSeperator;
+
+    FollowFile = YoriLibMalloc(sizeof(TAIL_FOLLOW_FILE) + (FilePath->LengthInChars + 1) * sizeof(TCHAR));
+    if (FollowFile == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(FollowFile, sizeof(TAIL_FOLLOW_FILE));
+    YoriLibInitEmptyString(&FollowFile->FilePath);
+    FollowFile->FilePath.StartOfString = (LPTSTR)(FollowFile + 1);
+    memcpy(FollowFile->FilePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    FollowFile->FilePath.LengthInChars = FilePath->LengthInChars;
+    FollowFile->FilePath.LengthAllocated = FilePath->LengthInChars + 1;
+    FollowFile->FilePath.StartOfString[FilePath->LengthInChars] = '\0';
+
+    YoriLibInitEmptyString(&FollowFile->DisplayName);
+    if (!YoriLibUnescapePath(&FollowFile->FilePath, &FollowFile->DisplayName)) {
+        FollowFile->DisplayName.StartOfString = FollowFile->FilePath.StartOfString;
+        FollowFile->DisplayName.LengthInChars = FollowFile->FilePath.LengthInChars;
+    }
+
+    FollowFile->FileHandle = FileHandle;
+    if (GetFileInformationByHandle(FileHandle, &FileInfo)) {
+        FollowFile->VolumeSerialNumber = FileInfo.dwVolumeSerialNumber;
+        FollowFile->FileIndexHigh = FileInfo.nFileIndexHigh;
+        FollowFile->FileIndexLow = FileInfo.nFileIndexLow;
+    }
+
+    //
+    //  Split the path into the directory to watch and the name to look
+    //  for in change records.  If the parent is the root, keep the
+    //  trailing seperator so the directory is opened rather than the
+    //  volume.
+    //
+
+    YoriLibInitEmptyString(&FollowFile->FileName);
+    YoriLibInitEmptyString(&DirectoryPath);
+    FinalSeperator = YoriLibFindRightMostCharacter(&FollowFile->FilePath, '\\');
+    if (FinalSeperator != NULL) {
+        DirectoryPath.StartOfString = FollowFile->FilePath.StartOfString;
+        DirectoryPath.LengthInChars = (DWORD)(FinalSeperator - DirectoryPath.StartOfString);
+        FollowFile->FileName.StartOfString = FinalSeperator + 1;
+        FollowFile->FileName.LengthInChars = FollowFile->FilePath.LengthInChars - DirectoryPath.LengthInChars - 1;
+        if (DirectoryPath.LengthInChars > 0 &&
+            DirectoryPath.StartOfString[DirectoryPath.LengthInChars - 1] == ':') {
+
+            DirectoryPath.LengthInChars++;
+        }
+
+        FollowFile->Directory = TailFindOrWatchDirectory(TailContext, &DirectoryPath);
+    }
+
+    YoriLibAppendList(&TailContext->FollowList, &FollowFile->ListEntry);
+    TailContext->FollowCount++;
+    return TRUE;
+}
+
+/**
+ If more than one file is being followed and output is switching to a
+ different file, display a header indicating which file subsequent lines
+ are from.
+
+ @param TailContext Pointer to the tail context.
+
+ @param FollowFile Pointer to the file whose lines are about to be displayed.
+ */
+VOID
+TailDisplayFollowHeader(
+    __in PTAIL_CONTEXT TailContext,
+    __in PTAIL_FOLLOW_FILE FollowFile
+    )
+{
+    if (TailContext->FollowCount <= 1 || TailContext->LastFileDisplayed == FollowFile) {
+        return;
+    }
+
+    if (TailContext->LastFileDisplayed != NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n"));
+    }
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("==> %y <==\n"), &FollowFile->DisplayName);
+    TailContext->LastFileDisplayed = FollowFile;
+}
+
+/**
+ Display any complete lines that have been appended to a followed file.
+
+ @param TailContext Pointer to the tail context.
+
+ @param FollowFile Pointer to the followed file.
+
+ @param ReturnFinalNonTerminatedLine If TRUE, display any trailing data
+        that is not followed by a line ending.  This is used when the file
+        will not be read any further.
+ */
+VOID
+TailOutputNewLines(
+    __in PTAIL_CONTEXT TailContext,
+    __in PTAIL_FOLLOW_FILE FollowFile,
+    __in BOOL ReturnFinalNonTerminatedLine
+    )
+{
+    YORI_LIB_LINE_ENDING LineEnding;
+    BOOL TimeoutReached;
+
+    while (TRUE) {
+        if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[0], &FollowFile->LineContext, ReturnFinalNonTerminatedLine, INFINITE, FollowFile->FileHandle, &LineEnding, &TimeoutReached)) {
+            break;
+        }
+        TailDisplayFollowHeader(TailContext, FollowFile);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
+    }
+}
+
+/**
+ Check whether the name of a followed file now refers to a different file,
+ which happens when logs are rotated.  If so, display everything remaining
+ in the previous file and continue from the start of the new one.  If the
+ name does not currently exist, keep following the previous file until a
+ new one is created.
+
+ @param TailContext Pointer to the tail context.
+
+ @param FollowFile Pointer to the followed file.
+ */
+VOID
+TailCheckForReplacement(
+    __in PTAIL_CONTEXT TailContext,
+    __in PTAIL_FOLLOW_FILE FollowFile
+    )
+{
+    HANDLE NewHandle;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+
+    NewHandle = CreateFile(FollowFile->FilePath.StartOfString,
+                           GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                           NULL);
+
+    if (NewHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (!GetFileInformationByHandle(NewHandle, &FileInfo) ||
+        (FileInfo.dwVolumeSerialNumber == FollowFile->VolumeSerialNumber &&
+         FileInfo.nFileIndexHigh == FollowFile->FileIndexHigh &&
+         FileInfo.nFileIndexLow == FollowFile->FileIndexLow)) {
+
+        CloseHandle(NewHandle);
+        return;
+    }
+
+    TailOutputNewLines(TailContext, FollowFile, TRUE);
+    YoriLibLineReadClose(FollowFile->LineContext);
+    FollowFile->LineContext = NULL;
+    CloseHandle(FollowFile->FileHandle);
+
+    FollowFile->FileHandle = NewHandle;
+    FollowFile->VolumeSerialNumber = FileInfo.dwVolumeSerialNumber;
+    FollowFile->FileIndexHigh = FileInfo.nFileIndexHigh;
+    FollowFile->FileIndexLow = FileInfo.nFileIndexLow;
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("tail: %y has been replaced; following new file\n"), &FollowFile->DisplayName);
+}
+
+/**
+ Check whether a followed file has been truncated to less than the data
+ that has already been read from it.  If so, discard any partial line and
+ continue from the start of the file.
+
+ @param FollowFile Pointer to the followed file.
+ */
+VOID
+TailCheckForTruncation(
+    __in PTAIL_FOLLOW_FILE FollowFile
+    )
+{
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER Position;
+
+    FileSize.LowPart = GetFileSize(FollowFile->FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return;
+    }
+
+    Position.HighPart = 0;
+    Position.LowPart = SetFilePointer(FollowFile->FileHandle, 0, &Position.HighPart, FILE_CURRENT);
+    if (Position.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return;
+    }
+
+    if (FileSize.QuadPart < Position.QuadPart) {
+        YoriLibLineReadClose(FollowFile->LineContext);
+        FollowFile->LineContext = NULL;
+        SetFilePointer(FollowFile->FileHandle, 0, NULL, FILE_BEGIN);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("tail: %y: file truncated\n"), &FollowFile->DisplayName);
+    }
+}
+
+/**
+ Process the change records returned for a watched directory, marking each
+ followed file they refer to as changed.  If the records were lost because
+ the buffer overflowed, every followed file in the directory is marked.
+
+ @param TailContext Pointer to the tail context.
+
+ @param Directory Pointer to the directory whose notification completed.
+ */
+VOID
+TailProcessDirectoryChanges(
+    __in PTAIL_CONTEXT TailContext,
+    __in PTAIL_FOLLOW_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PTAIL_FOLLOW_FILE FollowFile;
+    PFILE_NOTIFY_INFORMATION Notify;
+    YORI_STRING ChangedName;
+    DWORD BytesReturned;
+    BOOL RecordsValid;
+
+    RecordsValid = FALSE;
+    if (Directory->DirectoryHandle != INVALID_HANDLE_VALUE) {
+        if (GetOverlappedResult(Directory->DirectoryHandle, &Directory->Overlapped, &BytesReturned, FALSE) &&
+            BytesReturned > 0) {
+
+            RecordsValid = TRUE;
+        }
+    }
+
+    if (RecordsValid) {
+        YoriLibInitEmptyString(&ChangedName);
+        Notify = Directory->Buffer;
         while (TRUE) {
+            ChangedName.StartOfString = Notify->FileName;
+            ChangedName.LengthInChars = Notify->FileNameLength / sizeof(WCHAR);
+
+            ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+            while (ListEntry != NULL) {
+                FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+                if (FollowFile->Directory == Directory &&
+                    YoriLibCompareStringInsensitive(&FollowFile->FileName, &ChangedName) == 0) {
+
+                    FollowFile->DataChanged = TRUE;
+                    if (Notify->Action != FILE_ACTION_MODIFIED) {
+                        FollowFile->NameChanged = TRUE;
+                    }
+                }
+                ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
+            }
 
-            if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[TailContext->LinesFound % TailContext->LinesToDisplay], &LineContext, !TailContext->WaitForMore, INFINITE, hSource, &LineEnding, &TimeoutReached)) {
+            if (Notify->NextEntryOffset == 0) {
                 break;
             }
+            Notify = YoriLibAddToPointer(Notify, Notify->NextEntryOffset);
+        }
+    } else {
+        ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+        while (ListEntry != NULL) {
+            FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+            if (FollowFile->Directory == Directory) {
+                FollowFile->DataChanged = TRUE;
+                FollowFile->NameChanged = TRUE;
+            }
+            ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
+        }
+    }
+
+    //
+    //  Ask for the next set of changes.  If that fails, files in this
+    //  directory revert to being polled.
+    //
+
+    if (Directory->DirectoryHandle != INVALID_HANDLE_VALUE) {
+        if (!TailIssueDirectoryRead(Directory)) {
+            Directory->Active = FALSE;
+        }
+    } else {
+        if (!FindNextChangeNotification(Directory->WaitHandle)) {
+            Directory->Active = FALSE;
+        }
+    }
+}
+
+/**
+ Display the final lines of every file in the follow list, then wait for
+ changes and display new lines as they are written.  Files are watched via
+ notifications on their parent directories, and polled only where this is
+ not possible.  This returns when the operation is cancelled.
 
-            TailContext->LinesFound++;
+ @param TailContext Pointer to the tail context.
+ */
+VOID
+TailFollowFiles(
+    __in PTAIL_CONTEXT TailContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PTAIL_FOLLOW_FILE FollowFile;
+    PTAIL_FOLLOW_DIRECTORY Directory;
+    PTAIL_FOLLOW_DIRECTORY WaitDirectories[MAXIMUM_WAIT_OBJECTS];
+    HANDLE WaitHandles[MAXIMUM_WAIT_OBJECTS];
+    DWORD HandleCount;
+    DWORD FirstDirectoryIndex;
+    DWORD Timeout;
+    DWORD WaitResult;
+    BOOL PollRequired;
+    BOOL CheckAll;
+
+    ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+    while (ListEntry != NULL) {
+        FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+        TailDisplayFollowHeader(TailContext, FollowFile);
+        TailProcessStream(FollowFile->FileHandle, TailContext, &FollowFile->LineContext);
+        ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
+    }
+
+    while (TRUE) {
 
-            if (TailContext->FinalLine != 0 && TailContext->LinesFound >= TailContext->FinalLine) {
+        //
+        //  Build the set of handles to wait on.  Any file which is not in
+        //  an actively watched directory means the wait needs to time out
+        //  frequently enough to poll it.
+        //
+
+        HandleCount = 0;
+        if (YoriLibCancelGetEvent() != NULL) {
+            WaitHandles[HandleCount] = YoriLibCancelGetEvent();
+            HandleCount++;
+        }
+        FirstDirectoryIndex = HandleCount;
+
+        ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, NULL);
+        while (ListEntry != NULL) {
+            Directory = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_DIRECTORY, ListEntry);
+            if (Directory->Active) {
+                WaitDirectories[HandleCount] = Directory;
+                WaitHandles[HandleCount] = Directory->WaitHandle;
+                HandleCount++;
+            }
+            ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, ListEntry);
+        }
+
+        PollRequired = FALSE;
+        ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+        while (ListEntry != NULL) {
+            FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+            if (FollowFile->Directory == NULL || !FollowFile->Directory->Active) {
+                PollRequired = TRUE;
                 break;
             }
+            ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
+        }
+
+        if (PollRequired) {
+            Timeout = TAIL_FOLLOW_POLL_INTERVAL;
+        } else {
+            Timeout = TAIL_FOLLOW_RESCAN_INTERVAL;
         }
 
-        if (TailContext->LinesFound > TailContext->LinesToDisplay) {
-            StartLine = TailContext->LinesFound - TailContext->LinesToDisplay;
+        if (HandleCount == 0) {
+            Sleep(Timeout);
+            WaitResult = WAIT_TIMEOUT;
+        } else {
+            WaitResult = WaitForMultipleObjects(HandleCount, WaitHandles, FALSE, Timeout);
+        }
+
+        if (YoriLibIsOperationCancelled()) {
             break;
-        } else if (SeekToEndOffset != 0) {
+        }
 
-            //
-            //  If we didn't get enough lines and we have a file that
-            //  supports arbitrary seeks, try to grab more data.  If
-            //  we've already hit our arbitrary maximum (a 4Kb average
-            //  line size) start scanning from the top.
-            //
+        CheckAll = FALSE;
+        if (WaitResult >= WAIT_OBJECT_0 + FirstDirectoryIndex &&
+            WaitResult < WAIT_OBJECT_0 + HandleCount) {
 
-            if (SeekToEndOffset < 4096 * TailContext->LinesToDisplay) {
-                SeekToEndOffset = 4096 * TailContext->LinesToDisplay;
-            } else {
-                SeekToEndOffset = 0;
-                SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
-            }
-            YoriLibLineReadClose(LineContext);
-            LineContext = NULL;
-            continue;
+            TailProcessDirectoryChanges(TailContext, WaitDirectories[WaitResult - WAIT_OBJECT_0]);
+        } else if (WaitResult == WAIT_TIMEOUT) {
+            CheckAll = TRUE;
         } else {
-            StartLine = 0;
             break;
         }
-    }
 
-    for (CurrentLine = StartLine; CurrentLine < TailContext->LinesFound; CurrentLine++) {
-        LineString = &TailContext->LinesArray[CurrentLine % TailContext->LinesToDisplay];
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), LineString);
-    }
+        ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+        while (ListEntry != NULL) {
+            FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+            if (CheckAll) {
+                FollowFile->DataChanged = TRUE;
+                FollowFile->NameChanged = TRUE;
+            }
 
-    if (TailContext->WaitForMore) {
-        while (TRUE) {
+            if (FollowFile->NameChanged) {
+                FollowFile->NameChanged = FALSE;
+                FollowFile->DataChanged = TRUE;
+                TailCheckForReplacement(TailContext, FollowFile);
+            }
 
-            if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[0], &LineContext, FALSE, INFINITE, hSource, &LineEnding, &TimeoutReached)) {
-                if (YoriLibIsOperationCancelled()) {
-                    break;
-                }
-                Sleep(200);
-                continue;
+            if (FollowFile->DataChanged) {
+                FollowFile->DataChanged = FALSE;
+                TailCheckForTruncation(FollowFile);
+                TailOutputNewLines(TailContext, FollowFile, FALSE);
             }
-            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
+            ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
         }
     }
+}
 
-    YoriLibLineReadClose(LineContext);
-    return TRUE;
+/**
+ Free all files in the follow list and all watched directories.
+
+ @param TailContext Pointer to the tail context.
+ */
+VOID
+TailCleanupFollowList(
+    __in PTAIL_CONTEXT TailContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PTAIL_FOLLOW_FILE FollowFile;
+    PTAIL_FOLLOW_DIRECTORY Directory;
+
+    ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, NULL);
+    while (ListEntry != NULL) {
+        FollowFile = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_FILE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&TailContext->FollowList, ListEntry);
+        YoriLibRemoveListItem(&FollowFile->ListEntry);
+        if (FollowFile->LineContext != NULL) {
+            YoriLibLineReadClose(FollowFile->LineContext);
+        }
+        CloseHandle(FollowFile->FileHandle);
+        YoriLibFreeStringContents(&FollowFile->DisplayName);
+        YoriLibFree(FollowFile);
+    }
+    TailContext->FollowCount = 0;
+
+    ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, TAIL_FOLLOW_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&TailContext->DirectoryList, ListEntry);
+        YoriLibRemoveListItem(&Directory->ListEntry);
+        TailFreeDirectory(Directory);
+    }
+    TailContext->DirectoryCount = 0;
 }
 
 /**
@@ -257,6 +1204,7 @@ TailFileFoundCallback(
     )
 {
     HANDLE FileHandle;
+    PVOID LineContext;
     PTAIL_CONTEXT TailContext = (PTAIL_CONTEXT)Context;
 
     UNREFERENCED_PARAMETER(Depth);
@@ -285,7 +1233,23 @@ TailFileFoundCallback(
         }
 
         TailContext->SavedErrorThisArg = ERROR_SUCCESS;
-        TailProcessStream(FileHandle, TailContext);
+        TailContext->FilesFound++;
+        TailContext->FilesFoundThisArg++;
+
+        //
+        //  When following, files are displayed once all arguments have
+        //  been processed so they can be followed together.
+        //
+
+        if (TailContext->WaitForMore) {
+            if (TailAddFollowFile(TailContext, FilePath, FileHandle)) {
+                return TRUE;
+            }
+        }
+
+        LineContext = NULL;
+        TailProcessStream(FileHandle, TailContext, &LineContext);
+        YoriLibLineReadClose(LineContext);
 
         CloseHandle(FileHandle);
     }
@@ -391,9 +1355,12 @@ ENTRYPOINT(
     TAIL_CONTEXT TailContext;
     LONGLONG ContextLine;
     YORI_STRING Arg;
+    PVOID LineContext;
 
     ZeroMemory(&TailContext, sizeof(TailContext));
     TailContext.LinesToDisplay = 10;
+    YoriLibInitializeListHead(&TailContext.FollowList);
+    YoriLibInitializeListHead(&TailContext.DirectoryList);
     ContextLine = -1;
 
     for (i = 1; i < ArgC; i++) {
@@ -488,7 +1455,13 @@ ENTRYPOINT(
             return EXIT_FAILURE;
         }
 
-        TailProcessStream(GetStdHandle(STD_INPUT_HANDLE), &TailContext);
+        TailContext.FilesFound++;
+        LineContext = NULL;
+        TailProcessStream(GetStdHandle(STD_INPUT_HANDLE), &TailContext, &LineContext);
+        if (TailContext.WaitForMore) {
+            TailFollowStream(GetStdHandle(STD_INPUT_HANDLE), &TailContext, &LineContext);
+        }
+        YoriLibLineReadClose(LineContext);
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
         if (TailContext.Recursive) {
@@ -523,6 +1496,11 @@ ENTRYPOINT(
                 }
             }
         }
+
+        if (TailContext.FollowCount > 0) {
+            TailFollowFiles(&TailContext);
+            TailCleanupFollowList(&TailContext);
+        }
     }
 
     for (Count = 0; Count < TailContext.LinesToDisplay; Count++) {
@@ -53,6 +53,103 @@ TeeHelp()
     return TRUE;
 }
 
+/**
+ The size of each read from the input when copying data without decoding
+ it.
+ */
+#define TEE_BUFFER_SIZE (1024 * 1024)
+
+/**
+ The size of each buffer written to every destination.  Each byte of input
+ can become at most two bytes of output when line endings are converted,
+ and any bytes held back while checking for a byte order mark, along with
+ a final line ending, may be added.
+ */
+#define TEE_OUTPUT_BUFFER_SIZE (TEE_BUFFER_SIZE * 2 + sizeof(TeeUtf8Bom) + 2)
+
+/**
+ The byte order mark which is removed from the start of UTF-8 input.
+ */
+const UCHAR TeeUtf8Bom[] = { 0xEF, 0xBB, 0xBF };
+
+/**
+ The number of buffers used when copying data without interpreting it.
+ With two buffers, input can be read into one while the previous one is
+ being written.
+ */
+#define TEE_BUFFER_COUNT (2)
+
+/**
+ The number of destinations that data is written to: standard output and
+ the file.
+ */
+#define TEE_DESTINATION_COUNT (2)
+
+/**
+ A buffer of data read from the input which is written to every
+ destination.
+ */
+typedef struct _TEE_BUFFER {
+
+    /**
+     The data read from the input.
+     */
+    PUCHAR Data;
+
+    /**
+     The number of bytes of data in the buffer.  Zero indicates the end of
+     input.
+     */
+    DWORD BytesPopulated;
+
+    /**
+     The number of destinations which have not yet written this buffer.
+     */
+    LONG WritesOutstanding;
+
+    /**
+     An event which is signalled when every destination has written this
+     buffer so that it can be reused for more input.
+     */
+    HANDLE FreeEvent;
+
+} TEE_BUFFER, *PTEE_BUFFER;
+
+/**
+ A target which receives a copy of all input.
+ */
+typedef struct _TEE_DESTINATION {
+
+    /**
+     Handle to the stream to write data to.
+     */
+    HANDLE hTarget;
+
+    /**
+     A thread which writes buffers to this destination.
+     */
+    HANDLE hThread;
+
+    /**
+     A semaphore which counts buffers that are ready to be written to this
+     destination.
+     */
+    HANDLE DataReady;
+
+    /**
+     Pointer to the array of buffers shared by all destinations.
+     */
+    PTEE_BUFFER Buffers;
+
+    /**
+     Set to TRUE if a write to this destination has failed.  Once this
+     happens, buffers are no longer written to it, but it continues to
+     release them so other destinations are not affected.
+     */
+    BOOL WriteFailed;
+
+} TEE_DESTINATION, *PTEE_DESTINATION;
+
 /**
  Context passed to the callback which is invoked for each source stream
  processed.
@@ -65,6 +162,47 @@ typedef struct _TEE_CONTEXT {
      */
     HANDLE hFile;
 
+    /**
+     Buffers shared by all destinations when copying data without
+     interpreting it.
+     */
+    TEE_BUFFER Buffers[TEE_BUFFER_COUNT];
+
+    /**
+     The destinations to write to when copying data without interpreting it.
+     */
+    TEE_DESTINATION Destinations[TEE_DESTINATION_COUNT];
+
+    /**
+     A buffer to read input into before its line endings are converted
+     into one of the shared buffers.
+     */
+    PUCHAR ReadBuffer;
+
+    /**
+     The number of bytes at the start of input which match a UTF-8 byte
+     order mark and have not yet been written.
+     */
+    DWORD BomBytesMatched;
+
+    /**
+     Set to TRUE once the start of input has been checked for a byte order
+     mark.
+     */
+    BOOLEAN BomChecked;
+
+    /**
+     Set to TRUE if the previous byte was a carriage return, so a following
+     line feed is part of the same line ending.
+     */
+    BOOLEAN SkipLf;
+
+    /**
+     Set to TRUE if data has been written since the last line ending, so a
+     line ending needs to be added at the end of input.
+     */
+    BOOLEAN LineOpen;
+
 } TEE_CONTEXT, *PTEE_CONTEXT;
 
 /**
@@ -109,6 +247,350 @@ TeeProcessStream(
     return TRUE;
 }
 
+/**
+ A thread which writes each buffer of input to a single destination as it
+ becomes available.  Each destination has its own thread so that a slow
+ destination does not prevent a faster one from being written to, and a
+ failed destination does not prevent others from being written to.
+
+ @param Context Pointer to the destination.
+
+ @return Zero to indicate every buffer was written, nonzero to indicate a
+         failure.
+ */
+DWORD WINAPI
+TeeDestinationWriter(
+    __in LPVOID Context
+    )
+{
+    PTEE_DESTINATION Destination;
+    PTEE_BUFFER Buffer;
+    DWORD BufferIndex;
+    DWORD BytesWritten;
+    DWORD BytesSent;
+    BOOL EndOfInput;
+
+    Destination = (PTEE_DESTINATION)Context;
+    BufferIndex = 0;
+
+    while (TRUE) {
+        WaitForSingleObject(Destination->DataReady, INFINITE);
+
+        Buffer = &Destination->Buffers[BufferIndex];
+        EndOfInput = (Buffer->BytesPopulated == 0);
+
+        BytesSent = 0;
+        while (!Destination->WriteFailed && BytesSent < Buffer->BytesPopulated) {
+            if (!WriteFile(Destination->hTarget,
+                           YoriLibAddToPointer(Buffer->Data, BytesSent),
+                           Buffer->BytesPopulated - BytesSent,
+                           &BytesWritten,
+                           NULL)) {
+
+                Destination->WriteFailed = TRUE;
+                break;
+            }
+            BytesSent += BytesWritten;
+        }
+
+        if (InterlockedDecrement(&Buffer->WritesOutstanding) == 0) {
+            SetEvent(Buffer->FreeEvent);
+        }
+
+        if (EndOfInput) {
+            break;
+        }
+
+        BufferIndex = (BufferIndex + 1) % TEE_BUFFER_COUNT;
+    }
+
+    if (Destination->WriteFailed) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ Free the buffers and destinations used when copying data without
+ interpreting it.  Any writer threads must have terminated before calling
+ this function.
+
+ @param TeeContext Pointer to the context for the operation.
+ */
+VOID
+TeeCleanupRawCopy(
+    __in PTEE_CONTEXT TeeContext
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < TEE_DESTINATION_COUNT; Index++) {
+        if (TeeContext->Destinations[Index].hThread != NULL) {
+            CloseHandle(TeeContext->Destinations[Index].hThread);
+            TeeContext->Destinations[Index].hThread = NULL;
+        }
+        if (TeeContext->Destinations[Index].DataReady != NULL) {
+            CloseHandle(TeeContext->Destinations[Index].DataReady);
+            TeeContext->Destinations[Index].DataReady = NULL;
+        }
+    }
+
+    for (Index = 0; Index < TEE_BUFFER_COUNT; Index++) {
+        if (TeeContext->Buffers[Index].FreeEvent != NULL) {
+            CloseHandle(TeeContext->Buffers[Index].FreeEvent);
+            TeeContext->Buffers[Index].FreeEvent = NULL;
+        }
+        if (TeeContext->Buffers[Index].Data != NULL) {
+            YoriLibFree(TeeContext->Buffers[Index].Data);
+            TeeContext->Buffers[Index].Data = NULL;
+        }
+    }
+
+    if (TeeContext->ReadBuffer != NULL) {
+        YoriLibFree(TeeContext->ReadBuffer);
+        TeeContext->ReadBuffer = NULL;
+    }
+}
+
+/**
+ Convert a block of input into the form that processing it by line would
+ write.  Any UTF-8 byte order mark at the start of input is removed, every
+ line ending, whether a carriage return, line feed, or both, is written as
+ a carriage return line feed pair, and at the end of input a line ending is
+ added if the final line did not have one.  Because the line endings and
+ byte order mark can span reads, state is carried in the context between
+ calls.
+
+ @param TeeContext Pointer to the context for the operation.
+
+ @param Input Pointer to the input data.
+
+ @param InputLength The number of bytes in Input.  Zero indicates the end
+        of input.
+
+ @param Output Pointer to a buffer of TEE_OUTPUT_BUFFER_SIZE bytes to
+        receive the converted data.
+
+ @return The number of bytes written to Output.
+ */
+DWORD
+TeeConvertBuffer(
+    __in PTEE_CONTEXT TeeContext,
+    __in PUCHAR Input,
+    __in DWORD InputLength,
+    __out PUCHAR Output
+    )
+{
+    DWORD Index;
+    DWORD OutputLength;
+    UCHAR ThisChar;
+
+    OutputLength = 0;
+
+    for (Index = 0; Index < InputLength; Index++) {
+        ThisChar = Input[Index];
+
+        if (!TeeContext->BomChecked) {
+            if (YoriLibGetMultibyteInputEncoding() == CP_UTF8 &&
+                ThisChar == TeeUtf8Bom[TeeContext->BomBytesMatched]) {
+
+                TeeContext->BomBytesMatched++;
+                if (TeeContext->BomBytesMatched == sizeof(TeeUtf8Bom)) {
+                    TeeContext->BomBytesMatched = 0;
+                    TeeContext->BomChecked = TRUE;
+                }
+                continue;
+            }
+
+            if (TeeContext->BomBytesMatched > 0) {
+                memcpy(&Output[OutputLength], TeeUtf8Bom, TeeContext->BomBytesMatched);
+                OutputLength += TeeContext->BomBytesMatched;
+                TeeContext->BomBytesMatched = 0;
+                TeeContext->LineOpen = TRUE;
+            }
+            TeeContext->BomChecked = TRUE;
+        }
+
+        if (ThisChar == '\r' || ThisChar == '\n') {
+            if (ThisChar == '\n' && TeeContext->SkipLf) {
+                TeeContext->SkipLf = FALSE;
+                continue;
+            }
+            Output[OutputLength++] = '\r';
+            Output[OutputLength++] = '\n';
+            TeeContext->SkipLf = (BOOLEAN)(ThisChar == '\r');
+            TeeContext->LineOpen = FALSE;
+        } else {
+            Output[OutputLength++] = ThisChar;
+            TeeContext->SkipLf = FALSE;
+            TeeContext->LineOpen = TRUE;
+        }
+    }
+
+    if (InputLength == 0) {
+        if (TeeContext->BomBytesMatched > 0) {
+            memcpy(&Output[OutputLength], TeeUtf8Bom, TeeContext->BomBytesMatched);
+            OutputLength += TeeContext->BomBytesMatched;
+            TeeContext->BomBytesMatched = 0;
+            TeeContext->LineOpen = TRUE;
+        }
+        if (TeeContext->LineOpen) {
+            Output[OutputLength++] = '\r';
+            Output[OutputLength++] = '\n';
+            TeeContext->LineOpen = FALSE;
+        }
+    }
+
+    return OutputLength;
+}
+
+/**
+ Copy a single stream to standard output and the file without decoding its
+ contents.  Input is read into large buffers while previously read buffers
+ are written to each destination by a thread for that destination.  Line
+ endings and any byte order mark are converted to match what processing
+ the input by line would write, so this can only be used when the input
+ and output encodings match and are not UTF-16.
+
+ @param hSource Handle to the source.
+
+ @param TeeContext Pointer to the context for the operation, including a
+        handle to the output stream to write data to.
+
+ @return TRUE to indicate the copy was performed, FALSE if resources for it
+         could not be allocated and no data has been consumed.
+ */
+BOOL
+TeeCopyStreamRaw(
+    __in HANDLE hSource,
+    __in PTEE_CONTEXT TeeContext
+    )
+{
+    PTEE_BUFFER Buffer;
+    HANDLE Threads[TEE_DESTINATION_COUNT];
+    DWORD BufferIndex;
+    DWORD BytesRead;
+    DWORD BytesPopulated;
+    DWORD ThreadId;
+    DWORD Index;
+    BOOL EndOfInput;
+
+    TeeContext->ReadBuffer = YoriLibMalloc(TEE_BUFFER_SIZE);
+    if (TeeContext->ReadBuffer == NULL) {
+        return FALSE;
+    }
+    TeeContext->BomBytesMatched = 0;
+    TeeContext->BomChecked = FALSE;
+    TeeContext->SkipLf = FALSE;
+    TeeContext->LineOpen = FALSE;
+
+    for (Index = 0; Index < TEE_BUFFER_COUNT; Index++) {
+        Buffer = &TeeContext->Buffers[Index];
+        Buffer->Data = YoriLibMalloc(TEE_OUTPUT_BUFFER_SIZE);
+        Buffer->FreeEvent = CreateEvent(NULL, FALSE, TRUE, NULL);
+        if (Buffer->Data == NULL || Buffer->FreeEvent == NULL) {
+            TeeCleanupRawCopy(TeeContext);
+            return FALSE;
+        }
+    }
+
+    TeeContext->Destinations[0].hTarget = GetStdHandle(STD_OUTPUT_HANDLE);
+    TeeContext->Destinations[1].hTarget = TeeContext->hFile;
+
+    for (Index = 0; Index < TEE_DESTINATION_COUNT; Index++) {
+        TeeContext->Destinations[Index].Buffers = TeeContext->Buffers;
+        TeeContext->Destinations[Index].DataReady = CreateSemaphore(NULL, 0, TEE_BUFFER_COUNT, NULL);
+        if (TeeContext->Destinations[Index].DataReady == NULL) {
+            TeeCleanupRawCopy(TeeContext);
+            return FALSE;
+        }
+    }
+
+    for (Index = 0; Index < TEE_DESTINATION_COUNT; Index++) {
+        TeeContext->Destinations[Index].hThread = CreateThread(NULL, 0, TeeDestinationWriter, &TeeContext->Destinations[Index], 0, &ThreadId);
+        if (TeeContext->Destinations[Index].hThread == NULL) {
+
+            //
+            //  Tell any threads that have started that input has ended,
+            //  and wait for them before tearing down.
+            //
+
+            if (Index > 0) {
+                Buffer = &TeeContext->Buffers[0];
+                Buffer->BytesPopulated = 0;
+                Buffer->WritesOutstanding = Index;
+                for (BufferIndex = 0; BufferIndex < Index; BufferIndex++) {
+                    ReleaseSemaphore(TeeContext->Destinations[BufferIndex].DataReady, 1, NULL);
+                }
+                WaitForMultipleObjects(Index, Threads, TRUE, INFINITE);
+            }
+            TeeCleanupRawCopy(TeeContext);
+            return FALSE;
+        }
+        Threads[Index] = TeeContext->Destinations[Index].hThread;
+    }
+
+    BufferIndex = 0;
+    EndOfInput = FALSE;
+    while (TRUE) {
+
+        //
+        //  A failed read indicates the end of input, typically because the
+        //  writing end of a pipe has been closed.
+        //
+
+        BytesRead = 0;
+        if (!EndOfInput) {
+            if (!ReadFile(hSource, TeeContext->ReadBuffer, TEE_BUFFER_SIZE, &BytesRead, NULL) ||
+                YoriLibIsOperationCancelled()) {
+
+                BytesRead = 0;
+            }
+            if (BytesRead == 0) {
+                EndOfInput = TRUE;
+            }
+        }
+
+        Buffer = &TeeContext->Buffers[BufferIndex];
+        WaitForSingleObject(Buffer->FreeEvent, INFINITE);
+
+        //
+        //  An empty buffer tells each destination to stop, so if input
+        //  was consumed without generating any output, such as a byte
+        //  order mark, keep the buffer and read more.
+        //
+
+        BytesPopulated = TeeConvertBuffer(TeeContext, TeeContext->ReadBuffer, BytesRead, Buffer->Data);
+        if (BytesPopulated == 0 && !EndOfInput) {
+            SetEvent(Buffer->FreeEvent);
+            continue;
+        }
+
+        Buffer->BytesPopulated = BytesPopulated;
+        Buffer->WritesOutstanding = TEE_DESTINATION_COUNT;
+        for (Index = 0; Index < TEE_DESTINATION_COUNT; Index++) {
+            ReleaseSemaphore(TeeContext->Destinations[Index].DataReady, 1, NULL);
+        }
+
+        //
+        //  Stop once an empty buffer has been handed out.  If the end of
+        //  input generated a final line ending, loop again to hand out an
+        //  empty buffer.
+        //
+
+        if (BytesPopulated == 0) {
+            break;
+        }
+
+        BufferIndex = (BufferIndex + 1) % TEE_BUFFER_COUNT;
+    }
+
+    WaitForMultipleObjects(TEE_DESTINATION_COUNT, Threads, TRUE, INFINITE);
+    TeeCleanupRawCopy(TeeContext);
+    return TRUE;
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the tee builtin command.
@@ -144,6 +626,7 @@ ENTRYPOINT(
     TEE_CONTEXT TeeContext;
     YORI_STRING FileName;
     YORI_STRING Arg;
+    DWORD ConsoleMode;
 
     ZeroMemory(&TeeContext, sizeof(TeeContext));
 
@@ -219,7 +702,21 @@ ENTRYPOINT(
         return EXIT_FAILURE;
     }
 
-    TeeProcessStream(GetStdHandle(STD_INPUT_HANDLE), &TeeContext);
+    //
+    //  If output is not to a console and no encoding conversion is needed,
+    //  copy data without decoding it, which allows large buffers to be
+    //  written to each destination independently.  Otherwise, process the
+    //  input by line.  UTF-16 input is always processed by line, since
+    //  line endings are only converted for byte oriented encodings.
+    //
+
+    if (GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &ConsoleMode) ||
+        YoriLibGetMultibyteInputEncoding() != YoriLibGetMultibyteOutputEncoding() ||
+        YoriLibGetMultibyteInputEncoding() == CP_UTF16 ||
+        !TeeCopyStreamRaw(GetStdHandle(STD_INPUT_HANDLE), &TeeContext)) {
+
+        TeeProcessStream(GetStdHandle(STD_INPUT_HANDLE), &TeeContext);
+    }
 
     CloseHandle(TeeContext.hFile);
     YoriLibFreeStringContents(&FileName);
@@ -38,7 +38,13 @@ CHAR strTimeThisHelpText[] =
         "\n"
         "Runs a child program and times its execution.\n"
         "\n"
-        "TIMETHIS [-license] [-f <fmt>] <command>\n"
+        "TIMETHIS [-license] [-f <fmt>] [-n <runs>] [-o csv|json] [-w <runs>]\n"
+        "    <command>\n"
+        "\n"
+        "   -f <fmt>       Display the results of a single run with a format string\n"
+        "   -n <runs>      Execute the command <runs> times and display statistics\n"
+        "   -o csv|json    Display statistics in CSV or JSON form\n"
+        "   -w <runs>      Execute the command <runs> times before measuring\n"
         "\n"
         "Format specifiers are:\n"
         "   $CHILDCPU$         Amount of CPU time used by the child process\n"
@@ -49,12 +55,20 @@ CHAR strTimeThisHelpText[] =
         "   $CHILDUSERMS$      Amount of user time used by the child process in ms\n"
         "   $ELAPSEDTIME$      Amount of time taken to execute the child process\n"
         "   $ELAPSEDTIMEMS$    Amount of time taken to execute the child process in ms\n"
+        "   $PEAKWORKINGSET$   Peak working set of the child process in Kb\n"
         "   $TREECPU$          Amount of CPU time used by all child processes\n"
         "   $TREECPUMS$        Amount of CPU time used by all child processes in ms\n"
         "   $TREEKERNEL$       Amount of kernel time used by all child processes\n"
         "   $TREEKERNELMS$     Amount of kernel time used by all child processes in ms\n"
+        "   $TREEPAGEFAULTS$   Number of page faults taken by all child processes\n"
+        "   $TREEPEAKCOMMIT$   Peak memory committed by all child processes in Kb\n"
+        "   $TREEPROCESSES$    Number of child processes\n"
+        "   $TREEREADBYTES$    Number of bytes read by all child processes\n"
+        "   $TREEREADOPS$      Number of read operations by all child processes\n"
         "   $TREEUSER$         Amount of user time used by all child processes\n"
-        "   $TREEUSERMS$       Amount of user time used by all child processes in ms\n";
+        "   $TREEUSERMS$       Amount of user time used by all child processes in ms\n"
+        "   $TREEWRITEBYTES$   Number of bytes written by all child processes\n"
+        "   $TREEWRITEOPS$     Number of write operations by all child processes\n";
 
 /**
  Display usage text to the user.
@@ -190,6 +204,32 @@ typedef struct _TIMETHIS_CONTEXT {
      Amount of time taken to execute the child process.
      */
     LARGE_INTEGER WallTimeInMs;
+
+    /**
+     The peak working set of the immediate child process, in bytes.
+     */
+    LARGE_INTEGER PeakWorkingSet;
+
+    /**
+     The peak amount of memory committed by the child process tree, in
+     bytes.
+     */
+    LARGE_INTEGER PeakCommitTree;
+
+    /**
+     The number of page faults taken by the child process tree.
+     */
+    LARGE_INTEGER PageFaultsTree;
+
+    /**
+     The number of processes in the child process tree.
+     */
+    LARGE_INTEGER ProcessesTree;
+
+    /**
+     The IO performed by the child process tree.
+     */
+    YORI_IO_COUNTERS IoCountersTree;
 } TIMETHIS_CONTEXT, *PTIMETHIS_CONTEXT;
 
 /**
@@ -216,6 +256,7 @@ TimeThisExpandVariables(
     )
 {
     LARGE_INTEGER CpuTime;
+    LARGE_INTEGER Value;
     PTIMETHIS_CONTEXT TimeThisContext = (PTIMETHIS_CONTEXT)Context;
 
     if (YoriLibCompareStringWithLiteral(VariableName, _T("CHILDCPU")) == 0) {
@@ -236,6 +277,9 @@ TimeThisExpandVariables(
         return TimeThisOutputTimestamp(TimeThisContext->WallTimeInMs, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("ELAPSEDTIMEMS")) == 0) {
         return TimeThisOutputLargeInteger(TimeThisContext->WallTimeInMs, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("PEAKWORKINGSET")) == 0) {
+        Value.QuadPart = TimeThisContext->PeakWorkingSet.QuadPart / 1024;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREECPU")) == 0) {
         CpuTime.QuadPart = TimeThisContext->KernelTimeTreeInMs.QuadPart + TimeThisContext->UserTimeTreeInMs.QuadPart;
         return TimeThisOutputTimestamp(CpuTime, OutputBuffer);
@@ -246,14 +290,573 @@ TimeThisExpandVariables(
         return TimeThisOutputTimestamp(TimeThisContext->KernelTimeTreeInMs, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEKERNELMS")) == 0) {
         return TimeThisOutputLargeInteger(TimeThisContext->KernelTimeTreeInMs, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEPAGEFAULTS")) == 0) {
+        return TimeThisOutputLargeInteger(TimeThisContext->PageFaultsTree, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEPEAKCOMMIT")) == 0) {
+        Value.QuadPart = TimeThisContext->PeakCommitTree.QuadPart / 1024;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEPROCESSES")) == 0) {
+        return TimeThisOutputLargeInteger(TimeThisContext->ProcessesTree, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEREADBYTES")) == 0) {
+        Value.QuadPart = TimeThisContext->IoCountersTree.ReadBytes;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEREADOPS")) == 0) {
+        Value.QuadPart = TimeThisContext->IoCountersTree.ReadOperations;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEUSER")) == 0) {
         return TimeThisOutputTimestamp(TimeThisContext->UserTimeTreeInMs, OutputBuffer);
     } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEUSERMS")) == 0) {
         return TimeThisOutputLargeInteger(TimeThisContext->UserTimeTreeInMs, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEWRITEBYTES")) == 0) {
+        Value.QuadPart = TimeThisContext->IoCountersTree.WriteBytes;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
+    } else if (YoriLibCompareStringWithLiteral(VariableName, _T("TREEWRITEOPS")) == 0) {
+        Value.QuadPart = TimeThisContext->IoCountersTree.WriteOperations;
+        return TimeThisOutputLargeInteger(Value, 10, OutputBuffer);
+    }
+    return 0;
+}
+
+/**
+ Execute the child process once and collect information about its
+ execution.
+
+ @param CmdLine Pointer to the command line of the child process.
+
+ @param TimeThisContext On successful completion, populated with information
+        about the execution of the child process.
+
+ @param ExitCode On successful completion, updated to contain the exit code
+        of the child process.
+
+ @return TRUE to indicate the child process was executed, FALSE if it could
+         not be launched or waiting for it was cancelled.
+ */
+__success(return)
+BOOL
+TimeThisExecuteChild(
+    __in PYORI_STRING CmdLine,
+    __out PTIMETHIS_CONTEXT TimeThisContext,
+    __out PDWORD ExitCode
+    )
+{
+    PROCESS_INFORMATION ProcessInfo;
+    STARTUPINFO StartupInfo;
+    HANDLE hJob;
+    FILETIME ftCreationTime;
+    FILETIME ftExitTime;
+    FILETIME ftKernelTime;
+    FILETIME ftUserTime;
+    LARGE_INTEGER liCreationTime;
+    LARGE_INTEGER liExitTime;
+
+    ZeroMemory(TimeThisContext, sizeof(TIMETHIS_CONTEXT));
+
+    hJob = YoriLibCreateJobObject();
+
+    memset(&StartupInfo, 0, sizeof(StartupInfo));
+    StartupInfo.cb = sizeof(StartupInfo);
+
+    if (!CreateProcess(NULL, CmdLine->StartOfString, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &StartupInfo, &ProcessInfo)) {
+        DWORD LastError = GetLastError();
+        LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("timethis: execution failed: %s"), ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        if (hJob != NULL) {
+            CloseHandle(hJob);
+        }
+        return FALSE;
+    }
+
+    if (hJob != NULL) {
+        YoriLibAssignProcessToJobObject(hJob, ProcessInfo.hProcess);
+    }
+
+    ResumeThread(ProcessInfo.hThread);
+
+    //
+    //  Wait for the immediate child process to terminate.
+    //
+
+#if YORI_BUILTIN
+    {
+        HANDLE HandleArray[2];
+        DWORD WaitResult;
+
+        YoriLibCancelEnable();
+        HandleArray[1] = YoriLibCancelGetEvent();
+        HandleArray[0] = ProcessInfo.hProcess;
+
+        WaitResult = WaitForMultipleObjects(2, HandleArray, FALSE, INFINITE);
+
+        //
+        //  If cancelled, abort
+        //
+
+        if (WaitResult == WAIT_OBJECT_0 + 1) {
+            CloseHandle(ProcessInfo.hProcess);
+            CloseHandle(ProcessInfo.hThread);
+            if (hJob != NULL) {
+                CloseHandle(hJob);
+            }
+
+            return FALSE;
+        }
+    }
+#else
+    WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+#endif
+    GetExitCodeProcess(ProcessInfo.hProcess, ExitCode);
+
+    //
+    //  Save off times from the child process.
+    //
+
+    GetProcessTimes(ProcessInfo.hProcess, &ftCreationTime, &ftExitTime, &ftKernelTime, &ftUserTime);
+
+    liCreationTime.HighPart = ftCreationTime.dwHighDateTime;
+    liCreationTime.LowPart = ftCreationTime.dwLowDateTime;
+    liExitTime.HighPart = ftExitTime.dwHighDateTime;
+    liExitTime.LowPart = ftExitTime.dwLowDateTime;
+    TimeThisContext->KernelTimeInMs.HighPart = ftKernelTime.dwHighDateTime;
+    TimeThisContext->KernelTimeInMs.LowPart = ftKernelTime.dwLowDateTime;
+    TimeThisContext->KernelTimeInMs.QuadPart = TimeThisContext->KernelTimeInMs.QuadPart / (10 * 1000);
+    TimeThisContext->UserTimeInMs.HighPart = ftUserTime.dwHighDateTime;
+    TimeThisContext->UserTimeInMs.LowPart = ftUserTime.dwLowDateTime;
+    TimeThisContext->UserTimeInMs.QuadPart = TimeThisContext->UserTimeInMs.QuadPart / (10 * 1000);
+
+    TimeThisContext->WallTimeInMs.QuadPart = (liExitTime.QuadPart - liCreationTime.QuadPart) / (10 * 1000);
+
+    //
+    //  Save off memory usage from the child process.
+    //
+
+    if (DllNtDll.pNtQueryInformationProcess != NULL) {
+        PROCESS_VM_COUNTERS VmInfo;
+        DWORD dwBytesReturned;
+        LONG Status;
+
+        Status = DllNtDll.pNtQueryInformationProcess(ProcessInfo.hProcess, ProcessVmCounters, &VmInfo, sizeof(VmInfo), &dwBytesReturned);
+        if (Status == 0) {
+            TimeThisContext->PeakWorkingSet.QuadPart = VmInfo.PeakWorkingSetSize;
+            TimeThisContext->PeakCommitTree.QuadPart = VmInfo.PeakCommitUsage;
+        }
+    }
+
+    //
+    //  Save off times, memory and IO from all processes within the job, if
+    //  it exists.  Note that currently we're not waiting for all processes
+    //  within the job to terminate.
+    //
+
+    TimeThisContext->KernelTimeTreeInMs.QuadPart = TimeThisContext->KernelTimeInMs.QuadPart;
+    TimeThisContext->UserTimeTreeInMs.QuadPart = TimeThisContext->UserTimeInMs.QuadPart;
+    TimeThisContext->ProcessesTree.QuadPart = 1;
+
+    if (hJob != NULL) {
+        YORI_JOB_BASIC_AND_IO_ACCOUNTING_INFORMATION JobInfo;
+        YORI_JOB_EXTENDED_LIMIT_INFORMATION LimitInfo;
+        DWORD BytesReturned;
+
+        if (DllKernel32.pQueryInformationJobObject != NULL &&
+            DllKernel32.pQueryInformationJobObject(hJob, 8, &JobInfo, sizeof(JobInfo), &BytesReturned)) {
+
+            TimeThisContext->KernelTimeTreeInMs.QuadPart = JobInfo.BasicInfo.TotalKernelTime.QuadPart / (10 * 1000);
+            TimeThisContext->UserTimeTreeInMs.QuadPart = JobInfo.BasicInfo.TotalUserTime.QuadPart / (10 * 1000);
+            TimeThisContext->PageFaultsTree.QuadPart = JobInfo.BasicInfo.TotalPageFaultCount;
+            TimeThisContext->ProcessesTree.QuadPart = JobInfo.BasicInfo.TotalProcesses;
+            memcpy(&TimeThisContext->IoCountersTree, &JobInfo.IoInfo, sizeof(YORI_IO_COUNTERS));
+        }
+
+        if (DllKernel32.pQueryInformationJobObject != NULL &&
+            DllKernel32.pQueryInformationJobObject(hJob, 9, &LimitInfo, sizeof(LimitInfo), &BytesReturned)) {
+
+            TimeThisContext->PeakCommitTree.QuadPart = LimitInfo.PeakJobMemoryUsed;
+        }
+        CloseHandle(hJob);
+    }
+
+    CloseHandle(ProcessInfo.hProcess);
+    CloseHandle(ProcessInfo.hThread);
+
+    return TRUE;
+}
+
+/**
+ A list of values that are recorded for each execution of the child process
+ when displaying statistics.
+ */
+typedef enum _TIMETHIS_METRIC {
+    TimeThisMetricElapsed = 0,
+    TimeThisMetricChildCpu,
+    TimeThisMetricTreeCpu,
+    TimeThisMetricTreeKernel,
+    TimeThisMetricTreeUser,
+    TimeThisMetricPeakWorkingSet,
+    TimeThisMetricTreePeakCommit,
+    TimeThisMetricTreePageFaults,
+    TimeThisMetricTreeReadOps,
+    TimeThisMetricTreeWriteOps,
+    TimeThisMetricTreeReadBytes,
+    TimeThisMetricTreeWriteBytes,
+    TimeThisMetricMax
+} TIMETHIS_METRIC;
+
+/**
+ The name of each metric when displayed in CSV or JSON form.
+ */
+CONST LPCTSTR TimeThisMetricNames[TimeThisMetricMax] = {
+    _T("elapsedms"),
+    _T("childcpums"),
+    _T("treecpums"),
+    _T("treekernelms"),
+    _T("treeuserms"),
+    _T("peakworkingsetkb"),
+    _T("treepeakcommitkb"),
+    _T("treepagefaults"),
+    _T("treereadops"),
+    _T("treewriteops"),
+    _T("treereadbytes"),
+    _T("treewritebytes")
+};
+
+/**
+ The description of each metric when displayed in a table.
+ */
+CONST LPCTSTR TimeThisMetricDescriptions[TimeThisMetricMax] = {
+    _T("Elapsed time (ms)"),
+    _T("Child CPU time (ms)"),
+    _T("Tree CPU time (ms)"),
+    _T("Tree kernel time (ms)"),
+    _T("Tree user time (ms)"),
+    _T("Peak working set (Kb)"),
+    _T("Tree peak commit (Kb)"),
+    _T("Tree page faults"),
+    _T("Tree read operations"),
+    _T("Tree write operations"),
+    _T("Tree bytes read"),
+    _T("Tree bytes written")
+};
+
+/**
+ Return the value of a metric from a single execution of the child process.
+
+ @param TimeThisContext Pointer to information about the execution.
+
+ @param Metric The metric to return.
+
+ @return The value of the metric.
+ */
+LONGLONG
+TimeThisGetMetric(
+    __in PTIMETHIS_CONTEXT TimeThisContext,
+    __in TIMETHIS_METRIC Metric
+    )
+{
+    switch(Metric) {
+        case TimeThisMetricElapsed:
+            return TimeThisContext->WallTimeInMs.QuadPart;
+        case TimeThisMetricChildCpu:
+            return TimeThisContext->KernelTimeInMs.QuadPart + TimeThisContext->UserTimeInMs.QuadPart;
+        case TimeThisMetricTreeCpu:
+            return TimeThisContext->KernelTimeTreeInMs.QuadPart + TimeThisContext->UserTimeTreeInMs.QuadPart;
+        case TimeThisMetricTreeKernel:
+            return TimeThisContext->KernelTimeTreeInMs.QuadPart;
+        case TimeThisMetricTreeUser:
+            return TimeThisContext->UserTimeTreeInMs.QuadPart;
+        case TimeThisMetricPeakWorkingSet:
+            return TimeThisContext->PeakWorkingSet.QuadPart / 1024;
+        case TimeThisMetricTreePeakCommit:
+            return TimeThisContext->PeakCommitTree.QuadPart / 1024;
+        case TimeThisMetricTreePageFaults:
+            return TimeThisContext->PageFaultsTree.QuadPart;
+        case TimeThisMetricTreeReadOps:
+            return (LONGLONG)TimeThisContext->IoCountersTree.ReadOperations;
+        case TimeThisMetricTreeWriteOps:
+            return (LONGLONG)TimeThisContext->IoCountersTree.WriteOperations;
+        case TimeThisMetricTreeReadBytes:
+            return (LONGLONG)TimeThisContext->IoCountersTree.ReadBytes;
+        case TimeThisMetricTreeWriteBytes:
+            return (LONGLONG)TimeThisContext->IoCountersTree.WriteBytes;
     }
     return 0;
 }
 
+/**
+ Summary statistics describing the values of a metric across all executions
+ of the child process.
+ */
+typedef struct _TIMETHIS_STATISTICS {
+
+    /**
+     The smallest value.
+     */
+    LONGLONG Min;
+
+    /**
+     The middle value.
+     */
+    LONGLONG Median;
+
+    /**
+     The average value.
+     */
+    LONGLONG Mean;
+
+    /**
+     The value that 95% of values are less than or equal to.
+     */
+    LONGLONG P95;
+
+    /**
+     The population standard deviation of the values.
+     */
+    LONGLONG StdDev;
+} TIMETHIS_STATISTICS, *PTIMETHIS_STATISTICS;
+
+/**
+ Calculate the integer square root of a number.
+
+ @param Value The number to calculate the square root of.
+
+ @return The largest integer whose square is less than or equal to Value.
+ */
+ULONGLONG
+TimeThisSquareRoot(
+    __in ULONGLONG Value
+    )
+{
+    ULONGLONG Result;
+    ULONGLONG Bit;
+
+    Result = 0;
+    Bit = (ULONGLONG)1 << 62;
+    while (Bit > Value) {
+        Bit = Bit >> 2;
+    }
+
+    while (Bit != 0) {
+        if (Value >= Result + Bit) {
+            Value = Value - (Result + Bit);
+            Result = (Result >> 1) + Bit;
+        } else {
+            Result = Result >> 1;
+        }
+        Bit = Bit >> 2;
+    }
+
+    return Result;
+}
+
+/**
+ Calculate summary statistics for a set of values.
+
+ @param Samples Pointer to an array of values.
+
+ @param Count The number of elements in Samples.  This must be nonzero.
+
+ @param SortBuffer Pointer to an array of Count elements which is used to
+        sort the values.
+
+ @param Stats On completion, populated with summary statistics.
+ */
+VOID
+TimeThisCalculateStatistics(
+    __in_ecount(Count) PLONGLONG Samples,
+    __in DWORD Count,
+    __out_ecount(Count) PLONGLONG SortBuffer,
+    __out PTIMETHIS_STATISTICS Stats
+    )
+{
+    DWORD Index;
+    DWORD InsertIndex;
+    LONGLONG Value;
+    LONGLONG Sum;
+    LONGLONG Difference;
+    ULONGLONG MaxDifference;
+    ULONGLONG Scaled;
+    ULONGLONG Square;
+    ULONGLONG Variance;
+    ULONGLONG Remainder;
+    DWORD Shift;
+
+    ASSERT(Count > 0);
+
+    //
+    //  The number of executions is expected to be small, so an insertion
+    //  sort is sufficient.
+    //
+
+    Sum = 0;
+    for (Index = 0; Index < Count; Index++) {
+        Value = Samples[Index];
+        Sum += Value;
+        for (InsertIndex = Index; InsertIndex > 0 && SortBuffer[InsertIndex - 1] > Value; InsertIndex--) {
+            SortBuffer[InsertIndex] = SortBuffer[InsertIndex - 1];
+        }
+        SortBuffer[InsertIndex] = Value;
+    }
+
+    Stats->Min = SortBuffer[0];
+    Stats->Mean = Sum / Count;
+    if (Count % 2 == 0) {
+        Stats->Median = (SortBuffer[Count / 2 - 1] + SortBuffer[Count / 2]) / 2;
+    } else {
+        Stats->Median = SortBuffer[Count / 2];
+    }
+
+    //
+    //  Use the nearest rank method, which is the smallest value that at
+    //  least 95% of values are less than or equal to.
+    //
+
+    Index = (95 * Count + 99) / 100;
+    Stats->P95 = SortBuffer[Index - 1];
+
+    //
+    //  Byte counts can be large enough that squaring the difference from
+    //  the mean would overflow.  Find the largest difference and scale
+    //  every difference down so that its square fits in 62 bits, then
+    //  scale the result back up.
+    //
+
+    MaxDifference = 0;
+    for (Index = 0; Index < Count; Index++) {
+        Difference = Samples[Index] - Stats->Mean;
+        if (Difference < 0) {
+            Difference = -Difference;
+        }
+        if ((ULONGLONG)Difference > MaxDifference) {
+            MaxDifference = (ULONGLONG)Difference;
+        }
+    }
+
+    Shift = 0;
+    while ((MaxDifference >> Shift) >= 0x80000000) {
+        Shift++;
+    }
+
+    //
+    //  Divide each square by the count as it is accumulated so the total
+    //  cannot overflow, but carry the remainders so the result is the same
+    //  as dividing the sum.
+    //
+
+    Variance = 0;
+    Remainder = 0;
+    for (Index = 0; Index < Count; Index++) {
+        Difference = Samples[Index] - Stats->Mean;
+        if (Difference < 0) {
+            Difference = -Difference;
+        }
+        Scaled = (ULONGLONG)Difference >> Shift;
+        Square = Scaled * Scaled;
+        Variance += Square / Count;
+        Remainder += Square % Count;
+        if (Remainder >= Count) {
+            Variance += Remainder / Count;
+            Remainder = Remainder % Count;
+        }
+    }
+    Stats->StdDev = (LONGLONG)(TimeThisSquareRoot(Variance) << Shift);
+}
+
+/**
+ The form to display results in.
+ */
+typedef enum _TIMETHIS_OUTPUT_FORMAT {
+    TimeThisOutputFormatString = 0,
+    TimeThisOutputTable,
+    TimeThisOutputCsv,
+    TimeThisOutputJson
+} TIMETHIS_OUTPUT_FORMAT;
+
+/**
+ Display summary statistics for all metrics.
+
+ @param OutputFormat Specifies whether to display a table, CSV or JSON.
+
+ @param CmdLine Pointer to the command line of the child process.
+
+ @param Samples Pointer to an array of RunCount values for each metric.
+
+ @param RunCount The number of measured executions of the child process.
+
+ @param WarmupCount The number of executions of the child process which were
+        not measured.
+
+ @param SortBuffer Pointer to an array of RunCount elements which is used to
+        sort the values.
+ */
+VOID
+TimeThisDisplayStatistics(
+    __in TIMETHIS_OUTPUT_FORMAT OutputFormat,
+    __in PYORI_STRING CmdLine,
+    __in PLONGLONG Samples,
+    __in DWORD RunCount,
+    __in DWORD WarmupCount,
+    __in PLONGLONG SortBuffer
+    )
+{
+    TIMETHIS_STATISTICS Stats;
+    YORI_STRING Escaped;
+    DWORD Metric;
+    DWORD Index;
+    DWORD Length;
+
+    if (OutputFormat == TimeThisOutputTable) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\nRuns: %i, warmup runs: %i\n\n"), RunCount, WarmupCount);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-24s %12s %12s %12s %12s %12s\n"), _T(""), _T("Min"), _T("Median"), _T("Mean"), _T("P95"), _T("StdDev"));
+    } else if (OutputFormat == TimeThisOutputCsv) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("metric,runs,min,median,mean,p95,stddev\n"));
+    } else if (OutputFormat == TimeThisOutputJson) {
+
+        //
+        //  Escape the command line so that it can be included as a JSON
+        //  string.
+        //
+
+        YoriLibInitEmptyString(&Escaped);
+        if (YoriLibAllocateString(&Escaped, CmdLine->LengthInChars * 6 + 1)) {
+            Length = 0;
+            for (Index = 0; Index < CmdLine->LengthInChars; Index++) {
+                if (CmdLine->StartOfString[Index] == '"' || CmdLine->StartOfString[Index] == '\\') {
+                    Escaped.StartOfString[Length++] = '\\';
+                    Escaped.StartOfString[Length++] = CmdLine->StartOfString[Index];
+                } else if (CmdLine->StartOfString[Index] < ' ') {
+                    Length += YoriLibSPrintf(&Escaped.StartOfString[Length], _T("\\u%04x"), CmdLine->StartOfString[Index]);
+                } else {
+                    Escaped.StartOfString[Length++] = CmdLine->StartOfString[Index];
+                }
+            }
+            Escaped.LengthInChars = Length;
+        }
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("{\n  \"command\": \"%y\",\n  \"runs\": %i,\n  \"warmups\": %i,\n  \"metrics\": {\n"), &Escaped, RunCount, WarmupCount);
+        YoriLibFreeStringContents(&Escaped);
+    }
+
+    for (Metric = 0; Metric < TimeThisMetricMax; Metric++) {
+        TimeThisCalculateStatistics(&Samples[Metric * RunCount], RunCount, SortBuffer, &Stats);
+
+        if (OutputFormat == TimeThisOutputTable) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-24s %12lli %12lli %12lli %12lli %12lli\n"), TimeThisMetricDescriptions[Metric], Stats.Min, Stats.Median, Stats.Mean, Stats.P95, Stats.StdDev);
+        } else if (OutputFormat == TimeThisOutputCsv) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%s,%i,%lli,%lli,%lli,%lli,%lli\n"), TimeThisMetricNames[Metric], RunCount, Stats.Min, Stats.Median, Stats.Mean, Stats.P95, Stats.StdDev);
+        } else if (OutputFormat == TimeThisOutputJson) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("    \"%s\": { \"min\": %lli, \"median\": %lli, \"mean\": %lli, \"p95\": %lli, \"stddev\": %lli, \"samples\": ["), TimeThisMetricNames[Metric], Stats.Min, Stats.Median, Stats.Mean, Stats.P95, Stats.StdDev);
+            for (Index = 0; Index < RunCount; Index++) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%s%lli"), Index == 0?_T(""):_T(", "), Samples[Metric * RunCount + Index]);
+            }
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("] }%s\n"), Metric + 1 < TimeThisMetricMax?_T(","):_T(""));
+        }
+    }
+
+    if (OutputFormat == TimeThisOutputJson) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("  }\n}\n"));
+    }
+}
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the timethis builtin command.
@@ -287,22 +890,19 @@ ENTRYPOINT(
     BOOL ArgumentUnderstood;
     DWORD StartArg = 0;
     DWORD i;
+    DWORD RunIndex;
+    DWORD Metric;
+    DWORD RunCount;
+    DWORD WarmupCount;
+    TIMETHIS_OUTPUT_FORMAT OutputFormat;
     YORI_STRING Arg;
     YORI_STRING DisplayString;
     YORI_STRING AllocatedFormatString;
     TIMETHIS_CONTEXT TimeThisContext;
     YORI_STRING Executable;
     PYORI_STRING ChildArgs;
-    PROCESS_INFORMATION ProcessInfo;
-    STARTUPINFO StartupInfo;
-    HANDLE hJob;
-    FILETIME ftCreationTime;
-    FILETIME ftExitTime;
-    FILETIME ftKernelTime;
-    FILETIME ftUserTime;
-
-    LARGE_INTEGER liCreationTime;
-    LARGE_INTEGER liExitTime;
+    PLONGLONG Samples;
+    PLONGLONG SortBuffer;
     LPTSTR DefaultFormatString = _T("Elapsed time:      $ELAPSEDTIME$\n")
                                  _T("Child CPU time:    $CHILDCPU$\n")
                                  _T("Child kernel time: $CHILDKERNEL$\n")
@@ -313,6 +913,9 @@ ENTRYPOINT(
 
     YoriLibInitEmptyString(&AllocatedFormatString);
     YoriLibConstantString(&AllocatedFormatString, DefaultFormatString);
+    RunCount = 1;
+    WarmupCount = 0;
+    OutputFormat = TimeThisOutputFormatString;
 
     for (i = 1; i < ArgC; i++) {
 
@@ -334,6 +937,39 @@ ENTRYPOINT(
                     ArgumentUnderstood = TRUE;
                     i++;
                 }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("n")) == 0 ||
+                       YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("w")) == 0) {
+                if (ArgC > i + 1) {
+                    LONGLONG LlCount = 0;
+                    DWORD CharsConsumed = 0;
+                    if (YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlCount, &CharsConsumed) &&
+                        CharsConsumed > 0 &&
+                        LlCount >= 0) {
+
+                        if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("n")) == 0) {
+                            RunCount = (DWORD)LlCount;
+                            if (RunCount < 1) {
+                                RunCount = 1;
+                            }
+                        } else {
+                            WarmupCount = (DWORD)LlCount;
+                        }
+                        ArgumentUnderstood = TRUE;
+                        i++;
+                    }
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("o")) == 0) {
+                if (ArgC > i + 1) {
+                    if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("csv")) == 0) {
+                        OutputFormat = TimeThisOutputCsv;
+                        ArgumentUnderstood = TRUE;
+                        i++;
+                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("json")) == 0) {
+                        OutputFormat = TimeThisOutputJson;
+                        ArgumentUnderstood = TRUE;
+                        i++;
+                    }
+                }
             }
         } else {
             ArgumentUnderstood = TRUE;
@@ -351,6 +987,10 @@ ENTRYPOINT(
         return EXIT_FAILURE;
     }
 
+    if (OutputFormat == TimeThisOutputFormatString && RunCount > 1) {
+        OutputFormat = TimeThisOutputTable;
+    }
+
     ChildArgs = YoriLibMalloc((ArgC - StartArg) * sizeof(YORI_STRING));
     if (ChildArgs == NULL) {
         YoriLibFreeStringContents(&AllocatedFormatString);
@@ -383,121 +1023,66 @@ ENTRYPOINT(
 
     ASSERT(YoriLibIsStringNullTerminated(&CmdLine));
 
-    hJob = YoriLibCreateJobObject();
-
-    memset(&StartupInfo, 0, sizeof(StartupInfo));
-    StartupInfo.cb = sizeof(StartupInfo);
+    YoriLibFreeStringContents(&Executable);
+    YoriLibFree(ChildArgs);
 
-    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &StartupInfo, &ProcessInfo)) {
-        DWORD LastError = GetLastError();
-        LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("timethis: execution failed: %s"), ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        YoriLibFree(ChildArgs);
+    if (RunCount > (DWORD)-1 / (TimeThisMetricMax * sizeof(LONGLONG))) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("timethis: too many executions requested\n"));
         YoriLibFreeStringContents(&CmdLine);
-        YoriLibFreeStringContents(&Executable);
         YoriLibFreeStringContents(&AllocatedFormatString);
-        if (hJob != NULL) {
-            CloseHandle(hJob);
-        }
         return EXIT_FAILURE;
     }
 
-    if (hJob != NULL) {
-        YoriLibAssignProcessToJobObject(hJob, ProcessInfo.hProcess);
+    Samples = YoriLibMalloc(RunCount * TimeThisMetricMax * sizeof(LONGLONG));
+    SortBuffer = YoriLibMalloc(RunCount * sizeof(LONGLONG));
+    if (Samples == NULL || SortBuffer == NULL) {
+        if (Samples != NULL) {
+            YoriLibFree(Samples);
+        }
+        if (SortBuffer != NULL) {
+            YoriLibFree(SortBuffer);
+        }
+        YoriLibFreeStringContents(&CmdLine);
+        YoriLibFreeStringContents(&AllocatedFormatString);
+        return EXIT_FAILURE;
     }
 
-    ResumeThread(ProcessInfo.hThread);
-
-    YoriLibFreeStringContents(&Executable);
-    YoriLibFreeStringContents(&CmdLine);
-    YoriLibFree(ChildArgs);
-
     //
-    //  Wait for the immediate child process to terminate.
+    //  Execute any warmup runs, whose results are discarded, followed by
+    //  the runs that are measured.
     //
 
-#if YORI_BUILTIN
-    {
-        HANDLE HandleArray[2];
-        DWORD WaitResult;
-
-        YoriLibCancelEnable();
-        HandleArray[1] = YoriLibCancelGetEvent();
-        HandleArray[0] = ProcessInfo.hProcess;
-
-        WaitResult = WaitForMultipleObjects(2, HandleArray, FALSE, INFINITE);
-
-        //
-        //  If cancelled, abort
-        //
-
-        if (WaitResult == WAIT_OBJECT_0 + 1) {
-            CloseHandle(ProcessInfo.hProcess);
-            CloseHandle(ProcessInfo.hThread);
-            if (hJob != NULL) {
-                CloseHandle(hJob);
-            }
+    ExitCode = EXIT_FAILURE;
+    for (RunIndex = 0; RunIndex < WarmupCount + RunCount; RunIndex++) {
+        if (!TimeThisExecuteChild(&CmdLine, &TimeThisContext, &ExitCode)) {
+            YoriLibFree(Samples);
+            YoriLibFree(SortBuffer);
+            YoriLibFreeStringContents(&CmdLine);
             YoriLibFreeStringContents(&AllocatedFormatString);
-
             return EXIT_FAILURE;
         }
-    }
-#else
-    WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
-#endif
-    GetExitCodeProcess(ProcessInfo.hProcess, &ExitCode);
 
-    //
-    //  Save off times from the child process.
-    //
-
-    GetProcessTimes(ProcessInfo.hProcess, &ftCreationTime, &ftExitTime, &ftKernelTime, &ftUserTime);
-
-    liCreationTime.HighPart = ftCreationTime.dwHighDateTime;
-    liCreationTime.LowPart = ftCreationTime.dwLowDateTime;
-    liExitTime.HighPart = ftExitTime.dwHighDateTime;
-    liExitTime.LowPart = ftExitTime.dwLowDateTime;
-    TimeThisContext.KernelTimeInMs.HighPart = ftKernelTime.dwHighDateTime;
-    TimeThisContext.KernelTimeInMs.LowPart = ftKernelTime.dwLowDateTime;
-    TimeThisContext.KernelTimeInMs.QuadPart = TimeThisContext.KernelTimeInMs.QuadPart / (10 * 1000);
-    TimeThisContext.UserTimeInMs.HighPart = ftUserTime.dwHighDateTime;
-    TimeThisContext.UserTimeInMs.LowPart = ftUserTime.dwLowDateTime;
-    TimeThisContext.UserTimeInMs.QuadPart = TimeThisContext.UserTimeInMs.QuadPart / (10 * 1000);
-
-    TimeThisContext.WallTimeInMs.QuadPart = (liExitTime.QuadPart - liCreationTime.QuadPart) / (10 * 1000);
-
-    //
-    //  Save off times from all processes within the job, if it exists.
-    //  Note that currently we're not waiting for all processes within the
-    //  job to terminate.
-    //
-
-    TimeThisContext.KernelTimeTreeInMs.QuadPart = TimeThisContext.KernelTimeInMs.QuadPart;
-    TimeThisContext.UserTimeTreeInMs.QuadPart = TimeThisContext.UserTimeInMs.QuadPart;
-
-    if (hJob != NULL) {
-        YORI_JOB_BASIC_ACCOUNTING_INFORMATION JobInfo;
-        DWORD BytesReturned;
-
-        if (DllKernel32.pQueryInformationJobObject != NULL &&
-            DllKernel32.pQueryInformationJobObject(hJob, 1, &JobInfo, sizeof(JobInfo), &BytesReturned)) {
-
-            TimeThisContext.KernelTimeTreeInMs.QuadPart = JobInfo.TotalKernelTime.QuadPart / (10 * 1000);
-            TimeThisContext.UserTimeTreeInMs.QuadPart = JobInfo.TotalUserTime.QuadPart / (10 * 1000);
+        if (RunIndex >= WarmupCount) {
+            for (Metric = 0; Metric < TimeThisMetricMax; Metric++) {
+                Samples[Metric * RunCount + RunIndex - WarmupCount] = TimeThisGetMetric(&TimeThisContext, Metric);
+            }
         }
-        CloseHandle(hJob);
     }
 
-    CloseHandle(ProcessInfo.hProcess);
-    CloseHandle(ProcessInfo.hThread);
-
-    YoriLibInitEmptyString(&DisplayString);
-    YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, TimeThisExpandVariables, &TimeThisContext, &DisplayString);
-    if (DisplayString.StartOfString != NULL) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
-        YoriLibFreeStringContents(&DisplayString);
+    if (OutputFormat == TimeThisOutputFormatString) {
+        YoriLibInitEmptyString(&DisplayString);
+        YoriLibExpandCommandVariables(&AllocatedFormatString, '$', FALSE, TimeThisExpandVariables, &TimeThisContext, &DisplayString);
+        if (DisplayString.StartOfString != NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y"), &DisplayString);
+            YoriLibFreeStringContents(&DisplayString);
+        }
+    } else {
+        TimeThisDisplayStatistics(OutputFormat, &CmdLine, Samples, RunCount, WarmupCount, SortBuffer);
     }
+
+    YoriLibFree(Samples);
+    YoriLibFree(SortBuffer);
+    YoriLibFreeStringContents(&CmdLine);
     YoriLibFreeStringContents(&AllocatedFormatString);
 
     return ExitCode;